@@ -24,6 +24,47 @@
 
 namespace fastertransformer {
 
+static int pad_start_ids(size_t                         batch_size,
+                         std::vector<std::vector<int>>& tmp_start_ids,
+                         std::vector<int>&              tmp_start_lengths,
+                         std::vector<int>*              v_start_lengths,
+                         std::vector<int>*              v_start_ids,
+                         size_t&                        max_input_len,
+                         const int                      end_id,
+                         const int                      beam_width)
+{
+    max_input_len = tmp_start_lengths.data()[0];
+    for (uint i = 1; i < (uint)tmp_start_lengths.size(); i++) {
+        max_input_len = max_input_len > tmp_start_lengths.data()[i] ? max_input_len : tmp_start_lengths.data()[i];
+    }
+
+    while ((int)tmp_start_lengths.size() < batch_size) {
+        std::vector<int> padding_ids;
+        for (int i = 0; i < max_input_len; i++) {
+            padding_ids.push_back(end_id);
+        }
+        tmp_start_ids.push_back(padding_ids);
+        tmp_start_lengths.push_back(max_input_len);
+    }
+
+    // Add padding
+    for (int i = 0; i < (int)tmp_start_ids.size(); i++) {
+        for (int j = (int)tmp_start_ids[i].size(); j < max_input_len; j++) {
+            tmp_start_ids[i].push_back(end_id);
+        }
+    }
+
+    for (int i = 0; i < (int)tmp_start_ids.size(); i++) {
+        for (int b = 0; b < beam_width; b++) {
+            for (int j = 0; j < (int)tmp_start_ids[i].size(); j++) {
+                v_start_ids->push_back(tmp_start_ids[i][j]);
+            }
+            v_start_lengths->push_back(tmp_start_lengths[i]);
+        }
+    }
+    return batch_size;
+}
+
 int read_start_ids(size_t            batch_size,
                    std::vector<int>* v_start_lengths,
                    std::vector<int>* v_start_ids,
@@ -62,36 +103,50 @@ int read_start_ids(size_t            batch_size,
         return 0;
     }
 
-    max_input_len = tmp_start_lengths.data()[0];
-    for (uint i = 1; i < (uint)tmp_start_lengths.size(); i++) {
-        max_input_len = max_input_len > tmp_start_lengths.data()[i] ? max_input_len : tmp_start_lengths.data()[i];
-    }
+    return pad_start_ids(
+        batch_size, tmp_start_ids, tmp_start_lengths, v_start_lengths, v_start_ids, max_input_len, end_id, beam_width);
+}
 
-    while ((int)tmp_start_lengths.size() < batch_size) {
-        std::vector<int> padding_ids;
-        for (int i = 0; i < max_input_len; i++) {
-            padding_ids.push_back(end_id);
-        }
-        tmp_start_ids.push_back(padding_ids);
-        tmp_start_lengths.push_back(max_input_len);
+int read_start_texts(size_t            batch_size,
+                     std::vector<int>* v_start_lengths,
+                     std::vector<int>* v_start_ids,
+                     size_t&           max_input_len,
+                     const int         end_id,
+                     const int         beam_width,
+                     const Tokenizer&  tokenizer,
+                     std::string       file_name)
+{
+    std::vector<std::string> prompts;
+    std::ifstream            prompt_file(file_name, std::ios::in);
+    if (!prompt_file.is_open()) {
+        printf("[WARNING] Cannot open the file '%s'. \n", file_name.c_str());
+        max_input_len = 0;
+        return 0;
     }
-
-    // Add padding
-    for (int i = 0; i < (int)tmp_start_ids.size(); i++) {
-        for (int j = (int)tmp_start_ids[i].size(); j < max_input_len; j++) {
-            tmp_start_ids[i].push_back(end_id);
-        }
+    std::string line;
+    while (std::getline(prompt_file, line)) {
+        prompts.push_back(line);
+    }
+    if (prompts.empty()) {
+        max_input_len = 0;
+        return 0;
+    }
+    if (batch_size == 0) {
+        batch_size = prompts.size();
     }
 
-    for (int i = 0; i < (int)tmp_start_ids.size(); i++) {
-        for (int b = 0; b < beam_width; b++) {
-            for (int j = 0; j < (int)tmp_start_ids[i].size(); j++) {
-                v_start_ids->push_back(tmp_start_ids[i][j]);
-            }
-            v_start_lengths->push_back(tmp_start_lengths[i]);
-        }
+    std::vector<std::vector<int>> tmp_start_ids = tokenizer.encodeBatch(prompts);
+    std::vector<int>              tmp_start_lengths;
+    for (const std::vector<int>& ids : tmp_start_ids) {
+        tmp_start_lengths.push_back(ids.size());
     }
-    return batch_size;
+    return pad_start_ids(
+        batch_size, tmp_start_ids, tmp_start_lengths, v_start_lengths, v_start_ids, max_input_len, end_id, beam_width);
+}
+
+bool is_text_input(const std::string& file_name)
+{
+    return file_name.size() > 4 && file_name.compare(file_name.size() - 4, 4, ".txt") == 0;
 }
 
 model_config_t read_model_config(const INIReader& reader)
@@ -102,6 +157,8 @@ model_config_t read_model_config(const INIReader& reader)
     config.model_dir  = std::string(reader.Get("ft_instance_hyperparameter", "model_dir"));
     config.sparse     = static_cast<bool>(reader.GetInteger("ft_instance_hyperparameter", "sparse"));
     config.int8_mode  = reader.GetInteger("ft_instance_hyperparameter", "int8_mode");
+    // vocab.json and merges.txt, or tokenizer.model, for the text inputs.
+    config.tokenizer_dir = reader.Get("ft_instance_hyperparameter", "tokenizer_dir", config.model_dir);
 
     config.tensor_para_size   = reader.GetInteger("ft_instance_hyperparameter", "tensor_para_size");
     config.pipeline_para_size = reader.GetInteger("ft_instance_hyperparameter", "pipeline_para_size");
@@ -340,7 +397,8 @@ void populate_request(std::unordered_map<std::string, Tensor>& input_tensors,
                       const uint64_t&                          random_seed,
                       const std::string&                       csv_path,
                       const model_config_t&                    model_config,
-                      const request_config_t&                  request_config)
+                      const request_config_t&                  request_config,
+                      const Tokenizer*                         tokenizer)
 {
     // Read ids of request from file.
     size_t     max_input_len      = 0;
@@ -349,8 +407,20 @@ void populate_request(std::unordered_map<std::string, Tensor>& input_tensors,
     const auto request_output_len = request_config.request_output_len;
 
     std::vector<int> v_start_ids;
-    request_batch_size = read_start_ids(
-        request_batch_size, &v_start_lengths, &v_start_ids, max_input_len, model_config.end_id, 1, csv_path);
+    if (tokenizer != nullptr) {
+        request_batch_size = read_start_texts(request_batch_size,
+                                              &v_start_lengths,
+                                              &v_start_ids,
+                                              max_input_len,
+                                              model_config.end_id,
+                                              1,
+                                              *tokenizer,
+                                              csv_path);
+    }
+    else {
+        request_batch_size = read_start_ids(
+            request_batch_size, &v_start_lengths, &v_start_ids, max_input_len, model_config.end_id, 1, csv_path);
+    }
 
     if (max_input_len > 0) {
         // conditional case.
@@ -499,4 +569,36 @@ void write_output_tensors(std::unordered_map<std::string, Tensor>& output_tensor
     }
 }
 
+void write_output_texts(std::unordered_map<std::string, Tensor>& output_tensors,
+                        const Tokenizer&                         tokenizer,
+                        const int                                end_id)
+{
+    std::string file_name = "out.txt";
+    auto        out_file  = std::ofstream(file_name, std::ios::out);
+    if (!out_file.is_open()) {
+        printf("[WARNING] Cannot write results into output file %s\n", file_name.c_str());
+        return;
+    }
+    const Tensor&    output_ids       = output_tensors.at("output_ids");
+    const size_t     total_output_len = output_ids.shape[2];
+    std::vector<int> h_buf(output_ids.size());
+    cudaD2Hcpy(h_buf.data(), output_ids.getPtr<int>(), h_buf.size());
+
+    std::vector<int> ids;
+    for (size_t i = 0; i < h_buf.size(); i += total_output_len) {
+        ids.clear();
+        for (size_t j = i; j < i + total_output_len; j++) {
+            if (h_buf[j] != end_id) {
+                ids.push_back(h_buf[j]);
+            }
+        }
+        const std::string text = tokenizer.decode(ids);
+        out_file << text << std::endl;
+        if (i == 0) {
+            printf("[INFO] %s\n", text.c_str());
+        }
+    }
+    out_file.close();
+}
+
 }  // namespace fastertransformer
@@ -24,12 +24,14 @@
 #include "src/fastertransformer/utils/Tensor.h"
 #include "src/fastertransformer/utils/mpi_utils.h"
 #include "src/fastertransformer/utils/nccl_utils.h"
+#include "src/fastertransformer/utils/tokenizer.h"
 
 namespace fastertransformer {
 
 struct model_config_t {
     std::string model_name;
     std::string model_dir;
+    std::string tokenizer_dir;
     bool        sparse;
     int         int8_mode;
     int         attention_type;
@@ -121,6 +123,19 @@ int read_start_ids(size_t            batch_size,
                    const int         beam_width,
                    std::string       file_name);
 
+// Same as read_start_ids, from a file of prompts, one per line.
+int read_start_texts(size_t            batch_size,
+                     std::vector<int>* v_start_lengths,
+                     std::vector<int>* v_start_ids,
+                     size_t&           max_input_len,
+                     const int         end_id,
+                     const int         beam_width,
+                     const Tokenizer&  tokenizer,
+                     std::string       file_name);
+
+// Whether the input file holds prompts (.txt) rather than ids (.csv).
+bool is_text_input(const std::string& file_name);
+
 void populate_request(std::unordered_map<std::string, Tensor>& input_tensors,
                       std::unordered_map<std::string, Tensor>& output_tensors,
                       int*&                                    d_input_ids,
@@ -136,8 +151,13 @@ void populate_request(std::unordered_map<std::string, Tensor>& input_tensors,
                       const uint64_t&                          random_seed,
                       const std::string&                       csv_path,
                       const model_config_t&                    model_config,
-                      const request_config_t&                  request_config);
+                      const request_config_t&                  request_config,
+                      const Tokenizer*                         tokenizer = nullptr);
 
 void write_output_tensors(std::unordered_map<std::string, Tensor>& output_tensors);
+// Writes the decoded sequences to out.txt, one per line. The end_id tokens, padding included, are skipped.
+void write_output_texts(std::unordered_map<std::string, Tensor>& output_tensors,
+                        const Tokenizer&                         tokenizer,
+                        const int                                end_id);
 
 }  // namespace fastertransformer
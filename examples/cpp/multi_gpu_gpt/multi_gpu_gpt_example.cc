@@ -197,6 +197,15 @@ void multi_gpu_gpt_example(const INIReader reader, std::string in_csv)
                                         0,
                                         request_config.shared_contexts_ratio);
 
+    // A .txt input holds prompts, one per line, which are tokenized here and the outputs decoded to out.txt.
+    std::shared_ptr<Tokenizer> tokenizer;
+    if (is_text_input(in_csv)) {
+        tokenizer = Tokenizer::loadFromDirectory(model_config.tokenizer_dir);
+        FT_CHECK_WITH_INFO(tokenizer != nullptr,
+                           fmtstr("No vocab.json and merges.txt, or tokenizer.model, in tokenizer_dir %s",
+                                  model_config.tokenizer_dir.c_str()));
+    }
+
     std::unordered_map<std::string, Tensor> input_tensors;
     int*                                    d_input_ids     = nullptr;
     int*                                    d_input_lengths = nullptr;
@@ -225,7 +234,8 @@ void multi_gpu_gpt_example(const INIReader reader, std::string in_csv)
                      random_seed,
                      in_csv,
                      model_config,
-                     request_config);
+                     request_config,
+                     tokenizer.get());
     print_mem_usage();
 
     int ite = 1;
@@ -249,6 +259,9 @@ void multi_gpu_gpt_example(const INIReader reader, std::string in_csv)
 
     if (rank == 0) {
         write_output_tensors(output_tensors);
+        if (tokenizer != nullptr) {
+            write_output_texts(output_tensors, *tokenizer, model_config.end_id);
+        }
     }
     // test time
     struct timeval start, end;
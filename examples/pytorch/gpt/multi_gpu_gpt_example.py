@@ -119,6 +119,10 @@ def main():
                         help='Triggers the shared context optimization when'
                              'compact_size <= shared_contexts_ratio * batch_size'
                              'A value of 0.0 deactivate the optimization')
+    parser.add_argument('--moe_expert_parallel', action='store_true',
+                        help='Split the MoE experts across the tensor parallel ranks instead of slicing each of them.')
+    parser.add_argument('--moe_capacity_factor', type=float, default=0.0,
+                        help='The capacity factor of the experts with --moe_expert_parallel. 0 drops no token.')
     parser.add_argument('--banned_words',
         type=str,
         default="",
@@ -249,7 +253,9 @@ def main():
                           gpt_with_moe=gpt_with_moe,
                           expert_num=expert_num,
                           moe_k=moe_k,
-                          moe_layer_index=moe_layer_index)
+                          moe_layer_index=moe_layer_index,
+                          moe_expert_parallel=args.moe_expert_parallel,
+                          moe_capacity_factor=args.moe_capacity_factor)
         if not gpt.load(ckpt_path=args.ckpt_path):
             print("[WARNING] Checkpoint file not found. Model loading is skipped.")
     else:
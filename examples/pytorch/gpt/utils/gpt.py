@@ -37,8 +37,13 @@ class GPTWeights:
                  has_pre_decoder_layernorm: bool = False,
                  has_post_decoder_layernorm: bool = True,
                  int8_mode: int = 0,
-                 inter_size: int = 0):
+                 inter_size: int = 0,
+                 expert_num: int = 0,
+                 moe_expert_parallel: bool = False):
         assert(head_num % tensor_para_size == 0)
+        if moe_expert_parallel:
+            assert expert_num % tensor_para_size == 0, "expert_num must be a multiple of tensor_para_size."
+            assert int8_mode == 0, "Expert parallelism is not supported with int8_mode."
 
         if int8_mode == 1:
             torch_infer_dtype = str_type_map[inference_data_type]
@@ -60,6 +65,8 @@ class GPTWeights:
         self.has_adapters = has_adapters
         self.adapter_inter_size = adapter_inter_size
         self.gpt_with_moe = gpt_with_moe
+        self.expert_num = expert_num
+        self.moe_expert_parallel = moe_expert_parallel
         self.has_positional_encoding = has_positional_encoding
         self.has_pre_decoder_layernorm = has_pre_decoder_layernorm
         self.has_post_decoder_layernorm = has_post_decoder_layernorm
@@ -273,6 +280,26 @@ class GPTWeights:
                 return torch.from_numpy(np.fromfile(file_path, dtype=self.weights_data_type)).to(str_type_map[self.inference_data_type])
             else:
                 return torch.empty(0).to(str_type_map[self.inference_data_type])
+
+        def load_mlp_to_torch(i: int, name: str, expert_shape: typing.Tuple[int, ...], is_load: bool):
+            file_path = f"{ckpt_path}/model.layers.{i}.mlp.{name}.{tp_rank}.bin"
+            if os.path.isfile(file_path) or not self.moe_expert_parallel:
+                if not os.path.isfile(file_path):
+                    file_path = f"{ckpt_path}/model.layers.{i}.mlp.moe.experts.{name}.{tp_rank}.bin"
+                return load_to_torch(file_path, is_load)
+            if not is_load:
+                return load_to_torch(file_path, False)
+            # With expert parallelism this rank holds the whole inter_size of its own experts, so gather their
+            # inter_size slices from the files of every tensor parallel rank.
+            local_expert_num = self.expert_num // self.tensor_para_size
+            expert_begin = tp_rank * local_expert_num
+            slices = []
+            for rank in range(self.tensor_para_size):
+                val = load_to_torch(f"{ckpt_path}/model.layers.{i}.mlp.moe.experts.{name}.{rank}.bin", True)
+                val = val.reshape(self.expert_num, *expert_shape)
+                slices.append(val[expert_begin:expert_begin + local_expert_num])
+            return torch.cat(slices, dim=1 + expert_shape.index(-1)).contiguous()
+
         w.extend([load_to_torch(f"{ckpt_path}/model.layers.{i}.input_layernorm.weight.bin", is_load(i))
                  for i in range(self.layer_num)])
         w.extend([load_to_torch(f"{ckpt_path}/model.layers.{i}.input_layernorm.bias.bin", is_load(i))
@@ -289,21 +316,12 @@ class GPTWeights:
                  is_load(i)) for i in range(self.layer_num)])
         w.extend([load_to_torch(f"{ckpt_path}/model.layers.{i}.post_attention_layernorm.bias.bin",
                  is_load(i)) for i in range(self.layer_num)])
-        w.extend([load_to_torch(
-                f"{ckpt_path}/model.layers.{i}.mlp.dense_h_to_4h.weight.{tp_rank}.bin" \
-                    if os.path.isfile(f"{ckpt_path}/model.layers.{i}.mlp.dense_h_to_4h.weight.{tp_rank}.bin") \
-                        else f"{ckpt_path}/model.layers.{i}.mlp.moe.experts.dense_h_to_4h.weight.{tp_rank}.bin",
-                is_load(i)) for i in range(self.layer_num)])
-        w.extend([load_to_torch(
-                f"{ckpt_path}/model.layers.{i}.mlp.dense_h_to_4h.bias.{tp_rank}.bin" \
-                    if os.path.isfile(f"{ckpt_path}/model.layers.{i}.mlp.dense_h_to_4h.bias.{tp_rank}.bin") \
-                        else f"{ckpt_path}/model.layers.{i}.mlp.moe.experts.dense_h_to_4h.bias.{tp_rank}.bin",
-                is_load(i)) for i in range(self.layer_num)])
-        w.extend([load_to_torch(
-                f"{ckpt_path}/model.layers.{i}.mlp.dense_4h_to_h.weight.{tp_rank}.bin" \
-                    if os.path.isfile(f"{ckpt_path}/model.layers.{i}.mlp.dense_4h_to_h.weight.{tp_rank}.bin") \
-                        else f"{ckpt_path}/model.layers.{i}.mlp.moe.experts.dense_4h_to_h.weight.{tp_rank}.bin",
-                is_load(i)) for i in range(self.layer_num)])
+        w.extend([load_mlp_to_torch(i, "dense_h_to_4h.weight", (self.global_hidden_units, -1), is_load(i))
+                 for i in range(self.layer_num)])
+        w.extend([load_mlp_to_torch(i, "dense_h_to_4h.bias", (-1,), is_load(i))
+                 for i in range(self.layer_num)])
+        w.extend([load_mlp_to_torch(i, "dense_4h_to_h.weight", (-1, self.global_hidden_units), is_load(i))
+                 for i in range(self.layer_num)])
         w.extend([load_to_torch(
                 f"{ckpt_path}/model.layers.{i}.mlp.dense_4h_to_h.bias.bin" \
                     if os.path.isfile(f"{ckpt_path}/model.layers.{i}.mlp.dense_4h_to_h.bias.bin") \
@@ -462,6 +480,8 @@ class GPT(nn.Module):
                  has_adapters: bool = False,
                  adapter_inter_size: int = 0,
                  use_attention_linear_bias: bool = False,
+                 moe_expert_parallel: bool = False,
+                 moe_capacity_factor: float = 0.0,
                  int8_mode: int = 0,
                  weights_data_type: typing.Union[str, np.dtype] = np.float32,
                  shared_contexts_ratio: float = 1.0):
@@ -488,6 +508,8 @@ class GPT(nn.Module):
         self.has_adapters = has_adapters
         self.adapter_inter_size = adapter_inter_size
         self.use_attention_linear_bias = use_attention_linear_bias
+        self.moe_expert_parallel = moe_expert_parallel
+        self.moe_capacity_factor = moe_capacity_factor
 
         # multi-gpu params
         self.tensor_para_size = tensor_para_size
@@ -518,7 +540,9 @@ class GPT(nn.Module):
                                   has_adapters=self.has_adapters,
                                   adapter_inter_size=self.adapter_inter_size,
                                   int8_mode=int8_mode,
-                                  inter_size=inter_size)
+                                  inter_size=inter_size,
+                                  expert_num=self.expert_num,
+                                  moe_expert_parallel=self.moe_expert_parallel)
 
         # Prepare for tensor/pipeline parallel
         try:
@@ -45,6 +45,8 @@ class ParallelGPT(GPT):
             self.has_adapters,
             self.adapter_inter_size,
             self.use_attention_linear_bias,
+            self.moe_expert_parallel,
+            self.moe_capacity_factor,
             self.weights.w,
             self.weights.int8_w,
             self.weights.scale,
@@ -22,13 +22,13 @@
 namespace fastertransformer {
 
 template<typename T>
-__global__ void add_bias_temperature(T*          logits,
-                                     const T*    bias,
-                                     const int   batch_size,
-                                     const int   beam_width,
-                                     const int   vocab_size,
-                                     const int   vocab_size_padded,
-                                     const float temperature)
+__global__ void add_bias_temperature(T*           logits,
+                                     const T*     bias,
+                                     const int    batch_size,
+                                     const int    beam_width,
+                                     const int    vocab_size,
+                                     const int    vocab_size_padded,
+                                     const float* temperatures)
 {
     int tid  = threadIdx.x;
     int bid  = blockIdx.x;
@@ -36,8 +36,9 @@ __global__ void add_bias_temperature(T*          logits,
 
     logits += bbid * vocab_size_padded;
 
-    const T MASK_VAL = (std::is_same<T, half>::value) ? -HALF_FLT_MAX : -FLT_MAX;
-    const T inv_temp = static_cast<T>(1.0f / (temperature + 1e-6f));
+    const T     MASK_VAL    = (std::is_same<T, half>::value) ? -HALF_FLT_MAX : -FLT_MAX;
+    const float temperature = temperatures == nullptr ? 1.0f : temperatures[bbid / beam_width];
+    const T     inv_temp    = static_cast<T>(temperature == 1.0f ? 1.0f : 1.0f / (temperature + 1e-6f));
     for (int i = tid + bid * blockDim.x; i < vocab_size_padded; i += blockDim.x * gridDim.x) {
         if (i < vocab_size) {
             T bias_val = bias == nullptr ? (T)(0.0f) : bias[i];
@@ -56,7 +57,7 @@ __global__ void add_bias_temperature(half2*       logits,
                                      const int    beam_width,
                                      const int    vocab_size,
                                      const int    vocab_size_padded,
-                                     const float  temperature)
+                                     const float* temperatures)
 {
     assert(vocab_size % 2 == 0);
     assert(vocab_size_padded % 2 == 0);
@@ -65,8 +66,9 @@ __global__ void add_bias_temperature(half2*       logits,
     const int bid  = blockIdx.x;
     const int bbid = blockIdx.y;
 
-    const half2 mask_val = __float2half2_rn(-HALF_FLT_MAX);
-    const half2 inv_temp = __float2half2_rn(1.0f / (temperature + 1e-6f));
+    const float temperature = temperatures == nullptr ? 1.0f : temperatures[bbid / beam_width];
+    const half2 mask_val    = __float2half2_rn(-HALF_FLT_MAX);
+    const half2 inv_temp    = __float2half2_rn(temperature == 1.0f ? 1.0f : 1.0f / (temperature + 1e-6f));
 
     const int half_vocab_size        = vocab_size / 2;
     const int half_vocab_size_padded = vocab_size_padded / 2;
@@ -86,18 +88,18 @@ __global__ void add_bias_temperature(half2*       logits,
 }
 
 template<typename T, bool IS_ADDITIVE>
-__global__ void apply_repetition_penalty(T*          logits,
-                                         const int   batch_size,
-                                         const int   beam_width,
-                                         const int   vocab_size,
-                                         const int   vocab_size_padded,
-                                         const int   step,
-                                         const int*  current_ids,
-                                         const int*  previous_ids,
-                                         const int*  parent_ids,
-                                         const int*  input_lengths,
-                                         const int   max_input_length,
-                                         const float repetition_penalty)
+__global__ void apply_repetition_penalty(T*           logits,
+                                         const int    batch_size,
+                                         const int    beam_width,
+                                         const int    vocab_size,
+                                         const int    vocab_size_padded,
+                                         const int    step,
+                                         const int*   current_ids,
+                                         const int*   previous_ids,
+                                         const int*   parent_ids,
+                                         const int*   input_lengths,
+                                         const int    max_input_length,
+                                         const float* repetition_penalties)
 {
     assert(step > 0);
 
@@ -106,6 +108,11 @@ __global__ void apply_repetition_penalty(T*          logits,
     const int batch_id = bbid / beam_width;
     const int bbsize   = batch_size * beam_width;
 
+    const float repetition_penalty = repetition_penalties[batch_id];
+    if (repetition_penalty == (IS_ADDITIVE ? 0.0f : 1.0f)) {
+        return;
+    }
+
     logits += bbid * vocab_size_padded;
     extern __shared__ char sbuf[];
     T*                     penalty_logits = reinterpret_cast<T*>(sbuf);
@@ -155,18 +162,22 @@ __global__ void apply_repetition_penalty(T*          logits,
 
 template<typename T>
 __global__ void apply_min_length_penalty(T*         logits,
-                                         const int  min_length,
+                                         const int* min_lengths,
                                          const int* end_ids,
                                          const int* sequence_lengths,
                                          const int  max_input_length,
                                          const int  beam_width,
+                                         const int  local_batch_size,
                                          const int  vocab_size_padded)
 {
     int bbid = threadIdx.x + blockIdx.x * blockDim.x;  // batch-beam index
     int bid  = bbid / beam_width;                      // batch index
+    if (bid >= local_batch_size) {
+        return;
+    }
     // We need +1 because sequence_lengths = max_input_length + num_gen_tokens - 1,
     // which is equal to the length of k/v caches.
-    if (sequence_lengths[bbid] + 1 - max_input_length < min_length) {
+    if (sequence_lengths[bbid] + 1 - max_input_length < min_lengths[bid]) {
         T mask_val                                      = (std::is_same<T, half>::value) ? -HALF_FLT_MAX : -FLT_MAX;
         logits[bbid * vocab_size_padded + end_ids[bid]] = mask_val;
     }
@@ -189,13 +200,14 @@ void invokeAddBiasApplyPenalties(int                         step,
                                  const int                   vocab_size,
                                  const int                   vocab_size_padded,
                                  const int*                  end_ids,
-                                 const float                 temperature,
-                                 const float                 repetition_penalty,
+                                 const float*                temperatures,
+                                 const float*                repetition_penalties,
                                  const RepetitionPenaltyType repetition_penalty_type,
-                                 const int                   min_length,
+                                 const int*                  min_lengths,
+                                 const int                   max_min_length,
                                  cudaStream_t                stream)
 {
-    if (bias != nullptr || temperature != 1.0f || vocab_size != vocab_size_padded) {
+    if (bias != nullptr || temperatures != nullptr || vocab_size != vocab_size_padded) {
         dim3 block(512);
         if (std::is_same<T, half>::value && vocab_size % 2 == 0 && vocab_size_padded % 2 == 0) {
             dim3 grid((vocab_size_padded / 2 + block.x - 1) / block.x, beam_width * local_batch_size);
@@ -205,17 +217,17 @@ void invokeAddBiasApplyPenalties(int                         step,
                                                              beam_width,
                                                              vocab_size,
                                                              vocab_size_padded,
-                                                             temperature);
+                                                             temperatures);
         }
         else {
             dim3 grid((vocab_size_padded + block.x - 1) / block.x, beam_width * local_batch_size);
             add_bias_temperature<<<grid, block, 0, stream>>>(
-                logits, bias, batch_size, beam_width, vocab_size, vocab_size_padded, temperature);
+                logits, bias, batch_size, beam_width, vocab_size, vocab_size_padded, temperatures);
         }
     }
 
     if (repetition_penalty_type != RepetitionPenaltyType::None && step > 0) {
-        if (repetition_penalty != getDefaultPenaltyValue(repetition_penalty_type)) {
+        if (repetition_penalties != nullptr) {
             size_t smem_size = (sizeof(T) * step + 31) / 32 * 32 + sizeof(int) * step;
             dim3   block(256);
             dim3   grid(beam_width * local_batch_size);
@@ -235,7 +247,7 @@ void invokeAddBiasApplyPenalties(int                         step,
                                                          parent_ids + ite * beam_width * local_batch_size,
                                                          input_lengths,
                                                          max_input_length,
-                                                         repetition_penalty);
+                                                         repetition_penalties);
             }
             else if (repetition_penalty_type == RepetitionPenaltyType::Additive) {
                 apply_repetition_penalty<T, true>
@@ -250,19 +262,25 @@ void invokeAddBiasApplyPenalties(int                         step,
                                                          parent_ids + ite * beam_width * local_batch_size,
                                                          input_lengths,
                                                          max_input_length,
-                                                         repetition_penalty);
+                                                         repetition_penalties);
             }
         }
     }
 
-    if (step - max_input_length < min_length) {
+    if (min_lengths != nullptr && step - max_input_length < max_min_length) {
         FT_CHECK_WITH_INFO(sequence_lengths != nullptr, "Need sequence_lengths to apply min length penlaty");
         FT_CHECK_WITH_INFO(end_ids != nullptr, "Need end_id to apply min length penlaty");
 
         const int block_size = min(local_batch_size * beam_width, 1024);
         const int grid_size  = (local_batch_size * beam_width + block_size - 1) / block_size;
-        apply_min_length_penalty<<<grid_size, block_size, 0, stream>>>(
-            logits, min_length, end_ids, sequence_lengths, max_input_length, beam_width, vocab_size_padded);
+        apply_min_length_penalty<<<grid_size, block_size, 0, stream>>>(logits,
+                                                                       min_lengths,
+                                                                       end_ids,
+                                                                       sequence_lengths,
+                                                                       max_input_length,
+                                                                       beam_width,
+                                                                       local_batch_size,
+                                                                       vocab_size_padded);
     }
 }
 
@@ -282,10 +300,11 @@ template void invokeAddBiasApplyPenalties(int                         step,
                                           const int                   vocab_size,
                                           const int                   vocab_size_padded,
                                           const int*                  end_ids,
-                                          const float                 temperature,
-                                          const float                 repetition_penalty,
+                                          const float*                temperatures,
+                                          const float*                repetition_penalties,
                                           const RepetitionPenaltyType repetition_penalty_type,
-                                          const int                   min_length,
+                                          const int*                  min_lengths,
+                                          const int                   max_min_length,
                                           cudaStream_t                stream);
 
 template void invokeAddBiasApplyPenalties(int                         step,
@@ -304,10 +323,11 @@ template void invokeAddBiasApplyPenalties(int                         step,
                                           const int                   vocab_size,
                                           const int                   vocab_size_padded,
                                           const int*                  end_ids,
-                                          const float                 temperature,
-                                          const float                 repetition_penalty,
+                                          const float*                temperatures,
+                                          const float*                repetition_penalties,
                                           const RepetitionPenaltyType repetition_penalty_type,
-                                          const int                   min_length,
+                                          const int*                  min_lengths,
+                                          const int                   max_min_length,
                                           cudaStream_t                stream);
 
 }  // namespace fastertransformer
@@ -22,6 +22,9 @@
 
 namespace fastertransformer {
 
+// The runtime arguments are given per request, [local_batch_size] on gpu: temperatures, repetition_penalties and
+// min_lengths. A null pointer means that every request uses the default value, which skips the corresponding
+// kernel. max_min_length is the maximum of min_lengths, on cpu.
 template<typename T>
 void invokeAddBiasApplyPenalties(int                         step,
                                  T*                          logits,
@@ -39,10 +42,11 @@ void invokeAddBiasApplyPenalties(int                         step,
                                  const int                   vocab_size,
                                  const int                   vocab_size_padded,
                                  const int*                  end_ids,
-                                 const float                 temperature,
-                                 const float                 repetition_penalty,
+                                 const float*                temperatures,
+                                 const float*                repetition_penalties,
                                  const RepetitionPenaltyType repetition_penalty_type,
-                                 const int                   min_length,
+                                 const int*                  min_lengths,
+                                 const int                   max_min_length,
                                  cudaStream_t                stream);
 
 }  // namespace fastertransformer
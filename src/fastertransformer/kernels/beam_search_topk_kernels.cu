@@ -823,8 +823,10 @@ __global__ void insertUnfinishedPath(BeamHypotheses beam_hyps,
             }
             beam_hyps.sequence_lengths_tgt[tgt_beam_idx] = length;
 
+            const float length_penalty =
+                beam_hyps.length_penalties == nullptr ? beam_hyps.length_penalty : beam_hyps.length_penalties[bid];
             beam_hyps.normed_scores[tgt_beam_idx] = apply_length_penalty(
-                cum_log_probs[src_beam_idx], finished[src_beam_idx] ? length + 1 : length, beam_hyps.length_penalty);
+                cum_log_probs[src_beam_idx], finished[src_beam_idx] ? length + 1 : length, length_penalty);
             beam_hyps.cum_log_probs[tgt_beam_idx] = cum_log_probs[src_beam_idx];
 
             beam_hyps.num_beams[bid]++;
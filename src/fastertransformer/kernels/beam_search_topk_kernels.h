@@ -52,6 +52,9 @@ struct BeamHypotheses {
     int   local_batch_size;
     int   max_seq_len;
     float length_penalty;
+    // [batch_size] on the device, the length penalty of each request for invokeInsertUnfinishedPath, which uses
+    // length_penalty for all of them if nullptr
+    const float* length_penalties = nullptr;
 
     bool early_stopping         = true;
     bool is_return_normed_score = true;  // return normed_cum_log_probs or cum_log_probs
@@ -0,0 +1,220 @@
+/*
+ * Copyright (c) 2023, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/fastertransformer/kernels/lora_kernels.h"
+#include "src/fastertransformer/kernels/reduce_kernel_utils.cuh"
+#include "src/fastertransformer/utils/cuda_type_utils.cuh"
+#include "src/fastertransformer/utils/cuda_utils.h"
+
+#include <algorithm>
+
+namespace fastertransformer {
+
+__device__ inline int getLoraSlot(int token, const int* lora_slots, const int* padding_offset, int seq_len)
+{
+    const int offset   = padding_offset == nullptr ? 0 : padding_offset[token];
+    const int batch_id = (token + offset) / seq_len;
+    return lora_slots[batch_id];
+}
+
+// One block per token, one warp per rank at a time.
+template<typename T>
+__global__ void loraShrink(float*     lora_buf,
+                           const T*   in,
+                           const T*   lora_a,
+                           size_t     slot_stride,
+                           const int* lora_slots,
+                           const int* padding_offset,
+                           int        seq_len,
+                           int        k,
+                           int        rank)
+{
+    const int token = blockIdx.x;
+    const int slot  = getLoraSlot(token, lora_slots, padding_offset, seq_len);
+    if (slot < 0) {
+        return;
+    }
+
+    const T*  x         = in + (size_t)token * k;
+    const T*  a         = lora_a + slot * slot_stride;
+    const int warp_id   = threadIdx.x / 32;
+    const int lane_id   = threadIdx.x % 32;
+    const int num_warps = blockDim.x / 32;
+    for (int r = warp_id; r < rank; r += num_warps) {
+        const T* a_row = a + (size_t)r * k;
+        float    sum   = 0.0f;
+        for (int j = lane_id; j < k; j += 32) {
+            sum += cuda_cast<float>(x[j]) * cuda_cast<float>(a_row[j]);
+        }
+        sum = warpReduceSum(sum);
+        if (lane_id == 0) {
+            lora_buf[(size_t)token * rank + r] = sum;
+        }
+    }
+}
+
+// One block per token and slice of blockDim.x columns.
+template<typename T>
+__global__ void loraExpand(T*           out,
+                           const float* lora_buf,
+                           const T*     lora_b,
+                           size_t       slot_stride,
+                           const int*   lora_slots,
+                           const int*   padding_offset,
+                           int          seq_len,
+                           int          n,
+                           int          ldb,
+                           int          rank)
+{
+    extern __shared__ float s_lora[];
+
+    const int token = blockIdx.x;
+    const int slot  = getLoraSlot(token, lora_slots, padding_offset, seq_len);
+    if (slot < 0) {
+        return;
+    }
+
+    for (int r = threadIdx.x; r < rank; r += blockDim.x) {
+        s_lora[r] = lora_buf[(size_t)token * rank + r];
+    }
+    __syncthreads();
+
+    const int col = blockIdx.y * blockDim.x + threadIdx.x;
+    if (col >= n) {
+        return;
+    }
+    const T* b   = lora_b + slot * slot_stride + col;
+    float    sum = 0.0f;
+    for (int r = 0; r < rank; r++) {
+        sum += s_lora[r] * cuda_cast<float>(b[(size_t)r * ldb]);
+    }
+    T* o = out + (size_t)token * n + col;
+    *o   = cuda_cast<T>(cuda_cast<float>(*o) + sum);
+}
+
+template<typename T>
+void invokeLoraShrink(float*       lora_buf,
+                      const T*     in,
+                      const T*     lora_a,
+                      size_t       slot_stride,
+                      const int*   lora_slots,
+                      const int*   padding_offset,
+                      int          seq_len,
+                      int          m,
+                      int          k,
+                      int          rank,
+                      cudaStream_t stream)
+{
+    if (m == 0 || rank == 0) {
+        return;
+    }
+    dim3 grid(m);
+    dim3 block(std::min(rank, 8) * 32);
+    loraShrink<<<grid, block, 0, stream>>>(
+        lora_buf, in, lora_a, slot_stride, lora_slots, padding_offset, seq_len, k, rank);
+}
+
+template<typename T>
+void invokeLoraExpand(T*           out,
+                      const float* lora_buf,
+                      const T*     lora_b,
+                      size_t       slot_stride,
+                      const int*   lora_slots,
+                      const int*   padding_offset,
+                      int          seq_len,
+                      int          m,
+                      int          n,
+                      int          ldb,
+                      int          rank,
+                      cudaStream_t stream)
+{
+    if (m == 0 || rank == 0) {
+        return;
+    }
+    dim3 block(256);
+    dim3 grid(m, (n + block.x - 1) / block.x);
+    loraExpand<<<grid, block, sizeof(float) * rank, stream>>>(
+        out, lora_buf, lora_b, slot_stride, lora_slots, padding_offset, seq_len, n, ldb, rank);
+}
+
+template<typename T>
+void invokeAddLora(T*           out,
+                   const T*     in,
+                   float*       lora_buf,
+                   const T*     lora_a,
+                   const T*     lora_b,
+                   size_t       slot_stride,
+                   const int*   lora_slots,
+                   const int*   padding_offset,
+                   int          seq_len,
+                   int          m,
+                   int          k,
+                   int          n,
+                   int          rank,
+                   cudaStream_t stream)
+{
+    invokeLoraShrink(lora_buf, in, lora_a, slot_stride, lora_slots, padding_offset, seq_len, m, k, rank, stream);
+    invokeLoraExpand(out, lora_buf, lora_b, slot_stride, lora_slots, padding_offset, seq_len, m, n, n, rank, stream);
+}
+
+#define INSTANTIATE_LORA_KERNELS(T)                                                                                    \
+    template void invokeLoraShrink(float*       lora_buf,                                                              \
+                                   const T*     in,                                                                    \
+                                   const T*     lora_a,                                                                \
+                                   size_t       slot_stride,                                                           \
+                                   const int*   lora_slots,                                                            \
+                                   const int*   padding_offset,                                                        \
+                                   int          seq_len,                                                               \
+                                   int          m,                                                                     \
+                                   int          k,                                                                     \
+                                   int          rank,                                                                  \
+                                   cudaStream_t stream);                                                               \
+    template void invokeLoraExpand(T*           out,                                                                   \
+                                   const float* lora_buf,                                                              \
+                                   const T*     lora_b,                                                                \
+                                   size_t       slot_stride,                                                           \
+                                   const int*   lora_slots,                                                            \
+                                   const int*   padding_offset,                                                        \
+                                   int          seq_len,                                                               \
+                                   int          m,                                                                     \
+                                   int          n,                                                                     \
+                                   int          ldb,                                                                   \
+                                   int          rank,                                                                  \
+                                   cudaStream_t stream);                                                               \
+    template void invokeAddLora(T*           out,                                                                      \
+                                const T*     in,                                                                       \
+                                float*       lora_buf,                                                                 \
+                                const T*     lora_a,                                                                   \
+                                const T*     lora_b,                                                                   \
+                                size_t       slot_stride,                                                              \
+                                const int*   lora_slots,                                                               \
+                                const int*   padding_offset,                                                           \
+                                int          seq_len,                                                                  \
+                                int          m,                                                                        \
+                                int          k,                                                                        \
+                                int          n,                                                                        \
+                                int          rank,                                                                     \
+                                cudaStream_t stream)
+
+INSTANTIATE_LORA_KERNELS(float);
+INSTANTIATE_LORA_KERNELS(half);
+#ifdef ENABLE_BF16
+INSTANTIATE_LORA_KERNELS(__nv_bfloat16);
+#endif
+
+#undef INSTANTIATE_LORA_KERNELS
+
+}  // namespace fastertransformer
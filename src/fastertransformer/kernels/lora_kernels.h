@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) 2023, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cuda_runtime.h>
+#include <stddef.h>
+
+namespace fastertransformer {
+
+// Low-rank adapters of a batch mixing several adapters. The adapters are stacked in slots: the adapter of slot s is
+// lora_a + s * slot_stride, of shape [rank, k], and lora_b + s * slot_stride, of shape [rank, ldb]. Token i uses the
+// slot lora_slots[b] of its sequence b = (i + padding_offset[i]) / seq_len, and no adapter if that slot is negative.
+
+// lora_buf[i, r] = sum_j in[i, j] * lora_a[slot][r, j], lora_buf is [m, rank]
+template<typename T>
+void invokeLoraShrink(float*       lora_buf,
+                      const T*     in,
+                      const T*     lora_a,
+                      size_t       slot_stride,
+                      const int*   lora_slots,
+                      const int*   padding_offset,
+                      int          seq_len,
+                      int          m,
+                      int          k,
+                      int          rank,
+                      cudaStream_t stream);
+
+// out[i, j] += sum_r lora_buf[i, r] * lora_b[slot][r, j], for j < n, out is [m, n]
+template<typename T>
+void invokeLoraExpand(T*           out,
+                      const float* lora_buf,
+                      const T*     lora_b,
+                      size_t       slot_stride,
+                      const int*   lora_slots,
+                      const int*   padding_offset,
+                      int          seq_len,
+                      int          m,
+                      int          n,
+                      int          ldb,
+                      int          rank,
+                      cudaStream_t stream);
+
+// out += in * A^T * B, token by token, with the adapters of their sequences.
+template<typename T>
+void invokeAddLora(T*           out,
+                   const T*     in,
+                   float*       lora_buf,
+                   const T*     lora_a,
+                   const T*     lora_b,
+                   size_t       slot_stride,
+                   const int*   lora_slots,
+                   const int*   padding_offset,
+                   int          seq_len,
+                   int          m,
+                   int          k,
+                   int          n,
+                   int          rank,
+                   cudaStream_t stream);
+
+}  // namespace fastertransformer
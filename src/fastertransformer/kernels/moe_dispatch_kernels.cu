@@ -0,0 +1,260 @@
+/*
+ * Copyright (c) 2023, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/fastertransformer/kernels/moe_dispatch_kernels.h"
+#include "src/fastertransformer/utils/cuda_type_utils.cuh"
+#include "src/fastertransformer/utils/cuda_utils.h"
+
+#include <algorithm>
+
+#ifndef CUDART_VERSION
+#error CUDART_VERSION Undefined!
+#elif (CUDART_VERSION >= 11050)
+#include <cub/cub.cuh>
+#else
+#include "3rdparty/cub/cub.cuh"
+#endif
+
+namespace fastertransformer {
+
+static constexpr int DISPATCH_TPB = 256;
+
+// One block per expert, scanning the expanded rows in order so the first ones routed to the expert take its slots.
+__global__ void planMoeDispatch(int*       slot_for_expanded_row,
+                                int*       slot_rows,
+                                int*       expert_counts,
+                                int64_t*   expert_load,
+                                const int* expert_for_source_row,
+                                int        num_rows,
+                                int        num_experts,
+                                int        k,
+                                int        capacity)
+{
+    using BlockScan = cub::BlockScan<int, DISPATCH_TPB>;
+    __shared__ typename BlockScan::TempStorage temp_storage;
+
+    const int expert       = blockIdx.x;
+    const int num_expanded = k * num_rows;
+    int       num_routed   = 0;
+    for (int begin = 0; begin < num_expanded; begin += DISPATCH_TPB) {
+        const int  i         = begin + threadIdx.x;
+        const int  row       = i % num_rows;
+        const bool is_routed = i < num_expanded && expert_for_source_row[row * k + i / num_rows] == expert;
+        int        position, num_chunk_routed;
+        BlockScan(temp_storage).ExclusiveSum(is_routed ? 1 : 0, position, num_chunk_routed);
+        position += num_routed;
+        if (is_routed && position < capacity) {
+            const int slot           = expert * capacity + position;
+            slot_for_expanded_row[i] = slot;
+            slot_rows[slot]          = row;
+        }
+        num_routed += num_chunk_routed;
+        __syncthreads();
+    }
+
+    const int num_kept = min(num_routed, capacity);
+    for (int position = num_kept + threadIdx.x; position < capacity; position += DISPATCH_TPB) {
+        slot_rows[expert * capacity + position] = -1;
+    }
+    if (threadIdx.x == 0) {
+        expert_counts[expert] = num_kept;
+        if (expert_load != nullptr) {
+            expert_load[expert] += num_routed;
+            expert_load[num_experts + expert] += num_routed - num_kept;
+        }
+    }
+}
+
+void invokePlanMoeDispatch(int*         slot_for_expanded_row,
+                           int*         slot_rows,
+                           int*         expert_counts,
+                           int64_t*     expert_load,
+                           const int*   expert_for_source_row,
+                           int          num_rows,
+                           int          num_experts,
+                           int          k,
+                           int          capacity,
+                           cudaStream_t stream)
+{
+    // The rows routed to no expert keep -1.
+    check_cuda_error(cudaMemsetAsync(slot_for_expanded_row, 0xff, sizeof(int) * k * num_rows, stream));
+    if (num_rows == 0) {
+        check_cuda_error(cudaMemsetAsync(slot_rows, 0xff, sizeof(int) * num_experts * capacity, stream));
+        check_cuda_error(cudaMemsetAsync(expert_counts, 0, sizeof(int) * num_experts, stream));
+        return;
+    }
+    planMoeDispatch<<<num_experts, DISPATCH_TPB, 0, stream>>>(slot_for_expanded_row,
+                                                              slot_rows,
+                                                              expert_counts,
+                                                              expert_load,
+                                                              expert_for_source_row,
+                                                              num_rows,
+                                                              num_experts,
+                                                              k,
+                                                              capacity);
+}
+
+// One block. The offsets of the (expert, source) groups are small, so one thread computes them.
+__global__ void buildExpertRowMaps(int64_t*   total_rows_before_expert,
+                                   int*       grouped_row_slots,
+                                   int*       slot_grouped_rows,
+                                   const int* expert_counts,
+                                   int        num_sources,
+                                   int        num_local_experts,
+                                   int        capacity)
+{
+    extern __shared__ int group_offsets[];
+    const int             num_groups = num_sources * num_local_experts;
+    if (threadIdx.x == 0) {
+        int offset = 0;
+        for (int expert = 0; expert < num_local_experts; expert++) {
+            for (int source = 0; source < num_sources; source++) {
+                group_offsets[expert * num_sources + source] = offset;
+                offset += expert_counts[source * num_local_experts + expert];
+            }
+            total_rows_before_expert[expert] = offset;
+        }
+        group_offsets[num_groups] = offset;
+    }
+    __syncthreads();
+
+    const int num_slots = num_groups * capacity;
+    for (int slot = threadIdx.x; slot < num_slots; slot += blockDim.x) {
+        const int source   = slot / (num_local_experts * capacity);
+        const int expert   = slot / capacity % num_local_experts;
+        const int position = slot % capacity;
+        if (position < expert_counts[source * num_local_experts + expert]) {
+            const int grouped_row          = group_offsets[expert * num_sources + source] + position;
+            grouped_row_slots[grouped_row] = slot;
+            slot_grouped_rows[slot]        = grouped_row;
+        }
+        else {
+            slot_grouped_rows[slot] = -1;
+        }
+    }
+    for (int grouped_row = group_offsets[num_groups] + threadIdx.x; grouped_row < num_slots;
+         grouped_row += blockDim.x) {
+        grouped_row_slots[grouped_row] = -1;
+    }
+}
+
+void invokeBuildExpertRowMaps(int64_t*     total_rows_before_expert,
+                              int*         grouped_row_slots,
+                              int*         slot_grouped_rows,
+                              const int*   expert_counts,
+                              int          num_sources,
+                              int          num_local_experts,
+                              int          capacity,
+                              cudaStream_t stream)
+{
+    const size_t shared_size = sizeof(int) * (num_sources * num_local_experts + 1);
+    buildExpertRowMaps<<<1, DISPATCH_TPB, shared_size, stream>>>(total_rows_before_expert,
+                                                                 grouped_row_slots,
+                                                                 slot_grouped_rows,
+                                                                 expert_counts,
+                                                                 num_sources,
+                                                                 num_local_experts,
+                                                                 capacity);
+}
+
+// One block per output row.
+template<typename T>
+__global__ void
+permuteMoeRows(T* out, const T* in, const int* out_row_to_in_row, int in_row_begin, int num_in_rows, int cols)
+{
+    const int  in_row  = out_row_to_in_row[blockIdx.x] - in_row_begin;
+    const bool is_copy = in_row >= 0 && in_row < num_in_rows;
+    const T*   in_ptr  = in + (size_t)(is_copy ? in_row : 0) * cols;
+    T*         out_ptr = out + (size_t)blockIdx.x * cols;
+    for (int j = threadIdx.x; j < cols; j += blockDim.x) {
+        out_ptr[j] = is_copy ? in_ptr[j] : cuda_cast<T>(0.0f);
+    }
+}
+
+template<typename T>
+void invokePermuteMoeRows(T*           out,
+                          const T*     in,
+                          const int*   out_row_to_in_row,
+                          int          num_out_rows,
+                          int          in_row_begin,
+                          int          num_in_rows,
+                          int          cols,
+                          cudaStream_t stream)
+{
+    if (num_out_rows == 0) {
+        return;
+    }
+    const int block_size = std::min(1024, (cols + 31) / 32 * 32);
+    permuteMoeRows<<<num_out_rows, block_size, 0, stream>>>(out, in, out_row_to_in_row, in_row_begin, num_in_rows, cols);
+}
+
+template<typename T>
+__global__ void dropMoeScales(T*         expert_scales,
+                              int*       expanded_source_row_to_expanded_dest_row,
+                              const int* slot_for_expanded_row,
+                              int        num_rows,
+                              int        k)
+{
+    for (int i = blockIdx.x * blockDim.x + threadIdx.x; i < k * num_rows; i += blockDim.x * gridDim.x) {
+        if (slot_for_expanded_row[i] < 0) {
+            expert_scales[(i % num_rows) * k + i / num_rows] = cuda_cast<T>(0.0f);
+        }
+        expanded_source_row_to_expanded_dest_row[i] = i;
+    }
+}
+
+template<typename T>
+void invokeDropMoeScales(T*           expert_scales,
+                         int*         expanded_source_row_to_expanded_dest_row,
+                         const int*   slot_for_expanded_row,
+                         int          num_rows,
+                         int          k,
+                         cudaStream_t stream)
+{
+    const int num_expanded = k * num_rows;
+    if (num_expanded == 0) {
+        return;
+    }
+    const int grid_size = std::min(65536, (num_expanded + DISPATCH_TPB - 1) / DISPATCH_TPB);
+    dropMoeScales<<<grid_size, DISPATCH_TPB, 0, stream>>>(
+        expert_scales, expanded_source_row_to_expanded_dest_row, slot_for_expanded_row, num_rows, k);
+}
+
+#define INSTANTIATE_MOE_DISPATCH_KERNELS(T)                                                                            \
+    template void invokePermuteMoeRows(T*           out,                                                               \
+                                       const T*     in,                                                                \
+                                       const int*   out_row_to_in_row,                                                 \
+                                       int          num_out_rows,                                                      \
+                                       int          in_row_begin,                                                      \
+                                       int          num_in_rows,                                                       \
+                                       int          cols,                                                              \
+                                       cudaStream_t stream);                                                           \
+    template void invokeDropMoeScales(T*           expert_scales,                                                      \
+                                      int*         expanded_source_row_to_expanded_dest_row,                           \
+                                      const int*   slot_for_expanded_row,                                              \
+                                      int          num_rows,                                                           \
+                                      int          k,                                                                  \
+                                      cudaStream_t stream)
+
+INSTANTIATE_MOE_DISPATCH_KERNELS(float);
+INSTANTIATE_MOE_DISPATCH_KERNELS(half);
+#ifdef ENABLE_BF16
+INSTANTIATE_MOE_DISPATCH_KERNELS(__nv_bfloat16);
+#endif
+
+#undef INSTANTIATE_MOE_DISPATCH_KERNELS
+
+}  // namespace fastertransformer
@@ -0,0 +1,139 @@
+/*
+ * Copyright (c) 2023, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cuda_runtime.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace fastertransformer {
+
+// Routing of the tokens of a MoE layer to experts with a fixed capacity, as in GShard.
+//
+// The k * num_rows expanded rows i = k_idx * num_rows + row, the k_idx-th choice of the token row, are taken in that
+// order, so the first choices of all the tokens come before the second ones. Expert e keeps the first capacity
+// expanded rows routed to it in the slots [e * capacity, (e + 1) * capacity) and drops the others: a dropped row does
+// not go through its expert and its gating scale becomes 0, the token only keeps its residual.
+//
+// The slots of the experts are grouped by rank, expert e living on rank e / (num_experts / world_size), so the
+// slots sent to a rank are contiguous.
+
+// The slots of each expert, for the tokens of one rank. capacity_factor 0 never drops a token.
+inline size_t getMoeExpertCapacity(size_t num_rows, size_t k, size_t num_experts, float capacity_factor)
+{
+    if (capacity_factor <= 0.0f) {
+        return num_rows;
+    }
+    const size_t capacity = (size_t)std::ceil(capacity_factor * num_rows * k / num_experts);
+    return std::max(std::min(capacity, num_rows), (size_t)1);
+}
+
+// expert_for_source_row is [num_rows, k], from topk_gating_softmax_kernelLauncher. Experts out of [0, num_experts)
+// are never routed.
+// slot_for_expanded_row [k * num_rows]: the slot of each expanded row, -1 when dropped.
+// slot_rows [num_experts * capacity]: the token of each slot, -1 for an empty slot.
+// expert_counts [num_experts]: the slots used by each expert, a prefix of its slots.
+// expert_load [2 * num_experts] (optional): adds the rows routed to each expert, then the rows dropped by each expert.
+void invokePlanMoeDispatch(int*         slot_for_expanded_row,
+                           int*         slot_rows,
+                           int*         expert_counts,
+                           int64_t*     expert_load,
+                           const int*   expert_for_source_row,
+                           int          num_rows,
+                           int          num_experts,
+                           int          k,
+                           int          capacity,
+                           cudaStream_t stream);
+
+// Groups the slots received by the local experts of a rank for the expert GEMMs. The slots are [num_sources,
+// num_local_experts, capacity] and expert_counts [num_sources, num_local_experts], the counts of the sources.
+// The grouped rows are by expert, then by source.
+// total_rows_before_expert [num_local_experts]: the rows of the experts up to each one, for run_expert_fc.
+// grouped_row_slots [num_sources * num_local_experts * capacity]: the slot of each grouped row, -1 past the last one.
+// slot_grouped_rows [num_sources * num_local_experts * capacity]: the grouped row of each slot, -1 for empty slots.
+void invokeBuildExpertRowMaps(int64_t*     total_rows_before_expert,
+                              int*         grouped_row_slots,
+                              int*         slot_grouped_rows,
+                              const int*   expert_counts,
+                              int          num_sources,
+                              int          num_local_experts,
+                              int          capacity,
+                              cudaStream_t stream);
+
+// out[r] = in[out_row_to_in_row[r] - in_row_begin], or zeros when that row is not in [0, num_in_rows).
+template<typename T>
+void invokePermuteMoeRows(T*           out,
+                          const T*     in,
+                          const int*   out_row_to_in_row,
+                          int          num_out_rows,
+                          int          in_row_begin,
+                          int          num_in_rows,
+                          int          cols,
+                          cudaStream_t stream);
+
+// Zeroes the gating scales [num_rows, k] of the dropped rows, and sets expanded_source_row_to_expanded_dest_row
+// [k * num_rows] to the identity, the layout of the rows combined from the slots, for
+// finalize_moe_routing_kernelLauncher.
+template<typename T>
+void invokeDropMoeScales(T*           expert_scales,
+                         int*         expanded_source_row_to_expanded_dest_row,
+                         const int*   slot_for_expanded_row,
+                         int          num_rows,
+                         int          k,
+                         cudaStream_t stream);
+
+// Host references of the kernels above, with the same outputs.
+struct MoeDispatchPlan {
+    std::vector<int>     slot_for_expanded_row;
+    std::vector<int>     slot_rows;
+    std::vector<int>     expert_counts;
+    std::vector<int64_t> expert_load;
+};
+
+MoeDispatchPlan
+planMoeDispatchOnHost(const int* expert_for_source_row, int num_rows, int num_experts, int k, int capacity);
+
+void buildExpertRowMapsOnHost(int64_t*   total_rows_before_expert,
+                              int*       grouped_row_slots,
+                              int*       slot_grouped_rows,
+                              const int* expert_counts,
+                              int        num_sources,
+                              int        num_local_experts,
+                              int        capacity);
+
+template<typename T>
+void permuteMoeRowsOnHost(T*         out,
+                          const T*   in,
+                          const int* out_row_to_in_row,
+                          int        num_out_rows,
+                          int        in_row_begin,
+                          int        num_in_rows,
+                          int        cols)
+{
+    for (int r = 0; r < num_out_rows; r++) {
+        const int in_row = out_row_to_in_row[r] - in_row_begin;
+        for (int j = 0; j < cols; j++) {
+            out[(size_t)r * cols + j] =
+                in_row >= 0 && in_row < num_in_rows ? in[(size_t)in_row * cols + j] : static_cast<T>(0.0f);
+        }
+    }
+}
+
+}  // namespace fastertransformer
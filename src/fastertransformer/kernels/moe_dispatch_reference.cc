@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) 2023, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/fastertransformer/kernels/moe_dispatch_kernels.h"
+
+namespace fastertransformer {
+
+MoeDispatchPlan
+planMoeDispatchOnHost(const int* expert_for_source_row, int num_rows, int num_experts, int k, int capacity)
+{
+    MoeDispatchPlan plan;
+    plan.slot_for_expanded_row.assign(k * num_rows, -1);
+    plan.slot_rows.assign(num_experts * capacity, -1);
+    plan.expert_counts.assign(num_experts, 0);
+    plan.expert_load.assign(2 * num_experts, 0);
+    for (int i = 0; i < k * num_rows; i++) {
+        const int row    = i % num_rows;
+        const int expert = expert_for_source_row[row * k + i / num_rows];
+        if (expert < 0 || expert >= num_experts) {
+            continue;
+        }
+        plan.expert_load[expert]++;
+        if (plan.expert_counts[expert] == capacity) {
+            plan.expert_load[num_experts + expert]++;
+            continue;
+        }
+        const int slot                = expert * capacity + plan.expert_counts[expert]++;
+        plan.slot_for_expanded_row[i] = slot;
+        plan.slot_rows[slot]          = row;
+    }
+    return plan;
+}
+
+void buildExpertRowMapsOnHost(int64_t*   total_rows_before_expert,
+                              int*       grouped_row_slots,
+                              int*       slot_grouped_rows,
+                              const int* expert_counts,
+                              int        num_sources,
+                              int        num_local_experts,
+                              int        capacity)
+{
+    const int num_slots   = num_sources * num_local_experts * capacity;
+    int       grouped_row = 0;
+    for (int slot = 0; slot < num_slots; slot++) {
+        slot_grouped_rows[slot] = -1;
+        grouped_row_slots[slot] = -1;
+    }
+    for (int expert = 0; expert < num_local_experts; expert++) {
+        for (int source = 0; source < num_sources; source++) {
+            for (int position = 0; position < expert_counts[source * num_local_experts + expert]; position++) {
+                const int slot                 = (source * num_local_experts + expert) * capacity + position;
+                grouped_row_slots[grouped_row] = slot;
+                slot_grouped_rows[slot]        = grouped_row++;
+            }
+        }
+        total_rows_before_expert[expert] = grouped_row;
+    }
+}
+
+}  // namespace fastertransformer
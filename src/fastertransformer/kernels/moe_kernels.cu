@@ -818,6 +818,68 @@ void CutlassMoeFCRunner<T, WeightType, Enable>::compute_total_rows_before_expert
         sorted_indices, total_indices, num_experts, total_rows_before_expert);
 }
 
+template<typename T, typename WeightType, typename Enable>
+void CutlassMoeFCRunner<T, WeightType, Enable>::run_expert_fc(const T*          permuted_input,
+                                                              const WeightType* fc1_expert_weights,
+                                                              const T*          fc1_scales,
+                                                              const T*          fc1_expert_biases,
+                                                              ActivationType    fc1_activation_type,
+                                                              const WeightType* fc2_expert_weights,
+                                                              const T*          fc2_scales,
+                                                              int64_t*          total_rows_before_expert,
+                                                              const int         num_rows,
+                                                              const int         hidden_size,
+                                                              const int         inter_size,
+                                                              const int         num_experts,
+                                                              T*                fc1_result,
+                                                              T*                fc2_result,
+                                                              cudaStream_t      stream)
+{
+    FT_LOG_DEBUG(__PRETTY_FUNCTION__);
+    static constexpr bool scales_required =
+        std::is_same<WeightType, uint8_t>::value || std::is_same<WeightType, cutlass::uint4b_t>::value;
+    if (scales_required && (fc1_scales == nullptr || fc2_scales == nullptr)) {
+        throw std::runtime_error("[FT Error][Run Expert FC] Scales expected but a scale is a null pointer");
+    }
+    else if (!scales_required && (fc1_scales != nullptr || fc2_scales != nullptr)) {
+        throw std::runtime_error("[FT Error][Run Expert FC] Scales are ignored for fp32/fp16/bf16 but received scales");
+    }
+
+    moe_gemm_runner_.moe_gemm_bias_act(permuted_input,
+                                       fc1_expert_weights,
+                                       fc1_scales,
+                                       fc1_expert_biases,
+                                       fc1_result,
+                                       total_rows_before_expert,
+                                       num_rows,
+                                       inter_size,
+                                       hidden_size,
+                                       num_experts,
+                                       fc1_activation_type,
+                                       stream);
+
+#ifndef NDEBUG
+    cudaDeviceSynchronize();
+    check_cuda_error(cudaGetLastError());
+#endif
+
+    moe_gemm_runner_.moe_gemm(fc1_result,
+                              fc2_expert_weights,
+                              fc2_scales,
+                              fc2_result,
+                              total_rows_before_expert,
+                              num_rows,
+                              hidden_size,
+                              inter_size,
+                              num_experts,
+                              stream);
+
+#ifndef NDEBUG
+    cudaDeviceSynchronize();
+    check_cuda_error(cudaGetLastError());
+#endif
+}
+
 // ========================== Permutation things =======================================
 
 // Duplicated and permutes rows for MoE. In addition, reverse the permutation map to help with finalizing routing.
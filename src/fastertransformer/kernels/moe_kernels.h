@@ -179,6 +179,25 @@ public:
                                           int64_t*     total_rows_before_expert,
                                           cudaStream_t stream);
 
+    // Runs the experts on rows already grouped by expert, e.g. the rows dispatched to the experts of a rank by
+    // ExpertParallelMoe: expert e takes the rows [total_rows_before_expert[e - 1], total_rows_before_expert[e]).
+    // fc1_result holds [num_rows, inter_size].
+    void run_expert_fc(const T*          permuted_input,
+                       const WeightType* fc1_expert_weights,
+                       const T*          fc1_scales,
+                       const T*          fc1_expert_biases,
+                       ActivationType    fc1_activation_type,
+                       const WeightType* fc2_expert_weights,
+                       const T*          fc2_scales,
+                       int64_t*          total_rows_before_expert,
+                       const int         num_rows,
+                       const int         hidden_size,
+                       const int         inter_size,
+                       const int         num_experts,
+                       T*                fc1_result,
+                       T*                fc2_result,
+                       cudaStream_t      stream);
+
 private:
     void configure_ws_ptrs(char*     ws_ptr,
                            const int num_rows,
@@ -271,6 +290,25 @@ public:
     {
         FT_CHECK_WITH_INFO(false, "FP32 x int8 MoE not supported.");
     }
+
+    void run_expert_fc(const float*   permuted_input,
+                       const uint8_t* fc1_expert_weights,
+                       const float*   fc1_scales,
+                       const float*   fc1_expert_biases,
+                       ActivationType fc1_activation_type,
+                       const uint8_t* fc2_expert_weights,
+                       const float*   fc2_scales,
+                       int64_t*       total_rows_before_expert,
+                       const int      num_rows,
+                       const int      hidden_size,
+                       const int      inter_size,
+                       const int      num_experts,
+                       float*         fc1_result,
+                       float*         fc2_result,
+                       cudaStream_t   stream)
+    {
+        FT_CHECK_WITH_INFO(false, "FP32 x int8 MoE not supported.");
+    }
 };
 
 }  // namespace fastertransformer
@@ -108,12 +108,15 @@ __launch_bounds__(THREADBLOCK_SIZE) __global__ void batch_topk_kernel(const int*
                                                                       const int      V,
                                                                       const int      K,
                                                                       const int      vocab_size,
-                                                                      const float    length_penalty,
-                                                                      const T        diversity_rate)
+                                                                      const float*   length_penalties,
+                                                                      const float*   diversity_rates)
 {
     int thread_id = threadIdx.x;
     int vector_id = blockIdx.x;
 
+    const float length_penalty = length_penalties == nullptr ? 0.0f : length_penalties[vector_id];
+    const T     diversity_rate = diversity_rates == nullptr ? (T)0.0f : (T)diversity_rates[vector_id];
+
     // reposition x, y to data for the current vector
     x += vector_id * V;
     y += vector_id * V;
@@ -148,12 +151,14 @@ __launch_bounds__(THREADBLOCK_SIZE) __global__ void batch_topk_kernel(const int*
     }
 
     for (int elem_id = thread_id; elem_id < V; elem_id += THREADBLOCK_SIZE) {
-        int i    = elem_id % K;
-        T   elem = length_penalty == 0.0f ? y[elem_id] :
-                                            apply_length_penalty(y[elem_id],
-                                                               finished[vector_id] ? sequence_lengths[vector_id] :
-                                                                                       sequence_lengths[vector_id] + 1,
-                                                               length_penalty);
+        int i = elem_id % K;
+        // The length of a candidate is the length of the beam it extends.
+        const int beam_idx = vector_id * K + (x[elem_id] / vocab_size) % K;
+        T         elem     = length_penalty == 0.0f ? y[elem_id] :
+                                                      apply_length_penalty(y[elem_id],
+                                                                   finished[beam_idx] ? sequence_lengths[beam_idx] :
+                                                                                        sequence_lengths[beam_idx] + 1,
+                                                                   length_penalty);
         elem += diversity_rate * (T)i;
         int elem_idx = elem_id;  // x[elem_id];
         partial.insert(elem, elem_idx);
@@ -561,8 +566,8 @@ void topK_softMax_kernelLauncher(const T*        log_probs,
                                  const int       beam_width,
                                  const int       vocab_size,
                                  const int*      end_ids,
-                                 T               diversity_rate,
-                                 const float     length_penalty,
+                                 const float*    diversity_rates,
+                                 const float*    length_penalties,
                                  cudaStream_t    stream)
 {
     const int items_per_thread = 1;
@@ -572,7 +577,7 @@ void topK_softMax_kernelLauncher(const T*        log_probs,
     assert(temp_storage_size % 2 == 0);
     assert(temp_storage_size >= 2 * batch_size * beam_width * beam_width * 2);
     // Beam search needs the sequence lengths of beams to apply length penalty.
-    assert(length_penalty == 0.0f || sequence_lengths != nullptr);
+    assert(length_penalties == nullptr || sequence_lengths != nullptr);
 
     const int topk_buf_offset  = ceil(batch_size * beam_width * beam_width * 2 / 4.) * 4;
     int*      topk_tmp_id_buf  = reinterpret_cast<int*>(temp_storage);
@@ -629,8 +634,8 @@ void topK_softMax_kernelLauncher(const T*        log_probs,
                                                                            beam_width * beam_width * 2,
                                                                            beam_width,
                                                                            vocab_size,
-                                                                           length_penalty,
-                                                                           diversity_rate);
+                                                                           length_penalties,
+                                                                           diversity_rates);
         sync_check_cuda_error();
 #endif
     }
@@ -663,8 +668,8 @@ void topK_softMax_kernelLauncher(const T*        log_probs,
                                               beam_width,                                                              \
                                               vocab_size,                                                              \
                                               end_ids,                                                                 \
-                                              diversity_rate,                                                          \
-                                              length_penalty,                                                          \
+                                              diversity_rates,                                                         \
+                                              length_penalties,                                                        \
                                               stream);                                                                 \
         break;
 
@@ -683,8 +688,8 @@ void invokeTopkSoftMax(const T*        log_probs,
                        const int       beam_width,
                        const int       vocab_size,
                        const int*      end_ids,
-                       const float     diversity_rate,
-                       const float     length_penalty,
+                       const float*    diversity_rates,
+                       const float*    length_penalties,
                        cudaStream_t    stream)
 {
     switch (beam_width) {
@@ -714,8 +719,8 @@ template void invokeTopkSoftMax<float>(const float*    log_probs,
                                        const int       beam_width,
                                        const int       vocab_size,
                                        const int*      end_ids,
-                                       const float     diversity_rate,
-                                       const float     length_penalty,
+                                       const float*    diversity_rates,
+                                       const float*    length_penalties,
                                        cudaStream_t    stream);
 
 template void invokeTopkSoftMax<half>(const half*     log_probs,
@@ -732,8 +737,8 @@ template void invokeTopkSoftMax<half>(const half*     log_probs,
                                       const int       beam_width,
                                       const int       vocab_size,
                                       const int*      end_ids,
-                                      const float     diversity_rate,
-                                      const float     length_penalty,
+                                      const float*    diversity_rates,
+                                      const float*    length_penalties,
                                       cudaStream_t    stream);
 
 }  // end of namespace fastertransformer
@@ -19,6 +19,7 @@
 
 namespace fastertransformer {
 
+// diversity_rates and length_penalties are given per request, [batch_size] on gpu, or null if every request uses 0.
 template<typename T>
 void invokeTopkSoftMax(const T*        log_probs,
                        const T*        bias,
@@ -34,8 +35,8 @@ void invokeTopkSoftMax(const T*        log_probs,
                        const int       beam_width,
                        const int       vocab_size,
                        const int*      end_ids,
-                       const float     diversity_rate,
-                       const float     length_penalty,
+                       const float*    diversity_rates,
+                       const float*    length_penalties,
                        cudaStream_t    stream);
 
 }  // namespace fastertransformer
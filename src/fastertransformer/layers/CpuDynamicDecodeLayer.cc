@@ -0,0 +1,924 @@
+/*
+ * Copyright (c) 2023, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/fastertransformer/layers/CpuDynamicDecodeLayer.h"
+#include "src/fastertransformer/layers/beam_search_layers/BeamSearchReference.h"
+#include "src/fastertransformer/utils/cuda_utils.h"
+
+#include <cfloat>
+#include <cmath>
+#include <cstdlib>
+#include <thread>
+#include <type_traits>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define FT_CPU_DECODE_X86
+#include <immintrin.h>
+#define FT_TARGET_AVX2 __attribute__((target("avx2,f16c")))
+#define FT_TARGET_AVX512 __attribute__((target("avx512f,avx2,f16c")))
+#endif
+
+namespace fastertransformer {
+
+namespace {
+
+static const float HALF_FLT_MAX = 65504.F;
+static const uint  TOP_K_MAX    = 1024;  // as the device top-k sampling kernels
+static const int   TOP_P_MIN_K  = 256;   // number of candidates of the first top-p attempt
+
+struct Candidate {
+    float value;
+    int   id;
+};
+
+// Descending value, then ascending id.
+inline bool isBetter(const Candidate& a, const Candidate& b)
+{
+    return a.value > b.value || (a.value == b.value && a.id < b.id);
+}
+
+// Keeps the k best candidates seen so far. A candidate is only worth pushing if it is above threshold(), the value of
+// the k-th best one: the values are scanned by ascending id, so a later candidate equal to the threshold always loses
+// the tie.
+class TopKCollector {
+public:
+    explicit TopKCollector(int k): k_(k)
+    {
+        candidates_.reserve(getCapacity());
+    }
+
+    float threshold() const
+    {
+        return threshold_;
+    }
+
+    void push(float value, int id)
+    {
+        candidates_.push_back({value, id});
+        if (candidates_.size() == getCapacity()) {
+            compact();
+        }
+    }
+
+    void compact()
+    {
+        if (candidates_.size() > (size_t)k_) {
+            std::nth_element(candidates_.begin(), candidates_.begin() + k_ - 1, candidates_.end(), isBetter);
+            candidates_.resize(k_);
+        }
+        if (candidates_.size() == (size_t)k_) {
+            // the worst of the kept candidates
+            threshold_ = std::max_element(candidates_.begin(), candidates_.end(), isBetter)->value;
+        }
+    }
+
+    void sorted(std::vector<int>* indices)
+    {
+        compact();
+        std::sort(candidates_.begin(), candidates_.end(), isBetter);
+        indices->resize(candidates_.size());
+        for (size_t i = 0; i < candidates_.size(); i++) {
+            (*indices)[i] = candidates_[i].id;
+        }
+    }
+
+private:
+    size_t getCapacity() const
+    {
+        return 2 * (size_t)k_ + 64;
+    }
+
+    int                    k_;
+    float                  threshold_ = -INFINITY;
+    std::vector<Candidate> candidates_;
+};
+
+void scanScalar(const float* values, int begin, int end, TopKCollector* collector)
+{
+    for (int i = begin; i < end; i++) {
+        if (values[i] > collector->threshold()) {
+            collector->push(values[i], i);
+        }
+    }
+}
+
+#ifdef FT_CPU_DECODE_X86
+FT_TARGET_AVX2 void scanAvx2(const float* values, int begin, int end, TopKCollector* collector)
+{
+    int i = begin;
+    for (; i + 8 <= end; i += 8) {
+        const __m256 v    = _mm256_loadu_ps(values + i);
+        unsigned     mask = (unsigned)_mm256_movemask_ps(
+            _mm256_cmp_ps(v, _mm256_set1_ps(collector->threshold()), _CMP_GT_OQ));
+        while (mask != 0) {
+            const int j = i + __builtin_ctz(mask);
+            collector->push(values[j], j);
+            mask &= mask - 1;
+        }
+    }
+    scanScalar(values, i, end, collector);
+}
+
+FT_TARGET_AVX512 void scanAvx512(const float* values, int begin, int end, TopKCollector* collector)
+{
+    int i = begin;
+    for (; i + 16 <= end; i += 16) {
+        const __m512 v    = _mm512_loadu_ps(values + i);
+        unsigned     mask = (unsigned)_mm512_cmp_ps_mask(v, _mm512_set1_ps(collector->threshold()), _CMP_GT_OQ);
+        while (mask != 0) {
+            const int j = i + __builtin_ctz(mask);
+            collector->push(values[j], j);
+            mask &= mask - 1;
+        }
+    }
+    scanScalar(values, i, end, collector);
+}
+#endif
+
+// splitmix64, which passes BigCrush and only needs a 64-bit state per request.
+inline uint64_t nextRandom(uint64_t* state)
+{
+    uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+    z          = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z          = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+// Uniform in (0, 1], as curand_uniform.
+inline float uniformRandom(uint64_t* state)
+{
+    return (float)((nextRandom(state) >> 40) + 1) * (1.0f / 16777216.0f);
+}
+
+// The state of the subsequence-th stream of seed, which plays the role of curand_init(seed, subsequence, 0, state).
+inline uint64_t initRandomState(unsigned long long seed, size_t subsequence)
+{
+    uint64_t state = seed;
+    state ^= nextRandom(&state) + subsequence * 0xd1b54a32d192ed03ULL;
+    return state;
+}
+
+template<typename V>
+std::vector<V> getRuntimeArg(TensorMap* runtime_args, const std::string& key, const V default_value, size_t batch_size)
+{
+    std::vector<V> values(batch_size, default_value);
+    if (runtime_args == nullptr || !runtime_args->isExist(key)) {
+        return values;
+    }
+    const Tensor& tensor = runtime_args->at(key);
+    FT_CHECK_WITH_INFO(tensor.where == MEMORY_CPU, fmtstr("%s must be on cpu.", key.c_str()));
+    FT_CHECK_WITH_INFO(tensor.size() == 1 || tensor.size() == batch_size,
+                       fmtstr("%s must be of shape [1] or [batch_size(%ld)], got %s.",
+                              key.c_str(),
+                              batch_size,
+                              vec2str(tensor.shape).c_str()));
+    for (size_t i = 0; i < batch_size; i++) {
+        values[i] = tensor.getVal<V>(tensor.size() == 1 ? 0 : i);
+    }
+    return values;
+}
+
+template<typename T>
+const float* getFloatRow(const T* row, int size)
+{
+    thread_local std::vector<float> buffer;
+    buffer.resize(size);
+    hostCast(buffer.data(), row, size);
+    return buffer.data();
+}
+
+template<>
+const float* getFloatRow(const float* row, int size)
+{
+    return row;
+}
+
+}  // namespace
+
+int getCpuDecodeThreadCount()
+{
+    char* num_threads_env = std::getenv("FT_CPU_DECODE_THREADS");
+    if (num_threads_env != nullptr) {
+        return std::max(1, atoi(num_threads_env));
+    }
+    return std::max(1, (int)std::thread::hardware_concurrency());
+}
+
+void hostTopK(const float* values, int n, int k, std::vector<int>* indices, HostConvertIsa isa)
+{
+    k = std::min(k, n);
+    indices->clear();
+    if (k <= 0) {
+        return;
+    }
+    // The first k values seed the threshold, then only the values above it are pushed.
+    TopKCollector collector(k);
+    for (int i = 0; i < k; i++) {
+        collector.push(values[i], i);
+    }
+    collector.compact();
+    if ((int)isa > (int)getHostConvertIsa()) {
+        isa = getHostConvertIsa();
+    }
+#ifdef FT_CPU_DECODE_X86
+    if (isa == HostConvertIsa::AVX512) {
+        scanAvx512(values, k, n, &collector);
+    }
+    else if (isa == HostConvertIsa::AVX2) {
+        scanAvx2(values, k, n, &collector);
+    }
+    else {
+        scanScalar(values, k, n, &collector);
+    }
+#else
+    scanScalar(values, k, n, &collector);
+#endif
+    collector.sorted(indices);
+}
+
+template<typename T>
+struct CpuDynamicDecodeLayer<T>::StepArgs {
+    T*         logits;          // [local_batch_size * beam_width, vocab_size_padded]
+    const T*   embedding_bias;  // [vocab_size_padded], optional
+    const int* end_ids;         // [local_batch_size]
+    const int* input_lengths;   // [local_batch_size * beam_width], optional
+    const int* bad_words;       // [2, bad_words_len] or [local_batch_size, 2, bad_words_len], optional
+    size_t     bad_words_len;
+    bool       shared_bad_words;
+    const int* stop_words;  // [local_batch_size, 2, stop_words_len], optional
+    size_t     stop_words_len;
+
+    int*   output_ids;        // [max_seq_len, batch_size * beam_width]
+    int*   parent_ids;        // [max_seq_len, batch_size * beam_width], beam search only
+    int*   sequence_lengths;  // [local_batch_size * beam_width], optional in sampling
+    bool*  finished;          // [local_batch_size * beam_width], optional in sampling
+    float* cum_log_probs;     // [local_batch_size * beam_width], optional in sampling
+    float* output_log_probs;  // [local_batch_size] of the current step in sampling, the whole tensor in beam search
+
+    const int* src_cache_indirection;  // [local_batch_size, beam_width, max_seq_len], beam search only
+    int*       tgt_cache_indirection;  // [local_batch_size, beam_width, max_seq_len], beam search only
+
+    int step;
+    int max_input_length;
+    int max_seq_len;
+    int ite;
+    int local_batch_size;
+    int batch_size;
+    int beam_width;
+
+    // The device layers apply a penalty to the whole local batch as soon as one request needs it.
+    bool is_apply_temperature;
+    bool is_apply_repetition_penalty;
+    bool is_apply_min_length;
+};
+
+template<typename T>
+CpuDynamicDecodeLayer<T>::CpuDynamicDecodeLayer(size_t vocab_size, size_t vocab_size_padded, int num_threads):
+    vocab_size_(vocab_size), vocab_size_padded_(vocab_size_padded), pool_(num_threads)
+{
+    FT_LOG_DEBUG(__PRETTY_FUNCTION__);
+}
+
+template<typename T>
+void CpuDynamicDecodeLayer<T>::parallelFor(int num_rows, const std::function<void(int)>& func)
+{
+    const int num_chunks = std::min(num_rows, pool_.getNumThreads());
+    if (num_chunks <= 1) {
+        for (int row = 0; row < num_rows; row++) {
+            func(row);
+        }
+        return;
+    }
+    for (int chunk = 0; chunk < num_chunks; chunk++) {
+        const int begin = (int)((int64_t)num_rows * chunk / num_chunks);
+        const int end   = (int)((int64_t)num_rows * (chunk + 1) / num_chunks);
+        pool_.submit([&func, begin, end] {
+            for (int row = begin; row < end; row++) {
+                func(row);
+            }
+        });
+    }
+    pool_.wait();
+}
+
+template<typename T>
+void CpuDynamicDecodeLayer<T>::setup(const size_t batch_size, const size_t beam_width, TensorMap* runtime_args)
+{
+    /**
+     * @brief Set up the runtime arguments of each request, as DynamicDecodeLayer::setup.
+     *
+     * runtime_args:
+     *   \param  runtime_top_k [1] or [batch_size] on cpu, optional, uint
+     *   \param  runtime_top_p [1] or [batch_size] on cpu, optional, float
+     *   \param  beam_search_diversity_rate [1] or [batch_size] on cpu, optional
+     *   \param  temperature [1] or [batch_size] on cpu, optional
+     *   \param  len_penalty [1] or [batch_size] on cpu, optional
+     *   \param  repetition_penalty [1] or [batch_size] on cpu, optional
+     *   \param  presence_penalty [1] or [batch_size] on cpu, optional, float
+     *   \param  min_length [1] or [batch_size] on cpu, optional
+     *   \param  random_seed [1] or [batch_size] on cpu, optional, unsigned long long int
+     *   \param  top_p_decay [batch_size] on cpu, float, optional
+     *   \param  top_p_min [batch_size] on cpu, float, optional
+     *   \param  top_p_reset_ids [batch_size] on cpu, uint32, optional
+     */
+
+    FT_LOG_DEBUG(__PRETTY_FUNCTION__);
+    batch_size_ = batch_size;
+    beam_width_ = beam_width;
+
+    temperature_        = getRuntimeArg(runtime_args, "temperature", 1.0f, batch_size);
+    len_penalty_        = getRuntimeArg(runtime_args, "len_penalty", 0.0f, batch_size);
+    diversity_rate_     = getRuntimeArg(runtime_args, "beam_search_diversity_rate", 0.0f, batch_size);
+    min_lengths_        = getRuntimeArg(runtime_args, "min_length", 0, batch_size);
+    top_p_decay_        = getRuntimeArg(runtime_args, "top_p_decay", 1.0f, batch_size);
+    top_p_min_          = getRuntimeArg(runtime_args, "top_p_min", 1e-6f, batch_size);
+    top_p_reset_ids_    = getRuntimeArg(runtime_args, "top_p_reset_ids", -1, batch_size);
+    top_k_              = getRuntimeArg(runtime_args, "runtime_top_k", (uint)0, batch_size);
+    top_p_              = getRuntimeArg(runtime_args, "runtime_top_p", 0.0f, batch_size);
+    repetition_penalty_type_ = RepetitionPenaltyType::None;
+    if (runtime_args != nullptr
+        && (runtime_args->isExist("repetition_penalty") || runtime_args->isExist("presence_penalty"))) {
+        FT_CHECK_WITH_INFO(
+            !(runtime_args->isExist("repetition_penalty") && runtime_args->isExist("presence_penalty")),
+            "Found ambiguous parameters repetition_penalty and presence_penalty which are mutually exclusive. "
+            "Please provide one of repetition_penalty or presence_penalty.");
+        repetition_penalty_type_ = runtime_args->isExist("repetition_penalty") ? RepetitionPenaltyType::Multiplicative :
+                                                                                 RepetitionPenaltyType::Additive;
+    }
+    repetition_penalty_ = getRuntimeArg(runtime_args,
+                                        repetition_penalty_type_ == RepetitionPenaltyType::Additive ?
+                                            "presence_penalty" :
+                                            "repetition_penalty",
+                                        getDefaultPenaltyValue(repetition_penalty_type_),
+                                        batch_size);
+
+    // Same normalization of top_k and top_p as the device sampling layers.
+    for (size_t i = 0; i < batch_size; i++) {
+        uint&  k = top_k_[i];
+        float& p = top_p_[i];
+        if (k == 0 && p == 0.0f) {
+            // top-p sampling does not support top_p = 0, which is greedy search.
+            k = 1;
+        }
+        if (k > 0 && p == 0.0f) {
+            p = 1.0f;
+        }
+        if (k > TOP_K_MAX) {
+            FT_LOG_WARNING("topk (%d) is larger than max supported number (%d) for token %d, clip to %d.",
+                           k,
+                           TOP_K_MAX,
+                           (int)i,
+                           TOP_K_MAX);
+            k = TOP_K_MAX;
+        }
+        if (p < 0.0f || p > 1.0f) {
+            FT_LOG_WARNING("topp (%f) is out of range ([0.0, 1.0f]) for token %d, clip to closest number.", p, (int)i);
+            p = std::min(std::max(p, 0.0f), 1.0f);
+        }
+        if (top_p_decay_[i] > 1.0f || top_p_decay_[i] <= 0.0f) {
+            FT_LOG_WARNING("top_p_decay (%f) is out of range ((0.0, 1.0f]) for token %d, change to 1.0f.",
+                           top_p_decay_[i],
+                           (int)i);
+            top_p_decay_[i] = 1.0f;
+        }
+        if (top_p_min_[i] > 1.0f || top_p_min_[i] <= 0.0f) {
+            FT_LOG_WARNING(
+                "top_p_min (%f) is out of range ((0.0, 1.0f]) for token %d, change to 0.5f.", top_p_min_[i], (int)i);
+            top_p_min_[i] = 0.5f;
+        }
+    }
+    initial_top_p_ = top_p_;
+
+    // The word lists of the new requests are compiled on their first step.
+    bad_words_  = WordListState();
+    stop_words_ = WordListState();
+
+    // A single seed initializes a different stream of the seed for each request, as curand_init(seed, i) does.
+    random_state_.resize(batch_size);
+    Tensor random_seeds = runtime_args != nullptr && runtime_args->isExist("random_seed") ?
+                              runtime_args->at("random_seed") :
+                              Tensor();
+    FT_CHECK_WITH_INFO(random_seeds.size() <= 1 || random_seeds.size() == batch_size,
+                       fmtstr("random_seeds must be of shape [1] or [batch_size(%ld)], got random_seeds.shape=%s",
+                              batch_size,
+                              vec2str(random_seeds.shape).c_str()));
+    for (size_t i = 0; i < batch_size; i++) {
+        if (random_seeds.size() == batch_size && batch_size > 1) {
+            random_state_[i] = initRandomState(random_seeds.getVal<unsigned long long>(i), 0);
+        }
+        else {
+            const unsigned long long seed = random_seeds.size() == 0 ? 0 : random_seeds.getVal<unsigned long long>();
+            random_state_[i]              = initRandomState(seed, i);
+        }
+    }
+}
+
+template<typename T>
+void CpuDynamicDecodeLayer<T>::prepareWordList(WordListState* list, const Tensor& words, bool shared)
+{
+    const size_t words_len = words.shape.back();
+    if (list->words != words.getPtr<const int>() || list->words_len != words_len) {
+        const size_t num_lists = shared ? 1 : batch_size_;
+        list->matchers.clear();
+        for (size_t i = 0; i < num_lists; i++) {
+            list->matchers.emplace_back(words.getPtr<const int>() + i * 2 * words_len, words_len);
+        }
+        list->words     = words.getPtr<const int>();
+        list->words_len = words_len;
+        list->state_steps.assign(batch_size_ * beam_width_, -1);
+    }
+    list->states.resize(batch_size_ * beam_width_);
+}
+
+template<typename T>
+int CpuDynamicDecodeLayer<T>::getWordListState(WordListState* list, const StepArgs& args, int row, int last_step)
+{
+    // The state after the tokens [0, last_step] of the sequence.
+    const int              batch_idx = row / args.beam_width;
+    const int              id_offset = args.ite * args.local_batch_size * args.beam_width;
+    const int              bbsize    = args.batch_size * args.beam_width;
+    const WordListMatcher& matcher =
+        list->matchers[list->matchers.size() == 1 ? 0 : args.ite * args.local_batch_size + batch_idx];
+    int& state      = list->states[id_offset + row];
+    int& state_step = list->state_steps[id_offset + row];
+    if (last_step < 0) {
+        return WordListMatcher::kStartState;
+    }
+
+    if (args.beam_width == 1 && state_step == last_step) {
+        return state;
+    }
+    if (args.beam_width == 1 && state_step == last_step - 1) {
+        state      = matcher.advance(state, args.output_ids[last_step * bbsize + id_offset + row]);
+        state_step = last_step;
+        return state;
+    }
+
+    // Replays the last tokens, following the parents of the beam.
+    const int        first_step = std::max(0, last_step + 1 - (int)matcher.getMaxWordLength());
+    std::vector<int> tokens;
+    int              parent_id = row % args.beam_width;
+    for (int t = last_step; t >= first_step; t--) {
+        tokens.push_back(args.output_ids[t * bbsize + id_offset + batch_idx * args.beam_width + parent_id]);
+        if (args.beam_width > 1) {
+            parent_id = args.parent_ids[t * bbsize + id_offset + batch_idx * args.beam_width + parent_id];
+            if (parent_id < 0 || parent_id >= args.beam_width) {
+                break;
+            }
+        }
+    }
+    std::reverse(tokens.begin(), tokens.end());
+    state      = matcher.advance(WordListMatcher::kStartState, tokens.data(), tokens.size());
+    state_step = args.beam_width == 1 ? last_step : -1;
+    return state;
+}
+
+template<typename T>
+void CpuDynamicDecodeLayer<T>::banBadWords(const StepArgs& args, int row)
+{
+    const int              batch_idx = row / args.beam_width;
+    const WordListMatcher& matcher =
+        bad_words_.matchers[args.shared_bad_words ? 0 : args.ite * args.local_batch_size + batch_idx];
+
+    // A word of one token is always banned, a longer word when the previous tokens are its beginning.
+    size_t     num_banned;
+    const int* banned = matcher.getNextWordEnds(getWordListState(&bad_words_, args, row, args.step - 1), &num_banned);
+    T*         logits = args.logits + (size_t)row * vocab_size_padded_;
+    for (size_t i = 0; i < num_banned; i++) {
+        if (0 < banned[i] && banned[i] < (int)vocab_size_padded_) {
+            logits[banned[i]] = (T)(-INFINITY);
+        }
+    }
+    for (int banned_token : matcher.getSingleTokenWords()) {
+        if (0 < banned_token && banned_token < (int)vocab_size_padded_) {
+            logits[banned_token] = (T)(-INFINITY);
+        }
+    }
+}
+
+template<typename T>
+void CpuDynamicDecodeLayer<T>::applyPenalties(const StepArgs& args, int row)
+{
+    const float mask_val = std::is_same<T, half>::value ? -HALF_FLT_MAX : -FLT_MAX;
+    const int   req      = args.ite * args.local_batch_size + row;
+    T*          logits   = args.logits + (size_t)row * vocab_size_padded_;
+
+    if (args.is_apply_temperature) {
+        const float inv_temperature = 1.0f / (temperature_[req] + 1e-6f);
+        for (size_t i = 0; i < vocab_size_padded_; i++) {
+            if (i < vocab_size_) {
+                T logit = logits[i];
+                if (args.embedding_bias != nullptr) {
+                    logit = (T)((float)logit + (float)args.embedding_bias[i]);
+                }
+                logits[i] = (T)((float)logit * inv_temperature);
+            }
+            else {
+                logits[i] = (T)mask_val;
+            }
+        }
+    }
+
+    if (args.is_apply_repetition_penalty) {
+        // The penalized values are computed before any of them is written, so that a token which appears several
+        // times is only penalized once.
+        const float penalty      = repetition_penalty_[req];
+        const int   input_length = args.input_lengths != nullptr ? args.input_lengths[row] : args.max_input_length;
+
+        std::vector<int>   penalty_ids;
+        std::vector<float> penalty_logits;
+        for (int index = 0; index < args.step; index++) {
+            // Skip the padding tokens of the input sequences.
+            if (index >= input_length && index < args.max_input_length) {
+                continue;
+            }
+            const int   id    = args.output_ids[index * args.batch_size + args.ite * args.local_batch_size + row];
+            const float logit = (float)logits[id];
+            penalty_ids.push_back(id);
+            penalty_logits.push_back(repetition_penalty_type_ == RepetitionPenaltyType::Additive ?
+                                         logit - penalty :
+                                         (logit < 0.0f ? logit * penalty : logit / penalty));
+        }
+        for (size_t i = 0; i < penalty_ids.size(); i++) {
+            logits[penalty_ids[i]] = (T)penalty_logits[i];
+        }
+    }
+
+    // sequence_lengths = max_input_length + num_gen_tokens - 1, which is equal to the length of k/v caches.
+    if (args.is_apply_min_length && args.sequence_lengths[row] + 1 - args.max_input_length < min_lengths_[req]) {
+        logits[args.end_ids[row]] = (T)mask_val;
+    }
+}
+
+template<typename T>
+void CpuDynamicDecodeLayer<T>::sampleRow(const StepArgs& args, int row)
+{
+    const int req         = args.ite * args.local_batch_size + row;
+    const int end_id      = args.end_ids[row];
+    const int vocab_size  = (int)vocab_size_;
+    const int k           = (int)top_k_[req];
+    const bool need_probs = args.cum_log_probs != nullptr || args.output_log_probs != nullptr;
+    int*      output_id   = args.output_ids + args.step * args.batch_size + req;
+
+    if (args.finished != nullptr && args.finished[row]) {
+        // A finished request only generates end_id, with probability 1 in top-p sampling.
+        *output_id = end_id;
+        if (k == 0) {
+            uniformRandom(&random_state_[req]);
+            if (args.output_log_probs != nullptr) {
+                args.output_log_probs[row] = 0.0f;
+            }
+        }
+        return;
+    }
+
+    // The padded tokens are never selected, so only the first vocab_size logits are looked at.
+    const float* logits = getFloatRow(args.logits + (size_t)row * vocab_size_padded_, vocab_size);
+
+    thread_local std::vector<int>   indices;
+    thread_local std::vector<float> values;
+    float                           log_prob = 0.0f;
+    if (k > 0) {
+        hostTopK(logits, vocab_size, k, &indices);
+        const float max_logit = logits[indices[0]];
+        // The device layer only normalizes the logits with a softmax when log probs are returned.
+        float norm = 1.0f;
+        if (need_probs) {
+            norm = 0.0f;
+            for (int i = 0; i < vocab_size; i++) {
+                norm += std::exp(logits[i] - max_logit);
+            }
+        }
+        values.resize(indices.size());
+        float sum = 0.0f;
+        for (size_t i = 0; i < indices.size(); i++) {
+            values[i] = std::exp(logits[indices[i]] - max_logit) / norm;
+            sum += values[i];
+        }
+        float  rand     = uniformRandom(&random_state_[req]) * top_p_[req] * sum;
+        size_t selected = 0;
+        for (; selected < indices.size(); selected++) {
+            rand -= values[selected];
+            if (rand <= 0.0f || selected == indices.size() - 1) {
+                break;
+            }
+        }
+        *output_id = indices[selected];
+        log_prob   = std::log(values[selected]);
+        if (args.output_log_probs != nullptr) {
+            // The probability of the token conditioned on being in the top-k tokens.
+            args.output_log_probs[row] = log_prob - std::log(sum);
+        }
+    }
+    else {
+        float max_logit = -FLT_MAX;
+        for (int i = 0; i < vocab_size; i++) {
+            max_logit = std::max(max_logit, logits[i]);
+        }
+        float norm = 0.0f;
+        for (int i = 0; i < vocab_size; i++) {
+            norm += std::exp(logits[i] - max_logit);
+        }
+        // Try the most likely tokens first, and only widen the candidates if their total probability does not reach
+        // the random draw, which is rare for a top_p far from 1.
+        const float rand = uniformRandom(&random_state_[req]) * top_p_[req];
+        int         num_candidates = std::min(TOP_P_MIN_K, vocab_size);
+        while (true) {
+            hostTopK(logits, vocab_size, num_candidates, &indices);
+            float  cum_prob = 0.0f;
+            size_t selected = 0;
+            float  prob     = 0.0f;
+            for (; selected < indices.size(); selected++) {
+                prob = std::exp(logits[indices[selected]] - max_logit) / norm;
+                cum_prob += prob;
+                if (rand <= cum_prob) {
+                    break;
+                }
+            }
+            if (selected < indices.size() || num_candidates == vocab_size) {
+                selected   = std::min(selected, indices.size() - 1);
+                *output_id = indices[selected];
+                log_prob   = std::log(std::exp(logits[indices[selected]] - max_logit) / norm);
+                break;
+            }
+            num_candidates = std::min(2 * num_candidates, vocab_size);
+        }
+        if (args.output_log_probs != nullptr) {
+            args.output_log_probs[row] = log_prob;
+        }
+        // top_p decay, https://arxiv.org/pdf/2206.04624.pdf
+        top_p_[req] = *output_id == top_p_reset_ids_[req] ? initial_top_p_[req] :
+                                                             std::max(top_p_[req] * top_p_decay_[req], top_p_min_[req]);
+    }
+
+    if (args.cum_log_probs != nullptr) {
+        args.cum_log_probs[row] += log_prob;
+    }
+    if (args.sequence_lengths != nullptr && args.finished != nullptr) {
+        args.sequence_lengths[row] += 1;
+        args.finished[row] = *output_id == end_id;
+    }
+}
+
+template<typename T>
+void CpuDynamicDecodeLayer<T>::applyStopWords(const StepArgs& args, int row)
+{
+    const int              batch_idx = row / args.beam_width;
+    const WordListMatcher& matcher   = stop_words_.matchers[args.ite * args.local_batch_size + batch_idx];
+    if (matcher.isMatch(getWordListState(&stop_words_, args, row, args.step))) {
+        args.finished[row] = true;
+    }
+}
+
+template<typename T>
+void CpuDynamicDecodeLayer<T>::beamSearchStep(const StepArgs& args, int local_batch_id)
+{
+    // One request at a time: the reference decodes the requests [ite * local_batch_size, ...) of a batch, so a
+    // request is the local batch of size 1 at ite = its index in the batch.
+    const int                          K   = args.beam_width;
+    const int                          req = args.ite * args.local_batch_size + local_batch_id;
+    const size_t                       bb  = (size_t)local_batch_id * K;
+    std::vector<BeamSearchRequestArgs> request_args(1);
+    request_args[0].end_id             = args.end_ids[local_batch_id];
+    request_args[0].temperature        = temperature_[req];
+    request_args[0].len_penalty        = len_penalty_[req];
+    request_args[0].repetition_penalty = repetition_penalty_[req];
+    request_args[0].diversity_rate     = diversity_rate_[req];
+    request_args[0].min_length         = min_lengths_[req];
+
+    beamSearchStepReference(args.logits + bb * vocab_size_padded_,
+                            args.embedding_bias,
+                            request_args,
+                            repetition_penalty_type_,
+                            args.input_lengths != nullptr ? args.input_lengths + bb : nullptr,
+                            args.output_ids,
+                            args.parent_ids,
+                            args.sequence_lengths + bb,
+                            args.finished + bb,
+                            args.cum_log_probs + bb,
+                            args.output_log_probs,
+                            args.step,
+                            args.max_input_length,
+                            req,
+                            1,
+                            args.batch_size,
+                            K,
+                            (int)vocab_size_,
+                            (int)vocab_size_padded_);
+
+    // Every beam which is not finished takes the k/v cache indirections of its parent.
+    const int start_step = std::max(0, args.step + 1 - args.max_seq_len);
+    for (int beam = 0; beam < K; beam++) {
+        if (args.finished[bb + beam]) {
+            continue;
+        }
+        const int parent = args.parent_ids[args.step * args.batch_size * K + req * K + beam];
+        int*       tgt    = args.tgt_cache_indirection + (bb + beam) * args.max_seq_len;
+        const int* src    = args.src_cache_indirection + (bb + parent) * args.max_seq_len;
+        for (int t = start_step; t <= args.step; t++) {
+            const int t_circ = t % args.max_seq_len;
+            tgt[t_circ]      = t == args.step ? beam : src[t_circ];
+        }
+    }
+}
+
+template<typename T>
+void CpuDynamicDecodeLayer<T>::forward(std::unordered_map<std::string, Tensor>*       output_tensors,
+                                       const std::unordered_map<std::string, Tensor>* input_tensors)
+{
+    FT_LOG_DEBUG(__PRETTY_FUNCTION__);
+    TensorMap input_map(*input_tensors);
+    TensorMap output_map(*output_tensors);
+    forward(&output_map, &input_map);
+}
+
+template<typename T>
+void CpuDynamicDecodeLayer<T>::forward(TensorMap* output_tensors, TensorMap* input_tensors)
+{
+    /**
+     * @brief Same tensors as DynamicDecodeLayer::forward, all on cpu. The runtime arguments are the ones of setup().
+     *
+     * input_tensors:
+     *   \param  logits [batch_size, beam_width, vocab_size_padded]
+     *   \param  embedding_bias [vocab_size_padded], optional
+     *   \param  step [1] on cpu
+     *   \param  max_input_length [1] on cpu
+     *   \param  input_lengths [batch_size, beam_width], optional
+     *   \param  sequence_limit_length [batch_size], optional
+     *   \param  end_id [batch_size]
+     *   \param  ite [1] on cpu
+     *   \param  local_batch_size [1] on cpu
+     *   \param  stop_words_list [batch_size, 2, stop_words_length], optional
+     *   \param  bad_words_list [2, bad_words_length] or [batch_size, 2, bad_words_length], optional
+     *   \param  src_cache_indirection [local_batch_size, beam_width, max_seq_len], beam search only
+     *
+     * output_tensors:
+     *   \param  output_ids [max_seq_len, batch_size]
+     *   \param  finished [batch_size * beam_width], optional in sampling
+     *   \param  should_stop [1] on cpu, optional
+     *   \param  cum_log_probs [batch_size * beam_width], necessary in beam search
+     *   \param  parent_ids [max_seq_len, batch_size * beam_width], beam search only
+     *   \param  sequence_length [batch_size * beam_width], optional in sampling
+     *   \param  output_log_probs [request_ouptut_length, batch_size * beam_width] in sampling,
+     *               [max_seq_len, batch_size * beam_width] in beam search, must be float*, optional
+     *   \param  tgt_cache_indirection [local_batch_size, beam_width, max_seq_len], beam search only
+     */
+
+    FT_LOG_DEBUG(__PRETTY_FUNCTION__);
+    FT_CHECK(input_tensors->at("logits").shape.size() == 3);
+    FT_CHECK_WITH_INFO(input_tensors->at("logits").where == MEMORY_CPU
+                           && output_tensors->at("output_ids").where == MEMORY_CPU,
+                       "CpuDynamicDecodeLayer only decodes tensors on cpu.");
+    FT_CHECK_WITH_INFO(!output_tensors->isExist("beam_hyps"), "CpuDynamicDecodeLayer does not support beam_hyps.");
+
+    StepArgs args;
+    args.step             = input_tensors->at("step").getVal<int>();
+    args.max_input_length = input_tensors->at("max_input_length").getVal<int>();
+    args.max_seq_len      = (int)output_tensors->at("output_ids").shape[0];
+    args.ite              = input_tensors->at("ite").getVal<int>();
+    args.batch_size       = (int)input_tensors->at("logits").shape[0];
+    args.beam_width       = (int)input_tensors->at("logits").shape[1];
+    args.local_batch_size = input_tensors->at("local_batch_size").getVal<int>();
+    FT_CHECK_WITH_INFO((size_t)args.batch_size == batch_size_ && (size_t)args.beam_width == beam_width_,
+                       fmtstr("setup was called for batch_size %ld and beam_width %ld, got %d and %d.",
+                              batch_size_,
+                              beam_width_,
+                              args.batch_size,
+                              args.beam_width));
+
+    const size_t local_batch_offset = (size_t)args.ite * args.local_batch_size * args.beam_width;
+    const int    num_rows           = args.local_batch_size * args.beam_width;
+
+    args.logits         = input_tensors->at("logits").getPtrWithOffset<T>(local_batch_offset * vocab_size_padded_);
+    args.embedding_bias = input_tensors->getPtr<const T>("embedding_bias", nullptr);
+    args.end_ids        = input_tensors->at("end_id").getPtrWithOffset<const int>(args.ite * args.local_batch_size);
+    args.input_lengths  = input_tensors->getPtrWithOffset<const int>("input_lengths", local_batch_offset, nullptr);
+
+    args.bad_words        = nullptr;
+    args.bad_words_len    = 0;
+    args.shared_bad_words = true;
+    if (input_tensors->isExist("bad_words_list")) {
+        const Tensor& bad_words = input_tensors->at("bad_words_list");
+        FT_CHECK_WITH_INFO(bad_words.shape.size() == 2 || bad_words.shape.size() == 3,
+                           "Bad words dimension must be 2 or 3.");
+        const bool is_matrix = bad_words.shape.size() == 2;
+        if (!is_matrix) {
+            FT_CHECK_WITH_INFO(bad_words.shape[0] == (size_t)args.batch_size,
+                               fmtstr("Shape of dim 0 of bad words is invalid. It must be equal to batch size."
+                                      " However, it is %d and the batch size is %d.",
+                                      bad_words.shape[0],
+                                      args.batch_size));
+        }
+        args.shared_bad_words = is_matrix || bad_words.shape[0] == 1;
+        args.bad_words_len    = bad_words.shape[is_matrix ? 1 : 2];
+        args.bad_words        = args.shared_bad_words ? bad_words.getPtr<const int>() :
+                                                        bad_words.getPtrWithOffset<const int>(
+                                                     (size_t)args.ite * args.local_batch_size * 2 * args.bad_words_len);
+        prepareWordList(&bad_words_, bad_words, args.shared_bad_words);
+    }
+    args.stop_words     = nullptr;
+    args.stop_words_len = 0;
+    if (input_tensors->isExist("stop_words_list")) {
+        args.stop_words_len = input_tensors->at("stop_words_list").shape[2];
+        args.stop_words     = input_tensors->at("stop_words_list")
+                              .getPtrWithOffset<const int>((size_t)args.ite * args.local_batch_size * 2
+                                                           * args.stop_words_len);
+        prepareWordList(&stop_words_, input_tensors->at("stop_words_list"), false);
+    }
+
+    args.output_ids       = output_tensors->at("output_ids").getPtr<int>();
+    args.parent_ids       = output_tensors->getPtr<int>("parent_ids", nullptr);
+    args.sequence_lengths = output_tensors->getPtrWithOffset<int>("sequence_length", local_batch_offset, nullptr);
+    args.finished         = output_tensors->getPtrWithOffset<bool>("finished", local_batch_offset, nullptr);
+    args.cum_log_probs    = output_tensors->getPtrWithOffset<float>("cum_log_probs", local_batch_offset, nullptr);
+    args.output_log_probs = nullptr;
+    if (output_tensors->isExist("output_log_probs")) {
+        args.output_log_probs =
+            args.beam_width > 1 ?
+                output_tensors->getPtr<float>("output_log_probs") :
+                output_tensors->getPtrWithOffset<float>(
+                    "output_log_probs",
+                    (size_t)(args.step - args.max_input_length) * args.batch_size + local_batch_offset);
+    }
+    args.src_cache_indirection = input_tensors->getPtr<const int>("src_cache_indirection", nullptr);
+    args.tgt_cache_indirection = output_tensors->getPtr<int>("tgt_cache_indirection", nullptr);
+
+    const int* min_lengths          = min_lengths_.data() + args.ite * args.local_batch_size;
+    const int  num_generated_tokens = args.step - args.max_input_length;
+    if (args.beam_width > 1) {
+        FT_CHECK_WITH_INFO(args.cum_log_probs != nullptr, "cum_log_probs should be provided in beam search.");
+        FT_CHECK_WITH_INFO(args.parent_ids != nullptr && args.sequence_lengths != nullptr && args.finished != nullptr
+                               && args.src_cache_indirection != nullptr && args.tgt_cache_indirection != nullptr,
+                           "Beam search needs parent_ids, sequence_length, finished and the cache indirections.");
+        parallelFor(args.local_batch_size, [&](int local_batch_id) {
+            if (args.bad_words != nullptr) {
+                for (int beam = 0; beam < args.beam_width; beam++) {
+                    banBadWords(args, local_batch_id * args.beam_width + beam);
+                }
+            }
+            beamSearchStep(args, local_batch_id);
+        });
+    }
+    else {
+        const float* temperatures = temperature_.data() + args.ite * args.local_batch_size;
+        const float* penalties    = repetition_penalty_.data() + args.ite * args.local_batch_size;
+        const float  default_penalty = getDefaultPenaltyValue(repetition_penalty_type_);
+        args.is_apply_temperature =
+            args.embedding_bias != nullptr
+            || std::any_of(temperatures, temperatures + num_rows, [](float t) { return t != 1.0f; });
+        args.is_apply_repetition_penalty =
+            args.step > 1 && repetition_penalty_type_ != RepetitionPenaltyType::None
+            && std::any_of(penalties, penalties + num_rows, [&](float p) { return p != default_penalty; });
+        args.is_apply_min_length = std::any_of(
+            min_lengths, min_lengths + num_rows, [&](int min_length) { return min_length > num_generated_tokens; });
+        FT_CHECK_WITH_INFO(!args.is_apply_min_length || args.sequence_lengths != nullptr,
+                           "Need sequence_length to apply min length penalty");
+
+        parallelFor(num_rows, [&](int row) {
+            if (args.bad_words != nullptr) {
+                banBadWords(args, row);
+            }
+            applyPenalties(args, row);
+            sampleRow(args, row);
+        });
+    }
+
+    if (args.stop_words != nullptr) {
+        FT_CHECK_WITH_INFO(args.finished != nullptr, "Need finished to apply stop words");
+        for (int row = 0; row < num_rows; row++) {
+            applyStopWords(args, row);
+        }
+    }
+
+    if (input_tensors->isExist("sequence_limit_length")) {
+        // As the device layer, the length criterion is checked over the whole batch.
+        bool*           finished = output_tensors->at("finished").getPtr<bool>();
+        const uint32_t* limits   = input_tensors->at("sequence_limit_length").getPtr<const uint32_t>();
+        int             num_finished = 0;
+        for (int i = 0; i < args.batch_size * args.beam_width; i++) {
+            finished[i] |= args.step >= (int)limits[i / args.beam_width];
+            num_finished += finished[i] ? 1 : 0;
+        }
+        if (output_tensors->isExist("should_stop")) {
+            *output_tensors->at("should_stop").getPtr<bool>() = num_finished == args.batch_size * args.beam_width;
+        }
+    }
+}
+
+template class CpuDynamicDecodeLayer<float>;
+template class CpuDynamicDecodeLayer<half>;
+
+}  // namespace fastertransformer
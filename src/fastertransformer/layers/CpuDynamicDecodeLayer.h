@@ -0,0 +1,136 @@
+/*
+ * Copyright (c) 2023, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Host implementation of DynamicDecodeLayer, for logits that live in host memory.
+ *
+ * setup() and forward() take the same TensorMap arguments as DynamicDecodeLayer, but every tensor has to be on the
+ * cpu. One decoding step runs the same pipeline as the device layers:
+ *
+ *   1. ban the bad words, add the embedding bias, apply the temperature, the repetition (or presence) penalty and
+ *      the min length penalty,
+ *   2. sample with top-k (and top-p within the top-k tokens) or top-p, or run one step of beam search through
+ *      beamSearchStepReference,
+ *   3. apply the stop words and the length criterion.
+ *
+ * The stop and bad word lists are compiled into WordListMatchers on their first step after setup(), so they are
+ * expected not to change during a generation, and each sequence keeps its matcher state from one step to the next.
+ * In beam search, where the beams are reordered, the state is rebuilt from the last tokens of the beam.
+ *
+ * The rows of the batch are decoded in parallel by a pool of getCpuDecodeThreadCount() threads, and the top-k/top-p
+ * candidates are selected by a vectorized threshold scan instead of sorting the whole vocabulary. Each request has its
+ * own random stream, seeded from random_seed, so the sampled tokens do not depend on the number of threads. The
+ * streams are not the curand ones: sampled tokens match the device layers when the sampling is deterministic
+ * (top_k = 1, or a random draw far from a decision boundary), and log probs match up to the float rounding.
+ *
+ * As on the device, the logits are used as scratch memory and modified in place.
+ **/
+
+#pragma once
+
+#include "src/fastertransformer/kernels/penalty_types.h"
+#include "src/fastertransformer/utils/Tensor.h"
+#include "src/fastertransformer/utils/host_convert_utils.h"
+#include "src/fastertransformer/utils/host_thread_pool.h"
+#include "src/fastertransformer/utils/word_list.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace fastertransformer {
+
+// FT_CPU_DECODE_THREADS if it is set, otherwise the number of hardware threads.
+int getCpuDecodeThreadCount();
+
+// Indices of the k largest values of values[0, n), by descending value and then ascending index as the device top-k
+// kernels break ties. Only the candidates above the current k-th best value are kept, and they are found with the
+// given instruction set.
+void hostTopK(const float* values, int n, int k, std::vector<int>* indices, HostConvertIsa isa);
+
+inline void hostTopK(const float* values, int n, int k, std::vector<int>* indices)
+{
+    hostTopK(values, n, k, indices, getHostConvertIsa());
+}
+
+template<typename T>
+class CpuDynamicDecodeLayer {
+private:
+    struct StepArgs;
+
+    size_t vocab_size_;
+    size_t vocab_size_padded_;
+    size_t batch_size_ = 0;
+    size_t beam_width_ = 0;
+
+    HostThreadPool pool_;
+
+    // runtime arguments of each request, set by setup()
+    std::vector<uint>     top_k_;
+    std::vector<float>    top_p_;  // decayed after every step of top-p sampling
+    std::vector<float>    initial_top_p_;
+    std::vector<float>    top_p_decay_;
+    std::vector<float>    top_p_min_;
+    std::vector<int>      top_p_reset_ids_;
+    std::vector<float>    temperature_;
+    std::vector<float>    len_penalty_;
+    std::vector<float>    diversity_rate_;
+    std::vector<float>    repetition_penalty_;
+    std::vector<int>      min_lengths_;
+    std::vector<uint64_t> random_state_;
+
+    RepetitionPenaltyType repetition_penalty_type_ = RepetitionPenaltyType::None;
+
+    struct WordListState {
+        const int*                   words     = nullptr;  // the whole list tensor the matchers were compiled from
+        size_t                       words_len = 0;
+        std::vector<WordListMatcher> matchers;     // one per request, or one for all when the list is shared
+        std::vector<int>             states;       // [batch_size * beam_width]
+        std::vector<int>             state_steps;  // the last step fed to each state, -1 if none
+    };
+    WordListState bad_words_;
+    WordListState stop_words_;
+
+    void prepareWordList(WordListState* list, const Tensor& words, bool shared);
+    int  getWordListState(WordListState* list, const StepArgs& args, int row, int last_step);
+
+    void parallelFor(int num_rows, const std::function<void(int)>& func);
+    void banBadWords(const StepArgs& args, int row);
+    void applyPenalties(const StepArgs& args, int row);
+    void sampleRow(const StepArgs& args, int row);
+    void applyStopWords(const StepArgs& args, int row);
+    void beamSearchStep(const StepArgs& args, int local_batch_id);
+
+public:
+    CpuDynamicDecodeLayer(size_t vocab_size, size_t vocab_size_padded, int num_threads = getCpuDecodeThreadCount());
+    CpuDynamicDecodeLayer(CpuDynamicDecodeLayer const&) = delete;
+    void operator=(CpuDynamicDecodeLayer const&)        = delete;
+
+    void setup(const size_t batch_size, const size_t beam_width, TensorMap* runtime_args);
+    void forward(TensorMap* output_tensors, TensorMap* input_tensors);
+    void forward(std::unordered_map<std::string, Tensor>*       output_tensors,
+                 const std::unordered_map<std::string, Tensor>* input_tensors);
+
+    int getNumThreads() const
+    {
+        return std::max(pool_.getNumThreads(), 1);
+    }
+};
+
+}  // namespace fastertransformer
@@ -23,6 +23,8 @@
 #include "src/fastertransformer/layers/sampling_layers/TopKSamplingLayer.h"
 #include "src/fastertransformer/layers/sampling_layers/TopPSamplingLayer.h"
 
+#include <cstring>
+
 namespace fastertransformer {
 
 template<typename T>
@@ -170,11 +172,13 @@ void DynamicDecodeLayer<T>::setup(const size_t batch_size, const size_t beam_wid
      */
 
     FT_LOG_DEBUG(__PRETTY_FUNCTION__);
-    has_diff_runtime_args_ = hasDiffRuntimeArgs(runtime_args);
     if (beam_width == 1) {  // sampling layers
         topk_decode_->setup(batch_size, beam_width, runtime_args);
         topp_decode_->setup(batch_size, beam_width, runtime_args);
     }
+    else {  // beam search layers, which take the runtime arguments of each request
+        online_beamsearch_decode_->setup(batch_size, beam_width, runtime_args);
+    }
 }
 
 template<typename T>
@@ -236,16 +240,16 @@ void DynamicDecodeLayer<T>::forward(TensorMap* output_tensors, TensorMap* input_
      */
 
     FT_LOG_DEBUG(__PRETTY_FUNCTION__);
-    const int ite  = (int)input_tensors->at("ite").getVal<uint>();
-    const int step = input_tensors->at("step").getVal<int>();
-    FT_CHECK(input_tensors->at("logits").shape.size() == 3);
+    const int ite  = (int)input_tensors->at(tensor_keys::ite).getVal<uint>();
+    const int step = input_tensors->at(tensor_keys::step).getVal<int>();
+    FT_CHECK(input_tensors->at(tensor_keys::logits).shape.size() == 3);
 
-    const size_t batch_size       = input_tensors->at("logits").shape[0];
-    const size_t beam_width       = input_tensors->at("logits").shape[1];
-    const size_t local_batch_size = (size_t)input_tensors->at("local_batch_size").getVal<int>();
+    const size_t batch_size       = input_tensors->at(tensor_keys::logits).shape[0];
+    const size_t beam_width       = input_tensors->at(tensor_keys::logits).shape[1];
+    const size_t local_batch_size = (size_t)input_tensors->at(tensor_keys::local_batch_size).getVal<int>();
 
-    if (input_tensors->isExist("bad_words_list")) {
-        const auto& bad_words     = input_tensors->at("bad_words_list");
+    if (input_tensors->isExist(tensor_keys::bad_words_list)) {
+        const auto& bad_words     = input_tensors->at(tensor_keys::bad_words_list);
         const int*  bad_words_ptr = bad_words.getPtr<const int>();
         FT_CHECK_WITH_INFO(bad_words.shape.size() == 2 || bad_words.shape.size() == 3,
                            "Bad words dimension must be 2 or 3.");
@@ -265,9 +269,9 @@ void DynamicDecodeLayer<T>::forward(TensorMap* output_tensors, TensorMap* input_
         const int id_offset                      = ite * local_batch_size;
         const int decode_vocab_size_units_offset = id_offset * vocab_size_padded_;
 
-        invokeBanBadWords((T*)input_tensors->at("logits").getPtrWithOffset(decode_vocab_size_units_offset),
-                          output_tensors->at("output_ids").getPtr<const int>(),
-                          beam_width > 1 ? output_tensors->at("parent_ids").getPtr<const int>() : nullptr,
+        invokeBanBadWords((T*)input_tensors->at(tensor_keys::logits).getPtrWithOffset(decode_vocab_size_units_offset),
+                          output_tensors->at(tensor_keys::output_ids).getPtr<const int>(),
+                          beam_width > 1 ? output_tensors->at(tensor_keys::parent_ids).getPtr<const int>() : nullptr,
                           batch_size,
                           local_batch_size,
                           beam_width,
@@ -284,154 +288,133 @@ void DynamicDecodeLayer<T>::forward(TensorMap* output_tensors, TensorMap* input_
 
     // dynamic decode GPT
     if (beam_width > 1) {
-        // Because we still not support batch beam search now, so we need to compute one by one if there are different
-        // runtime arguments.
-        const size_t dynamic_decode_batch_size      = has_diff_runtime_args_ ? 1 : local_batch_size;
-        const int    dynamic_decode_total_iteration = local_batch_size / dynamic_decode_batch_size;
-
-        for (uint dynamic_ite = ite * dynamic_decode_total_iteration;
-             dynamic_ite < (ite + 1) * dynamic_decode_total_iteration;
-             ++dynamic_ite) {
-            const int dynamic_id_offset                      = dynamic_ite * dynamic_decode_batch_size * beam_width;
-            const int dynamic_decode_vocab_size_units_offset = dynamic_id_offset * vocab_size_padded_;
-
-            // common inputs
-            Tensor logits = input_tensors->at("logits");
-            Tensor end_id = input_tensors->at("end_id");
-
-            TensorMap dynamic_decode_input_tensors(
-                {{"logits",
-                  Tensor{logits.where,
-                         logits.type,
-                         {dynamic_decode_batch_size, logits.shape[1], logits.shape[2]},
-                         logits.getPtrWithOffset(dynamic_decode_vocab_size_units_offset)}},
-                 {"step", input_tensors->at("step")},
-                 {"max_input_length", input_tensors->at("max_input_length")},
-                 {"end_id",
-                  Tensor{end_id.where,
-                         end_id.type,
-                         {dynamic_decode_batch_size},
-                         end_id.getPtrWithOffset(dynamic_ite * dynamic_decode_batch_size)}},
-                 {"ite", Tensor{MEMORY_CPU, TYPE_UINT32, {1}, &dynamic_ite}}});
-
-            if (input_tensors->isExist("embedding_bias")) {
-                dynamic_decode_input_tensors.insert({"embedding_bias", input_tensors->at("embedding_bias")});
-            }
-            if (input_tensors->isExist("input_lengths")) {
-                Tensor input_lengths = input_tensors->at("input_lengths");
-                dynamic_decode_input_tensors.insert(
-                    {"input_lengths",
-                     input_lengths.slice({dynamic_decode_batch_size, input_lengths.shape[1]}, dynamic_id_offset)});
-            }
-            for (auto t = input_tensors->begin(); t != input_tensors->end(); ++t) {
-                if (t->first.find("random_seed") == std::string::npos) {
-                    dynamic_decode_input_tensors.insert(*t);
-                }
-            }
+        // Beam search takes the runtime arguments of each request (see setup), so the requests of a local batch are
+        // decoded at once even if their arguments differ.
+        const size_t local_batch_offset = ite * local_batch_size * beam_width;
 
-            // common outputs
-            TensorMap dynamic_decode_output_tensors({{"output_ids", output_tensors->at("output_ids")}});
-            if (output_tensors->isExist("sequence_length")) {
-                Tensor sequence_length = output_tensors->at("sequence_length");
-                dynamic_decode_output_tensors.insert({"sequence_length",
-                                                      Tensor{sequence_length.where,
-                                                             sequence_length.type,
-                                                             {dynamic_decode_batch_size * beam_width},
-                                                             sequence_length.getPtrWithOffset(dynamic_id_offset)}});
-            }
-            if (output_tensors->isExist("finished")) {
-                Tensor finished = output_tensors->at("finished");
-                dynamic_decode_output_tensors.insert({"finished",
-                                                      Tensor{finished.where,
-                                                             finished.type,
-                                                             {dynamic_decode_batch_size * beam_width},
-                                                             finished.getPtrWithOffset(dynamic_id_offset)}});
-            }
-            if (output_tensors->isExist("cum_log_probs")) {
-                Tensor cum_log_probs = output_tensors->at("cum_log_probs");
-                dynamic_decode_output_tensors.insert({"cum_log_probs",
-                                                      Tensor{cum_log_probs.where,
-                                                             cum_log_probs.type,
-                                                             {dynamic_decode_batch_size * beam_width},
-                                                             cum_log_probs.getPtrWithOffset(dynamic_id_offset)}});
-            }
-            if (output_tensors->isExist("beam_hyps")) {
-                dynamic_decode_output_tensors.insert("beam_hyps", output_tensors->at("beam_hyps"));
+        // common inputs
+        Tensor logits = input_tensors->at(tensor_keys::logits);
+        Tensor end_id = input_tensors->at(tensor_keys::end_id);
+
+        TensorMap dynamic_decode_input_tensors;
+        dynamic_decode_input_tensors.insert(
+            tensor_keys::logits,
+            logits.slice({local_batch_size, beam_width, logits.shape[2]}, local_batch_offset * logits.shape[2]));
+        dynamic_decode_input_tensors.insert(tensor_keys::step, input_tensors->at(tensor_keys::step));
+        dynamic_decode_input_tensors.insert(tensor_keys::max_input_length,
+                                            input_tensors->at(tensor_keys::max_input_length));
+        dynamic_decode_input_tensors.insert(tensor_keys::end_id,
+                                            end_id.slice({local_batch_size}, ite * local_batch_size));
+        dynamic_decode_input_tensors.insert(tensor_keys::ite, Tensor{MEMORY_CPU, TYPE_INT32, {1}, &ite});
+
+        if (input_tensors->isExist(tensor_keys::embedding_bias)) {
+            dynamic_decode_input_tensors.insertIfValid(tensor_keys::embedding_bias,
+                                                       input_tensors->at(tensor_keys::embedding_bias));
+        }
+        if (input_tensors->isExist(tensor_keys::input_lengths)) {
+            Tensor input_lengths = input_tensors->at(tensor_keys::input_lengths);
+            dynamic_decode_input_tensors.insert(
+                tensor_keys::input_lengths, input_lengths.slice({local_batch_size, beam_width}, local_batch_offset));
+        }
+        for (auto t = input_tensors->begin(); t != input_tensors->end(); ++t) {
+            if (std::strstr(t->first.c_str(), "random_seed") == nullptr) {
+                dynamic_decode_input_tensors.insertIfValid(t->first, t->second);
             }
+        }
 
-            if (output_tensors->isExist("output_log_probs")) {
-                dynamic_decode_output_tensors.insert({"output_log_probs", output_tensors->at("output_log_probs")});
-            }
+        // common outputs
+        TensorMap dynamic_decode_output_tensors;
+        dynamic_decode_output_tensors.insert(tensor_keys::output_ids, output_tensors->at(tensor_keys::output_ids));
+        if (output_tensors->isExist(tensor_keys::sequence_length)) {
+            Tensor sequence_length = output_tensors->at(tensor_keys::sequence_length);
+            dynamic_decode_output_tensors.insert(
+                tensor_keys::sequence_length,
+                sequence_length.slice({local_batch_size * beam_width}, local_batch_offset));
+        }
+        if (output_tensors->isExist(tensor_keys::finished)) {
+            Tensor finished = output_tensors->at(tensor_keys::finished);
+            dynamic_decode_output_tensors.insert(tensor_keys::finished,
+                                                 finished.slice({local_batch_size * beam_width}, local_batch_offset));
+        }
+        if (output_tensors->isExist(tensor_keys::cum_log_probs)) {
+            Tensor cum_log_probs = output_tensors->at(tensor_keys::cum_log_probs);
+            dynamic_decode_output_tensors.insert(
+                tensor_keys::cum_log_probs, cum_log_probs.slice({local_batch_size * beam_width}, local_batch_offset));
+        }
+        if (output_tensors->isExist(tensor_keys::beam_hyps)) {
+            dynamic_decode_output_tensors.insert(tensor_keys::beam_hyps, output_tensors->at(tensor_keys::beam_hyps));
+        }
 
-            dynamic_decode_input_tensors.insert({"src_cache_indirection", input_tensors->at("src_cache_indirection")});
+        if (output_tensors->isExist(tensor_keys::output_log_probs)) {
+            dynamic_decode_output_tensors.insertIfValid(tensor_keys::output_log_probs,
+                                                        output_tensors->at(tensor_keys::output_log_probs));
+        }
 
-            dynamic_decode_output_tensors.insert({"parent_ids", output_tensors->at("parent_ids")});
-            dynamic_decode_output_tensors.insert(
-                {"tgt_cache_indirection", output_tensors->at("tgt_cache_indirection")});
+        FT_CHECK_WITH_INFO(dynamic_decode_input_tensors.isExist(tensor_keys::src_cache_indirection),
+                           "src_cache_indirection should be provided in beam search.");
 
-            FT_CHECK_WITH_INFO(dynamic_decode_output_tensors.isExist("cum_log_probs"),
-                               "cum_log_probs should be provided in beam search.");
+        dynamic_decode_output_tensors.insert(tensor_keys::parent_ids, output_tensors->at(tensor_keys::parent_ids));
+        dynamic_decode_output_tensors.insert(tensor_keys::tgt_cache_indirection,
+                                             output_tensors->at(tensor_keys::tgt_cache_indirection));
 
-            if (true || beam_width < 16
-                || (output_tensors->isExist("beam_hyps")
-                    && input_tensors->getVal<float>("beam_search_diversity_rate", 0.0f) != 0.0f)) {
-                // only online_beamsearch_decode_ support beam_search_diversity_rate when beam_hyps is used
-                online_beamsearch_decode_->forward(&dynamic_decode_output_tensors, &dynamic_decode_input_tensors);
-            }
-            else {
-                FT_CHECK(false);  // deprecate this module
-                beamsearch_decode_->forward(&dynamic_decode_output_tensors, &dynamic_decode_input_tensors);
-            }
-        }  // end of dynamic_ite
+        FT_CHECK_WITH_INFO(dynamic_decode_output_tensors.isExist(tensor_keys::cum_log_probs),
+                           "cum_log_probs should be provided in beam search.");
+
+        // only online_beamsearch_decode_ support beam_search_diversity_rate when beam_hyps is used, beamsearch_decode_
+        // is deprecated.
+        online_beamsearch_decode_->forward(&dynamic_decode_output_tensors, &dynamic_decode_input_tensors);
     }
     else {  // beam_width=1
         // In sampling, we have supported batch sampling. So, we always compute all sentences once.
         const size_t local_batch_offset = ite * local_batch_size * beam_width;
 
-        Tensor logits = input_tensors->at("logits");
-        Tensor end_id = input_tensors->at("end_id");
-
-        TensorMap decode_input_tensors(
-            {{"logits",
-              logits.slice({local_batch_size, beam_width, logits.shape[2]}, local_batch_offset * logits.shape[2])},
-             {"step", input_tensors->at("step")},
-             {"max_input_length", input_tensors->at("max_input_length")},
-             {"end_id", end_id.slice({local_batch_size}, ite * local_batch_size)},
-             {"ite", Tensor{MEMORY_CPU, TYPE_INT32, {1}, &ite}}});
-
-        if (input_tensors->isExist("embedding_bias")) {
-            decode_input_tensors.insert({"embedding_bias", input_tensors->at("embedding_bias")});
+        Tensor logits = input_tensors->at(tensor_keys::logits);
+        Tensor end_id = input_tensors->at(tensor_keys::end_id);
+
+        TensorMap decode_input_tensors;
+        decode_input_tensors.insert(
+            tensor_keys::logits,
+            logits.slice({local_batch_size, beam_width, logits.shape[2]}, local_batch_offset * logits.shape[2]));
+        decode_input_tensors.insert(tensor_keys::step, input_tensors->at(tensor_keys::step));
+        decode_input_tensors.insert(tensor_keys::max_input_length, input_tensors->at(tensor_keys::max_input_length));
+        decode_input_tensors.insert(tensor_keys::end_id, end_id.slice({local_batch_size}, ite * local_batch_size));
+        decode_input_tensors.insert(tensor_keys::ite, Tensor{MEMORY_CPU, TYPE_INT32, {1}, &ite});
+
+        if (input_tensors->isExist(tensor_keys::embedding_bias)) {
+            decode_input_tensors.insertIfValid(tensor_keys::embedding_bias,
+                                               input_tensors->at(tensor_keys::embedding_bias));
         }
-        if (input_tensors->isExist("input_lengths")) {
-            Tensor input_lengths = input_tensors->at("input_lengths");
-            decode_input_tensors.insert(
-                {"input_lengths", input_lengths.slice({local_batch_size, beam_width}, local_batch_offset)});
+        if (input_tensors->isExist(tensor_keys::input_lengths)) {
+            Tensor input_lengths = input_tensors->at(tensor_keys::input_lengths);
+            decode_input_tensors.insert(tensor_keys::input_lengths,
+                                        input_lengths.slice({local_batch_size, beam_width}, local_batch_offset));
         }
 
-        TensorMap decode_output_tensors({{"output_ids", output_tensors->at("output_ids")}});
-        if (output_tensors->isExist("sequence_length")) {
-            Tensor sequence_length = output_tensors->at("sequence_length");
-            decode_output_tensors.insert(
-                {"sequence_length", sequence_length.slice({local_batch_size * beam_width}, local_batch_offset)});
+        TensorMap decode_output_tensors;
+        decode_output_tensors.insert(tensor_keys::output_ids, output_tensors->at(tensor_keys::output_ids));
+        if (output_tensors->isExist(tensor_keys::sequence_length)) {
+            Tensor sequence_length = output_tensors->at(tensor_keys::sequence_length);
+            decode_output_tensors.insert(tensor_keys::sequence_length,
+                                         sequence_length.slice({local_batch_size * beam_width}, local_batch_offset));
         }
-        if (output_tensors->isExist("finished")) {
-            Tensor finished = output_tensors->at("finished");
-            decode_output_tensors.insert(
-                {"finished", finished.slice({local_batch_size * beam_width}, local_batch_offset)});
+        if (output_tensors->isExist(tensor_keys::finished)) {
+            Tensor finished = output_tensors->at(tensor_keys::finished);
+            decode_output_tensors.insert(tensor_keys::finished,
+                                         finished.slice({local_batch_size * beam_width}, local_batch_offset));
         }
-        if (output_tensors->isExist("cum_log_probs")) {
-            Tensor cum_log_probs = output_tensors->at("cum_log_probs");
-            decode_output_tensors.insert(
-                {"cum_log_probs", cum_log_probs.slice({local_batch_size * beam_width}, local_batch_offset)});
+        if (output_tensors->isExist(tensor_keys::cum_log_probs)) {
+            Tensor cum_log_probs = output_tensors->at(tensor_keys::cum_log_probs);
+            decode_output_tensors.insert(tensor_keys::cum_log_probs,
+                                         cum_log_probs.slice({local_batch_size * beam_width}, local_batch_offset));
         }
-        if (output_tensors->isExist("output_log_probs")) {
-            Tensor output_log_probs = output_tensors->at("output_log_probs");
-            int    max_input_length = input_tensors->at("max_input_length").getVal<int>();
+        if (output_tensors->isExist(tensor_keys::output_log_probs)) {
+            Tensor output_log_probs = output_tensors->at(tensor_keys::output_log_probs);
+            int    max_input_length = input_tensors->at(tensor_keys::max_input_length).getVal<int>();
             size_t step_offset      = (step - max_input_length) * batch_size * beam_width;
-            decode_output_tensors.insert({"output_log_probs",
-                                          output_log_probs.slice({output_log_probs.shape[0] - (step - max_input_length),
-                                                                  local_batch_size * beam_width},
-                                                                 step_offset + local_batch_offset)});
+            decode_output_tensors.insert(tensor_keys::output_log_probs,
+                                         output_log_probs.slice({output_log_probs.shape[0] - (step - max_input_length),
+                                                                 local_batch_size * beam_width},
+                                                                step_offset + local_batch_offset));
         }
 
         // Run topk / topp decode layers.
@@ -444,15 +427,15 @@ void DynamicDecodeLayer<T>::forward(TensorMap* output_tensors, TensorMap* input_
         topp_decode_->forward(&decode_output_tensors, &decode_input_tensors);
     }
 
-    if (input_tensors->isExist("stop_words_list")) {
+    if (input_tensors->isExist(tensor_keys::stop_words_list)) {
         const size_t id_offset         = ite * local_batch_size * beam_width;
-        const size_t stop_words_length = input_tensors->at("stop_words_list").shape[2];
+        const size_t stop_words_length = input_tensors->at(tensor_keys::stop_words_list).shape[2];
 
-        invokeStopWordsCriterion(output_tensors->at("output_ids").getPtr<const int>(),
-                                 output_tensors->at("parent_ids").getPtr<const int>(),
-                                 input_tensors->at("stop_words_list")
+        invokeStopWordsCriterion(output_tensors->at(tensor_keys::output_ids).getPtr<const int>(),
+                                 output_tensors->at(tensor_keys::parent_ids).getPtr<const int>(),
+                                 input_tensors->at(tensor_keys::stop_words_list)
                                      .getPtrWithOffset<const int>(ite * local_batch_size * 2 * stop_words_length),
-                                 output_tensors->at("finished").getPtrWithOffset<bool>(id_offset),
+                                 output_tensors->at(tensor_keys::finished).getPtrWithOffset<bool>(id_offset),
                                  id_offset,
                                  stop_words_length,
                                  batch_size,
@@ -461,11 +444,11 @@ void DynamicDecodeLayer<T>::forward(TensorMap* output_tensors, TensorMap* input_
                                  stream_);
     }
 
-    if (input_tensors->isExist("sequence_limit_length")) {
-        invokeLengthCriterion(output_tensors->at("finished").getPtr<bool>(),
-                              output_tensors->at("should_stop").getPtr<bool>(),
+    if (input_tensors->isExist(tensor_keys::sequence_limit_length)) {
+        invokeLengthCriterion(output_tensors->at(tensor_keys::finished).getPtr<bool>(),
+                              output_tensors->at(tensor_keys::should_stop).getPtr<bool>(),
                               h_pinned_finished_sum_,
-                              input_tensors->at("sequence_limit_length").getPtr<const uint32_t>(),
+                              input_tensors->at(tensor_keys::sequence_limit_length).getPtr<const uint32_t>(),
                               batch_size,
                               beam_width,
                               step,
@@ -473,46 +456,6 @@ void DynamicDecodeLayer<T>::forward(TensorMap* output_tensors, TensorMap* input_
     }
 }
 
-template<typename T>
-bool DynamicDecodeLayer<T>::hasDiffRuntimeArgs(TensorMap* input_tensors)
-{
-    for (int i = 0; i < (int)runtime_arg_names_.size(); i++) {
-        if (input_tensors->isExist(runtime_arg_names_[i])) {
-            auto tensor = input_tensors->at(runtime_arg_names_[i]);
-            FT_CHECK(tensor.shape.size() == 1);
-            for (int j = 1; j < (int)tensor.shape[0]; j++) {
-                const void* data = tensor.data;
-                switch (tensor.type) {
-                    case TYPE_FP32:
-                        if (((const float*)data)[0] != ((const float*)data)[j]) {
-                            return true;
-                        }
-                        break;
-                    case TYPE_INT32:
-                        if (((const int*)data)[0] != ((const int*)data)[j]) {
-                            return true;
-                        }
-                        break;
-                    case TYPE_UINT32:
-                        if (((const uint*)data)[0] != ((const uint*)data)[j]) {
-                            return true;
-                        }
-                        break;
-                    case TYPE_UINT64:
-                        if (((const unsigned long long int*)data)[0] != ((const unsigned long long int*)data)[j]) {
-                            return true;
-                        }
-                        break;
-                    default:
-                        FT_CHECK_WITH_INFO(false, runtime_arg_names_[i] + ": " + tensor.toString() + " is invalid.");
-                        break;
-                }
-            }
-        }
-    }
-    return false;
-}
-
 template class DynamicDecodeLayer<float>;
 template class DynamicDecodeLayer<half>;
 
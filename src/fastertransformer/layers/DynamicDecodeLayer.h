@@ -32,7 +32,6 @@ protected:
     void allocateBuffer() override;
     void freeBuffer() override;
     void initialize();
-    bool hasDiffRuntimeArgs(TensorMap* input_tensors);
 
     DynamicDecodeBaseLayer* online_beamsearch_decode_;
     DynamicDecodeBaseLayer* beamsearch_decode_;
@@ -43,16 +42,6 @@ protected:
     size_t          vocab_size_padded_;
     cudaDeviceProp* cuda_device_prop_;
 
-    // List of argument names which can have different values in runtime
-    // and does not support a batched version of kernel in beam search.
-    const std::vector<std::string> runtime_arg_names_ = {"beam_search_diversity_rate",
-                                                         "temperature",
-                                                         "len_penalty",
-                                                         "repetition_penalty",
-                                                         "presence_penalty",
-                                                         "min_length"};
-
-    bool has_diff_runtime_args_ = false;
     int* h_pinned_finished_sum_ = nullptr;
 
 public:
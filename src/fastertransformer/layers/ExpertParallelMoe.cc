@@ -0,0 +1,224 @@
+/*
+ * Copyright (c) 2023, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/fastertransformer/layers/ExpertParallelMoe.h"
+#include "src/fastertransformer/utils/cuda_utils.h"
+#include "src/fastertransformer/utils/nvtx_utils.h"
+
+#include <algorithm>
+
+namespace fastertransformer {
+
+float ExpertLoad::getImbalance() const
+{
+    int64_t total = 0, busiest = 0;
+    for (int64_t routed : routed_tokens) {
+        total += routed;
+        busiest = std::max(busiest, routed);
+    }
+    return total == 0 ? 1.0f : (float)busiest * routed_tokens.size() / total;
+}
+
+template<typename T>
+ExpertParallelMoe<T>::ExpertParallelMoe(size_t       expert_num,
+                                        size_t       hidden_units,
+                                        NcclParam    expert_para,
+                                        float        capacity_factor,
+                                        cudaStream_t stream,
+                                        IAllocator*  allocator):
+    expert_num_(expert_num),
+    local_expert_num_(expert_num / expert_para.world_size_),
+    hidden_units_(hidden_units),
+    expert_para_(expert_para),
+    capacity_factor_(capacity_factor),
+    stream_(stream),
+    allocator_(allocator)
+{
+    FT_CHECK_WITH_INFO(expert_num > 0 && expert_num % expert_para.world_size_ == 0,
+                       fmtstr("the %zu experts cannot be split across %d ranks", expert_num, expert_para.world_size_));
+    expert_load_ = (int64_t*)allocator_->reMalloc(expert_load_, sizeof(int64_t) * 2 * expert_num_, true);
+}
+
+template<typename T>
+ExpertParallelMoe<T>::~ExpertParallelMoe()
+{
+    freeBuffer();
+    allocator_->free((void**)(&expert_load_));
+}
+
+template<typename T>
+void ExpertParallelMoe<T>::allocateBuffer(size_t num_rows, size_t k, size_t capacity, size_t inter_size)
+{
+    // The slots of all the experts, and the ones of the local experts.
+    const size_t num_slots         = expert_num_ * capacity;
+    const size_t num_grouped_slots = local_expert_num_ * capacity;
+
+    softmax_buf_ = (T*)allocator_->reMalloc(softmax_buf_, sizeof(T) * num_rows * expert_num_, false);
+    source_rows_ = (int*)allocator_->reMalloc(source_rows_, sizeof(int) * k * num_rows, false);
+    slot_for_expanded_row_ =
+        (int*)allocator_->reMalloc(slot_for_expanded_row_, sizeof(int) * k * num_rows, false);
+    slot_rows_     = (int*)allocator_->reMalloc(slot_rows_, sizeof(int) * num_slots, false);
+    expert_counts_ = (int*)allocator_->reMalloc(expert_counts_, sizeof(int) * expert_num_, false);
+    slot_buf_      = (T*)allocator_->reMalloc(slot_buf_, sizeof(T) * num_slots * hidden_units_, false);
+    total_rows_before_expert_ =
+        (int64_t*)allocator_->reMalloc(total_rows_before_expert_, sizeof(int64_t) * local_expert_num_, false);
+    grouped_row_slots_ = (int*)allocator_->reMalloc(grouped_row_slots_, sizeof(int) * num_grouped_slots, false);
+    slot_grouped_rows_ = (int*)allocator_->reMalloc(slot_grouped_rows_, sizeof(int) * num_grouped_slots, false);
+    grouped_input_ =
+        (T*)allocator_->reMalloc(grouped_input_, sizeof(T) * num_grouped_slots * hidden_units_, false);
+    grouped_output_ =
+        (T*)allocator_->reMalloc(grouped_output_, sizeof(T) * num_grouped_slots * hidden_units_, false);
+    fc1_result_ = (T*)allocator_->reMalloc(fc1_result_, sizeof(T) * num_grouped_slots * inter_size, false);
+}
+
+template<typename T>
+void ExpertParallelMoe<T>::freeBuffer()
+{
+    allocator_->free((void**)(&softmax_buf_));
+    allocator_->free((void**)(&source_rows_));
+    allocator_->free((void**)(&slot_for_expanded_row_));
+    allocator_->free((void**)(&slot_rows_));
+    allocator_->free((void**)(&expert_counts_));
+    allocator_->free((void**)(&slot_buf_));
+    allocator_->free((void**)(&total_rows_before_expert_));
+    allocator_->free((void**)(&grouped_row_slots_));
+    allocator_->free((void**)(&slot_grouped_rows_));
+    allocator_->free((void**)(&grouped_input_));
+    allocator_->free((void**)(&grouped_output_));
+    allocator_->free((void**)(&fc1_result_));
+}
+
+template<typename T>
+void ExpertParallelMoe<T>::forward(T*                        fc2_result,
+                                   T*                        expert_scales,
+                                   int*                      expanded_source_row_to_expanded_dest_row,
+                                   int*                      expert_for_source_row,
+                                   const T*                  input,
+                                   const T*                  gating_output,
+                                   const FfnWeight<T>*       ffn_weights,
+                                   ActivationType            activation_type,
+                                   size_t                    num_rows,
+                                   size_t                    inter_size,
+                                   size_t                    k,
+                                   CutlassMoeFCRunner<T, T>* moe_fc_runner)
+{
+    FT_LOG_DEBUG(__PRETTY_FUNCTION__);
+    const size_t capacity = getMoeExpertCapacity(num_rows, k, expert_num_, capacity_factor_);
+    allocateBuffer(num_rows, k, capacity, inter_size);
+
+    PUSH_RANGE("MoE dispatch");
+    topk_gating_softmax_kernelLauncher<T>(gating_output,
+                                          nullptr,
+                                          expert_scales,
+                                          softmax_buf_,
+                                          expert_for_source_row,
+                                          source_rows_,
+                                          num_rows,
+                                          expert_num_,
+                                          k,
+                                          stream_);
+    invokePlanMoeDispatch(slot_for_expanded_row_,
+                          slot_rows_,
+                          expert_counts_,
+                          expert_load_,
+                          expert_for_source_row,
+                          num_rows,
+                          expert_num_,
+                          k,
+                          capacity,
+                          stream_);
+    sync_check_cuda_error();
+
+    // The slots of the local experts, and the rows they start at in the slots of all the experts.
+    const size_t local_slot_num   = local_expert_num_ * capacity;
+    const size_t local_slot_begin = expert_para_.rank_ * local_slot_num;
+    invokePermuteMoeRows(
+        slot_buf_, input, slot_rows_ + local_slot_begin, local_slot_num, 0, num_rows, hidden_units_, stream_);
+    invokeBuildExpertRowMaps(total_rows_before_expert_,
+                             grouped_row_slots_,
+                             slot_grouped_rows_,
+                             expert_counts_ + expert_para_.rank_ * local_expert_num_,
+                             1,
+                             local_expert_num_,
+                             capacity,
+                             stream_);
+    invokePermuteMoeRows(
+        grouped_input_, slot_buf_, grouped_row_slots_, local_slot_num, 0, local_slot_num, hidden_units_, stream_);
+    sync_check_cuda_error();
+    POP_RANGE;
+
+    PUSH_RANGE("MoE experts");
+    moe_fc_runner->run_expert_fc(grouped_input_,
+                                 ffn_weights->intermediate_weight.kernel,
+                                 nullptr,
+                                 ffn_weights->intermediate_weight.bias,
+                                 activation_type,
+                                 ffn_weights->output_weight.kernel,
+                                 nullptr,
+                                 total_rows_before_expert_,
+                                 local_slot_num,
+                                 hidden_units_,
+                                 inter_size,
+                                 local_expert_num_,
+                                 fc1_result_,
+                                 grouped_output_,
+                                 stream_);
+    POP_RANGE;
+
+    PUSH_RANGE("MoE combine");
+    invokePermuteMoeRows(
+        slot_buf_, grouped_output_, slot_grouped_rows_, local_slot_num, 0, local_slot_num, hidden_units_, stream_);
+    // The rows of the experts of the other ranks are zeros.
+    invokePermuteMoeRows(fc2_result,
+                         slot_buf_,
+                         slot_for_expanded_row_,
+                         k * num_rows,
+                         local_slot_begin,
+                         local_slot_num,
+                         hidden_units_,
+                         stream_);
+    invokeDropMoeScales(
+        expert_scales, expanded_source_row_to_expanded_dest_row, slot_for_expanded_row_, num_rows, k, stream_);
+    sync_check_cuda_error();
+    POP_RANGE;
+}
+
+template<typename T>
+ExpertLoad ExpertParallelMoe<T>::getExpertLoad() const
+{
+    std::vector<int64_t> load(2 * expert_num_);
+    check_cuda_error(cudaStreamSynchronize(stream_));
+    check_cuda_error(cudaMemcpy(load.data(), expert_load_, sizeof(int64_t) * load.size(), cudaMemcpyDeviceToHost));
+
+    ExpertLoad expert_load;
+    expert_load.routed_tokens.assign(load.begin(), load.begin() + expert_num_);
+    expert_load.dropped_tokens.assign(load.begin() + expert_num_, load.end());
+    return expert_load;
+}
+
+template<typename T>
+void ExpertParallelMoe<T>::resetExpertLoad()
+{
+    check_cuda_error(cudaMemsetAsync(expert_load_, 0, sizeof(int64_t) * 2 * expert_num_, stream_));
+}
+
+template class ExpertParallelMoe<float>;
+template class ExpertParallelMoe<half>;
+#ifdef ENABLE_BF16
+template class ExpertParallelMoe<__nv_bfloat16>;
+#endif
+
+}  // namespace fastertransformer
@@ -0,0 +1,121 @@
+/*
+ * Copyright (c) 2023, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * The experts of a MoE layer split across the ranks of expert_para, each rank holding num_experts / world_size whole
+ * experts instead of a slice of every expert.
+ *
+ * The tokens are routed with a capacity per expert (moe_dispatch_kernels.h). The ranks must hold the same tokens, as
+ * the FFN inputs under tensor parallelism: each rank runs its experts on their slots and writes the rows of the other
+ * experts as zeros, so the all reduce of the FFN output combines them.
+ *
+ * The outputs are those of CutlassMoeFCRunner::run_moe_fc for finalize_moe_routing_kernelLauncher, with the scales of
+ * the dropped rows set to 0.
+ *
+ * Weights of a rank: the FFN kernels [num_experts / world_size, hidden_units, inter_size] and intermediate bias
+ * [num_experts / world_size, inter_size] of its experts, the gating kernel and the output bias of all the experts.
+ **/
+
+#pragma once
+
+#include "src/fastertransformer/kernels/moe_dispatch_kernels.h"
+#include "src/fastertransformer/kernels/moe_kernels.h"
+#include "src/fastertransformer/layers/FfnWeight.h"
+#include "src/fastertransformer/utils/activation_types.h"
+#include "src/fastertransformer/utils/allocator.h"
+#include "src/fastertransformer/utils/nccl_utils.h"
+
+#include <vector>
+
+namespace fastertransformer {
+
+// The rows routed to each expert by the forwards since the last reset, summed over the MoE layers, and the rows it
+// dropped once full.
+struct ExpertLoad {
+    std::vector<int64_t> routed_tokens;
+    std::vector<int64_t> dropped_tokens;
+
+    // The load of the busiest expert over the mean load, 1 for a balanced routing.
+    float getImbalance() const;
+};
+
+template<typename T>
+class ExpertParallelMoe {
+private:
+    size_t       expert_num_;
+    size_t       local_expert_num_;
+    size_t       hidden_units_;
+    NcclParam    expert_para_;
+    float        capacity_factor_;
+    cudaStream_t stream_;
+    IAllocator*  allocator_;
+
+    T*       softmax_buf_              = nullptr;
+    int*     source_rows_              = nullptr;
+    int*     slot_for_expanded_row_    = nullptr;
+    int*     slot_rows_                = nullptr;
+    int*     expert_counts_            = nullptr;
+    T*       slot_buf_                 = nullptr;
+    int64_t* total_rows_before_expert_ = nullptr;
+    int*     grouped_row_slots_        = nullptr;
+    int*     slot_grouped_rows_        = nullptr;
+    T*       grouped_input_            = nullptr;
+    T*       grouped_output_           = nullptr;
+    T*       fc1_result_               = nullptr;
+    int64_t* expert_load_              = nullptr;
+
+    void allocateBuffer(size_t num_rows, size_t k, size_t capacity, size_t inter_size);
+
+public:
+    ExpertParallelMoe(size_t       expert_num,
+                      size_t       hidden_units,
+                      NcclParam    expert_para,
+                      float        capacity_factor,
+                      cudaStream_t stream,
+                      IAllocator*  allocator);
+    ~ExpertParallelMoe();
+    ExpertParallelMoe(ExpertParallelMoe<T> const&) = delete;
+    void operator=(ExpertParallelMoe<T> const&)    = delete;
+
+    // gating_output [num_rows, expert_num] are the logits of the gating GEMM, inter_size the one of a whole expert.
+    // fc2_result is [k * num_rows, hidden_units], the other outputs [num_rows, k].
+    void forward(T*                        fc2_result,
+                 T*                        expert_scales,
+                 int*                      expanded_source_row_to_expanded_dest_row,
+                 int*                      expert_for_source_row,
+                 const T*                  input,
+                 const T*                  gating_output,
+                 const FfnWeight<T>*       ffn_weights,
+                 ActivationType            activation_type,
+                 size_t                    num_rows,
+                 size_t                    inter_size,
+                 size_t                    k,
+                 CutlassMoeFCRunner<T, T>* moe_fc_runner);
+
+    // Frees the buffers of forward, but not the load counts.
+    void freeBuffer();
+
+    // Synchronizes the stream. Each rank counts its own tokens.
+    ExpertLoad getExpertLoad() const;
+    void       resetExpertLoad();
+
+    size_t getLocalExpertNum() const
+    {
+        return local_expert_num_;
+    }
+};
+
+}  // namespace fastertransformer
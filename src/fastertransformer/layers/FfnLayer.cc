@@ -15,6 +15,7 @@
  */
 
 #include "src/fastertransformer/layers/FfnLayer.h"
+#include "src/fastertransformer/kernels/lora_kernels.h"
 #include "src/fastertransformer/kernels/transpose_int8_kernels.h"
 #include "src/fastertransformer/utils/nvtx_utils.h"
 
@@ -38,7 +39,8 @@ void FfnLayer<T>::forward(TensorMap* output_tensors, TensorMap* input_tensors, c
     //      ia3_tasks [batch_size] (optional)
     //      moe_k     [1], uint64 (optional)
     //      padding_offset [token_num] (optional)
-    //      seq_len [1], int32, (optional), only used for ia3
+    //      seq_len [1], int32, (optional), only used for ia3 and lora
+    //      lora_slots [batch_size] (optional)
 
     // output tensors:
     //      ffn_output [token_num, hidden_dimension] or [moe_k * token_num, hidden_dimension] if use_moe
@@ -47,7 +49,7 @@ void FfnLayer<T>::forward(TensorMap* output_tensors, TensorMap* input_tensors, c
     //      expert_for_source_row [token_num, moe_k] (optional)
 
     FT_LOG_DEBUG(__PRETTY_FUNCTION__);
-    FT_CHECK(input_tensors->size() >= 1 && input_tensors->size() <= 5);
+    FT_CHECK(input_tensors->size() >= 1 && input_tensors->size() <= 6);
     FT_CHECK(output_tensors->size() >= 1 || output_tensors->size() <= 4);
     bool   use_moe = false;
     size_t moe_k   = 0;
@@ -89,6 +91,19 @@ void FfnLayer<T>::forward(TensorMap* output_tensors, TensorMap* input_tensors, c
 
     const int* ia3_tasks = input_tensors->getPtr<const int>("ia3_tasks", nullptr);
 
+    const int*           lora_slots      = input_tensors->getPtr<const int>("lora_slots", nullptr);
+    const int*           padding_offset  = input_tensors->getPtr<const int>("padding_offset", nullptr);
+    const int            seq_len         = input_tensors->getVal<int>("seq_len", 1);
+    const LoraWeight<T>& inter_lora      = ffn_weights->intermediate_lora_weight;
+    const LoraWeight<T>& output_lora     = ffn_weights->output_lora_weight;
+    const bool           use_inter_lora  = lora_slots != nullptr && inter_lora.a != nullptr;
+    const bool           use_output_lora = lora_slots != nullptr && output_lora.a != nullptr;
+    if (use_inter_lora || use_output_lora) {
+        FT_CHECK_WITH_INFO(!use_moe && int8_mode_ == 0, "LoRA adapters are not supported with MoE or int8_mode.");
+        lora_buf_ = (float*)allocator_->reMalloc(
+            lora_buf_, sizeof(float) * m * std::max(inter_lora.rank, output_lora.rank), false);
+    }
+
     if (use_moe) {
         PUSH_RANGE("FFN moe");
         FT_CHECK(ia3_tasks == nullptr);
@@ -104,7 +119,22 @@ void FfnLayer<T>::forward(TensorMap* output_tensors, TensorMap* input_tensors, c
                               moe_gates_buf_,
                               expert_num_);
 
-        if (int8_mode_ == 0) {
+        if (expert_parallel_moe_ != nullptr) {
+            FT_CHECK_WITH_INFO(int8_mode_ == 0, "Expert parallelism is not supported with int8_mode.");
+            expert_parallel_moe_->forward(output_tensor,
+                                          expert_scales,
+                                          permuted_rows,
+                                          permuted_experts,
+                                          input_tensor,
+                                          moe_gates_buf_,
+                                          ffn_weights,
+                                          activation_type,
+                                          m,
+                                          inter_size_,
+                                          moe_k,
+                                          moe_fc_runner_.get());
+        }
+        else if (int8_mode_ == 0) {
             moe_fc_runner_->run_moe_fc(input_tensor,
                                        moe_gates_buf_,
                                        ffn_weights->intermediate_weight.kernel,
@@ -291,6 +321,25 @@ void FfnLayer<T>::forward(TensorMap* output_tensors, TensorMap* input_tensors, c
 
     POP_RANGE;
 
+    if (use_inter_lora) {
+        // Before the activation, and only on the first matrix of a gated activation.
+        invokeAddLora(inter_buf_,
+                      input_tensor,
+                      lora_buf_,
+                      inter_lora.a,
+                      inter_lora.b,
+                      inter_lora.slot_stride,
+                      lora_slots,
+                      padding_offset,
+                      seq_len,
+                      m,
+                      hidden_units_,
+                      inter_size_,
+                      inter_lora.rank,
+                      stream_);
+        sync_check_cuda_error();
+    }
+
     if (int8_mode_ != 1 || ia3_tasks != nullptr || use_gated_activation) {
         // if int8_mode == 1 && ia3_tasks == nullptr && we don't use gated activations, we use cutlass
         // to fuse GEMM + bias + activation, so we skip the activation function here. In all
@@ -303,8 +352,8 @@ void FfnLayer<T>::forward(TensorMap* output_tensors, TensorMap* input_tensors, c
                           ffn_weights->ia3_weight.kernel,
                           int8_mode_ == 2 ? ffn_weights->intermediate_weight.scale_out : (float*)nullptr,
                           int8_mode_ == 2 ? ffn_weights->output_weight.scale : (float*)nullptr,
-                          input_tensors->getPtr<int>("padding_offset", nullptr),
-                          input_tensors->getVal<int>("seq_len", 1));
+                          padding_offset,
+                          seq_len);
         POP_RANGE;
     }
 
@@ -371,6 +420,23 @@ void FfnLayer<T>::forward(TensorMap* output_tensors, TensorMap* input_tensors, c
         }
     }
     sync_check_cuda_error();
+    if (use_output_lora) {
+        invokeAddLora(output_tensor,
+                      inter_buf_,
+                      lora_buf_,
+                      output_lora.a,
+                      output_lora.b,
+                      output_lora.slot_stride,
+                      lora_slots,
+                      padding_offset,
+                      seq_len,
+                      m,
+                      inter_size_,
+                      hidden_units_,
+                      output_lora.rank,
+                      stream_);
+        sync_check_cuda_error();
+    }
     POP_RANGE;
 
     if (is_free_buffer_after_forward_ == true) {
@@ -435,6 +501,7 @@ FfnLayer<T>::FfnLayer(FfnLayer<T> const& ffn_layer):
     use_gated_activation_(ffn_layer.use_gated_activation_),
     moe_fc_runner_(ffn_layer.moe_fc_runner_),
     moe_int8_weight_only_fc_runner_(ffn_layer.moe_int8_weight_only_fc_runner_),
+    expert_parallel_moe_(ffn_layer.expert_parallel_moe_),
     weight_only_int8_fc_runner_(ffn_layer.weight_only_int8_fc_runner_),
     int8_fc_runner_(ffn_layer.int8_fc_runner_)
 {
@@ -449,6 +516,28 @@ FfnLayer<T>::~FfnLayer()
     freeBuffer();
 }
 
+template<typename T>
+void FfnLayer<T>::setExpertParallel(NcclParam expert_para, float capacity_factor)
+{
+    FT_CHECK_WITH_INFO(expert_num_ > 0, "Expert parallelism needs a MoE layer.");
+    expert_parallel_moe_ = std::make_shared<ExpertParallelMoe<T>>(
+        expert_num_, hidden_units_, expert_para, capacity_factor, stream_, allocator_);
+}
+
+template<typename T>
+ExpertLoad FfnLayer<T>::getExpertLoad() const
+{
+    FT_CHECK_WITH_INFO(expert_parallel_moe_ != nullptr, "The expert load is only counted with expert parallelism.");
+    return expert_parallel_moe_->getExpertLoad();
+}
+
+template<typename T>
+void FfnLayer<T>::resetExpertLoad()
+{
+    FT_CHECK_WITH_INFO(expert_parallel_moe_ != nullptr, "The expert load is only counted with expert parallelism.");
+    expert_parallel_moe_->resetExpertLoad();
+}
+
 template<typename T>
 void FfnLayer<T>::allocateBuffer()
 {
@@ -463,19 +552,23 @@ void FfnLayer<T>::allocateBuffer(size_t token_num, int moe_k, bool use_moe)
     if (use_moe) {
         moe_gates_buf_ =
             (T*)allocator_->reMalloc(moe_gates_buf_, sizeof(T) * pad_to_multiple_of_16(token_num * expert_num_), false);
-        size_t ws_size_moe = 0;
-        if (int8_mode_ == 0) {
-            FT_CHECK_WITH_INFO(moe_fc_runner_.get() != NULL, "moe runner was not initialized.");
-            ws_size_moe = moe_fc_runner_->getWorkspaceSize(token_num, hidden_units_, inter_size_, expert_num_, moe_k);
-        }
-        else if (int8_mode_ == 1) {
-            FT_CHECK_WITH_INFO(moe_int8_weight_only_fc_runner_.get() != NULL,
-                               "weight only moe runner was not initialized.");
-            ws_size_moe = moe_int8_weight_only_fc_runner_->getWorkspaceSize(
-                token_num, hidden_units_, inter_size_, expert_num_, moe_k);
-        }
+        // ExpertParallelMoe holds its own buffers.
+        if (expert_parallel_moe_ == nullptr) {
+            size_t ws_size_moe = 0;
+            if (int8_mode_ == 0) {
+                FT_CHECK_WITH_INFO(moe_fc_runner_.get() != NULL, "moe runner was not initialized.");
+                ws_size_moe =
+                    moe_fc_runner_->getWorkspaceSize(token_num, hidden_units_, inter_size_, expert_num_, moe_k);
+            }
+            else if (int8_mode_ == 1) {
+                FT_CHECK_WITH_INFO(moe_int8_weight_only_fc_runner_.get() != NULL,
+                                   "weight only moe runner was not initialized.");
+                ws_size_moe = moe_int8_weight_only_fc_runner_->getWorkspaceSize(
+                    token_num, hidden_units_, inter_size_, expert_num_, moe_k);
+            }
 
-        moe_fc_workspace_ = (char*)allocator_->reMalloc(moe_fc_workspace_, sizeof(char) * ws_size_moe, false);
+            moe_fc_workspace_ = (char*)allocator_->reMalloc(moe_fc_workspace_, sizeof(char) * ws_size_moe, false);
+        }
     }
     else {
         const auto type_size = int8_mode_ == 2 ? sizeof(int8_t) : sizeof(T);
@@ -520,6 +613,10 @@ void FfnLayer<T>::freeBuffer()
             allocator_->free((void**)(&mixed_gemm_workspace_));
             mixed_gemm_ws_bytes_ = 0;
         }
+        allocator_->free((void**)(&lora_buf_));
+        if (expert_parallel_moe_ != nullptr) {
+            expert_parallel_moe_->freeBuffer();
+        }
 
         is_allocate_buffer_ = false;
     }
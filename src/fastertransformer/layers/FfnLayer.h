@@ -22,6 +22,7 @@
 #include "src/fastertransformer/kernels/matrix_vector_multiplication.h"
 #include "src/fastertransformer/kernels/moe_kernels.h"
 #include "src/fastertransformer/layers/BaseLayer.h"
+#include "src/fastertransformer/layers/ExpertParallelMoe.h"
 #include "src/fastertransformer/layers/FfnWeight.h"
 #include "src/fastertransformer/utils/activation_types.h"
 #include "src/fastertransformer/utils/cuda_utils.h"
@@ -50,6 +51,7 @@ private:
 
     std::shared_ptr<CutlassMoeFCRunner<T, T>>       moe_fc_runner_;
     std::shared_ptr<CutlassMoeFCRunner<T, uint8_t>> moe_int8_weight_only_fc_runner_;
+    std::shared_ptr<ExpertParallelMoe<T>>           expert_parallel_moe_;
 
     std::shared_ptr<CutlassFpAIntBGemmRunner<T, uint8_t>> weight_only_int8_fc_runner_;
     std::shared_ptr<CutlassInt8GemmRunner<T>>             int8_fc_runner_;
@@ -69,6 +71,7 @@ protected:
     size_t mixed_gemm_ws_bytes_  = 0;
     char*  int8_gemm_workspace_  = nullptr;
     size_t int8_gemm_ws_bytes_   = 0;
+    float* lora_buf_             = nullptr;
 
     size_t inter_size_;
     /* used to allocater memory buffers
@@ -122,6 +125,13 @@ public:
         inter_size_ = runtime_inter_size;
     }
 
+    // Splits the experts across the ranks of expert_para instead of slicing each of them, see ExpertParallelMoe.
+    // The ranks must hold the same FFN inputs, and the runtime inter size is then the one of a whole expert.
+    void setExpertParallel(NcclParam expert_para, float capacity_factor);
+    // The load of the experts over the MoE layers run since the last reset, with expert parallelism only.
+    ExpertLoad getExpertLoad() const;
+    void       resetExpertLoad();
+
     virtual void forward(std::vector<fastertransformer::Tensor>*       output_tensors,
                          const std::vector<fastertransformer::Tensor>* input_tensors,
                          const FfnWeight<T>*                           ffn_weights);
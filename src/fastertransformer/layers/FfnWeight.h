@@ -17,6 +17,7 @@
 #pragma once
 
 #include "DenseWeight.h"
+#include "LoraWeight.h"
 
 namespace fastertransformer {
 
@@ -27,6 +28,8 @@ struct FfnWeight {
     DenseWeight<T1, T2> intermediate_weight2;  // for gated activation
     DenseWeight<T1, T2> output_weight;
     DenseWeight<T1, T2> ia3_weight;
+    LoraWeight<T1>      intermediate_lora_weight;
+    LoraWeight<T1>      output_lora_weight;
 };
 
 }  // namespace fastertransformer
@@ -0,0 +1,33 @@
+/*
+ * Copyright (c) 2023, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+#include "stdlib.h"
+
+namespace fastertransformer {
+
+// Low-rank adapters of a GEMM of k inputs and n outputs, y = x * W + (x * A^T) * B, stacked in the slots of a
+// LoraAdapterRegistry. Slot s holds A at a + s * slot_stride, [rank, k], and B at b + s * slot_stride, [rank, n].
+// The layers only apply them to the sequences given a slot by the "lora_slots" input tensor.
+template<typename T>
+struct LoraWeight {
+    const T* a           = nullptr;
+    const T* b           = nullptr;
+    size_t   rank        = 0;
+    size_t   slot_stride = 0;
+};
+
+}  // namespace fastertransformer
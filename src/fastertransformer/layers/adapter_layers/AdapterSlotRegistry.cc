@@ -0,0 +1,361 @@
+/*
+ * Copyright (c) 2023, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/fastertransformer/layers/adapter_layers/AdapterSlotRegistry.h"
+#include "src/fastertransformer/utils/cuda_utils.h"
+
+#include <algorithm>
+
+namespace fastertransformer {
+
+const char* getAdapterStateName(AdapterState state)
+{
+    switch (state) {
+        case AdapterState::STAGING:
+            return "staging";
+        case AdapterState::READY:
+            return "ready";
+        case AdapterState::RETIRED:
+            return "retired";
+        case AdapterState::FAILED:
+            return "failed";
+        case AdapterState::PAGED_OUT:
+            return "paged_out";
+    }
+    return "unknown";
+}
+
+AdapterSlotRegistry::AdapterSlotRegistry(size_t num_slots): slots_(num_slots), page_events_(num_slots, nullptr)
+{
+    FT_CHECK_WITH_INFO(num_slots > 0, "an adapter registry needs at least one slot");
+    staging_thread_ = std::thread(&AdapterSlotRegistry::stagingLoop, this);
+}
+
+AdapterSlotRegistry::~AdapterSlotRegistry()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        is_stop_ = true;
+    }
+    job_cv_.notify_all();
+    staging_thread_.join();
+    for (cudaEvent_t event : page_events_) {
+        if (event != nullptr) {
+            cudaEventDestroy(event);
+        }
+    }
+}
+
+std::vector<int> AdapterSlotRegistry::findSlotsToTake(size_t num_slots, const std::vector<int>& used_slots) const
+{
+    std::vector<int> free_slots;
+    std::vector<int> paged_slots;
+    for (int slot = 0; slot < (int)slots_.size(); slot++) {
+        const Slot& s = slots_[slot];
+        if (s.is_free) {
+            free_slots.push_back(slot);
+        }
+        else if (s.is_paged && s.state == AdapterState::READY && s.num_references == 0
+                 && std::find(used_slots.begin(), used_slots.end(), slot) == used_slots.end()) {
+            paged_slots.push_back(slot);
+        }
+    }
+    std::sort(paged_slots.begin(), paged_slots.end(), [this](int a, int b) {
+        return slots_[a].last_use < slots_[b].last_use;
+    });
+    free_slots.insert(free_slots.end(), paged_slots.begin(), paged_slots.end());
+    free_slots.resize(std::min(free_slots.size(), num_slots));
+    return free_slots;
+}
+
+void AdapterSlotRegistry::takeSlot(int slot, int adapter_id, AdapterState state)
+{
+    if (!slots_[slot].is_free) {
+        // A paged adapter, paged in again by the next request using it.
+        adapters_[slots_[slot].adapter_id].slot = -1;
+    }
+    slots_[slot] = {adapter_id, state, false, 0, false, use_count_};
+}
+
+int AdapterSlotRegistry::takeFreeSlot(int adapter_id, AdapterState state)
+{
+    use_count_++;
+    const std::vector<int> slots = findSlotsToTake(1, {});
+    FT_CHECK_WITH_INFO(!slots.empty(),
+                       fmtstr("cannot register the adapter %d, the %zu adapter slots are in use",
+                              adapter_id,
+                              slots_.size()));
+    takeSlot(slots[0], adapter_id, state);
+    return slots[0];
+}
+
+void AdapterSlotRegistry::retireSlot(int slot)
+{
+    slots_[slot].state   = AdapterState::RETIRED;
+    slots_[slot].is_free = slots_[slot].num_references == 0;
+}
+
+void AdapterSlotRegistry::addStagedAdapter(int adapter_id, int slot)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    FT_CHECK_WITH_INFO(adapter_id >= 0, fmtstr("adapter ids must be non-negative, got %d", adapter_id));
+    FT_CHECK_WITH_INFO(adapters_.count(adapter_id) == 0, fmtstr("the adapter %d is already registered", adapter_id));
+    FT_CHECK_WITH_INFO(slot >= 0 && slot < (int)slots_.size() && slots_[slot].is_free,
+                       fmtstr("the slot %d of the adapter %d is not a free slot", slot, adapter_id));
+    slots_[slot]               = {adapter_id, AdapterState::READY, false, 0};
+    adapters_[adapter_id].slot = slot;
+}
+
+void AdapterSlotRegistry::registerAdapter(int adapter_id, StageFunction stage)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        FT_CHECK_WITH_INFO(adapter_id >= 0, fmtstr("adapter ids must be non-negative, got %d", adapter_id));
+        const int slot = takeFreeSlot(adapter_id, AdapterState::STAGING);
+        // A version still being staged is dropped when its staging finishes.
+        Adapter& adapter = adapters_[adapter_id];
+        if (adapter.is_paged && adapter.slot >= 0) {
+            // Serves the requests until the new version replaces it, so it cannot be paged out anymore.
+            slots_[adapter.slot].is_paged = false;
+        }
+        adapter.staging_slot = slot;
+        adapter.is_failed    = false;
+        adapter.is_paged     = false;
+        jobs_.push_back({adapter_id, slot, std::move(stage)});
+    }
+    job_cv_.notify_one();
+}
+
+void AdapterSlotRegistry::addPagedAdapter(int adapter_id)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    FT_CHECK_WITH_INFO(adapter_id >= 0, fmtstr("adapter ids must be non-negative, got %d", adapter_id));
+    Adapter& adapter = adapters_[adapter_id];
+    if (adapter.slot >= 0) {
+        retireSlot(adapter.slot);
+    }
+    // A version still being staged is dropped when its staging finishes.
+    adapter = {-1, -1, false, true};
+}
+
+bool AdapterSlotRegistry::unregisterAdapter(int adapter_id)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto                        adapter = adapters_.find(adapter_id);
+    if (adapter == adapters_.end()) {
+        return false;
+    }
+    if (adapter->second.slot >= 0) {
+        retireSlot(adapter->second.slot);
+    }
+    // The slot being staged is freed when its staging finishes.
+    adapters_.erase(adapter);
+    return true;
+}
+
+std::vector<AdapterInfo> AdapterSlotRegistry::listAdapters() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<AdapterInfo>    infos;
+    for (int slot = 0; slot < (int)slots_.size(); slot++) {
+        if (!slots_[slot].is_free) {
+            infos.push_back({slots_[slot].adapter_id, slot, slots_[slot].state, slots_[slot].num_references});
+        }
+    }
+    for (const auto& adapter : adapters_) {
+        if (adapter.second.is_failed) {
+            infos.push_back({adapter.first, -1, AdapterState::FAILED, 0});
+        }
+        else if (adapter.second.is_paged && adapter.second.slot < 0) {
+            infos.push_back({adapter.first, -1, AdapterState::PAGED_OUT, 0});
+        }
+    }
+    std::sort(infos.begin(), infos.end(), [](const AdapterInfo& a, const AdapterInfo& b) {
+        return a.adapter_id < b.adapter_id || (a.adapter_id == b.adapter_id && a.slot < b.slot);
+    });
+    return infos;
+}
+
+void AdapterSlotRegistry::waitForStaging() const
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_cv_.wait(lock, [this] { return jobs_.empty() && !is_staging_; });
+}
+
+void AdapterSlotRegistry::acquireSlots(int* slots, const int* adapter_ids, size_t size)
+{
+    acquireSlots(slots, adapter_ids, size, 0, nullptr);
+}
+
+void AdapterSlotRegistry::acquireSlots(
+    int* slots, const int* adapter_ids, size_t size, cudaStream_t stream, const PageFunction& page)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    use_count_++;
+    std::vector<int> used_slots;
+    std::vector<int> paged_out_ids;
+    for (size_t i = 0; i < size; i++) {
+        if (adapter_ids[i] == -1) {
+            continue;
+        }
+        auto adapter = adapters_.find(adapter_ids[i]);
+        FT_CHECK_WITH_INFO(adapter != adapters_.end(), fmtstr("unknown adapter %d", adapter_ids[i]));
+        if (adapter->second.slot >= 0) {
+            used_slots.push_back(adapter->second.slot);
+            continue;
+        }
+        FT_CHECK_WITH_INFO(adapter->second.is_paged && page,
+                           fmtstr("the adapter %d is %s",
+                                  adapter_ids[i],
+                                  adapter->second.is_paged  ? "paged out" :
+                                  adapter->second.is_failed ? "not staged, its staging failed" :
+                                                              "still staging"));
+        if (std::find(paged_out_ids.begin(), paged_out_ids.end(), adapter_ids[i]) == paged_out_ids.end()) {
+            paged_out_ids.push_back(adapter_ids[i]);
+        }
+    }
+
+    const std::vector<int> page_slots = findSlotsToTake(paged_out_ids.size(), used_slots);
+    FT_CHECK_WITH_INFO(page_slots.size() == paged_out_ids.size(),
+                       fmtstr("cannot page in %zu adapters, only %zu of the %zu adapter slots are free or hold an "
+                              "adapter which no request uses",
+                              paged_out_ids.size(),
+                              page_slots.size(),
+                              slots_.size()));
+    for (size_t i = 0; i < paged_out_ids.size(); i++) {
+        const int slot = page_slots[i];
+        takeSlot(slot, paged_out_ids[i], AdapterState::READY);
+        slots_[slot].is_paged = true;
+        try {
+            if (page_events_[slot] == nullptr) {
+                check_cuda_error(cudaEventCreateWithFlags(&page_events_[slot], cudaEventDisableTiming));
+            }
+            page(paged_out_ids[i], slot);
+            // The other requests get the slot as soon as it is published, before the copy is done on stream.
+            check_cuda_error(cudaEventRecord(page_events_[slot], stream));
+        }
+        catch (...) {
+            slots_[slot].is_free = true;
+            throw;
+        }
+        adapters_[paged_out_ids[i]].slot = slot;
+    }
+
+    for (size_t i = 0; i < size; i++) {
+        slots[i] = adapter_ids[i] == -1 ? -1 : adapters_[adapter_ids[i]].slot;
+        if (slots[i] >= 0) {
+            slots_[slots[i]].num_references++;
+            slots_[slots[i]].last_use = use_count_;
+            if (page_events_[slots[i]] != nullptr) {
+                check_cuda_error(cudaStreamWaitEvent(stream, page_events_[slots[i]], 0));
+            }
+        }
+    }
+}
+
+void AdapterSlotRegistry::releaseSlots(const int* slots, size_t size)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (size_t i = 0; i < size; i++) {
+        if (slots[i] < 0) {
+            continue;
+        }
+        Slot& slot = slots_[slots[i]];
+        FT_CHECK_WITH_INFO(slot.num_references > 0, fmtstr("the adapter slot %d is not acquired", slots[i]));
+        slot.num_references--;
+        if (slot.state == AdapterState::RETIRED && slot.num_references == 0) {
+            slot.is_free = true;
+        }
+    }
+}
+
+int AdapterSlotRegistry::getSlot(int adapter_id) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto                        adapter = adapters_.find(adapter_id);
+    return adapter == adapters_.end() ? -1 : adapter->second.slot;
+}
+
+void AdapterSlotRegistry::finishStaging(int adapter_id, int slot, bool is_staged)
+{
+    auto adapter = adapters_.find(adapter_id);
+    if (adapter == adapters_.end() || adapter->second.staging_slot != slot) {
+        // Unregistered or registered again while it was staged.
+        slots_[slot].is_free = true;
+        return;
+    }
+    adapter->second.staging_slot = -1;
+    if (!is_staged) {
+        slots_[slot].is_free      = true;
+        adapter->second.is_failed = true;
+        return;
+    }
+    if (adapter->second.slot >= 0) {
+        retireSlot(adapter->second.slot);
+    }
+    adapter->second.slot = slot;
+    slots_[slot].state   = AdapterState::READY;
+}
+
+void AdapterSlotRegistry::stagingLoop()
+{
+    while (true) {
+        StagingJob job;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            job_cv_.wait(lock, [this] { return !jobs_.empty() || is_stop_; });
+            if (is_stop_) {
+                return;
+            }
+            job = std::move(jobs_.front());
+            jobs_.pop_front();
+            is_staging_ = true;
+        }
+
+        bool is_staged = true;
+        try {
+            job.stage(job.slot);
+        }
+        catch (const std::exception& e) {
+            FT_LOG_ERROR("Cannot stage the adapter %d: %s", job.adapter_id, e.what());
+            is_staged = false;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            finishStaging(job.adapter_id, job.slot, is_staged);
+            is_staging_ = false;
+        }
+        done_cv_.notify_all();
+    }
+}
+
+AdapterSlotsHolder::AdapterSlotsHolder(AdapterSlotRegistry*                      registry,
+                                       const int*                                adapter_ids,
+                                       size_t                                    size,
+                                       cudaStream_t                              stream,
+                                       const AdapterSlotRegistry::PageFunction& page):
+    registry_(registry), slots_(size), stream_(stream)
+{
+    registry_->acquireSlots(slots_.data(), adapter_ids, size, stream, page);
+}
+
+AdapterSlotsHolder::~AdapterSlotsHolder()
+{
+    cudaStreamSynchronize(stream_);
+    registry_->releaseSlots(slots_.data(), slots_.size());
+}
+
+}  // namespace fastertransformer
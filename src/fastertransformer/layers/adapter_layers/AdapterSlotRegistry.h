@@ -0,0 +1,184 @@
+/*
+ * Copyright (c) 2023, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Adapters registered and unregistered while a model serves requests.
+ *
+ * The weights of the adapters live in a fixed number of preallocated slots, e.g. the task rows of the IA3 tables.
+ * An adapter is registered with a function copying it into a slot, which runs on a staging thread, so registering
+ * never blocks the requests being served: the adapter serves the requests which come after its staging.
+ *
+ * Requests acquire the slots of their adapters before they run and release them once their kernels are done. A slot
+ * is only reused when no request references it, so unregistering or replacing an adapter never changes the weights
+ * under a running request: registering an id again stages the new version into another slot, and the requests
+ * which acquired the old version keep it until they release it.
+ *
+ * Adapters can also be paged: their weights stay with the caller, e.g. on the host, and they are copied into a slot
+ * by the requests which use them, over the least recently used slot of a paged adapter which no request holds. This
+ * serves more adapters than there are slots, e.g. the LoRA adapters of LoraAdapterRegistry.
+ **/
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <cuda_runtime.h>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace fastertransformer {
+
+enum class AdapterState {
+    STAGING,   // being copied to its slot
+    READY,     // serves the requests
+    RETIRED,   // unregistered or replaced, its slot is freed once the requests using it release it
+    FAILED,    // its staging failed, the error is logged
+    PAGED_OUT  // a paged adapter which is not in a slot
+};
+
+const char* getAdapterStateName(AdapterState state);
+
+struct AdapterInfo {
+    int          adapter_id     = -1;
+    int          slot           = -1;  // -1 for a failed or paged out adapter
+    AdapterState state          = AdapterState::FAILED;
+    size_t       num_references = 0;  // requests holding the slot
+};
+
+// Thread-safe.
+class AdapterSlotRegistry {
+public:
+    // Copies the weights of an adapter into a slot and throws on failure. Called on the staging thread.
+    using StageFunction = std::function<void(int slot)>;
+    // Copies the weights of a paged adapter into a slot and throws on failure. Called by acquireSlots with the
+    // registry locked, so it should only queue the copy on the stream of the request.
+    using PageFunction = std::function<void(int adapter_id, int slot)>;
+
+    explicit AdapterSlotRegistry(size_t num_slots);
+    // Waits for the adapter being staged, the ones queued after it are dropped.
+    ~AdapterSlotRegistry();
+    AdapterSlotRegistry(AdapterSlotRegistry const&) = delete;
+    void operator=(AdapterSlotRegistry const&)      = delete;
+
+    // Registers an adapter which is already in its slot, e.g. loaded with the model.
+    void addStagedAdapter(int adapter_id, int slot);
+    // Takes a free slot and queues stage for it, the adapter is ready once stage returns. Registering an id again
+    // replaces its adapter when the new version is ready. Throws if all the slots are used.
+    void registerAdapter(int adapter_id, StageFunction stage);
+    // Registers a paged adapter, which gets a slot when a request acquires it. Adding an id again replaces its
+    // adapter: the slot of the previous version is retired, and the next request pages the new version in.
+    void addPagedAdapter(int adapter_id);
+    // New requests cannot acquire the adapter anymore, its slot is freed once released by the requests using it.
+    // Returns false for an unknown adapter.
+    bool unregisterAdapter(int adapter_id);
+    // The slots in use and the failed adapters, sorted by adapter id.
+    std::vector<AdapterInfo> listAdapters() const;
+    // Blocks until the queued adapters are staged.
+    void waitForStaging() const;
+
+    // Gives slots[i] the slot of the ready adapter adapter_ids[i], or -1 for the id -1 which runs the base model, and
+    // holds the slots until releaseSlots. Throws, and holds nothing, if an adapter is not ready.
+    void acquireSlots(int* slots, const int* adapter_ids, size_t size);
+    // Same, but the paged adapters which are not in a slot are paged in with page on stream, first into the free
+    // slots, then into the least recently used slots of the paged adapters which no request holds. Throws, and holds
+    // nothing, if there are not enough such slots. stream waits for the copies of the slots it gets, including those
+    // queued by other requests on their streams.
+    void
+    acquireSlots(int* slots, const int* adapter_ids, size_t size, cudaStream_t stream, const PageFunction& page);
+    void releaseSlots(const int* slots, size_t size);
+    // The slot of the ready version of the adapter, or -1.
+    int getSlot(int adapter_id) const;
+
+    size_t getNumSlots() const
+    {
+        return slots_.size();
+    }
+
+private:
+    struct Slot {
+        int          adapter_id     = -1;
+        AdapterState state          = AdapterState::READY;
+        bool         is_free        = true;
+        size_t       num_references = 0;
+        bool         is_paged       = false;  // can be paged out when no request holds it
+        uint64_t     last_use       = 0;      // use_count_ when it was last taken or acquired
+    };
+    struct Adapter {
+        int  slot         = -1;  // of the version serving the requests
+        int  staging_slot = -1;  // of the version being staged
+        bool is_failed    = false;
+        bool is_paged     = false;
+    };
+    struct StagingJob {
+        int           adapter_id;
+        int           slot;
+        StageFunction stage;
+    };
+
+    // The functions below are called with mutex_ held.
+    int  takeFreeSlot(int adapter_id, AdapterState state);
+    // The free slots, then the least recently used slots which can be paged out, apart from used_slots, or fewer if
+    // there are not enough.
+    std::vector<int> findSlotsToTake(size_t num_slots, const std::vector<int>& used_slots) const;
+    void             takeSlot(int slot, int adapter_id, AdapterState state);
+    void retireSlot(int slot);
+    void finishStaging(int adapter_id, int slot, bool is_staged);
+
+    void stagingLoop();
+
+    std::vector<Slot>                slots_;
+    std::unordered_map<int, Adapter> adapters_;
+    uint64_t                         use_count_ = 0;  // bumped by each acquireSlots and takeFreeSlot
+    // Of the last copy into each slot by a page function, created when the slot is first paged into.
+    std::vector<cudaEvent_t>         page_events_;
+
+    mutable std::mutex              mutex_;
+    std::condition_variable         job_cv_;
+    mutable std::condition_variable done_cv_;
+    std::deque<StagingJob>          jobs_;
+    bool                            is_staging_ = false;
+    bool                            is_stop_    = false;
+    std::thread                     staging_thread_;
+};
+
+// Holds the slots of the adapters of a batch until its kernels queued on stream are done.
+class AdapterSlotsHolder {
+public:
+    AdapterSlotsHolder(AdapterSlotRegistry*                      registry,
+                       const int*                                adapter_ids,
+                       size_t                                    size,
+                       cudaStream_t                              stream,
+                       const AdapterSlotRegistry::PageFunction& page = nullptr);
+    ~AdapterSlotsHolder();
+    AdapterSlotsHolder(AdapterSlotsHolder const&) = delete;
+    void operator=(AdapterSlotsHolder const&)     = delete;
+
+    const std::vector<int>& getSlots() const
+    {
+        return slots_;
+    }
+
+private:
+    AdapterSlotRegistry* const registry_;
+    std::vector<int>           slots_;
+    const cudaStream_t         stream_;
+};
+
+}  // namespace fastertransformer
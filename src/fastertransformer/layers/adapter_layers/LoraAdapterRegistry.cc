@@ -0,0 +1,353 @@
+/*
+ * Copyright (c) 2023, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/fastertransformer/layers/adapter_layers/LoraAdapterRegistry.h"
+#include "src/fastertransformer/utils/host_convert_utils.h"
+#include "src/fastertransformer/utils/mmap_utils.h"
+
+#include <algorithm>
+#include <fstream>
+
+namespace fastertransformer {
+
+const char* getLoraTargetName(LoraTarget target)
+{
+    switch (target) {
+        case LoraTarget::QKV:
+            return "qkv";
+        case LoraTarget::FFN_INTERMEDIATE:
+            return "ffn_intermediate";
+        case LoraTarget::FFN_OUTPUT:
+            return "ffn_output";
+    }
+    return "unknown";
+}
+
+std::array<LoraShape, LORA_TARGET_NUM>
+getLoraShapes(size_t d_model, size_t hidden_units, size_t inter_size, size_t tensor_para_size)
+{
+    std::array<LoraShape, LORA_TARGET_NUM> shapes;
+    shapes[(int)LoraTarget::QKV]              = {d_model, 3 * hidden_units / tensor_para_size};
+    shapes[(int)LoraTarget::FFN_INTERMEDIATE] = {d_model, inter_size / tensor_para_size};
+    shapes[(int)LoraTarget::FFN_OUTPUT]       = {inter_size / tensor_para_size, d_model};
+    return shapes;
+}
+
+namespace {
+
+template<typename T>
+void castFromFloat(T* dst, const float* src, size_t size)
+{
+    hostCast(dst, src, size);
+}
+
+template<>
+void castFromFloat(float* dst, const float* src, size_t size)
+{
+    std::copy(src, src + size, dst);
+}
+
+template<typename T>
+float toFloat(T value)
+{
+    float result;
+    hostCast(&result, &value, 1);
+    return result;
+}
+
+template<>
+float toFloat(float value)
+{
+    return value;
+}
+
+// The matrix of a file, or an empty one if the file does not exist.
+std::vector<float> readMatrix(const std::string& filename, size_t size, FtCudaDataType model_file_type)
+{
+    std::vector<float> matrix;
+    if (!std::ifstream(filename).good()) {
+        return matrix;
+    }
+    matrix.resize(size);
+    if (model_file_type == FtCudaDataType::FP16) {
+        MappedWeight<half> weight = mapWeightFromBin<half>({size}, filename);
+        FT_CHECK_WITH_INFO(!weight.empty(), fmtstr("cannot read %zu values from %s", size, filename.c_str()));
+        hostCast(matrix.data(), weight.data, size);
+    }
+    else {
+        FT_CHECK_WITH_INFO(model_file_type == FtCudaDataType::FP32,
+                           fmtstr("LoRA adapters are read from FP32 or FP16 files, not %d", (int)model_file_type));
+        MappedWeight<float> weight = mapWeightFromBin<float>({size}, filename);
+        FT_CHECK_WITH_INFO(!weight.empty(), fmtstr("cannot read %zu values from %s", size, filename.c_str()));
+        std::copy(weight.data, weight.data + size, matrix.begin());
+    }
+    return matrix;
+}
+
+}  // namespace
+
+template<typename T>
+LoraAdapterRegistry<T>::LoraAdapterRegistry(size_t                                        layer_begin,
+                                            size_t                                        layer_end,
+                                            const std::array<LoraShape, LORA_TARGET_NUM>& shapes,
+                                            size_t                                        max_rank,
+                                            size_t                                        num_slots,
+                                            IAllocator*                                   allocator):
+    layer_begin_(layer_begin),
+    layer_end_(layer_end),
+    shapes_(shapes),
+    max_rank_(max_rank),
+    allocator_(allocator),
+    slots_(num_slots)
+{
+    FT_CHECK_WITH_INFO(layer_begin <= layer_end && max_rank > 0 && num_slots > 0,
+                       fmtstr("invalid LoRA registry: layers [%zu, %zu), max_rank %zu, num_slots %zu",
+                              layer_begin,
+                              layer_end,
+                              max_rank,
+                              num_slots));
+    for (const LoraShape& shape : shapes_) {
+        slot_stride_ += (layer_end_ - layer_begin_) * max_rank_ * (shape.k + shape.n);
+    }
+    d_slots_ = (T*)allocator_->malloc(sizeof(T) * slot_stride_ * num_slots, true);
+}
+
+template<typename T>
+LoraAdapterRegistry<T>::~LoraAdapterRegistry()
+{
+    allocator_->free((void**)(&d_slots_));
+}
+
+template<typename T>
+size_t LoraAdapterRegistry<T>::getOffset(size_t local_layer, LoraTarget target) const
+{
+    size_t offset = 0;
+    for (const LoraShape& shape : shapes_) {
+        offset += local_layer * max_rank_ * (shape.k + shape.n);
+    }
+    for (int t = 0; t < (int)target; t++) {
+        offset += max_rank_ * (shapes_[t].k + shapes_[t].n);
+    }
+    return offset;
+}
+
+template<typename T>
+void LoraAdapterRegistry<T>::addAdapter(int adapter_id, const LoraAdapterWeights<T>& weights)
+{
+    const size_t num_layer = layer_end_ - layer_begin_;
+    FT_CHECK_WITH_INFO(adapter_id >= 0, fmtstr("LoRA adapter ids must be non-negative, got %d", adapter_id));
+    FT_CHECK_WITH_INFO(weights.rank > 0 && weights.rank <= max_rank_,
+                       fmtstr("LoRA adapter %d has rank %zu, expected 1 to %zu", adapter_id, weights.rank, max_rank_));
+    FT_CHECK_WITH_INFO(weights.a.size() == num_layer && weights.b.size() == num_layer,
+                       fmtstr("LoRA adapter %d has %zu layers, expected %zu", adapter_id, weights.a.size(), num_layer));
+
+    std::shared_ptr<std::vector<T>> image = std::make_shared<std::vector<T>>(slot_stride_);
+    for (size_t l = 0; l < num_layer; l++) {
+        for (int t = 0; t < (int)LORA_TARGET_NUM; t++) {
+            const std::vector<T>& a     = weights.a[l][t];
+            const std::vector<T>& b     = weights.b[l][t];
+            const LoraShape&      shape = shapes_[t];
+            if (a.empty() && b.empty()) {
+                continue;
+            }
+            FT_CHECK_WITH_INFO(a.size() == weights.rank * shape.k && b.size() == weights.rank * shape.n,
+                               fmtstr("LoRA adapter %d, layer %zu, %s: A and B have %zu and %zu values, "
+                                      "expected %zu and %zu",
+                                      adapter_id,
+                                      layer_begin_ + l,
+                                      getLoraTargetName((LoraTarget)t),
+                                      a.size(),
+                                      b.size(),
+                                      weights.rank * shape.k,
+                                      weights.rank * shape.n));
+            T* image_a = image->data() + getOffset(l, (LoraTarget)t);
+            T* image_b = image_a + max_rank_ * shape.k;
+            std::copy(a.begin(), a.end(), image_a);
+            if (weights.scale == 1.0f) {
+                std::copy(b.begin(), b.end(), image_b);
+            }
+            else {
+                std::vector<float> scaled_b(b.size());
+                for (size_t i = 0; i < b.size(); i++) {
+                    scaled_b[i] = toFloat(b[i]) * weights.scale;
+                }
+                castFromFloat(image_b, scaled_b.data(), b.size());
+            }
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        host_adapters_[adapter_id] = image;
+    }
+    // A new version of an adapter on the device is copied again when it is next used.
+    slots_.addPagedAdapter(adapter_id);
+}
+
+template<typename T>
+void LoraAdapterRegistry<T>::loadAdapter(int                adapter_id,
+                                         const std::string& dir_path,
+                                         size_t             rank,
+                                         float              alpha,
+                                         size_t             tensor_para_rank,
+                                         FtCudaDataType     model_file_type)
+{
+    // The matrices split between the tensor parallel ranks: B of QKV and FFN_INTERMEDIATE, A of FFN_OUTPUT.
+    const std::array<bool, LORA_TARGET_NUM> is_a_split = {{false, false, true}};
+    const std::string                       suffix     = "." + std::to_string(tensor_para_rank) + ".bin";
+
+    const size_t          num_layer = layer_end_ - layer_begin_;
+    LoraAdapterWeights<T> weights;
+    weights.rank = rank;
+    weights.a.resize(num_layer);
+    weights.b.resize(num_layer);
+    const float scale = alpha / rank;
+
+    for (size_t l = 0; l < num_layer; l++) {
+        for (int t = 0; t < (int)LORA_TARGET_NUM; t++) {
+            const std::string prefix = dir_path + "/layers." + std::to_string(layer_begin_ + l) + "."
+                                       + getLoraTargetName((LoraTarget)t) + ".lora_";
+            const std::string a_file = prefix + "a" + (is_a_split[t] ? suffix : ".bin");
+            const std::string b_file = prefix + "b" + (is_a_split[t] ? ".bin" : suffix);
+
+            std::vector<float> a = readMatrix(a_file, rank * shapes_[t].k, model_file_type);
+            std::vector<float> b = readMatrix(b_file, rank * shapes_[t].n, model_file_type);
+            FT_CHECK_WITH_INFO(a.empty() == b.empty(),
+                               fmtstr("LoRA adapter %d: %s exists but not %s",
+                                      adapter_id,
+                                      (a.empty() ? b_file : a_file).c_str(),
+                                      (a.empty() ? a_file : b_file).c_str()));
+            for (float& value : b) {
+                value *= scale;
+            }
+            weights.a[l][t].resize(a.size());
+            weights.b[l][t].resize(b.size());
+            castFromFloat(weights.a[l][t].data(), a.data(), a.size());
+            castFromFloat(weights.b[l][t].data(), b.data(), b.size());
+        }
+    }
+    addAdapter(adapter_id, weights);
+    FT_LOG_INFO("Loaded the LoRA adapter %d of rank %zu from %s", adapter_id, rank, dir_path.c_str());
+}
+
+template<typename T>
+bool LoraAdapterRegistry<T>::unregisterAdapter(int adapter_id)
+{
+    if (!slots_.unregisterAdapter(adapter_id)) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    host_adapters_.erase(adapter_id);
+    return true;
+}
+
+template<typename T>
+bool LoraAdapterRegistry<T>::hasAdapter(int adapter_id) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return host_adapters_.count(adapter_id) > 0;
+}
+
+template<typename T>
+std::vector<int> LoraAdapterRegistry<T>::getAdapterIds() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<int>            adapter_ids;
+    for (const auto& adapter : host_adapters_) {
+        adapter_ids.push_back(adapter.first);
+    }
+    std::sort(adapter_ids.begin(), adapter_ids.end());
+    return adapter_ids;
+}
+
+template<typename T>
+std::shared_ptr<const std::vector<T>> LoraAdapterRegistry<T>::getHostAdapter(int adapter_id) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto                        adapter = host_adapters_.find(adapter_id);
+    FT_CHECK_WITH_INFO(adapter != host_adapters_.end(), fmtstr("unknown LoRA adapter %d", adapter_id));
+    return adapter->second;
+}
+
+template<typename T>
+std::unique_ptr<AdapterSlotsHolder>
+LoraAdapterRegistry<T>::getSlots(const int* adapter_ids, size_t batch_size, cudaStream_t stream)
+{
+    // No running batch holds the slot. The pageable image is staged by the time cudaMemcpyAsync returns, so a new
+    // version of the adapter can replace it right after, and the batches on other streams wait for the copy.
+    auto page = [this, stream](int adapter_id, int slot) {
+        const std::shared_ptr<const std::vector<T>> image = getHostAdapter(adapter_id);
+        check_cuda_error(cudaMemcpyAsync(d_slots_ + slot * slot_stride_,
+                                         image->data(),
+                                         sizeof(T) * slot_stride_,
+                                         cudaMemcpyHostToDevice,
+                                         stream));
+        num_copies_++;
+    };
+    return std::unique_ptr<AdapterSlotsHolder>(new AdapterSlotsHolder(&slots_, adapter_ids, batch_size, stream, page));
+}
+
+template<typename T>
+LoraWeight<T> LoraAdapterRegistry<T>::getWeight(size_t layer, LoraTarget target) const
+{
+    LoraWeight<T> weight;
+    if (layer < layer_begin_ || layer >= layer_end_) {
+        return weight;
+    }
+    weight.a           = d_slots_ + getOffset(layer - layer_begin_, target);
+    weight.b           = weight.a + max_rank_ * shapes_[(int)target].k;
+    weight.rank        = max_rank_;
+    weight.slot_stride = slot_stride_;
+    return weight;
+}
+
+template<typename T>
+void LoraAdapterRegistry<T>::addLoraOnHost(
+    float* out, const float* in, const int* adapter_ids, size_t m, size_t seq_len, size_t layer, LoraTarget target)
+    const
+{
+    FT_CHECK(layer >= layer_begin_ && layer < layer_end_);
+    const size_t       k = shapes_[(int)target].k;
+    const size_t       n = shapes_[(int)target].n;
+    std::vector<float> shrunk(max_rank_);
+    for (size_t i = 0; i < m; i++) {
+        const int adapter_id = adapter_ids[i / seq_len];
+        if (adapter_id == -1) {
+            continue;
+        }
+        const T* a = getHostAdapter(adapter_id)->data() + getOffset(layer - layer_begin_, target);
+        const T* b = a + max_rank_ * k;
+        for (size_t r = 0; r < max_rank_; r++) {
+            shrunk[r] = 0.0f;
+            for (size_t j = 0; j < k; j++) {
+                shrunk[r] += in[i * k + j] * toFloat(a[r * k + j]);
+            }
+        }
+        for (size_t j = 0; j < n; j++) {
+            for (size_t r = 0; r < max_rank_; r++) {
+                out[i * n + j] += shrunk[r] * toFloat(b[r * n + j]);
+            }
+        }
+    }
+}
+
+template class LoraAdapterRegistry<float>;
+template class LoraAdapterRegistry<half>;
+#ifdef ENABLE_BF16
+template class LoraAdapterRegistry<__nv_bfloat16>;
+#endif
+
+}  // namespace fastertransformer
@@ -0,0 +1,174 @@
+/*
+ * Copyright (c) 2023, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Low-rank adapters (LoRA) of many fine-tunes of one base model, served together.
+ *
+ * The registry holds the weights of every adapter on the host, and a fixed number of slots on the device. Before a
+ * batch runs, getSlots gives a slot to the adapter of each sequence: the adapters already on the device are reused,
+ * the others are paged over the least recently used slots which no running batch holds, see AdapterSlotRegistry.
+ * The layers then gather the adapter of each token from the slots with the "lora_slots" tensor, so one batch can mix
+ * any adapters, up to one per slot.
+ *
+ * The adapters of a slot are padded to max_rank with zeros, so the slots all have the same layout:
+ *
+ *     for each local layer, for each target: A [max_rank, k], B [max_rank, n]
+ *
+ * where k and n are the inputs and outputs of the GEMM of the target on this tensor parallel rank. The scale
+ * alpha / rank of an adapter is applied to its B when it is added.
+ **/
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "src/fastertransformer/layers/LoraWeight.h"
+#include "src/fastertransformer/layers/adapter_layers/AdapterSlotRegistry.h"
+#include "src/fastertransformer/utils/allocator.h"
+#include "src/fastertransformer/utils/cuda_utils.h"
+
+namespace fastertransformer {
+
+enum class LoraTarget {
+    QKV,               // the fused QKV GEMM of the self attention
+    FFN_INTERMEDIATE,  // the first GEMM of the FFN
+    FFN_OUTPUT         // the second GEMM of the FFN
+};
+
+static constexpr size_t LORA_TARGET_NUM = 3;
+
+const char* getLoraTargetName(LoraTarget target);
+
+struct LoraShape {
+    size_t k = 0;  // inputs
+    size_t n = 0;  // outputs
+};
+
+// The shapes of the GEMMs of a layer on one tensor parallel rank. The QKV and intermediate GEMMs are split along
+// their outputs, the output GEMM along its inputs, whose partial results are reduced with the base model's.
+std::array<LoraShape, LORA_TARGET_NUM>
+getLoraShapes(size_t d_model, size_t hidden_units, size_t inter_size, size_t tensor_para_size);
+
+// Host weights of an adapter on one tensor parallel rank. a[l][t] is [rank, k] and b[l][t] is [rank, n] for the
+// local layer l and the target t. An empty pair of matrices leaves the target without adapter.
+template<typename T>
+struct LoraAdapterWeights {
+    size_t                                                   rank  = 0;
+    float                                                    scale = 1.0f;  // alpha / rank, applied to b
+    std::vector<std::array<std::vector<T>, LORA_TARGET_NUM>> a;
+    std::vector<std::array<std::vector<T>, LORA_TARGET_NUM>> b;
+};
+
+// Thread-safe, adapters can be added and unregistered while batches run.
+template<typename T>
+class LoraAdapterRegistry {
+public:
+    // The adapters of the layers [layer_begin, layer_end), those of this pipeline parallel rank.
+    LoraAdapterRegistry(size_t                                        layer_begin,
+                        size_t                                        layer_end,
+                        const std::array<LoraShape, LORA_TARGET_NUM>& shapes,
+                        size_t                                        max_rank,
+                        size_t                                        num_slots,
+                        IAllocator*                                   allocator);
+    ~LoraAdapterRegistry();
+    LoraAdapterRegistry(const LoraAdapterRegistry&)            = delete;
+    LoraAdapterRegistry& operator=(const LoraAdapterRegistry&) = delete;
+
+    // Adding an id again replaces its adapter, the batches running with the previous version keep it.
+    void addAdapter(int adapter_id, const LoraAdapterWeights<T>& weights);
+    // Reads the adapter from dir_path/layers.<l>.<target>.lora_<a|b>[.<tensor_para_rank>].bin, where the matrices
+    // split between the tensor parallel ranks have the suffix of the rank. A target without files has no adapter.
+    void loadAdapter(int                adapter_id,
+                     const std::string& dir_path,
+                     size_t             rank,
+                     float              alpha,
+                     size_t             tensor_para_rank,
+                     FtCudaDataType     model_file_type = FtCudaDataType::FP32);
+    // Returns false for an unknown adapter. Its slot is freed once the batches using it are done.
+    bool             unregisterAdapter(int adapter_id);
+    bool             hasAdapter(int adapter_id) const;
+    std::vector<int> getAdapterIds() const;
+    // The adapters and their slots, see AdapterSlotRegistry::listAdapters.
+    std::vector<AdapterInfo> listAdapters() const
+    {
+        return slots_.listAdapters();
+    }
+
+    // Gives the slot of adapter_ids[i], or -1 for the id -1 which runs the base model, and holds the slots until the
+    // batch queued on stream is done and the holder is destroyed. The adapters which are not on the device are copied
+    // to their slots on stream. Throws if the batch needs more slots than are free or unused by the other batches.
+    std::unique_ptr<AdapterSlotsHolder> getSlots(const int* adapter_ids, size_t batch_size, cudaStream_t stream);
+    // The slot of the adapter, or -1 if it is not on the device.
+    int getSlot(int adapter_id) const
+    {
+        return slots_.getSlot(adapter_id);
+    }
+
+    // The slots of a layer and target, an empty weight for the layers of the other pipeline parallel ranks.
+    LoraWeight<T> getWeight(size_t layer, LoraTarget target) const;
+
+    // Host reference of the adapters of a layer and target: out[i, :] += in[i, :] * A^T * B with the adapter
+    // adapter_ids[i / seq_len] of each row, none for the id -1. in is [m, k] and out is [m, n].
+    void addLoraOnHost(
+        float* out, const float* in, const int* adapter_ids, size_t m, size_t seq_len, size_t layer, LoraTarget target)
+        const;
+
+    size_t getNumSlots() const
+    {
+        return slots_.getNumSlots();
+    }
+    size_t getMaxRank() const
+    {
+        return max_rank_;
+    }
+    const LoraShape& getShape(LoraTarget target) const
+    {
+        return shapes_[(int)target];
+    }
+    // Number of adapters copied to the device so far.
+    size_t getNumCopies() const
+    {
+        return num_copies_;
+    }
+
+private:
+    // Offset of A in a slot, B follows it.
+    size_t                                getOffset(size_t local_layer, LoraTarget target) const;
+    std::shared_ptr<const std::vector<T>> getHostAdapter(int adapter_id) const;
+
+    const size_t                                 layer_begin_;
+    const size_t                                 layer_end_;
+    const std::array<LoraShape, LORA_TARGET_NUM> shapes_;
+    const size_t                                 max_rank_;
+    size_t                                       slot_stride_ = 0;  // elements of a slot
+    IAllocator*                                  allocator_;
+
+    // padded, in the layout of a slot
+    std::unordered_map<int, std::shared_ptr<const std::vector<T>>> host_adapters_;
+    mutable std::mutex                                             mutex_;  // of host_adapters_
+
+    T*                  d_slots_ = nullptr;
+    AdapterSlotRegistry slots_;
+    std::atomic<size_t> num_copies_{0};
+};
+
+}  // namespace fastertransformer
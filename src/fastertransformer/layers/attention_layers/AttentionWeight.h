@@ -17,6 +17,7 @@
 #pragma once
 
 #include "src/fastertransformer/layers/DenseWeight.h"
+#include "src/fastertransformer/layers/LoraWeight.h"
 
 namespace fastertransformer {
 
@@ -28,6 +29,7 @@ struct AttentionWeight {
     DenseWeight<T1, T2> attention_output_weight;
     DenseWeight<T1, T2> ia3_key_weight;
     DenseWeight<T1, T2> ia3_value_weight;
+    LoraWeight<T1>      qkv_lora_weight;  // on the fused QKV outputs, [rank, 3, local_hidden_units]
 };
 
 }  // namespace fastertransformer
@@ -16,6 +16,7 @@
 
 #include "src/fastertransformer/layers/attention_layers/DecoderSelfAttentionLayer.h"
 #include "src/fastertransformer/kernels/decoder_masked_multihead_attention.h"
+#include "src/fastertransformer/kernels/lora_kernels.h"
 #include "src/fastertransformer/utils/logger.h"
 #include "src/fastertransformer/utils/memory_utils.h"
 #include "src/fastertransformer/utils/nvtx_utils.h"
@@ -226,6 +227,7 @@ void DecoderSelfAttentionLayer<T>::freeBuffer()
     if (is_allocate_buffer_) {
         allocator_->free((void**)(&qkv_buf_));
         allocator_->free((void**)(&context_buf_));
+        allocator_->free((void**)(&lora_buf_));
         is_allocate_buffer_ = false;
 
         if (mixed_gemm_workspace_) {
@@ -474,6 +476,7 @@ void DecoderSelfAttentionLayer<T>::forward(TensorMap*                output_tens
     //      relative_attention_bias [1, head_num, step, step] or [1, head_num, max_seq_len, max_seq_len] (optional)
     //      linear_bias_slopes [head_num] (optional)
     //      ia3_tasks [batch_size] (optional)
+    //      lora_slots [batch_size] (optional)
 
     // output tensors:
     //      attention_output [batch_size, d_model_],
@@ -496,6 +499,7 @@ void DecoderSelfAttentionLayer<T>::forward(TensorMap*                output_tens
         input_tensors->isExist("relative_attention_bias") ? input_tensors->at("relative_attention_bias").shape[3] : 0;
     const T*   linear_bias_slopes = input_tensors->getPtr<T>("linear_bias_slopes", nullptr);
     const bool has_ia3            = input_tensors->isExist("ia3_tasks");
+    const int* lora_slots         = input_tensors->getPtr<int>("lora_slots", nullptr);
 
     T* attention_out = output_tensors->getPtr<T>("hidden_features");
     T* key_cache     = output_tensors->getPtr<T>("key_cache");
@@ -577,6 +581,27 @@ void DecoderSelfAttentionLayer<T>::forward(TensorMap*                output_tens
         }
     }
     sync_check_cuda_error();
+
+    const LoraWeight<T>& qkv_lora = attention_weights->qkv_lora_weight;
+    if (lora_slots != nullptr && qkv_lora.a != nullptr) {
+        FT_CHECK_WITH_INFO(int8_mode_ == 0, "LoRA adapters are not supported with int8_mode.");
+        lora_buf_ = (float*)allocator_->reMalloc(lora_buf_, sizeof(float) * batch_size * qkv_lora.rank, false);
+        invokeAddLora(qkv_buf_,
+                      attention_input,
+                      lora_buf_,
+                      qkv_lora.a,
+                      qkv_lora.b,
+                      qkv_lora.slot_stride,
+                      lora_slots,
+                      (const int*)nullptr,
+                      1,
+                      batch_size,
+                      d_model_,
+                      3 * local_hidden_units_,
+                      qkv_lora.rank,
+                      stream_);
+        sync_check_cuda_error();
+    }
     POP_RANGE;
     fusedQKV_masked_attention_dispatch<T>(
         qkv_buf_,
@@ -16,6 +16,7 @@
  */
 
 #include "src/fastertransformer/layers/attention_layers/GptContextAttentionLayer.h"
+#include "src/fastertransformer/kernels/lora_kernels.h"
 #include "src/fastertransformer/kernels/unfused_attention_kernels.h"
 #include "src/fastertransformer/utils/nvtx_utils.h"
 
@@ -38,6 +39,7 @@ void GptContextAttentionLayer<T>::forward(TensorMap*                output_tenso
     //          each element contains ptr with buffer shape[2, local_head_num_, prompt_length, size_per_head]
     //      d_prefix_prompt_lengths [batch_size], int (optional)
     //      linear_bias_slopes [head_num] (optional)
+    //      lora_slots [batch_size], int (optional)
 
     // output_tensors:
     //      hidden_features [token_num, hidden_dimension]
@@ -57,6 +59,7 @@ void GptContextAttentionLayer<T>::forward(TensorMap*                output_tenso
     const int* padding_offset          = input_tensors->getPtr<int>("padding_offset", nullptr);
     int*       cu_seqlens              = input_tensors->getPtr<int>("cu_seqlens", nullptr);
     T*         linear_bias_slopes      = input_tensors->getPtr<T>("linear_bias_slopes", nullptr);
+    const int* lora_slots              = input_tensors->getPtr<int>("lora_slots", nullptr);
     /* float*     attention_query_dynamic_scale = input_tensors->getPtr<float>("attention_query_dynamic_scale",
      * nullptr); */
 
@@ -142,6 +145,27 @@ void GptContextAttentionLayer<T>::forward(TensorMap*                output_tenso
 
     sync_check_cuda_error();
 
+    const LoraWeight<T>& qkv_lora = attention_weights->qkv_lora_weight;
+    if (lora_slots != nullptr && qkv_lora.a != nullptr) {
+        FT_CHECK_WITH_INFO(int8_mode_ == 0, "LoRA adapters are not supported with int8_mode.");
+        lora_buf_ = (float*)allocator_->reMalloc(lora_buf_, sizeof(float) * m * qkv_lora.rank, false);
+        invokeAddLora(qkv_buf_,
+                      attention_input,
+                      lora_buf_,
+                      qkv_lora.a,
+                      qkv_lora.b,
+                      qkv_lora.slot_stride,
+                      lora_slots,
+                      padding_offset,
+                      request_seq_len,
+                      m,
+                      hidden_units_,
+                      3 * local_hidden_units_,
+                      qkv_lora.rank,
+                      stream_);
+        sync_check_cuda_error();
+    }
+
     // IDEA: append prefix prompt key value here
     PrefixPromptBatchWeightsParam<T> param{d_prefix_prompt_batch,
                                            d_prefix_prompt_lengths,
@@ -609,6 +633,8 @@ void GptContextAttentionLayer<T>::freeBuffer()
         allocator_->free((void**)(&int8_gemm_workspace_));
         int8_gemm_ws_bytes_ = 0;
 
+        allocator_->free((void**)(&lora_buf_));
+
         is_allocate_buffer_ = false;
     }
 }
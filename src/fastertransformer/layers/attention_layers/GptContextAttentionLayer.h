@@ -73,6 +73,7 @@ protected:
     size_t mixed_gemm_ws_bytes_  = 0;
     char*  int8_gemm_workspace_  = nullptr;
     size_t int8_gemm_ws_bytes_   = 0;
+    float* lora_buf_             = nullptr;
 
     // int8_mode_ == 0 means we don't use any mechanism related to INT8.
     // int8_mode_ == 1 for weight quantized only gemm for GPT
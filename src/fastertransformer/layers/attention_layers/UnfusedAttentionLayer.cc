@@ -15,6 +15,7 @@
  */
 
 #include "src/fastertransformer/layers/attention_layers/UnfusedAttentionLayer.h"
+#include "src/fastertransformer/kernels/lora_kernels.h"
 #include "src/fastertransformer/kernels/unfused_attention_kernels.h"
 
 namespace fastertransformer {
@@ -31,6 +32,7 @@ void UnfusedAttentionLayer<T>::forward(TensorMap*                output_tensors,
     //      relative_attention_bias [head_num, seq_len, seq_len] (optional)
     //      linear_bias_slopes [head_num] (optional)
     //      ia3_tasks [batch] (optional)
+    //      lora_slots [batch] (optional)
     //  output_tensors:
     //      hidden_features  [token_num, hidden_units]
     //      attentions [batch, num_layer, head_num, seqlen, seqlen] (optional)
@@ -49,6 +51,7 @@ void UnfusedAttentionLayer<T>::forward(TensorMap*                output_tensors,
     const T*   relative_attention_bias = input_tensors->getPtr<T>("relative_attention_bias", nullptr);
     const T*   linear_bias_slopes      = input_tensors->getPtr<T>("linear_bias_slopes", nullptr);
     const int* ia3_tasks               = input_tensors->getPtr<int>("ia3_tasks", nullptr);
+    const int* lora_slots              = input_tensors->getPtr<int>("lora_slots", nullptr);
 
     bool with_bias                  = attention_weights->query_weight.bias != nullptr ? true : false;
     bool use_relative_position_bias = relative_attention_bias != nullptr ? true : false;
@@ -136,6 +139,39 @@ void UnfusedAttentionLayer<T>::forward(TensorMap*                output_tensors,
     }
 #endif
 
+    const LoraWeight<T>& qkv_lora = attention_weights->qkv_lora_weight;
+    if (lora_slots != nullptr && qkv_lora.a != nullptr) {
+        // One shrink for the three outputs, whose columns are interleaved in B.
+        lora_buf_ = (float*)allocator_->reMalloc(lora_buf_, sizeof(float) * m * qkv_lora.rank, false);
+        invokeLoraShrink(lora_buf_,
+                         from_tensor,
+                         qkv_lora.a,
+                         qkv_lora.slot_stride,
+                         lora_slots,
+                         padding_offset,
+                         request_seq_len,
+                         m,
+                         k,
+                         qkv_lora.rank,
+                         stream_);
+        T* qkv_bufs[] = {q_buf_, k_buf_, v_buf_};
+        for (int i = 0; i < 3; i++) {
+            invokeLoraExpand(qkv_bufs[i],
+                             lora_buf_,
+                             qkv_lora.b + i * n,
+                             qkv_lora.slot_stride,
+                             lora_slots,
+                             padding_offset,
+                             request_seq_len,
+                             m,
+                             n,
+                             3 * n,
+                             qkv_lora.rank,
+                             stream_);
+        }
+        sync_check_cuda_error();
+    }
+
     if (padding_offset == nullptr) {
         invokeAddQKVBiasIA3Transpose(q_buf_2_,
                                      k_buf_2_,
@@ -422,6 +458,7 @@ void UnfusedAttentionLayer<T>::freeBuffer()
         allocator_->free((void**)(&qkv_buf_));
         allocator_->free((void**)(&qkv_buf_2_));
         allocator_->free((void**)(&batch_qkv_kernel_ptr_));
+        allocator_->free((void**)(&lora_buf_));
         sync_check_cuda_error();
         is_allocate_buffer_ = false;
     }
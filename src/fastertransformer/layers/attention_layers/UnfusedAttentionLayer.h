@@ -56,6 +56,8 @@ protected:
     T** batch_qkv_input_ptr_  = nullptr;
     T** batch_qkv_buf_ptr_    = nullptr;
 
+    float* lora_buf_ = nullptr;
+
 public:
     UnfusedAttentionLayer(size_t           max_batch_size,
                           size_t           max_seq_len,
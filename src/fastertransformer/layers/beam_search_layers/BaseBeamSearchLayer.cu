@@ -17,9 +17,49 @@
 #include "src/fastertransformer/kernels/beam_search_penalty_kernels.h"
 #include "src/fastertransformer/layers/beam_search_layers/BaseBeamSearchLayer.h"
 #include "src/fastertransformer/utils/cuda_utils.h"
+#include "src/fastertransformer/utils/memory_utils.h"
+
+#include <algorithm>
 
 namespace fastertransformer {
 
+namespace {
+
+// Copies a runtime argument of shape [1] or [batch_size] on cpu to h_buf and d_buf, both of batch_size elements.
+template<typename V>
+void setRuntimeArg(TensorMap*         runtime_args,
+                   const std::string& name,
+                   V                  default_value,
+                   size_t             batch_size,
+                   V*                 h_buf,
+                   V*                 d_buf,
+                   cudaStream_t       stream)
+{
+    const Tensor arg = runtime_args == nullptr ?
+                           Tensor(MEMORY_CPU, getTensorType<V>(), {1}, &default_value) :
+                           runtime_args->at(name, Tensor(MEMORY_CPU, getTensorType<V>(), {1}, &default_value));
+    FT_CHECK_WITH_INFO(arg.size() == 1 || arg.size() == batch_size,
+                       fmtstr("%s must have 1 or %lu values, but has %lu.", name.c_str(), batch_size, arg.size()));
+    if (arg.size() == 1) {
+        std::fill_n(h_buf, batch_size, arg.getVal<V>());
+    }
+    else {
+        std::copy_n(arg.getPtr<V>(), batch_size, h_buf);
+    }
+    cudaAutoCpy(d_buf, h_buf, batch_size, stream);
+}
+
+template<typename V>
+bool isAllDefault(const V* values, int ite, int local_batch_size, V default_value)
+{
+    return values == nullptr
+           || std::all_of(values + ite * local_batch_size,
+                          values + (ite + 1) * local_batch_size,
+                          [&](V value) { return value == default_value; });
+}
+
+}  // namespace
+
 __global__ void update_indir_cache_kernel(int*        tgt_indir_cache,
                                           const int*  src_indir_cache,
                                           const int*  beam_ids,
@@ -114,6 +154,52 @@ BaseBeamSearchLayer<T>::~BaseBeamSearchLayer()
 {
     FT_LOG_DEBUG(__PRETTY_FUNCTION__);
     freeBuffer();
+    freeRuntimeArgsBuffer();
+}
+
+template<typename T>
+void BaseBeamSearchLayer<T>::allocateRuntimeArgsBuffer(size_t batch_size)
+{
+    FT_LOG_DEBUG(__PRETTY_FUNCTION__);
+    temperature_buf_ = reinterpret_cast<float*>(allocator_->reMalloc(temperature_buf_, sizeof(float) * batch_size));
+    repetition_penalty_buf_ =
+        reinterpret_cast<float*>(allocator_->reMalloc(repetition_penalty_buf_, sizeof(float) * batch_size));
+    min_lengths_buf_ = reinterpret_cast<int*>(allocator_->reMalloc(min_lengths_buf_, sizeof(int) * batch_size));
+    len_penalty_buf_ = reinterpret_cast<float*>(allocator_->reMalloc(len_penalty_buf_, sizeof(float) * batch_size));
+    diversity_rate_buf_ =
+        reinterpret_cast<float*>(allocator_->reMalloc(diversity_rate_buf_, sizeof(float) * batch_size));
+
+    // host buffers.
+    temperature_             = (float*)std::realloc((void*)temperature_, batch_size * sizeof(float));
+    repetition_penalty_      = (float*)std::realloc((void*)repetition_penalty_, batch_size * sizeof(float));
+    min_lengths_             = (int*)std::realloc((void*)min_lengths_, batch_size * sizeof(int));
+    len_penalty_             = (float*)std::realloc((void*)len_penalty_, batch_size * sizeof(float));
+    diversity_rate_          = (float*)std::realloc((void*)diversity_rate_, batch_size * sizeof(float));
+    runtime_args_batch_size_ = batch_size;
+}
+
+template<typename T>
+void BaseBeamSearchLayer<T>::freeRuntimeArgsBuffer()
+{
+    FT_LOG_DEBUG(__PRETTY_FUNCTION__);
+    if (runtime_args_batch_size_ > 0) {
+        allocator_->free((void**)(&temperature_buf_));
+        allocator_->free((void**)(&repetition_penalty_buf_));
+        allocator_->free((void**)(&min_lengths_buf_));
+        allocator_->free((void**)(&len_penalty_buf_));
+        allocator_->free((void**)(&diversity_rate_buf_));
+        std::free(temperature_);
+        std::free(repetition_penalty_);
+        std::free(min_lengths_);
+        std::free(len_penalty_);
+        std::free(diversity_rate_);
+        temperature_             = nullptr;
+        repetition_penalty_      = nullptr;
+        min_lengths_             = nullptr;
+        len_penalty_             = nullptr;
+        diversity_rate_          = nullptr;
+        runtime_args_batch_size_ = 0;
+    }
 }
 
 template<typename T>
@@ -128,7 +214,91 @@ void BaseBeamSearchLayer<T>::freeBuffer()
 template<typename T>
 void BaseBeamSearchLayer<T>::setup(const size_t batch_size, const size_t beam_width, TensorMap* runtime_args)
 {
-    // do nothing.
+    // Set up the runtime arguments of each request, so that a batch of requests with different arguments is decoded
+    // in a single pass.
+    //
+    // runtime_args:
+    //      beam_search_diversity_rate [1] or [batch_size] on cpu, optional
+    //      temperature [1] or [batch_size] on cpu, optional
+    //      len_penalty [1] or [batch_size] on cpu, optional
+    //      repetition_penalty [1] or [batch_size] on cpu, optional
+    //      presence_penalty [1] or [batch_size] on cpu, optional
+    //          Only one of repetition and presence penalties is allowed.
+    //      min_length [1] or [batch_size] on cpu, optional
+
+    FT_LOG_DEBUG(__PRETTY_FUNCTION__);
+    setupRuntimeArgs(batch_size, runtime_args);
+    is_runtime_args_setup_ = true;
+    last_step_             = -1;
+    last_ite_              = -1;
+}
+
+template<typename T>
+void BaseBeamSearchLayer<T>::setupRuntimeArgs(size_t batch_size, TensorMap* runtime_args)
+{
+    allocateRuntimeArgsBuffer(batch_size);
+
+    setRuntimeArg(runtime_args, "temperature", 1.0f, batch_size, temperature_, temperature_buf_, stream_);
+    setRuntimeArg(runtime_args, "len_penalty", 0.0f, batch_size, len_penalty_, len_penalty_buf_, stream_);
+    setRuntimeArg(
+        runtime_args, "beam_search_diversity_rate", 0.0f, batch_size, diversity_rate_, diversity_rate_buf_, stream_);
+    setRuntimeArg(runtime_args, "min_length", 0, batch_size, min_lengths_, min_lengths_buf_, stream_);
+
+    repetition_penalty_type_ = RepetitionPenaltyType::None;
+    if (runtime_args != nullptr
+        && (runtime_args->isExist("repetition_penalty") || runtime_args->isExist("presence_penalty"))) {
+        FT_CHECK_WITH_INFO(
+            !(runtime_args->isExist("repetition_penalty") && runtime_args->isExist("presence_penalty")),
+            "Found ambiguous parameters repetition_penalty and presence_penalty which are mutually exclusive. "
+            "Please provide one of repetition_penalty or presence_penalty.");
+        repetition_penalty_type_ = runtime_args->isExist("repetition_penalty") ? RepetitionPenaltyType::Multiplicative :
+                                                                                 RepetitionPenaltyType::Additive;
+    }
+    setRuntimeArg(runtime_args,
+                  repetition_penalty_type_ == RepetitionPenaltyType::Additive ? "presence_penalty" :
+                                                                                "repetition_penalty",
+                  getDefaultPenaltyValue(repetition_penalty_type_),
+                  batch_size,
+                  repetition_penalty_,
+                  repetition_penalty_buf_,
+                  stream_);
+}
+
+template<typename T>
+const float* BaseBeamSearchLayer<T>::getTemperatures(int ite, int local_batch_size) const
+{
+    return isAllDefault(temperature_, ite, local_batch_size, 1.0f) ? nullptr :
+                                                                     temperature_buf_ + ite * local_batch_size;
+}
+
+template<typename T>
+const float* BaseBeamSearchLayer<T>::getRepetitionPenalties(int ite, int local_batch_size) const
+{
+    const float default_value = getDefaultPenaltyValue(repetition_penalty_type_);
+    return repetition_penalty_type_ == RepetitionPenaltyType::None
+                   || isAllDefault(repetition_penalty_, ite, local_batch_size, default_value) ?
+               nullptr :
+               repetition_penalty_buf_ + ite * local_batch_size;
+}
+
+template<typename T>
+const int* BaseBeamSearchLayer<T>::getMinLengths(int ite, int local_batch_size) const
+{
+    return isAllDefault(min_lengths_, ite, local_batch_size, 0) ? nullptr : min_lengths_buf_ + ite * local_batch_size;
+}
+
+template<typename T>
+const float* BaseBeamSearchLayer<T>::getLenPenalties(int ite, int local_batch_size) const
+{
+    return isAllDefault(len_penalty_, ite, local_batch_size, 0.0f) ? nullptr :
+                                                                     len_penalty_buf_ + ite * local_batch_size;
+}
+
+template<typename T>
+const float* BaseBeamSearchLayer<T>::getDiversityRates(int ite, int local_batch_size) const
+{
+    return isAllDefault(diversity_rate_, ite, local_batch_size, 0.0f) ? nullptr :
+                                                                        diversity_rate_buf_ + ite * local_batch_size;
 }
 
 template<typename T>
@@ -189,13 +359,10 @@ void BaseBeamSearchLayer<T>::forward(TensorMap* output_tensors, TensorMap* input
     //      max_input_length [1] on cpu
     //      input_lengths [local_batch_size * beam_width], optional
     //      ite [1] on cpu
-    //      beam_search_diversity_rate [1] on cpu, optional
-    //      temperature [1] on cpu, optional
-    //      len_penalty [1] on cpu, optional
-    //      repetition_penalty [1] on cpu, optional
-    //      presence_penalty [1] on cpu, optional
-    //          Only one of repetition and presence penalties is allowed.
-    //      min_length [1] on cpu, int, optional
+    //
+    //      The runtime arguments (temperature, len_penalty, ...) of each request are given to setup() before each
+    //      generation. Callers which do not call setup() can still give them here, with the shapes setup() takes,
+    //      and they are then read at every call.
 
     // output_tensors:
     //      output_ids [max_seq_len, batch_size, beam_width]
@@ -217,29 +384,36 @@ void BaseBeamSearchLayer<T>::forward(TensorMap* output_tensors, TensorMap* input
     const int ite              = input_tensors->at("ite").getVal<int>();
     const int local_batch_size = input_tensors->at("logits").shape[0];
 
-    const float temperature    = input_tensors->getVal<float>("temperature", 1.0f);
-    const T*    embedding_bias = input_tensors->getPtr<const T>("embedding_bias", nullptr);
-
-    RepetitionPenaltyType repetition_penalty_type = RepetitionPenaltyType::None;
-    float                 repetition_penalty      = getDefaultPenaltyValue(repetition_penalty_type);
-    if (input_tensors->isExist("repetition_penalty") || input_tensors->isExist("presence_penalty")) {
-        FT_CHECK_WITH_INFO(
-            !(input_tensors->isExist("repetition_penalty") && input_tensors->isExist("presence_penalty")),
-            "Found ambiguous parameters repetition_penalty and presence_penalty which are mutually exclusive. "
-            "Please provide one of repetition_penalty or presence_penalty.");
-        repetition_penalty_type = input_tensors->isExist("repetition_penalty") ? RepetitionPenaltyType::Multiplicative :
-                                                                                 RepetitionPenaltyType::Additive;
-        repetition_penalty      = repetition_penalty_type == RepetitionPenaltyType::Multiplicative ?
-                                      input_tensors->getVal<float>("repetition_penalty") :
-                                      input_tensors->getVal<float>("presence_penalty");
+    // A call which does not come after the previous one starts another generation, so the arguments given to
+    // setup() for the previous generation are not used anymore.
+    if (step < last_step_ || (step == last_step_ && ite <= last_ite_)) {
+        is_runtime_args_setup_ = false;
     }
+    last_step_ = step;
+    last_ite_  = ite;
+    if (!is_runtime_args_setup_) {
+        setupRuntimeArgs(batch_size, input_tensors);
+    }
+
+    const T* embedding_bias = input_tensors->getPtr<const T>("embedding_bias", nullptr);
+    FT_CHECK_WITH_INFO((size_t)((ite + 1) * local_batch_size) <= runtime_args_batch_size_,
+                       fmtstr("The runtime arguments are set up for %lu requests, but ite %d of local batch size %d "
+                              "is decoded.",
+                              runtime_args_batch_size_,
+                              ite,
+                              local_batch_size));
+    const int* min_lengths    = getMinLengths(ite, local_batch_size);
+    const int  max_min_length = min_lengths == nullptr ?
+                                    0 :
+                                    *std::max_element(min_lengths_ + ite * local_batch_size,
+                                                     min_lengths_ + (ite + 1) * local_batch_size);
 
     invokeAddBiasApplyPenalties(
         step,
         input_tensors->at("logits").getPtr<T>(),
         output_tensors->at("output_ids")
             .getPtrWithOffset<const int>((step - 1) * batch_size * beam_width + ite * local_batch_size * beam_width),
-        output_tensors->getPtr<const int>("output_ids"),
+        output_tensors->at("output_ids").getPtrWithOffset<const int>(ite * local_batch_size * beam_width),
         output_tensors->getPtr<const int>("parent_ids"),
         input_tensors->getPtr<const int>("input_lengths", nullptr),
         output_tensors->getPtr<const int>("sequence_length", nullptr),
@@ -252,10 +426,11 @@ void BaseBeamSearchLayer<T>::forward(TensorMap* output_tensors, TensorMap* input
         vocab_size_,
         vocab_size_padded_,
         input_tensors->getPtr<const int>("end_id", nullptr),
-        temperature,
-        repetition_penalty,
-        repetition_penalty_type,
-        input_tensors->getVal<const int>("min_length", 0),
+        getTemperatures(ite, local_batch_size),
+        getRepetitionPenalties(ite, local_batch_size),
+        repetition_penalty_type_,
+        min_lengths,
+        max_min_length,
         stream_);
     sync_check_cuda_error();
 
@@ -25,6 +25,9 @@ template<typename T>
 class BaseBeamSearchLayer: public DynamicDecodeBaseLayer {
 private:
     void freeBuffer();
+    void allocateRuntimeArgsBuffer(size_t batch_size);
+    void freeRuntimeArgsBuffer();
+    void setupRuntimeArgs(size_t batch_size, TensorMap* runtime_args);
 
 protected:
     // meta data
@@ -34,6 +37,35 @@ protected:
     size_t topk_softmax_workspace_size_;
     void*  topk_softmax_workspace_ = nullptr;
 
+    // Runtime arguments of each request, set by setup() for the generation which follows it, or read from the
+    // inputs of every forward call otherwise. They outlive a forward call, so they are not freed with the workspace
+    // when is_free_buffer_after_forward_ is set.
+    bool   is_runtime_args_setup_   = false;
+    int    last_step_               = -1;  // and last_ite_, of the previous forward call of the generation
+    int    last_ite_                = -1;
+    size_t runtime_args_batch_size_ = 0;
+    float* temperature_buf_         = nullptr;
+    float* repetition_penalty_buf_  = nullptr;
+    int*   min_lengths_buf_         = nullptr;
+    float* len_penalty_buf_         = nullptr;
+    float* diversity_rate_buf_      = nullptr;
+
+    float* temperature_        = nullptr;
+    float* repetition_penalty_ = nullptr;
+    int*   min_lengths_        = nullptr;
+    float* len_penalty_        = nullptr;
+    float* diversity_rate_     = nullptr;
+
+    RepetitionPenaltyType repetition_penalty_type_ = RepetitionPenaltyType::None;
+
+    // Pointers to the runtime arguments of the requests [ite * local_batch_size, (ite + 1) * local_batch_size), or
+    // nullptr if they all use the default value.
+    const float* getTemperatures(int ite, int local_batch_size) const;
+    const float* getRepetitionPenalties(int ite, int local_batch_size) const;
+    const int*   getMinLengths(int ite, int local_batch_size) const;
+    const float* getLenPenalties(int ite, int local_batch_size) const;
+    const float* getDiversityRates(int ite, int local_batch_size) const;
+
     virtual void allocateBuffer()                                                   = 0;
     virtual void allocateBuffer(size_t batch_size, size_t beam_width)               = 0;
     virtual void invokeSoftMax(TensorMap* output_tensors, TensorMap* input_tensors) = 0;
@@ -0,0 +1,300 @@
+/*
+ * Copyright (c) 2023, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/fastertransformer/layers/beam_search_layers/BeamSearchReference.h"
+#include "src/fastertransformer/utils/cuda_utils.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <type_traits>
+
+namespace fastertransformer {
+
+namespace {
+
+static const float HALF_FLT_MAX = 65504.F;
+
+struct Candidate {
+    int   id;  // token id + row * vocab_size_padded, as produced by the device top-k kernels
+    float value;
+};
+
+// Descending value, then ascending id.
+bool isBetter(const Candidate& a, const Candidate& b)
+{
+    return a.value > b.value || (a.value == b.value && a.id < b.id);
+}
+
+template<typename T>
+void applyPenalties(T*                                        logits,
+                    const T*                                  embedding_bias,
+                    const std::vector<BeamSearchRequestArgs>& args,
+                    const RepetitionPenaltyType               repetition_penalty_type,
+                    const int*                                input_lengths,
+                    const int*                                output_ids,
+                    const int*                                parent_ids,
+                    const int*                                sequence_lengths,
+                    const int                                 step,
+                    const int                                 max_input_length,
+                    const int                                 ite,
+                    const int                                 local_batch_size,
+                    const int                                 batch_size,
+                    const int                                 beam_width,
+                    const int                                 vocab_size,
+                    const int                                 vocab_size_padded)
+{
+    const float mask_val       = std::is_same<T, half>::value ? -HALF_FLT_MAX : -FLT_MAX;
+    const float default_value  = getDefaultPenaltyValue(repetition_penalty_type);
+    const int   bbsize         = batch_size * beam_width;
+    const int   id_offset      = ite * local_batch_size * beam_width;
+    int         max_min_length = 0;
+    for (const BeamSearchRequestArgs& arg : args) {
+        max_min_length = std::max(max_min_length, arg.min_length);
+    }
+
+    for (int bbid = 0; bbid < local_batch_size * beam_width; bbid++) {
+        const int                    batch_id = bbid / beam_width;
+        const BeamSearchRequestArgs& arg      = args[batch_id];
+        T*                           row      = logits + (size_t)bbid * vocab_size_padded;
+
+        const float inv_temp = arg.temperature == 1.0f ? 1.0f : 1.0f / (arg.temperature + 1e-6f);
+        for (int i = 0; i < vocab_size_padded; i++) {
+            if (i < vocab_size) {
+                const float bias = embedding_bias == nullptr ? 0.0f : (float)embedding_bias[i];
+                row[i]           = (T)(((float)row[i] + bias) * inv_temp);
+            }
+            else {
+                row[i] = (T)mask_val;
+            }
+        }
+
+        if (repetition_penalty_type != RepetitionPenaltyType::None && step > 0
+            && arg.repetition_penalty != default_value) {
+            // The penalty is computed from the logits before any penalty is written, so that a token which appears
+            // several times is only penalized once.
+            const int          input_length = input_lengths != nullptr ? input_lengths[bbid] : max_input_length;
+            std::vector<int>   penalty_steps;
+            std::vector<int>   penalty_ids;
+            std::vector<float> penalty_logits;
+            auto               add_penalty = [&](int i, int token_id) {
+                const float logit = (float)row[token_id];
+                float       value;
+                if (repetition_penalty_type == RepetitionPenaltyType::Additive) {
+                    value = logit - arg.repetition_penalty;
+                }
+                else {
+                    value = logit > 0.0f ? logit / arg.repetition_penalty : logit * arg.repetition_penalty;
+                }
+                penalty_steps.push_back(i);
+                penalty_ids.push_back(token_id);
+                penalty_logits.push_back(value);
+            };
+            add_penalty(step - 1, output_ids[(step - 1) * bbsize + id_offset + bbid]);
+            int parent_beam = bbid % beam_width;
+            for (int i = step - 2; i >= 0; --i) {
+                // Skip the padded tokens.
+                if (i >= input_length && i < max_input_length) {
+                    continue;
+                }
+                parent_beam = parent_ids[i * bbsize + id_offset + batch_id * beam_width + parent_beam];
+                add_penalty(i, output_ids[i * bbsize + id_offset + batch_id * beam_width + parent_beam]);
+            }
+            for (size_t j = 0; j < penalty_ids.size(); j++) {
+                if (penalty_steps[j] >= input_length && penalty_steps[j] < max_input_length) {
+                    continue;
+                }
+                row[penalty_ids[j]] = (T)penalty_logits[j];
+            }
+        }
+
+        // sequence_lengths = max_input_length + num_gen_tokens - 1, which is equal to the length of k/v caches.
+        if (step - max_input_length < max_min_length
+            && sequence_lengths[bbid] + 1 - max_input_length < arg.min_length) {
+            row[arg.end_id] = (T)mask_val;
+        }
+    }
+}
+
+}  // namespace
+
+template<typename T>
+void beamSearchStepReference(T*                                        logits,
+                             const T*                                  embedding_bias,
+                             const std::vector<BeamSearchRequestArgs>& args,
+                             const RepetitionPenaltyType               repetition_penalty_type,
+                             const int*                                input_lengths,
+                             int*                                      output_ids,
+                             int*                                      parent_ids,
+                             int*                                      sequence_lengths,
+                             bool*                                     finished,
+                             float*                                    cum_log_probs,
+                             float*                                    output_log_probs,
+                             const int                                 step,
+                             const int                                 max_input_length,
+                             const int                                 ite,
+                             const int                                 local_batch_size,
+                             const int                                 batch_size,
+                             const int                                 beam_width,
+                             const int                                 vocab_size,
+                             const int                                 vocab_size_padded)
+{
+    FT_CHECK_WITH_INFO(args.size() == (size_t)local_batch_size,
+                       fmtstr("%lu runtime arguments for %d requests.", args.size(), local_batch_size));
+    applyPenalties(logits,
+                   embedding_bias,
+                   args,
+                   repetition_penalty_type,
+                   input_lengths,
+                   output_ids,
+                   parent_ids,
+                   sequence_lengths,
+                   step,
+                   max_input_length,
+                   ite,
+                   local_batch_size,
+                   batch_size,
+                   beam_width,
+                   vocab_size,
+                   vocab_size_padded);
+
+    const int id_offset = step * batch_size * beam_width + ite * local_batch_size * beam_width;
+    const int K         = beam_width;
+
+    std::vector<int>       new_ids(local_batch_size * K);
+    std::vector<float>     new_cum_log_probs(local_batch_size * K);
+    std::vector<Candidate> beam_candidates;
+    std::vector<Candidate> candidates;
+    std::vector<float>     log_probs(vocab_size_padded);
+    for (int batch_id = 0; batch_id < local_batch_size; batch_id++) {
+        const BeamSearchRequestArgs& arg = args[batch_id];
+
+        // The 2 * K best extensions of each beam.
+        candidates.clear();
+        for (int beam = 0; beam < K; beam++) {
+            const int bbid = batch_id * K + beam;
+            const T*  row  = logits + (size_t)bbid * vocab_size_padded;
+            if (finished[bbid]) {
+                std::fill(log_probs.begin(), log_probs.end(), -INFINITY);
+                log_probs[arg.end_id] = 0.0f;
+            }
+            else {
+                float max_logit = -FLT_MAX;
+                for (int i = 0; i < vocab_size_padded; i++) {
+                    max_logit = std::max(max_logit, (float)row[i]);
+                }
+                float sum = 0.0f;
+                for (int i = 0; i < vocab_size_padded; i++) {
+                    sum += std::exp((float)row[i] - max_logit);
+                }
+                const float log_sum = std::log(sum);
+                for (int i = 0; i < vocab_size_padded; i++) {
+                    log_probs[i] = (float)row[i] - max_logit - log_sum;
+                }
+            }
+            beam_candidates.resize(vocab_size_padded);
+            for (int i = 0; i < vocab_size_padded; i++) {
+                beam_candidates[i] = {i + bbid * vocab_size_padded, log_probs[i] + cum_log_probs[bbid]};
+            }
+            std::partial_sort(
+                beam_candidates.begin(), beam_candidates.begin() + 2 * K, beam_candidates.end(), isBetter);
+            candidates.insert(candidates.end(), beam_candidates.begin(), beam_candidates.begin() + 2 * K);
+        }
+
+        // The K best candidates of the request, ranked with its length penalty and diversity rate.
+        std::vector<Candidate> scores(candidates.size());
+        for (size_t i = 0; i < candidates.size(); i++) {
+            const int bbid   = batch_id * K + (candidates[i].id / vocab_size_padded) % K;
+            const int length = finished[bbid] ? sequence_lengths[bbid] : sequence_lengths[bbid] + 1;
+            float     score  = candidates[i].value;
+            if (arg.len_penalty != 0.0f && length != 1) {
+                score /= std::pow((float)length, arg.len_penalty);
+            }
+            score += arg.diversity_rate * (float)(i % K);
+            scores[i] = {(int)i, score};
+        }
+        std::partial_sort(scores.begin(), scores.begin() + K, scores.end(), isBetter);
+        for (int k = 0; k < K; k++) {
+            const Candidate& candidate = candidates[scores[k].id];
+            const int        bbid      = batch_id * K + k;
+            new_ids[bbid]              = candidate.id;
+            new_cum_log_probs[bbid]    = candidate.value;
+            if (output_log_probs != nullptr) {
+                output_log_probs[id_offset + bbid] =
+                    candidate.value - cum_log_probs[batch_id * K + (candidate.id / vocab_size_padded) % K];
+            }
+        }
+    }
+
+    // Every beam takes the state of its parent.
+    std::vector<int> lengths(local_batch_size * K);
+    for (int bbid = 0; bbid < local_batch_size * K; bbid++) {
+        lengths[bbid] = finished[bbid] ? sequence_lengths[bbid] : sequence_lengths[bbid] + 1;
+    }
+    for (int bbid = 0; bbid < local_batch_size * K; bbid++) {
+        const int batch_id = bbid / K;
+        const int beam     = (new_ids[bbid] / vocab_size_padded) % K;
+        const int token_id = new_ids[bbid] % vocab_size_padded;
+
+        sequence_lengths[bbid]       = lengths[batch_id * K + beam];
+        finished[bbid]               = token_id == args[batch_id].end_id;
+        parent_ids[id_offset + bbid] = beam;
+        output_ids[id_offset + bbid] = token_id;
+        cum_log_probs[bbid]          = new_cum_log_probs[bbid];
+    }
+}
+
+template void beamSearchStepReference(float*                                    logits,
+                                      const float*                              embedding_bias,
+                                      const std::vector<BeamSearchRequestArgs>& args,
+                                      const RepetitionPenaltyType               repetition_penalty_type,
+                                      const int*                                input_lengths,
+                                      int*                                      output_ids,
+                                      int*                                      parent_ids,
+                                      int*                                      sequence_lengths,
+                                      bool*                                     finished,
+                                      float*                                    cum_log_probs,
+                                      float*                                    output_log_probs,
+                                      const int                                 step,
+                                      const int                                 max_input_length,
+                                      const int                                 ite,
+                                      const int                                 local_batch_size,
+                                      const int                                 batch_size,
+                                      const int                                 beam_width,
+                                      const int                                 vocab_size,
+                                      const int                                 vocab_size_padded);
+
+template void beamSearchStepReference(half*                                     logits,
+                                      const half*                               embedding_bias,
+                                      const std::vector<BeamSearchRequestArgs>& args,
+                                      const RepetitionPenaltyType               repetition_penalty_type,
+                                      const int*                                input_lengths,
+                                      int*                                      output_ids,
+                                      int*                                      parent_ids,
+                                      int*                                      sequence_lengths,
+                                      bool*                                     finished,
+                                      float*                                    cum_log_probs,
+                                      float*                                    output_log_probs,
+                                      const int                                 step,
+                                      const int                                 max_input_length,
+                                      const int                                 ite,
+                                      const int                                 local_batch_size,
+                                      const int                                 batch_size,
+                                      const int                                 beam_width,
+                                      const int                                 vocab_size,
+                                      const int                                 vocab_size_padded);
+
+}  // namespace fastertransformer
@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) 2023, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Host reference of one step of batched beam search, as run by DynamicDecodeLayer with OnlineBeamSearchLayer
+ * (without beam hypotheses):
+ *
+ *   1. add the embedding bias, apply the temperature, repetition (or presence) penalty and min length penalty of
+ *      each request to its logits,
+ *   2. keep the 2 * beam_width best tokens of each beam by log softmax plus cumulative log prob; a finished beam
+ *      only extends with end_id at no cost,
+ *   3. rank the candidates of each request with its length penalty and diversity rate, and keep the beam_width best,
+ *   4. update output_ids, parent_ids, sequence_lengths, finished and cum_log_probs.
+ *
+ * Ties are broken by the lowest token id, as on the device, so the results are expected to match the device layer
+ * exactly for float logits. The cache indirection is not computed.
+ **/
+
+#pragma once
+
+#include "src/fastertransformer/kernels/penalty_types.h"
+
+#include <vector>
+
+namespace fastertransformer {
+
+struct BeamSearchRequestArgs {
+    int   end_id;
+    float temperature        = 1.0f;
+    float len_penalty        = 0.0f;
+    float repetition_penalty = 1.0f;  // or the presence penalty, according to the repetition penalty type
+    float diversity_rate     = 0.0f;
+    int   min_length         = 0;
+};
+
+// The requests [ite * local_batch_size, (ite + 1) * local_batch_size) of the batch are decoded. logits, input_lengths,
+// sequence_lengths, finished and cum_log_probs are local to the decoded requests, args has one entry per decoded
+// request, output_ids, parent_ids and output_log_probs cover the whole batch.
+template<typename T>
+void beamSearchStepReference(T*                                        logits,
+                             const T*                                  embedding_bias,
+                             const std::vector<BeamSearchRequestArgs>& args,
+                             const RepetitionPenaltyType               repetition_penalty_type,
+                             const int*                                input_lengths,
+                             int*                                      output_ids,
+                             int*                                      parent_ids,
+                             int*                                      sequence_lengths,
+                             bool*                                     finished,
+                             float*                                    cum_log_probs,
+                             float*                                    output_log_probs,
+                             const int                                 step,
+                             const int                                 max_input_length,
+                             const int                                 ite,
+                             const int                                 local_batch_size,
+                             const int                                 batch_size,
+                             const int                                 beam_width,
+                             const int                                 vocab_size,
+                             const int                                 vocab_size_padded);
+
+}  // namespace fastertransformer
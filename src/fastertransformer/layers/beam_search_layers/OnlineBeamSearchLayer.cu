@@ -96,10 +96,6 @@ void OnlineBeamSearchLayer<T>::invokeSoftMax(TensorMap* output_tensors, TensorMa
     //      max_input_length [1] on cpu
     //      input_lengths [local_batch_size * beam_width]
     //      ite [1] on cpu
-    //      beam_search_diversity_rate [1] on cpu, optional
-    //      temperature [1] on cpu, optional
-    //      len_penalty [1] on cpu, optional
-    //      repetition_penalty [1] on cpu, optional
 
     // output_tensors:
     //      output_ids [max_seq_len, batch_size, beam_width]
@@ -113,16 +109,13 @@ void OnlineBeamSearchLayer<T>::invokeSoftMax(TensorMap* output_tensors, TensorMa
     FT_CHECK(input_tensors->size() >= 7);
     FT_CHECK(output_tensors->size() >= 6);
 
-    const int   batch_size       = output_tensors->at("output_ids").shape[1];
-    const int   beam_width       = output_tensors->at("output_ids").shape[2];
-    const int   step             = input_tensors->at("step").getVal<int>();
-    const int   ite              = input_tensors->at("ite").getVal<int>();
-    const int   local_batch_size = input_tensors->at("logits").shape[0];
-    const float diversity_rate   = input_tensors->isExist("beam_search_diversity_rate") ?
-                                       input_tensors->at("beam_search_diversity_rate").getVal<float>() :
-                                       0.0f;
-    const float length_penalty =
-        input_tensors->isExist("len_penalty") ? input_tensors->at("len_penalty").getVal<float>() : 0.0f;
+    const int    batch_size       = output_tensors->at("output_ids").shape[1];
+    const int    beam_width       = output_tensors->at("output_ids").shape[2];
+    const int    step             = input_tensors->at("step").getVal<int>();
+    const int    ite              = input_tensors->at("ite").getVal<int>();
+    const int    local_batch_size = input_tensors->at("logits").shape[0];
+    const float* diversity_rates  = this->getDiversityRates(ite, local_batch_size);
+    const float* length_penalties = this->getLenPenalties(ite, local_batch_size);
 
     const int id_offset = step * batch_size * beam_width + local_batch_size * ite * beam_width;
 
@@ -138,7 +131,6 @@ void OnlineBeamSearchLayer<T>::invokeSoftMax(TensorMap* output_tensors, TensorMa
         beam_hyps.parent_ids_src       = output_tensors->at("parent_ids").getPtr<int>();
         beam_hyps.sequence_lengths_src = output_tensors->at("sequence_length").getPtr<int>();
         beam_hyps.log_probs_src        = output_tensors->getPtr<float>("output_log_probs", nullptr);
-        beam_hyps.length_penalty       = length_penalty;
         beam_hyps.end_ids              = input_tensors->at("end_id").getPtr<int>();
     }
 
@@ -156,8 +148,8 @@ void OnlineBeamSearchLayer<T>::invokeSoftMax(TensorMap* output_tensors, TensorMa
                       beam_width,
                       vocab_size_padded_,
                       input_tensors->at("end_id").getPtr<int>(),
-                      diversity_rate,
-                      length_penalty,
+                      diversity_rates,
+                      length_penalties,
                       stream_);
     sync_check_cuda_error();
 
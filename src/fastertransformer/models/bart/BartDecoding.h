@@ -105,8 +105,9 @@ protected:
     bool*              finished_buf_              = nullptr;
     bool*              h_finished_buf_            = nullptr;
 
-    int* start_ids_buf_ = nullptr;
-    int* end_ids_buf_   = nullptr;
+    int*   start_ids_buf_   = nullptr;
+    int*   end_ids_buf_     = nullptr;
+    float* len_penalty_buf_ = nullptr;
 
     T*   key_cache_             = nullptr;
     T*   value_cache_           = nullptr;
@@ -15,6 +15,7 @@
  */
 
 #include "src/fastertransformer/models/gptneox/GptNeoXWeight.h"
+#include "src/fastertransformer/utils/weight_loader.h"
 
 namespace fastertransformer {
 
@@ -271,11 +272,15 @@ void GptNeoXWeight<T>::loadModel(std::string dir_path)
         }
     }
 
+    WeightLoaderPool loader;
     for (int l = 0; l < num_layer_; l++) {
         if (isValidLayerParallelId(l)) {
-            decoder_layer_weights[l]->loadModel(dir_path + "/model.layers." + std::to_string(l), model_file_type);
+            loader.submit([this, l, &dir_path, model_file_type]() {
+                decoder_layer_weights[l]->loadModel(dir_path + "/model.layers." + std::to_string(l), model_file_type);
+            });
         }
     }
+    loader.wait();
 }
 
 template<typename T>
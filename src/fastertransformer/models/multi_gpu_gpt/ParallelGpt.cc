@@ -84,6 +84,50 @@ void ParallelGpt<T>::initialize()
                                                           allocator_,
                                                           is_free_buffer_after_forward_,
                                                           cuda_device_prop_);
+
+    PipelineCostParams cost_params;
+    cost_params.num_layer          = num_layer_;
+    cost_params.hidden_units       = hidden_units_;
+    cost_params.inter_size         = inter_size_;
+    cost_params.vocab_size         = vocab_size_;
+    cost_params.tensor_para_size   = tensor_para_.world_size_;
+    cost_params.pipeline_para_size = pipeline_para_.world_size_;
+    cost_params.data_type_size     = int8_mode_ != 0 ? 1 : sizeof(T);
+    setMicrobatchPlanner(createMicrobatchPlanner(cost_params));
+}
+
+template<typename T>
+void ParallelGpt<T>::setMicrobatchPlanner(std::shared_ptr<MicrobatchPlanner> planner)
+{
+    // The ranks must run the same microbatches, while the plans of a cost model depend on the calibration file of
+    // their host.
+    if (dynamic_cast<HeuristicMicrobatchPlanner*>(planner.get()) == nullptr
+        && tensor_para_.world_size_ * pipeline_para_.world_size_ > 1) {
+        planner = std::make_shared<BroadcastMicrobatchPlanner>(
+            planner, [this](size_t local_batch_size) { return broadcastLocalBatchSize(local_batch_size); });
+    }
+    microbatch_planner_ = planner;
+    // The stages have the same layers, so the first one is timed for all of them.
+    is_timing_stages_ = planner->isCalibrating() && pipeline_para_.rank_ == 0 && tensor_para_.rank_ == 0;
+    gpt_context_decoder_->setMicrobatchPlanner(planner.get());
+    gpt_context_decoder_->setStageTimer(is_timing_stages_ ? &stage_timer_ : nullptr);
+    gpt_decoder_->setStageTimer(is_timing_stages_ ? &stage_timer_ : nullptr);
+}
+
+template<typename T>
+void ParallelGpt<T>::setLoraAdapters(std::shared_ptr<LoraAdapterRegistry<T>> lora_adapters)
+{
+    lora_adapters_ = lora_adapters;
+}
+
+template<typename T>
+void ParallelGpt<T>::reportStageTimes(PipelinePhase phase)
+{
+    if (is_timing_stages_) {
+        stage_timer_.report(microbatch_planner_.get(),
+                            phase,
+                            (num_layer_ + pipeline_para_.world_size_ - 1) / pipeline_para_.world_size_);
+    }
 }
 
 template<typename T>
@@ -101,10 +145,7 @@ void ParallelGpt<T>::allocateBuffer(size_t batch_size,
                                     bool   is_return_context_cum_log_probs)
 {
     FT_LOG_DEBUG(__PRETTY_FUNCTION__);
-    const size_t batchxbeam       = batch_size * beam_width;
-    const size_t local_batch_size = getLocalBatchSize(batch_size, 1, pipeline_para_.world_size_);
-    FT_CHECK(batch_size % local_batch_size == 0);
-    const size_t num_microbatches = batch_size / local_batch_size;
+    const size_t batchxbeam = batch_size * beam_width;
 
     const size_t self_cache_size =
         (num_layer_ / pipeline_para_.world_size_) * batchxbeam * memory_len * hidden_units_ / tensor_para_.world_size_;
@@ -193,10 +234,25 @@ void ParallelGpt<T>::allocateBuffer(size_t batch_size,
         compact_idx_          = (int*)allocator_->reMalloc(compact_idx_, batch_size * sizeof(int), false);
         compact_size_         = (int*)allocator_->reMalloc(compact_size_, sizeof(int), false);
     }
+    // the microbatches are planned in forward, there are at most batch_size of them
     microbatch_should_stop_ =
-        (bool*)allocator_->reMalloc(microbatch_should_stop_, sizeof(bool) * num_microbatches, true, true);
+        (bool*)allocator_->reMalloc(microbatch_should_stop_, sizeof(bool) * batch_size, true, true);
     tiled_total_padding_count_ =
         (int*)allocator_->reMalloc(tiled_total_padding_count_, batchxbeam * sizeof(int), false);
+    if (lora_adapters_ != nullptr) {
+        lora_slots_buf_ = (int*)allocator_->reMalloc(lora_slots_buf_, batchxbeam * sizeof(int), false);
+    }
+    if (token_delta_cb_ != nullptr) {
+        h_delta_output_ids_ =
+            (int*)allocator_->reMalloc(h_delta_output_ids_, sizeof(int) * batchxbeam, false, true);
+        h_delta_parent_ids_ =
+            (int*)allocator_->reMalloc(h_delta_parent_ids_, sizeof(int) * batchxbeam, false, true);
+        h_delta_sequence_lengths_ =
+            (int*)allocator_->reMalloc(h_delta_sequence_lengths_, sizeof(int) * batchxbeam, false, true);
+        h_delta_finished_ = (bool*)allocator_->reMalloc(h_delta_finished_, sizeof(bool) * batchxbeam, false, true);
+        h_delta_output_log_probs_ =
+            (float*)allocator_->reMalloc(h_delta_output_log_probs_, sizeof(float) * batchxbeam, false, true);
+    }
 
     is_allocate_buffer_ = true;
 }
@@ -265,6 +321,13 @@ void ParallelGpt<T>::freeBuffer()
             allocator_->free((void**)(&compact_size_));
         }
         allocator_->free((void**)(&tiled_total_padding_count_));
+        allocator_->free((void**)(&lora_slots_buf_));
+
+        allocator_->free((void**)(&h_delta_output_ids_), true);
+        allocator_->free((void**)(&h_delta_parent_ids_), true);
+        allocator_->free((void**)(&h_delta_sequence_lengths_), true);
+        allocator_->free((void**)(&h_delta_finished_), true);
+        allocator_->free((void**)(&h_delta_output_log_probs_), true);
 
         is_allocate_buffer_ = false;
     }
@@ -393,10 +456,28 @@ ParallelGpt<T>::ParallelGpt(ParallelGpt<T> const& gpt):
 template<typename T>
 ParallelGpt<T>::~ParallelGpt()
 {
+    if (is_timing_stages_) {
+        microbatch_planner_->saveCalibration();
+    }
     delete gpt_decoder_;
     delete gpt_context_decoder_;
     delete dynamic_decode_layer_;
     freeBuffer();
+    allocator_->free((void**)(&microbatch_plan_buf_));
+}
+
+template<typename T>
+size_t ParallelGpt<T>::broadcastLocalBatchSize(size_t local_batch_size)
+{
+    // Each tensor parallel rank gets the plan of its first pipeline rank, then of the first rank of its group.
+    int plan             = local_batch_size;
+    microbatch_plan_buf_ = (int*)(allocator_->reMalloc(microbatch_plan_buf_, sizeof(int), false));
+    cudaAutoCpy(microbatch_plan_buf_, &plan, 1, stream_);
+    ftNcclBroadCast(microbatch_plan_buf_, 1, 0, pipeline_para_, stream_);
+    ftNcclBroadCast(microbatch_plan_buf_, 1, 0, tensor_para_, stream_);
+    cudaAutoCpy(&plan, microbatch_plan_buf_, 1, stream_);
+    check_cuda_error(cudaStreamSynchronize(stream_));
+    return plan;
 }
 
 template<typename T>
@@ -523,11 +604,24 @@ void ParallelGpt<T>::registerCallback(callback_sig* fn, void* ctx)
     token_generated_ctx_ = ctx;
 }
 
+template<typename T>
+void ParallelGpt<T>::registerDeltaCallback(callback_sig* fn, void* ctx)
+{
+    // The deltas are produced on the last pipeline rank, while the caller reads the outputs on the first one.
+    FT_CHECK_WITH_INFO(pipeline_para_.world_size_ == 1,
+                       "Streaming token deltas is not supported with pipeline parallelism, "
+                       "register the callback with registerCallback instead.");
+    token_delta_cb_  = fn;
+    token_delta_ctx_ = ctx;
+}
+
 template<typename T>
 void ParallelGpt<T>::unRegisterCallback()
 {
     token_generated_cb_  = nullptr;
     token_generated_ctx_ = nullptr;
+    token_delta_cb_      = nullptr;
+    token_delta_ctx_     = nullptr;
 }
 
 template<typename T>
@@ -607,6 +701,8 @@ void ParallelGpt<T>::forward(std::unordered_map<std::string, Tensor>*       outp
     //      top_p_decay [batch_size] on gpu, float, optional
     //      top_p_min [batch_size] on gpu, float, optional
     //      top_p_reset_ids [batch_size] on gpu, uint32, optional
+    //      adapter_ids [batch_size] on cpu, int, optional
+    //          The LoRA adapter of each request, -1 for the base model, see setLoraAdapters.
 
     // output_tensors:
     //      output_ids [batch_size, beam_width, max_output_seq_len]
@@ -802,6 +898,24 @@ void ParallelGpt<T>::forward(std::unordered_map<std::string, Tensor>*       outp
     setSeqLimitLen(seq_limit_len_, input_tensors->at("output_seq_len"), limit_len_offset, batch_size);
     POP_RANGE;
 
+    // Holds the LoRA slots of the batch until the end of the forward.
+    const bool                          use_lora_adapters = input_tensors->count("adapter_ids") > 0;
+    std::unique_ptr<AdapterSlotsHolder> lora_slots;
+    if (use_lora_adapters) {
+        FT_CHECK_WITH_INFO(lora_adapters_ != nullptr && gpt_weights->getLoraAdapters() == lora_adapters_.get(),
+                           "adapter_ids need the LoRA adapters of the model and of its weights to be the same.");
+        const Tensor& adapter_ids = input_tensors->at("adapter_ids");
+        FT_CHECK_WITH_INFO(adapter_ids.where == MEMORY_CPU && adapter_ids.size() == batch_size,
+                           "adapter_ids should be [batch_size] on cpu.");
+        lora_slots = lora_adapters_->getSlots(adapter_ids.getPtr<const int>(), batch_size, stream_);
+        const std::vector<int>& slots = lora_slots->getSlots();
+        std::vector<int>        tiled_slots(batch_size * beam_width);
+        for (size_t i = 0; i < tiled_slots.size(); i++) {
+            tiled_slots[i] = slots[i / beam_width];
+        }
+        cudaAutoCpy(lora_slots_buf_, tiled_slots.data(), batch_size * beam_width, stream_);
+    }
+
     const DataType       data_type      = getTensorType<T>();
     const cudaDataType_t gemm_data_type = getCudaDataType<T>();
 
@@ -887,7 +1001,9 @@ void ParallelGpt<T>::forward(std::unordered_map<std::string, Tensor>*       outp
         POP_RANGE;
 
         int  compact_size;
-        bool use_shared_contexts = (shared_contexts_ratio_ > 0.0f) && (max_input_length >= 1) && (batch_size > 1);
+        // the compacted contexts would lose the adapter of each request
+        bool use_shared_contexts = (shared_contexts_ratio_ > 0.0f) && (max_input_length >= 1) && (batch_size > 1)
+                                   && !use_lora_adapters;
         PUSH_RANGE("find context dups");
         if (use_shared_contexts) {
             invokeFindContextDups(shared_contexts_idx_,
@@ -1075,6 +1191,10 @@ void ParallelGpt<T>::forward(std::unordered_map<std::string, Tensor>*       outp
                                                     {local_head_num_},
                                                     linear_bias_slopes_ + local_head_num_ * tensor_para_.rank_));
             }
+            if (use_lora_adapters) {
+                decoder_input_tensors.insert(
+                    "lora_slots", Tensor(MEMORY_GPU, TYPE_INT32, {batch_size * beam_width}, lora_slots_buf_));
+            }
 
             TensorMap decoder_output_tensors(
                 {{"decoder_output",
@@ -1089,6 +1209,7 @@ void ParallelGpt<T>::forward(std::unordered_map<std::string, Tensor>*       outp
 
             gpt_context_decoder_->forward(
                 &decoder_output_tensors, &decoder_input_tensors, &gpt_weights->decoder_layer_weights);
+            reportStageTimes(PipelinePhase::CONTEXT);
 
             if (is_return_context_embeddings) {
                 PUSH_RANGE("context embedding sum length dim");
@@ -1191,7 +1312,9 @@ void ParallelGpt<T>::forward(std::unordered_map<std::string, Tensor>*       outp
     // If continue, we restart from initial_step because last token hasn't been processed in decoder
     const int step_start = continue_gen ? initial_step : max_input_length;
 
-    const size_t local_batch_size = getLocalBatchSize(batch_size, 1, pipeline_para_.world_size_);
+    // the steps attend to (step_start + gen_len) / 2 tokens on average
+    const size_t local_batch_size = microbatch_planner_->getLocalBatchSize(
+        PipelinePhase::GENERATION, batch_size, (step_start + gen_len) / 2, beam_width);
     FT_CHECK(batch_size % local_batch_size == 0);
     const size_t iteration_num = batch_size / local_batch_size;
     for (int microbatch = 0; microbatch < iteration_num; ++microbatch) {
@@ -1333,6 +1456,11 @@ void ParallelGpt<T>::forward(std::unordered_map<std::string, Tensor>*       outp
                                                          {local_head_num_},
                                                          linear_bias_slopes_ + local_head_num_ * tensor_para_.rank_)});
                 }
+                if (use_lora_adapters) {
+                    decoder_input_tensors.insert(
+                        {"lora_slots",
+                         Tensor(MEMORY_GPU, TYPE_INT32, {local_batch_size * beam_width}, lora_slots_buf_ + id_offset)});
+                }
 
                 std::unordered_map<std::string, Tensor> decoder_output_tensors(
                     {{"decoder_output",
@@ -1551,8 +1679,21 @@ void ParallelGpt<T>::forward(std::unordered_map<std::string, Tensor>*       outp
             }
             POP_RANGE;
         }
-
-        if (token_generated_cb_ && step_ + 1 < (int)gen_len) {
+        reportStageTimes(PipelinePhase::GENERATION);
+
+        if (token_delta_cb_) {
+            // The steps which only fill the caches of a continued generation replay the prompt, they generate no
+            // token and have no log probs.
+            if (!fill_caches_only && pipeline_para_.rank_ == pipeline_para_.world_size_ - 1
+                && tensor_para_.rank_ == 0) {
+                sendTokenDelta(batch_size,
+                               beam_width,
+                               max_context_len,
+                               output_tensors->count("output_log_probs") > 0
+                                   && output_tensors->at("output_log_probs").data != nullptr);
+            }
+        }
+        else if (token_generated_cb_ && step_ + 1 < (int)gen_len) {
             setOutputTensors(
                 output_tensors, input_tensors, gen_len, session_len, max_context_len, max_input_without_prompt_length);
             sendTensorsToFirstPipelineNode(output_tensors, input_tensors);
@@ -1735,6 +1876,59 @@ void ParallelGpt<T>::setOutputTensors(std::unordered_map<std::string, Tensor>*
     POP_RANGE;
 }
 
+template<typename T>
+void ParallelGpt<T>::sendTokenDelta(const size_t batch_size,
+                                    const size_t beam_width,
+                                    const size_t max_context_len,
+                                    const bool   is_return_log_probs)
+{
+    // Only copies the [batch_size, beam_width] rows written by the last step, so a streamed token costs O(batch x beam)
+    // instead of gathering the whole [batch_size, beam_width, session_len] outputs as setOutputTensors does.
+    // It is called on the rank which runs the dynamic decode, since the finished flags only live there. With beam
+    // search, the beams are reordered at every step: parent_ids gives the beam each new token extends.
+    const size_t batchxbeam = batch_size * beam_width;
+    cudaMemcpyAsync(h_delta_output_ids_,
+                    output_ids_buf_ + step_ * batchxbeam,
+                    sizeof(int) * batchxbeam,
+                    cudaMemcpyDeviceToHost,
+                    stream_);
+    cudaMemcpyAsync(
+        h_delta_sequence_lengths_, sequence_lengths_, sizeof(int) * batchxbeam, cudaMemcpyDeviceToHost, stream_);
+    cudaMemcpyAsync(h_delta_finished_, finished_buf_, sizeof(bool) * batchxbeam, cudaMemcpyDeviceToHost, stream_);
+    if (beam_width > 1) {
+        cudaMemcpyAsync(h_delta_parent_ids_,
+                        parent_ids_buf_ + step_ * batchxbeam,
+                        sizeof(int) * batchxbeam,
+                        cudaMemcpyDeviceToHost,
+                        stream_);
+    }
+    if (is_return_log_probs) {
+        // Same rows as written by DynamicDecodeLayer: beam search indexes them by step, sampling by generated token.
+        const size_t log_probs_row = beam_width > 1 ? step_ : step_ - max_context_len;
+        cudaMemcpyAsync(h_delta_output_log_probs_,
+                        output_log_probs_buf_ + log_probs_row * batchxbeam,
+                        sizeof(float) * batchxbeam,
+                        cudaMemcpyDeviceToHost,
+                        stream_);
+    }
+    check_cuda_error(cudaStreamSynchronize(stream_));
+
+    std::unordered_map<std::string, Tensor> delta_tensors{
+        {"step", Tensor{MEMORY_CPU, TYPE_INT32, {1}, &step_}},
+        {"output_ids", Tensor{MEMORY_CPU, TYPE_INT32, {batch_size, beam_width}, h_delta_output_ids_}},
+        {"sequence_length", Tensor{MEMORY_CPU, TYPE_INT32, {batch_size, beam_width}, h_delta_sequence_lengths_}},
+        {"is_finished", Tensor{MEMORY_CPU, TYPE_BOOL, {batch_size, beam_width}, h_delta_finished_}}};
+    if (beam_width > 1) {
+        delta_tensors.insert(
+            {"parent_ids", Tensor{MEMORY_CPU, TYPE_INT32, {batch_size, beam_width}, h_delta_parent_ids_}});
+    }
+    if (is_return_log_probs) {
+        delta_tensors.insert(
+            {"output_log_probs", Tensor{MEMORY_CPU, TYPE_FP32, {batch_size, beam_width}, h_delta_output_log_probs_}});
+    }
+    token_delta_cb_(&delta_tensors, token_delta_ctx_);
+}
+
 template<typename T>
 size_t ParallelGpt<T>::getPipelineParallelRank()
 {
@@ -1777,6 +1971,27 @@ size_t ParallelGpt<T>::getStep()
     return step_;
 }
 
+template<typename T>
+ExpertLoad ParallelGpt<T>::getExpertLoad() const
+{
+    FT_CHECK_WITH_INFO(gpt_variant_params_.moe_expert_parallel, "The expert load needs moe_expert_parallel.");
+    ExpertLoad       load       = gpt_context_decoder_->getExpertLoad();
+    const ExpertLoad generation = gpt_decoder_->getExpertLoad();
+    for (size_t e = 0; e < load.routed_tokens.size(); e++) {
+        load.routed_tokens[e] += generation.routed_tokens[e];
+        load.dropped_tokens[e] += generation.dropped_tokens[e];
+    }
+    return load;
+}
+
+template<typename T>
+void ParallelGpt<T>::resetExpertLoad()
+{
+    FT_CHECK_WITH_INFO(gpt_variant_params_.moe_expert_parallel, "The expert load needs moe_expert_parallel.");
+    gpt_context_decoder_->resetExpertLoad();
+    gpt_decoder_->resetExpertLoad();
+}
+
 template class ParallelGpt<float>;
 template class ParallelGpt<half>;
 #ifdef ENABLE_BF16
@@ -25,6 +25,7 @@
 #include "src/fastertransformer/models/multi_gpu_gpt/ParallelGptDecoder.h"
 #include "src/fastertransformer/models/multi_gpu_gpt/ParallelGptWeight.h"
 #include "src/fastertransformer/utils/custom_ar_comm.h"
+#include "src/fastertransformer/utils/microbatch_planner.h"
 
 namespace fastertransformer {
 
@@ -86,6 +87,13 @@ private:
     ParallelGptContextDecoder<T>* gpt_context_decoder_;
     DynamicDecodeLayer<float>*    dynamic_decode_layer_;
 
+    std::shared_ptr<MicrobatchPlanner> microbatch_planner_;
+    MicrobatchStageTimer               stage_timer_;
+    bool                               is_timing_stages_    = false;    // for the calibration of microbatch_planner_
+    int*                               microbatch_plan_buf_ = nullptr;  // [1], see broadcastLocalBatchSize
+
+    std::shared_ptr<LoraAdapterRegistry<T>> lora_adapters_;
+
     void allocateBuffer() override;
     void allocateBuffer(size_t batch_size,
                         size_t beam_width,
@@ -96,6 +104,10 @@ private:
     void freeBuffer() override;
 
     void initialize();
+    // Records the time of the layers of the microbatches just run, when calibrating.
+    void reportStageTimes(PipelinePhase phase);
+    // The local batch size planned by the first tensor and pipeline parallel rank.
+    size_t broadcastLocalBatchSize(size_t local_batch_size);
 
     void computeContextCumLogProbs(float*                      cum_log_probs,
                                    const T*                    context_decoder_outputs,
@@ -112,6 +124,7 @@ protected:
     size_t session_len_;
     size_t memory_len_;
     int*   tiled_total_padding_count_ = nullptr;
+    int*   lora_slots_buf_            = nullptr;  // [batch_size, beam_width], the slot of each sequence's adapter
 
     T*       padded_embedding_kernel_;
     const T* padded_embedding_kernel_ptr_;
@@ -173,6 +186,15 @@ protected:
     using callback_sig                 = void(std::unordered_map<std::string, Tensor>*, void*);
     callback_sig* token_generated_cb_  = nullptr;
     void*         token_generated_ctx_ = nullptr;
+    callback_sig* token_delta_cb_      = nullptr;
+    void*         token_delta_ctx_     = nullptr;
+
+    // pinned host buffers of the tokens generated by the last step, for token_delta_cb_
+    int*   h_delta_output_ids_       = nullptr;
+    int*   h_delta_parent_ids_       = nullptr;
+    int*   h_delta_sequence_lengths_ = nullptr;
+    bool*  h_delta_finished_         = nullptr;
+    float* h_delta_output_log_probs_ = nullptr;
 
     void setOutputTensors(std::unordered_map<std::string, Tensor>*       output_tensors,
                           const std::unordered_map<std::string, Tensor>* input_tensors,
@@ -182,6 +204,10 @@ protected:
                           const size_t                                   max_input_without_prompt_length);
     void sendTensorsToFirstPipelineNode(std::unordered_map<std::string, Tensor>*       output_tensors,
                                         const std::unordered_map<std::string, Tensor>* input_tensors);
+    void sendTokenDelta(const size_t batch_size,
+                        const size_t beam_width,
+                        const size_t max_context_len,
+                        const bool   is_return_log_probs);
 
 public:
     ParallelGpt(size_t                              max_batch_size,
@@ -242,7 +268,20 @@ public:
     size_t getStep();
     bool*  getFinishBuffer();
 
+    // Replaces the planner created from the environment, see createMicrobatchPlanner.
+    void setMicrobatchPlanner(std::shared_ptr<MicrobatchPlanner> planner);
+    // Serves the adapters of the registry, chosen per request with the adapter_ids input. The weights given to forward
+    // must be bound to the same registry, see ParallelGptWeight::setLoraAdapters.
+    void setLoraAdapters(std::shared_ptr<LoraAdapterRegistry<T>> lora_adapters);
+    // The rows routed to and dropped by each expert of the MoE layers since the last reset, over the context and
+    // generation phases. Needs gptVariantParams::moe_expert_parallel.
+    ExpertLoad getExpertLoad() const;
+    void       resetExpertLoad();
+
     void registerCallback(callback_sig* fn, void* ctx);
+    // Streams only the tokens of each step instead of the whole outputs, see sendTokenDelta. Requires
+    // pipeline_para_size 1.
+    void registerDeltaCallback(callback_sig* fn, void* ctx);
     void unRegisterCallback();
 };
 
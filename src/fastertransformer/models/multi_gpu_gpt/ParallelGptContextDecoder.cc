@@ -19,6 +19,7 @@
 #include "src/fastertransformer/kernels/bert_preprocess_kernels.h"
 #include "src/fastertransformer/kernels/gpt_kernels.h"
 #include "src/fastertransformer/utils/nvtx_utils.h"
+#include "src/fastertransformer/utils/workspace_planner.h"
 
 namespace fastertransformer {
 
@@ -82,6 +83,9 @@ void ParallelGptContextDecoder<T>::initialize()
                                                        custom_all_reduce_comm_,
                                                        enable_custom_all_reduce_);
     }
+    if (moe_expert_parallel_) {
+        ffn_layer_->setExpertParallel(tensor_para_, moe_capacity_factor_);
+    }
 }
 
 template<typename T>
@@ -94,18 +98,86 @@ template<typename T>
 void ParallelGptContextDecoder<T>::allocateBuffer(size_t batch_size, size_t seq_len, bool use_shared_contexts)
 {
     FT_LOG_DEBUG(__PRETTY_FUNCTION__);
-    decoder_normed_input_ = reinterpret_cast<T*>(
-        allocator_->reMalloc(decoder_normed_input_, sizeof(T) * batch_size * seq_len * hidden_units_, false));
-    self_attn_output_ = reinterpret_cast<T*>(
-        allocator_->reMalloc(self_attn_output_, sizeof(T) * batch_size * seq_len * hidden_units_, false));
+    // Lifetimes are the phases of one iteration of the context loop. The layer loop repeats the attention and ffn
+    // phases, so the buffers read by the next layer span the whole iteration. The others live inside one layer, e.g.
+    // k_cache_layer_ (attention) shares its memory with the moe buffers (ffn).
+    const int pre       = 0;  // compact inputs, padding offsets
+    const int attention = 1;
+    const int ffn       = 2;
+    const int post      = 3;  // rebuild padding, uncompact outputs
+
+    const size_t     token_num     = batch_size * seq_len;
+    const size_t     hidden_size   = sizeof(T) * token_num * hidden_units_;
+    const size_t     moe_rows      = pad_to_multiple_of_16(moe_k_ * token_num);
+    const size_t     moe_data_size = sizeof(T) * pad_to_multiple_of_16(moe_k_ * token_num * hidden_units_);
+    WorkspacePlanner planner;
+
+    const int decoder_normed_input_id = planner.addBuffer("decoder_normed_input", hidden_size, attention, ffn);
+    const int self_attn_output_id     = planner.addBuffer("self_attn_output", hidden_size, attention, ffn);
+    const int after_adapter_attn_output_id =
+        has_adapters_ ? planner.addBuffer("after_adapter_attn_output", hidden_size, ffn, ffn) : -1;
+    const int decoder_layer_output_id = planner.addBuffer("decoder_layer_output", hidden_size, pre, post);
+    const int padding_offset_id       = planner.addBuffer("padding_offset", sizeof(int) * token_num, pre, post);
+    const int cu_seqlens_id           = planner.addBuffer("cu_seqlens", sizeof(int) * (batch_size + 1), pre, post);
+    // for moe
+    const int expert_scales_id = planner.addBuffer("expert_scales", sizeof(T) * moe_rows, ffn, ffn);
+    const int expanded_source_row_to_expanded_dest_row_id =
+        planner.addBuffer("expanded_source_row_to_expanded_dest_row", sizeof(int) * moe_rows, ffn, ffn);
+    const int expert_for_source_row_id = planner.addBuffer("expert_for_source_row", sizeof(int) * moe_rows, ffn, ffn);
+    const int fc2_result_id            = planner.addBuffer("fc2_result", moe_data_size, ffn, ffn);
+    const int adapter_fc2_result_id =
+        has_adapters_ ? planner.addBuffer("adapter_fc2_result", moe_data_size, ffn, ffn) : -1;
+    // for shared contexts; the caches of a layer are read back by invokeUnCompactCaches right after attention
+    int compact_decoder_features_id = -1;
+    int compact_attention_mask_id   = -1;
+    int compact_input_lengths_id    = -1;
+    int k_cache_layer_id            = -1;
+    int v_cache_layer_id            = -1;
+    if (use_shared_contexts) {
+        compact_decoder_features_id = planner.addBuffer("compact_decoder_features", hidden_size, pre, post);
+        compact_attention_mask_id =
+            planner.addBuffer("compact_attention_mask", sizeof(T) * token_num * seq_len, pre, post);
+        compact_input_lengths_id = planner.addBuffer("compact_input_lengths", sizeof(int) * batch_size, pre, post);
+        k_cache_layer_id         = planner.addBuffer("k_cache_layer", hidden_size, attention, attention);
+        v_cache_layer_id         = planner.addBuffer("v_cache_layer", hidden_size, attention, attention);
+    }
+
+    const WorkspacePlan plan = planner.plan();
+    FT_LOG_DEBUG("context decoder workspace: %zu bytes, %zu bytes without sharing", plan.arena_size, plan.total_size);
+    workspace_ = allocator_->reMalloc(workspace_, plan.arena_size, false);
+
+    decoder_normed_input_    = plan.getBuffer<T>(workspace_, decoder_normed_input_id);
+    self_attn_output_        = plan.getBuffer<T>(workspace_, self_attn_output_id);
     normed_self_attn_output_ = decoder_normed_input_;  // reuse the buffer
     // only allocate additionl buffers when has adapters
     after_adapter_attn_output_ =
-        has_adapters_ ? reinterpret_cast<T*>(
-            allocator_->reMalloc(after_adapter_attn_output_, sizeof(T) * batch_size * seq_len * hidden_units_, false)) :
-                        self_attn_output_;
-    decoder_layer_output_ = reinterpret_cast<T*>(
-        allocator_->reMalloc(decoder_layer_output_, sizeof(T) * batch_size * seq_len * hidden_units_, false));
+        has_adapters_ ? plan.getBuffer<T>(workspace_, after_adapter_attn_output_id) : self_attn_output_;
+    decoder_layer_output_ = plan.getBuffer<T>(workspace_, decoder_layer_output_id);
+    padding_offset_       = plan.getBuffer<int>(workspace_, padding_offset_id);
+    cu_seqlens_           = plan.getBuffer<int>(workspace_, cu_seqlens_id);
+
+    expert_scales_ = plan.getBuffer<T>(workspace_, expert_scales_id);
+    expanded_source_row_to_expanded_dest_row_ =
+        plan.getBuffer<int>(workspace_, expanded_source_row_to_expanded_dest_row_id);
+    expert_for_source_row_ = plan.getBuffer<int>(workspace_, expert_for_source_row_id);
+    fc2_result_            = plan.getBuffer<T>(workspace_, fc2_result_id);
+    adapter_fc2_result_    = has_adapters_ ? plan.getBuffer<T>(workspace_, adapter_fc2_result_id) : nullptr;
+
+    if (use_shared_contexts) {
+        compact_decoder_features_ = plan.getBuffer<T>(workspace_, compact_decoder_features_id);
+        compact_attention_mask_   = plan.getBuffer<T>(workspace_, compact_attention_mask_id);
+        compact_input_lengths_    = plan.getBuffer<int>(workspace_, compact_input_lengths_id);
+        k_cache_layer_            = plan.getBuffer<T>(workspace_, k_cache_layer_id);
+        v_cache_layer_            = plan.getBuffer<T>(workspace_, v_cache_layer_id);
+    }
+    else {
+        compact_decoder_features_ = nullptr;
+        compact_attention_mask_   = nullptr;
+        compact_input_lengths_    = nullptr;
+        k_cache_layer_            = nullptr;
+        v_cache_layer_            = nullptr;
+    }
+
     if (int8_mode_ == 2) {
         // dynamic scale
         attention_query_dynamic_scale_ = reinterpret_cast<float*>(
@@ -114,36 +186,7 @@ void ParallelGptContextDecoder<T>::allocateBuffer(size_t batch_size, size_t seq_
             allocator_->reMalloc(ffn_intermediate_dynamic_scale_, sizeof(float) * batch_size * seq_len, true));
     }
     h_pinned_token_num_ptr_ = (size_t*)allocator_->reMalloc(h_pinned_token_num_ptr_, sizeof(size_t), true, true);
-    padding_offset_ =
-        reinterpret_cast<int*>(allocator_->reMalloc(padding_offset_, sizeof(int) * batch_size * seq_len, false));
-    cu_seqlens_ = reinterpret_cast<int*>(allocator_->reMalloc(cu_seqlens_, sizeof(int) * (batch_size + 1), false));
-    // for moe
-    expert_scales_ = reinterpret_cast<T*>(
-        allocator_->malloc(sizeof(T) * pad_to_multiple_of_16(moe_k_ * batch_size * seq_len), false));
-    expanded_source_row_to_expanded_dest_row_ = reinterpret_cast<int*>(
-        allocator_->malloc(sizeof(int) * pad_to_multiple_of_16(moe_k_ * batch_size * seq_len), false));
-    expert_for_source_row_ = reinterpret_cast<int*>(
-        allocator_->malloc(sizeof(int) * pad_to_multiple_of_16(moe_k_ * batch_size * seq_len), false));
-    fc2_result_ = reinterpret_cast<T*>(
-        allocator_->malloc(sizeof(T) * pad_to_multiple_of_16(moe_k_ * batch_size * seq_len * hidden_units_), false));
-    adapter_fc2_result_ =
-        has_adapters_ ? reinterpret_cast<T*>(allocator_->malloc(
-            sizeof(T) * pad_to_multiple_of_16(moe_k_ * batch_size * seq_len * hidden_units_), false)) :
-                        nullptr;
-    is_allocate_buffer_ = true;
-
-    if (use_shared_contexts) {
-        compact_decoder_features_ = reinterpret_cast<T*>(
-            allocator_->reMalloc(compact_decoder_features_, sizeof(T) * batch_size * seq_len * hidden_units_, false));
-        compact_attention_mask_ = reinterpret_cast<T*>(
-            allocator_->reMalloc(compact_attention_mask_, sizeof(T) * batch_size * seq_len * seq_len, false));
-        compact_input_lengths_ =
-            reinterpret_cast<int*>(allocator_->reMalloc(compact_input_lengths_, sizeof(int) * batch_size, false));
-        k_cache_layer_ = reinterpret_cast<T*>(
-            allocator_->reMalloc(k_cache_layer_, sizeof(T) * batch_size * seq_len * hidden_units_, false));
-        v_cache_layer_ = reinterpret_cast<T*>(
-            allocator_->reMalloc(v_cache_layer_, sizeof(T) * batch_size * seq_len * hidden_units_, false));
-    }
+    is_allocate_buffer_     = true;
 }
 
 template<typename T>
@@ -151,29 +194,26 @@ void ParallelGptContextDecoder<T>::freeBuffer()
 {
     if (is_allocate_buffer_) {
         FT_LOG_DEBUG(__PRETTY_FUNCTION__);
-        allocator_->free((void**)(&decoder_normed_input_));
-        allocator_->free((void**)(&self_attn_output_));
-        if (has_adapters_) {
-            allocator_->free((void**)(&after_adapter_attn_output_));
-            allocator_->free((void**)(&adapter_fc2_result_));
-        }
-        allocator_->free((void**)(&decoder_layer_output_));
+        allocator_->free((void**)(&workspace_));
+        decoder_normed_input_                     = nullptr;
+        self_attn_output_                         = nullptr;
+        normed_self_attn_output_                  = nullptr;
+        after_adapter_attn_output_                = nullptr;
+        decoder_layer_output_                     = nullptr;
+        padding_offset_                           = nullptr;
+        cu_seqlens_                               = nullptr;
+        expert_scales_                            = nullptr;
+        expanded_source_row_to_expanded_dest_row_ = nullptr;
+        expert_for_source_row_                    = nullptr;
+        fc2_result_                               = nullptr;
+        adapter_fc2_result_                       = nullptr;
+        compact_decoder_features_                 = nullptr;
+        compact_attention_mask_                   = nullptr;
+        compact_input_lengths_                    = nullptr;
+        k_cache_layer_                            = nullptr;
+        v_cache_layer_                            = nullptr;
+
         allocator_->free((void**)(&h_pinned_token_num_ptr_), true);
-        allocator_->free((void**)(&padding_offset_));
-        allocator_->free((void**)(&cu_seqlens_));
-
-        allocator_->free((void**)(&expert_scales_));
-        allocator_->free((void**)(&expanded_source_row_to_expanded_dest_row_));
-        allocator_->free((void**)(&expert_for_source_row_));
-        allocator_->free((void**)(&fc2_result_));
-
-        if (compact_attention_mask_ != nullptr) {
-            allocator_->free((void**)(&compact_decoder_features_));
-            allocator_->free((void**)(&compact_attention_mask_));
-            allocator_->free((void**)(&compact_input_lengths_));
-            allocator_->free((void**)(&k_cache_layer_));
-            allocator_->free((void**)(&v_cache_layer_));
-        }
         if (int8_mode_ == 2) {
             allocator_->free((void**)(&attention_query_dynamic_scale_));
             allocator_->free((void**)(&ffn_intermediate_dynamic_scale_));
@@ -250,6 +290,8 @@ ParallelGptContextDecoder<T>::ParallelGptContextDecoder(size_t               max
     activation_type_(gpt_variant_params.activation_type),
     adapter_inter_size_(gpt_variant_params.adapter_inter_size),
     has_adapters_(gpt_variant_params.has_adapters),
+    moe_expert_parallel_(gpt_variant_params.moe_expert_parallel),
+    moe_capacity_factor_(gpt_variant_params.moe_capacity_factor),
     hidden_units_(head_num_ * size_per_head),
     tensor_para_(tensor_para),
     pipeline_para_(pipeline_para),
@@ -279,6 +321,8 @@ ParallelGptContextDecoder<T>::ParallelGptContextDecoder(ParallelGptContextDecode
     activation_type_(decoder.activation_type_),
     adapter_inter_size_(decoder.adapter_inter_size_),
     has_adapters_(decoder.has_adapters_),
+    moe_expert_parallel_(decoder.moe_expert_parallel_),
+    moe_capacity_factor_(decoder.moe_capacity_factor_),
     hidden_units_(decoder.hidden_units_),
     tensor_para_(decoder.tensor_para_),
     pipeline_para_(decoder.pipeline_para_),
@@ -312,6 +356,7 @@ void ParallelGptContextDecoder<T>::forward(
     //      compact_idx [compact_size], optional
     //      batch_to_compact_idx [batch_size], optional
     //      linear_bias_slopes [head_num], optional
+    //      lora_slots [batch_size], optional
 
     // output tensors:
     //      decoder_output [batch_size, seq_len, hidden_dimension],
@@ -334,6 +379,9 @@ void ParallelGptContextDecoder<T>::forward(
 
     const bool use_shared_contexts = input_tensors->isExist("compact_idx");
     FT_CHECK(!use_shared_contexts || input_tensors->isExist("batch_to_compact_idx"));
+    const int* lora_slots = input_tensors->getPtr<int>("lora_slots", nullptr);
+    FT_CHECK_WITH_INFO(!use_shared_contexts || lora_slots == nullptr,
+                       "LoRA adapters are not supported with shared contexts.");
 
     Tensor decoder_input_tensor = input_tensors->at("decoder_input");
     FT_CHECK(decoder_input_tensor.shape[2] == hidden_units_);
@@ -370,7 +418,10 @@ void ParallelGptContextDecoder<T>::forward(
     }
     POP_RANGE;
 
-    const size_t local_batch_size = getLocalBatchSize(batch_size, seq_len, pipeline_para_.world_size_);
+    const size_t local_batch_size =
+        microbatch_planner_ != nullptr ?
+            microbatch_planner_->getLocalBatchSize(PipelinePhase::CONTEXT, batch_size, seq_len) :
+            getLocalBatchSize(batch_size, seq_len, pipeline_para_.world_size_);
     FT_CHECK(batch_size % local_batch_size == 0);
     const size_t iteration_num = batch_size / local_batch_size;
 
@@ -469,6 +520,9 @@ void ParallelGptContextDecoder<T>::forward(
                 }
                 POP_RANGE;
             }
+            if (stage_timer_ != nullptr && isFirstLayerParallelId(l)) {
+                stage_timer_->start(stream_);
+            }
 
             PUSH_RANGE("pre-mha layernorm");
             if (layernorm_type_ == LayerNormType::pre_layernorm) {
@@ -524,6 +578,12 @@ void ParallelGptContextDecoder<T>::forward(
                 self_attention_input_tensors.insert("linear_bias_slopes", input_tensors->at("linear_bias_slopes"));
             }
 
+            if (lora_slots != nullptr) {
+                self_attention_input_tensors.insert(
+                    "lora_slots",
+                    Tensor{MEMORY_GPU, TYPE_INT32, {local_batch_size}, lora_slots + ite * local_batch_size});
+            }
+
             // The key/value cache stride per batch.
             const size_t cache_stride_per_batch = hidden_units_ / tensor_para_.world_size_ * max_seq_len;
             // The key/value cache offset of the layer.
@@ -667,7 +727,25 @@ void ParallelGptContextDecoder<T>::forward(
                     Tensor{MEMORY_GPU, TYPE_INT32, {h_token_num, moe_k_}, expert_for_source_row_});
             }
 
-            ffn_layer_->resetInterSize(inter_size_ / tensor_para_.world_size_);
+            const int ffn_seq_len = seq_len;
+            if (lora_slots != nullptr) {
+                ffn_input_tensors.insert(
+                    "lora_slots",
+                    Tensor{MEMORY_GPU, TYPE_INT32, {local_batch_size}, lora_slots + ite * local_batch_size});
+                ffn_input_tensors.insert("seq_len", Tensor{MEMORY_CPU, TYPE_INT32, {1}, &ffn_seq_len});
+                if (is_unpadded_mha) {
+                    ffn_input_tensors.insert("padding_offset",
+                                             Tensor{MEMORY_GPU, TYPE_INT32, {h_token_num}, padding_offset_});
+                }
+            }
+
+            // The ranks hold whole experts with expert parallelism, so the weights must be sliced by expert too.
+            FT_CHECK_WITH_INFO(!use_moe || layer_weight->isMoeExpertParallel() == moe_expert_parallel_,
+                               fmtstr("The weights of layer %u do not match moe_expert_parallel = %d.",
+                                      l,
+                                      (int)moe_expert_parallel_));
+            ffn_layer_->resetInterSize(use_moe && moe_expert_parallel_ ? inter_size_ :
+                                                                         inter_size_ / tensor_para_.world_size_);
             ffn_layer_->forward(&ffn_output_tensors, &ffn_input_tensors, &layer_weight->ffn_weights);
 
             // the adapter after ffn (only pre layernorm currently)
@@ -793,6 +871,9 @@ void ParallelGptContextDecoder<T>::forward(
             }
             sync_check_cuda_error();
             POP_RANGE;
+            if (stage_timer_ != nullptr && (isLastLayerParallelId(l) || l == num_layer_ - 1)) {
+                stage_timer_->stop(stream_, h_token_num);
+            }
             PUSH_RANGE("Nccl send");
             if (isLastLayerParallelId(l) == true && (pipeline_para_.rank_ != pipeline_para_.world_size_ - 1)) {
                 const int data_size = h_token_num * hidden_units_ / tensor_para_.world_size_;
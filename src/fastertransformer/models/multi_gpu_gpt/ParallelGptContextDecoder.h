@@ -29,6 +29,7 @@
 #include "src/fastertransformer/utils/allocator.h"
 #include "src/fastertransformer/utils/cublasMMWrapper.h"
 #include "src/fastertransformer/utils/custom_ar_comm.h"
+#include "src/fastertransformer/utils/microbatch_planner.h"
 
 namespace fastertransformer {
 
@@ -55,7 +56,11 @@ private:
     // adapter
     bool   has_adapters_;
     size_t adapter_inter_size_;
-    T*     after_adapter_attn_output_;
+    T*     after_adapter_attn_output_ = nullptr;
+
+    // expert parallelism
+    bool  moe_expert_parallel_;
+    float moe_capacity_factor_;
 
     // calculated data
     size_t hidden_units_;
@@ -79,6 +84,9 @@ private:
     BaseAttentionLayer<T>* self_attention_layer_;
     FfnLayer<T>*           ffn_layer_;
 
+    MicrobatchPlanner*    microbatch_planner_ = nullptr;  // getLocalBatchSize when null
+    MicrobatchStageTimer* stage_timer_        = nullptr;
+
     void allocateBuffer() override;
     void allocateBuffer(size_t batch_size, size_t seq_len, bool use_shared_contexts);
     void freeBuffer() override;
@@ -88,6 +96,9 @@ private:
     bool isLastLayerParallelId(uint l);
     int  getFirstLayerParallelId();
 
+    // The device scratch buffers below point into workspace_, laid out by WorkspacePlanner in allocateBuffer.
+    void* workspace_ = nullptr;
+
     T*      decoder_normed_input_    = nullptr;
     T*      self_attn_output_        = nullptr;
     T*      normed_self_attn_output_ = nullptr;
@@ -138,6 +149,26 @@ public:
 
     ~ParallelGptContextDecoder();
 
+    // The load of the experts, with moe_expert_parallel only.
+    ExpertLoad getExpertLoad() const
+    {
+        return ffn_layer_->getExpertLoad();
+    }
+    void resetExpertLoad()
+    {
+        ffn_layer_->resetExpertLoad();
+    }
+
+    void setMicrobatchPlanner(MicrobatchPlanner* microbatch_planner)
+    {
+        microbatch_planner_ = microbatch_planner;
+    }
+    // Times the layers of each microbatch, see MicrobatchStageTimer.
+    void setStageTimer(MicrobatchStageTimer* stage_timer)
+    {
+        stage_timer_ = stage_timer;
+    }
+
     void forward(TensorMap*                                            output_tensors,
                  const TensorMap*                                      input_tensors,
                  const std::vector<ParallelGptDecoderLayerWeight<T>*>* decoder_layer_weights);
@@ -78,6 +78,9 @@ void ParallelGptDecoder<T>::initialize()
                                                        custom_all_reduce_comm_,
                                                        enable_custom_all_reduce_);
     }
+    if (moe_expert_parallel_) {
+        ffn_layer_->setExpertParallel(tensor_para_, moe_capacity_factor_);
+    }
 }
 
 template<typename T>
@@ -115,6 +118,8 @@ ParallelGptDecoder<T>::ParallelGptDecoder(size_t                              ma
     activation_type_(gpt_variant_params.activation_type),
     adapter_inter_size_(gpt_variant_params.adapter_inter_size),
     has_adapters_(gpt_variant_params.has_adapters),
+    moe_expert_parallel_(gpt_variant_params.moe_expert_parallel),
+    moe_capacity_factor_(gpt_variant_params.moe_capacity_factor),
     hidden_units_(head_num_ * size_per_head_),
     tensor_para_(tensor_para),
     pipeline_para_(pipeline_para),
@@ -146,6 +151,8 @@ ParallelGptDecoder<T>::ParallelGptDecoder(ParallelGptDecoder<T> const& decoder):
     activation_type_(decoder.activation_type_),
     adapter_inter_size_(decoder.adapter_inter_size_),
     has_adapters_(decoder.has_adapters_),
+    moe_expert_parallel_(decoder.moe_expert_parallel_),
+    moe_capacity_factor_(decoder.moe_capacity_factor_),
     hidden_units_(decoder.hidden_units_),
     tensor_para_(decoder.tensor_para_),
     pipeline_para_(decoder.pipeline_para_),
@@ -271,6 +278,7 @@ void ParallelGptDecoder<T>::forward(std::unordered_map<std::string, Tensor>*
     //          is real local_batch_size. (optional.)
     //      masked_tokens [local_batch_size, memory_len]
     //      linear_bias_slopes [head_num], optional
+    //      lora_slots [local_batch_size], optional
 
     // output tensors:
     //      decoder_output [local_batch_size, hidden_dimension],
@@ -338,6 +346,9 @@ void ParallelGptDecoder<T>::forward(std::unordered_map<std::string, Tensor>*
             }
             POP_RANGE;
         }
+        if (stage_timer_ != nullptr && isFirstLayerParallelId(l)) {
+            stage_timer_->start(stream_);
+        }
 
         PUSH_RANGE("pre-mha layernorm");
         ParallelGptDecoderLayerWeight<T>* layer_weight = gpt_decoder_layer_weight->at(l);
@@ -375,6 +386,9 @@ void ParallelGptDecoder<T>::forward(std::unordered_map<std::string, Tensor>*
         if (input_tensors->count("linear_bias_slopes")) {
             self_attention_input_tensors.insert("linear_bias_slopes", input_tensors->at("linear_bias_slopes"));
         }
+        if (input_tensors->count("lora_slots")) {
+            self_attention_input_tensors.insert("lora_slots", input_tensors->at("lora_slots"));
+        }
 
         size_t cache_offset = l - getFirstLayerParallelId();
         for (auto t = k_cache.shape.begin() + 1; t != k_cache.shape.end(); ++t) {
@@ -498,7 +512,17 @@ void ParallelGptDecoder<T>::forward(std::unordered_map<std::string, Tensor>*
                 Tensor{MEMORY_GPU, TYPE_INT32, {local_batch_size, moe_k_}, expert_for_source_row_});
         }
 
-        ffn_layer_->resetInterSize(inter_size_ / tensor_para_.world_size_);
+        if (input_tensors->count("lora_slots")) {
+            ffn_input_tensors.insert("lora_slots", input_tensors->at("lora_slots"));
+        }
+
+        // The ranks hold whole experts with expert parallelism, so the weights must be sliced by expert too.
+        FT_CHECK_WITH_INFO(!use_moe || layer_weight->isMoeExpertParallel() == moe_expert_parallel_,
+                           fmtstr("The weights of layer %u do not match moe_expert_parallel = %d.",
+                                  l,
+                                  (int)moe_expert_parallel_));
+        ffn_layer_->resetInterSize(use_moe && moe_expert_parallel_ ? inter_size_ :
+                                                                     inter_size_ / tensor_para_.world_size_);
         ffn_layer_->forward(&ffn_output_tensors, &ffn_input_tensors, &layer_weight->ffn_weights);
 
         // the adapter after ffn
@@ -625,6 +649,9 @@ void ParallelGptDecoder<T>::forward(std::unordered_map<std::string, Tensor>*
         sync_check_cuda_error();
         POP_RANGE;
 
+        if (stage_timer_ != nullptr && (isLastLayerParallelId(l) || l == num_layer_ - 1)) {
+            stage_timer_->stop(stream_, local_batch_size);
+        }
         PUSH_RANGE("Nccl send");
         if (isLastLayerParallelId(l) == true && pipeline_para_.rank_ != pipeline_para_.world_size_ - 1
             && pipeline_para_.world_size_ > 1) {
@@ -27,6 +27,7 @@
 #include "src/fastertransformer/utils/allocator.h"
 #include "src/fastertransformer/utils/cublasMMWrapper.h"
 #include "src/fastertransformer/utils/custom_ar_comm.h"
+#include "src/fastertransformer/utils/microbatch_planner.h"
 #include "src/fastertransformer/utils/nccl_utils.h"
 namespace fastertransformer {
 
@@ -52,6 +53,10 @@ private:
     size_t adapter_inter_size_;
     T*     after_adapter_attn_output_;
 
+    // expert parallelism
+    bool  moe_expert_parallel_;
+    float moe_capacity_factor_;
+
     // calculated data
     size_t hidden_units_;
 
@@ -76,6 +81,8 @@ private:
     BaseAttentionLayer<T>* self_attention_layer_;
     FfnLayer<T>*           ffn_layer_;
 
+    MicrobatchStageTimer* stage_timer_ = nullptr;
+
     void initialize();
     void allocateBuffer() override;
     void allocateBuffer(size_t batch_size);
@@ -114,6 +121,22 @@ public:
 
     ~ParallelGptDecoder();
 
+    // The load of the experts, with moe_expert_parallel only.
+    ExpertLoad getExpertLoad() const
+    {
+        return ffn_layer_->getExpertLoad();
+    }
+    void resetExpertLoad()
+    {
+        ffn_layer_->resetExpertLoad();
+    }
+
+    // Times the layers of each microbatch, see MicrobatchStageTimer.
+    void setStageTimer(MicrobatchStageTimer* stage_timer)
+    {
+        stage_timer_ = stage_timer;
+    }
+
     void forward(std::unordered_map<std::string, Tensor>*              output_tensors,
                  const std::unordered_map<std::string, Tensor>*        input_tensors,
                  const std::vector<ParallelGptDecoderLayerWeight<T>*>* decoder_layer_weights);
@@ -42,7 +42,9 @@ ParallelGptDecoderLayerWeight<T>::ParallelGptDecoderLayerWeight(const int
 }
 
 template<typename T>
-ParallelGptDecoderLayerWeight<T>::ParallelGptDecoderLayerWeight(const int int8_mode): int8_mode_(int8_mode)
+ParallelGptDecoderLayerWeight<T>::ParallelGptDecoderLayerWeight(const int        int8_mode,
+                                                                gptVariantParams gpt_variant_params):
+    int8_mode_(int8_mode), gpt_variant_params_(gpt_variant_params)
 {
 }
 
@@ -275,6 +277,8 @@ template<typename T>
 void ParallelGptDecoderLayerWeight<T>::loadModel(std::string dir_path, FtCudaDataType model_file_type)
 {
     FT_CHECK(is_maintain_buffer == true);
+    FT_CHECK_WITH_INFO(!gpt_variant_params_.moe_expert_parallel,
+                       "loadModel cannot read the checkpoints sliced by expert of expert parallelism.");
 
     loadWeightFromBin<T>(weights_ptr[0], {hidden_units_}, dir_path + ".input_layernorm.bias.bin", model_file_type);
     loadWeightFromBin<T>(weights_ptr[1], {hidden_units_}, dir_path + ".input_layernorm.weight.bin", model_file_type);
@@ -48,13 +48,17 @@ struct gptVariantParams {
     size_t adapter_inter_size = 0;
     // Whether to use the attention linear positional bias
     bool use_attention_linear_bias = false;
+    // Whether to split the experts of the MoE layers across the tensor parallel ranks instead of slicing each of them,
+    // see ExpertParallelMoe, and the capacity factor of the experts then (0 drops no token).
+    bool  moe_expert_parallel = false;
+    float moe_capacity_factor = 0.0f;
 };
 
 template<typename T>
 struct ParallelGptDecoderLayerWeight {
 public:
     ParallelGptDecoderLayerWeight() = default;
-    ParallelGptDecoderLayerWeight(const int int8_mode);
+    ParallelGptDecoderLayerWeight(const int int8_mode, gptVariantParams gpt_variant_params = {});
     ParallelGptDecoderLayerWeight(const int        hidden_units,
                                   const int        inter_size,
                                   const int        tensor_para_size,
@@ -70,6 +74,11 @@ public:
 #endif
     void transposeCalibrateQuantizeWeight();
     void transposeWeight();
+    // Whether the MoE experts are laid out for expert parallelism, see gptVariantParams::moe_expert_parallel.
+    bool isMoeExpertParallel() const
+    {
+        return gpt_variant_params_.moe_expert_parallel;
+    }
 
     LayerNormWeight<T> pre_layernorm_weights;
     AttentionWeight<T> self_attention_weights;
@@ -15,6 +15,8 @@
  */
 
 #include "src/fastertransformer/models/multi_gpu_gpt/ParallelGptWeight.h"
+#include "src/fastertransformer/utils/packed_checkpoint.h"
+#include "src/fastertransformer/utils/weight_loader.h"
 
 namespace fastertransformer {
 
@@ -120,7 +122,8 @@ ParallelGptWeight<T>::ParallelGptWeight(const ParallelGptWeight& other):
     prompt_learning_type_(other.prompt_learning_type_),
     prompt_learning_pair_(other.prompt_learning_pair_),
     gpt_variant_params_(other.gpt_variant_params_),
-    shared_embed_(other.shared_embed_)
+    shared_embed_(other.shared_embed_),
+    lora_adapters_(other.lora_adapters_)
 {
     mallocWeights();
     if (gpt_variant_params_.has_positional_encoding) {
@@ -178,6 +181,7 @@ ParallelGptWeight<T>& ParallelGptWeight<T>::operator=(const ParallelGptWeight& o
     prompt_learning_pair_       = other.prompt_learning_pair_;
     gpt_variant_params_         = other.gpt_variant_params_;
     shared_embed_               = other.shared_embed_;
+    lora_adapters_              = other.lora_adapters_;
 
     mallocWeights();
     if (gpt_variant_params_.has_positional_encoding) {
@@ -345,11 +349,35 @@ void ParallelGptWeight<T>::loadModel(std::string dir_path)
     }
     setWeightPtr();
 
+    WeightLoaderPool loader;
     for (int l = 0; l < num_layer_; l++) {
         if (isValidLayerParallelId(l)) {
-            decoder_layer_weights[l]->loadModel(dir_path + "/model.layers." + std::to_string(l), model_file_type);
+            loader.submit([this, l, &dir_path, model_file_type]() {
+                decoder_layer_weights[l]->loadModel(dir_path + "/model.layers." + std::to_string(l), model_file_type);
+            });
         }
     }
+    loader.wait();
+    releasePackedCheckpoints(dir_path);
+}
+
+template<typename T>
+void ParallelGptWeight<T>::setLoraAdapters(const LoraAdapterRegistry<T>* lora_adapters)
+{
+    lora_adapters_ = lora_adapters;
+    for (int l = 0; l < num_layer_; l++) {
+        if (!isValidLayerParallelId(l)) {
+            continue;
+        }
+        ParallelGptDecoderLayerWeight<T>* layer_weight = decoder_layer_weights[l];
+
+        auto getWeight = [&](LoraTarget target) {
+            return lora_adapters == nullptr ? LoraWeight<T>() : lora_adapters->getWeight(l, target);
+        };
+        layer_weight->self_attention_weights.qkv_lora_weight = getWeight(LoraTarget::QKV);
+        layer_weight->ffn_weights.intermediate_lora_weight   = getWeight(LoraTarget::FFN_INTERMEDIATE);
+        layer_weight->ffn_weights.output_lora_weight         = getWeight(LoraTarget::FFN_OUTPUT);
+    }
 }
 
 template<typename T>
@@ -361,13 +389,14 @@ bool ParallelGptWeight<T>::isValidLayerParallelId(int l)
 }
 
 template<typename T>
-void ParallelGptWeight<T>::resizeLayer(const int num_layer, const int int8_mode)
+void ParallelGptWeight<T>::resizeLayer(const int num_layer, const int int8_mode, gptVariantParams gpt_variant_params)
 {
-    int8_mode_ = int8_mode;
-    num_layer_ = num_layer;
+    int8_mode_          = int8_mode;
+    num_layer_          = num_layer;
+    gpt_variant_params_ = gpt_variant_params;
     decoder_layer_weights.reserve(num_layer_);
     for (int l = 0; l < num_layer_; l++) {
-        decoder_layer_weights.push_back(new ParallelGptDecoderLayerWeight<T>(int8_mode_));
+        decoder_layer_weights.push_back(new ParallelGptDecoderLayerWeight<T>(int8_mode_, gpt_variant_params_));
     }
 }
 
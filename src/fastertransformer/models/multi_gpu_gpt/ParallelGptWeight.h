@@ -17,6 +17,7 @@
 #pragma once
 
 #include "src/fastertransformer/kernels/layernorm_kernels.h"
+#include "src/fastertransformer/layers/adapter_layers/LoraAdapterRegistry.h"
 
 #include "src/fastertransformer/models/multi_gpu_gpt/ParallelGptDecoder.h"
 #include "src/fastertransformer/models/multi_gpu_gpt/ParallelGptDecoderLayerWeight.h"
@@ -46,7 +47,9 @@ struct ParallelGptWeight {
     ParallelGptWeight(const ParallelGptWeight& other);
     ParallelGptWeight& operator=(const ParallelGptWeight& other);
     void               loadModel(std::string dir_path);
-    void               resizeLayer(const int num_layer, const int int8_mode = 0);
+    void               resizeLayer(const int        num_layer,
+                                   const int        int8_mode          = 0,
+                                   gptVariantParams gpt_variant_params = {});
 #ifdef SPARSITY_ENABLED
     void compress_weights(cublasMMWrapper& cublas_wrapper);
 #endif
@@ -74,6 +77,13 @@ struct ParallelGptWeight {
     {
         max_seq_len_ = max_seq_len;
     }
+    // Points the LoRA weights of the layers of this pipeline parallel rank to the slots of lora_adapters, or clears
+    // them for nullptr. The registry must outlive the binding.
+    void                                 setLoraAdapters(const LoraAdapterRegistry<T>* lora_adapters);
+    inline const LoraAdapterRegistry<T>* getLoraAdapters() const
+    {
+        return lora_adapters_;
+    }
 
 private:
     void setWeightPtr();
@@ -102,6 +112,8 @@ private:
     // each prompt token's weight size
     size_t prompt_token_weight_size_ = 0;
 
+    const LoraAdapterRegistry<T>* lora_adapters_ = nullptr;
+
     bool is_maintain_buffer = false;
 
     // The number of base weights of the GPT model: According to the variant params,
@@ -20,8 +20,17 @@
 #include "src/fastertransformer/utils/logger.h"
 #include "src/fastertransformer/utils/memory_utils.h"
 
+#include <algorithm>
+
 namespace fastertransformer {
 
+// The files of the IA3 vectors, in the order of ia3_weights_ptr_.
+static const char* const ia3_weight_names[IA3_ADAPTER_MAX_NUM_DECODER] = {"layer.0.SelfAttention.k.ia3.weight.",
+                                                                          "layer.0.SelfAttention.v.ia3.weight.",
+                                                                          "layer.1.EncDecAttention.k.ia3.weight.",
+                                                                          "layer.1.EncDecAttention.v.ia3.weight.",
+                                                                          "layer.2.DenseReluDense.ia3.weight."};
+
 template<typename T>
 T5DecoderLayerWeight<T>::T5DecoderLayerWeight(const size_t head_num,
                                               const size_t size_per_head,
@@ -323,6 +332,7 @@ void T5DecoderLayerWeight<T>::mallocWeights()
         for (int i = 0; i < IA3_ADAPTER_MAX_NUM_DECODER; i++) {
             deviceMalloc(&ia3_weights_ptr_[i], ia3_weights_size_[i]);
         }
+        maintain_ia3_buffer_ = true;
     }
     is_maintain_buffer = true;
 }
@@ -438,26 +448,12 @@ void T5DecoderLayerWeight<T>::loadModel(std::string dir_path, FtCudaDataType mod
     }
 
     if (ia3_num_tasks_ > 0) {
-        loadWeightFromBin<T>(ia3_weights_ptr_[0],
-                             {ia3_weights_size_[0]},
-                             dir_path + "layer.0.SelfAttention.k.ia3.weight." + tp_rank + ".bin",
-                             model_file_type);
-        loadWeightFromBin<T>(ia3_weights_ptr_[1],
-                             {ia3_weights_size_[1]},
-                             dir_path + "layer.0.SelfAttention.v.ia3.weight." + tp_rank + ".bin",
-                             model_file_type);
-        loadWeightFromBin<T>(ia3_weights_ptr_[2],
-                             {ia3_weights_size_[2]},
-                             dir_path + "layer.1.EncDecAttention.k.ia3.weight." + tp_rank + ".bin",
-                             model_file_type);
-        loadWeightFromBin<T>(ia3_weights_ptr_[3],
-                             {ia3_weights_size_[3]},
-                             dir_path + "layer.1.EncDecAttention.v.ia3.weight." + tp_rank + ".bin",
-                             model_file_type);
-        loadWeightFromBin<T>(ia3_weights_ptr_[4],
-                             {ia3_weights_size_[4]},
-                             dir_path + "layer.2.DenseReluDense.ia3.weight." + tp_rank + ".bin",
-                             model_file_type);
+        for (size_t i = 0; i < IA3_ADAPTER_MAX_NUM_DECODER; i++) {
+            loadWeightFromBin<T>(ia3_weights_ptr_[i],
+                                 {ia3_weights_size_[i]},
+                                 dir_path + ia3_weight_names[i] + tp_rank + ".bin",
+                                 model_file_type);
+        }
     }
 
     adapter_weights_.loadModel(dir_path, model_file_type);
@@ -465,6 +461,49 @@ void T5DecoderLayerWeight<T>::loadModel(std::string dir_path, FtCudaDataType mod
     FT_LOG_DEBUG("T5DecoderLayerWeight " + std::string(__func__) + " end");
 }
 
+template<typename T>
+void T5DecoderLayerWeight<T>::reserveIA3Tasks(size_t ia3_num_tasks)
+{
+    if (ia3_num_tasks <= ia3_num_tasks_) {
+        return;
+    }
+    const size_t old_num_tasks = ia3_num_tasks_;
+    T*           old_weights_ptr[IA3_ADAPTER_MAX_NUM_DECODER];
+    size_t       old_weights_size[IA3_ADAPTER_MAX_NUM_DECODER];
+    std::copy(ia3_weights_ptr_, ia3_weights_ptr_ + IA3_ADAPTER_MAX_NUM_DECODER, old_weights_ptr);
+    std::copy(ia3_weights_size_, ia3_weights_size_ + IA3_ADAPTER_MAX_NUM_DECODER, old_weights_size);
+
+    ia3_num_tasks_ = ia3_num_tasks;
+    initialize();
+    for (size_t i = 0; i < IA3_ADAPTER_MAX_NUM_DECODER; i++) {
+        deviceMalloc(&ia3_weights_ptr_[i], ia3_weights_size_[i]);
+        if (old_num_tasks > 0) {
+            cudaD2Dcpy(ia3_weights_ptr_[i], old_weights_ptr[i], old_weights_size[i]);
+            deviceFree(old_weights_ptr[i]);
+        }
+    }
+    maintain_ia3_buffer_ = true;
+    setWeightPtr();
+}
+
+template<typename T>
+void T5DecoderLayerWeight<T>::loadIA3Task(size_t             task,
+                                          std::string const& dir_path,
+                                          FtCudaDataType     model_file_type,
+                                          cudaStream_t       stream)
+{
+    FT_CHECK_WITH_INFO(task < ia3_num_tasks_, fmtstr("IA3 task %zu out of the %zu tasks", task, ia3_num_tasks_));
+    const auto tp_rank = std::to_string(tensor_para_rank_);
+    for (size_t i = 0; i < IA3_ADAPTER_MAX_NUM_DECODER; i++) {
+        const size_t task_size = ia3_weights_size_[i] / ia3_num_tasks_;
+        loadWeightFromBinOnStream<T>(ia3_weights_ptr_[i] + task * task_size,
+                                     {task_size},
+                                     dir_path + ia3_weight_names[i] + tp_rank + ".bin",
+                                     model_file_type,
+                                     stream);
+    }
+}
+
 template<typename T>
 void T5DecoderLayerWeight<T>::setT5WithBias(bool t5_with_bias_para, bool use_gated_activation_para)
 {
@@ -58,6 +58,10 @@ struct T5DecoderLayerWeight {
 
     void loadModel(std::string dir_path, FtCudaDataType model_file_type);
 
+    // See T5EncoderLayerWeight.
+    void reserveIA3Tasks(size_t ia3_num_tasks);
+    void loadIA3Task(size_t task, std::string const& dir_path, FtCudaDataType model_file_type, cudaStream_t stream);
+
     void setT5WithBias(bool t5_with_bias_para, bool use_gated_activation_para);
 
     bool has_adapters() const
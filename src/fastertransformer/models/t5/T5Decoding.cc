@@ -117,8 +117,9 @@ void T5Decoding<T>::allocateBuffer(
     tiled_encoder_sequence_length_ =
         (int*)(allocator_->reMalloc(tiled_encoder_sequence_length_, sizeof(int) * batchxbeam, false));
 
-    start_ids_buf_ = (int*)(allocator_->reMalloc(start_ids_buf_, sizeof(int) * batch_size, false));
-    end_ids_buf_   = (int*)(allocator_->reMalloc(end_ids_buf_, sizeof(int) * batch_size, false));
+    start_ids_buf_   = (int*)(allocator_->reMalloc(start_ids_buf_, sizeof(int) * batch_size, false));
+    end_ids_buf_     = (int*)(allocator_->reMalloc(end_ids_buf_, sizeof(int) * batch_size, false));
+    len_penalty_buf_ = (float*)(allocator_->reMalloc(len_penalty_buf_, sizeof(float) * batch_size, false));
 
     output_ids_buf_ =
         (int*)(allocator_->reMalloc(output_ids_buf_, sizeof(int) * batchxbeam * (max_seq_len + 1), false));
@@ -186,6 +187,7 @@ void T5Decoding<T>::freeBuffer()
 
         allocator_->free((void**)(&start_ids_buf_));
         allocator_->free((void**)(&end_ids_buf_));
+        allocator_->free((void**)(&len_penalty_buf_));
 
         allocator_->free((void**)(&output_ids_buf_));
         allocator_->free((void**)(&parent_ids_buf_));
@@ -406,8 +408,19 @@ void T5Decoding<T>::setOutputTensors(TensorMap* output_tensors, TensorMap const*
             beam_hyps_.output_ids_src       = output_ids_buf_;
             beam_hyps_.log_probs_src        = output_log_probs_buf_;
             beam_hyps_.max_seq_len          = max_seq_len;
-            beam_hyps_.length_penalty =
-                input_tensors->isExist("len_penalty") ? input_tensors->at("len_penalty").getVal<float>() : 0.0f;
+            // The penalty of each request, len_penalty is [1] or [batch_size] as in the beam search layer.
+            const Tensor len_penalty =
+                input_tensors->isExist("len_penalty") ? input_tensors->at("len_penalty") : Tensor();
+            if (len_penalty.size() == batch_size) {
+                cudaAutoCpy(len_penalty_buf_, len_penalty.getPtr<const float>(), batch_size, stream_);
+            }
+            else {
+                deviceFill(len_penalty_buf_,
+                           batch_size,
+                           len_penalty.size() == 1 ? len_penalty.getVal<float>() : 0.0f,
+                           stream_);
+            }
+            beam_hyps_.length_penalties = len_penalty_buf_;
 
             invokeInsertUnfinishedPath(beam_hyps_, finished_buf_, cum_log_probs_, batch_size, beam_width, stream_);
             sync_check_cuda_error();
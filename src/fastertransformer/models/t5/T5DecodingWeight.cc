@@ -17,6 +17,8 @@
 #include "src/fastertransformer/models/t5/T5DecodingWeight.h"
 #include "src/fastertransformer/utils/IA3.h"
 #include "src/fastertransformer/utils/logger.h"
+#include "src/fastertransformer/utils/packed_checkpoint.h"
+#include "src/fastertransformer/utils/weight_loader.h"
 
 namespace fastertransformer {
 
@@ -276,10 +278,43 @@ void T5DecodingWeight<T>::loadModel(std::string dir_path)
         loadWeightFromBin<T>(weights_ptr[5], {(size_t)weights_size[5]}, dir_path + "/shared.bias.bin", model_file_type);
     }
 
+    WeightLoaderPool loader;
     for (int l = 0; l < num_layer_; l++) {
         if (isValidLayerParallelId(l)) {
-            decoder_layer_weights[l]->loadModel(dir_path + "/decoder.block." + std::to_string(l) + ".",
-                                                model_file_type);
+            loader.submit([this, l, &dir_path, model_file_type]() {
+                decoder_layer_weights[l]->loadModel(dir_path + "/decoder.block." + std::to_string(l) + ".",
+                                                    model_file_type);
+            });
+        }
+    }
+    loader.wait();
+    releasePackedCheckpoints(dir_path);
+    FT_LOG_DEBUG("T5DecodingWeight " + std::string(__func__) + " end");
+}
+
+template<typename T>
+void T5DecodingWeight<T>::reserveIA3Tasks(size_t ia3_num_tasks)
+{
+    if (ia3_num_tasks <= ia3_num_tasks_) {
+        return;
+    }
+    for (int l = 0; l < num_layer_; l++) {
+        if (isValidLayerParallelId(l)) {
+            decoder_layer_weights[l]->reserveIA3Tasks(ia3_num_tasks);
+        }
+    }
+    ia3_num_tasks_ = ia3_num_tasks;
+}
+
+template<typename T>
+void T5DecodingWeight<T>::loadIA3Task(size_t task, std::string dir_path, cudaStream_t stream)
+{
+    FT_LOG_DEBUG("T5DecodingWeight " + std::string(__func__) + " start");
+    FtCudaDataType model_file_type = getModelFileType(dir_path + "/config.ini", "decoder");
+    for (int l = 0; l < num_layer_; l++) {
+        if (isValidLayerParallelId(l)) {
+            decoder_layer_weights[l]->loadIA3Task(
+                task, dir_path + "/decoder.block." + std::to_string(l) + ".", model_file_type, stream);
         }
     }
     FT_LOG_DEBUG("T5DecodingWeight " + std::string(__func__) + " end");
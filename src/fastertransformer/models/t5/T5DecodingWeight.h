@@ -72,6 +72,14 @@ struct T5DecodingWeight {
         return ia3_num_tasks_;
     };
 
+    // Grows the IA3 tables of the layers to ia3_num_tasks tasks, keeping the tasks already loaded. The tables move,
+    // so the model must not be in use.
+    void reserveIA3Tasks(size_t ia3_num_tasks);
+    // Loads the IA3 task of dir_path, which has the IA3 files of a model directory with a single task, into the row
+    // task of the tables of the layers of this pipeline parallel rank. The copies run on stream, so the other tasks
+    // keep serving requests meanwhile.
+    void loadIA3Task(size_t task, std::string dir_path, cudaStream_t stream);
+
 private:
     void setWeightPtr();
     void mallocWeights();
@@ -350,6 +350,9 @@ void T5Encoder<T>::allocateBuffer(size_t batch_size, size_t seq_len)
         (const T**)(allocator_->reMalloc(prompt_learning_weight_batch_, sizeof(T**) * batch_size, false));
     tiled_prompt_lengths_buf_ =
         (int*)(allocator_->reMalloc(tiled_prompt_lengths_buf_, sizeof(int) * batch_size, false));
+    if (lora_adapters_ != nullptr) {
+        lora_slots_buf_ = (int*)(allocator_->reMalloc(lora_slots_buf_, sizeof(int) * batch_size, false));
+    }
     is_allocate_buffer_ = true;
 }
 
@@ -384,6 +387,7 @@ void T5Encoder<T>::freeBuffer()
 
         allocator_->free((void**)(&prompt_learning_weight_batch_));
         allocator_->free((void**)(&tiled_prompt_lengths_buf_));
+        allocator_->free((void**)(&lora_slots_buf_));
         is_allocate_buffer_ = false;
     }
 }
@@ -458,6 +462,8 @@ void T5Encoder<T>::forward(TensorMap*                output_tensors,
     //      request_prompt_lengths [batch_size], optional
     //      request_prompt_embedding [batch_size, max_prompt_length, hidden_units], float, optional
     //      ia3_tasks [batch_size], optional
+    //      adapter_ids [batch_size] on cpu, int, optional
+    //          The LoRA adapter of each request, -1 for the base model, see setLoraAdapters.
     // output tensors:
     //      output_hidden_state [batch, seqlen, d_model_]
     //      output_attentions [batch_size, layer_num, num_heads, seqlen, seqlen], optional
@@ -479,6 +485,7 @@ void T5Encoder<T>::forward(TensorMap*                output_tensors,
     const size_t request_seq_len    = input_tensors->at(input_tensor_name).shape[1];
     const bool   return_attentions  = output_tensors->at("output_attentions", {}).size();
     const bool   has_ia3_tasks      = input_tensors->isExist("ia3_tasks");
+    const bool   use_lora_adapters  = input_tensors->isExist("adapter_ids");
     FT_CHECK(input_tensors->size() >= 2);
     FT_CHECK(request_batch_size == input_tensors->at("sequence_length").shape[0]);
     if (has_ia3_tasks) {
@@ -491,6 +498,18 @@ void T5Encoder<T>::forward(TensorMap*                output_tensors,
 
     allocateBuffer(request_batch_size, request_seq_len);
 
+    // Holds the LoRA slots of the batch until the end of the forward.
+    std::unique_ptr<AdapterSlotsHolder> lora_slots;
+    if (use_lora_adapters) {
+        FT_CHECK_WITH_INFO(lora_adapters_ != nullptr && t5_encoder_weights->getLoraAdapters() == lora_adapters_.get(),
+                           "adapter_ids need the LoRA adapters of the model and of its weights to be the same.");
+        const Tensor& adapter_ids = input_tensors->at("adapter_ids");
+        FT_CHECK_WITH_INFO(adapter_ids.where == MEMORY_CPU && adapter_ids.size() == request_batch_size,
+                           "adapter_ids should be [batch_size] on cpu.");
+        lora_slots = lora_adapters_->getSlots(adapter_ids.getPtr<const int>(), request_batch_size, stream_);
+        cudaAutoCpy(lora_slots_buf_, lora_slots->getSlots().data(), request_batch_size, stream_);
+    }
+
     size_t attentions_size = request_batch_size * num_layer_ * head_num_ * request_seq_len * request_seq_len;
     if (return_attentions) {
         cudaMemsetAsync(output_tensors->at("output_attentions").getPtr<T>(), 0, sizeof(T) * attentions_size, stream_);
@@ -811,6 +830,10 @@ void T5Encoder<T>::forward(TensorMap*                output_tensors,
                     attn_input_tensors.insert(
                         {"ia3_tasks", input_tensors->at("ia3_tasks").slice({local_batch_size}, id_offset)});
                 }
+                if (use_lora_adapters) {
+                    attn_input_tensors.insert(
+                        "lora_slots", Tensor{MEMORY_GPU, TYPE_INT32, {local_batch_size}, lora_slots_buf_ + id_offset});
+                }
                 TensorMap attn_output_tensors{
                     {"hidden_features",
                      Tensor{MEMORY_GPU, data_type, std::vector<size_t>{h_token_num, d_model_}, attn_out_buf_}}};
@@ -877,6 +900,12 @@ void T5Encoder<T>::forward(TensorMap*                output_tensors,
                 if (has_ia3_tasks) {
                     ffn_input_tensors.insert("ia3_tasks",
                                              input_tensors->at("ia3_tasks").slice({local_batch_size}, id_offset));
+                }
+                if (use_lora_adapters) {
+                    ffn_input_tensors.insert(
+                        "lora_slots", Tensor{MEMORY_GPU, TYPE_INT32, {local_batch_size}, lora_slots_buf_ + id_offset});
+                }
+                if (has_ia3_tasks || use_lora_adapters) {
                     ffn_input_tensors.insertIfValid("padding_offset", *padding_offset_tensor_ptr);
                     ffn_input_tensors.insert("seq_len", Tensor{MEMORY_CPU, TYPE_INT32, {1}, &request_seq_len});
                 }
@@ -86,6 +86,8 @@ private:
     int                                 enable_custom_all_reduce_;
     LinearAdapterConfig                 adapter_config_;
 
+    std::shared_ptr<LoraAdapterRegistry<T>> lora_adapters_;
+
 protected:
     // model params
     size_t* h_pinned_token_num_ptr_  = nullptr;
@@ -109,6 +111,8 @@ protected:
     const T** prompt_learning_weight_batch_ = nullptr;
     int*      tiled_prompt_lengths_buf_     = nullptr;
 
+    int* lora_slots_buf_ = nullptr;  // [batch_size], the slot of each request's adapter
+
 public:
     T5Encoder(size_t                              max_batch_size,
               size_t                              max_seq_len,
@@ -174,6 +178,13 @@ public:
         return adapter_config_.enabled();
     }
 
+    // Serves the adapters of the registry, chosen per request with the adapter_ids input. The weights given to forward
+    // must be bound to the same registry, see T5EncoderWeight::setLoraAdapters.
+    void setLoraAdapters(std::shared_ptr<LoraAdapterRegistry<T>> lora_adapters)
+    {
+        lora_adapters_ = lora_adapters;
+    }
+
     void setStream(cudaStream_t stream) override;
 };
 
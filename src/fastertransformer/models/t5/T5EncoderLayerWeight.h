@@ -61,6 +61,13 @@ struct T5EncoderLayerWeight {
     void loadModel(std::string const& dir_path, FtCudaDataType model_file_type);
     void setT5WithBias(bool t5_with_bias_para, bool use_gated_activation_para);
 
+    // Grows the IA3 tables to ia3_num_tasks tasks, keeping the tasks already loaded. The tables move, so the layer
+    // must not be in use.
+    void reserveIA3Tasks(size_t ia3_num_tasks);
+    // Loads the IA3 vectors of one task, from the files of loadModel which hold a single task, into the row task of
+    // the tables. The copies run on stream, so the other tasks keep serving requests meanwhile.
+    void loadIA3Task(size_t task, std::string const& dir_path, FtCudaDataType model_file_type, cudaStream_t stream);
+
     bool has_adapters() const
     {
         return adapter_weights_.enabled();
@@ -16,6 +16,8 @@
 
 #include "src/fastertransformer/models/t5/T5EncoderWeight.h"
 #include "src/fastertransformer/utils/logger.h"
+#include "src/fastertransformer/utils/packed_checkpoint.h"
+#include "src/fastertransformer/utils/weight_loader.h"
 
 namespace fastertransformer {
 
@@ -205,6 +207,7 @@ T5EncoderWeight<T>::T5EncoderWeight(const T5EncoderWeight& other):
     for (int i = 0; i < num_layer_; i++) {
         t5_encoder_layer_weights.push_back(new T5EncoderLayerWeight<T>(*other.t5_encoder_layer_weights[i]));
     }
+    setLoraAdapters(other.lora_adapters_);
     FT_LOG_DEBUG("T5EncoderWeight " + std::string(__func__) + " end");
 }
 
@@ -256,6 +259,7 @@ T5EncoderWeight<T>& T5EncoderWeight<T>::operator=(const T5EncoderWeight& other)
     for (int i = 0; i < num_layer_; i++) {
         t5_encoder_layer_weights.push_back(new T5EncoderLayerWeight<T>(*other.t5_encoder_layer_weights[i]));
     }
+    setLoraAdapters(other.lora_adapters_);
     FT_LOG_DEBUG("T5EncoderWeight " + std::string(__func__) + " end");
 
     return *this;
@@ -357,10 +361,62 @@ void T5EncoderWeight<T>::loadModel(std::string dir_path)
         }
     }
 
+    WeightLoaderPool loader;
     for (int l = 0; l < num_layer_; l++) {
         if (isValidLayerParallelId(l)) {
-            t5_encoder_layer_weights[l]->loadModel(dir_path + "/encoder.block." + std::to_string(l) + ".",
-                                                   model_file_type);
+            loader.submit([this, l, &dir_path, model_file_type]() {
+                t5_encoder_layer_weights[l]->loadModel(dir_path + "/encoder.block." + std::to_string(l) + ".",
+                                                       model_file_type);
+            });
+        }
+    }
+    loader.wait();
+    releasePackedCheckpoints(dir_path);
+    FT_LOG_DEBUG("T5EncoderWeight " + std::string(__func__) + " end");
+}
+
+template<typename T>
+void T5EncoderWeight<T>::setLoraAdapters(const LoraAdapterRegistry<T>* lora_adapters)
+{
+    lora_adapters_ = lora_adapters;
+    for (int l = 0; l < num_layer_; l++) {
+        if (!isValidLayerParallelId(l)) {
+            continue;
+        }
+        T5EncoderLayerWeight<T>* layer_weight = t5_encoder_layer_weights[l];
+
+        auto getWeight = [&](LoraTarget target) {
+            return lora_adapters == nullptr ? LoraWeight<T>() : lora_adapters->getWeight(l, target);
+        };
+        layer_weight->attention_weights_.qkv_lora_weight   = getWeight(LoraTarget::QKV);
+        layer_weight->ffn_weights_.intermediate_lora_weight = getWeight(LoraTarget::FFN_INTERMEDIATE);
+        layer_weight->ffn_weights_.output_lora_weight       = getWeight(LoraTarget::FFN_OUTPUT);
+    }
+}
+
+template<typename T>
+void T5EncoderWeight<T>::reserveIA3Tasks(size_t ia3_num_tasks)
+{
+    if (ia3_num_tasks <= ia3_num_tasks_) {
+        return;
+    }
+    for (int l = 0; l < num_layer_; l++) {
+        if (isValidLayerParallelId(l)) {
+            t5_encoder_layer_weights[l]->reserveIA3Tasks(ia3_num_tasks);
+        }
+    }
+    ia3_num_tasks_ = ia3_num_tasks;
+}
+
+template<typename T>
+void T5EncoderWeight<T>::loadIA3Task(size_t task, std::string dir_path, cudaStream_t stream)
+{
+    FT_LOG_DEBUG("T5EncoderWeight " + std::string(__func__) + " start");
+    FtCudaDataType model_file_type = getModelFileType(dir_path + "/config.ini", "encoder");
+    for (int l = 0; l < num_layer_; l++) {
+        if (isValidLayerParallelId(l)) {
+            t5_encoder_layer_weights[l]->loadIA3Task(
+                task, dir_path + "/encoder.block." + std::to_string(l) + ".", model_file_type, stream);
         }
     }
     FT_LOG_DEBUG("T5EncoderWeight " + std::string(__func__) + " end");
@@ -17,6 +17,7 @@
 #pragma once
 
 #include "src/fastertransformer/kernels/gen_relative_pos_bias.h"
+#include "src/fastertransformer/layers/adapter_layers/LoraAdapterRegistry.h"
 #include "src/fastertransformer/models/t5/T5EncoderLayerWeight.h"
 #include "src/fastertransformer/utils/prompt_learning.h"
 
@@ -68,6 +69,22 @@ struct T5EncoderWeight {
         return ia3_num_tasks_;
     };
 
+    // Grows the IA3 tables of the layers to ia3_num_tasks tasks, keeping the tasks already loaded. The tables move,
+    // so the model must not be in use.
+    void reserveIA3Tasks(size_t ia3_num_tasks);
+    // Loads the IA3 task of dir_path, which has the IA3 files of a model directory with a single task, into the row
+    // task of the tables of the layers of this pipeline parallel rank. The copies run on stream, so the other tasks
+    // keep serving requests meanwhile.
+    void loadIA3Task(size_t task, std::string dir_path, cudaStream_t stream);
+
+    // Points the LoRA weights of the layers of this pipeline parallel rank to the slots of lora_adapters, or clears
+    // them for nullptr. The registry must outlive the binding.
+    void                                 setLoraAdapters(const LoraAdapterRegistry<T>* lora_adapters);
+    inline const LoraAdapterRegistry<T>* getLoraAdapters() const
+    {
+        return lora_adapters_;
+    }
+
 private:
     void setWeightPtr();
     void mallocWeights();
@@ -103,6 +120,8 @@ private:
     bool                                       malloc_load_prompt_weights_ = false;
     // each prompt token's weight size
     size_t prompt_token_weight_size_ = 0;
+
+    const LoraAdapterRegistry<T>* lora_adapters_ = nullptr;
 };
 
 }  // namespace fastertransformer
\ No newline at end of file
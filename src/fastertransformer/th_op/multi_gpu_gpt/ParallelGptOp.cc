@@ -43,6 +43,8 @@ ParallelGptOp::ParallelGptOp(const int64_t                 head_num,
                              const bool                    has_adapters,
                              const int64_t                 adapter_inter_size,
                              const bool                    use_attention_linear_bias,
+                             const bool                    moe_expert_parallel,
+                             const double                  moe_capacity_factor,
                              const std::vector<th::Tensor> weights,
                              const std::vector<th::Tensor> int8_weights,
                              const std::vector<th::Tensor> scale,
@@ -61,7 +63,9 @@ ParallelGptOp::ParallelGptOp(const int64_t                 head_num,
                                             has_post_decoder_layernorm,
                                             has_adapters,
                                             (size_t)adapter_inter_size,
-                                            use_attention_linear_bias};
+                                            use_attention_linear_bias,
+                                            moe_expert_parallel,
+                                            (float)moe_capacity_factor};
 
     switch (st_) {
         case at::ScalarType::Float:
@@ -233,6 +237,8 @@ static auto fasterTransformerGptTHS =
                               bool,
                               int64_t,
                               bool,
+                              bool,
+                              double,
                               std::vector<th::Tensor>,
                               std::vector<th::Tensor>,
                               std::vector<th::Tensor>,
@@ -95,7 +95,7 @@ public:
 
         ftNcclInitialize(tensor_para_, pipeline_para_, tensor_para_size, pipeline_para_size);
 
-        gpt_weights_.resizeLayer(layer_num_);
+        gpt_weights_.resizeLayer(layer_num_, int8_mode_, gpt_variant_params_);
         for (int i = 0; i < (int)layer_num_; i++) {
             gpt_weights_.decoder_layer_weights[i]->pre_layernorm_weights.gamma =
                 get_ptr<T>(weights_[i + 0 * layer_num_]);
@@ -519,6 +519,8 @@ public:
                   const bool                 has_adapters,
                   const int64_t              adapter_inter_size,
                   const bool                 use_attention_linear_bias,
+                  const bool                 moe_expert_parallel,
+                  const double               moe_capacity_factor,
                   const vector<th::Tensor>   weights,
                   const vector<th::Tensor>   int8_weights,
                   const vector<th::Tensor>   scale,
@@ -48,7 +48,8 @@ GptJTritonModelInstance<T>::GptJTritonModelInstance(std::unique_ptr<ft::GptJ<T>>
     cublas_algo_map_(std::move(cublas_algo_map)),
     cublas_wrapper_mutex_(std::move(cublas_wrapper_mutex)),
     cublas_wrapper_(std::move(cublas_wrapper)),
-    cuda_device_prop_ptr_(std::move(cuda_device_prop_ptr))
+    cuda_device_prop_ptr_(std::move(cuda_device_prop_ptr)),
+    request_staging_(allocator_.get())
 {
 }
 
@@ -58,65 +59,34 @@ std::unordered_map<std::string, ft::Tensor> GptJTritonModelInstance<T>::convert_
 {
     FT_LOG_DEBUG(__PRETTY_FUNCTION__);
 
-    move_tensor_H2D(input_tensors->at("input_ids"), d_input_ids_, &allocator_);
-    move_tensor_H2D(input_tensors->at("input_lengths"), d_input_lengths_, &allocator_);
-
     const size_t request_batch_size = input_tensors->at("input_ids").shape[0];
     const size_t input_data_len     = input_tensors->at("input_ids").shape[1];
-    h_total_output_lengths_         = reinterpret_cast<uint32_t*>(malloc(request_batch_size * sizeof(uint32_t)));
+    h_total_output_lengths_.resize(request_batch_size);
     for (int i = 0; i < request_batch_size; ++i) {
         h_total_output_lengths_[i] =
             reinterpret_cast<const uint32_t*>(input_tensors->at("request_output_len").data)[i] + input_data_len;
     }
 
     std::unordered_map<std::string, ft::Tensor> ft_input_tensors = std::unordered_map<std::string, ft::Tensor>{
-        {"input_ids", as_GPU_tensor(input_tensors->at("input_ids"), d_input_ids_)},
-        {"input_lengths", as_GPU_tensor(input_tensors->at("input_lengths"), d_input_lengths_)},
         {"output_seq_len",
          ft::Tensor{ft::MEMORY_CPU,
                     ft::TYPE_UINT32,
                     {input_tensors->at("request_output_len").shape[0]},
-                    h_total_output_lengths_}}};
-
-    if (input_tensors->find("bad_words_list") != input_tensors->end()) {
-        move_tensor_H2D(input_tensors->at("bad_words_list"), d_input_bad_words_, &allocator_);
-        ft_input_tensors.insert(
-            {"bad_words_list", as_GPU_tensor(input_tensors->at("bad_words_list"), d_input_bad_words_)});
-    }
-
-    if (input_tensors->find("stop_words_list") != input_tensors->end()) {
-        move_tensor_H2D(input_tensors->at("stop_words_list"), d_input_stop_words_, &allocator_);
-        ft_input_tensors.insert(
-            {"stop_words_list", as_GPU_tensor(input_tensors->at("stop_words_list"), d_input_stop_words_)});
-    }
-
+                    h_total_output_lengths_.data()}}};
+
+    std::vector<const char*> device_inputs = {"input_ids",
+                                              "input_lengths",
+                                              "bad_words_list",
+                                              "stop_words_list",
+                                              "top_p_decay",
+                                              "top_p_min",
+                                              "top_p_reset_ids"};
     if (input_tensors->count("request_prompt_embedding") && input_tensors->count("request_prompt_lengths")
         && input_tensors->count("request_prompt_type")) {
-
-        move_tensor_H2D(input_tensors->at("request_prompt_lengths"), d_request_prompt_lengths_, &allocator_);
-        ft_input_tensors.insert(
-            {"request_prompt_lengths",
-             as_GPU_tensor(input_tensors->at("request_prompt_lengths"), d_request_prompt_lengths_)});
-
-        move_tensor_H2D(input_tensors->at("request_prompt_embedding"), d_request_prompt_embedding_, &allocator_);
-        ft_input_tensors.insert(
-            {"request_prompt_embedding",
-             as_GPU_tensor(input_tensors->at("request_prompt_embedding"), d_request_prompt_embedding_)});
-    }
-
-    if (input_tensors->find("top_p_decay") != input_tensors->end()) {
-        move_tensor_H2D(input_tensors->at("top_p_decay"), d_top_p_decay_, &allocator_);
-        ft_input_tensors.insert({"top_p_decay", as_GPU_tensor(input_tensors->at("top_p_decay"), d_top_p_decay_)});
-    }
-    if (input_tensors->find("top_p_min") != input_tensors->end()) {
-        move_tensor_H2D(input_tensors->at("top_p_min"), d_top_p_min_, &allocator_);
-        ft_input_tensors.insert({"top_p_min", as_GPU_tensor(input_tensors->at("top_p_min"), d_top_p_min_)});
-    }
-    if (input_tensors->find("top_p_reset_ids") != input_tensors->end()) {
-        move_tensor_H2D(input_tensors->at("top_p_reset_ids"), d_top_p_reset_ids_, &allocator_);
-        ft_input_tensors.insert(
-            {"top_p_reset_ids", as_GPU_tensor(input_tensors->at("top_p_reset_ids"), d_top_p_reset_ids_)});
+        device_inputs.push_back("request_prompt_lengths");
+        device_inputs.push_back("request_prompt_embedding");
     }
+    stage_tensors_H2D(*input_tensors, device_inputs, &request_staging_, allocator_->returnStream(), &ft_input_tensors);
 
     for (auto t = input_tensors->begin(); t != input_tensors->end(); ++t) {
         if (t->first.find("input_ids") == std::string::npos && t->first.find("input_lengths") == std::string::npos
@@ -218,11 +188,6 @@ GptJTritonModelInstance<T>::forward(std::shared_ptr<std::unordered_map<std::stri
         output_tensors.insert({"error_message", ft::Tensor{ft::MEMORY_CPU, ft::TYPE_BYTES, {1}, &h_exception_}});
     }
 
-    if (h_total_output_lengths_ != nullptr) {
-        free(h_total_output_lengths_);
-        h_total_output_lengths_ = nullptr;
-    }
-
     return convert_outputs(output_tensors);
 }
 
@@ -19,6 +19,7 @@
 #include "src/fastertransformer/models/gptneox/GptNeoX.h"
 #include "src/fastertransformer/triton_backend/gptneox/GptNeoXTritonModel.h"
 #include "src/fastertransformer/triton_backend/transformer_triton_backend.hpp"
+#include "src/fastertransformer/utils/request_staging.h"
 #include <memory>
 
 namespace ft = fastertransformer;
@@ -52,6 +53,7 @@ private:
     const std::unique_ptr<std::mutex>                             cublas_wrapper_mutex_;
     const std::unique_ptr<ft::cublasMMWrapper>                    cublas_wrapper_;
     const std::unique_ptr<cudaDeviceProp>                         cuda_device_prop_ptr_;
+    ft::RequestStaging                                            request_staging_;  // the inputs copied to the device
 
     std::unordered_map<std::string, ft::Tensor>
     convert_inputs(std::shared_ptr<std::unordered_map<std::string, triton::Tensor>> input_tensors);
@@ -62,21 +64,11 @@ private:
                         const size_t max_request_output_len);
     void freeBuffer();
 
-    int*   d_input_ids_                = nullptr;
-    int*   d_input_lengths_            = nullptr;
-    int*   d_input_bad_words_          = nullptr;
-    int*   d_input_stop_words_         = nullptr;
-    int*   d_request_prompt_lengths_   = nullptr;
-    T*     d_request_prompt_embedding_ = nullptr;
-    float* d_top_p_decay_              = nullptr;
-    float* d_top_p_min_                = nullptr;
-    int*   d_top_p_reset_ids_          = nullptr;
-
     int*   d_output_ids_       = nullptr;
     int*   d_sequence_lengths_ = nullptr;
     float* d_output_log_probs_ = nullptr;
     float* d_cum_log_probs_    = nullptr;
 
-    uint32_t*          h_total_output_lengths_ = nullptr;
-    std::exception_ptr h_exception_            = nullptr;
+    std::vector<uint32_t> h_total_output_lengths_;
+    std::exception_ptr    h_exception_ = nullptr;
 };
@@ -200,6 +200,10 @@ ParallelGptTritonModel<T>::ParallelGptTritonModel(size_t      tensor_para_size,
     prompt_learning_start_id=50257
     prompt_learning_type=3
     num_tasks=3
+    tokenizer_dir=/workspace/gpt2-tokenizer # optional, where vocab.json and merges.txt or tokenizer.model are,
+                                            # model_dir by default
+    lora_num_slots=8 # optional, the LoRA adapters on a device at once, 0 (no registerAdapter) by default
+    lora_max_rank=16 # needed with lora_num_slots
 
     [task_0]
     task_name=sentiment
@@ -259,6 +263,16 @@ ParallelGptTritonModel<T>::ParallelGptTritonModel(size_t      tensor_para_size,
         const int   prompt_length    = reader.GetInteger(config_task_name, "prompt_length", 0);
         prompt_learning_table_pair_.insert({task_name, {task_name_id, prompt_length}});
     }
+
+    // vocab.json and merges.txt, or tokenizer.model.
+    tokenizer_ = ft::Tokenizer::loadFromDirectory(reader.Get("gpt", "tokenizer_dir", model_dir));
+
+    lora_num_slots_ = reader.GetInteger("gpt", "lora_num_slots", 0);
+    lora_max_rank_  = reader.GetInteger("gpt", "lora_max_rank", 0);
+    FT_CHECK_WITH_INFO(lora_num_slots_ == 0 || lora_max_rank_ > 0, "lora_num_slots needs lora_max_rank");
+    lora_allocators_.resize(ft::getDeviceCount());
+    lora_adapters_.resize(ft::getDeviceCount());
+    lora_tensor_para_ranks_.resize(ft::getDeviceCount());
 }
 
 template<typename T>
@@ -298,7 +312,8 @@ ParallelGptTritonModel<T>::ParallelGptTritonModel(size_t
     model_name_(model_name),
     model_dir_(model_dir),
     int8_mode_(int8_mode),
-    enable_custom_all_reduce_(enable_custom_all_reduce)
+    enable_custom_all_reduce_(enable_custom_all_reduce),
+    tokenizer_(ft::Tokenizer::loadFromDirectory(model_dir))
 {
 }
 
@@ -393,6 +408,9 @@ std::unique_ptr<AbstractTransformerModelInstance> ParallelGptTritonModel<T>::cre
                            int8_mode_,
                            custom_all_reduce_comm,
                            enable_custom_all_reduce_));
+    if (lora_num_slots_ > 0) {
+        gpt->setLoraAdapters(lora_adapters_[device_id]);
+    }
 
     return std::unique_ptr<ParallelGptTritonModelInstance<T>>(
         new ParallelGptTritonModelInstance<T>(std::move(gpt),
@@ -401,7 +419,9 @@ std::unique_ptr<AbstractTransformerModelInstance> ParallelGptTritonModel<T>::cre
                                               std::move(cublas_algo_map),
                                               std::move(cublas_wrapper_mutex),
                                               std::move(cublas_wrapper),
-                                              std::move(cuda_device_prop_ptr)));
+                                              std::move(cuda_device_prop_ptr),
+                                              tokenizer_,
+                                              end_id_));
 }
 
 template<typename T>
@@ -425,9 +445,74 @@ void ParallelGptTritonModel<T>::createSharedWeights(int device_id, int rank)
                                                                             prompt_learning_table_pair_,
                                                                             gpt_variant_params_);
     shared_weights_[device_id]->loadModel(model_dir_);
+
+    if (lora_num_slots_ > 0) {
+        const size_t local_num_layer = num_layer_ / pipeline_para_size_;
+        lora_allocators_[device_id].reset(new ft::Allocator<ft::AllocatorType::CUDA>(device_id));
+        lora_adapters_[device_id] = std::make_shared<ft::LoraAdapterRegistry<T>>(
+            pipeline_para_rank * local_num_layer,
+            (pipeline_para_rank + 1) * local_num_layer,
+            ft::getLoraShapes(head_num_ * size_per_head_, head_num_ * size_per_head_, inter_size_, tensor_para_size_),
+            lora_max_rank_,
+            lora_num_slots_,
+            lora_allocators_[device_id].get());
+        lora_tensor_para_ranks_[device_id] = tensor_para_rank;
+        shared_weights_[device_id]->setLoraAdapters(lora_adapters_[device_id].get());
+    }
     return;
 }
 
+template<typename T>
+void ParallelGptTritonModel<T>::registerAdapter(int adapter_id, std::string dir_path)
+{
+    FT_CHECK_WITH_INFO(lora_num_slots_ > 0, "this model has no LoRA slots, set lora_num_slots to register adapters");
+    INIReader reader = INIReader(dir_path + "/config.ini");
+    FT_CHECK_WITH_INFO(reader.ParseError() >= 0, ft::fmtstr("Can't load %s/config.ini", dir_path.c_str()));
+    const size_t             rank            = reader.GetInteger("lora", "rank", 0);
+    const float              alpha           = reader.GetFloat("lora", "alpha", rank);
+    const ft::FtCudaDataType model_file_type = ft::getModelFileType(dir_path + "/config.ini", "lora");
+
+    // Only read to the host: the adapter is copied to a slot of a device by the first request using it there. The
+    // other nodes register the adapter on their own model.
+    try {
+        for (size_t device_id = 0; device_id < lora_adapters_.size(); device_id++) {
+            if (lora_adapters_[device_id] != nullptr) {
+                lora_adapters_[device_id]->loadAdapter(
+                    adapter_id, dir_path, rank, alpha, lora_tensor_para_ranks_[device_id], model_file_type);
+            }
+        }
+    }
+    catch (...) {
+        // Dropped from every device, so that the devices never serve different versions of it.
+        unregisterAdapter(adapter_id);
+        throw;
+    }
+}
+
+template<typename T>
+bool ParallelGptTritonModel<T>::unregisterAdapter(int adapter_id)
+{
+    bool is_unregistered = false;
+    for (auto& lora_adapters : lora_adapters_) {
+        if (lora_adapters != nullptr && lora_adapters->unregisterAdapter(adapter_id)) {
+            is_unregistered = true;
+        }
+    }
+    return is_unregistered;
+}
+
+template<typename T>
+std::vector<ft::AdapterInfo> ParallelGptTritonModel<T>::listAdapters()
+{
+    // The adapters are the same on every device, their slots are those of the first one.
+    for (auto& lora_adapters : lora_adapters_) {
+        if (lora_adapters != nullptr) {
+            return lora_adapters->listAdapters();
+        }
+    }
+    return {};
+}
+
 template<typename T>
 std::string ParallelGptTritonModel<T>::toString()
 {
@@ -441,6 +526,7 @@ std::string ParallelGptTritonModel<T>::toString()
        << gpt_variant_params_.has_post_decoder_layernorm << "\nstart_id: " << start_id_ << "\nend_id: " << end_id_
        << "\ntensor_para_size: " << tensor_para_size_ << "\npipeline_para_size: " << pipeline_para_size_
        << "\nint8_mode: " << int8_mode_ << "\nenable_custom_all_reduce: " << enable_custom_all_reduce_
+       << "\nlora_num_slots: " << lora_num_slots_ << "\nlora_max_rank: " << lora_max_rank_
        << "\nmodel_name: " << model_name_ << "\nmodel_dir: " << model_dir_ << std::endl;
     return ss.str();
 }
@@ -23,6 +23,7 @@
 #include "src/fastertransformer/utils/cuda_utils.h"
 #include "src/fastertransformer/utils/custom_ar_comm.h"
 #include "src/fastertransformer/utils/nccl_utils.h"
+#include "src/fastertransformer/utils/tokenizer.h"
 
 namespace ft = fastertransformer;
 
@@ -62,6 +63,13 @@ struct ParallelGptTritonModel: public AbstractTransformerModel {
 
     virtual void createSharedWeights(int deviceId, int rank) override;
 
+    // LoRA adapters registered at runtime and paged into the lora_num_slots slots of each device. dir_path has the
+    // files of ft::LoraAdapterRegistry::loadAdapter and a config.ini whose [lora] section gives the rank, alpha and
+    // weight_data_type of the adapter, and adapter_id is then requested through adapter_ids.
+    virtual void                         registerAdapter(int adapter_id, std::string dir_path) override;
+    virtual bool                         unregisterAdapter(int adapter_id) override;
+    virtual std::vector<ft::AdapterInfo> listAdapters() override;
+
     virtual void createCustomComms(std::vector<std::shared_ptr<ft::AbstractCustomComm>>* custom_all_reduce_comms,
                                    int                                                   world_size) override;
 
@@ -97,4 +105,14 @@ private:
     int                                        prompt_learning_start_id_   = 0;
     ft::PromptLearningType                     prompt_learning_type_       = ft::PromptLearningType::no_prompt;
     std::map<std::string, std::pair<int, int>> prompt_learning_table_pair_ = {};
+
+    // For the "input_text" requests, nullptr when the model has no tokenizer files. Shared by the instances.
+    std::shared_ptr<const ft::Tokenizer> tokenizer_;
+
+    // LoRA adapters of each device, shared by its instances, none if lora_num_slots_ is 0
+    size_t                                                               lora_num_slots_ = 0;
+    size_t                                                               lora_max_rank_  = 0;
+    std::vector<std::unique_ptr<ft::Allocator<ft::AllocatorType::CUDA>>> lora_allocators_;  // of the slots
+    std::vector<std::shared_ptr<ft::LoraAdapterRegistry<T>>>             lora_adapters_;
+    std::vector<int>                                                     lora_tensor_para_ranks_;
 };
@@ -18,13 +18,42 @@
 #include "src/fastertransformer/triton_backend/transformer_triton_backend.hpp"
 #include "src/fastertransformer/triton_backend/triton_utils.hpp"
 #include "src/fastertransformer/utils/Tensor.h"
+#include "src/fastertransformer/utils/memory_utils.h"
 #include <algorithm>
+#include <cstring>
 #include <functional>
 #include <numeric>
+#include <thread>
 #include <vector>
 
 namespace ft = fastertransformer;
 
+// Triton BYTES tensors are a sequence of elements, each one its length as 4 bytes then its bytes.
+static void serialize_triton_strings(const std::vector<std::string>& strings, std::vector<char>* buffer)
+{
+    buffer->clear();
+    for (const std::string& str : strings) {
+        const uint32_t length = str.size();
+        buffer->insert(buffer->end(), (const char*)&length, (const char*)&length + sizeof(length));
+        buffer->insert(buffer->end(), str.begin(), str.end());
+    }
+}
+
+static std::vector<std::string> deserialize_triton_strings(const triton::Tensor& tensor)
+{
+    const size_t num_strings =
+        std::accumulate(tensor.shape.begin(), tensor.shape.end(), (size_t)1, std::multiplies<size_t>());
+    std::vector<std::string> strings;
+    const char*              data = (const char*)tensor.data;
+    for (size_t i = 0; i < num_strings; i++) {
+        uint32_t length;
+        std::memcpy(&length, data, sizeof(length));
+        strings.emplace_back(data + sizeof(length), length);
+        data += sizeof(length) + length;
+    }
+    return strings;
+}
+
 template<typename T>
 void triton_stream_callback(std::unordered_map<std::string, ft::Tensor>* output_tensors, void* ctx)
 {
@@ -34,6 +63,12 @@ void triton_stream_callback(std::unordered_map<std::string, ft::Tensor>* output_
     model->stream_cb_(result, model->stream_ctx_);
 }
 
+template<typename T>
+void triton_stream_delta_callback(std::unordered_map<std::string, ft::Tensor>* delta_tensors, void* ctx)
+{
+    reinterpret_cast<ParallelGptTritonModelInstance<T>*>(ctx)->pushStreamDelta(*delta_tensors);
+}
+
 template<typename T>
 ParallelGptTritonModelInstance<T>::ParallelGptTritonModelInstance(
     std::unique_ptr<ft::ParallelGpt<T>>                     gpt,
@@ -42,14 +77,19 @@ ParallelGptTritonModelInstance<T>::ParallelGptTritonModelInstance(
     std::unique_ptr<ft::cublasAlgoMap>                      cublas_algo_map,
     std::unique_ptr<std::mutex>                             cublas_wrapper_mutex,
     std::unique_ptr<ft::cublasMMWrapper>                    cublas_wrapper,
-    std::unique_ptr<cudaDeviceProp>                         cuda_device_prop_ptr):
+    std::unique_ptr<cudaDeviceProp>                         cuda_device_prop_ptr,
+    std::shared_ptr<const ft::Tokenizer>                    tokenizer,
+    int                                                     end_id):
     gpt_(std::move(gpt)),
     gpt_weight_(gpt_weight),
     allocator_(std::move(allocator)),
     cublas_algo_map_(std::move(cublas_algo_map)),
     cublas_wrapper_mutex_(std::move(cublas_wrapper_mutex)),
     cublas_wrapper_(std::move(cublas_wrapper)),
-    cuda_device_prop_ptr_(std::move(cuda_device_prop_ptr))
+    cuda_device_prop_ptr_(std::move(cuda_device_prop_ptr)),
+    tokenizer_(tokenizer),
+    end_id_(end_id),
+    request_staging_(allocator_.get())
 {
 }
 
@@ -66,11 +106,9 @@ std::unordered_map<std::string, ft::Tensor> ParallelGptTritonModelInstance<T>::c
     std::shared_ptr<std::unordered_map<std::string, triton::Tensor>> input_tensors)
 {
     const size_t request_batch_size = input_tensors->at("input_ids").shape[0];
-    move_tensor_H2D(input_tensors->at("input_ids"), d_input_ids_, &allocator_);
-    move_tensor_H2D(input_tensors->at("input_lengths"), d_input_lengths_, &allocator_);
 
-    h_total_output_lengths_ = (uint32_t*)std::realloc((void*)h_total_output_lengths_, request_batch_size * sizeof(uint32_t));
-    const int input_data_len = input_tensors->at("input_ids").shape[1];
+    h_total_output_lengths_.resize(request_batch_size);
+    const int  input_data_len = input_tensors->at("input_ids").shape[1];
     const bool continue_interactive =
         input_tensors->count("START") && reinterpret_cast<const int32_t*>(input_tensors->at("START").data)[0] == 0;
     for (int i = 0; i < request_batch_size; ++i) {
@@ -79,56 +117,28 @@ std::unordered_map<std::string, ft::Tensor> ParallelGptTritonModelInstance<T>::c
     }
 
     std::unordered_map<std::string, ft::Tensor> ft_input_tensors{
-        {"input_ids", as_GPU_tensor(input_tensors->at("input_ids"), d_input_ids_)},
         {"input_lengths_h", as_CPU_tensor(input_tensors->at("input_lengths"))},
-        {"input_lengths", as_GPU_tensor(input_tensors->at("input_lengths"), d_input_lengths_)},
         {"output_seq_len",
          ft::Tensor{ft::MEMORY_CPU,
                     ft::TYPE_UINT32,
                     {input_tensors->at("request_output_len").shape[0]},
-                    h_total_output_lengths_}}};
-
+                    h_total_output_lengths_.data()}}};
+
+    std::vector<const char*> device_inputs = {"input_ids",
+                                              "input_lengths",
+                                              "bad_words_list",
+                                              "stop_words_list",
+                                              "top_p_decay",
+                                              "top_p_min",
+                                              "top_p_reset_ids"};
     if (input_tensors->count("request_prompt_embedding") && input_tensors->count("request_prompt_lengths")
         && input_tensors->count("request_prompt_type")) {
-
-        move_tensor_H2D(input_tensors->at("request_prompt_lengths"), d_request_prompt_lengths_, &allocator_);
         ft_input_tensors.insert(
             {"request_prompt_lengths_h", as_CPU_tensor(input_tensors->at("request_prompt_lengths"))});
-        ft_input_tensors.insert(
-            {"request_prompt_lengths",
-             as_GPU_tensor(input_tensors->at("request_prompt_lengths"), d_request_prompt_lengths_)});
-
-        move_tensor_H2D(input_tensors->at("request_prompt_embedding"), d_request_prompt_embedding_, &allocator_);
-        ft_input_tensors.insert(
-            {"request_prompt_embedding",
-             as_GPU_tensor(input_tensors->at("request_prompt_embedding"), d_request_prompt_embedding_)});
-    }
-
-    if (input_tensors->find("bad_words_list") != input_tensors->end()) {
-        move_tensor_H2D(input_tensors->at("bad_words_list"), d_input_bad_words_, &allocator_);
-        ft_input_tensors.insert(
-            {"bad_words_list", as_GPU_tensor(input_tensors->at("bad_words_list"), d_input_bad_words_)});
-    }
-
-    if (input_tensors->find("stop_words_list") != input_tensors->end()) {
-        move_tensor_H2D(input_tensors->at("stop_words_list"), d_input_stop_words_, &allocator_);
-        ft_input_tensors.insert(
-            {"stop_words_list", as_GPU_tensor(input_tensors->at("stop_words_list"), d_input_stop_words_)});
-    }
-
-    if (input_tensors->find("top_p_decay") != input_tensors->end()) {
-        move_tensor_H2D(input_tensors->at("top_p_decay"), d_top_p_decay_, &allocator_);
-        ft_input_tensors.insert({"top_p_decay", as_GPU_tensor(input_tensors->at("top_p_decay"), d_top_p_decay_)});
-    }
-    if (input_tensors->find("top_p_min") != input_tensors->end()) {
-        move_tensor_H2D(input_tensors->at("top_p_min"), d_top_p_min_, &allocator_);
-        ft_input_tensors.insert({"top_p_min", as_GPU_tensor(input_tensors->at("top_p_min"), d_top_p_min_)});
-    }
-    if (input_tensors->find("top_p_reset_ids") != input_tensors->end()) {
-        move_tensor_H2D(input_tensors->at("top_p_reset_ids"), d_top_p_reset_ids_, &allocator_);
-        ft_input_tensors.insert(
-            {"top_p_reset_ids", as_GPU_tensor(input_tensors->at("top_p_reset_ids"), d_top_p_reset_ids_)});
+        device_inputs.push_back("request_prompt_lengths");
+        device_inputs.push_back("request_prompt_embedding");
     }
+    stage_tensors_H2D(*input_tensors, device_inputs, &request_staging_, allocator_->returnStream(), &ft_input_tensors);
 
     for (auto t = input_tensors->begin(); t != input_tensors->end(); ++t) {
         if (t->first.find("input_ids") == std::string::npos && t->first.find("input_lengths") == std::string::npos
@@ -162,6 +172,12 @@ template<typename T>
 std::shared_ptr<std::unordered_map<std::string, triton::Tensor>> ParallelGptTritonModelInstance<T>::forward(
     std::shared_ptr<std::unordered_map<std::string, triton::Tensor>> input_tensors)
 {
+    const bool is_text_request = input_tensors->count("input_text") > 0;
+    if (is_text_request) {
+        FT_CHECK_WITH_INFO(tokenizer_ != nullptr, "input_text needs vocab.json and merges.txt, or tokenizer.model");
+        FT_CHECK_WITH_INFO(input_tensors->count("START") == 0, "input_text is not supported in interactive mode");
+        encodeInputText(input_tensors);
+    }
     FT_CHECK_WITH_INFO(input_tensors->at("input_ids").shape.size() == 2,
                        "input_tensors->at(\"input_ids\").shape.size() == 2");
     FT_CHECK_WITH_INFO(input_tensors->at("input_lengths").shape.size() == 1,
@@ -237,8 +253,26 @@ std::shared_ptr<std::unordered_map<std::string, triton::Tensor>> ParallelGptTrit
                                           d_output_ctx_emb_}});
     }
 
+    const bool is_stream_delta = stream_cb_ != nullptr && input_tensors->count("is_stream_delta")
+                                 && *((bool*)input_tensors->at("is_stream_delta").data);
+    std::thread stream_thread;
+    stream_detokenizers_.clear();
+    if (is_stream_delta && is_text_request && beam_width == 1) {
+        for (size_t i = 0; i < request_batch_size; i++) {
+            stream_detokenizers_.emplace_back(*tokenizer_, true);
+        }
+        stream_finished_.assign(request_batch_size, false);
+    }
+    if (is_stream_delta) {
+        is_stream_done_ = false;
+        stream_thread   = std::thread(&ParallelGptTritonModelInstance<T>::drainStreamDeltas, this);
+    }
+
     try {
-        if (stream_cb_ != nullptr) {
+        if (is_stream_delta) {
+            gpt_->registerDeltaCallback(triton_stream_delta_callback<T>, this);
+        }
+        else if (stream_cb_ != nullptr) {
             gpt_->registerCallback(triton_stream_callback<T>, this);
         }
 
@@ -249,10 +283,181 @@ std::shared_ptr<std::unordered_map<std::string, triton::Tensor>> ParallelGptTrit
         }
     }
     catch (...) {
+        gpt_->unRegisterCallback();
         h_exception_ = std::current_exception();
         output_tensors.insert({"error_message", ft::Tensor{ft::MEMORY_CPU, ft::TYPE_BYTES, {1}, &h_exception_}});
     }
-    return convert_outputs(output_tensors);
+
+    // Every delta is delivered before the final response.
+    if (stream_thread.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(stream_mutex_);
+            is_stream_done_ = true;
+        }
+        stream_pushed_cv_.notify_one();
+        stream_thread.join();
+    }
+    auto outputs = convert_outputs(output_tensors);
+    if (is_text_request && output_tensors.count("error_message") == 0) {
+        decodeOutputText(output_tensors, outputs.get());
+    }
+    return outputs;
+}
+
+template<typename T>
+void ParallelGptTritonModelInstance<T>::encodeInputText(
+    std::shared_ptr<std::unordered_map<std::string, triton::Tensor>> input_tensors)
+{
+    const std::vector<std::string>      prompts = deserialize_triton_strings(input_tensors->at("input_text"));
+    const std::vector<std::vector<int>> ids     = tokenizer_->encodeBatch(prompts);
+    const size_t                        batch_size = ids.size();
+
+    size_t max_input_len = 1;
+    for (const std::vector<int>& sequence_ids : ids) {
+        max_input_len = std::max(max_input_len, sequence_ids.size());
+    }
+    h_text_input_ids_.assign(batch_size * max_input_len, end_id_);
+    h_text_input_lengths_.resize(batch_size);
+    for (size_t i = 0; i < batch_size; i++) {
+        std::copy(ids[i].begin(), ids[i].end(), h_text_input_ids_.begin() + i * max_input_len);
+        h_text_input_lengths_[i] = ids[i].size();
+    }
+
+    input_tensors->erase("input_text");
+    input_tensors->erase("input_ids");
+    input_tensors->erase("input_lengths");
+    input_tensors->insert(
+        {"input_ids",
+         triton::Tensor{triton::MEMORY_CPU, triton::TYPE_INT32, {batch_size, max_input_len}, h_text_input_ids_.data()}});
+    input_tensors->insert(
+        {"input_lengths",
+         triton::Tensor{triton::MEMORY_CPU, triton::TYPE_INT32, {batch_size}, h_text_input_lengths_.data()}});
+}
+
+template<typename T>
+void ParallelGptTritonModelInstance<T>::decodeOutputText(const std::unordered_map<std::string, ft::Tensor>& output_tensors,
+                                                         std::unordered_map<std::string, triton::Tensor>*   outputs)
+{
+    const ft::Tensor& output_ids     = output_tensors.at("output_ids");
+    const size_t      batch_size     = output_ids.shape[0];
+    const size_t      beam_width     = output_ids.shape[1];
+    const size_t      max_output_len = output_ids.shape[2];
+
+    std::vector<int> h_output_ids(output_ids.size());
+    std::vector<int> h_sequence_lengths(batch_size * beam_width);
+    ft::cudaD2Hcpy(h_output_ids.data(), output_ids.getPtr<int>(), h_output_ids.size());
+    ft::cudaD2Hcpy(h_sequence_lengths.data(), d_sequence_lengths_, h_sequence_lengths.size());
+
+    // The outputs are the prompt, without padding, then the generated tokens. The generated text continues the
+    // prompt, so it keeps its leading space, even with the dummy prefix of sentencepiece.
+    std::vector<std::string> texts(batch_size * beam_width);
+    for (size_t i = 0; i < texts.size(); i++) {
+        const int* sequence_ids = h_output_ids.data() + i * max_output_len;
+        const int  end          = std::min((int)max_output_len, h_sequence_lengths[i]);
+        for (int j = h_text_input_lengths_[i / beam_width]; j < end && sequence_ids[j] != end_id_; j++) {
+            texts[i] += tokenizer_->getTokenBytes(sequence_ids[j]);
+        }
+    }
+    serialize_triton_strings(texts, &h_output_text_);
+    outputs->insert(
+        {"output_text",
+         triton::Tensor{triton::MEMORY_CPU, triton::TYPE_BYTES, {batch_size, beam_width}, h_output_text_.data()}});
+}
+
+template<typename T>
+void ParallelGptTritonModelInstance<T>::decodeStreamDeltaText(
+    const std::unordered_map<std::string, ft::Tensor>& delta_tensors,
+    std::unordered_map<std::string, triton::Tensor>*   outputs)
+{
+    const ft::Tensor& output_ids  = delta_tensors.at("output_ids");
+    const int*        ids         = output_ids.getPtr<int>();
+    const bool*       is_finished = delta_tensors.at("is_finished").getPtr<bool>();
+
+    std::vector<std::string> texts(stream_detokenizers_.size());
+    for (size_t i = 0; i < texts.size(); i++) {
+        if (stream_finished_[i]) {
+            continue;
+        }
+        if (ids[i] != end_id_) {
+            texts[i] = stream_detokenizers_[i].push(ids[i]);
+        }
+        if (is_finished[i]) {
+            texts[i] += stream_detokenizers_[i].finish();
+            stream_finished_[i] = true;
+        }
+    }
+    serialize_triton_strings(texts, &h_stream_text_);
+    outputs->insert({"output_text",
+                     triton::Tensor{triton::MEMORY_CPU, triton::TYPE_BYTES, output_ids.shape, h_stream_text_.data()}});
+}
+
+template<typename T>
+void ParallelGptTritonModelInstance<T>::pushStreamDelta(const std::unordered_map<std::string, ft::Tensor>& delta_tensors)
+{
+    // The tensors point to buffers which are overwritten by the next step, so the delta keeps its own copy.
+    std::unique_ptr<StreamDelta> delta(new StreamDelta());
+    size_t                       num_bytes = 0;
+    for (auto& t : delta_tensors) {
+        num_bytes += t.second.sizeBytes();
+    }
+    delta->buffer.resize(num_bytes);
+    size_t offset = 0;
+    for (auto& t : delta_tensors) {
+        std::memcpy(delta->buffer.data() + offset, t.second.data, t.second.sizeBytes());
+        delta->tensors.insert(
+            {t.first, ft::Tensor{ft::MEMORY_CPU, t.second.type, t.second.shape, delta->buffer.data() + offset}});
+        offset += t.second.sizeBytes();
+    }
+
+    // Back pressure: the generation waits for the drain thread when the queue is full.
+    if (!stream_deltas_.tryPush(std::move(delta))) {
+        std::unique_lock<std::mutex> lock(stream_mutex_);
+        is_stream_pusher_waiting_ = true;
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        stream_popped_cv_.wait(lock, [&] { return stream_deltas_.tryPush(std::move(delta)); });
+        is_stream_pusher_waiting_ = false;
+    }
+    wakeStreamThread(is_stream_drainer_waiting_, stream_pushed_cv_);
+}
+
+template<typename T>
+void ParallelGptTritonModelInstance<T>::wakeStreamThread(const std::atomic<bool>& is_waiting,
+                                                         std::condition_variable& cv)
+{
+    // Pairs with the fence after the waiting thread sets is_waiting: either it sees the queue change before it
+    // sleeps, or this thread sees is_waiting. Taking the mutex makes sure it is not between its check and its wait.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (is_waiting.load(std::memory_order_relaxed)) {
+        std::lock_guard<std::mutex> lock(stream_mutex_);
+        cv.notify_one();
+    }
+}
+
+template<typename T>
+void ParallelGptTritonModelInstance<T>::drainStreamDeltas()
+{
+    std::unique_ptr<StreamDelta> delta;
+    while (true) {
+        if (!stream_deltas_.tryPop(&delta)) {
+            // The queue is drained before the thread stops, so every delta pushed before the flag was set is sent.
+            std::unique_lock<std::mutex> lock(stream_mutex_);
+            is_stream_drainer_waiting_ = true;
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            stream_pushed_cv_.wait(lock, [&] { return stream_deltas_.tryPop(&delta) || is_stream_done_; });
+            is_stream_drainer_waiting_ = false;
+        }
+        if (delta == nullptr) {
+            break;
+        }
+        wakeStreamThread(is_stream_pusher_waiting_, stream_popped_cv_);
+
+        auto outputs = convert_outputs(delta->tensors);
+        if (!stream_detokenizers_.empty()) {
+            decodeStreamDeltaText(delta->tensors, outputs.get());
+        }
+        stream_cb_(outputs, stream_ctx_);
+        delta.reset();
+    }
 }
 
 template<typename T>
@@ -293,7 +498,6 @@ void ParallelGptTritonModelInstance<T>::freeBuffer()
     allocator_->free((void**)(&d_output_ctx_emb_));
     allocator_->free((void**)(&d_cum_log_probs_));
     allocator_->free((void**)(&d_is_finished_));
-    std::free(h_total_output_lengths_);
 }
 
 template struct ParallelGptTritonModelInstance<float>;
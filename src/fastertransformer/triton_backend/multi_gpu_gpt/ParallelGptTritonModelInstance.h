@@ -19,7 +19,13 @@
 #include "src/fastertransformer/models/multi_gpu_gpt/ParallelGpt.h"
 #include "src/fastertransformer/triton_backend/multi_gpu_gpt/ParallelGptTritonModel.h"
 #include "src/fastertransformer/triton_backend/transformer_triton_backend.hpp"
+#include "src/fastertransformer/utils/request_staging.h"
+#include "src/fastertransformer/utils/spsc_queue.h"
+#include "src/fastertransformer/utils/tokenizer.h"
+#include <atomic>
+#include <condition_variable>
 #include <memory>
+#include <mutex>
 
 namespace ft = fastertransformer;
 
@@ -32,7 +38,9 @@ struct ParallelGptTritonModelInstance: AbstractTransformerModelInstance {
                                    std::unique_ptr<ft::cublasAlgoMap>                      cublas_algo_map,
                                    std::unique_ptr<std::mutex>                             cublas_wrapper_mutex,
                                    std::unique_ptr<ft::cublasMMWrapper>                    cublas_wrapper,
-                                   std::unique_ptr<cudaDeviceProp>                         cuda_device_prop_ptr);
+                                   std::unique_ptr<cudaDeviceProp>                         cuda_device_prop_ptr,
+                                   std::shared_ptr<const ft::Tokenizer>                    tokenizer = nullptr,
+                                   int                                                     end_id    = 0);
     ~ParallelGptTritonModelInstance();
 
     std::shared_ptr<std::vector<triton::Tensor>>
@@ -44,6 +52,15 @@ struct ParallelGptTritonModelInstance: AbstractTransformerModelInstance {
     static std::shared_ptr<std::unordered_map<std::string, triton::Tensor>>
     convert_outputs(const std::unordered_map<std::string, ft::Tensor>& output_tensors);
 
+    // Token delta streaming ("is_stream_delta" input): the generation thread copies the tokens of each step to
+    // the queue, and a separate thread drains it to stream_cb_, so a slow client does not stall the generation until
+    // the queue is full.
+    struct StreamDelta {
+        std::unordered_map<std::string, ft::Tensor> tensors;  // on cpu, pointing to buffer
+        std::vector<char>                           buffer;
+    };
+    void pushStreamDelta(const std::unordered_map<std::string, ft::Tensor>& delta_tensors);
+
 private:
     const std::unique_ptr<ft::ParallelGpt<T>>                     gpt_;
     const std::shared_ptr<ft::ParallelGptWeight<T>>               gpt_weight_;
@@ -52,6 +69,9 @@ private:
     const std::unique_ptr<std::mutex>                             cublas_wrapper_mutex_;
     const std::unique_ptr<ft::cublasMMWrapper>                    cublas_wrapper_;
     const std::unique_ptr<cudaDeviceProp>                         cuda_device_prop_ptr_;
+    const std::shared_ptr<const ft::Tokenizer>                    tokenizer_;
+    const int                                                     end_id_;
+    ft::RequestStaging                                            request_staging_;  // the inputs copied to the device
 
     std::unordered_map<std::string, ft::Tensor>
     convert_inputs(std::shared_ptr<std::unordered_map<std::string, triton::Tensor>> input_tensors);
@@ -61,16 +81,18 @@ private:
                         const size_t total_output_len,
                         const size_t request_output_len);
     void freeBuffer();
+    void drainStreamDeltas();
+    // Wakes the thread waiting on cv, if is_waiting.
+    void wakeStreamThread(const std::atomic<bool>& is_waiting, std::condition_variable& cv);
 
-    int*   d_input_ids_                = nullptr;
-    int*   d_input_lengths_            = nullptr;
-    int*   d_request_prompt_lengths_   = nullptr;
-    int*   d_input_bad_words_          = nullptr;
-    int*   d_input_stop_words_         = nullptr;
-    T*     d_request_prompt_embedding_ = nullptr;
-    float* d_top_p_decay_              = nullptr;
-    float* d_top_p_min_                = nullptr;
-    int*   d_top_p_reset_ids_          = nullptr;
+    // Text in, text out, when the model has a tokenizer: the "input_text" input (BYTES [batch_size, 1]) replaces
+    // "input_ids" and "input_lengths", and the outputs get "output_text" (BYTES [batch_size, beam_width]), the
+    // generated text without the prompt. Token deltas get the text they complete as well, without beam search.
+    void encodeInputText(std::shared_ptr<std::unordered_map<std::string, triton::Tensor>> input_tensors);
+    void decodeOutputText(const std::unordered_map<std::string, ft::Tensor>& output_tensors,
+                          std::unordered_map<std::string, triton::Tensor>*   outputs);
+    void decodeStreamDeltaText(const std::unordered_map<std::string, ft::Tensor>& delta_tensors,
+                               std::unordered_map<std::string, triton::Tensor>*   outputs);
 
     int*   d_output_ids_             = nullptr;
     int*   d_sequence_lengths_       = nullptr;
@@ -80,6 +102,24 @@ private:
     float* d_output_ctx_emb_         = nullptr;
     bool*  d_is_finished_            = nullptr;
 
-    uint32_t*          h_total_output_lengths_ = nullptr;
-    std::exception_ptr h_exception_            = nullptr;
+    std::vector<uint32_t> h_total_output_lengths_;
+    std::exception_ptr    h_exception_ = nullptr;
+
+    std::vector<int>                        h_text_input_ids_;
+    std::vector<int>                        h_text_input_lengths_;
+    std::vector<char>                       h_output_text_;  // serialized like triton BYTES tensors
+    std::vector<char>                       h_stream_text_;
+    std::vector<ft::IncrementalDetokenizer> stream_detokenizers_;  // per sequence, for the token deltas
+    std::vector<bool>                       stream_finished_;
+
+    // The generation thread and the drain thread push and pop without locking. They only take stream_mutex_ to
+    // sleep when the queue is full or empty, and to wake the other thread when it sleeps.
+    static const size_t                         stream_delta_queue_size_ = 64;
+    ft::SpscQueue<std::unique_ptr<StreamDelta>> stream_deltas_{stream_delta_queue_size_};
+    bool                                        is_stream_done_ = false;  // under stream_mutex_
+    std::mutex                                  stream_mutex_;
+    std::condition_variable                     stream_pushed_cv_;
+    std::condition_variable                     stream_popped_cv_;
+    std::atomic<bool>                           is_stream_pusher_waiting_{false};
+    std::atomic<bool>                           is_stream_drainer_waiting_{false};
 };
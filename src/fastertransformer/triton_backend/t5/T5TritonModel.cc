@@ -161,7 +161,14 @@ T5TritonModel<T>::T5TritonModel(size_t      tensor_para_size,
         ft::PositionEmbeddingType(reader.Get("structure", "position_embedding_type", "relative") == "relative" ? 0 : 1);
     q_scaling_ = t5_with_bias_ ? 1.0f : (1.0f / (sqrt(encoder_size_per_head_) * 1.0f));
 
-    ia3_num_tasks_ = reader.GetInteger("structure", "ia3_num_tasks", 0);
+    ia3_num_tasks_         = reader.GetInteger("structure", "ia3_num_tasks", 0);
+    ia3_num_runtime_tasks_ = reader.GetInteger("structure", "ia3_num_runtime_tasks", 0);
+    if (ia3_num_tasks_ + ia3_num_runtime_tasks_ > 0) {
+        ia3_adapters_ = std::make_shared<ft::AdapterSlotRegistry>(ia3_num_tasks_ + ia3_num_runtime_tasks_);
+        for (size_t i = 0; i < ia3_num_tasks_; i++) {
+            ia3_adapters_->addStagedAdapter(i, i);
+        }
+    }
 
     max_distance_ = 128;  // use default value of huggingface here
 }
@@ -290,6 +297,7 @@ T5TritonModel<T>::createModelInstance(int
                                                                                   std::move(decoding),
                                                                                   encoder_shared_weights_[device_id],
                                                                                   decoding_shared_weights_[device_id],
+                                                                                  ia3_adapters_,
                                                                                   std::move(allocator),
                                                                                   std::move(cublas_algo_map),
                                                                                   std::move(cublas_wrapper_mutex),
@@ -345,6 +353,52 @@ void T5TritonModel<T>::createSharedWeights(int device_id, int rank)
 
     encoder_shared_weights_[device_id]->loadModel(model_dir_);
     decoding_shared_weights_[device_id]->loadModel(model_dir_);
+    if (ia3_num_runtime_tasks_ > 0) {
+        encoder_shared_weights_[device_id]->reserveIA3Tasks(ia3_num_tasks_ + ia3_num_runtime_tasks_);
+        decoding_shared_weights_[device_id]->reserveIA3Tasks(ia3_num_tasks_ + ia3_num_runtime_tasks_);
+    }
+}
+
+template<typename T>
+void T5TritonModel<T>::registerAdapter(int adapter_id, std::string dir_path)
+{
+    FT_CHECK_WITH_INFO(ia3_adapters_ != nullptr,
+                       "this model has no IA3 rows, set ia3_num_runtime_tasks to register IA3 tasks");
+    // The weights of every device of this node; the other nodes register the adapter on their own model.
+    auto encoder_weights  = encoder_shared_weights_;
+    auto decoding_weights = decoding_shared_weights_;
+    ia3_adapters_->registerAdapter(adapter_id, [encoder_weights, decoding_weights, dir_path](int slot) {
+        for (size_t device_id = 0; device_id < encoder_weights.size(); device_id++) {
+            if (encoder_weights[device_id] == nullptr) {
+                continue;
+            }
+            ft::check_cuda_error(cudaSetDevice(device_id));
+            // A stream of its own, so the copies do not wait for the requests being served.
+            cudaStream_t stream;
+            ft::check_cuda_error(cudaStreamCreateWithFlags(&stream, cudaStreamNonBlocking));
+            try {
+                encoder_weights[device_id]->loadIA3Task(slot, dir_path, stream);
+                decoding_weights[device_id]->loadIA3Task(slot, dir_path, stream);
+            }
+            catch (...) {
+                cudaStreamDestroy(stream);
+                throw;
+            }
+            ft::check_cuda_error(cudaStreamDestroy(stream));
+        }
+    });
+}
+
+template<typename T>
+bool T5TritonModel<T>::unregisterAdapter(int adapter_id)
+{
+    return ia3_adapters_ != nullptr && ia3_adapters_->unregisterAdapter(adapter_id);
+}
+
+template<typename T>
+std::vector<ft::AdapterInfo> T5TritonModel<T>::listAdapters()
+{
+    return ia3_adapters_ != nullptr ? ia3_adapters_->listAdapters() : std::vector<ft::AdapterInfo>();
 }
 
 template<typename T>
@@ -367,7 +421,9 @@ std::string T5TritonModel<T>::toString()
        << "\n    decoding_num_bucket_or_max_pos_seq_len_: " << decoding_num_bucket_or_max_pos_seq_len_
        << "\n    decoding_adapter: " << decoding_adapter_.toString() << "\n    t5_with_bias_: " << t5_with_bias_
        << "\n    use_gated_activation_: " << use_gated_activation_
-       << "\n   position_embedding_type_: " << position_embedding_type_string << "\n    start_id_: " << start_id_
+       << "\n   position_embedding_type_: " << position_embedding_type_string
+       << "\n    ia3_num_tasks_: " << ia3_num_tasks_ << "\n    ia3_num_runtime_tasks_: " << ia3_num_runtime_tasks_
+       << "\n    start_id_: " << start_id_
        << "\n    end_id_: " << end_id_ << "\n    model_name_: " << model_name_ << "\n    model_dir_: " << model_dir_
        << std::endl;
 
@@ -48,6 +48,12 @@ struct T5TritonModel: public AbstractTransformerModel {
 
     virtual void createSharedWeights(int deviceId, int rank) override;
 
+    // IA3 tasks registered at runtime into the spare rows of the IA3 tables, see ia3_num_runtime_tasks. dir_path has
+    // the IA3 files of a model directory with a single task, and adapter_id is then requested through ia3_tasks.
+    virtual void                         registerAdapter(int adapter_id, std::string dir_path) override;
+    virtual bool                         unregisterAdapter(int adapter_id) override;
+    virtual std::vector<ft::AdapterInfo> listAdapters() override;
+
     virtual void createCustomComms(std::vector<std::shared_ptr<ft::AbstractCustomComm>>* custom_all_reduce_comms,
                                    int                                                   world_size) override;
 
@@ -83,7 +89,11 @@ private:
     ft::LinearAdapterConfig decoding_adapter_{};
 
     float  q_scaling_;
-    size_t ia3_num_tasks_;
+    size_t ia3_num_tasks_         = 0;
+    size_t ia3_num_runtime_tasks_ = 0;  // spare rows of the IA3 tables for registerAdapter
+
+    // the rows of the IA3 tables, the tasks of the checkpoint are the adapters 0 to ia3_num_tasks_ - 1
+    std::shared_ptr<ft::AdapterSlotRegistry> ia3_adapters_;
 
     size_t max_distance_;
     int    start_id_;
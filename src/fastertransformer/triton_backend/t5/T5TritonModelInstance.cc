@@ -36,6 +36,7 @@ T5TritonModelInstance<T>::T5TritonModelInstance(std::unique_ptr<ft::T5Encoder<T>
                                                 std::unique_ptr<ft::T5Decoding<T>>       t5_decoding,
                                                 std::shared_ptr<ft::T5EncoderWeight<T>>  t5_encoder_weight,
                                                 std::shared_ptr<ft::T5DecodingWeight<T>> t5_decoding_weight,
+                                                std::shared_ptr<ft::AdapterSlotRegistry> ia3_adapters,
                                                 std::unique_ptr<ft::Allocator<ft::AllocatorType::CUDA>> allocator,
                                                 std::unique_ptr<ft::cublasAlgoMap>                      cublas_algo_map,
                                                 std::unique_ptr<std::mutex>          cublas_wrapper_mutex,
@@ -45,43 +46,32 @@ T5TritonModelInstance<T>::T5TritonModelInstance(std::unique_ptr<ft::T5Encoder<T>
     t5_decoding_(std::move(t5_decoding)),
     t5_encoder_weight_(t5_encoder_weight),
     t5_decoding_weight_(t5_decoding_weight),
+    ia3_adapters_(ia3_adapters),
     allocator_(std::move(allocator)),
     cublas_algo_map_(std::move(cublas_algo_map)),
     cublas_wrapper_mutex_(std::move(cublas_wrapper_mutex)),
     cublas_wrapper_(std::move(cublas_wrapper)),
-    cuda_device_prop_ptr_(std::move(cuda_device_prop_ptr))
+    cuda_device_prop_ptr_(std::move(cuda_device_prop_ptr)),
+    request_staging_(allocator_.get())
 {
 }
 
 template<typename T>
 ft::TensorMap
-T5TritonModelInstance<T>::convert_inputs(std::shared_ptr<std::unordered_map<std::string, triton::Tensor>> input_tensors)
+T5TritonModelInstance<T>::convert_inputs(std::shared_ptr<std::unordered_map<std::string, triton::Tensor>> input_tensors,
+                                         const std::unordered_map<std::string, ft::Tensor>& device_tensors)
 {
-    move_tensor_H2D(input_tensors->at("input_ids"), d_input_ids_, &allocator_);
-    move_tensor_H2D(input_tensors->at("sequence_length"), d_input_lengths_, &allocator_);
-
-    ft::TensorMap ft_input_tensors(
-        {{"input_ids", as_GPU_tensor(input_tensors->at("input_ids"), d_input_ids_)},
-         {"sequence_length", as_GPU_tensor(input_tensors->at("sequence_length"), d_input_lengths_)}});
+    ft::TensorMap ft_input_tensors({{"input_ids", device_tensors.at("input_ids")},
+                                    {"sequence_length", device_tensors.at("sequence_length")}});
 
     if (input_tensors->count("prompt_learning_task_name_ids")) {
         ft_input_tensors.insert({"prompt_learning_task_name_ids",
                                  input_tensors->at("prompt_learning_task_name_ids").convertTritonTensorToFt()});
     }
-    if (input_tensors->count("request_prompt_lengths")) {
-        move_tensor_H2D(input_tensors->at("request_prompt_lengths"), d_request_prompt_lengths_, &allocator_);
-        ft_input_tensors.insert(
-            {"request_prompt_lengths",
-             as_GPU_tensor(input_tensors->at("request_prompt_lengths"), d_request_prompt_lengths_)});
-    }
-    if (input_tensors->count("request_prompt_embedding")) {
-        move_tensor_H2D(input_tensors->at("request_prompt_embedding"), d_request_prompt_embedding_, &allocator_);
-        ft_input_tensors.insert(
-            {"request_prompt_embedding",
-             as_GPU_tensor(input_tensors->at("request_prompt_embedding"), d_request_prompt_embedding_)});
-    }
-    if (input_tensors->count("ia3_tasks")) {
-        ft_input_tensors.insert({"ia3_tasks", as_GPU_tensor(input_tensors->at("ia3_tasks"), d_input_ia3_tasks_)});
+    for (const char* name : {"request_prompt_lengths", "request_prompt_embedding", "ia3_tasks"}) {
+        if (device_tensors.count(name)) {
+            ft_input_tensors.insert({name, device_tensors.at(name)});
+        }
     }
     return ft_input_tensors;
 }
@@ -113,11 +103,39 @@ T5TritonModelInstance<T>::forward(std::shared_ptr<std::unordered_map<std::string
 
     allocateBuffer(request_batch_size, beam_width, max_output_len, mem_max_seq_len);
 
-    if (has_ia3_tasks) {
-        move_tensor_H2D(input_tensors->at("ia3_tasks"), d_input_ia3_tasks_, &allocator_);
+    // The registry gives the IA3 row of each task, and holds the rows until the request is done.
+    std::unique_ptr<ft::AdapterSlotsHolder> ia3_rows;
+    if (has_ia3_tasks && ia3_adapters_ != nullptr) {
+        const triton::Tensor& ia3_tasks = input_tensors->at("ia3_tasks");
+        FT_CHECK_WITH_INFO(ia3_tasks.where == triton::MEMORY_CPU, "ia3_tasks must be on the CPU");
+        ia3_rows.reset(new ft::AdapterSlotsHolder(
+            ia3_adapters_.get(), (const int*)ia3_tasks.data, request_batch_size, allocator_->returnStream()));
+    }
+
+    std::unordered_map<std::string, ft::Tensor> device_tensors;
+    stage_tensors_H2D(*input_tensors,
+                      {"input_ids",
+                       "sequence_length",
+                       "request_prompt_lengths",
+                       "request_prompt_embedding",
+                       "ia3_tasks",
+                       "top_p_decay",
+                       "top_p_min",
+                       "top_p_reset_ids",
+                       "bad_words_list",
+                       "stop_words_list"},
+                      &request_staging_,
+                      allocator_->returnStream(),
+                      &device_tensors);
+    if (ia3_rows != nullptr) {
+        ft::check_cuda_error(cudaMemcpyAsync(device_tensors.at("ia3_tasks").getPtr<int>(),
+                                             ia3_rows->getSlots().data(),
+                                             sizeof(int) * request_batch_size,
+                                             cudaMemcpyHostToDevice,
+                                             allocator_->returnStream()));
     }
 
-    ft::TensorMap encoder_input_tensors(convert_inputs(input_tensors));
+    ft::TensorMap encoder_input_tensors(convert_inputs(input_tensors, device_tensors));
 
     ft::TensorMap encoder_output_tensors(
         {{"output_hidden_state",
@@ -129,18 +147,10 @@ T5TritonModelInstance<T>::forward(std::shared_ptr<std::unordered_map<std::string
     ft::TensorMap decoding_input_tensors({{"encoder_output", encoder_output_tensors.at("output_hidden_state")},
                                           {"encoder_sequence_length", encoder_input_tensors.at("sequence_length")}});
 
-    if (input_tensors->find("top_p_decay") != input_tensors->end()) {
-        move_tensor_H2D(input_tensors->at("top_p_decay"), d_top_p_decay_, &allocator_);
-        decoding_input_tensors.insert({"top_p_decay", as_GPU_tensor(input_tensors->at("top_p_decay"), d_top_p_decay_)});
-    }
-    if (input_tensors->find("top_p_min") != input_tensors->end()) {
-        move_tensor_H2D(input_tensors->at("top_p_min"), d_top_p_min_, &allocator_);
-        decoding_input_tensors.insert({"top_p_min", as_GPU_tensor(input_tensors->at("top_p_min"), d_top_p_min_)});
-    }
-    if (input_tensors->find("top_p_reset_ids") != input_tensors->end()) {
-        move_tensor_H2D(input_tensors->at("top_p_reset_ids"), d_top_p_reset_ids_, &allocator_);
-        decoding_input_tensors.insert(
-            {"top_p_reset_ids", as_GPU_tensor(input_tensors->at("top_p_reset_ids"), d_top_p_reset_ids_)});
+    for (const char* name : {"top_p_decay", "top_p_min", "top_p_reset_ids", "bad_words_list", "stop_words_list"}) {
+        if (device_tensors.count(name)) {
+            decoding_input_tensors.insert({name, device_tensors.at(name)});
+        }
     }
 
     std::set<std::string> keys_on_gpu = {"input_ids",
@@ -157,18 +167,6 @@ T5TritonModelInstance<T>::forward(std::shared_ptr<std::unordered_map<std::string
         }
     }
 
-    if (input_tensors->find("bad_words_list") != input_tensors->end()) {
-        move_tensor_H2D(input_tensors->at("bad_words_list"), d_input_bad_words_, &allocator_);
-        decoding_input_tensors.insert(
-            {"bad_words_list", as_GPU_tensor(input_tensors->at("bad_words_list"), d_input_bad_words_)});
-    }
-
-    if (input_tensors->find("stop_words_list") != input_tensors->end()) {
-        move_tensor_H2D(input_tensors->at("stop_words_list"), d_input_stop_words_, &allocator_);
-        decoding_input_tensors.insert(
-            {"stop_words_list", as_GPU_tensor(input_tensors->at("stop_words_list"), d_input_stop_words_)});
-    }
-
     ft::TensorMap decoding_output_tensors(
         {{"output_ids",
           ft::Tensor{ft::MEMORY_GPU,
@@ -197,12 +195,17 @@ T5TritonModelInstance<T>::forward(std::shared_ptr<std::unordered_map<std::string
     if (has_ia3_tasks) {
         const auto num_ia3_tasks = t5_encoder_weight_->getNumIA3Tasks();
         FT_CHECK_WITH_INFO(num_ia3_tasks > 0, "Cannot request ia3_tasks, model has no IA3 adapters");
-        const bool is_within_range = ft::invokeCheckRange<int>(
-            d_input_ia3_tasks_, request_batch_size, 0, num_ia3_tasks - 1, d_within_range_, t5_encoder_->getStream());
+        const ft::Tensor ia3_tasks       = device_tensors.at("ia3_tasks");
+        const bool       is_within_range = ft::invokeCheckRange<int>(ia3_tasks.getPtr<int>(),
+                                                                request_batch_size,
+                                                                0,
+                                                                num_ia3_tasks - 1,
+                                                                d_within_range_,
+                                                                t5_encoder_->getStream());
         FT_CHECK_WITH_INFO(is_within_range,
                            ft::fmtstr("Requested IA3 tasks aren't in the range [0, %d).", num_ia3_tasks));
 
-        decoding_input_tensors.insert({"ia3_tasks", as_GPU_tensor(input_tensors->at("ia3_tasks"), d_input_ia3_tasks_)});
+        decoding_input_tensors.insert({"ia3_tasks", ia3_tasks});
     }
 
     try {
@@ -20,6 +20,7 @@
 #include "src/fastertransformer/models/t5/T5Encoder.h"
 #include "src/fastertransformer/triton_backend/t5/T5TritonModel.h"
 #include "src/fastertransformer/triton_backend/transformer_triton_backend.hpp"
+#include "src/fastertransformer/utils/request_staging.h"
 #include <memory>
 
 namespace ft = fastertransformer;
@@ -31,6 +32,7 @@ struct T5TritonModelInstance: AbstractTransformerModelInstance {
                           std::unique_ptr<ft::T5Decoding<T>>                      t5_decoding,
                           std::shared_ptr<ft::T5EncoderWeight<T>>                 t5_encoder_weight,
                           std::shared_ptr<ft::T5DecodingWeight<T>>                t5_decoding_weight,
+                          std::shared_ptr<ft::AdapterSlotRegistry>                ia3_adapters,
                           std::unique_ptr<ft::Allocator<ft::AllocatorType::CUDA>> allocator,
                           std::unique_ptr<ft::cublasAlgoMap>                      cublas_algo_map,
                           std::unique_ptr<std::mutex>                             cublas_wrapper_mutex,
@@ -56,13 +58,16 @@ private:
     const std::shared_ptr<ft::T5EncoderWeight<T>>                 t5_encoder_weight_;
     const std::unique_ptr<ft::T5Decoding<T>>                      t5_decoding_;
     const std::shared_ptr<ft::T5DecodingWeight<T>>                t5_decoding_weight_;
+    const std::shared_ptr<ft::AdapterSlotRegistry>                ia3_adapters_;  // maps ia3_tasks to the IA3 rows
     const std::unique_ptr<ft::Allocator<ft::AllocatorType::CUDA>> allocator_;
     const std::unique_ptr<ft::cublasAlgoMap>                      cublas_algo_map_;
     const std::unique_ptr<std::mutex>                             cublas_wrapper_mutex_;
     const std::unique_ptr<ft::cublasMMWrapper>                    cublas_wrapper_;
     const std::unique_ptr<cudaDeviceProp>                         cuda_device_prop_ptr_;
+    ft::RequestStaging                                            request_staging_;  // the inputs copied to the device
 
-    ft::TensorMap convert_inputs(std::shared_ptr<std::unordered_map<std::string, triton::Tensor>> input_tensors);
+    ft::TensorMap convert_inputs(std::shared_ptr<std::unordered_map<std::string, triton::Tensor>> input_tensors,
+                                 const std::unordered_map<std::string, ft::Tensor>&               device_tensors);
 
     void allocateBuffer(const size_t request_batch_size,
                         const size_t beam_width,
@@ -70,17 +75,6 @@ private:
                         const size_t mem_max_seq_len);
     void freeBuffer();
 
-    int*   d_input_ids_                = nullptr;
-    int*   d_input_lengths_            = nullptr;
-    int*   d_input_bad_words_          = nullptr;
-    int*   d_input_stop_words_         = nullptr;
-    int*   d_input_ia3_tasks_          = nullptr;
-    int*   d_request_prompt_lengths_   = nullptr;
-    T*     d_request_prompt_embedding_ = nullptr;
-    float* d_top_p_decay_              = nullptr;
-    float* d_top_p_min_                = nullptr;
-    int*   d_top_p_reset_ids_          = nullptr;
-
     T*     d_encoder_outputs_  = nullptr;
     int*   d_output_ids_       = nullptr;
     int*   d_sequence_lengths_ = nullptr;
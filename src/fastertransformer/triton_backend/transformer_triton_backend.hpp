@@ -21,6 +21,7 @@
 #include <sys/time.h>
 #include <vector>
 
+#include "src/fastertransformer/layers/adapter_layers/AdapterSlotRegistry.h"
 #include "src/fastertransformer/utils/Tensor.h"
 #include "src/fastertransformer/utils/custom_ar_comm.h"
 #include "src/fastertransformer/utils/mpi_utils.h"
@@ -309,6 +310,21 @@ struct AbstractTransformerModel {
 
     virtual void createSharedWeights(int deviceId, int rank) = 0;
 
+    // Adapters registered and unregistered while the model serves requests, see ft::AdapterSlotRegistry. The models
+    // without runtime adapters reject them.
+    virtual void registerAdapter(int adapter_id, std::string dir_path)
+    {
+        FT_CHECK_WITH_INFO(false, "this model does not register adapters at runtime");
+    }
+    virtual bool unregisterAdapter(int adapter_id)
+    {
+        return false;
+    }
+    virtual std::vector<ft::AdapterInfo> listAdapters()
+    {
+        return {};
+    }
+
     virtual std::string toString()            = 0;
     virtual int         getTensorParaSize()   = 0;
     virtual int         getPipelineParaSize() = 0;
@@ -18,6 +18,7 @@
 
 #include "src/fastertransformer/triton_backend/transformer_triton_backend.hpp"
 #include "src/fastertransformer/utils/Tensor.h"
+#include "src/fastertransformer/utils/request_staging.h"
 
 namespace ft = fastertransformer;
 
@@ -54,3 +55,28 @@ inline ft::Tensor as_CPU_tensor(const triton::Tensor& tensor)
 {
     return ft::Tensor{ft::MEMORY_CPU, triton::Tensor::convertTritonTypeToFt(tensor.type), tensor.shape, tensor.data};
 }
+
+// Copies the inputs of names which are in input_tensors and on the host to the device, all at once through staging,
+// and adds them to ft_input_tensors as device tensors.
+inline void stage_tensors_H2D(const std::unordered_map<std::string, triton::Tensor>& input_tensors,
+                              const std::vector<const char*>&                         names,
+                              ft::RequestStaging*                                     staging,
+                              cudaStream_t                                            stream,
+                              std::unordered_map<std::string, ft::Tensor>*            ft_input_tensors)
+{
+    std::vector<int> indices(names.size(), -1);
+    staging->clear();
+    for (size_t i = 0; i < names.size(); i++) {
+        auto tensor = input_tensors.find(names[i]);
+        if (tensor != input_tensors.end() && tensor->second.where == triton::MEMORY_CPU) {
+            indices[i] = staging->add(tensor->second.data, as_CPU_tensor(tensor->second).sizeBytes());
+        }
+    }
+    staging->copyToDevice(stream);
+    for (size_t i = 0; i < names.size(); i++) {
+        auto tensor = input_tensors.find(names[i]);
+        if (tensor != input_tensors.end()) {
+            ft_input_tensors->insert({names[i], as_GPU_tensor(tensor->second, staging->getDevicePtr(indices[i]))});
+        }
+    }
+}
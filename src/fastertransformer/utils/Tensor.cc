@@ -33,6 +33,9 @@
 
 namespace fastertransformer {
 
+constexpr size_t TensorShape::kInlineDims;
+constexpr size_t TensorMap::kReservedTensors;
+
 Tensor::Tensor():
     // a none tensor.
     where(MEMORY_CPU),
@@ -43,14 +46,14 @@ Tensor::Tensor():
 {
 }
 
-Tensor::Tensor(const MemoryType _where, const DataType _type, const std::vector<size_t> _shape, const void* _data):
+Tensor::Tensor(const MemoryType _where, const DataType _type, const TensorShape& _shape, const void* _data):
     where(_where), type(_type), shape(_shape), data(_data)
 {
 }
 
 Tensor::Tensor(const MemoryType          _where,
                const DataType            _type,
-               const std::vector<size_t> _shape,
+               const TensorShape&        _shape,
                const void*               _data,
                const std::vector<size_t> _offset):
     where(_where), type(_type), shape(_shape), data(_data), offsets(_offset)
@@ -331,7 +334,7 @@ void Tensor::saveNpy(const std::string& filename) const
     }
 }
 
-Tensor Tensor::slice(std::vector<size_t> shape, size_t offset) const
+Tensor Tensor::slice(const TensorShape& shape, size_t offset) const
 {
     if (this->data != nullptr) {
         size_t n_elts        = this->size();
@@ -347,6 +350,7 @@ Tensor Tensor::slice(std::vector<size_t> shape, size_t offset) const
 
 TensorMap::TensorMap(const std::unordered_map<std::string, Tensor>& tensor_map)
 {
+    tensor_map_.reserve(std::max(tensor_map.size(), kReservedTensors));
     for (auto& kv : tensor_map) {
         if (isValid(kv.second)) {
             insert(kv.first, kv.second);
@@ -359,6 +363,7 @@ TensorMap::TensorMap(const std::unordered_map<std::string, Tensor>& tensor_map)
 
 TensorMap::TensorMap(const std::vector<Tensor>& tensor_map)
 {
+    tensor_map_.reserve(std::max(tensor_map.size(), kReservedTensors));
     for (size_t i = 0; i < tensor_map.size(); i++) {
         insert(std::to_string(i), tensor_map[i]);
     }
@@ -366,6 +371,7 @@ TensorMap::TensorMap(const std::vector<Tensor>& tensor_map)
 
 TensorMap::TensorMap(std::initializer_list<std::pair<std::string, Tensor>> tensor_map)
 {
+    tensor_map_.reserve(std::max(tensor_map.size(), kReservedTensors));
     for (auto& pair : tensor_map) {
         if (isValid(pair.second)) {
             insert(pair.first, pair.second);
@@ -385,18 +391,26 @@ std::vector<std::string> TensorMap::keys() const
 {
     std::vector<std::string> key_names;
     for (auto& kv : tensor_map_) {
-        key_names.push_back(kv.first);
+        key_names.push_back(kv.first.str());
     }
     return key_names;
 }
 
+std::unordered_map<std::string, Tensor> TensorMap::getMap() const
+{
+    std::unordered_map<std::string, Tensor> tensor_map;
+    for (auto& kv : tensor_map_) {
+        tensor_map.insert({kv.first.str(), kv.second});
+    }
+    return tensor_map;
+}
+
 std::string TensorMap::toString()
 {
     std::stringstream ss;
     ss << "{";
-    std::vector<std::string> key_names = keys();
     for (size_t i = 0; i < tensor_map_.size(); ++i) {
-        ss << key_names[i] << ": " << at(key_names[i]).toString();
+        ss << tensor_map_[i].first.c_str() << ": " << tensor_map_[i].second.toString();
         if (i < tensor_map_.size() - 1) {
             ss << ", ";
         }
@@ -437,7 +451,7 @@ TensorMap TensorMap::fromNpyFolder(const std::string& base_folder)
         }
         std::string key = filename.substr(pos + 1, len - pos - 5);
 
-        ret_tensor.tensor_map_.insert({key, Tensor::loadNpy(base_folder + "/" + filename, where)});
+        ret_tensor.insert({key, Tensor::loadNpy(base_folder + "/" + filename, where)});
     }
 
     closedir(dir_p);
@@ -452,7 +466,7 @@ void TensorMap::saveNpy(const std::string& base_folder)
     FT_CHECK_WITH_INFO(ret == 0 || errno == EEXIST, fmtstr("Could not create folder %s.\n", base_folder.c_str()));
 
     for (const auto& item : tensor_map_) {
-        item.second.saveNpy(base_folder + "/" + item.second.whereToString() + "-" + item.first + ".npy");
+        item.second.saveNpy(base_folder + "/" + item.second.whereToString() + "-" + item.first.str() + ".npy");
     }
 }
 
@@ -20,11 +20,15 @@
 #include "src/fastertransformer/utils/cuda_fp8_utils.h"
 #include "src/fastertransformer/utils/cuda_utils.h"
 #include "src/fastertransformer/utils/string_utils.h"
+#include "src/fastertransformer/utils/tensor_key.h"
 
 #include "stdlib.h"
+#include <algorithm>
 #include <cuda_fp16.h>
 #include <cuda_runtime_api.h>
 #include <dirent.h>
+#include <initializer_list>
+#include <memory>
 #include <numeric>
 #include <stdlib.h>
 #include <string>
@@ -104,18 +108,157 @@ typedef enum memorytype_enum {
     MEMORY_GPU
 } MemoryType;
 
+// The shape of a tensor. Up to kInlineDims dimensions are stored inline, so creating, copying and slicing tensors
+// does not allocate. It converts to and from std::vector<size_t>.
+class TensorShape {
+public:
+    static constexpr size_t kInlineDims = 8;
+
+    typedef size_t        value_type;
+    typedef size_t*       iterator;
+    typedef const size_t* const_iterator;
+
+    TensorShape() = default;
+    TensorShape(std::initializer_list<size_t> dims)
+    {
+        assign(dims.begin(), dims.size());
+    }
+    TensorShape(const std::vector<size_t>& dims)
+    {
+        assign(dims.data(), dims.size());
+    }
+    TensorShape(const size_t* first, const size_t* last)
+    {
+        assign(first, last - first);
+    }
+    TensorShape(const TensorShape& other)
+    {
+        assign(other.data(), other.size_);
+    }
+    TensorShape& operator=(const TensorShape& other)
+    {
+        if (this != &other) {
+            assign(other.data(), other.size_);
+        }
+        return *this;
+    }
+
+    size_t size() const
+    {
+        return size_;
+    }
+    bool empty() const
+    {
+        return size_ == 0;
+    }
+    size_t* data()
+    {
+        return heap_dims_ ? heap_dims_.get() : inline_dims_;
+    }
+    const size_t* data() const
+    {
+        return heap_dims_ ? heap_dims_.get() : inline_dims_;
+    }
+    size_t* begin()
+    {
+        return data();
+    }
+    size_t* end()
+    {
+        return data() + size_;
+    }
+    const size_t* begin() const
+    {
+        return data();
+    }
+    const size_t* end() const
+    {
+        return data() + size_;
+    }
+    size_t& operator[](size_t i)
+    {
+        return data()[i];
+    }
+    size_t operator[](size_t i) const
+    {
+        return data()[i];
+    }
+    size_t front() const
+    {
+        return data()[0];
+    }
+    size_t back() const
+    {
+        return data()[size_ - 1];
+    }
+
+    void push_back(size_t dim)
+    {
+        if (size_ == capacity()) {
+            grow(2 * size_);
+        }
+        data()[size_++] = dim;
+    }
+
+    operator std::vector<size_t>() const
+    {
+        return std::vector<size_t>(begin(), end());
+    }
+
+    friend bool operator==(const TensorShape& a, const TensorShape& b)
+    {
+        return a.size_ == b.size_ && std::equal(a.begin(), a.end(), b.begin());
+    }
+    friend bool operator!=(const TensorShape& a, const TensorShape& b)
+    {
+        return !(a == b);
+    }
+
+private:
+    size_t capacity() const
+    {
+        return heap_dims_ ? heap_capacity_ : kInlineDims;
+    }
+    void grow(size_t capacity)
+    {
+        std::unique_ptr<size_t[]> dims(new size_t[capacity]);
+        std::copy(begin(), end(), dims.get());
+        heap_dims_     = std::move(dims);
+        heap_capacity_ = capacity;
+    }
+    void assign(const size_t* dims, size_t size)
+    {
+        if (size > capacity()) {
+            heap_dims_.reset(new size_t[size]);
+            heap_capacity_ = size;
+        }
+        std::copy(dims, dims + size, data());
+        size_ = size;
+    }
+
+    size_t                    size_ = 0;
+    size_t                    inline_dims_[kInlineDims];
+    std::unique_ptr<size_t[]> heap_dims_;
+    size_t                    heap_capacity_ = 0;
+};
+
+inline std::string vec2str(const TensorShape& shape)
+{
+    return vec2str(std::vector<size_t>(shape));
+}
+
 struct Tensor {
     const MemoryType          where;
     const DataType            type;
-    const std::vector<size_t> shape;
+    const TensorShape         shape;
     const void*               data;  // TODO(bhseuh) modify from const void* to void* const
     const std::vector<size_t> offsets = std::vector<size_t>{};
 
     Tensor();
-    Tensor(const MemoryType _where, const DataType _type, const std::vector<size_t> _shape, const void* _data);
+    Tensor(const MemoryType _where, const DataType _type, const TensorShape& _shape, const void* _data);
     Tensor(const MemoryType          _where,
            const DataType            _type,
-           const std::vector<size_t> _shape,
+           const TensorShape&        _shape,
            const void*               _data,
            const std::vector<size_t> _offset);
 
@@ -290,28 +433,59 @@ struct Tensor {
     void updateShape(size_t idx, size_t val)
     {
         // TODO: find a better way to update the shape
-        std::vector<size_t>& shape_ref = const_cast<std::vector<size_t>&>(shape);
-        shape_ref[idx]                 = val;
+        TensorShape& shape_ref = const_cast<TensorShape&>(shape);
+        shape_ref[idx]         = val;
     }
 
-    Tensor slice(std::vector<size_t> shape, size_t offset = 0) const;
+    Tensor slice(const TensorShape& shape, size_t offset = 0) const;
 
 private:
     static void parseNpyIntro(FILE*& f_ptr, uint32_t& header_len, uint32_t& start_data);
     static int  parseNpyHeader(FILE*& f_ptr, uint32_t header_len, DataType& type, std::vector<size_t>& shape);
 };
 
+// A small map of named tensors, stored flat in insertion order. Lookups scan the entries, comparing static keys by
+// id (see tensor_key.h), or names as strings for the std::string API.
+//
+// Unlike the std::unordered_map it replaces, inserting may invalidate the references returned by at(), as for a
+// std::vector: copy the Tensor instead of holding a Tensor& across an insert into the same map. The first
+// kReservedTensors insertions never reallocate.
 class TensorMap {
 private:
-    std::unordered_map<std::string, Tensor> tensor_map_;
+    static constexpr size_t kReservedTensors = 16;
+
+    std::vector<std::pair<TensorKey, Tensor>> tensor_map_;
 
     inline bool isValid(const Tensor& tensor)
     {
         return tensor.size() > 0 && tensor.data != nullptr;
     }
 
+    inline int find(const TensorKeyRef& key) const
+    {
+        for (size_t i = 0; i < tensor_map_.size(); i++) {
+            if (key.matches(tensor_map_[i].first)) {
+                return (int)i;
+            }
+        }
+        return -1;
+    }
+
+    inline size_t findOrThrow(const TensorKeyRef& key) const
+    {
+        const int i = find(key);
+        FT_CHECK_WITH_INFO(i >= 0,
+                           fmtstr("Cannot find a tensor of name %s in the tensor map (keys: %s)",
+                                  key.c_str(),
+                                  vec2str(keys()).c_str()));
+        return (size_t)i;
+    }
+
 public:
-    TensorMap() = default;
+    TensorMap()
+    {
+        tensor_map_.reserve(kReservedTensors);
+    }
     TensorMap(const std::unordered_map<std::string, Tensor>& tensor_map);
     TensorMap(const std::vector<Tensor>& tensor_map);
     TensorMap(std::initializer_list<std::pair<std::string, Tensor>> tensor_map);
@@ -322,178 +496,140 @@ public:
         return tensor_map_.size();
     }
 
-    inline bool isExist(const std::string& key) const
+    inline bool isExist(const TensorKeyRef& key) const
     {
         FT_LOG_DEBUG("%s for key: %s", __PRETTY_FUNCTION__, key.c_str());
-        return tensor_map_.find(key) != tensor_map_.end();
+        return find(key) >= 0;
     }
 
     std::vector<std::string> keys() const;
 
-    inline void insert(const std::string& key, const Tensor& value)
+    inline void insert(const TensorKeyRef& key, const Tensor& value)
     {
         FT_CHECK_WITH_INFO(!isExist(key), fmtstr("Duplicated key %s", key.c_str()));
         FT_CHECK_WITH_INFO(isValid(value), fmtstr("A none tensor or nullptr is not allowed (key is %s)", key.c_str()));
-        tensor_map_.insert({key, value});
+        tensor_map_.emplace_back(key.toKey(), value);
     }
 
-    inline void insertIfValid(const std::string& key, const Tensor& value)
+    // Skips an invalid tensor, and keeps the existing tensor if the key is already in the map.
+    inline void insertIfValid(const TensorKeyRef& key, const Tensor& value)
     {
-        if (isValid(value)) {
-            insert({key, value});
+        if (isValid(value) && !isExist(key)) {
+            tensor_map_.emplace_back(key.toKey(), value);
         }
     }
 
+    // Keeps the existing tensor if the key is already in the map.
     inline void insert(std::pair<std::string, Tensor> p)
     {
-        tensor_map_.insert(p);
+        if (!isExist(p.first)) {
+            tensor_map_.emplace_back(TensorKey(p.first), p.second);
+        }
     }
 
     // prevent converting int or size_t to string automatically
     Tensor at(int tmp)    = delete;
     Tensor at(size_t tmp) = delete;
 
-    inline Tensor& at(const std::string& key)
+    // The reference is invalidated by a later insert, see above.
+    inline Tensor& at(const TensorKeyRef& key)
     {
         FT_LOG_DEBUG("%s for key %s", __PRETTY_FUNCTION__, key.c_str());
-        FT_CHECK_WITH_INFO(isExist(key),
-                           fmtstr("Cannot find a tensor of name %s in the tensor map (keys: %s)",
-                                  key.c_str(),
-                                  vec2str(keys()).c_str()));
-        return tensor_map_.at(key);
+        return tensor_map_[findOrThrow(key)].second;
     }
 
-    inline Tensor at(const std::string& key) const
+    inline Tensor at(const TensorKeyRef& key) const
     {
-        FT_CHECK_WITH_INFO(isExist(key),
-                           fmtstr("Cannot find a tensor of name %s in the tensor map (keys: %s)",
-                                  key.c_str(),
-                                  vec2str(keys()).c_str()));
-        return tensor_map_.at(key);
+        return tensor_map_[findOrThrow(key)].second;
     }
 
-    inline Tensor& at(const std::string& key, Tensor& default_tensor)
+    inline Tensor& at(const TensorKeyRef& key, Tensor& default_tensor)
     {
         FT_LOG_DEBUG("%s for key %s", __PRETTY_FUNCTION__, key.c_str());
-        if (isExist(key)) {
-            return tensor_map_.at(key);
-        }
-        return default_tensor;
+        const int i = find(key);
+        return i >= 0 ? tensor_map_[i].second : default_tensor;
     }
 
-    inline Tensor at(const std::string& key, Tensor& default_tensor) const
+    inline Tensor at(const TensorKeyRef& key, Tensor& default_tensor) const
     {
         FT_LOG_DEBUG("%s for key %s", __PRETTY_FUNCTION__, key.c_str());
-        if (isExist(key)) {
-            return tensor_map_.at(key);
-        }
-        return default_tensor;
+        const int i = find(key);
+        return i >= 0 ? tensor_map_[i].second : default_tensor;
     }
 
-    inline Tensor& at(const std::string& key, Tensor&& default_tensor)
+    inline Tensor& at(const TensorKeyRef& key, Tensor&& default_tensor)
     {
         FT_LOG_DEBUG("%s for key %s", __PRETTY_FUNCTION__, key.c_str());
-        if (isExist(key)) {
-            return tensor_map_.at(key);
-        }
-        return default_tensor;
+        const int i = find(key);
+        return i >= 0 ? tensor_map_[i].second : default_tensor;
     }
 
-    inline Tensor at(const std::string& key, Tensor&& default_tensor) const
+    inline Tensor at(const TensorKeyRef& key, Tensor&& default_tensor) const
     {
-        if (isExist(key)) {
-            return tensor_map_.at(key);
-        }
-        return default_tensor;
+        const int i = find(key);
+        return i >= 0 ? tensor_map_[i].second : default_tensor;
     }
 
     template<typename T>
-    inline T getVal(const std::string& key) const
+    inline T getVal(const TensorKeyRef& key) const
     {
-        FT_CHECK_WITH_INFO(isExist(key),
-                           fmtstr("Cannot find a tensor of name %s in the tensor map (keys: %s)",
-                                  key.c_str(),
-                                  vec2str(keys()).c_str()));
-        return tensor_map_.at(key).getVal<T>();
+        return tensor_map_[findOrThrow(key)].second.getVal<T>();
     }
 
     template<typename T>
-    inline T getVal(const std::string& key, T default_value) const
+    inline T getVal(const TensorKeyRef& key, T default_value) const
     {
-        if (isExist(key)) {
-            return tensor_map_.at(key).getVal<T>();
-        }
-        return default_value;
+        const int i = find(key);
+        return i >= 0 ? tensor_map_[i].second.getVal<T>() : default_value;
     }
 
     template<typename T>
-    inline T getValWithOffset(const std::string& key, size_t index) const
+    inline T getValWithOffset(const TensorKeyRef& key, size_t index) const
     {
-        FT_CHECK_WITH_INFO(isExist(key),
-                           fmtstr("Cannot find a tensor of name %s in the tensor map (keys: %s)",
-                                  key.c_str(),
-                                  vec2str(keys()).c_str()));
-        return tensor_map_.at(key).getVal<T>(index);
+        return tensor_map_[findOrThrow(key)].second.getVal<T>(index);
     }
 
     template<typename T>
-    inline T getValWithOffset(const std::string& key, size_t index, T default_value) const
+    inline T getValWithOffset(const TensorKeyRef& key, size_t index, T default_value) const
     {
-        if (isExist(key)) {
-            return tensor_map_.at(key).getVal<T>(index);
-        }
-        return default_value;
+        const int i = find(key);
+        return i >= 0 ? tensor_map_[i].second.getVal<T>(index) : default_value;
     }
 
     template<typename T>
-    inline T* getPtr(const std::string& key) const
+    inline T* getPtr(const TensorKeyRef& key) const
     {
-        FT_CHECK_WITH_INFO(isExist(key),
-                           fmtstr("Cannot find a tensor of name %s in the tensor map (keys: %s)",
-                                  key.c_str(),
-                                  vec2str(keys()).c_str()));
-        return tensor_map_.at(key).getPtr<T>();
+        return tensor_map_[findOrThrow(key)].second.getPtr<T>();
     }
 
     template<typename T>
-    inline T* getPtr(const std::string& key, T* default_ptr) const
+    inline T* getPtr(const TensorKeyRef& key, T* default_ptr) const
     {
-        if (isExist(key)) {
-            return tensor_map_.at(key).getPtr<T>();
-        }
-        return default_ptr;
+        const int i = find(key);
+        return i >= 0 ? tensor_map_[i].second.getPtr<T>() : default_ptr;
     }
 
     template<typename T>
-    inline T* getPtrWithOffset(const std::string& key, size_t index) const
+    inline T* getPtrWithOffset(const TensorKeyRef& key, size_t index) const
     {
-        FT_CHECK_WITH_INFO(isExist(key),
-                           fmtstr("Cannot find a tensor of name %s in the tensor map (keys: %s)",
-                                  key.c_str(),
-                                  vec2str(keys()).c_str()));
-        return tensor_map_.at(key).getPtrWithOffset<T>(index);
+        return tensor_map_[findOrThrow(key)].second.getPtrWithOffset<T>(index);
     }
 
     template<typename T>
-    inline T* getPtrWithOffset(const std::string& key, size_t index, T* default_ptr) const
+    inline T* getPtrWithOffset(const TensorKeyRef& key, size_t index, T* default_ptr) const
     {
-        if (isExist(key)) {
-            return tensor_map_.at(key).getPtrWithOffset<T>(index);
-        }
-        return default_ptr;
+        const int i = find(key);
+        return i >= 0 ? tensor_map_[i].second.getPtrWithOffset<T>(index) : default_ptr;
     }
 
-    inline std::unordered_map<std::string, Tensor> getMap() const
-    {
-        return tensor_map_;
-    }
+    std::unordered_map<std::string, Tensor> getMap() const;
 
-    inline std::unordered_map<std::string, Tensor>::iterator begin()
+    inline std::vector<std::pair<TensorKey, Tensor>>::iterator begin()
     {
         return tensor_map_.begin();
     }
 
-    inline std::unordered_map<std::string, Tensor>::iterator end()
+    inline std::vector<std::pair<TensorKey, Tensor>>::iterator end()
     {
         return tensor_map_.end();
     }
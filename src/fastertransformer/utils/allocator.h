@@ -20,7 +20,11 @@
 #pragma once
 
 #include "cuda_utils.h"
+#include "src/fastertransformer/utils/caching_allocator.h"
+#include <cstdlib>
+#include <cstring>
 #include <cuda_runtime.h>
+#include <string>
 #include <unordered_map>
 #include <vector>
 
@@ -52,7 +56,8 @@ namespace fastertransformer {
 enum class AllocatorType {
     CUDA,
     TF,
-    TH
+    TH,
+    CPU
 };
 
 enum class ReallocType {
@@ -119,24 +124,88 @@ protected:
 template<AllocatorType AllocType_>
 class Allocator;
 
+// Device memory for CachingAllocator, from the stream-ordered memory pool when it is available.
+class CudaBlockBackend: public IBlockBackend {
+public:
+    explicit CudaBlockBackend(int device_id): device_id_(device_id) {}
+
+    void* allocate(size_t size, cudaStream_t stream) override
+    {
+        void* ptr      = nullptr;
+        int   o_device = 0;
+        check_cuda_error(getSetDevice(device_id_, &o_device));
+#if defined(CUDA_MEMORY_POOL_DISABLED)
+        cudaError_t result = cudaMalloc(&ptr, size);
+#else
+        cudaError_t result = cudaMallocAsync(&ptr, size, stream);
+#endif
+        check_cuda_error(getSetDevice(o_device));
+        if (result == cudaErrorMemoryAllocation) {
+            cudaGetLastError();  // clear the error, the caller releases its cached blocks and retries
+            return nullptr;
+        }
+        check_cuda_error(result);
+        return ptr;
+    }
+
+    void deallocate(void* ptr, size_t size, cudaStream_t stream) override
+    {
+        int o_device = 0;
+        check_cuda_error(getSetDevice(device_id_, &o_device));
+#if defined(CUDA_MEMORY_POOL_DISABLED)
+        check_cuda_error(cudaFree(ptr));
+#else
+        if (is_synchronous_) {
+            check_cuda_error(cudaFree(ptr));
+        }
+        else {
+            check_cuda_error(cudaFreeAsync(ptr, stream));
+        }
+#endif
+        check_cuda_error(getSetDevice(o_device));
+    }
+
+    // Frees with cudaFree from now on, so that blocks can be released after their stream is destroyed.
+    void setSynchronous()
+    {
+        is_synchronous_ = true;
+    }
+
+private:
+    const int device_id_;
+    bool      is_synchronous_ = false;
+};
+
+// FT_CUDA_CACHING_ALLOCATOR=ON keeps the freed device buffers for reuse instead of giving them back to the memory
+// pool right away. Off by default, since the layers with is_free_buffer_after_forward would then keep their memory.
+inline bool isCudaCachingAllocatorEnabled()
+{
+    static char* env = std::getenv("FT_CUDA_CACHING_ALLOCATOR");
+    return env != nullptr && std::string(env) == "ON";
+}
+
 template<>
 class Allocator<AllocatorType::CUDA>: public IAllocator {
 private:
-    const int                          device_id_;
-    cudaStream_t                       stream_ = 0;  // initialize as default stream
-    std::unordered_map<void*, size_t>* pointer_mapping_;
+    const int                                 device_id_;
+    cudaStream_t                              stream_ = 0;  // initialize as default stream
+    CudaBlockBackend                          backend_;
+    mutable CachingAllocator                  cache_;          // device buffers
+    mutable std::unordered_map<void*, size_t> host_pointers_;  // pinned host buffers
 
     bool isExist(void* address) const
     {
-        return pointer_mapping_->count(address) > 0;
+        return host_pointers_.count(address) > 0 || cache_.isExist(address);
     }
     ReallocType isReMalloc(void* address, size_t size) const
     {
         FT_CHECK(isExist(address));
-        if (pointer_mapping_->at(address) < size) {
+        const size_t current_size =
+            host_pointers_.count(address) > 0 ? host_pointers_.at(address) : cache_.getSize(address);
+        if (current_size < size) {
             return ReallocType::INCREASE;
         }
-        else if (pointer_mapping_->at(address) == size) {
+        else if (current_size == size) {
             return ReallocType::REUSE;
         }
         else {
@@ -145,10 +214,10 @@ private:
     }
 
 public:
-    Allocator(int device_id): device_id_(device_id)
+    Allocator(int device_id):
+        device_id_(device_id), backend_(device_id), cache_(&backend_, isCudaCachingAllocatorEnabled())
     {
         FT_LOG_DEBUG(__PRETTY_FUNCTION__);
-        pointer_mapping_ = new std::unordered_map<void*, size_t>();
 #if defined(CUDA_MEMORY_POOL_DISABLED)
         FT_LOG_WARNING(
             "Async cudaMalloc/Free is not supported before CUDA 11.2. Using Sync cudaMalloc/Free."
@@ -184,10 +253,11 @@ public:
     virtual ~Allocator()
     {
         FT_LOG_DEBUG(__PRETTY_FUNCTION__);
-        while (!pointer_mapping_->empty()) {
-            free((void**)(&pointer_mapping_->begin()->first));
+        while (!host_pointers_.empty()) {
+            free((void**)(&host_pointers_.begin()->first), true);
         }
-        delete pointer_mapping_;
+        // The streams of the cached blocks may already be destroyed: cache_ releases its blocks with cudaFree.
+        backend_.setSynchronous();
     }
 
     void setStream(cudaStream_t stream)
@@ -212,13 +282,10 @@ public:
         check_cuda_error(getSetDevice(device_id_, &o_device));
         if (is_host) {
             check_cuda_error(cudaMallocHost(&ptr, (size_t)(ceil(size / 32.)) * 32));
+            host_pointers_.insert({getAddress(ptr), size});
         }
         else {
-#if defined(CUDA_MEMORY_POOL_DISABLED)
-            check_cuda_error(cudaMalloc(&ptr, (size_t)(ceil(size / 32.)) * 32));
-#else
-            check_cuda_error(cudaMallocAsync(&ptr, (size_t)(ceil(size / 32.)) * 32, stream_));
-#endif
+            ptr = cache_.malloc((size_t)(ceil(size / 32.)) * 32, stream_);
         }
         if (is_set_zero) {
             check_cuda_error(cudaMemsetAsync(ptr, 0, (size_t)(ceil(size / 32.)) * 32, stream_));
@@ -226,8 +293,6 @@ public:
         check_cuda_error(getSetDevice(o_device));
         FT_LOG_DEBUG("malloc buffer %p with size %ld", ptr, size);
 
-        pointer_mapping_->insert({getAddress(ptr), size});
-
         return ptr;
     }
 
@@ -237,22 +302,23 @@ public:
         void* address = getAddress(*ptr);
         if (*ptr != nullptr) {
             int o_device = 0;
-            if (pointer_mapping_->count(address)) {
+            if (host_pointers_.count(address)) {
                 FT_LOG_DEBUG("Free buffer %p", address);
                 check_cuda_error(getSetDevice(device_id_, &o_device));
-                if (is_host) {
-                    check_cuda_error(cudaFreeHost(*ptr));
-                }
-                else {
-#if defined(CUDA_MEMORY_POOL_DISABLED)
-                    check_cuda_error(cudaFree(*ptr));
-#else
-                    check_cuda_error(cudaFreeAsync(*ptr, stream_));
+                check_cuda_error(cudaFreeHost(*ptr));
+                check_cuda_error(getSetDevice(o_device));
+                host_pointers_.erase(address);
+            }
+            else if (cache_.isExist(address)) {
+                FT_LOG_DEBUG("Free buffer %p", address);
+                // The cached buffer is only reused by later work on stream_, which runs after the pending work on
+                // it, so there is no need to synchronize unless the buffer goes back to the memory pool.
+                cache_.free(*ptr, stream_);
+#if !defined(CUDA_MEMORY_POOL_DISABLED)
+                if (!isCudaCachingAllocatorEnabled()) {
                     cudaStreamSynchronize(stream_);
-#endif
                 }
-                check_cuda_error(getSetDevice(o_device));
-                pointer_mapping_->erase(address);
+#endif
             }
             else {
                 FT_LOG_WARNING("pointer_mapping_ does not have information of ptr at %p.", address);
@@ -266,6 +332,268 @@ public:
     {
         check_cuda_error(cudaMemsetAsync(ptr, val, size, stream_));
     }
+
+    // Allocated, reserved and cached bytes of the device buffers, with their high-water marks.
+    CachingAllocatorStats getCacheStats() const
+    {
+        return cache_.getStats();
+    }
+
+    void resetCachePeakStats()
+    {
+        cache_.resetPeakStats();
+    }
+
+    // Gives the cached device buffers back to the memory pool until at most max_cached_bytes stay cached, and
+    // returns the number of released bytes.
+    size_t trimCache(size_t max_cached_bytes = 0)
+    {
+        return cache_.trim(max_cached_bytes);
+    }
+};
+
+// Page-locked host memory for CachingAllocator.
+class PinnedBlockBackend: public IBlockBackend {
+public:
+    void* allocate(size_t size, cudaStream_t stream) override
+    {
+        void*       ptr    = nullptr;
+        cudaError_t result = cudaMallocHost(&ptr, size);
+        if (result == cudaErrorMemoryAllocation) {
+            cudaGetLastError();
+            return nullptr;
+        }
+        check_cuda_error(result);
+        return ptr;
+    }
+
+    void deallocate(void* ptr, size_t size, cudaStream_t stream) override
+    {
+        check_cuda_error(cudaFreeHost(ptr));
+    }
+};
+
+enum class CpuAllocatorMode {
+    ARENA,        // bump allocation from large chunks, everything is released at once by reset()
+    PINNED_POOL,  // page-locked buffers cached for reuse, for the copies between host and device
+};
+
+// Host memory allocator, every buffer is on the host whatever is_host says.
+//
+// In ARENA mode, the buffers are carved out of large heap chunks by bumping an offset: malloc() costs a few
+// instructions and free() only forgets the buffer, its memory comes back when reset() releases all the buffers at
+// once. reset() also merges the chunks into one large enough for the next round, so that the scratch buffers of a
+// forward pass only hit the heap while the arena grows.
+//
+// In PINNED_POOL mode, the page-locked buffers are kept by a CachingAllocator, as cudaMallocHost and cudaFreeHost are
+// slow and synchronize the whole device. The host may write to a reused buffer right away, so free() waits for the
+// pending copies on the stream before the buffer is cached.
+template<>
+class Allocator<AllocatorType::CPU>: public IAllocator {
+private:
+    struct Chunk {
+        void*  base;  // as returned by std::malloc
+        char*  data;  // base rounded up to the alignment
+        size_t size;
+    };
+
+    const CpuAllocatorMode mode_;
+    const size_t           alignment_;
+    const size_t           chunk_size_;
+    cudaStream_t           stream_ = 0;
+
+    // ARENA mode
+    std::vector<Chunk>                        chunks_;
+    size_t                                    chunk_id_ = 0;  // chunk the next buffer is carved from
+    size_t                                    offset_   = 0;  // in chunks_[chunk_id_]
+    mutable std::unordered_map<void*, size_t> arena_pointers_;
+    mutable CachingAllocatorStats             arena_stats_;
+
+    // PINNED_POOL mode
+    PinnedBlockBackend       pinned_backend_;
+    mutable CachingAllocator pinned_cache_;
+
+    bool isExist(void* address) const
+    {
+        return mode_ == CpuAllocatorMode::ARENA ? arena_pointers_.count(address) > 0 : pinned_cache_.isExist(address);
+    }
+    ReallocType isReMalloc(void* address, size_t size) const
+    {
+        FT_CHECK(isExist(address));
+        const size_t current_size =
+            mode_ == CpuAllocatorMode::ARENA ? arena_pointers_.at(address) : pinned_cache_.getSize(address);
+        if (current_size < size) {
+            return ReallocType::INCREASE;
+        }
+        else if (current_size == size) {
+            return ReallocType::REUSE;
+        }
+        else {
+            return ReallocType::DECREASE;
+        }
+    }
+
+    void addChunk(size_t size)
+    {
+        Chunk chunk;
+        chunk.size = size;
+        chunk.base = std::malloc(size + alignment_);
+        FT_CHECK_WITH_INFO(chunk.base != nullptr, fmtstr("Out of host memory: cannot allocate %ld bytes.", size));
+        chunk.data = (char*)(((uintptr_t)chunk.base + alignment_ - 1) / alignment_ * alignment_);
+        chunks_.push_back(chunk);
+        arena_stats_.num_backend_allocs++;
+        arena_stats_.reserved_bytes += size;
+        arena_stats_.peak_reserved_bytes = std::max(arena_stats_.peak_reserved_bytes, arena_stats_.reserved_bytes);
+    }
+
+    void freeChunks()
+    {
+        for (auto& chunk : chunks_) {
+            std::free(chunk.base);
+            arena_stats_.num_backend_frees++;
+        }
+        chunks_.clear();
+        arena_stats_.reserved_bytes = 0;
+        chunk_id_                   = 0;
+        offset_                     = 0;
+    }
+
+    void* arenaMalloc(size_t size)
+    {
+        size = (size + alignment_ - 1) / alignment_ * alignment_;
+        while (chunk_id_ < chunks_.size() && offset_ + size > chunks_[chunk_id_].size) {
+            chunk_id_++;
+            offset_ = 0;
+        }
+        if (chunk_id_ == chunks_.size()) {
+            addChunk(std::max(size, chunk_size_));
+        }
+        void* ptr = chunks_[chunk_id_].data + offset_;
+        offset_ += size;
+        return ptr;
+    }
+
+public:
+    // alignment has to be a power of two. cudaMallocHost aligns the pinned buffers to at least 256 bytes.
+    Allocator(CpuAllocatorMode mode = CpuAllocatorMode::ARENA, size_t alignment = 64, size_t chunk_size = 64 << 20):
+        mode_(mode), alignment_(alignment), chunk_size_(chunk_size), pinned_cache_(&pinned_backend_)
+    {
+        FT_LOG_DEBUG(__PRETTY_FUNCTION__);
+        FT_CHECK_WITH_INFO(alignment > 0 && (alignment & (alignment - 1)) == 0,
+                           fmtstr("The alignment %ld is not a power of two.", alignment));
+    }
+
+    virtual ~Allocator()
+    {
+        FT_LOG_DEBUG(__PRETTY_FUNCTION__);
+        freeChunks();
+    }
+
+    void setStream(cudaStream_t stream)
+    {
+        stream_ = stream;
+    }
+
+    cudaStream_t returnStream()
+    {
+        return stream_;
+    };
+
+    CpuAllocatorMode getMode() const
+    {
+        return mode_;
+    }
+
+    void* malloc(size_t size, const bool is_set_zero = true, bool is_host = false)
+    {
+        FT_LOG_DEBUG(__PRETTY_FUNCTION__);
+        if (size == 0) {
+            return nullptr;
+        }
+        void* ptr = nullptr;
+        if (mode_ == CpuAllocatorMode::ARENA) {
+            ptr                  = arenaMalloc(size);
+            arena_pointers_[ptr] = size;
+            arena_stats_.num_allocs++;
+            arena_stats_.allocated_bytes += size;
+            arena_stats_.peak_allocated_bytes =
+                std::max(arena_stats_.peak_allocated_bytes, arena_stats_.allocated_bytes);
+        }
+        else {
+            ptr = pinned_cache_.malloc(size, stream_);
+        }
+        FT_CHECK_WITH_INFO((uintptr_t)ptr % alignment_ == 0,
+                           fmtstr("The host buffer %p is not aligned to %ld bytes.", ptr, alignment_));
+        if (is_set_zero) {
+            memSet(ptr, 0, size);
+        }
+        FT_LOG_DEBUG("malloc host buffer %p with size %ld", ptr, size);
+        return ptr;
+    }
+
+    void free(void** ptr, bool is_host = false) const
+    {
+        FT_LOG_DEBUG(__PRETTY_FUNCTION__);
+        void* address = getAddress(*ptr);
+        if (*ptr != nullptr) {
+            if (!isExist(address)) {
+                FT_LOG_WARNING("Allocator<AllocatorType::CPU> does not have information of ptr at %p.", address);
+            }
+            else if (mode_ == CpuAllocatorMode::ARENA) {
+                FT_LOG_DEBUG("Free host buffer %p", address);
+                arena_stats_.allocated_bytes -= arena_pointers_.at(address);
+                arena_pointers_.erase(address);
+            }
+            else {
+                FT_LOG_DEBUG("Free host buffer %p", address);
+                check_cuda_error(cudaStreamSynchronize(stream_));
+                pinned_cache_.free(*ptr, stream_);
+            }
+        }
+        *ptr = nullptr;
+        return;
+    }
+
+    void memSet(void* ptr, const int val, const size_t size)
+    {
+        std::memset(ptr, val, size);
+    }
+
+    // ARENA mode: invalidates all the buffers. If the last round needed more than one chunk, they are replaced by a
+    // single chunk of their total size.
+    void reset()
+    {
+        FT_CHECK(mode_ == CpuAllocatorMode::ARENA);
+        arena_pointers_.clear();
+        arena_stats_.allocated_bytes = 0;
+        if (chunks_.size() > 1) {
+            const size_t total_size = arena_stats_.reserved_bytes;
+            freeChunks();
+            addChunk(total_size);
+        }
+        chunk_id_ = 0;
+        offset_   = 0;
+    }
+
+    // PINNED_POOL mode: gives the cached buffers back until at most max_cached_bytes stay cached, and returns the
+    // number of released bytes.
+    size_t trimCache(size_t max_cached_bytes = 0)
+    {
+        return mode_ == CpuAllocatorMode::ARENA ? 0 : pinned_cache_.trim(max_cached_bytes);
+    }
+
+    // In ARENA mode, the reserved bytes are the chunks and a new chunk counts as a backend allocation.
+    CachingAllocatorStats getStats() const
+    {
+        return mode_ == CpuAllocatorMode::ARENA ? arena_stats_ : pinned_cache_.getStats();
+    }
+
+    void resetPeakStats()
+    {
+        arena_stats_.peak_allocated_bytes = arena_stats_.allocated_bytes;
+        arena_stats_.peak_reserved_bytes  = arena_stats_.reserved_bytes;
+        pinned_cache_.resetPeakStats();
+    }
 };
 
 #ifdef GOOGLE_CUDA
@@ -0,0 +1,801 @@
+/*
+ * Copyright (c) 2023, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/fastertransformer/utils/async_logger.h"
+#include "src/fastertransformer/utils/spsc_queue.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace fastertransformer {
+
+constexpr size_t LogRecord::kPayloadSize;
+
+void LogArgWriter::putInteger(LogArgType type, size_t size, uint64_t value)
+{
+    const size_t record_size = type == LOG_ARG_POINTER ? 1 + sizeof(value) : 2 + sizeof(value);
+    if (reserve(record_size)) {
+        char* p = buffer_ + size_;
+        *p++    = type;
+        if (type != LOG_ARG_POINTER) {
+            *p++ = (char)size;
+        }
+        std::memcpy(p, &value, sizeof(value));
+        size_ += record_size;
+    }
+}
+
+void LogArgWriter::putString(const char* value, size_t length)
+{
+    // A string too long for the record is cut, the rest of the arguments are dropped.
+    if (truncated_ || size_ + 3 > capacity_) {
+        truncated_ = true;
+        return;
+    }
+    const uint16_t stored_length = (uint16_t)std::min(length, std::min(capacity_ - size_ - 3, (size_t)UINT16_MAX));
+    buffer_[size_] = LOG_ARG_STRING;
+    std::memcpy(buffer_ + size_ + 1, &stored_length, sizeof(stored_length));
+    std::memcpy(buffer_ + size_ + 3, value, stored_length);
+    size_ += 3 + stored_length;
+    truncated_ = stored_length < length;
+}
+
+namespace {
+
+struct LogArg {
+    LogArgType  type;
+    size_t      size;  // of an integer
+    uint64_t    bits;
+    double      value;
+    const char* str;
+    size_t      length;
+};
+
+class LogArgReader {
+public:
+    LogArgReader(const char* args, size_t args_size): p_(args), end_(args + args_size) {}
+
+    bool next(LogArg* arg)
+    {
+        if (p_ >= end_) {
+            return false;
+        }
+        arg->type = (LogArgType)*p_++;
+        switch (arg->type) {
+            case LOG_ARG_INT:
+            case LOG_ARG_UINT:
+                arg->size = (uint8_t)*p_++;
+                return read(&arg->bits, sizeof(arg->bits));
+            case LOG_ARG_POINTER:
+                return read(&arg->bits, sizeof(arg->bits));
+            case LOG_ARG_DOUBLE:
+                return read(&arg->value, sizeof(arg->value));
+            case LOG_ARG_STRING: {
+                uint16_t length;
+                if (!read(&length, sizeof(length)) || p_ + length > end_) {
+                    return false;
+                }
+                arg->str    = p_;
+                arg->length = length;
+                p_ += length;
+                return true;
+            }
+            case LOG_ARG_UNKNOWN:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+private:
+    bool read(void* value, size_t size)
+    {
+        if (p_ + size > end_) {
+            return false;
+        }
+        std::memcpy(value, p_, size);
+        p_ += size;
+        return true;
+    }
+
+    const char* p_;
+    const char* end_;
+};
+
+int64_t signExtend(uint64_t bits, size_t size)
+{
+    if (size == 0 || size >= sizeof(bits)) {
+        return (int64_t)bits;
+    }
+    const int shift = 64 - 8 * (int)size;
+    return (int64_t)(bits << shift) >> shift;
+}
+
+uint64_t zeroExtend(uint64_t bits, size_t size)
+{
+    return size == 0 || size >= sizeof(bits) ? bits : bits & ((1ull << (8 * size)) - 1);
+}
+
+template<typename T>
+void appendFormatted(std::string* out, const std::string& spec, T value)
+{
+    char buffer[128];
+    int  length = snprintf(buffer, sizeof(buffer), spec.c_str(), value);
+    if (length < 0) {
+        return;
+    }
+    if ((size_t)length < sizeof(buffer)) {
+        out->append(buffer, length);
+        return;
+    }
+    std::vector<char> large(length + 1);
+    snprintf(large.data(), large.size(), spec.c_str(), value);
+    out->append(large.data(), length);
+}
+
+// Size of the integer argument a length modifier asks for, 0 for long double or unknown.
+size_t getLengthModifierSize(const std::string& modifier)
+{
+    if (modifier.empty()) {
+        return sizeof(int);
+    }
+    static const std::unordered_map<std::string, size_t> sizes = {{"hh", sizeof(char)},
+                                                                  {"h", sizeof(short)},
+                                                                  {"l", sizeof(long)},
+                                                                  {"ll", sizeof(long long)},
+                                                                  {"q", sizeof(long long)},
+                                                                  {"j", sizeof(intmax_t)},
+                                                                  {"z", sizeof(size_t)},
+                                                                  {"t", sizeof(ptrdiff_t)}};
+    auto                                                it    = sizes.find(modifier);
+    return it == sizes.end() ? 0 : it->second;
+}
+
+int64_t toSigned(const LogArg& arg, size_t modifier_size)
+{
+    switch (arg.type) {
+        case LOG_ARG_INT:
+        case LOG_ARG_UINT:
+            return signExtend(arg.bits, modifier_size == 0 ? arg.size : std::min(arg.size, modifier_size));
+        case LOG_ARG_DOUBLE:
+            return (int64_t)arg.value;
+        default:
+            return (int64_t)arg.bits;
+    }
+}
+
+uint64_t toUnsigned(const LogArg& arg, size_t modifier_size)
+{
+    switch (arg.type) {
+        case LOG_ARG_INT:
+        case LOG_ARG_UINT:
+            return zeroExtend(arg.bits, modifier_size == 0 ? arg.size : std::min(arg.size, modifier_size));
+        case LOG_ARG_DOUBLE:
+            return (uint64_t)arg.value;
+        default:
+            return arg.bits;
+    }
+}
+
+}  // namespace
+
+std::string formatLogMessage(const char* format, size_t format_length, const char* args, size_t args_size)
+{
+    LogArgReader reader(args, args_size);
+    std::string  out;
+    out.reserve(format_length + 64);
+
+    size_t i = 0;
+    while (i < format_length) {
+        const char c = format[i++];
+        if (c != '%') {
+            out += c;
+            continue;
+        }
+        if (i < format_length && format[i] == '%') {
+            out += '%';
+            i++;
+            continue;
+        }
+
+        // One conversion specification: flags, width, precision, length modifier and conversion. The length modifier
+        // is replaced by the one of the stored argument.
+        LogArg      arg;
+        std::string spec = "%";
+        while (i < format_length && std::strchr("-+ #0'", format[i]) != nullptr) {
+            spec += format[i++];
+        }
+        for (int field = 0; field < 2; field++) {
+            if (field == 1) {
+                if (i >= format_length || format[i] != '.') {
+                    break;
+                }
+                spec += format[i++];
+            }
+            if (i < format_length && format[i] == '*') {
+                i++;
+                spec += std::to_string(reader.next(&arg) ? (int)toSigned(arg, sizeof(int)) : 0);
+                continue;
+            }
+            while (i < format_length && format[i] >= '0' && format[i] <= '9') {
+                spec += format[i++];
+            }
+        }
+        std::string modifier;
+        while (i < format_length && std::strchr("hlLqjzt", format[i]) != nullptr) {
+            modifier += format[i++];
+        }
+        if (i >= format_length) {
+            out += spec + modifier;
+            break;
+        }
+        const char conversion = format[i++];
+        if (conversion == 'n') {
+            continue;
+        }
+        if (!reader.next(&arg)) {
+            out += "<?>";
+            continue;
+        }
+        const size_t modifier_size = getLengthModifierSize(modifier);
+        switch (conversion) {
+            case 'd':
+            case 'i':
+                if (arg.type == LOG_ARG_STRING || arg.type == LOG_ARG_UNKNOWN) {
+                    out += "<?>";
+                    break;
+                }
+                appendFormatted(&out, spec + "ll" + conversion, (long long)toSigned(arg, modifier_size));
+                break;
+            case 'u':
+            case 'o':
+            case 'x':
+            case 'X':
+                if (arg.type == LOG_ARG_STRING || arg.type == LOG_ARG_UNKNOWN) {
+                    out += "<?>";
+                    break;
+                }
+                appendFormatted(&out, spec + "ll" + conversion, (unsigned long long)toUnsigned(arg, modifier_size));
+                break;
+            case 'c':
+                appendFormatted(&out, spec + "c", (int)toSigned(arg, sizeof(char)));
+                break;
+            case 'e':
+            case 'E':
+            case 'f':
+            case 'F':
+            case 'g':
+            case 'G':
+            case 'a':
+            case 'A':
+                if (arg.type == LOG_ARG_STRING || arg.type == LOG_ARG_UNKNOWN) {
+                    out += "<?>";
+                    break;
+                }
+                appendFormatted(
+                    &out, spec + conversion, arg.type == LOG_ARG_DOUBLE ? arg.value : (double)toSigned(arg, 0));
+                break;
+            case 's':
+                if (arg.type != LOG_ARG_STRING) {
+                    out += "<?>";
+                    break;
+                }
+                appendFormatted(&out, spec + "s", std::string(arg.str, arg.length).c_str());
+                break;
+            case 'p':
+                appendFormatted(&out, spec + "p", (void*)(uintptr_t)arg.bits);
+                break;
+            default:
+                out += spec + modifier + conversion;
+                break;
+        }
+    }
+    return out;
+}
+
+std::atomic<bool> AsyncLogger::running_{false};
+
+namespace {
+
+const char* const kBinaryLogMagic   = "FTLOGBIN";
+const uint32_t    kBinaryLogVersion = 1;
+
+// Entries of a binary log, all in native byte order:
+//   kFormatEntry  format id (4 bytes), length (2 bytes), characters
+//   kRecordEntry  format id (4 bytes), LogRecordHeader, arguments
+//   kDroppedEntry thread id (4 bytes), number of records dropped since the last kDroppedEntry of the thread (8 bytes)
+const char kFormatEntry  = 'F';
+const char kRecordEntry  = 'R';
+const char kDroppedEntry = 'D';
+
+const char* getLevelName(int level)
+{
+    switch (level) {
+        case 0:
+            return "TRACE";
+        case 10:
+            return "DEBUG";
+        case 20:
+            return "INFO";
+        case 30:
+            return "WARNING";
+        default:
+            return "ERROR";
+    }
+}
+
+std::string formatRecord(const LogRecordHeader& header, const char* format, const char* args)
+{
+    std::string line = std::string("[FT][") + getLevelName(header.level) + "]";
+    if (header.rank >= 0) {
+        line += "[" + std::to_string(header.rank) + "]";
+    }
+    line += " " + formatLogMessage(format, header.format_length, args, header.args_size);
+    if (header.flags & LOG_RECORD_TRUNCATED) {
+        line += " [truncated]";
+    }
+    return line + "\n";
+}
+
+std::string formatContext(const LogRecordHeader& header)
+{
+    const time_t seconds = (time_t)(header.timestamp_ns / 1000000000);
+    struct tm    local_time;
+    localtime_r(&seconds, &local_time);
+    char date[32];
+    strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", &local_time);
+    char context[64];
+    snprintf(context,
+             sizeof(context),
+             "[%s.%06u][thread %u]",
+             date,
+             (unsigned)(header.timestamp_ns % 1000000000 / 1000),
+             header.thread_id);
+    return context;
+}
+
+struct ThreadLogQueue {
+    ThreadLogQueue(size_t queue_size, uint32_t thread_id, uint64_t generation):
+        queue(queue_size), thread_id(thread_id), generation(generation)
+    {
+    }
+
+    SpscQueue<LogRecord>  queue;
+    const uint32_t        thread_id;
+    const uint64_t        generation;  // of the logger session the queue belongs to
+    std::atomic<uint64_t> num_dropped{0};
+    std::atomic<bool>     closed{false};  // the thread exited
+    uint64_t              num_reported_dropped = 0;  // owned by the background thread
+};
+
+// The queue of the calling thread, marked closed when the thread exits.
+struct ThreadLogQueueHolder {
+    ~ThreadLogQueueHolder()
+    {
+        if (queue != nullptr) {
+            queue->closed.store(true, std::memory_order_release);
+        }
+    }
+
+    std::shared_ptr<ThreadLogQueue> queue;
+};
+
+ThreadLogQueueHolder& getThreadLogQueueHolder()
+{
+    thread_local ThreadLogQueueHolder holder;
+    return holder;
+}
+
+class AsyncLoggerState {
+public:
+    bool start(const AsyncLoggerConfig& config)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (thread_.joinable()) {
+            return false;
+        }
+        if (config.binary && config.path.empty()) {
+            fprintf(stderr, "[FT][WARNING] The binary async logger needs a path, it is not started.\n");
+            return false;
+        }
+        output_ = nullptr;
+        if (!config.path.empty()) {
+            output_ = fopen(config.path.c_str(), config.binary ? "wb" : "w");
+            if (output_ == nullptr) {
+                fprintf(stderr, "[FT][WARNING] Cannot open %s, the async logger is not started.\n", config.path.c_str());
+                return false;
+            }
+        }
+        config_            = config;
+        config_.queue_size = std::max(config.queue_size, (size_t)1);
+        format_ids_.clear();
+        stop_            = false;
+        flush_requested_ = 0;
+        flushed_         = 0;
+        num_written_     = 0;
+        num_dropped_     = 0;
+        if (config_.binary) {
+            fwrite(kBinaryLogMagic, 1, std::strlen(kBinaryLogMagic), output_);
+            fwrite(&kBinaryLogVersion, sizeof(kBinaryLogVersion), 1, output_);
+        }
+        generation_.fetch_add(1, std::memory_order_acq_rel);
+        thread_ = std::thread(&AsyncLoggerState::run, this);
+        return true;
+    }
+
+    void stop()
+    {
+        std::thread thread;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!thread_.joinable()) {
+                return;
+            }
+            stop_ = true;
+            thread.swap(thread_);
+        }
+        wake_cv_.notify_one();
+        thread.join();
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto& queue : queues_) {
+            num_dropped_ += queue->num_dropped.load(std::memory_order_acquire);
+        }
+        queues_.clear();
+        if (output_ != nullptr) {
+            fclose(output_);
+            output_ = nullptr;
+        }
+    }
+
+    void flush()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (!thread_.joinable()) {
+            return;
+        }
+        const uint64_t request = ++flush_requested_;
+        wake_cv_.notify_one();
+        flushed_cv_.wait(lock, [&]() { return flushed_ >= request || !thread_.joinable(); });
+    }
+
+    LogRecord* tryAcquire()
+    {
+        ThreadLogQueue* queue  = getThreadQueue();
+        LogRecord*      record = queue->queue.tryAcquirePush();
+        if (record == nullptr) {
+            queue->num_dropped.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        record->header.thread_id = queue->thread_id;
+        return record;
+    }
+
+    void commit()
+    {
+        getThreadLogQueueHolder().queue->queue.commitPush();
+    }
+
+    AsyncLoggerStats getStats()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        AsyncLoggerStats            stats{num_written_, num_dropped_};
+        for (auto& queue : queues_) {
+            stats.num_dropped += queue->num_dropped.load(std::memory_order_acquire);
+        }
+        return stats;
+    }
+
+private:
+    ThreadLogQueue* getThreadQueue()
+    {
+        ThreadLogQueueHolder& holder     = getThreadLogQueueHolder();
+        const uint64_t        generation = generation_.load(std::memory_order_acquire);
+        if (holder.queue == nullptr || holder.queue->generation != generation) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            holder.queue = std::make_shared<ThreadLogQueue>(config_.queue_size, ++num_threads_, generation);
+            queues_.push_back(holder.queue);
+        }
+        return holder.queue.get();
+    }
+
+    void run()
+    {
+        while (true) {
+            uint64_t request;
+            bool     stop;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                request = flush_requested_;
+                stop    = stop_;
+            }
+            // Everything pushed before the request was made is in the queues now.
+            drain();
+            fflush(output_ != nullptr ? output_ : stdout);
+            if (output_ == nullptr) {
+                fflush(stderr);
+            }
+
+            std::unique_lock<std::mutex> lock(mutex_);
+            flushed_ = request;
+            flushed_cv_.notify_all();
+            if (stop) {
+                break;
+            }
+            wake_cv_.wait_for(lock, kPollInterval, [&]() { return stop_ || flush_requested_ != request; });
+        }
+    }
+
+    // Writes the records queued so far, in order of time across threads. The records of a thread logging without
+    // pause are left for the next round.
+    void drain()
+    {
+        std::vector<std::shared_ptr<ThreadLogQueue>> queues;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            queues = queues_;
+        }
+        num_remaining_.resize(queues.size());
+        for (size_t i = 0; i < queues.size(); i++) {
+            num_remaining_[i] = queues[i]->queue.size();
+            reportDropped(queues[i].get());
+        }
+
+        uint64_t num_records = 0;
+        while (true) {
+            const LogRecord* next       = nullptr;
+            size_t           next_queue = 0;
+            for (size_t i = 0; i < queues.size(); i++) {
+                const LogRecord* record = num_remaining_[i] > 0 ? queues[i]->queue.front() : nullptr;
+                if (record != nullptr && (next == nullptr || record->header.timestamp_ns < next->header.timestamp_ns)) {
+                    next       = record;
+                    next_queue = i;
+                }
+            }
+            if (next == nullptr) {
+                break;
+            }
+            write(*next);
+            queues[next_queue]->queue.pop();
+            num_remaining_[next_queue]--;
+            num_records++;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        num_written_ += num_records;
+        for (auto it = queues_.begin(); it != queues_.end();) {
+            // A closed queue gets no more records once it has been seen closed.
+            if ((*it)->closed.load(std::memory_order_acquire) && (*it)->queue.empty()) {
+                reportDropped(it->get());
+                num_dropped_ += (*it)->num_dropped.load(std::memory_order_acquire);
+                it = queues_.erase(it);
+            }
+            else {
+                ++it;
+            }
+        }
+    }
+
+    void write(const LogRecord& record)
+    {
+        const char* format = record.payload;
+        const char* args   = record.payload + record.header.format_length;
+        if (!config_.binary) {
+            const std::string line = formatRecord(record.header, format, args);
+            FILE* out = output_ != nullptr ? output_ : (record.header.flags & LOG_RECORD_STDERR ? stderr : stdout);
+            fwrite(line.data(), 1, line.size(), out);
+            return;
+        }
+
+        const std::string key(format, record.header.format_length);
+        auto              it = format_ids_.find(key);
+        if (it == format_ids_.end()) {
+            it                    = format_ids_.insert({key, (uint32_t)format_ids_.size()}).first;
+            const uint16_t length = record.header.format_length;
+            fputc(kFormatEntry, output_);
+            fwrite(&it->second, sizeof(it->second), 1, output_);
+            fwrite(&length, sizeof(length), 1, output_);
+            fwrite(format, 1, length, output_);
+        }
+        fputc(kRecordEntry, output_);
+        fwrite(&it->second, sizeof(it->second), 1, output_);
+        fwrite(&record.header, sizeof(record.header), 1, output_);
+        fwrite(args, 1, record.header.args_size, output_);
+    }
+
+    void reportDropped(ThreadLogQueue* queue)
+    {
+        const uint64_t num_dropped = queue->num_dropped.load(std::memory_order_acquire);
+        if (num_dropped == queue->num_reported_dropped) {
+            return;
+        }
+        const uint64_t count        = num_dropped - queue->num_reported_dropped;
+        queue->num_reported_dropped = num_dropped;
+        if (config_.binary) {
+            fputc(kDroppedEntry, output_);
+            fwrite(&queue->thread_id, sizeof(queue->thread_id), 1, output_);
+            fwrite(&count, sizeof(count), 1, output_);
+        }
+        else {
+            fprintf(output_ != nullptr ? output_ : stderr,
+                    "[FT][WARNING] The async logger dropped %lu records of thread %u, its queue is full.\n",
+                    (unsigned long)count,
+                    queue->thread_id);
+        }
+    }
+
+    static constexpr std::chrono::milliseconds kPollInterval{5};
+
+    std::mutex              mutex_;
+    std::condition_variable wake_cv_;
+    std::condition_variable flushed_cv_;
+    std::thread             thread_;
+    bool                    stop_            = false;
+    uint64_t                flush_requested_ = 0;
+    uint64_t                flushed_         = 0;
+
+    AsyncLoggerConfig                            config_;
+    FILE*                                        output_ = nullptr;
+    std::atomic<uint64_t>                        generation_{0};
+    uint32_t                                     num_threads_ = 0;
+    std::vector<std::shared_ptr<ThreadLogQueue>> queues_;
+    uint64_t                                     num_written_ = 0;
+    uint64_t                                     num_dropped_ = 0;
+
+    // Owned by the background thread.
+    std::vector<size_t>                       num_remaining_;
+    std::unordered_map<std::string, uint32_t> format_ids_;
+};
+
+constexpr std::chrono::milliseconds AsyncLoggerState::kPollInterval;
+
+// Never destroyed: threads may log while the process exits.
+AsyncLoggerState& getState()
+{
+    static AsyncLoggerState* state = new AsyncLoggerState();
+    return *state;
+}
+
+}  // namespace
+
+bool AsyncLogger::start(const AsyncLoggerConfig& config)
+{
+    static std::once_flag stop_at_exit;
+    std::call_once(stop_at_exit, []() { std::atexit(AsyncLogger::stop); });
+    if (!getState().start(config)) {
+        return false;
+    }
+    running_.store(true, std::memory_order_release);
+    return true;
+}
+
+void AsyncLogger::startFromEnv()
+{
+    static std::once_flag started;
+    std::call_once(started, []() {
+        const char*       async      = std::getenv("FT_LOG_ASYNC");
+        const char*       path       = std::getenv("FT_LOG_ASYNC_FILE");
+        const char*       queue_size = std::getenv("FT_LOG_ASYNC_QUEUE_SIZE");
+        AsyncLoggerConfig config;
+        if (path != nullptr && path[0] != '\0') {
+            config.path   = path;
+            config.binary = true;
+        }
+        else if (async == nullptr || std::string(async) != "ON") {
+            return;
+        }
+        if (queue_size != nullptr) {
+            config.queue_size = std::max(std::atol(queue_size), 1L);
+        }
+        start(config);
+    });
+}
+
+void AsyncLogger::stop()
+{
+    running_.store(false, std::memory_order_release);
+    getState().stop();
+}
+
+void AsyncLogger::flush()
+{
+    getState().flush();
+}
+
+LogRecord* AsyncLogger::tryAcquire()
+{
+    return getState().tryAcquire();
+}
+
+void AsyncLogger::commit()
+{
+    getState().commit();
+}
+
+AsyncLoggerStats AsyncLogger::getStats()
+{
+    return getState().getStats();
+}
+
+bool decodeBinaryLog(FILE* input, FILE* output, bool print_context)
+{
+    char     magic[8];
+    uint32_t version;
+    if (fread(magic, 1, sizeof(magic), input) != sizeof(magic) || std::memcmp(magic, kBinaryLogMagic, sizeof(magic))
+        || fread(&version, sizeof(version), 1, input) != 1 || version != kBinaryLogVersion) {
+        return false;
+    }
+
+    std::vector<std::string> formats;
+    std::vector<char>        args(LogRecord::kPayloadSize);
+    int                      entry;
+    while ((entry = fgetc(input)) != EOF) {
+        if (entry == kFormatEntry) {
+            uint32_t id;
+            uint16_t length;
+            if (fread(&id, sizeof(id), 1, input) != 1 || fread(&length, sizeof(length), 1, input) != 1) {
+                return false;
+            }
+            std::string format(length, '\0');
+            if (fread(&format[0], 1, length, input) != length) {
+                return false;
+            }
+            if (formats.size() <= id) {
+                formats.resize(id + 1);
+            }
+            formats[id] = format;
+        }
+        else if (entry == kRecordEntry) {
+            uint32_t        id;
+            LogRecordHeader header;
+            if (fread(&id, sizeof(id), 1, input) != 1 || fread(&header, sizeof(header), 1, input) != 1
+                || id >= formats.size() || header.args_size > args.size()
+                || fread(args.data(), 1, header.args_size, input) != header.args_size) {
+                return false;
+            }
+            header.format_length   = (uint16_t)formats[id].size();
+            const std::string line = formatRecord(header, formats[id].c_str(), args.data());
+            if (print_context) {
+                fputs(formatContext(header).c_str(), output);
+            }
+            fputs(line.c_str(), output);
+        }
+        else if (entry == kDroppedEntry) {
+            uint32_t thread_id;
+            uint64_t count;
+            if (fread(&thread_id, sizeof(thread_id), 1, input) != 1 || fread(&count, sizeof(count), 1, input) != 1) {
+                return false;
+            }
+            fprintf(output,
+                    "[FT][WARNING] The async logger dropped %lu records of thread %u, its queue is full.\n",
+                    (unsigned long)count,
+                    thread_id);
+        }
+        else {
+            return false;
+        }
+    }
+    return true;
+}
+
+}  // namespace fastertransformer
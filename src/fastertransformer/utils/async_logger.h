@@ -0,0 +1,210 @@
+/*
+ * Copyright (c) 2023, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Asynchronous backend of Logger.
+ *
+ * When it runs, Logger::log neither formats nor writes anything on the calling thread: it copies the format string
+ * and the raw arguments into a fixed-size LogRecord, built in place in a SpscQueue owned by the thread. A background
+ * thread drains the queues, formats the records and writes them. When the queue of a thread is full its records are
+ * dropped and counted, so the memory is bounded and logging never blocks. ERROR records are the exception: they
+ * flush the queues, so that they are written before the error is raised.
+ *
+ * The records are written as text, like the synchronous logger, or in a compact binary format where each format
+ * string is written once and the records only carry its id and the raw arguments. decode_binary_log turns a binary
+ * log into text.
+ *
+ * The backend is started by AsyncLogger::start, or by the environment:
+ *   FT_LOG_ASYNC=ON                  text, to stdout and stderr
+ *   FT_LOG_ASYNC_FILE=<path>         binary, to <path>
+ *   FT_LOG_ASYNC_QUEUE_SIZE=<n>      records per thread, 2048 by default (2 MB)
+ **/
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <type_traits>
+
+namespace fastertransformer {
+
+enum LogArgType : uint8_t {
+    LOG_ARG_INT     = 0,  // the size of the integer (1 byte), then its value, sign extended to 8 bytes
+    LOG_ARG_UINT    = 1,  // the size of the integer (1 byte), then its value, zero extended to 8 bytes
+    LOG_ARG_DOUBLE  = 2,  // 8 bytes
+    LOG_ARG_STRING  = 3,  // the length (2 bytes), then the characters
+    LOG_ARG_POINTER = 4,  // 8 bytes
+    LOG_ARG_UNKNOWN = 5,  // an argument of a type the logger cannot copy, printed as "<?>"
+};
+
+enum LogRecordFlag : uint8_t {
+    LOG_RECORD_STDERR    = 1,  // the synchronous logger would have written it to stderr
+    LOG_RECORD_TRUNCATED = 2,  // the arguments did not fit in the record
+};
+
+struct LogRecordHeader {
+    uint64_t timestamp_ns;  // since the epoch of std::chrono::system_clock
+    uint32_t thread_id;     // numbered by the logger, in order of the first log of each thread
+    int32_t  rank;          // -1 when not given
+    uint16_t format_length;
+    uint16_t args_size;
+    uint8_t  level;
+    uint8_t  flags;
+    uint16_t reserved;
+};
+
+struct LogRecord {
+    static constexpr size_t kPayloadSize = 1024 - sizeof(LogRecordHeader);
+
+    LogRecordHeader header;
+    char            payload[kPayloadSize];  // the format string, without '\0', then the arguments
+};
+
+// Encodes the arguments of a log call, and stops at the end of the buffer.
+class LogArgWriter {
+public:
+    LogArgWriter(char* buffer, size_t capacity): buffer_(buffer), capacity_(capacity) {}
+
+    template<typename T>
+    typename std::enable_if<std::is_integral<T>::value>::type put(const T& value)
+    {
+        putInteger(std::is_signed<T>::value ? LOG_ARG_INT : LOG_ARG_UINT, sizeof(T), (uint64_t)value);
+    }
+    template<typename T>
+    typename std::enable_if<std::is_enum<T>::value>::type put(const T& value)
+    {
+        put((typename std::underlying_type<T>::type)value);
+    }
+    template<typename T>
+    typename std::enable_if<std::is_floating_point<T>::value>::type put(const T& value)
+    {
+        const double d = (double)value;
+        if (reserve(1 + sizeof(d))) {
+            buffer_[size_] = LOG_ARG_DOUBLE;
+            std::memcpy(buffer_ + size_ + 1, &d, sizeof(d));
+            size_ += 1 + sizeof(d);
+        }
+    }
+    void put(const char* value)
+    {
+        // printf prints "(null)" for a null string, do the same.
+        value == nullptr ? putString("(null)", 6) : putString(value, std::strlen(value));
+    }
+    void put(char* value)
+    {
+        put((const char*)value);
+    }
+    void put(const std::string& value)
+    {
+        putString(value.c_str(), value.size());
+    }
+    template<typename T>
+    typename std::enable_if<!std::is_same<typename std::remove_cv<T>::type, char>::value>::type put(T* value)
+    {
+        putInteger(LOG_ARG_POINTER, 0, (uint64_t)(uintptr_t)value);
+    }
+    template<typename T>
+    typename std::enable_if<std::is_class<T>::value && !std::is_same<T, std::string>::value>::type put(const T&)
+    {
+        if (reserve(1)) {
+            buffer_[size_++] = LOG_ARG_UNKNOWN;
+        }
+    }
+
+    void putAll() {}
+    template<typename T, typename... Args>
+    void putAll(const T& value, const Args&... args)
+    {
+        put(value);
+        putAll(args...);
+    }
+
+    size_t size() const
+    {
+        return size_;
+    }
+    bool truncated() const
+    {
+        return truncated_;
+    }
+
+private:
+    bool reserve(size_t size)
+    {
+        if (truncated_ || size_ + size > capacity_) {
+            truncated_ = true;
+            return false;
+        }
+        return true;
+    }
+    void putInteger(LogArgType type, size_t size, uint64_t value);
+    void putString(const char* value, size_t length);
+
+    char*  buffer_;
+    size_t capacity_;
+    size_t size_      = 0;
+    bool   truncated_ = false;
+};
+
+// Formats a message like printf, from the arguments encoded by LogArgWriter.
+std::string formatLogMessage(const char* format, size_t format_length, const char* args, size_t args_size);
+
+struct AsyncLoggerConfig {
+    std::string path;               // where the records go, stdout and stderr when empty
+    bool        binary     = false;  // binary records, needs a path
+    size_t      queue_size = 2048;   // records per thread
+};
+
+// Since the last start.
+struct AsyncLoggerStats {
+    uint64_t num_written;
+    uint64_t num_dropped;
+};
+
+class AsyncLogger {
+public:
+    // Starts the background thread. Returns false if it runs already.
+    static bool start(const AsyncLoggerConfig& config);
+    // Starts the background thread if FT_LOG_ASYNC or FT_LOG_ASYNC_FILE are set. Only the first call does anything.
+    static void startFromEnv();
+    // Writes what is queued and stops the background thread, logging becomes synchronous again. Records logged by
+    // other threads during the call may be lost.
+    static void stop();
+    static bool isRunning()
+    {
+        return running_.load(std::memory_order_acquire);
+    }
+
+    // Blocks until the records logged before the call are written.
+    static void flush();
+    // The record to fill for the next log of the calling thread, in its queue, or nullptr if the queue is full and the
+    // log is dropped. The record is queued by commit.
+    static LogRecord*       tryAcquire();
+    static void             commit();
+    static AsyncLoggerStats getStats();
+
+private:
+    static std::atomic<bool> running_;
+};
+
+// Prints a binary log as text, each line prefixed by its time and thread when print_context is set. Returns false if
+// the input is not a binary log, or is truncated.
+bool decodeBinaryLog(FILE* input, FILE* output, bool print_context);
+
+}  // namespace fastertransformer
@@ -0,0 +1,235 @@
+/*
+ * Copyright (c) 2023, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/fastertransformer/utils/batch_scheduler.h"
+#include "src/fastertransformer/utils/cuda_utils.h"
+
+namespace fastertransformer {
+
+BatchSlotManager::BatchSlotManager(size_t max_batch_size): is_used_(max_batch_size, false)
+{
+    for (size_t i = 0; i < max_batch_size; i++) {
+        free_slots_.push((int)i);
+    }
+}
+
+int BatchSlotManager::acquire()
+{
+    if (free_slots_.empty()) {
+        return -1;
+    }
+    int slot = free_slots_.top();
+    free_slots_.pop();
+    is_used_[slot] = true;
+    return slot;
+}
+
+void BatchSlotManager::release(int slot)
+{
+    FT_CHECK_WITH_INFO(slot >= 0 && slot < (int)is_used_.size() && is_used_[slot],
+                       fmtstr("slot %d is not in use", slot));
+    is_used_[slot] = false;
+    free_slots_.push(slot);
+}
+
+void BatchRequestQueue::push(BatchRequest request)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        requests_.push_back(std::move(request));
+    }
+    cv_.notify_one();
+}
+
+size_t BatchRequestQueue::pop(size_t max_num_requests, std::vector<BatchRequest>* requests)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t                      num_requests = std::min(max_num_requests, requests_.size());
+    for (size_t i = 0; i < num_requests; i++) {
+        requests->push_back(std::move(requests_.front()));
+        requests_.pop_front();
+    }
+    return num_requests;
+}
+
+bool BatchRequestQueue::waitNotEmpty()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [this] { return !requests_.empty() || is_closed_; });
+    return !requests_.empty();
+}
+
+void BatchRequestQueue::close()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        is_closed_ = true;
+    }
+    cv_.notify_all();
+}
+
+size_t BatchRequestQueue::size() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return requests_.size();
+}
+
+BatchScheduler::BatchScheduler(size_t        max_batch_size,
+                               size_t        max_seq_len,
+                               BatchStepFunc step_func,
+                               size_t        max_context_tokens):
+    max_batch_size_(max_batch_size),
+    max_seq_len_(max_seq_len),
+    max_context_tokens_(max_context_tokens),
+    step_func_(step_func),
+    slot_manager_(max_batch_size),
+    active_(max_batch_size)
+{
+    FT_CHECK(max_batch_size > 0);
+    slots_buf_.reserve(max_batch_size);
+    next_token_ids_buf_.reserve(max_batch_size);
+}
+
+void BatchScheduler::enqueue(BatchRequest request)
+{
+    FT_CHECK_WITH_INFO(!request.input_ids.empty(), "request input_ids must not be empty");
+    FT_CHECK_WITH_INFO(request.max_new_tokens > 0, "request max_new_tokens must be positive");
+    FT_CHECK_WITH_INFO(request.input_ids.size() + request.max_new_tokens <= max_seq_len_,
+                       fmtstr("request %lu needs %lu tokens but a slot holds %lu",
+                              request.request_id,
+                              request.input_ids.size() + request.max_new_tokens,
+                              max_seq_len_));
+    queue_.push(std::move(request));
+}
+
+void BatchScheduler::admit()
+{
+    size_t num_free = slot_manager_.numFreeSlots();
+    if (admissible_.size() < num_free) {
+        std::vector<BatchRequest> requests;
+        queue_.pop(num_free - admissible_.size(), &requests);
+        for (auto& request : requests) {
+            admissible_.push_back(std::move(request));
+        }
+    }
+
+    size_t num_context_tokens = 0;
+    while (!admissible_.empty() && slot_manager_.numFreeSlots() > 0) {
+        const size_t input_length = admissible_.front().input_ids.size();
+        if (max_context_tokens_ > 0 && num_context_tokens > 0
+            && num_context_tokens + input_length > max_context_tokens_) {
+            break;
+        }
+        num_context_tokens += input_length;
+
+        int            slot   = slot_manager_.acquire();
+        ActiveRequest& active = active_[slot];
+        active.request        = std::move(admissible_.front());
+        admissible_.pop_front();
+        active.output_ids.clear();
+        active.output_ids.reserve(active.request.max_new_tokens);
+        active.step       = 0;
+        active.is_context = true;
+        stats_.num_admitted++;
+        FT_LOG_DEBUG("admit request %lu into slot %d", active.request.request_id, slot);
+    }
+}
+
+void BatchScheduler::evict(int slot)
+{
+    ActiveRequest& active = active_[slot];
+    FT_LOG_DEBUG("evict request %lu from slot %d after %lu tokens",
+                 active.request.request_id,
+                 slot,
+                 active.output_ids.size());
+    if (active.request.finish_callback) {
+        active.request.finish_callback(active.request.request_id, active.output_ids);
+    }
+    active.request = BatchRequest();
+    slot_manager_.release(slot);
+    stats_.num_finished++;
+}
+
+bool BatchScheduler::step()
+{
+    admit();
+
+    slots_buf_.clear();
+    bool has_context = false;
+    for (size_t slot = 0; slot < max_batch_size_; slot++) {
+        if (!slot_manager_.isUsed(slot)) {
+            continue;
+        }
+        const ActiveRequest& active = active_[slot];
+        BatchSlot            batch_slot;
+        batch_slot.slot         = (int)slot;
+        batch_slot.request_id   = active.request.request_id;
+        batch_slot.is_context   = active.is_context;
+        batch_slot.input_ids    = active.is_context ? active.request.input_ids.data() : &active.last_token;
+        batch_slot.input_length = active.is_context ? (int)active.request.input_ids.size() : 1;
+        batch_slot.step         = active.step;
+        slots_buf_.push_back(batch_slot);
+        has_context |= active.is_context;
+    }
+    if (slots_buf_.empty()) {
+        return false;
+    }
+
+    next_token_ids_buf_.assign(slots_buf_.size(), 0);
+    step_func_(slots_buf_, &next_token_ids_buf_);
+    stats_.num_steps++;
+    stats_.num_context_steps += has_context ? 1 : 0;
+    stats_.num_slot_steps += slots_buf_.size();
+
+    for (size_t i = 0; i < slots_buf_.size(); i++) {
+        const int      slot     = slots_buf_[i].slot;
+        const int      token_id = next_token_ids_buf_[i];
+        ActiveRequest& active   = active_[slot];
+        active.step += slots_buf_[i].input_length;
+        active.is_context = false;
+        active.last_token = token_id;
+        active.output_ids.push_back(token_id);
+        stats_.num_generated_tokens++;
+        if (active.request.token_callback) {
+            active.request.token_callback(active.request.request_id, token_id);
+        }
+        if (token_id == active.request.end_id || (int)active.output_ids.size() >= active.request.max_new_tokens) {
+            evict(slot);
+        }
+    }
+    return true;
+}
+
+void BatchScheduler::runUntilIdle()
+{
+    while (step() || !admissible_.empty() || queue_.size() > 0) {}
+}
+
+void BatchScheduler::serve()
+{
+    while (true) {
+        if (!step() && admissible_.empty() && !queue_.waitNotEmpty()) {
+            return;
+        }
+    }
+}
+
+void BatchScheduler::close()
+{
+    queue_.close();
+}
+
+}  // namespace fastertransformer
@@ -0,0 +1,190 @@
+/*
+ * Copyright (c) 2023, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Host-side scheduler for continuous (in-flight) batching.
+ *
+ * BatchScheduler owns a fixed number of batch slots and drives a step function one generation step at a time:
+ *
+ *   1. pending requests are admitted into free slots; their first step feeds the whole prompt (context step),
+ *   2. the step function generates one token for every active slot,
+ *   3. requests which produced end_id or reached max_new_tokens are evicted and their slot is freed for the next
+ *      step.
+ *
+ * The scheduler only does the bookkeeping: it does not touch the device, and no model uses it. ParallelGpt still
+ * runs static batches: it has no single-step entry point, and its masked attention assumes one step for the whole
+ * batch. The step function is expected to keep one row of its key/value caches per slot. Tests drive the scheduler
+ * with a mock step function.
+ **/
+
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <vector>
+
+namespace fastertransformer {
+
+struct BatchRequest {
+    uint64_t         request_id;
+    std::vector<int> input_ids;
+    int              max_new_tokens;
+    int              end_id = -1;  // no end token if negative
+
+    // Both are called from the thread which runs BatchScheduler::step.
+    std::function<void(uint64_t request_id, int token_id)>                       token_callback;
+    std::function<void(uint64_t request_id, const std::vector<int>& output_ids)> finish_callback;
+};
+
+// One active request, as seen by the step function.
+struct BatchSlot {
+    int      slot;        // row of the request in the key/value caches
+    uint64_t request_id;
+    bool     is_context;  // the prompt has not been encoded into the caches yet
+    // Tokens fed at this step: the whole prompt for a context step, the last generated token otherwise.
+    const int* input_ids;
+    int        input_length;
+    int        step;  // number of tokens already in the caches of the slot
+};
+
+// Generates the next token of every slot. next_token_ids has one entry per slot, in the same order.
+typedef std::function<void(const std::vector<BatchSlot>& slots, std::vector<int>* next_token_ids)> BatchStepFunc;
+
+// Allocates batch slots. Free slots are handed out lowest first, so active requests stay packed at the lowest
+// slots.
+class BatchSlotManager {
+public:
+    explicit BatchSlotManager(size_t max_batch_size);
+
+    // Returns -1 if every slot is used.
+    int  acquire();
+    void release(int slot);
+
+    size_t numFreeSlots() const
+    {
+        return free_slots_.size();
+    }
+    size_t maxBatchSize() const
+    {
+        return is_used_.size();
+    }
+    bool isUsed(int slot) const
+    {
+        return is_used_[slot];
+    }
+
+private:
+    std::priority_queue<int, std::vector<int>, std::greater<int>> free_slots_;
+    std::vector<bool>                                             is_used_;
+};
+
+// Thread-safe FIFO of requests waiting for a slot.
+class BatchRequestQueue {
+public:
+    void   push(BatchRequest request);
+    // Pops up to max_num_requests requests, without waiting.
+    size_t pop(size_t max_num_requests, std::vector<BatchRequest>* requests);
+    // Waits until a request is pushed or close() is called. Returns false if closed and empty.
+    bool   waitNotEmpty();
+    void   close();
+    size_t size() const;
+
+private:
+    mutable std::mutex       mutex_;
+    std::condition_variable  cv_;
+    std::deque<BatchRequest> requests_;
+    bool                     is_closed_ = false;
+};
+
+struct BatchSchedulerStats {
+    size_t num_steps            = 0;
+    size_t num_context_steps    = 0;  // steps which encoded at least one prompt
+    size_t num_admitted         = 0;
+    size_t num_finished         = 0;
+    size_t num_slot_steps       = 0;  // sum over steps of the number of active slots
+    size_t num_generated_tokens = 0;
+};
+
+class BatchScheduler {
+public:
+    // max_seq_len is the capacity of the caches of a slot: prompt plus generated tokens.
+    // max_context_tokens bounds the prompt tokens admitted in one step, 0 for no limit; a prompt longer than the
+    // limit is still admitted alone.
+    BatchScheduler(size_t        max_batch_size,
+                   size_t        max_seq_len,
+                   BatchStepFunc step_func,
+                   size_t        max_context_tokens = 0);
+
+    // Throws if the request cannot fit in the caches of a slot. Thread-safe.
+    void enqueue(BatchRequest request);
+
+    // Admits pending requests, runs one step and evicts finished requests. Returns false if there was nothing to
+    // run. Must be called from a single thread.
+    bool step();
+
+    // Steps until no request is active or pending.
+    void runUntilIdle();
+
+    // Steps until close() is called and every request is finished.
+    void serve();
+    void close();
+
+    size_t numActiveRequests() const
+    {
+        return max_batch_size_ - slot_manager_.numFreeSlots();
+    }
+    size_t numPendingRequests() const
+    {
+        return queue_.size();
+    }
+    BatchSchedulerStats getStats() const
+    {
+        return stats_;
+    }
+
+private:
+    struct ActiveRequest {
+        BatchRequest     request;
+        std::vector<int> output_ids;
+        int              step       = 0;
+        bool             is_context = true;
+        int              last_token = 0;
+    };
+
+    void admit();
+    void evict(int slot);
+
+    const size_t  max_batch_size_;
+    const size_t  max_seq_len_;
+    const size_t  max_context_tokens_;
+    BatchStepFunc step_func_;
+
+    BatchSlotManager           slot_manager_;
+    BatchRequestQueue          queue_;
+    std::deque<BatchRequest>   admissible_;  // popped from queue_ but not admitted yet, kept in order
+    std::vector<ActiveRequest> active_;      // indexed by slot
+    BatchSchedulerStats        stats_;
+
+    std::vector<BatchSlot> slots_buf_;
+    std::vector<int>       next_token_ids_buf_;
+};
+
+}  // namespace fastertransformer
@@ -0,0 +1,291 @@
+/*
+ * Copyright (c) 2023, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Caching layer between an allocator and the memory it gets blocks from.
+ *
+ * A freed block is not given back to the backend but kept in a free list of the stream it was freed on, and a later
+ * allocation of the same size class on that stream takes it without calling the backend. The work queued on a stream
+ * runs in order, so reusing a block on its own stream is always safe; blocks are never handed to another stream.
+ *
+ * Sizes are rounded up to size classes: multiples of 512 bytes, then four classes per power of two up to 16 MiB
+ * (at most 25% of padding), then multiples of 2 MiB. A cached block serves any request of at least half its size.
+ * When the backend runs out of memory, every cached block is released and the allocation is retried once.
+ *
+ * The bookkeeping does not touch the memory, so it works with any backend; HostBlockBackend serves blocks from the
+ * host heap for tests.
+ **/
+
+#pragma once
+
+#include "src/fastertransformer/utils/cuda_utils.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+
+namespace fastertransformer {
+
+class IBlockBackend {
+public:
+    virtual ~IBlockBackend() {}
+
+    // Returns nullptr if the backend is out of memory.
+    virtual void* allocate(size_t size, cudaStream_t stream)               = 0;
+    virtual void  deallocate(void* ptr, size_t size, cudaStream_t stream) = 0;
+};
+
+class HostBlockBackend: public IBlockBackend {
+public:
+    // Fails the allocations which would take more than capacity bytes.
+    explicit HostBlockBackend(size_t capacity = SIZE_MAX): capacity_(capacity) {}
+
+    void* allocate(size_t size, cudaStream_t stream) override
+    {
+        if (size > capacity_ - used_) {
+            return nullptr;
+        }
+        used_ += size;
+        return std::malloc(size);
+    }
+
+    void deallocate(void* ptr, size_t size, cudaStream_t stream) override
+    {
+        used_ -= size;
+        std::free(ptr);
+    }
+
+    size_t getUsedBytes() const
+    {
+        return used_;
+    }
+
+private:
+    size_t capacity_;
+    size_t used_ = 0;
+};
+
+struct CachingAllocatorStats {
+    size_t allocated_bytes      = 0;  // requested bytes of the live allocations
+    size_t reserved_bytes       = 0;  // bytes held from the backend, by live and cached blocks
+    size_t cached_bytes         = 0;  // bytes of the cached blocks
+    size_t peak_allocated_bytes = 0;
+    size_t peak_reserved_bytes  = 0;
+    size_t num_allocs           = 0;
+    size_t num_cache_hits       = 0;
+    size_t num_backend_allocs   = 0;
+    size_t num_backend_frees    = 0;
+
+    // Share of the reserved memory which is not requested: the padding to size classes and the cached blocks.
+    float getFragmentation() const
+    {
+        return reserved_bytes == 0 ? 0.0f : 1.0f - (float)allocated_bytes / (float)reserved_bytes;
+    }
+};
+
+class CachingAllocator {
+public:
+    static const size_t kMinBlockSize  = 512;
+    static const size_t kLargeSize     = 16 << 20;
+    static const size_t kLargeRounding = 2 << 20;
+
+    // The backend is not owned. With is_caching = false, the freed blocks go back to the backend right away.
+    explicit CachingAllocator(IBlockBackend* backend, bool is_caching = true):
+        backend_(backend), is_caching_(is_caching)
+    {
+    }
+    CachingAllocator(CachingAllocator const&) = delete;
+    void operator=(CachingAllocator const&)   = delete;
+
+    ~CachingAllocator()
+    {
+        for (auto& block : live_blocks_) {
+            backend_->deallocate(block.first, block.second.block_size, block.second.stream);
+        }
+        trim();
+    }
+
+    static size_t roundSize(size_t size)
+    {
+        if (size <= kMinBlockSize) {
+            return kMinBlockSize;
+        }
+        if (size > kLargeSize) {
+            return (size + kLargeRounding - 1) / kLargeRounding * kLargeRounding;
+        }
+        size_t power = kMinBlockSize;
+        while (power * 2 < size) {
+            power *= 2;
+        }
+        const size_t step = power / 4;
+        return (size + step - 1) / step * step;
+    }
+
+    void* malloc(size_t size, cudaStream_t stream)
+    {
+        if (size == 0) {
+            return nullptr;
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        size_t                      block_size = roundSize(size);
+        void*                       ptr        = takeCachedBlock(&block_size, stream);
+        if (ptr != nullptr) {
+            stats_.num_cache_hits++;
+        }
+        else {
+            ptr = backend_->allocate(block_size, stream);
+            if (ptr == nullptr && stats_.cached_bytes > 0) {
+                FT_LOG_DEBUG(
+                    "Out of memory for %ld bytes, releasing %ld cached bytes.", block_size, stats_.cached_bytes);
+                trimLocked(0);
+                ptr = backend_->allocate(block_size, stream);
+            }
+            FT_CHECK_WITH_INFO(ptr != nullptr,
+                               fmtstr("Out of memory: cannot allocate %ld bytes, %ld bytes are allocated.",
+                                      block_size,
+                                      stats_.allocated_bytes));
+            stats_.num_backend_allocs++;
+            stats_.reserved_bytes += block_size;
+            stats_.peak_reserved_bytes = std::max(stats_.peak_reserved_bytes, stats_.reserved_bytes);
+        }
+        live_blocks_[ptr] = {size, block_size, stream};
+        stats_.num_allocs++;
+        stats_.allocated_bytes += size;
+        stats_.peak_allocated_bytes = std::max(stats_.peak_allocated_bytes, stats_.allocated_bytes);
+        return ptr;
+    }
+
+    // The block goes to the free list of stream, which is the stream that last used it.
+    void free(void* ptr, cudaStream_t stream)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto                        it = live_blocks_.find(ptr);
+        FT_CHECK_WITH_INFO(it != live_blocks_.end(), fmtstr("%p was not allocated by this allocator.", ptr));
+        const Block block = it->second;
+        live_blocks_.erase(it);
+        stats_.allocated_bytes -= block.size;
+        if (is_caching_) {
+            free_blocks_[stream].insert({block.block_size, ptr});
+            stats_.cached_bytes += block.block_size;
+        }
+        else {
+            backend_->deallocate(ptr, block.block_size, stream);
+            stats_.num_backend_frees++;
+            stats_.reserved_bytes -= block.block_size;
+        }
+    }
+
+    bool isExist(void* ptr) const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return live_blocks_.count(ptr) > 0;
+    }
+
+    // The requested size of a live allocation.
+    size_t getSize(void* ptr) const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto                        it = live_blocks_.find(ptr);
+        FT_CHECK_WITH_INFO(it != live_blocks_.end(), fmtstr("%p was not allocated by this allocator.", ptr));
+        return it->second.size;
+    }
+
+    // Releases the cached blocks, largest first, until at most max_cached_bytes stay cached. Returns the number of
+    // released bytes.
+    size_t trim(size_t max_cached_bytes = 0)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return trimLocked(max_cached_bytes);
+    }
+
+    CachingAllocatorStats getStats() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return stats_;
+    }
+
+    void resetPeakStats()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats_.peak_allocated_bytes = stats_.allocated_bytes;
+        stats_.peak_reserved_bytes  = stats_.reserved_bytes;
+    }
+
+private:
+    struct Block {
+        size_t       size;        // requested size
+        size_t       block_size;  // size obtained from the backend
+        cudaStream_t stream;
+    };
+
+    // Takes the smallest cached block of stream which fits *block_size, and sets *block_size to its size.
+    void* takeCachedBlock(size_t* block_size, cudaStream_t stream)
+    {
+        auto stream_blocks = free_blocks_.find(stream);
+        if (stream_blocks == free_blocks_.end()) {
+            return nullptr;
+        }
+        auto it = stream_blocks->second.lower_bound(*block_size);
+        if (it == stream_blocks->second.end() || it->first > 2 * *block_size) {
+            return nullptr;
+        }
+        void* ptr   = it->second;
+        *block_size = it->first;
+        stats_.cached_bytes -= it->first;
+        stream_blocks->second.erase(it);
+        return ptr;
+    }
+
+    size_t trimLocked(size_t max_cached_bytes)
+    {
+        size_t released = 0;
+        while (stats_.cached_bytes > max_cached_bytes) {
+            // the largest cached block over all streams
+            auto largest = free_blocks_.end();
+            for (auto it = free_blocks_.begin(); it != free_blocks_.end(); ++it) {
+                if (it->second.empty()) {
+                    continue;
+                }
+                if (largest == free_blocks_.end() || it->second.rbegin()->first > largest->second.rbegin()->first) {
+                    largest = it;
+                }
+            }
+            auto         block      = std::prev(largest->second.end());
+            const size_t block_size = block->first;
+            backend_->deallocate(block->second, block_size, largest->first);
+            largest->second.erase(block);
+            stats_.cached_bytes -= block_size;
+            stats_.reserved_bytes -= block_size;
+            stats_.num_backend_frees++;
+            released += block_size;
+        }
+        return released;
+    }
+
+    IBlockBackend* backend_;
+    const bool     is_caching_;
+
+    mutable std::mutex                                   mutex_;
+    std::unordered_map<void*, Block>                     live_blocks_;
+    std::map<cudaStream_t, std::multimap<size_t, void*>> free_blocks_;  // cached blocks by stream and size
+    CachingAllocatorStats                                stats_;
+};
+
+}  // namespace fastertransformer
@@ -18,138 +18,145 @@
 
 namespace fastertransformer {
 
+namespace {
+
+bool isNearestAlgoEnabled()
+{
+    char* env = std::getenv("FT_GEMM_ALGO_FALLBACK");
+    return env != nullptr && std::string(env) == "ON";
+}
+
+}  // namespace
+
+cublasAlgoMap::cublasAlgoMap(): use_nearest_algo_(isNearestAlgoEnabled()) {}
+
 cublasAlgoMap::cublasAlgoMap(const std::string filename, const std::string sp_config_filename):
-    config_filename_(filename), sp_config_filename_(sp_config_filename)
+    config_filename_(filename), sp_config_filename_(sp_config_filename), use_nearest_algo_(isNearestAlgoEnabled())
 {
     loadGemmConfig();
     loadSpGemmConfig();
 }
 
 cublasAlgoMap::cublasAlgoMap(const cublasAlgoMap& algo_map):
+    algo_cache_(algo_map.algo_cache_),
     config_filename_(algo_map.config_filename_),
     sp_config_filename_(algo_map.sp_config_filename_),
-    algo_map_(algo_map.algo_map_),
-    sp_algo_map_(algo_map.sp_algo_map_)
+    sp_algo_map_(algo_map.sp_algo_map_),
+    use_nearest_algo_(algo_map.use_nearest_algo_)
 {
 }
 
+cublasAlgoMap& cublasAlgoMap::operator=(const cublasAlgoMap& algo_map)
+{
+    algo_cache_         = algo_map.algo_cache_;
+    config_filename_    = algo_map.config_filename_;
+    sp_config_filename_ = algo_map.sp_config_filename_;
+    sp_algo_map_        = algo_map.sp_algo_map_;
+    use_nearest_algo_   = algo_map.use_nearest_algo_;
+    exact_hits_         = 0;
+    nearest_hits_       = 0;
+    misses_             = 0;
+    return *this;
+}
+
 cublasAlgoMap::~cublasAlgoMap()
 {
-    algo_map_.clear();
+    cublasAlgoMapStats stats = getStats();
+    if (stats.exact_hits + stats.nearest_hits + stats.misses > 0) {
+        FT_LOG_DEBUG("cublasAlgoMap %s: %ld exact hits, %ld nearest hits, %ld misses",
+                     config_filename_.c_str(),
+                     stats.exact_hits,
+                     stats.nearest_hits,
+                     stats.misses);
+    }
 }
 
 void cublasAlgoMap::loadGemmConfig()
 {
-    FILE* fd;
-    fd = fopen(config_filename_.c_str(), "r");
-    if (fd == NULL) {
+    algo_cache_ = getSharedGemmAlgoCache(config_filename_);
+    if (algo_cache_ == nullptr) {
         std::cout << "[WARNING] " << config_filename_ << " is not found; using default GEMM algo" << std::endl;
-        return;
-    }
-
-    int   batchCount2, m2, n2, k2, algoId, customOption, tile, splitK_val;
-    int   batch_size, seq_len, head_num, size_per_head, dataType;
-    int   swizzle, reductionScheme, workspaceSize, stages;
-    int   inner_shapeId, cluster_shapeId, mma_shapeId, cga_shapeId, sche_mode;
-    float exec_time;
-    char  tmp[1024];
-    if (!fgets(tmp, 1024, fd)) {
-        printf("[ERROR] fgets fail at %s:%d \n", __FILE__, __LINE__);
-        exit(-1);
     }
-    while (fscanf(fd,
-                  "%d %d %d %d %d ### %d %d %d %d %d %d %d %d %d %d %d %d "
-#if (CUBLAS_VER_MAJOR == 11 && CUBLAS_VER_MINOR == 11 && CUBLAS_VER_PATCH >= 3)
-                  "%d %d "
-#elif (CUBLAS_VER_MAJOR == 11 && CUBLAS_VER_MINOR == 11 && CUBLAS_VER_PATCH < 3)
-                  "%d %d %d "
-#endif
-                  "%f\n",
-                  &batch_size,
-                  &seq_len,
-                  &head_num,
-                  &size_per_head,
-                  &dataType,
-                  &batchCount2,
-                  &n2,
-                  &m2,
-                  &k2,
-                  &algoId,
-                  &customOption,
-                  &tile,
-                  &splitK_val,
-                  &swizzle,
-                  &reductionScheme,
-                  &workspaceSize,
-                  &stages,
-#if (CUBLAS_VER_MAJOR == 11 && CUBLAS_VER_MINOR == 11 && CUBLAS_VER_PATCH >= 3)
-                  &inner_shapeId,
-                  &cluster_shapeId,
-#elif (CUBLAS_VER_MAJOR == 11 && CUBLAS_VER_MINOR == 11 && CUBLAS_VER_PATCH < 3)
-                  &mma_shapeId,
-                  &cga_shapeId,
-                  &sche_mode,
-#endif
-                  &exec_time)
-           != EOF) {
-        if (dataType != FLOAT_DATATYPE && dataType != HALF_DATATYPE && dataType != BFLOAT16_DATATYPE
-            && dataType != INT8_DATATYPE && dataType != FP8_DATATYPE) {
-            printf("[WARNING][readAlgoFromConfig] wrong dataType %d!\n", dataType);
-            continue;
-        }
-        cublasAlgoConfig_t markStr{batchCount2, m2, n2, k2, static_cast<CublasDataType>(dataType)};
-        // workspaceSize should be zero
-        if (algo_map_.find(markStr) == algo_map_.end()) {
-            algo_map_[markStr].algoId          = algoId;
-            algo_map_[markStr].customOption    = customOption;
-            algo_map_[markStr].tile            = tile;
-            algo_map_[markStr].splitK_val      = splitK_val;
-            algo_map_[markStr].swizzle         = swizzle;
-            algo_map_[markStr].reductionScheme = reductionScheme;
-            algo_map_[markStr].workspaceSize   = workspaceSize;
-            algo_map_[markStr].stages          = stages;
-#if (CUBLAS_VER_MAJOR == 11 && CUBLAS_VER_MINOR == 11 && CUBLAS_VER_PATCH >= 3)
-            algo_map_[markStr].inner_shapeId   = (uint16_t)inner_shapeId;
-            algo_map_[markStr].cluster_shapeId = (uint16_t)cluster_shapeId;
-#elif (CUBLAS_VER_MAJOR == 11 && CUBLAS_VER_MINOR == 11 && CUBLAS_VER_PATCH < 3)
-            algo_map_[markStr].mma_shapeId = (uint16_t)mma_shapeId;
-            algo_map_[markStr].cga_shapeId = (uint16_t)cga_shapeId;
-            algo_map_[markStr].sche_mode   = (uint16_t)sche_mode;
-#endif
-            algo_map_[markStr].exec_time = exec_time;
-        }
-    }
-    fclose(fd);
 }
 
 bool cublasAlgoMap::isExist(
     const int batch_count, const int m, const int n, const int k, const CublasDataType data_type)
 {
-    cublasAlgoConfig_t mark{batch_count, n, m, k, data_type};
-    return algo_map_.find(mark) != algo_map_.end();
+    return algo_cache_ != nullptr && algo_cache_->find(batch_count, n, m, k, data_type) != nullptr;
 }
 
 cublasLtMatmulAlgo_info
 cublasAlgoMap::getAlgo(const int batch_count, const int m, const int n, const int k, const CublasDataType data_type)
 {
-    cublasAlgoConfig_t mark{batch_count, n, m, k, data_type};
-    if (algo_map_.find(mark) != algo_map_.end()) {
-        return algo_map_[mark];
+    cublasLtMatmulAlgo_info info;
+    lookupAlgo(batch_count, m, n, k, data_type, &info);
+    return info;
+}
+
+cublasAlgoMatch cublasAlgoMap::lookupAlgo(const int                batch_count,
+                                          const int                m,
+                                          const int                n,
+                                          const int                k,
+                                          const CublasDataType     data_type,
+                                          cublasLtMatmulAlgo_info* info,
+                                          bool                     allow_nearest)
+{
+    const GemmAlgoRecord* record = nullptr;
+    cublasAlgoMatch       match  = cublasAlgoMatch::NONE;
+    if (algo_cache_ != nullptr) {
+        record = algo_cache_->find(batch_count, n, m, k, data_type);
+        if (record == nullptr && allow_nearest && use_nearest_algo_) {
+            record = algo_cache_->findNearest(batch_count, n, m, k, data_type);
+            // cublasGemmEx algorithms have no stages.
+            if (record != nullptr && record->stages == -1) {
+                record = nullptr;
+            }
+        }
+    }
+    if (record != nullptr) {
+        match = record->m == n ? cublasAlgoMatch::EXACT : cublasAlgoMatch::NEAREST;
+        (match == cublasAlgoMatch::EXACT ? exact_hits_ : nearest_hits_)++;
+        info->algoId          = record->algoId;
+        info->customOption    = record->customOption;
+        info->tile            = record->tile;
+        info->splitK_val      = record->splitK_val;
+        info->swizzle         = record->swizzle;
+        info->reductionScheme = record->reductionScheme;
+        info->workspaceSize   = record->workspaceSize;
+        info->stages          = record->stages;
+#if (CUBLAS_VER_MAJOR == 11 && CUBLAS_VER_MINOR == 11 && CUBLAS_VER_PATCH >= 3)
+        info->inner_shapeId   = record->inner_shapeId;
+        info->cluster_shapeId = record->cluster_shapeId;
+#elif (CUBLAS_VER_MAJOR == 11 && CUBLAS_VER_MINOR == 11 && CUBLAS_VER_PATCH < 3)
+        info->mma_shapeId = record->mma_shapeId;
+        info->cga_shapeId = record->cga_shapeId;
+        info->sche_mode   = record->sche_mode;
+#endif
+        info->exec_time = record->exec_time;
     }
     else {
-        cublasLtMatmulAlgo_info tmp_algo;
-        tmp_algo.algoId =
+        misses_++;
+        info->algoId =
             static_cast<int>(data_type == FLOAT_DATATYPE ? CUBLAS_GEMM_DEFAULT : CUBLAS_GEMM_DEFAULT_TENSOR_OP);
-        tmp_algo.customOption    = -1;
-        tmp_algo.tile            = -1;
-        tmp_algo.splitK_val      = -1;
-        tmp_algo.swizzle         = -1;
-        tmp_algo.reductionScheme = -1;
-        tmp_algo.workspaceSize   = -1;
-        tmp_algo.stages          = -1;
-        tmp_algo.exec_time       = -1.0f;
-        return tmp_algo;
+        info->customOption    = -1;
+        info->tile            = -1;
+        info->splitK_val      = -1;
+        info->swizzle         = -1;
+        info->reductionScheme = -1;
+        info->workspaceSize   = -1;
+        info->stages          = -1;
+        info->exec_time       = -1.0f;
     }
+    return match;
+}
+
+cublasAlgoMapStats cublasAlgoMap::getStats() const
+{
+    cublasAlgoMapStats stats;
+    stats.exact_hits   = exact_hits_;
+    stats.nearest_hits = nearest_hits_;
+    stats.misses       = misses_;
+    return stats;
 }
 
 void cublasAlgoMap::loadSpGemmConfig()
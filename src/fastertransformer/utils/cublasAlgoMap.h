@@ -15,12 +15,14 @@
  */
 
 #include "src/fastertransformer/utils/cuda_utils.h"
+#include "src/fastertransformer/utils/gemm_algo_cache.h"
+#include <atomic>
 #include <cublasLt.h>
 #include <cublas_v2.h>
 #include <cuda_runtime.h>
 #include <map>
+#include <memory>
 #include <string>
-#include <unordered_map>
 #include <utility>
 
 #pragma once
@@ -70,26 +72,36 @@ struct cublasAlgoConfig_t {
     }
 };
 
-class cublasAlgoConfig_hasher {
-public:
-    std::size_t operator()(cublasAlgoConfig_t const& config) const
-    {
-        return config.batch_count * 98317ull ^ config.m * 49157ull ^ config.n * 24593ull ^ config.k * 196613ull
-               ^ static_cast<int>(config.data_type) * 6151ull;
-    }
+enum class cublasAlgoMatch {
+    NONE,     // no tuned algorithm, the default one is used
+    EXACT,    // tuned for this exact shape
+    NEAREST,  // tuned for the nearest shape of the same bucket, see GemmAlgoCache::findNearest
+};
+
+struct cublasAlgoMapStats {
+    size_t exact_hits   = 0;
+    size_t nearest_hits = 0;
+    size_t misses       = 0;
 };
 
 class cublasAlgoMap {
 private:
-    std::unordered_map<cublasAlgoConfig_t, cublasLtMatmulAlgo_info, cublasAlgoConfig_hasher> algo_map_;
-    std::string                                                                              config_filename_;
-    std::string                                                                              sp_config_filename_;
-    std::map<std::string, int>                                                               sp_algo_map_;
+    // Read-only and shared with every other cublasAlgoMap loaded from the same config.
+    std::shared_ptr<const GemmAlgoCache> algo_cache_;
+    std::string                          config_filename_;
+    std::string                          sp_config_filename_;
+    std::map<std::string, int>           sp_algo_map_;
+    // Lets lookupAlgo fall back to the nearest tuned shape, only with FT_GEMM_ALGO_FALLBACK=ON.
+    bool                use_nearest_algo_ = true;
+    std::atomic<size_t> exact_hits_{0};
+    std::atomic<size_t> nearest_hits_{0};
+    std::atomic<size_t> misses_{0};
 
 public:
-    cublasAlgoMap(){};
+    cublasAlgoMap();
     explicit cublasAlgoMap(const std::string filename, const std::string sp_config_filename = "");
     cublasAlgoMap(const cublasAlgoMap& map);
+    cublasAlgoMap& operator=(const cublasAlgoMap& map);
     ~cublasAlgoMap();
     void loadGemmConfig();
     void loadSpGemmConfig();
@@ -98,8 +110,23 @@ public:
 
     bool isExist(const int batch_count, const int m, const int n, const int k, const CublasDataType data_type);
 
+    // The algorithm tuned for this exact shape, or the default one.
     cublasLtMatmulAlgo_info
     getAlgo(const int batch_count, const int m, const int n, const int k, const CublasDataType data_type);
+
+    // Same as getAlgo, and tells where the returned algorithm comes from. With allow_nearest, a shape which was not
+    // tuned takes the cublasLt algorithm of the nearest shape of its bucket instead. A NEAREST algorithm was tuned for
+    // another value of n, the dimension which follows the number of tokens, so the caller must check it supports this
+    // shape with cublasLtMatmulAlgoCheck. cublasGemmEx algorithms cannot be checked, so they only match exactly.
+    cublasAlgoMatch lookupAlgo(const int                batch_count,
+                               const int                m,
+                               const int                n,
+                               const int                k,
+                               const CublasDataType     data_type,
+                               cublasLtMatmulAlgo_info* info,
+                               bool                     allow_nearest = false);
+
+    cublasAlgoMapStats getStats() const;
 };
 
 }  // namespace fastertransformer
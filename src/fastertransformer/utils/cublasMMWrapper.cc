@@ -179,9 +179,12 @@ void cublasMMWrapper::Gemm(cublasOperation_t transa,
     const void* alpha = is_fp16_computeType ? reinterpret_cast<void*>(&h_alpha) : reinterpret_cast<void*>(&f_alpha);
     const void* beta  = is_fp16_computeType ? reinterpret_cast<void*>(&h_beta) : reinterpret_cast<void*>(&f_beta);
 
-    int findAlgo = cublas_algo_map_->isExist(batch_count, m, n, k, getCublasDataType(Atype_));
-
-    cublasLtMatmulAlgo_info info = cublas_algo_map_->getAlgo(batch_count, m, n, k, getCublasDataType(Atype_));
+    // A NEAREST algorithm is a cublasLt one, checked against this shape below. It is only taken when cublasLt is
+    // already the default, so that it never moves a GEMM from cublasGemmEx to cublasLtMatmul.
+    cublasLtMatmulAlgo_info info;
+    const cublasAlgoMatch   match =
+        cublas_algo_map_->lookupAlgo(batch_count, m, n, k, getCublasDataType(Atype_), &info, using_cublasLt);
+    int findAlgo = match != cublasAlgoMatch::NONE;
     if (findAlgo) {
         if (info.stages != -1) {
             using_cublasLt = true;
@@ -275,6 +278,15 @@ void cublasMMWrapper::Gemm(cublasOperation_t transa,
                 cublasLtMatmulAlgoConfigSetAttribute(
                     &algo, CUBLASLT_ALGO_CONFIG_SCHEDULING_MODE, &(info.sche_mode), sizeof(info.sche_mode));
 #endif
+                // An algorithm tuned for another shape may not support this one.
+                cublasLtMatmulHeuristicResult_t heuristic_result;
+                if (match == cublasAlgoMatch::NEAREST
+                    && (cublasLtMatmulAlgoCheck(
+                            cublaslt_handle_, operationDesc, Adesc, Bdesc, Cdesc, Cdesc, &algo, &heuristic_result)
+                            != CUBLAS_STATUS_SUCCESS
+                        || heuristic_result.workspaceSize > (size_t)workspaceSize)) {
+                    findAlgo = 0;
+                }
             }
         }
 
@@ -0,0 +1,46 @@
+/*
+ * Copyright (c) 2023, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/fastertransformer/utils/async_logger.h"
+#include "src/fastertransformer/utils/logger.h"
+
+#include <cstring>
+
+namespace ft = fastertransformer;
+
+int main(int argc, char* argv[])
+{
+    const bool print_context = argc == 3 && std::strcmp(argv[2], "--context") == 0;
+    if (argc < 2 || (argc == 3 && !print_context) || argc > 3) {
+        FT_LOG_ERROR("./bin/decode_binary_log log_file [--context]");
+        FT_LOG_ERROR("Prints a log written with FT_LOG_ASYNC_FILE=log_file as text, with --context each line starts "
+                     "with its time and thread.");
+        return 0;
+    }
+
+    FILE* input = fopen(argv[1], "rb");
+    if (input == nullptr) {
+        FT_LOG_ERROR("Cannot open %s", argv[1]);
+        return -1;
+    }
+    const bool is_valid = ft::decodeBinaryLog(input, stdout, print_context);
+    fclose(input);
+    if (!is_valid) {
+        FT_LOG_ERROR("%s is not a binary log, or is truncated", argv[1]);
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,389 @@
+/*
+ * Copyright (c) 2023, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/fastertransformer/utils/gemm_algo_cache.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+
+namespace fastertransformer {
+
+namespace {
+
+bool hasCacheMagic(const std::string& filename)
+{
+    FILE* fd = fopen(filename.c_str(), "rb");
+    if (fd == NULL) {
+        return false;
+    }
+    char magic[sizeof(GEMM_ALGO_CACHE_MAGIC)];
+    bool is_cache = fread(magic, 1, sizeof(magic), fd) == sizeof(magic)
+                    && memcmp(magic, GEMM_ALGO_CACHE_MAGIC, sizeof(magic)) == 0;
+    fclose(fd);
+    return is_cache;
+}
+
+// Returns false if the file does not exist.
+bool getModifiedTime(const std::string& filename, struct timespec* mtime)
+{
+    struct stat st;
+    if (stat(filename.c_str(), &st) != 0) {
+        return false;
+    }
+    *mtime = st.st_mtim;
+    return true;
+}
+
+bool isNotOlder(const struct timespec& a, const struct timespec& b)
+{
+    return a.tv_sec > b.tv_sec || (a.tv_sec == b.tv_sec && a.tv_nsec >= b.tv_nsec);
+}
+
+bool isCacheEnabled()
+{
+    static const bool is_enabled = [] {
+        char* env = std::getenv("FT_GEMM_ALGO_CACHE");
+        return env == nullptr || std::string(env) != "OFF";
+    }();
+    return is_enabled;
+}
+
+}  // namespace
+
+bool operator<(const GemmAlgoRecord& a, const GemmAlgoRecord& b)
+{
+    if (a.data_type != b.data_type) {
+        return a.data_type < b.data_type;
+    }
+    if (a.batch_count != b.batch_count) {
+        return a.batch_count < b.batch_count;
+    }
+    if (a.n != b.n) {
+        return a.n < b.n;
+    }
+    if (a.k != b.k) {
+        return a.k < b.k;
+    }
+    return a.m < b.m;
+}
+
+uint32_t getCublasVersion()
+{
+    return CUBLAS_VER_MAJOR * 10000 + CUBLAS_VER_MINOR * 100 + CUBLAS_VER_PATCH;
+}
+
+GemmAlgoCache::GemmAlgoCache(std::vector<GemmAlgoRecord> records): owned_records_(std::move(records))
+{
+    std::stable_sort(owned_records_.begin(), owned_records_.end());
+    owned_records_.erase(std::unique(owned_records_.begin(),
+                                     owned_records_.end(),
+                                     [](const GemmAlgoRecord& a, const GemmAlgoRecord& b) {
+                                         return !(a < b) && !(b < a);
+                                     }),
+                         owned_records_.end());
+    records_     = owned_records_.data();
+    num_records_ = owned_records_.size();
+}
+
+GemmAlgoCache::GemmAlgoCache(std::shared_ptr<MappedFile> file): file_(file)
+{
+    const GemmAlgoCacheHeader* header = reinterpret_cast<const GemmAlgoCacheHeader*>(file_->data());
+    records_     = reinterpret_cast<const GemmAlgoRecord*>(header + 1);
+    num_records_ = header->num_records;
+}
+
+std::shared_ptr<GemmAlgoCache> GemmAlgoCache::readBinary(const std::string& filename)
+{
+    std::shared_ptr<MappedFile> file = openMappedFile(filename);
+    if (file == nullptr) {
+        return nullptr;
+    }
+    if (file->size() < sizeof(GemmAlgoCacheHeader)) {
+        FT_LOG_WARNING("%s is too small to be a gemm algo cache", filename.c_str());
+        return nullptr;
+    }
+    const GemmAlgoCacheHeader* header = reinterpret_cast<const GemmAlgoCacheHeader*>(file->data());
+    if (memcmp(header->magic, GEMM_ALGO_CACHE_MAGIC, sizeof(GEMM_ALGO_CACHE_MAGIC)) != 0
+        || header->version != GEMM_ALGO_CACHE_VERSION || header->record_size != sizeof(GemmAlgoRecord)) {
+        FT_LOG_WARNING("%s is not a gemm algo cache of version %d", filename.c_str(), GEMM_ALGO_CACHE_VERSION);
+        return nullptr;
+    }
+    if (header->cublas_version != getCublasVersion()) {
+        FT_LOG_WARNING("%s was tuned with cuBLAS %d but cuBLAS %d is used",
+                       filename.c_str(),
+                       header->cublas_version,
+                       getCublasVersion());
+        return nullptr;
+    }
+    if (file->size() < sizeof(GemmAlgoCacheHeader) + (size_t)header->num_records * sizeof(GemmAlgoRecord)) {
+        FT_LOG_WARNING("%s is truncated", filename.c_str());
+        return nullptr;
+    }
+    return std::make_shared<GemmAlgoCache>(file);
+}
+
+std::shared_ptr<GemmAlgoCache> GemmAlgoCache::readText(const std::string& filename)
+{
+    FILE* fd = fopen(filename.c_str(), "r");
+    if (fd == NULL) {
+        return nullptr;
+    }
+
+    int   batchCount2, m2, n2, k2, algoId, customOption, tile, splitK_val;
+    int   batch_size, seq_len, head_num, size_per_head, dataType;
+    int   swizzle, reductionScheme, workspaceSize, stages;
+    int   inner_shapeId = 0, cluster_shapeId = 0, mma_shapeId = 0, cga_shapeId = 0, sche_mode = 0;
+    float exec_time;
+    char  tmp[1024];
+    if (!fgets(tmp, 1024, fd)) {
+        fclose(fd);
+        FT_CHECK_WITH_INFO(false, fmtstr("cannot read the header line of the gemm config %s", filename.c_str()));
+    }
+    std::vector<GemmAlgoRecord> records;
+    while (fscanf(fd,
+                  "%d %d %d %d %d ### %d %d %d %d %d %d %d %d %d %d %d %d "
+#if (CUBLAS_VER_MAJOR == 11 && CUBLAS_VER_MINOR == 11 && CUBLAS_VER_PATCH >= 3)
+                  "%d %d "
+#elif (CUBLAS_VER_MAJOR == 11 && CUBLAS_VER_MINOR == 11 && CUBLAS_VER_PATCH < 3)
+                  "%d %d %d "
+#endif
+                  "%f\n",
+                  &batch_size,
+                  &seq_len,
+                  &head_num,
+                  &size_per_head,
+                  &dataType,
+                  &batchCount2,
+                  &n2,
+                  &m2,
+                  &k2,
+                  &algoId,
+                  &customOption,
+                  &tile,
+                  &splitK_val,
+                  &swizzle,
+                  &reductionScheme,
+                  &workspaceSize,
+                  &stages,
+#if (CUBLAS_VER_MAJOR == 11 && CUBLAS_VER_MINOR == 11 && CUBLAS_VER_PATCH >= 3)
+                  &inner_shapeId,
+                  &cluster_shapeId,
+#elif (CUBLAS_VER_MAJOR == 11 && CUBLAS_VER_MINOR == 11 && CUBLAS_VER_PATCH < 3)
+                  &mma_shapeId,
+                  &cga_shapeId,
+                  &sche_mode,
+#endif
+                  &exec_time)
+           != EOF) {
+        if (dataType != FLOAT_DATATYPE && dataType != HALF_DATATYPE && dataType != BFLOAT16_DATATYPE
+            && dataType != INT8_DATATYPE && dataType != FP8_DATATYPE) {
+            FT_LOG_WARNING("wrong dataType %d in the gemm config %s, skipping the record", dataType, filename.c_str());
+            continue;
+        }
+        GemmAlgoRecord record;
+        memset(&record, 0, sizeof(record));
+        record.data_type       = dataType;
+        record.batch_count     = batchCount2;
+        record.m               = m2;
+        record.k               = k2;
+        record.n               = n2;
+        record.batch_size      = batch_size;
+        record.seq_len         = seq_len;
+        record.head_num        = head_num;
+        record.size_per_head   = size_per_head;
+        record.algoId          = algoId;
+        record.customOption    = customOption;
+        record.tile            = tile;
+        record.splitK_val      = splitK_val;
+        record.swizzle         = swizzle;
+        record.reductionScheme = reductionScheme;
+        record.workspaceSize   = workspaceSize;
+        record.stages          = stages;
+        record.inner_shapeId   = (uint16_t)inner_shapeId;
+        record.cluster_shapeId = (uint16_t)cluster_shapeId;
+        record.mma_shapeId     = (uint16_t)mma_shapeId;
+        record.cga_shapeId     = (uint16_t)cga_shapeId;
+        record.sche_mode       = (uint16_t)sche_mode;
+        record.exec_time       = exec_time;
+        records.push_back(record);
+    }
+    fclose(fd);
+    return std::make_shared<GemmAlgoCache>(std::move(records));
+}
+
+std::shared_ptr<GemmAlgoCache> GemmAlgoCache::read(const std::string& filename)
+{
+    return hasCacheMagic(filename) ? readBinary(filename) : readText(filename);
+}
+
+bool GemmAlgoCache::writeBinary(const std::string& filename) const
+{
+    const std::string tmp_filename = filename + ".tmp." + std::to_string(getpid());
+    FILE*             fd           = fopen(tmp_filename.c_str(), "wb");
+    if (fd == NULL) {
+        FT_LOG_WARNING("Cannot open %s to write the gemm algo cache", tmp_filename.c_str());
+        return false;
+    }
+    GemmAlgoCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, GEMM_ALGO_CACHE_MAGIC, sizeof(GEMM_ALGO_CACHE_MAGIC));
+    header.version        = GEMM_ALGO_CACHE_VERSION;
+    header.cublas_version = getCublasVersion();
+    header.record_size    = sizeof(GemmAlgoRecord);
+    header.num_records    = (uint32_t)num_records_;
+
+    bool is_ok = fwrite(&header, sizeof(header), 1, fd) == 1;
+    if (num_records_ > 0) {
+        is_ok = is_ok && fwrite(records_, sizeof(GemmAlgoRecord), num_records_, fd) == num_records_;
+    }
+    is_ok = (fclose(fd) == 0) && is_ok;
+    if (!is_ok || rename(tmp_filename.c_str(), filename.c_str()) != 0) {
+        FT_LOG_WARNING("Cannot write the gemm algo cache %s", filename.c_str());
+        remove(tmp_filename.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool GemmAlgoCache::writeText(const std::string& filename) const
+{
+    FILE* fd = fopen(filename.c_str(), "w");
+    if (fd == NULL) {
+        FT_LOG_WARNING("Cannot open %s to write the gemm config", filename.c_str());
+        return false;
+    }
+    fprintf(fd,
+            "batch_size, seq_len, head_num, size_per_head dataType ### batchCount, n, m, k, algoId, "
+            "customOption, tile, numSplitsK, swizzle, reductionScheme, workspaceSize, stages, "
+#if (CUBLAS_VER_MAJOR == 11 && CUBLAS_VER_MINOR == 11 && CUBLAS_VER_PATCH >= 3)
+            "inner_shapeId, cluster_shapeId, "
+#elif (CUBLAS_VER_MAJOR == 11 && CUBLAS_VER_MINOR == 11 && CUBLAS_VER_PATCH < 3)
+            "mma_shapeId, cga_shapeId, sche_mode, "
+#endif
+            "exec_time\n");
+    for (const GemmAlgoRecord& r : *this) {
+        fprintf(fd,
+                "%d %d %d %d %d ### %d %d %d %d %d %d %d %d %d %d %d %d ",
+                r.batch_size,
+                r.seq_len,
+                r.head_num,
+                r.size_per_head,
+                r.data_type,
+                r.batch_count,
+                r.n,
+                r.m,
+                r.k,
+                r.algoId,
+                r.customOption,
+                r.tile,
+                r.splitK_val,
+                r.swizzle,
+                r.reductionScheme,
+                r.workspaceSize,
+                r.stages);
+#if (CUBLAS_VER_MAJOR == 11 && CUBLAS_VER_MINOR == 11 && CUBLAS_VER_PATCH >= 3)
+        fprintf(fd, "%d %d ", r.inner_shapeId, r.cluster_shapeId);
+#elif (CUBLAS_VER_MAJOR == 11 && CUBLAS_VER_MINOR == 11 && CUBLAS_VER_PATCH < 3)
+        fprintf(fd, "%d %d %d ", r.mma_shapeId, r.cga_shapeId, r.sche_mode);
+#endif
+        fprintf(fd, "%f\n", r.exec_time);
+    }
+    return fclose(fd) == 0;
+}
+
+const GemmAlgoRecord*
+GemmAlgoCache::find(const int batch_count, const int m, const int n, const int k, const int data_type) const
+{
+    GemmAlgoRecord key;
+    key.data_type   = data_type;
+    key.batch_count = batch_count;
+    key.m           = m;
+    key.k           = k;
+    key.n           = n;
+    const GemmAlgoRecord* it = std::lower_bound(begin(), end(), key);
+    if (it == end() || key < *it) {
+        return nullptr;
+    }
+    return it;
+}
+
+const GemmAlgoRecord*
+GemmAlgoCache::findNearest(const int batch_count, const int m, const int n, const int k, const int data_type) const
+{
+    auto is_same_bucket = [&](const GemmAlgoRecord& record) {
+        return record.data_type == data_type && record.batch_count == batch_count && record.n == n && record.k == k;
+    };
+    GemmAlgoRecord key;
+    key.data_type   = data_type;
+    key.batch_count = batch_count;
+    key.m           = m;
+    key.k           = k;
+    key.n           = n;
+    const GemmAlgoRecord* it = std::lower_bound(begin(), end(), key);
+    if (it != end() && is_same_bucket(*it)) {
+        return it;
+    }
+    if (it != begin() && is_same_bucket(*(it - 1))) {
+        return it - 1;
+    }
+    return nullptr;
+}
+
+std::shared_ptr<const GemmAlgoCache> getSharedGemmAlgoCache(const std::string& config_filename)
+{
+    static std::mutex                                                          mutex;
+    static std::unordered_map<std::string, std::weak_ptr<const GemmAlgoCache>> caches;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    std::shared_ptr<const GemmAlgoCache> cache = caches[config_filename].lock();
+    if (cache != nullptr) {
+        return cache;
+    }
+
+    struct timespec config_mtime;
+    if (!getModifiedTime(config_filename, &config_mtime)) {
+        return nullptr;
+    }
+    if (hasCacheMagic(config_filename)) {
+        cache = GemmAlgoCache::readBinary(config_filename);
+    }
+    else if (isCacheEnabled()) {
+        const std::string cache_filename = config_filename + GEMM_ALGO_CACHE_SUFFIX;
+        struct timespec   cache_mtime;
+        if (getModifiedTime(cache_filename, &cache_mtime) && isNotOlder(cache_mtime, config_mtime)) {
+            cache = GemmAlgoCache::readBinary(cache_filename);
+        }
+        if (cache == nullptr) {
+            std::shared_ptr<GemmAlgoCache> text_cache = GemmAlgoCache::readText(config_filename);
+            if (text_cache != nullptr && text_cache->writeBinary(cache_filename)) {
+                FT_LOG_DEBUG("Write gemm algo cache %s", cache_filename.c_str());
+            }
+            cache = text_cache;
+        }
+    }
+    else {
+        cache = GemmAlgoCache::readText(config_filename);
+    }
+    caches[config_filename] = cache;
+    return cache;
+}
+
+}  // namespace fastertransformer
@@ -0,0 +1,143 @@
+/*
+ * Copyright (c) 2023, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Binary cache of tuned GEMM algorithms.
+ *
+ * The text gemm_config.in produced by the gemm tests is parsed once and stored as
+ *
+ *   [header][record 0][record 1]...
+ *
+ * where the fixed-size records are sorted by (data_type, batch_count, n, k, m). A lookup is a binary search over
+ * the records, which are used in place from a read-only mapping of the file, so every cublasAlgoMap of a process
+ * (and the page cache across processes) shares a single copy of the table.
+ *
+ * m is the dimension which follows the number of tokens, so the records of a shape bucket (every m tuned for a
+ * given data_type, batch_count, n and k) are contiguous and sorted by m.
+ **/
+
+#pragma once
+
+#include "src/fastertransformer/utils/cuda_utils.h"
+#include "src/fastertransformer/utils/mmap_utils.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace fastertransformer {
+
+static const char     GEMM_ALGO_CACHE_MAGIC[8] = {'F', 'T', 'A', 'L', 'G', 'O', '\0', '\0'};
+static const uint32_t GEMM_ALGO_CACHE_VERSION  = 2;
+static const char     GEMM_ALGO_CACHE_SUFFIX[] = ".bin";
+
+struct GemmAlgoCacheHeader {
+    char     magic[8];
+    uint32_t version;
+    uint32_t cublas_version;  // algorithms tuned with another cuBLAS are not reused
+    uint32_t record_size;
+    uint32_t num_records;
+};
+
+struct GemmAlgoRecord {
+    // lookup key, with the same meaning as cublasAlgoConfig_t
+    int32_t data_type;
+    int32_t batch_count;
+    int32_t m;
+    int32_t k;
+    int32_t n;
+    // problem the algorithm was tuned for, only kept to export the text format
+    int32_t batch_size;
+    int32_t seq_len;
+    int32_t head_num;
+    int32_t size_per_head;
+    // tuned algorithm, see cublasLtMatmulAlgo_info
+    int32_t  algoId;
+    int32_t  customOption;
+    int32_t  tile;
+    int32_t  splitK_val;
+    int32_t  swizzle;
+    int32_t  reductionScheme;
+    int32_t  workspaceSize;
+    int32_t  stages;
+    uint16_t inner_shapeId;
+    uint16_t cluster_shapeId;
+    uint16_t mma_shapeId;
+    uint16_t cga_shapeId;
+    uint16_t sche_mode;
+    uint16_t reserved;
+    float    exec_time;
+};
+
+// Orders by (data_type, batch_count, n, k, m). m comes last so that findNearest scans a contiguous range of m.
+bool operator<(const GemmAlgoRecord& a, const GemmAlgoRecord& b);
+
+uint32_t getCublasVersion();
+
+// Immutable, sorted table of tuned algorithms.
+class GemmAlgoCache {
+public:
+    // Sorts the records and drops duplicated keys; the first record of a key wins, as in the text format.
+    explicit GemmAlgoCache(std::vector<GemmAlgoRecord> records);
+    // Uses the records of a mapped binary cache in place.
+    explicit GemmAlgoCache(std::shared_ptr<MappedFile> file);
+
+    // Returns nullptr if the file is missing or not a valid cache for the current cuBLAS.
+    static std::shared_ptr<GemmAlgoCache> readBinary(const std::string& filename);
+    // Parses the text format written by the gemm tests. Returns nullptr if the file is missing.
+    static std::shared_ptr<GemmAlgoCache> readText(const std::string& filename);
+    // Reads either format, detected by the magic of the file.
+    static std::shared_ptr<GemmAlgoCache> read(const std::string& filename);
+
+    // Writes to a temporary file which is renamed, so concurrent readers never see a partial cache.
+    bool writeBinary(const std::string& filename) const;
+    bool writeText(const std::string& filename) const;
+
+    const GemmAlgoRecord* find(const int batch_count, const int m, const int n, const int k, const int data_type) const;
+    // Returns the exact record if it exists, otherwise the record of the same bucket with the smallest m larger than
+    // the requested one, otherwise the record of the bucket with the largest m. nullptr if the bucket is empty.
+    const GemmAlgoRecord*
+    findNearest(const int batch_count, const int m, const int n, const int k, const int data_type) const;
+
+    const GemmAlgoRecord* begin() const
+    {
+        return records_;
+    }
+    const GemmAlgoRecord* end() const
+    {
+        return records_ + num_records_;
+    }
+    size_t size() const
+    {
+        return num_records_;
+    }
+
+private:
+    std::shared_ptr<MappedFile> file_;
+    std::vector<GemmAlgoRecord> owned_records_;
+    const GemmAlgoRecord*       records_     = nullptr;
+    size_t                      num_records_ = 0;
+};
+
+// Returns the table of config_filename, shared by every caller of the process.
+// A text config is parsed once and its binary cache is stored next to it, as config_filename + ".bin", so later
+// processes map the cache instead of parsing the text again. The cache is rebuilt when the text config is newer.
+// Set FT_GEMM_ALGO_CACHE=OFF to disable reading and writing the binary cache of a text config.
+// Returns nullptr if config_filename does not exist.
+std::shared_ptr<const GemmAlgoCache> getSharedGemmAlgoCache(const std::string& config_filename);
+
+}  // namespace fastertransformer
@@ -0,0 +1,46 @@
+/*
+ * Copyright (c) 2023, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/fastertransformer/utils/gemm_algo_cache.h"
+
+namespace ft = fastertransformer;
+
+int main(int argc, char* argv[])
+{
+    if (argc != 4 || (std::string(argv[1]) != "import" && std::string(argv[1]) != "export")) {
+        FT_LOG_ERROR("./bin/gemm_algo_cache_tool import gemm_config.in gemm_config.in.bin");
+        FT_LOG_ERROR("./bin/gemm_algo_cache_tool export gemm_config.in.bin gemm_config.in");
+        return 0;
+    }
+
+    const std::string mode        = argv[1];
+    const std::string input_file  = argv[2];
+    const std::string output_file = argv[3];
+
+    std::shared_ptr<ft::GemmAlgoCache> cache =
+        mode == "import" ? ft::GemmAlgoCache::readText(input_file) : ft::GemmAlgoCache::readBinary(input_file);
+    if (cache == nullptr) {
+        FT_LOG_ERROR("Cannot read %s", input_file.c_str());
+        return -1;
+    }
+    bool is_ok = mode == "import" ? cache->writeBinary(output_file) : cache->writeText(output_file);
+    if (!is_ok) {
+        FT_LOG_ERROR("Cannot write %s", output_file.c_str());
+        return -1;
+    }
+    FT_LOG_INFO("Wrote %ld gemm algorithms to %s", cache->size(), output_file.c_str());
+    return 0;
+}
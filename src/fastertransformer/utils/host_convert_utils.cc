@@ -0,0 +1,422 @@
+/*
+ * Copyright (c) 2023, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/fastertransformer/utils/host_convert_utils.h"
+#include "src/fastertransformer/utils/logger.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define FT_HOST_CONVERT_X86
+#include <immintrin.h>
+#define FT_TARGET_AVX2 __attribute__((target("avx2,f16c")))
+#define FT_TARGET_AVX512 __attribute__((target("avx512f,avx2,f16c")))
+#endif
+
+namespace fastertransformer {
+
+namespace {
+
+// Storage formats. half and bfloat16 are handled through their bit patterns, so that the conversions do not depend
+// on the host implementation of the CUDA types.
+enum class HostFormat {
+    FP32,
+    FP16,
+    BF16,
+    INT8
+};
+
+template<typename T>
+struct HostFormatOf;
+template<>
+struct HostFormatOf<float> {
+    static constexpr HostFormat value = HostFormat::FP32;
+};
+template<>
+struct HostFormatOf<half> {
+    static constexpr HostFormat value = HostFormat::FP16;
+};
+template<>
+struct HostFormatOf<int8_t> {
+    static constexpr HostFormat value = HostFormat::INT8;
+};
+#ifdef ENABLE_BF16
+template<>
+struct HostFormatOf<__nv_bfloat16> {
+    static constexpr HostFormat value = HostFormat::BF16;
+};
+#endif
+
+static const uint16_t CANONICAL_NAN_16 = 0x7fff;
+static const uint32_t CANONICAL_NAN_32 = 0x7fffffff;
+
+inline uint32_t floatAsBits(float f)
+{
+    uint32_t u;
+    memcpy(&u, &f, sizeof(u));
+    return u;
+}
+
+inline float bitsAsFloat(uint32_t u)
+{
+    float f;
+    memcpy(&f, &u, sizeof(f));
+    return f;
+}
+
+/* ******************************** scalar path ******************************** */
+
+uint16_t float2halfBits(float f)
+{
+    const uint32_t f32_infty         = 255u << 23;
+    const uint32_t f16_max           = (127u + 16u) << 23;
+    const uint32_t denorm_magic_bits = ((127u - 15u) + (23u - 10u) + 1u) << 23;
+
+    uint32_t x    = floatAsBits(f);
+    uint32_t sign = x & 0x80000000u;
+    x ^= sign;
+
+    uint16_t o;
+    if (x > f32_infty) {
+        return CANONICAL_NAN_16;
+    }
+    else if (x >= f16_max) {
+        o = 0x7c00;
+    }
+    else if (x < (113u << 23)) {
+        // half subnormals: let the FPU do the round-to-nearest-even by adding a magic number.
+        o = (uint16_t)(floatAsBits(bitsAsFloat(x) + bitsAsFloat(denorm_magic_bits)) - denorm_magic_bits);
+    }
+    else {
+        uint32_t mant_odd = (x >> 13) & 1;
+        x += ((uint32_t)(15 - 127) << 23) + 0xfff + mant_odd;
+        o = (uint16_t)(x >> 13);
+    }
+    return o | (uint16_t)(sign >> 16);
+}
+
+float half2float(uint16_t h)
+{
+    const uint32_t shifted_exp = 0x7c00u << 13;
+
+    if ((h & 0x7fff) > 0x7c00) {
+        return bitsAsFloat(CANONICAL_NAN_32);
+    }
+    uint32_t o   = (uint32_t)(h & 0x7fff) << 13;
+    uint32_t exp = shifted_exp & o;
+    o += (127u - 15u) << 23;
+    if (exp == shifted_exp) {
+        o += (128u - 16u) << 23;
+    }
+    else if (exp == 0) {
+        o += 1u << 23;
+        o = floatAsBits(bitsAsFloat(o) - bitsAsFloat(113u << 23));
+    }
+    return bitsAsFloat(o | ((uint32_t)(h & 0x8000) << 16));
+}
+
+uint16_t float2bfloat16Bits(float f)
+{
+    uint32_t x = floatAsBits(f);
+    if ((x & 0x7fffffffu) > 0x7f800000u) {
+        return CANONICAL_NAN_16;
+    }
+    x += 0x7fffu + ((x >> 16) & 1);
+    return (uint16_t)(x >> 16);
+}
+
+float bfloat162float(uint16_t h)
+{
+    return bitsAsFloat((uint32_t)h << 16);
+}
+
+int8_t float2int8(float f)
+{
+    if (std::isnan(f)) {
+        return 0;
+    }
+    f = std::nearbyint(f);
+    return (int8_t)(f < -128.0f ? -128.0f : (f > 127.0f ? 127.0f : f));
+}
+
+inline float loadScalar(const void* src, HostFormat format, size_t i)
+{
+    switch (format) {
+        case HostFormat::FP32:
+            return ((const float*)src)[i];
+        case HostFormat::FP16:
+            return half2float(((const uint16_t*)src)[i]);
+        case HostFormat::BF16:
+            return bfloat162float(((const uint16_t*)src)[i]);
+        default:
+            return (float)((const int8_t*)src)[i];
+    }
+}
+
+inline void storeScalar(void* dst, HostFormat format, size_t i, float val)
+{
+    switch (format) {
+        case HostFormat::FP32:
+            ((float*)dst)[i] = val;
+            break;
+        case HostFormat::FP16:
+            ((uint16_t*)dst)[i] = float2halfBits(val);
+            break;
+        case HostFormat::BF16:
+            ((uint16_t*)dst)[i] = float2bfloat16Bits(val);
+            break;
+        default:
+            ((int8_t*)dst)[i] = float2int8(val);
+    }
+}
+
+void convertScalar(void* dst, HostFormat dst_format, const void* src, HostFormat src_format, size_t begin, size_t end)
+{
+    for (size_t i = begin; i < end; i++) {
+        storeScalar(dst, dst_format, i, loadScalar(src, src_format, i));
+    }
+}
+
+#ifdef FT_HOST_CONVERT_X86
+
+/* ********************************* AVX2 path ********************************* */
+
+FT_TARGET_AVX2 inline __m256 loadAvx2(const void* src, HostFormat format, size_t i)
+{
+    switch (format) {
+        case HostFormat::FP32:
+            return _mm256_loadu_ps((const float*)src + i);
+        case HostFormat::FP16: {
+            __m256 v   = _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)((const uint16_t*)src + i)));
+            __m256 nan = _mm256_cmp_ps(v, v, _CMP_UNORD_Q);
+            return _mm256_blendv_ps(v, _mm256_castsi256_ps(_mm256_set1_epi32(CANONICAL_NAN_32)), nan);
+        }
+        case HostFormat::BF16: {
+            __m256i v = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)((const uint16_t*)src + i)));
+            return _mm256_castsi256_ps(_mm256_slli_epi32(v, 16));
+        }
+        default: {
+            __m128i v = _mm_loadl_epi64((const __m128i*)((const int8_t*)src + i));
+            return _mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(v));
+        }
+    }
+}
+
+FT_TARGET_AVX2 inline void storeAvx2(void* dst, HostFormat format, size_t i, __m256 v)
+{
+    switch (format) {
+        case HostFormat::FP32:
+            _mm256_storeu_ps((float*)dst + i, v);
+            break;
+        case HostFormat::FP16: {
+            __m128i h     = _mm256_cvtps_ph(v, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+            __m256i nan   = _mm256_castps_si256(_mm256_cmp_ps(v, v, _CMP_UNORD_Q));
+            __m128i nan16 = _mm_packs_epi32(_mm256_castsi256_si128(nan), _mm256_extracti128_si256(nan, 1));
+            h             = _mm_blendv_epi8(h, _mm_set1_epi16(CANONICAL_NAN_16), nan16);
+            _mm_storeu_si128((__m128i*)((uint16_t*)dst + i), h);
+            break;
+        }
+        case HostFormat::BF16: {
+            __m256i x   = _mm256_castps_si256(v);
+            __m256i lsb = _mm256_and_si256(_mm256_srli_epi32(x, 16), _mm256_set1_epi32(1));
+            x = _mm256_srli_epi32(_mm256_add_epi32(_mm256_add_epi32(x, _mm256_set1_epi32(0x7fff)), lsb), 16);
+            __m256i nan = _mm256_castps_si256(_mm256_cmp_ps(v, v, _CMP_UNORD_Q));
+            x           = _mm256_blendv_epi8(x, _mm256_set1_epi32(CANONICAL_NAN_16), nan);
+            // packus works within 128-bit lanes, gather the two low halves afterwards.
+            x = _mm256_permute4x64_epi64(_mm256_packus_epi32(x, x), 0x08);
+            _mm_storeu_si128((__m128i*)((uint16_t*)dst + i), _mm256_castsi256_si128(x));
+            break;
+        }
+        default: {
+            __m256  nan = _mm256_cmp_ps(v, v, _CMP_UNORD_Q);
+            __m256  c   = _mm256_andnot_ps(nan, v);
+            __m256i x   = _mm256_cvtps_epi32(_mm256_min_ps(_mm256_max_ps(c, _mm256_set1_ps(-128.0f)),
+                                                         _mm256_set1_ps(127.0f)));
+            __m128i x16 = _mm_packs_epi32(_mm256_castsi256_si128(x), _mm256_extracti128_si256(x, 1));
+            _mm_storel_epi64((__m128i*)((int8_t*)dst + i), _mm_packs_epi16(x16, x16));
+        }
+    }
+}
+
+FT_TARGET_AVX2 void
+convertAvx2(void* dst, HostFormat dst_format, const void* src, HostFormat src_format, size_t begin, size_t end)
+{
+    size_t i = begin;
+    for (; i + 8 <= end; i += 8) {
+        storeAvx2(dst, dst_format, i, loadAvx2(src, src_format, i));
+    }
+    convertScalar(dst, dst_format, src, src_format, i, end);
+}
+
+/* ******************************** AVX-512 path ******************************* */
+
+FT_TARGET_AVX512 inline __m512 loadAvx512(const void* src, HostFormat format, size_t i)
+{
+    switch (format) {
+        case HostFormat::FP32:
+            return _mm512_loadu_ps((const float*)src + i);
+        case HostFormat::FP16: {
+            __m512    v   = _mm512_cvtph_ps(_mm256_loadu_si256((const __m256i*)((const uint16_t*)src + i)));
+            __mmask16 nan = _mm512_cmp_ps_mask(v, v, _CMP_UNORD_Q);
+            return _mm512_mask_mov_ps(v, nan, _mm512_castsi512_ps(_mm512_set1_epi32(CANONICAL_NAN_32)));
+        }
+        case HostFormat::BF16: {
+            __m512i v = _mm512_cvtepu16_epi32(_mm256_loadu_si256((const __m256i*)((const uint16_t*)src + i)));
+            return _mm512_castsi512_ps(_mm512_slli_epi32(v, 16));
+        }
+        default: {
+            __m128i v = _mm_loadu_si128((const __m128i*)((const int8_t*)src + i));
+            return _mm512_cvtepi32_ps(_mm512_cvtepi8_epi32(v));
+        }
+    }
+}
+
+FT_TARGET_AVX512 inline void storeAvx512(void* dst, HostFormat format, size_t i, __m512 v)
+{
+    __mmask16 nan = _mm512_cmp_ps_mask(v, v, _CMP_UNORD_Q);
+    switch (format) {
+        case HostFormat::FP32:
+            _mm512_storeu_ps((float*)dst + i, v);
+            break;
+        case HostFormat::FP16: {
+            __m256i h     = _mm512_cvtps_ph(v, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+            __m256i nan16 = _mm512_cvtepi32_epi16(_mm512_maskz_set1_epi32(nan, -1));
+            h             = _mm256_blendv_epi8(h, _mm256_set1_epi16(CANONICAL_NAN_16), nan16);
+            _mm256_storeu_si256((__m256i*)((uint16_t*)dst + i), h);
+            break;
+        }
+        case HostFormat::BF16: {
+            __m512i x   = _mm512_castps_si512(v);
+            __m512i lsb = _mm512_and_si512(_mm512_srli_epi32(x, 16), _mm512_set1_epi32(1));
+            x = _mm512_srli_epi32(_mm512_add_epi32(_mm512_add_epi32(x, _mm512_set1_epi32(0x7fff)), lsb), 16);
+            x = _mm512_mask_mov_epi32(x, nan, _mm512_set1_epi32(CANONICAL_NAN_16));
+            _mm256_storeu_si256((__m256i*)((uint16_t*)dst + i), _mm512_cvtepi32_epi16(x));
+            break;
+        }
+        default: {
+            __m512  c = _mm512_mask_mov_ps(v, nan, _mm512_setzero_ps());
+            __m512i x = _mm512_cvtps_epi32(
+                _mm512_min_ps(_mm512_max_ps(c, _mm512_set1_ps(-128.0f)), _mm512_set1_ps(127.0f)));
+            _mm_storeu_si128((__m128i*)((int8_t*)dst + i), _mm512_cvtsepi32_epi8(x));
+        }
+    }
+}
+
+FT_TARGET_AVX512 void
+convertAvx512(void* dst, HostFormat dst_format, const void* src, HostFormat src_format, size_t begin, size_t end)
+{
+    size_t i = begin;
+    for (; i + 16 <= end; i += 16) {
+        storeAvx512(dst, dst_format, i, loadAvx512(src, src_format, i));
+    }
+    convertScalar(dst, dst_format, src, src_format, i, end);
+}
+
+#endif  // FT_HOST_CONVERT_X86
+
+HostConvertIsa detectHostConvertIsa()
+{
+    HostConvertIsa isa = HostConvertIsa::SCALAR;
+#ifdef FT_HOST_CONVERT_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+        isa = HostConvertIsa::AVX512;
+    }
+    else if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("f16c")) {
+        isa = HostConvertIsa::AVX2;
+    }
+#endif
+    char* isa_env = std::getenv("FT_HOST_CONVERT_ISA");
+    if (isa_env != nullptr) {
+        std::string    isa_name(isa_env);
+        HostConvertIsa required = isa_name == "AVX512" ? HostConvertIsa::AVX512 :
+                                  isa_name == "AVX2"   ? HostConvertIsa::AVX2 :
+                                                         HostConvertIsa::SCALAR;
+        // an environment variable can only lower the instruction set, never enable unsupported instructions.
+        if ((int)required < (int)isa) {
+            isa = required;
+        }
+    }
+    FT_LOG_DEBUG("Host data type conversion uses %s.", getHostConvertIsaName(isa));
+    return isa;
+}
+
+}  // namespace
+
+HostConvertIsa getHostConvertIsa()
+{
+    static const HostConvertIsa isa = detectHostConvertIsa();
+    return isa;
+}
+
+const char* getHostConvertIsaName(HostConvertIsa isa)
+{
+    switch (isa) {
+        case HostConvertIsa::AVX512:
+            return "AVX512";
+        case HostConvertIsa::AVX2:
+            return "AVX2";
+        default:
+            return "SCALAR";
+    }
+}
+
+template<typename T_OUT, typename T_IN>
+void hostCast(T_OUT* dst, const T_IN* src, const size_t size, HostConvertIsa isa)
+{
+    static_assert(IsHostCastSupported<T_OUT, T_IN>::value, "hostCast does not support this pair of types.");
+    const HostFormat dst_format = HostFormatOf<T_OUT>::value;
+    const HostFormat src_format = HostFormatOf<T_IN>::value;
+    // never run instructions the host does not have, even if the caller asks for them.
+    if ((int)isa > (int)getHostConvertIsa()) {
+        isa = getHostConvertIsa();
+    }
+#ifdef FT_HOST_CONVERT_X86
+    if (isa == HostConvertIsa::AVX512) {
+        convertAvx512(dst, dst_format, src, src_format, 0, size);
+        return;
+    }
+    if (isa == HostConvertIsa::AVX2) {
+        convertAvx2(dst, dst_format, src, src_format, 0, size);
+        return;
+    }
+#endif
+    convertScalar(dst, dst_format, src, src_format, 0, size);
+}
+
+#define INSTANTIATE_HOST_CAST(T_OUT, T_IN)                                                                             \
+    template void hostCast(T_OUT* dst, const T_IN* src, const size_t size, HostConvertIsa isa);
+
+INSTANTIATE_HOST_CAST(half, float);
+INSTANTIATE_HOST_CAST(float, half);
+INSTANTIATE_HOST_CAST(int8_t, float);
+INSTANTIATE_HOST_CAST(float, int8_t);
+INSTANTIATE_HOST_CAST(int8_t, half);
+INSTANTIATE_HOST_CAST(half, int8_t);
+#ifdef ENABLE_BF16
+INSTANTIATE_HOST_CAST(__nv_bfloat16, float);
+INSTANTIATE_HOST_CAST(float, __nv_bfloat16);
+INSTANTIATE_HOST_CAST(__nv_bfloat16, half);
+INSTANTIATE_HOST_CAST(half, __nv_bfloat16);
+INSTANTIATE_HOST_CAST(int8_t, __nv_bfloat16);
+INSTANTIATE_HOST_CAST(__nv_bfloat16, int8_t);
+#endif
+#undef INSTANTIATE_HOST_CAST
+
+}  // namespace fastertransformer
@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2023, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "src/fastertransformer/utils/cuda_bf16_wrapper.h"
+#include <cstddef>
+#include <cstdint>
+#include <cuda_fp16.h>
+#include <type_traits>
+
+namespace fastertransformer {
+
+// Host-side data type conversion, used to convert checkpoint weights before they are copied to the device.
+// The results are bit-exact with the device conversions used by invokeCudaD2DcpyConvert: round-to-nearest-even for
+// float -> half/bfloat16 (NaN becomes the canonical 0x7fff), and round-to-nearest-even with saturation for
+// conversions to int8 (NaN becomes 0).
+
+enum class HostConvertIsa {
+    SCALAR,
+    AVX2,    // AVX2 + F16C
+    AVX512,  // AVX-512F
+};
+
+// The best instruction set supported by the host. It can be lowered with FT_HOST_CONVERT_ISA=SCALAR|AVX2|AVX512.
+HostConvertIsa getHostConvertIsa();
+const char*    getHostConvertIsaName(HostConvertIsa isa);
+
+template<typename T_OUT, typename T_IN>
+void hostCast(T_OUT* dst, const T_IN* src, const size_t size, HostConvertIsa isa);
+
+template<typename T_OUT, typename T_IN>
+void hostCast(T_OUT* dst, const T_IN* src, const size_t size)
+{
+    hostCast(dst, src, size, getHostConvertIsa());
+}
+
+// Pairs of types for which hostCast is instantiated.
+template<typename T_OUT, typename T_IN>
+struct IsHostCastSupported: std::false_type {};
+
+// clang-format off
+template<> struct IsHostCastSupported<half, float>:            std::true_type {};
+template<> struct IsHostCastSupported<float, half>:            std::true_type {};
+template<> struct IsHostCastSupported<int8_t, float>:          std::true_type {};
+template<> struct IsHostCastSupported<float, int8_t>:          std::true_type {};
+template<> struct IsHostCastSupported<int8_t, half>:           std::true_type {};
+template<> struct IsHostCastSupported<half, int8_t>:           std::true_type {};
+#ifdef ENABLE_BF16
+template<> struct IsHostCastSupported<__nv_bfloat16, float>:   std::true_type {};
+template<> struct IsHostCastSupported<float, __nv_bfloat16>:   std::true_type {};
+template<> struct IsHostCastSupported<__nv_bfloat16, half>:    std::true_type {};
+template<> struct IsHostCastSupported<half, __nv_bfloat16>:    std::true_type {};
+template<> struct IsHostCastSupported<int8_t, __nv_bfloat16>:  std::true_type {};
+template<> struct IsHostCastSupported<__nv_bfloat16, int8_t>:  std::true_type {};
+#endif
+// clang-format on
+
+}  // namespace fastertransformer
@@ -0,0 +1,115 @@
+/*
+ * Copyright (c) 2023, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "src/fastertransformer/utils/host_thread_pool.h"
+#include "src/fastertransformer/utils/cuda_utils.h"
+
+#include <algorithm>
+
+namespace fastertransformer {
+
+HostThreadPool::HostThreadPool(int num_threads, size_t max_queue_size):
+    max_queue_size_(max_queue_size > 0 ? max_queue_size : (size_t)std::max(num_threads, 1) * 2)
+{
+    FT_LOG_DEBUG(__PRETTY_FUNCTION__);
+    cudaGetDevice(&device_id_);
+    if (num_threads <= 1) {
+        return;
+    }
+    workers_.reserve(num_threads);
+    for (int i = 0; i < num_threads; i++) {
+        workers_.emplace_back(&HostThreadPool::workerLoop, this);
+    }
+}
+
+HostThreadPool::~HostThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        is_stop_ = true;
+    }
+    task_cv_.notify_all();
+    space_cv_.notify_all();
+    for (auto& worker : workers_) {
+        worker.join();
+    }
+}
+
+void HostThreadPool::runTask(std::function<void()>& task)
+{
+    try {
+        task();
+    }
+    catch (...) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!error_) {
+            error_ = std::current_exception();
+        }
+    }
+}
+
+void HostThreadPool::submit(std::function<void()> task)
+{
+    if (workers_.empty()) {
+        task();
+        return;
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    space_cv_.wait(lock, [this] { return queue_.size() < max_queue_size_ || is_stop_; });
+    queue_.push_back(std::move(task));
+    lock.unlock();
+    task_cv_.notify_one();
+}
+
+void HostThreadPool::wait()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_cv_.wait(lock, [this] { return queue_.empty() && num_running_ == 0; });
+    if (error_) {
+        std::exception_ptr error = error_;
+        error_                   = nullptr;
+        std::rethrow_exception(error);
+    }
+}
+
+void HostThreadPool::workerLoop()
+{
+    // The current device is a per-thread state, so workers have to pick the device of the loading thread.
+    cudaSetDevice(device_id_);
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            task_cv_.wait(lock, [this] { return !queue_.empty() || is_stop_; });
+            if (queue_.empty()) {
+                return;
+            }
+            task = std::move(queue_.front());
+            queue_.pop_front();
+            num_running_++;
+        }
+        space_cv_.notify_one();
+        runTask(task);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            num_running_--;
+        }
+        done_cv_.notify_all();
+    }
+}
+
+}  // namespace fastertransformer
@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) 2023, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace fastertransformer {
+
+// Small pool of host threads, for independent host-side work such as loading layers or decoding batch rows.
+// Tasks are queued in a bounded queue (submit() blocks when it is full) and run on the device that was current
+// when the pool was created. The first exception thrown by a task is rethrown by wait().
+// With num_threads <= 1, tasks run synchronously inside submit(), which matches a serial loop.
+class HostThreadPool {
+public:
+    explicit HostThreadPool(int num_threads, size_t max_queue_size = 0);
+    ~HostThreadPool();
+    HostThreadPool(HostThreadPool const&) = delete;
+    void operator=(HostThreadPool const&) = delete;
+
+    void submit(std::function<void()> task);
+    void wait();
+
+    int getNumThreads() const
+    {
+        return (int)workers_.size();
+    }
+
+private:
+    int                               device_id_ = 0;
+    size_t                            max_queue_size_;
+    std::vector<std::thread>          workers_;
+    std::deque<std::function<void()>> queue_;
+    std::mutex                        mutex_;
+    std::condition_variable           task_cv_;
+    std::condition_variable           space_cv_;
+    std::condition_variable           done_cv_;
+    size_t                            num_running_ = 0;
+    bool                              is_stop_     = false;
+    std::exception_ptr                error_;
+
+    void workerLoop();
+    void runTask(std::function<void()>& task);
+};
+
+}  // namespace fastertransformer
@@ -0,0 +1,520 @@
+/*
+ * Copyright (c) 2023, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/fastertransformer/utils/host_tracer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <unistd.h>
+
+namespace fastertransformer {
+
+const int LatencyHistogram::kSubBucketBits;
+const int LatencyHistogram::kSubBuckets;
+const int LatencyHistogram::kMaxExponent;
+const int LatencyHistogram::kNumBuckets;
+
+int LatencyHistogram::getBucket(int64_t duration_ns)
+{
+    if (duration_ns < kSubBuckets) {
+        return (int)std::max(duration_ns, (int64_t)0);
+    }
+    int exponent = 63 - __builtin_clzll((uint64_t)duration_ns);
+    if (exponent > kMaxExponent) {
+        return kNumBuckets - 1;
+    }
+    const int sub_bucket = (int)(duration_ns >> (exponent - kSubBucketBits)) - kSubBuckets;
+    return (exponent - kSubBucketBits + 1) * kSubBuckets + sub_bucket;
+}
+
+int64_t LatencyHistogram::getBucketMiddle(int bucket)
+{
+    if (bucket < kSubBuckets) {
+        return bucket;
+    }
+    const int     exponent = bucket / kSubBuckets + kSubBucketBits - 1;
+    const int64_t width    = (int64_t)1 << (exponent - kSubBucketBits);
+    return (kSubBuckets + bucket % kSubBuckets) * width + width / 2;
+}
+
+void LatencyHistogram::record(int64_t duration_ns)
+{
+    counts_[getBucket(duration_ns)]++;
+    count_++;
+    total_ += duration_ns;
+    min_ = std::min(min_, duration_ns);
+    max_ = std::max(max_, duration_ns);
+}
+
+void LatencyHistogram::merge(const LatencyHistogram& other)
+{
+    for (int i = 0; i < kNumBuckets; i++) {
+        counts_[i] += other.counts_[i];
+    }
+    count_ += other.count_;
+    total_ += other.total_;
+    min_ = std::min(min_, other.min_);
+    max_ = std::max(max_, other.max_);
+}
+
+int64_t LatencyHistogram::getPercentile(double p) const
+{
+    if (count_ == 0) {
+        return 0;
+    }
+    const uint64_t rank = std::max((uint64_t)std::ceil(p * count_), (uint64_t)1);
+    uint64_t       seen = 0;
+    for (int i = 0; i < kNumBuckets; i++) {
+        seen += counts_[i];
+        if (seen >= rank) {
+            return std::min(std::max(getBucketMiddle(i), min_), max_);
+        }
+    }
+    return max_;
+}
+
+std::atomic<int> HostTracer::state_{HostTracer::UNINITIALIZED};
+
+namespace {
+
+struct TraceEvent {
+    uint32_t name_id;
+    int64_t  begin_ns;
+    int64_t  duration_ns;
+};
+
+struct OpenRange {
+    uint32_t name_id;
+    uint32_t scope_id;
+    int64_t  begin_ns;
+};
+
+struct NameIds {
+    uint32_t name_id;
+    uint32_t scope_id;
+};
+
+// The ranges of one thread. Only the thread writes them, the mutex guards them against the exporters.
+struct ThreadTrace {
+    std::mutex                                     mutex;
+    uint32_t                                       thread_id = 0;
+    std::vector<TraceEvent>                        events;
+    uint64_t                                       num_dropped = 0;
+    std::vector<std::unique_ptr<LatencyHistogram>> histograms;  // by scope id
+
+    // Private to the thread.
+    std::vector<OpenRange>                   open_ranges;
+    uint64_t                                 generation = 0;
+    std::unordered_map<std::string, NameIds> name_ids;  // cache of the registry
+    std::string                              key;
+};
+
+// Names and scopes of all threads.
+class TraceRegistry {
+public:
+    static TraceRegistry& instance()
+    {
+        // Never destroyed: the trace is exported at exit.
+        static TraceRegistry* registry = new TraceRegistry();
+        return *registry;
+    }
+
+    NameIds getNameIds(const std::string& name)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto                        it = name_ids_.find(name);
+        if (it != name_ids_.end()) {
+            return {it->second, name_scopes_[it->second]};
+        }
+        const std::string scope    = HostTracer::getScopeName(name);
+        auto              scope_it = scope_ids_.find(scope);
+        if (scope_it == scope_ids_.end()) {
+            scope_it = scope_ids_.insert({scope, (uint32_t)scopes_.size()}).first;
+            scopes_.push_back(scope);
+        }
+        const uint32_t id = (uint32_t)names_.size();
+        names_.push_back(name);
+        name_scopes_.push_back(scope_it->second);
+        name_ids_.insert({name, id});
+        return {id, scope_it->second};
+    }
+
+    std::string getName(uint32_t name_id)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return names_[name_id];
+    }
+
+    std::string getScope(uint32_t scope_id)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return scopes_[scope_id];
+    }
+
+    std::shared_ptr<ThreadTrace> addThread()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto                        trace = std::make_shared<ThreadTrace>();
+        trace->thread_id                  = (uint32_t)threads_.size() + 1;
+        trace->events.reserve(std::min(max_events_.load(), (size_t)4096));
+        threads_.push_back(trace);
+        return trace;
+    }
+
+    std::vector<std::shared_ptr<ThreadTrace>> getThreads()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return threads_;
+    }
+
+    size_t getMaxEvents()
+    {
+        return max_events_.load(std::memory_order_relaxed);
+    }
+    void setMaxEvents(size_t max_events)
+    {
+        max_events_ = max_events;
+    }
+
+    int64_t getStartNs() const
+    {
+        return start_ns_;
+    }
+
+    std::atomic<uint64_t> generation{1};
+
+private:
+    TraceRegistry():
+        start_ns_(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                      std::chrono::steady_clock::now().time_since_epoch())
+                      .count())
+    {
+    }
+
+    std::mutex                                mutex_;
+    std::unordered_map<std::string, uint32_t> name_ids_;
+    std::deque<std::string>                   names_;
+    std::vector<uint32_t>                     name_scopes_;
+    std::unordered_map<std::string, uint32_t> scope_ids_;
+    std::deque<std::string>                   scopes_;
+    std::vector<std::shared_ptr<ThreadTrace>> threads_;
+    std::atomic<size_t>                       max_events_{1 << 20};
+    const int64_t                             start_ns_;
+};
+
+int64_t getNowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+ThreadTrace& getThreadTrace()
+{
+    thread_local std::shared_ptr<ThreadTrace> trace = TraceRegistry::instance().addThread();
+    const uint64_t generation = TraceRegistry::instance().generation.load(std::memory_order_acquire);
+    if (trace->generation != generation) {
+        trace->open_ranges.clear();
+        trace->generation = generation;
+    }
+    return *trace;
+}
+
+void pushRange(const char* name, size_t length)
+{
+    const int64_t begin_ns = getNowNs();
+    ThreadTrace&  trace    = getThreadTrace();
+    // Reusing the capacity of key avoids an allocation per range.
+    trace.key.assign(name, length);
+    auto it = trace.name_ids.find(trace.key);
+    if (it == trace.name_ids.end()) {
+        it = trace.name_ids.insert({trace.key, TraceRegistry::instance().getNameIds(trace.key)}).first;
+    }
+    trace.open_ranges.push_back({it->second.name_id, it->second.scope_id, begin_ns});
+}
+
+void appendJsonString(std::string* out, const std::string& value)
+{
+    *out += '"';
+    for (char c : value) {
+        if (c == '"' || c == '\\') {
+            *out += '\\';
+            *out += c;
+        }
+        else if ((unsigned char)c < 0x20) {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            *out += escaped;
+        }
+        else {
+            *out += c;
+        }
+    }
+    *out += '"';
+}
+
+void exportAtExit()
+{
+    const char* path = std::getenv("FT_TRACE_FILE");
+    if (path != nullptr && path[0] != '\0') {
+        if (HostTracer::exportChromeTrace(path)) {
+            fprintf(stderr, "[FT][INFO] Host trace written to %s\n", path);
+        }
+        else {
+            fprintf(stderr, "[FT][WARNING] Cannot write the host trace to %s\n", path);
+        }
+    }
+    // The thread-local loggers may be gone at exit, write directly.
+    fprintf(stderr, "%s", HostTracer::getSummary().c_str());
+}
+
+}  // namespace
+
+bool HostTracer::initFromEnv()
+{
+    static std::once_flag initialized;
+    std::call_once(initialized, []() {
+        const char* trace      = std::getenv("FT_TRACE");
+        const char* path       = std::getenv("FT_TRACE_FILE");
+        const char* max_events = std::getenv("FT_TRACE_MAX_EVENTS");
+        const bool  enabled =
+            (trace != nullptr && std::string(trace) == "ON") || (path != nullptr && path[0] != '\0');
+        if (max_events != nullptr) {
+            TraceRegistry::instance().setMaxEvents((size_t)std::max(std::atol(max_events), 0L));
+        }
+        if (enabled) {
+            std::atexit(exportAtExit);
+        }
+        int expected = UNINITIALIZED;
+        state_.compare_exchange_strong(expected, enabled ? ENABLED : DISABLED);
+    });
+    return state_.load(std::memory_order_relaxed) == ENABLED;
+}
+
+void HostTracer::setEnabled(bool enabled)
+{
+    initFromEnv();
+    TraceRegistry::instance().generation.fetch_add(1, std::memory_order_acq_rel);
+    state_.store(enabled ? ENABLED : DISABLED, std::memory_order_relaxed);
+}
+
+void HostTracer::pushRange(const char* name)
+{
+    fastertransformer::pushRange(name, std::strlen(name));
+}
+
+void HostTracer::pushRange(const std::string& name)
+{
+    fastertransformer::pushRange(name.c_str(), name.size());
+}
+
+void HostTracer::popRange()
+{
+    const int64_t end_ns = getNowNs();
+    ThreadTrace&  trace  = getThreadTrace();
+    if (trace.open_ranges.empty()) {
+        return;
+    }
+    const OpenRange range = trace.open_ranges.back();
+    trace.open_ranges.pop_back();
+    const uint32_t scope_id   = range.scope_id;
+    const size_t   max_events = TraceRegistry::instance().getMaxEvents();
+
+    std::lock_guard<std::mutex> lock(trace.mutex);
+    if (trace.events.size() < max_events) {
+        trace.events.push_back({range.name_id, range.begin_ns, end_ns - range.begin_ns});
+    }
+    else {
+        trace.num_dropped++;
+    }
+    if (trace.histograms.size() <= scope_id) {
+        trace.histograms.resize(scope_id + 1);
+    }
+    if (trace.histograms[scope_id] == nullptr) {
+        trace.histograms[scope_id].reset(new LatencyHistogram());
+    }
+    trace.histograms[scope_id]->record(end_ns - range.begin_ns);
+}
+
+std::vector<TraceScopeStats> HostTracer::getScopeStats()
+{
+    std::vector<LatencyHistogram> histograms;
+    for (auto& trace : TraceRegistry::instance().getThreads()) {
+        std::lock_guard<std::mutex> lock(trace->mutex);
+        if (histograms.size() < trace->histograms.size()) {
+            histograms.resize(trace->histograms.size());
+        }
+        for (size_t i = 0; i < trace->histograms.size(); i++) {
+            if (trace->histograms[i] != nullptr) {
+                histograms[i].merge(*trace->histograms[i]);
+            }
+        }
+    }
+
+    std::vector<TraceScopeStats> stats;
+    for (size_t i = 0; i < histograms.size(); i++) {
+        const LatencyHistogram& h = histograms[i];
+        if (h.getCount() > 0) {
+            stats.push_back({TraceRegistry::instance().getScope((uint32_t)i),
+                             h.getCount(),
+                             h.getTotal(),
+                             h.getMin(),
+                             h.getMax(),
+                             h.getPercentile(0.5),
+                             h.getPercentile(0.99)});
+        }
+    }
+    std::sort(stats.begin(), stats.end(), [](const TraceScopeStats& a, const TraceScopeStats& b) {
+        return a.total_ns > b.total_ns || (a.total_ns == b.total_ns && a.scope < b.scope);
+    });
+    return stats;
+}
+
+std::string HostTracer::getSummary()
+{
+    const std::vector<TraceScopeStats> stats = getScopeStats();
+    uint64_t                           num_dropped = 0;
+    for (auto& trace : TraceRegistry::instance().getThreads()) {
+        std::lock_guard<std::mutex> lock(trace->mutex);
+        num_dropped += trace->num_dropped;
+    }
+
+    size_t width = 5;
+    for (const TraceScopeStats& s : stats) {
+        width = std::max(width, s.scope.size());
+    }
+    std::string summary;
+    char        line[1024];
+    snprintf(line,
+             sizeof(line),
+             "[FT][INFO] Host trace: %lu scopes, %lu ranges not kept in the trace\n",
+             (unsigned long)stats.size(),
+             (unsigned long)num_dropped);
+    summary += line;
+    snprintf(line,
+             sizeof(line),
+             "[FT][INFO] %-*s %10s %12s %10s %10s %10s %10s\n",
+             (int)width,
+             "scope",
+             "count",
+             "total ms",
+             "mean us",
+             "p50 us",
+             "p99 us",
+             "max us");
+    summary += line;
+    for (const TraceScopeStats& s : stats) {
+        snprintf(line,
+                 sizeof(line),
+                 "[FT][INFO] %-*s %10lu %12.3f %10.2f %10.2f %10.2f %10.2f\n",
+                 (int)width,
+                 s.scope.substr(0, 900).c_str(),
+                 (unsigned long)s.count,
+                 s.total_ns / 1e6,
+                 s.total_ns / 1e3 / s.count,
+                 s.p50_ns / 1e3,
+                 s.p99_ns / 1e3,
+                 s.max_ns / 1e3);
+        summary += line;
+    }
+    return summary;
+}
+
+bool HostTracer::exportChromeTrace(const std::string& path)
+{
+    FILE* file = fopen(path.c_str(), "w");
+    if (file == nullptr) {
+        return false;
+    }
+
+    TraceRegistry& registry = TraceRegistry::instance();
+    const int      pid      = (int)getpid();
+    std::string    out      = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    bool           first    = true;
+    char           buffer[256];
+    std::unordered_map<uint32_t, std::string> names;
+    for (auto& trace : registry.getThreads()) {
+        std::lock_guard<std::mutex> lock(trace->mutex);
+        snprintf(buffer,
+                 sizeof(buffer),
+                 "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%u,\"args\":{\"name\":\"thread %u\"}}",
+                 first ? "" : ",\n",
+                 pid,
+                 trace->thread_id,
+                 trace->thread_id);
+        out += buffer;
+        first = false;
+        for (const TraceEvent& event : trace->events) {
+            auto it = names.find(event.name_id);
+            if (it == names.end()) {
+                std::string name;
+                appendJsonString(&name, registry.getName(event.name_id));
+                it = names.insert({event.name_id, name}).first;
+            }
+            out += ",\n{\"name\":";
+            out += it->second;
+            snprintf(buffer,
+                     sizeof(buffer),
+                     ",\"cat\":\"ft\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%u}",
+                     (event.begin_ns - registry.getStartNs()) / 1e3,
+                     event.duration_ns / 1e3,
+                     pid,
+                     trace->thread_id);
+            out += buffer;
+        }
+        if (out.size() > (1 << 20)) {
+            fwrite(out.data(), 1, out.size(), file);
+            out.clear();
+        }
+    }
+    out += "\n]}\n";
+    fwrite(out.data(), 1, out.size(), file);
+    return fclose(file) == 0;
+}
+
+void HostTracer::reset()
+{
+    for (auto& trace : TraceRegistry::instance().getThreads()) {
+        std::lock_guard<std::mutex> lock(trace->mutex);
+        trace->events.clear();
+        trace->histograms.clear();
+        trace->num_dropped = 0;
+    }
+}
+
+std::string HostTracer::getScopeName(const std::string& name)
+{
+    std::string scope;
+    for (size_t i = 0; i < name.size(); i++) {
+        scope += name[i];
+        if (name[i] == '_' && i + 1 < name.size() && name[i + 1] >= '0' && name[i + 1] <= '9') {
+            scope += '#';
+            while (i + 1 < name.size() && name[i + 1] >= '0' && name[i + 1] <= '9') {
+                i++;
+            }
+        }
+    }
+    return scope;
+}
+
+}  // namespace fastertransformer
@@ -0,0 +1,132 @@
+/*
+ * Copyright (c) 2023, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Host-side tracer fed by PUSH_RANGE/POP_RANGE.
+ *
+ * Each thread records its ranges with steady-clock timestamps in its own buffer, and aggregates their durations in a
+ * latency histogram per scope. A scope is the name of a range, where the numbers following a '_' are replaced by '#',
+ * so that "layer_0" ... "layer_31" are one scope "layer_#" and "token_%d" gives the latency of the generation steps.
+ * The ranges can be exported as a Chrome trace (chrome://tracing, Perfetto), and the scopes as a text summary.
+ *
+ * Ranges cost nothing but a relaxed load when the tracer is disabled. It is enabled by HostTracer::setEnabled, or by
+ * the environment:
+ *   FT_TRACE=ON                     record ranges, and log the summary at exit
+ *   FT_TRACE_FILE=<path>            same, and also write a Chrome trace to <path> at exit
+ *   FT_TRACE_MAX_EVENTS=<n>         ranges kept per thread for the trace, 1M by default, the later ones only go to
+ *                                   the histograms
+ **/
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace fastertransformer {
+
+// Histogram of durations in nanoseconds, with 16 buckets per power of two: the percentiles are within 1/32 of the
+// true values.
+class LatencyHistogram {
+public:
+    static const int kSubBucketBits = 4;
+    static const int kSubBuckets    = 1 << kSubBucketBits;
+    static const int kMaxExponent   = 47;  // about 39 hours, longer durations are clamped
+    static const int kNumBuckets    = (kMaxExponent - kSubBucketBits + 2) * kSubBuckets;
+
+    LatencyHistogram(): counts_(kNumBuckets, 0) {}
+
+    void record(int64_t duration_ns);
+    void merge(const LatencyHistogram& other);
+    // p in [0, 1].
+    int64_t getPercentile(double p) const;
+
+    uint64_t getCount() const
+    {
+        return count_;
+    }
+    int64_t getTotal() const
+    {
+        return total_;
+    }
+    int64_t getMin() const
+    {
+        return count_ == 0 ? 0 : min_;
+    }
+    int64_t getMax() const
+    {
+        return max_;
+    }
+
+private:
+    static int     getBucket(int64_t duration_ns);
+    static int64_t getBucketMiddle(int bucket);
+
+    std::vector<uint32_t> counts_;
+    uint64_t              count_ = 0;
+    int64_t               total_ = 0;
+    int64_t               min_   = INT64_MAX;
+    int64_t               max_   = 0;
+};
+
+struct TraceScopeStats {
+    std::string scope;
+    uint64_t    count;
+    int64_t     total_ns;
+    int64_t     min_ns;
+    int64_t     max_ns;
+    int64_t     p50_ns;
+    int64_t     p99_ns;
+};
+
+class HostTracer {
+public:
+    static bool isEnabled()
+    {
+        const int state = state_.load(std::memory_order_relaxed);
+        return state == ENABLED || (state == UNINITIALIZED && initFromEnv());
+    }
+    // Ranges open when the tracer is enabled or disabled are ignored.
+    static void setEnabled(bool enabled);
+
+    static void pushRange(const char* name);
+    static void pushRange(const std::string& name);
+    static void popRange();
+
+    // Scopes sorted by total time, all threads merged.
+    static std::vector<TraceScopeStats> getScopeStats();
+    static std::string                  getSummary();
+    // Returns false if path cannot be written.
+    static bool exportChromeTrace(const std::string& path);
+    // Forgets the recorded ranges and scopes.
+    static void reset();
+
+    // Replaces the numbers following a '_' by '#'.
+    static std::string getScopeName(const std::string& name);
+
+private:
+    enum State {
+        UNINITIALIZED = 0,
+        DISABLED      = 1,
+        ENABLED       = 2
+    };
+
+    static bool             initFromEnv();
+    static std::atomic<int> state_;
+};
+
+}  // namespace fastertransformer
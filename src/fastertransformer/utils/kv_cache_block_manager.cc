@@ -0,0 +1,217 @@
+/*
+ * Copyright (c) 2023, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/fastertransformer/utils/kv_cache_block_manager.h"
+#include "src/fastertransformer/utils/cuda_utils.h"
+
+#include <algorithm>
+
+namespace fastertransformer {
+
+float KVCacheBlockStats::fragmentation() const
+{
+    if (num_token_slots == 0) {
+        return 0.0f;
+    }
+    return 1.0f - (float)num_tokens / num_token_slots;
+}
+
+size_t getKVCacheBlockBytes(
+    size_t block_size, size_t num_layer, size_t local_head_num, size_t size_per_head, size_t element_size)
+{
+    return 2 * num_layer * block_size * local_head_num * size_per_head * element_size;
+}
+
+KVCacheBlockManager::KVCacheBlockManager(size_t num_blocks, size_t block_size):
+    block_size_(block_size), ref_counts_(num_blocks, 0)
+{
+    FT_CHECK_WITH_INFO(block_size > 0, "block_size must be positive");
+    free_blocks_.reserve(num_blocks);
+    for (size_t i = num_blocks; i > 0; i--) {
+        free_blocks_.push_back((int)i - 1);
+    }
+}
+
+int KVCacheBlockManager::allocateBlock()
+{
+    int block = free_blocks_.back();
+    free_blocks_.pop_back();
+    ref_counts_[block] = 1;
+    peak_used_blocks_  = std::max(peak_used_blocks_, ref_counts_.size() - free_blocks_.size());
+    return block;
+}
+
+void KVCacheBlockManager::addBlockRef(int block)
+{
+    FT_CHECK_WITH_INFO(block >= 0 && block < (int)ref_counts_.size() && ref_counts_[block] > 0,
+                       fmtstr("block %d is not allocated", block));
+    ref_counts_[block]++;
+}
+
+void KVCacheBlockManager::releaseBlock(int block)
+{
+    FT_CHECK_WITH_INFO(block >= 0 && block < (int)ref_counts_.size() && ref_counts_[block] > 0,
+                       fmtstr("block %d is not allocated", block));
+    if (--ref_counts_[block] == 0) {
+        free_blocks_.push_back(block);
+    }
+}
+
+KVCacheBlockManager::Sequence& KVCacheBlockManager::getSequence(uint64_t sequence_id)
+{
+    auto it = sequences_.find(sequence_id);
+    FT_CHECK_WITH_INFO(it != sequences_.end(), fmtstr("unknown sequence %lu", sequence_id));
+    return it->second;
+}
+
+const KVCacheBlockManager::Sequence& KVCacheBlockManager::getSequence(uint64_t sequence_id) const
+{
+    auto it = sequences_.find(sequence_id);
+    FT_CHECK_WITH_INFO(it != sequences_.end(), fmtstr("unknown sequence %lu", sequence_id));
+    return it->second;
+}
+
+bool KVCacheBlockManager::addSequence(uint64_t sequence_id, size_t num_tokens)
+{
+    return addSequence(sequence_id, {}, 0, num_tokens);
+}
+
+bool KVCacheBlockManager::addSequence(uint64_t                sequence_id,
+                                      const std::vector<int>& prefix_blocks,
+                                      size_t                  prefix_length,
+                                      size_t                  num_tokens)
+{
+    FT_CHECK_WITH_INFO(sequences_.find(sequence_id) == sequences_.end(),
+                       fmtstr("sequence %lu already exists", sequence_id));
+    FT_CHECK_WITH_INFO(prefix_length <= num_tokens && numBlocksForTokens(prefix_length) == prefix_blocks.size(),
+                       "prefix_blocks do not match prefix_length");
+    // A partially filled shared block has to be copied before the sequence writes to it.
+    const bool   copy_tail  = prefix_length % block_size_ != 0 && num_tokens > prefix_length;
+    const size_t num_needed = numBlocksForTokens(num_tokens) - prefix_blocks.size() + (copy_tail ? 1 : 0);
+    if (num_needed > free_blocks_.size()) {
+        return false;
+    }
+    Sequence& sequence = sequences_[sequence_id];
+    sequence.blocks.reserve(numBlocksForTokens(num_tokens));
+    for (int block : prefix_blocks) {
+        addBlockRef(block);
+        sequence.blocks.push_back(block);
+    }
+    sequence.length = prefix_length;
+    if (num_tokens > prefix_length) {
+        std::vector<KVCacheBlockCopy> copies;
+        appendTokens(sequence_id, num_tokens - prefix_length, &copies);
+        FT_CHECK_WITH_INFO(copies.empty() || copy_tail, "unexpected copy of a prefix block");
+    }
+    return true;
+}
+
+bool KVCacheBlockManager::appendTokens(uint64_t sequence_id, size_t num_tokens, std::vector<KVCacheBlockCopy>* copies)
+{
+    Sequence&    sequence     = getSequence(sequence_id);
+    const bool   is_tail_full = sequence.length % block_size_ == 0;
+    const bool   copy_tail    = num_tokens > 0 && !is_tail_full && ref_counts_[sequence.blocks.back()] > 1;
+    const size_t num_needed   = numBlocksForTokens(sequence.length + num_tokens) - sequence.blocks.size();
+    if (num_needed + (copy_tail ? 1 : 0) > free_blocks_.size()) {
+        return false;
+    }
+    if (copy_tail) {
+        const int src = sequence.blocks.back();
+        const int dst = allocateBlock();
+        releaseBlock(src);
+        sequence.blocks.back() = dst;
+        copies->push_back({src, dst});
+        num_cow_copies_++;
+    }
+    for (size_t i = 0; i < num_needed; i++) {
+        sequence.blocks.push_back(allocateBlock());
+    }
+    sequence.length += num_tokens;
+    return true;
+}
+
+void KVCacheBlockManager::forkSequence(uint64_t parent_id, uint64_t child_id)
+{
+    FT_CHECK_WITH_INFO(sequences_.find(child_id) == sequences_.end(),
+                       fmtstr("sequence %lu already exists", child_id));
+    const Sequence parent = getSequence(parent_id);
+    for (int block : parent.blocks) {
+        addBlockRef(block);
+    }
+    sequences_[child_id] = parent;
+}
+
+void KVCacheBlockManager::removeSequence(uint64_t sequence_id)
+{
+    Sequence& sequence = getSequence(sequence_id);
+    for (int block : sequence.blocks) {
+        releaseBlock(block);
+    }
+    sequences_.erase(sequence_id);
+}
+
+bool KVCacheBlockManager::hasSequence(uint64_t sequence_id) const
+{
+    return sequences_.find(sequence_id) != sequences_.end();
+}
+
+size_t KVCacheBlockManager::getSequenceLength(uint64_t sequence_id) const
+{
+    return getSequence(sequence_id).length;
+}
+
+const std::vector<int>& KVCacheBlockManager::getBlockTable(uint64_t sequence_id) const
+{
+    return getSequence(sequence_id).blocks;
+}
+
+void KVCacheBlockManager::getBlockTables(const std::vector<uint64_t>& sequence_ids,
+                                         size_t                       max_blocks_per_seq,
+                                         int*                         block_tables) const
+{
+    for (size_t i = 0; i < sequence_ids.size(); i++) {
+        const std::vector<int>& blocks = getBlockTable(sequence_ids[i]);
+        FT_CHECK_WITH_INFO(blocks.size() <= max_blocks_per_seq,
+                           fmtstr("sequence %lu has %lu blocks, more than %lu",
+                                  sequence_ids[i],
+                                  blocks.size(),
+                                  max_blocks_per_seq));
+        int* table = block_tables + i * max_blocks_per_seq;
+        std::copy(blocks.begin(), blocks.end(), table);
+        std::fill(table + blocks.size(), table + max_blocks_per_seq, -1);
+    }
+}
+
+KVCacheBlockStats KVCacheBlockManager::getStats() const
+{
+    KVCacheBlockStats stats;
+    stats.num_blocks       = ref_counts_.size();
+    stats.num_free_blocks  = free_blocks_.size();
+    stats.num_used_blocks  = stats.num_blocks - stats.num_free_blocks;
+    stats.num_sequences    = sequences_.size();
+    stats.peak_used_blocks = peak_used_blocks_;
+    stats.num_cow_copies   = num_cow_copies_;
+    for (int ref_count : ref_counts_) {
+        stats.num_shared_blocks += ref_count > 1 ? 1 : 0;
+    }
+    for (const auto& it : sequences_) {
+        stats.num_tokens += it.second.length;
+        stats.num_token_slots += it.second.blocks.size() * block_size_;
+    }
+    return stats;
+}
+
+}  // namespace fastertransformer
@@ -0,0 +1,145 @@
+/*
+ * Copyright (c) 2023, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Paged key/value cache bookkeeping.
+ *
+ * Instead of reserving memory_len tokens per sequence, the caches are split in fixed-size blocks of block_size
+ * tokens, allocated on demand. Each sequence owns a block table: entry i is the block which stores its tokens
+ * [i * block_size, (i + 1) * block_size).
+ *
+ * Blocks are reference counted, so several sequences can point to the same block: beams forked from a common
+ * parent, or requests which share a cached prompt prefix. A shared block is never written: appending to a sequence
+ * whose last block is shared first moves it to a private copy (copy-on-write), and returns the copy the caller has
+ * to perform on the device caches.
+ *
+ * This class only manages block ids, on the host. The device pool is num_layer x num_blocks x block_size x
+ * local_hidden_units for each of the key and value caches, see getKVCacheBlockBytes.
+ **/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace fastertransformer {
+
+struct KVCacheBlockCopy {
+    int src_block;
+    int dst_block;
+};
+
+struct KVCacheBlockStats {
+    size_t num_blocks        = 0;
+    size_t num_free_blocks   = 0;
+    size_t num_used_blocks   = 0;  // referenced by at least one sequence or by an external owner
+    size_t num_shared_blocks = 0;  // referenced more than once
+    size_t num_sequences     = 0;
+    size_t num_tokens        = 0;  // sum of the sequence lengths
+    size_t num_token_slots   = 0;  // sum of the tokens the block tables of the sequences can hold
+    size_t peak_used_blocks  = 0;
+    size_t num_cow_copies    = 0;
+
+    // Fraction of the blocks in use.
+    float utilization() const
+    {
+        return num_blocks == 0 ? 0.0f : (float)num_used_blocks / num_blocks;
+    }
+    // Fraction of the allocated token slots which are unused, i.e. the empty tail of the last block of each
+    // sequence. A contiguous cache of memory_len tokens per sequence has 1 - length / memory_len instead.
+    float fragmentation() const;
+};
+
+// Bytes of one block for all the layers, for both the key and the value caches.
+size_t getKVCacheBlockBytes(
+    size_t block_size, size_t num_layer, size_t local_head_num, size_t size_per_head, size_t element_size);
+
+class KVCacheBlockManager {
+public:
+    KVCacheBlockManager(size_t num_blocks, size_t block_size);
+
+    size_t blockSize() const
+    {
+        return block_size_;
+    }
+    size_t numFreeBlocks() const
+    {
+        return free_blocks_.size();
+    }
+    size_t numBlocksForTokens(size_t num_tokens) const
+    {
+        return (num_tokens + block_size_ - 1) / block_size_;
+    }
+    bool canAllocate(size_t num_tokens) const
+    {
+        return numBlocksForTokens(num_tokens) <= free_blocks_.size();
+    }
+
+    // Creates a sequence with room for num_tokens tokens. Returns false, without side effects, if there are not
+    // enough free blocks.
+    bool addSequence(uint64_t sequence_id, size_t num_tokens);
+    // Creates a sequence whose first prefix_length tokens are stored in prefix_blocks, which are shared, and with
+    // room for num_tokens tokens in total.
+    bool addSequence(uint64_t                sequence_id,
+                     const std::vector<int>& prefix_blocks,
+                     size_t                  prefix_length,
+                     size_t                  num_tokens);
+    // Makes room for num_tokens more tokens at the end of the sequence. If its last block is shared and partially
+    // filled, it is replaced by a private copy which is appended to copies. Returns false, without side effects, if
+    // there are not enough free blocks.
+    bool appendTokens(uint64_t sequence_id, size_t num_tokens, std::vector<KVCacheBlockCopy>* copies);
+    // The child shares every block of the parent, for beam search.
+    void forkSequence(uint64_t parent_id, uint64_t child_id);
+    void removeSequence(uint64_t sequence_id);
+
+    bool                    hasSequence(uint64_t sequence_id) const;
+    size_t                  getSequenceLength(uint64_t sequence_id) const;
+    const std::vector<int>& getBlockTable(uint64_t sequence_id) const;
+    // Writes the block tables of the sequences as a dense [sequence_ids.size(), max_blocks_per_seq] array, padded
+    // with -1, as consumed by the attention kernels.
+    void getBlockTables(const std::vector<uint64_t>& sequence_ids, size_t max_blocks_per_seq, int* block_tables) const;
+
+    // References held outside of the sequences, e.g. by a prefix cache.
+    void addBlockRef(int block);
+    void releaseBlock(int block);
+    int  getBlockRefCount(int block) const
+    {
+        return ref_counts_[block];
+    }
+
+    KVCacheBlockStats getStats() const;
+
+private:
+    struct Sequence {
+        std::vector<int> blocks;
+        size_t           length = 0;
+    };
+
+    int             allocateBlock();
+    Sequence&       getSequence(uint64_t sequence_id);
+    const Sequence& getSequence(uint64_t sequence_id) const;
+
+    const size_t                           block_size_;
+    std::vector<int>                       free_blocks_;  // used as a stack, the last freed block is reused first
+    std::vector<int>                       ref_counts_;
+    std::unordered_map<uint64_t, Sequence> sequences_;
+    size_t                                 peak_used_blocks_ = 0;
+    size_t                                 num_cow_copies_   = 0;
+};
+
+}  // namespace fastertransformer
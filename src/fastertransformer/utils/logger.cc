@@ -54,6 +54,8 @@ Logger::Logger()
             level_name = nullptr;
         }
     }
+
+    AsyncLogger::startFromEnv();
 }
 
 }  // namespace fastertransformer
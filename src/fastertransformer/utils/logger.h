@@ -16,10 +16,14 @@
 
 #pragma once
 
+#include <algorithm>
+#include <chrono>
 #include <cstdlib>
+#include <cstring>
 #include <map>
 #include <string>
 
+#include "src/fastertransformer/utils/async_logger.h"
 #include "src/fastertransformer/utils/string_utils.h"
 
 namespace fastertransformer {
@@ -47,6 +51,10 @@ public:
     void log(const Level level, const std::string format, const Args&... args)
     {
         if (level_ <= level) {
+            if (AsyncLogger::isRunning()) {
+                logAsync(level, -1, format.c_str(), format.size(), args...);
+                return;
+            }
             std::string fmt    = getPrefix(level) + format + "\n";
             FILE*       out    = level_ < WARNING ? stdout : stderr;
             std::string logstr = fmtstr(fmt, args...);
@@ -58,6 +66,10 @@ public:
     void log(const Level level, const int rank, const std::string format, const Args&... args)
     {
         if (level_ <= level) {
+            if (AsyncLogger::isRunning()) {
+                logAsync(level, rank, format.c_str(), format.size(), args...);
+                return;
+            }
             std::string fmt    = getPrefix(level, rank) + format + "\n";
             FILE*       out    = level_ < WARNING ? stdout : stderr;
             std::string logstr = fmtstr(fmt, args...);
@@ -65,6 +77,27 @@ public:
         }
     }
 
+    // Overloads for literal formats, which the asynchronous logger does not need to copy to a std::string.
+    template<typename... Args>
+    void log(const Level level, const char* format, const Args&... args)
+    {
+        if (level_ <= level && AsyncLogger::isRunning()) {
+            logAsync(level, -1, format, std::strlen(format), args...);
+            return;
+        }
+        log(level, std::string(format), args...);
+    }
+
+    template<typename... Args>
+    void log(const Level level, const int rank, const char* format, const Args&... args)
+    {
+        if (level_ <= level && AsyncLogger::isRunning()) {
+            logAsync(level, rank, format, std::strlen(format), args...);
+            return;
+        }
+        log(level, rank, std::string(format), args...);
+    }
+
     void setLevel(const Level level)
     {
         level_ = level;
@@ -104,6 +137,39 @@ private:
     {
         return PREFIX + "[" + getLevelName(level) + "][" + std::to_string(rank) + "] ";
     }
+
+    // Copies the format and the arguments to a record for the background thread, which formats and writes it.
+    template<typename... Args>
+    void logAsync(const Level level, const int rank, const char* format, size_t length, const Args&... args)
+    {
+        if (level >= ERROR) {
+            // Make room, so that errors are never dropped.
+            AsyncLogger::flush();
+        }
+        LogRecord* record = AsyncLogger::tryAcquire();
+        if (record == nullptr) {
+            return;
+        }
+        const size_t format_length = std::min(length, LogRecord::kPayloadSize);
+        std::memcpy(record->payload, format, format_length);
+        LogArgWriter writer(record->payload + format_length, LogRecord::kPayloadSize - format_length);
+        writer.putAll(args...);
+
+        const auto now               = std::chrono::system_clock::now().time_since_epoch();
+        record->header.timestamp_ns  = std::chrono::duration_cast<std::chrono::nanoseconds>(now).count();
+        record->header.rank          = rank;
+        record->header.format_length = (uint16_t)format_length;
+        record->header.args_size     = (uint16_t)writer.size();
+        record->header.level         = (uint8_t)level;
+        record->header.flags         = level_ < WARNING ? 0 : LOG_RECORD_STDERR;
+        if (writer.truncated() || format_length < length) {
+            record->header.flags |= LOG_RECORD_TRUNCATED;
+        }
+        AsyncLogger::commit();
+        if (level >= ERROR) {
+            AsyncLogger::flush();
+        }
+    }
 };
 
 #define FT_LOG(level, ...)                                                                                             \
@@ -16,10 +16,16 @@
 
 #include "src/fastertransformer/kernels/cutlass_kernels/cutlass_preprocessors.h"
 #include "src/fastertransformer/utils/Tensor.h"
+#include "src/fastertransformer/utils/allocator.h"
 #include "src/fastertransformer/utils/cuda_type_utils.cuh"
+#include "src/fastertransformer/utils/host_convert_utils.h"
 #include "src/fastertransformer/utils/logger.h"
 #include "src/fastertransformer/utils/memory_utils.h"
+#include "src/fastertransformer/utils/packed_checkpoint.h"
+#include <algorithm>
+#include <condition_variable>
 #include <curand_kernel.h>
+#include <mutex>
 #include <sys/stat.h>
 #include <unordered_map>
 
@@ -294,131 +300,240 @@ template void cudaRandomUniform(char* buffer, const size_t size);
 template void cudaRandomUniform(__nv_fp8_e4m3* buffer, const size_t size);
 #endif
 
-// loads data from binary file. If it succeeds, returns a non-empty vector. If loading fails or
-// the product of the elements in shape is 0, this function will return an empty vector.
-template<typename T>
-std::vector<T> loadWeightFromBinHelper(std::vector<size_t> shape, std::string filename)
-{
-    if (shape.size() > 2) {
-        printf("[ERROR] shape should have less than two dims \n");
-        return std::vector<T>();
+// Pinned buffers shared by the threads which convert weights. Weights are converted chunk by chunk, so a buffer
+// stays small even for the embedding tables, and at most MAX_NUM_BUFFERS buffers are in use at once: beyond that, a
+// thread waits for a free one. The buffers come from a pinned pool allocator. While weights are loading (see
+// beginWeightStaging) it caches the free buffers for the next conversion, otherwise its cache is trimmed as soon as
+// a buffer is released.
+class PinnedStagingPool {
+public:
+    static const size_t CHUNK_SIZE_IN_BYTES = 32 * 1024 * 1024;
+    static const size_t MAX_NUM_BUFFERS     = 4;
+
+    static PinnedStagingPool& instance()
+    {
+        // never destroyed: the CUDA context may already be gone at process exit.
+        static PinnedStagingPool* pool = new PinnedStagingPool();
+        return *pool;
+    }
+
+    void* acquire()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [this] { return num_used_buffers_ < MAX_NUM_BUFFERS; });
+        void* ptr = allocator_.malloc(CHUNK_SIZE_IN_BYTES, false);
+        num_used_buffers_++;
+        return ptr;
     }
-    size_t dim0 = shape[0], dim1 = 1;
-    if (shape.size() == 2) {
-        dim1 = shape[1];
+
+    void release(void* ptr)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            allocator_.free(&ptr);
+            num_used_buffers_--;
+            if (num_loadings_ == 0) {
+                allocator_.trimCache();
+            }
+        }
+        cv_.notify_one();
     }
-    size_t size = dim0 * dim1;
-    if (size == 0) {
-        FT_LOG_WARNING("shape is zero, skip loading weight from file %s \n", filename.c_str());
-        return std::vector<T>();
+
+    void beginLoading()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        num_loadings_++;
     }
 
-    std::vector<T> host_array(size);
-    std::ifstream  in(filename, std::ios::in | std::ios::binary);
-    if (!in.is_open()) {
-        FT_LOG_WARNING("file %s cannot be opened, loading model fails! \n", filename.c_str());
-        return std::vector<T>();
+    void endLoading()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (--num_loadings_ == 0) {
+            allocator_.trimCache();
+        }
     }
 
-    size_t loaded_data_size = sizeof(T) * size;
-    in.seekg(0, in.end);
-    in.seekg(0, in.beg);
+private:
+    std::mutex                    mutex_;
+    std::condition_variable       cv_;
+    Allocator<AllocatorType::CPU> allocator_{CpuAllocatorMode::PINNED_POOL};
+    size_t                        num_used_buffers_ = 0;
+    size_t                        num_loadings_     = 0;
+};
 
-    FT_LOG_DEBUG("Read " + std::to_string(loaded_data_size) + " bytes from " + filename);
-    in.read((char*)host_array.data(), loaded_data_size);
+void beginWeightStaging()
+{
+    PinnedStagingPool::instance().beginLoading();
+}
+
+void endWeightStaging()
+{
+    PinnedStagingPool::instance().endLoading();
+}
+
+// One buffer of the pool, given back when it goes out of scope.
+class PinnedStagingBuffer {
+public:
+    PinnedStagingBuffer(): ptr_(PinnedStagingPool::instance().acquire()) {}
+    ~PinnedStagingBuffer()
+    {
+        PinnedStagingPool::instance().release(ptr_);
+    }
+    PinnedStagingBuffer(const PinnedStagingBuffer&) = delete;
+    PinnedStagingBuffer& operator=(const PinnedStagingBuffer&) = delete;
 
-    size_t in_get_size = in.gcount();
-    if (in_get_size != loaded_data_size) {
-        FT_LOG_WARNING("file %s only has %ld, but request %ld, loading model fails! \n",
-                       filename.c_str(),
-                       in_get_size,
-                       loaded_data_size);
-        return std::vector<T>();
+    void* get() const
+    {
+        return ptr_;
     }
-    in.close();
-    // If we succeed, return an array with values.
-    return host_array;
+
+private:
+    void* ptr_;
+};
+
+// Copies to the device on stream and waits for the copy, so the source can be reused right away. The default stream
+// keeps the synchronous copy of cudaH2Dcpy.
+template<typename T>
+void copyH2DOnStream(T* ptr, const T* src, const size_t size, cudaStream_t stream)
+{
+    if (stream == 0) {
+        cudaH2Dcpy(ptr, src, size);
+        return;
+    }
+    check_cuda_error(cudaMemcpyAsync(ptr, src, sizeof(T) * size, cudaMemcpyHostToDevice, stream));
+    check_cuda_error(cudaStreamSynchronize(stream));
+}
+
+// The checkpoint data type differs from the model one and the host can convert it: convert into pinned memory
+// with the vectorized host routines, then copy, without any scratch device buffer.
+template<typename T, typename T_IN>
+void convertAndCopyH2D(T* ptr, const T_IN* src, const size_t size, cudaStream_t stream, std::true_type)
+{
+    PinnedStagingBuffer staging;
+    T*                  buffer     = (T*)staging.get();
+    const size_t        chunk_size = PinnedStagingPool::CHUNK_SIZE_IN_BYTES / sizeof(T);
+    for (size_t offset = 0; offset < size; offset += chunk_size) {
+        const size_t count = std::min(chunk_size, size - offset);
+        hostCast(buffer, src + offset, count);
+        copyH2DOnStream(ptr + offset, buffer, count, stream);
+    }
+}
+
+// Conversions which are only implemented on the device (e.g. to FP8).
+template<typename T, typename T_IN>
+void convertAndCopyH2D(T* ptr, const T_IN* src, const size_t size, cudaStream_t stream, std::false_type)
+{
+    T_IN* ptr_2 = nullptr;
+    deviceMalloc(&ptr_2, size, false);
+    copyH2DOnStream(ptr_2, src, size, stream);
+    invokeCudaD2DcpyConvert(ptr, ptr_2, size, stream);
+    check_cuda_error(cudaStreamSynchronize(stream));
+    deviceFree(ptr_2);
 }
 
+// Returns -1 if the weight cannot be read. A weight with a zero-sized shape is skipped and returns 0.
 template<typename T, typename T_IN>
-int loadWeightFromBinFunc(T* ptr, std::vector<size_t> shape, std::string filename)
+int loadWeightFromBinFunc(T* ptr, std::vector<size_t> shape, std::string filename, cudaStream_t stream)
 {
-    std::vector<T_IN> host_array = loadWeightFromBinHelper<T_IN>(shape, filename);
+    // The file (or the packed checkpoint holding it) is mapped instead of read into a temporary vector, so the H2D
+    // copy is sourced straight from the page cache.
+    MappedWeight<T_IN> host_array = mapCheckpointWeight<T_IN>(shape, filename);
 
     if (host_array.empty()) {
-        return 0;
+        const bool is_zero_sized = !shape.empty() && std::find(shape.begin(), shape.end(), 0) != shape.end();
+        return is_zero_sized ? 0 : -1;
     }
 
     if (std::is_same<T, T_IN>::value == true) {
-        cudaH2Dcpy(ptr, (T*)host_array.data(), host_array.size());
+        copyH2DOnStream(ptr, (const T*)host_array.data, host_array.size, stream);
     }
     else {
-        T_IN* ptr_2 = nullptr;
-        deviceMalloc(&ptr_2, host_array.size(), false);
-        cudaH2Dcpy(ptr_2, host_array.data(), host_array.size());
-        invokeCudaD2DcpyConvert(ptr, ptr_2, host_array.size());
-        deviceFree(ptr_2);
+        convertAndCopyH2D(ptr, host_array.data, host_array.size, stream, IsHostCastSupported<T, T_IN>());
     }
     return 0;
 }
 
-template int loadWeightFromBinFunc<float, float>(float* ptr, std::vector<size_t> shape, std::string filename);
-template int loadWeightFromBinFunc<half, float>(half* ptr, std::vector<size_t> shape, std::string filename);
-template int loadWeightFromBinFunc<float, half>(float* ptr, std::vector<size_t> shape, std::string filename);
-template int loadWeightFromBinFunc<half, half>(half* ptr, std::vector<size_t> shape, std::string filename);
-template int loadWeightFromBinFunc<int8_t, int8_t>(int8_t* ptr, std::vector<size_t> shape, std::string filename);
-#ifdef ENABLE_BF16
 template int
-loadWeightFromBinFunc<__nv_bfloat16, float>(__nv_bfloat16* ptr, std::vector<size_t> shape, std::string filename);
+loadWeightFromBinFunc<float, float>(float* ptr, std::vector<size_t> shape, std::string filename, cudaStream_t stream);
+template int
+loadWeightFromBinFunc<half, float>(half* ptr, std::vector<size_t> shape, std::string filename, cudaStream_t stream);
+template int
+loadWeightFromBinFunc<float, half>(float* ptr, std::vector<size_t> shape, std::string filename, cudaStream_t stream);
 template int
-loadWeightFromBinFunc<__nv_bfloat16, half>(__nv_bfloat16* ptr, std::vector<size_t> shape, std::string filename);
-template int loadWeightFromBinFunc<float, __nv_bfloat16>(float* ptr, std::vector<size_t> shape, std::string filename);
-template int loadWeightFromBinFunc<half, __nv_bfloat16>(half* ptr, std::vector<size_t> shape, std::string filename);
+loadWeightFromBinFunc<half, half>(half* ptr, std::vector<size_t> shape, std::string filename, cudaStream_t stream);
+template int loadWeightFromBinFunc<int8_t, int8_t>(int8_t*             ptr,
+                                                   std::vector<size_t> shape,
+                                                   std::string         filename,
+                                                   cudaStream_t        stream);
+#ifdef ENABLE_BF16
+template int loadWeightFromBinFunc<__nv_bfloat16, float>(__nv_bfloat16*      ptr,
+                                                         std::vector<size_t> shape,
+                                                         std::string         filename,
+                                                         cudaStream_t        stream);
+template int loadWeightFromBinFunc<__nv_bfloat16, half>(__nv_bfloat16*      ptr,
+                                                        std::vector<size_t> shape,
+                                                        std::string         filename,
+                                                        cudaStream_t        stream);
+template int loadWeightFromBinFunc<float, __nv_bfloat16>(float*              ptr,
+                                                         std::vector<size_t> shape,
+                                                         std::string         filename,
+                                                         cudaStream_t        stream);
+template int loadWeightFromBinFunc<half, __nv_bfloat16>(half*               ptr,
+                                                        std::vector<size_t> shape,
+                                                        std::string         filename,
+                                                        cudaStream_t        stream);
 template int loadWeightFromBinFunc<__nv_bfloat16, __nv_bfloat16>(__nv_bfloat16*      ptr,
                                                                  std::vector<size_t> shape,
-                                                                 std::string         filename);
+                                                                 std::string         filename,
+                                                                 cudaStream_t        stream);
 #endif  // ENABLE_BF16
-template int loadWeightFromBinFunc<int, int>(int* ptr, std::vector<size_t> shape, std::string filename);
-#ifdef ENABLE_FP8
 template int
-loadWeightFromBinFunc<__nv_fp8_e4m3, float>(__nv_fp8_e4m3* ptr, std::vector<size_t> shape, std::string filename);
+loadWeightFromBinFunc<int, int>(int* ptr, std::vector<size_t> shape, std::string filename, cudaStream_t stream);
+#ifdef ENABLE_FP8
+template int loadWeightFromBinFunc<__nv_fp8_e4m3, float>(__nv_fp8_e4m3*      ptr,
+                                                         std::vector<size_t> shape,
+                                                         std::string         filename,
+                                                         cudaStream_t        stream);
 #endif  // ENABLE_FP8
 
 template<typename T>
 int loadWeightFromBin(T* ptr, std::vector<size_t> shape, std::string filename, FtCudaDataType model_file_type)
 {
+    int result = -1;
     switch (model_file_type) {
         case FtCudaDataType::FP32:
-            loadWeightFromBinFunc<T, float>(ptr, shape, filename);
+            result = loadWeightFromBinFunc<T, float>(ptr, shape, filename, 0);
             break;
         case FtCudaDataType::FP16:
-            loadWeightFromBinFunc<T, half>(ptr, shape, filename);
+            result = loadWeightFromBinFunc<T, half>(ptr, shape, filename, 0);
             break;
         case FtCudaDataType::INT8:
-            loadWeightFromBinFunc<T, int8_t>(ptr, shape, filename);
+            result = loadWeightFromBinFunc<T, int8_t>(ptr, shape, filename, 0);
             break;
 #ifdef ENABLE_BF16
         case FtCudaDataType::BF16:
-            loadWeightFromBinFunc<T, __nv_bfloat16>(ptr, shape, filename);
+            result = loadWeightFromBinFunc<T, __nv_bfloat16>(ptr, shape, filename, 0);
             break;
 #endif
 #ifdef ENABLE_FP8
         case FtCudaDataType::FP8:
-            loadWeightFromBinFunc<T, float>(ptr, shape, filename);
+            result = loadWeightFromBinFunc<T, float>(ptr, shape, filename, 0);
             break;
 #endif
         default:
             FT_LOG_ERROR("Does not support FtCudaDataType=%d", model_file_type);
             FT_CHECK(false);
     }
-    return 0;
+    FT_CHECK_WITH_INFO(result == 0, fmtstr("cannot load the weight %s", filename.c_str()));
+    return result;
 }
 
 template<>
 int loadWeightFromBin(int* ptr, std::vector<size_t> shape, std::string filename, FtCudaDataType model_file_type)
 {
-    loadWeightFromBinFunc<int, int>(ptr, shape, filename);
-    return 0;
+    const int result = loadWeightFromBinFunc<int, int>(ptr, shape, filename, 0);
+    FT_CHECK_WITH_INFO(result == 0, fmtstr("cannot load the weight %s", filename.c_str()));
+    return result;
 }
 
 template int
@@ -438,6 +553,41 @@ loadWeightFromBin(__nv_fp8_e4m3* ptr, std::vector<size_t> shape, std::string fil
 template int
 loadWeightFromBin(int* ptr, std::vector<size_t> shape, std::string filename, FtCudaDataType model_file_type);
 
+template<typename T>
+void loadWeightFromBinOnStream(
+    T* ptr, std::vector<size_t> shape, std::string filename, FtCudaDataType model_file_type, cudaStream_t stream)
+{
+    int result = -1;
+    switch (model_file_type) {
+        case FtCudaDataType::FP32:
+            result = loadWeightFromBinFunc<T, float>(ptr, shape, filename, stream);
+            break;
+        case FtCudaDataType::FP16:
+            result = loadWeightFromBinFunc<T, half>(ptr, shape, filename, stream);
+            break;
+#ifdef ENABLE_BF16
+        case FtCudaDataType::BF16:
+            result = loadWeightFromBinFunc<T, __nv_bfloat16>(ptr, shape, filename, stream);
+            break;
+#endif
+        default:
+            FT_CHECK_WITH_INFO(false, fmtstr("Does not support FtCudaDataType=%d", (int)model_file_type));
+    }
+    FT_CHECK_WITH_INFO(result == 0, fmtstr("cannot load the weight %s", filename.c_str()));
+}
+
+template void loadWeightFromBinOnStream(
+    float* ptr, std::vector<size_t> shape, std::string filename, FtCudaDataType model_file_type, cudaStream_t stream);
+template void loadWeightFromBinOnStream(
+    half* ptr, std::vector<size_t> shape, std::string filename, FtCudaDataType model_file_type, cudaStream_t stream);
+#ifdef ENABLE_BF16
+template void loadWeightFromBinOnStream(__nv_bfloat16*      ptr,
+                                        std::vector<size_t> shape,
+                                        std::string         filename,
+                                        FtCudaDataType      model_file_type,
+                                        cudaStream_t        stream);
+#endif
+
 template<typename T, typename T_IN>
 int loadWeightFromBinAndQuantizeForWeightOnlyFunc(int8_t*             ptr,
                                                   T*                  scales_ptr,
@@ -446,7 +596,7 @@ int loadWeightFromBinAndQuantizeForWeightOnlyFunc(int8_t*             ptr,
 {
     FT_LOG_INFO(std::string("Loading and quantizing weight from file: ") + filename);
     FT_CHECK_WITH_INFO(shape.size() == 2, "We can only use this function to dequantize a weight matrix.");
-    std::vector<T_IN> host_array = loadWeightFromBinHelper<T_IN>(shape, filename);
+    MappedWeight<T_IN> host_array = mapCheckpointWeight<T_IN>(shape, filename);
 
     if (host_array.empty()) {
         return 0;
@@ -459,7 +609,7 @@ int loadWeightFromBinAndQuantizeForWeightOnlyFunc(int8_t*             ptr,
     // Note: This function preprocesses the weights to a special format for weight only quant!
     symmetric_quantize<T, T_IN>(host_quantized_weight_buf.data(),
                                 host_scales_buf.data(),
-                                host_array.data(),
+                                host_array.data,
                                 shape,
                                 QuantType::INT8_WEIGHT_ONLY);
 
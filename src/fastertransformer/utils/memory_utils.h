@@ -49,12 +49,26 @@ void cudaAutoCpy(T* tgt, const T* src, const size_t size, cudaStream_t stream =
 template<typename T>
 void cudaRandomUniform(T* buffer, const size_t size);
 
+// The weights which are converted on the host are staged through a small pool of pinned buffers shared by the
+// loading threads. Between beginWeightStaging() and the matching endWeightStaging() (WeightLoaderPool calls them)
+// the buffers are kept from one weight to the next, and they are freed when the last loading ends.
+void beginWeightStaging();
+void endWeightStaging();
+
+// Throws if the file is missing or too short. A weight with a zero-sized shape is skipped.
 template<typename T>
 int loadWeightFromBin(T*                  ptr,
                       std::vector<size_t> shape,
                       std::string         filename,
                       FtCudaDataType      model_file_type = FtCudaDataType::FP32);
 
+// Loads a weight like loadWeightFromBin, but copies it on stream rather than on the legacy default stream, so the
+// weights used by the kernels running on other streams can be updated without waiting for them. Returns once the
+// copy is done, and throws like loadWeightFromBin.
+template<typename T>
+void loadWeightFromBinOnStream(
+    T* ptr, std::vector<size_t> shape, std::string filename, FtCudaDataType model_file_type, cudaStream_t stream);
+
 template<typename T>
 int loadWeightFromBinAndQuantizeForWeightOnly(int8_t*             quantized_weight_ptr,
                                               T*                  scale_ptr,
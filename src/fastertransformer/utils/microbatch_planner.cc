@@ -0,0 +1,314 @@
+/*
+ * Copyright (c) 2023, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/fastertransformer/utils/microbatch_planner.h"
+#include "src/fastertransformer/utils/cuda_utils.h"
+#include "src/fastertransformer/utils/logger.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+namespace fastertransformer {
+
+namespace {
+
+std::vector<size_t> getDivisors(size_t n)
+{
+    std::vector<size_t> divisors;
+    for (size_t d = 1; d <= n; d++) {
+        if (n % d == 0) {
+            divisors.push_back(d);
+        }
+    }
+    return divisors;
+}
+
+}  // namespace
+
+const char* getPipelinePhaseName(PipelinePhase phase)
+{
+    return phase == PipelinePhase::CONTEXT ? "context" : "generation";
+}
+
+size_t HeuristicMicrobatchPlanner::getLocalBatchSize(PipelinePhase phase,
+                                                     size_t        batch_size,
+                                                     size_t        seq_len,
+                                                     size_t        beam_width)
+{
+    size_t local_batch_size = batch_size;
+    if (pipeline_para_size_ == 1) {
+        return local_batch_size;
+    }
+    if (local_batch_size % pipeline_para_size_ == 0) {
+        local_batch_size /= pipeline_para_size_;
+    }
+    // The rule counts a single token per sequence in the generation phase.
+    const size_t num_tokens = phase == PipelinePhase::CONTEXT ? seq_len : 1;
+    while (local_batch_size * num_tokens > 1024 && local_batch_size % 2 == 0) {
+        local_batch_size /= 2;
+    }
+    return local_batch_size;
+}
+
+CostModelMicrobatchPlanner::CostModelMicrobatchPlanner(const PipelineCostParams& params): params_(params)
+{
+    FT_CHECK_WITH_INFO(params.num_layer > 0 && params.hidden_units > 0 && params.tensor_para_size > 0
+                           && params.pipeline_para_size > 0,
+                       "The cost model needs the number of layers, the hidden units and the parallel sizes.");
+    FT_CHECK_WITH_INFO(params.flops_per_us > 0 && params.memory_bytes_per_us > 0 && params.send_bytes_per_us > 0,
+                       "The throughputs of the cost model must be positive.");
+}
+
+double CostModelMicrobatchPlanner::getAnalyticLayerTime(PipelinePhase phase, size_t num_tokens, size_t seq_len) const
+{
+    const double h  = (double)params_.hidden_units;
+    const double tp = (double)params_.tensor_para_size;
+    // QKV, attention output and the two FFN gemms, then Q K^T and the attention over seq_len tokens
+    const double num_weights = (4.0 * h * h + 2.0 * h * params_.inter_size) / tp;
+    const double flops       = 2.0 * num_tokens * num_weights + 4.0 * num_tokens * seq_len * h / tp;
+    double       bytes       = num_weights * params_.data_type_size;
+    if (phase == PipelinePhase::GENERATION) {
+        // every token reads the keys and values of its sequence
+        bytes += 2.0 * num_tokens * seq_len * h / tp * params_.data_type_size;
+    }
+    return params_.layer_overhead_us + std::max(flops / params_.flops_per_us, bytes / params_.memory_bytes_per_us);
+}
+
+double CostModelMicrobatchPlanner::getLayerTime(PipelinePhase phase, size_t num_tokens, size_t seq_len) const
+{
+    const std::map<size_t, Timing>& timings = timings_[(int)phase];
+    if (timings.empty()) {
+        return getAnalyticLayerTime(phase, num_tokens, seq_len);
+    }
+    auto mean = [](const std::pair<const size_t, Timing>& t) { return t.second.total_us / t.second.count; };
+
+    auto upper = timings.lower_bound(num_tokens);
+    if (upper == timings.end()) {
+        // beyond the largest timing, the layer is bound by compute
+        auto last = std::prev(timings.end());
+        return mean(*last) * num_tokens / last->first;
+    }
+    if (upper->first == num_tokens || upper == timings.begin()) {
+        // below the smallest, by memory
+        return mean(*upper);
+    }
+    auto         lower = std::prev(upper);
+    const double ratio = (double)(num_tokens - lower->first) / (upper->first - lower->first);
+    return mean(*lower) + ratio * (mean(*upper) - mean(*lower));
+}
+
+MicrobatchCost CostModelMicrobatchPlanner::getCost(
+    PipelinePhase phase, size_t batch_size, size_t local_batch_size, size_t seq_len, size_t beam_width) const
+{
+    FT_CHECK_WITH_INFO(local_batch_size > 0 && batch_size % local_batch_size == 0,
+                       fmtstr("local_batch_size %lu does not divide batch_size %lu", local_batch_size, batch_size));
+    const size_t num_microbatches = batch_size / local_batch_size;
+    const size_t num_stages       = params_.pipeline_para_size;
+    const size_t num_tokens       = local_batch_size * (phase == PipelinePhase::CONTEXT ? seq_len : beam_width);
+    const double tp               = (double)params_.tensor_para_size;
+
+    MicrobatchCost cost;
+    cost.local_batch_size = local_batch_size;
+    cost.stage_us         = params_.getStageNumLayer() * getLayerTime(phase, num_tokens, seq_len);
+    if (num_stages > 1) {
+        cost.send_us = params_.send_latency_us
+                       + num_tokens * params_.hidden_units / tp * params_.data_type_size / params_.send_bytes_per_us;
+    }
+    if (phase == PipelinePhase::GENERATION) {
+        const double num_weights = (double)params_.vocab_size * params_.hidden_units / tp;
+        const double compute_us  = 2.0 * num_tokens * num_weights / params_.flops_per_us;
+        const double memory_us   = num_weights * params_.data_type_size / params_.memory_bytes_per_us;
+        cost.head_us             = params_.layer_overhead_us + std::max(compute_us, memory_us);
+    }
+    // the slowest stage sets the pace once the pipeline is full
+    const double bottleneck_us = std::max(cost.stage_us + cost.send_us, cost.stage_us + cost.head_us);
+
+    cost.total_us = (num_stages - 1) * (cost.stage_us + cost.send_us) + cost.stage_us + cost.head_us
+                    + (num_microbatches - 1) * bottleneck_us;
+    return cost;
+}
+
+std::vector<MicrobatchCost> CostModelMicrobatchPlanner::getCosts(PipelinePhase phase,
+                                                                 size_t        batch_size,
+                                                                 size_t        seq_len,
+                                                                 size_t        beam_width) const
+{
+    std::vector<MicrobatchCost> costs;
+    for (size_t local_batch_size : getDivisors(batch_size)) {
+        costs.push_back(getCost(phase, batch_size, local_batch_size, seq_len, beam_width));
+    }
+    return costs;
+}
+
+size_t CostModelMicrobatchPlanner::getLocalBatchSize(PipelinePhase phase,
+                                                     size_t        batch_size,
+                                                     size_t        seq_len,
+                                                     size_t        beam_width)
+{
+    if (is_calibrating_) {
+        const std::vector<size_t> divisors = getDivisors(batch_size);
+        return divisors[num_sweeps_[(int)phase]++ % divisors.size()];
+    }
+    if (params_.pipeline_para_size == 1 || batch_size <= 1) {
+        return batch_size;
+    }
+    const std::vector<MicrobatchCost> costs = getCosts(phase, batch_size, seq_len, beam_width);
+    // the largest microbatches on ties
+    auto best = std::min_element(costs.rbegin(), costs.rend(), [](const MicrobatchCost& a, const MicrobatchCost& b) {
+        return a.total_us < b.total_us;
+    });
+    FT_LOG_DEBUG("%s phase of batch %lu (seq_len %lu): %lu microbatches of %lu, %.1f us",
+                 getPipelinePhaseName(phase),
+                 batch_size,
+                 seq_len,
+                 batch_size / best->local_batch_size,
+                 best->local_batch_size,
+                 best->total_us);
+    return best->local_batch_size;
+}
+
+void CostModelMicrobatchPlanner::setCalibrating(bool is_calibrating, const std::string& path)
+{
+    is_calibrating_   = is_calibrating;
+    calibration_path_ = path;
+    num_sweeps_       = {{0, 0}};
+}
+
+void CostModelMicrobatchPlanner::recordStageTime(PipelinePhase phase, size_t num_tokens, float us_per_layer)
+{
+    if (!is_calibrating_ || num_tokens == 0) {
+        return;
+    }
+    Timing& timing = timings_[(int)phase][num_tokens];
+    timing.total_us += us_per_layer;
+    timing.count++;
+}
+
+void CostModelMicrobatchPlanner::saveCalibration() const
+{
+    if (is_calibrating_ && !calibration_path_.empty()) {
+        saveCalibration(calibration_path_);
+    }
+}
+
+void CostModelMicrobatchPlanner::saveCalibration(const std::string& path) const
+{
+    std::ofstream file(path);
+    FT_CHECK_WITH_INFO(file.is_open(), fmtstr("Cannot write the microbatch calibration to %s", path.c_str()));
+    file << "# phase num_tokens us_per_layer count\n";
+    for (PipelinePhase phase : {PipelinePhase::CONTEXT, PipelinePhase::GENERATION}) {
+        for (const auto& t : timings_[(int)phase]) {
+            file << getPipelinePhaseName(phase) << " " << t.first << " " << t.second.total_us / t.second.count << " "
+                 << t.second.count << "\n";
+        }
+    }
+    FT_LOG_INFO("Saved the microbatch calibration to %s", path.c_str());
+}
+
+bool CostModelMicrobatchPlanner::loadCalibration(const std::string& path)
+{
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        return false;
+    }
+    std::string line;
+    size_t      line_id = 0;
+    while (std::getline(file, line)) {
+        line_id++;
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        std::istringstream ss(line);
+        std::string        phase_name;
+        size_t             num_tokens = 0;
+        double             us         = 0.0;
+        size_t             count      = 0;
+        ss >> phase_name >> num_tokens >> us >> count;
+        FT_CHECK_WITH_INFO(!ss.fail() && num_tokens > 0 && count > 0
+                               && (phase_name == "context" || phase_name == "generation"),
+                           fmtstr("Invalid microbatch calibration at %s:%lu", path.c_str(), line_id));
+        Timing& timing =
+            timings_[phase_name == "context" ? (int)PipelinePhase::CONTEXT : (int)PipelinePhase::GENERATION]
+                    [num_tokens];
+        timing.total_us += us * count;
+        timing.count += count;
+    }
+    return true;
+}
+
+std::shared_ptr<MicrobatchPlanner> createMicrobatchPlanner(const PipelineCostParams& params)
+{
+    const char*       planner_env      = std::getenv("FT_MICROBATCH_PLANNER");
+    const char*       calibration_env  = std::getenv("FT_MICROBATCH_CALIBRATION");
+    const char*       calibrate_env    = std::getenv("FT_MICROBATCH_CALIBRATE");
+    const bool        is_calibrating   = calibrate_env != nullptr && std::string(calibrate_env) == "ON";
+    const std::string calibration_path = calibration_env != nullptr ? calibration_env : "";
+    if (planner_env == nullptr || std::string(planner_env) != "COST_MODEL") {
+        if (is_calibrating || !calibration_path.empty()) {
+            FT_LOG_WARNING("The microbatch calibration is only used with FT_MICROBATCH_PLANNER=COST_MODEL.");
+        }
+        return std::make_shared<HeuristicMicrobatchPlanner>(params.pipeline_para_size);
+    }
+    auto planner = std::make_shared<CostModelMicrobatchPlanner>(params);
+    if (!calibration_path.empty() && planner->loadCalibration(calibration_path)) {
+        FT_LOG_INFO("Loaded the microbatch calibration of %s", calibration_path.c_str());
+    }
+    if (is_calibrating) {
+        FT_CHECK_WITH_INFO(!calibration_path.empty(), "FT_MICROBATCH_CALIBRATE needs FT_MICROBATCH_CALIBRATION.");
+        planner->setCalibrating(true, calibration_path);
+    }
+    return planner;
+}
+
+MicrobatchStageTimer::~MicrobatchStageTimer()
+{
+    for (cudaEvent_t event : events_) {
+        cudaEventDestroy(event);
+    }
+}
+
+void MicrobatchStageTimer::start(cudaStream_t stream)
+{
+    if (num_events_ == events_.size()) {
+        cudaEvent_t event;
+        check_cuda_error(cudaEventCreate(&event));
+        events_.push_back(event);
+    }
+    check_cuda_error(cudaEventRecord(events_[num_events_++], stream));
+}
+
+void MicrobatchStageTimer::stop(cudaStream_t stream, size_t num_tokens)
+{
+    FT_CHECK_WITH_INFO(num_events_ % 2 == 1, "MicrobatchStageTimer::stop without start");
+    start(stream);
+    num_tokens_.push_back(num_tokens);
+}
+
+void MicrobatchStageTimer::report(MicrobatchPlanner* planner, PipelinePhase phase, size_t num_layer)
+{
+    for (size_t i = 0; i < num_tokens_.size(); i++) {
+        float elapsed_ms = 0.0f;
+        check_cuda_error(cudaEventSynchronize(events_[2 * i + 1]));
+        check_cuda_error(cudaEventElapsedTime(&elapsed_ms, events_[2 * i], events_[2 * i + 1]));
+        planner->recordStageTime(phase, num_tokens_[i], elapsed_ms * 1000.0f / num_layer);
+    }
+    num_tokens_.clear();
+    num_events_ = 0;
+}
+
+}  // namespace fastertransformer
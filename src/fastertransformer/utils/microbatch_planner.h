@@ -0,0 +1,236 @@
+/*
+ * Copyright (c) 2023, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Choice of the microbatch size of pipeline parallelism.
+ *
+ * With pipeline parallelism the batch is split into microbatches of local_batch_size sequences, which go through the
+ * stages one after the other. Small microbatches shorten the bubble, i.e. the time the stages wait while the first
+ * microbatch fills the pipeline and the last one drains it. Large ones use the GPU better and, in the generation
+ * phase which is bound by memory, read the weights fewer times.
+ *
+ * CostModelMicrobatchPlanner estimates the time of a forward pass for each local_batch_size dividing the batch, and
+ * picks the fastest. With P stages and m microbatches,
+ *
+ *     time = (P - 1) * (stage + send) + (stage + head) + (m - 1) * max(stage + send, stage + head)
+ *
+ * where stage is the time of the layers of a stage on one microbatch, send the time to send its activations to the
+ * next stage, and head the time of the LM head and the sampling on the last stage (generation only). A layer takes
+ * the larger of its compute time and its memory time, plus a fixed overhead for its kernel launches.
+ *
+ * The layer time can be calibrated instead. A calibrating planner sweeps the microbatch sizes and records the layer
+ * times measured on a stage (see MicrobatchStageTimer), which are saved to a file. Once loaded, they replace the
+ * analytic layer time of their phase, interpolated linearly over the number of tokens of the microbatch.
+ *
+ * Every rank of the pipeline must plan the same microbatches, so plans only depend on the shape of the batch and on
+ * the calibration loaded when the planner was created, never on the timings of the current run. The calibration files
+ * of the hosts can still differ, so a pipeline model plans on its first rank and broadcasts the plans to the others,
+ * see BroadcastMicrobatchPlanner.
+ **/
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <cuda_runtime.h>
+
+namespace fastertransformer {
+
+enum class PipelinePhase {
+    CONTEXT,
+    GENERATION
+};
+
+const char* getPipelinePhaseName(PipelinePhase phase);
+
+class MicrobatchPlanner {
+public:
+    virtual ~MicrobatchPlanner() = default;
+
+    // Returns the number of sequences of a microbatch, a divisor of batch_size. seq_len is the length of the inputs in
+    // the context phase, and the length attended to in the generation phase, where a sequence has beam_width tokens.
+    virtual size_t
+    getLocalBatchSize(PipelinePhase phase, size_t batch_size, size_t seq_len, size_t beam_width = 1) = 0;
+
+    virtual bool isCalibrating() const
+    {
+        return false;
+    }
+    // Records that the layers of a stage took us_per_layer each on a microbatch of num_tokens tokens.
+    virtual void recordStageTime(PipelinePhase phase, size_t num_tokens, float us_per_layer) {}
+    // Writes the timings recorded while calibrating, if the planner has somewhere to write them.
+    virtual void saveCalibration() const {}
+};
+
+// The rule used by getLocalBatchSize: one microbatch per stage, halved while it has more than 1024 tokens.
+class HeuristicMicrobatchPlanner: public MicrobatchPlanner {
+public:
+    explicit HeuristicMicrobatchPlanner(size_t pipeline_para_size): pipeline_para_size_(pipeline_para_size) {}
+
+    size_t getLocalBatchSize(PipelinePhase phase, size_t batch_size, size_t seq_len, size_t beam_width = 1) override;
+
+private:
+    const size_t pipeline_para_size_;
+};
+
+struct PipelineCostParams {
+    size_t num_layer          = 0;
+    size_t hidden_units       = 0;
+    size_t inter_size         = 0;
+    size_t vocab_size         = 0;
+    size_t tensor_para_size   = 1;
+    size_t pipeline_para_size = 1;
+    size_t data_type_size     = 2;  // bytes of the weights and activations
+
+    // GPU, by default about what an A100 achieves in practice
+    double flops_per_us        = 2.0e8;  // 200 TFLOPS
+    double memory_bytes_per_us = 1.5e6;  // 1.5 TB/s
+    double layer_overhead_us   = 20.0;   // kernel launches, layer norms, ...
+    double send_latency_us     = 15.0;   // between stages
+    double send_bytes_per_us   = 5.0e4;  // 50 GB/s
+
+    size_t getStageNumLayer() const
+    {
+        return (num_layer + pipeline_para_size - 1) / pipeline_para_size;
+    }
+};
+
+struct MicrobatchCost {
+    size_t local_batch_size = 0;
+    double stage_us         = 0;  // the layers of a stage on one microbatch
+    double send_us          = 0;  // the activations of one microbatch to the next stage
+    double head_us          = 0;  // the LM head and sampling of one microbatch on the last stage
+    double total_us         = 0;  // all the microbatches through all the stages
+};
+
+// Not thread-safe.
+class CostModelMicrobatchPlanner: public MicrobatchPlanner {
+public:
+    explicit CostModelMicrobatchPlanner(const PipelineCostParams& params);
+
+    size_t getLocalBatchSize(PipelinePhase phase, size_t batch_size, size_t seq_len, size_t beam_width = 1) override;
+
+    // The costs of each local_batch_size dividing batch_size, by increasing local_batch_size.
+    std::vector<MicrobatchCost>
+    getCosts(PipelinePhase phase, size_t batch_size, size_t seq_len, size_t beam_width = 1) const;
+    MicrobatchCost getCost(
+        PipelinePhase phase, size_t batch_size, size_t local_batch_size, size_t seq_len, size_t beam_width = 1) const;
+    // Time of one layer on num_tokens tokens, from the calibration of the phase if there is one.
+    double getLayerTime(PipelinePhase phase, size_t num_tokens, size_t seq_len) const;
+    double getAnalyticLayerTime(PipelinePhase phase, size_t num_tokens, size_t seq_len) const;
+
+    const PipelineCostParams& getParams() const
+    {
+        return params_;
+    }
+
+    // While calibrating, getLocalBatchSize returns each divisor of the batch size in turn, and the recorded timings
+    // are saved to path by saveCalibration.
+    void setCalibrating(bool is_calibrating, const std::string& path = "");
+    bool isCalibrating() const override
+    {
+        return is_calibrating_;
+    }
+    void recordStageTime(PipelinePhase phase, size_t num_tokens, float us_per_layer) override;
+    void saveCalibration() const override;
+    void saveCalibration(const std::string& path) const;
+    // Adds the timings of a file written by saveCalibration. Returns false if there is no such file.
+    bool loadCalibration(const std::string& path);
+    bool hasCalibration(PipelinePhase phase) const
+    {
+        return !timings_[(int)phase].empty();
+    }
+
+private:
+    struct Timing {
+        double total_us = 0.0;
+        size_t count    = 0;
+    };
+
+    const PipelineCostParams params_;
+
+    std::array<std::map<size_t, Timing>, 2> timings_;  // per phase, by number of tokens of the microbatch
+    bool                                    is_calibrating_ = false;
+    std::string                             calibration_path_;
+    std::array<size_t, 2>                   num_sweeps_ = {{0, 0}};  // per phase, while calibrating
+};
+
+// Gives every rank the plans of one rank. broadcast takes the local_batch_size planned on this rank and returns the one
+// of the root rank, so every rank must plan at the same points.
+class BroadcastMicrobatchPlanner: public MicrobatchPlanner {
+public:
+    using BroadcastFunction = std::function<size_t(size_t local_batch_size)>;
+
+    BroadcastMicrobatchPlanner(std::shared_ptr<MicrobatchPlanner> planner, BroadcastFunction broadcast):
+        planner_(planner), broadcast_(broadcast)
+    {
+    }
+
+    size_t getLocalBatchSize(PipelinePhase phase, size_t batch_size, size_t seq_len, size_t beam_width = 1) override
+    {
+        return broadcast_(planner_->getLocalBatchSize(phase, batch_size, seq_len, beam_width));
+    }
+    bool isCalibrating() const override
+    {
+        return planner_->isCalibrating();
+    }
+    void recordStageTime(PipelinePhase phase, size_t num_tokens, float us_per_layer) override
+    {
+        planner_->recordStageTime(phase, num_tokens, us_per_layer);
+    }
+    void saveCalibration() const override
+    {
+        planner_->saveCalibration();
+    }
+
+private:
+    const std::shared_ptr<MicrobatchPlanner> planner_;
+    const BroadcastFunction                  broadcast_;
+};
+
+// The planner of a pipeline model, from the environment:
+//   FT_MICROBATCH_PLANNER=COST_MODEL uses the cost model, the rule of getLocalBatchSize is kept otherwise.
+//   FT_MICROBATCH_CALIBRATION=<file> loads the layer timings of the file into the cost model, if it exists.
+//   FT_MICROBATCH_CALIBRATE=ON sweeps the microbatch sizes and saves the timings to FT_MICROBATCH_CALIBRATION.
+std::shared_ptr<MicrobatchPlanner> createMicrobatchPlanner(const PipelineCostParams& params);
+
+// Times the layers of a stage on the GPU, for the calibration. start() goes after the activations are received and
+// stop() before they are sent, so the timings only cover the layers of the stage.
+class MicrobatchStageTimer {
+public:
+    MicrobatchStageTimer() = default;
+    ~MicrobatchStageTimer();
+    MicrobatchStageTimer(const MicrobatchStageTimer&)            = delete;
+    MicrobatchStageTimer& operator=(const MicrobatchStageTimer&) = delete;
+
+    void start(cudaStream_t stream);
+    void stop(cudaStream_t stream, size_t num_tokens);
+    // Waits for the timed microbatches and records their time per layer in planner.
+    void report(MicrobatchPlanner* planner, PipelinePhase phase, size_t num_layer);
+
+private:
+    std::vector<cudaEvent_t> events_;      // start and stop of each microbatch
+    std::vector<size_t>      num_tokens_;  // of each microbatch
+    size_t                   num_events_ = 0;
+};
+
+}  // namespace fastertransformer
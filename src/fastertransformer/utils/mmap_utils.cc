@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) 2023, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/fastertransformer/utils/mmap_utils.h"
+
+#include <algorithm>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace fastertransformer {
+
+MappedFile::MappedFile(const std::string& filename): filename_(filename)
+{
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return;
+    }
+    void* ptr = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // the mapping keeps its own reference to the file, so the descriptor is not needed anymore.
+    close(fd);
+    if (ptr == MAP_FAILED) {
+        FT_LOG_WARNING("mmap of file %s failed.", filename.c_str());
+        return;
+    }
+    data_ = ptr;
+    size_ = (size_t)st.st_size;
+}
+
+MappedFile::~MappedFile()
+{
+    if (data_ != nullptr) {
+        munmap(data_, size_);
+        data_ = nullptr;
+    }
+}
+
+void MappedFile::prefetch(size_t offset, size_t length) const
+{
+    if (data_ == nullptr || offset >= size_) {
+        return;
+    }
+    const size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+    const size_t begin     = offset / page_size * page_size;
+    const size_t end       = std::min(offset + length, size_);
+    madvise((char*)data_ + begin, end - begin, MADV_WILLNEED);
+}
+
+std::shared_ptr<MappedFile> openMappedFile(const std::string& filename)
+{
+    std::shared_ptr<MappedFile> file = std::make_shared<MappedFile>(filename);
+    if (!file->isValid()) {
+        return nullptr;
+    }
+    madvise(const_cast<void*>(file->data()), file->size(), MADV_SEQUENTIAL);
+    return file;
+}
+
+std::shared_ptr<MappedFile> mapBinFile(const std::string& filename, size_t num_bytes)
+{
+    std::shared_ptr<MappedFile> file = openMappedFile(filename);
+    if (file == nullptr) {
+        FT_LOG_WARNING("file %s cannot be opened, loading model fails! \n", filename.c_str());
+        return nullptr;
+    }
+    if (file->size() < num_bytes) {
+        FT_LOG_WARNING("file %s only has %ld, but request %ld, loading model fails! \n",
+                       filename.c_str(),
+                       file->size(),
+                       num_bytes);
+        return nullptr;
+    }
+    FT_LOG_DEBUG("Map " + std::to_string(num_bytes) + " bytes from " + filename);
+    file->prefetch(0, num_bytes);
+    return file;
+}
+
+}  // namespace fastertransformer
@@ -0,0 +1,112 @@
+/*
+ * Copyright (c) 2023, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "src/fastertransformer/utils/cuda_utils.h"
+#include "src/fastertransformer/utils/logger.h"
+
+namespace fastertransformer {
+
+// Read-only, private mapping of a whole file. The mapping is released when the last owner goes away, so views
+// returned by mapWeightFromBin stay valid as long as they are held.
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& filename);
+    ~MappedFile();
+    MappedFile(MappedFile const&)     = delete;
+    void operator=(MappedFile const&) = delete;
+
+    bool isValid() const
+    {
+        return data_ != nullptr;
+    }
+    const void* data() const
+    {
+        return data_;
+    }
+    size_t size() const
+    {
+        return size_;
+    }
+    const std::string& filename() const
+    {
+        return filename_;
+    }
+
+    // Hint the kernel to read ahead [offset, offset + length) since it is about to be consumed sequentially.
+    void prefetch(size_t offset, size_t length) const;
+
+private:
+    std::string filename_;
+    void*       data_ = nullptr;
+    size_t      size_ = 0;
+};
+
+// Host view of a weight which lives inside a mapped file. data is nullptr if loading fails or the shape is empty.
+template<typename T>
+struct MappedWeight {
+    std::shared_ptr<MappedFile> file;
+    const T*                    data = nullptr;
+    size_t                      size = 0;
+
+    bool empty() const
+    {
+        return data == nullptr || size == 0;
+    }
+};
+
+std::shared_ptr<MappedFile> openMappedFile(const std::string& filename);
+
+// Maps filename and checks that it holds at least num_bytes bytes. Returns nullptr (with a warning) otherwise.
+std::shared_ptr<MappedFile> mapBinFile(const std::string& filename, size_t num_bytes);
+
+// Number of elements of a weight of one or two dims. Throws on any other shape.
+inline size_t weightNumElements(const std::vector<size_t>& shape, const std::string& filename)
+{
+    FT_CHECK_WITH_INFO(!shape.empty() && shape.size() <= 2,
+                       fmtstr("the shape of weight %s should have one or two dims, but has %zu",
+                              filename.c_str(),
+                              shape.size()));
+    return shape[0] * (shape.size() == 2 ? shape[1] : 1);
+}
+
+// Maps filename and returns a view of the first prod(shape) elements of type T, without copying them.
+// This is the CPU-only counterpart of loadWeightFromBin; it does not touch any device.
+template<typename T>
+MappedWeight<T> mapWeightFromBin(std::vector<size_t> shape, std::string filename)
+{
+    MappedWeight<T> weight;
+    size_t          size = weightNumElements(shape, filename);
+    if (size == 0) {
+        FT_LOG_WARNING("shape is zero, skip loading weight from file %s \n", filename.c_str());
+        return weight;
+    }
+    weight.file = mapBinFile(filename, sizeof(T) * size);
+    if (weight.file == nullptr) {
+        return weight;
+    }
+    weight.data = reinterpret_cast<const T*>(weight.file->data());
+    weight.size = size;
+    return weight;
+}
+
+}  // namespace fastertransformer
@@ -15,6 +15,7 @@
  */
 
 #include "src/fastertransformer/utils/nccl_utils.h"
+#include "src/fastertransformer/utils/microbatch_planner.h"
 
 namespace fastertransformer {
 
@@ -419,17 +420,8 @@ void ftNcclInitialize(NcclParam& tensor_para,
 
 size_t getLocalBatchSize(const size_t batch_size, const size_t seq_len, const size_t pipeline_para_size)
 {
-    size_t local_batch_size = batch_size;
-    if (pipeline_para_size == 1) {
-        return local_batch_size;
-    }
-    if (local_batch_size % pipeline_para_size == 0) {
-        local_batch_size /= pipeline_para_size;
-    }
-    while (local_batch_size * seq_len > 1024 && local_batch_size % 2 == 0) {
-        local_batch_size /= 2;
-    }
-    return local_batch_size;
+    HeuristicMicrobatchPlanner planner(pipeline_para_size);
+    return planner.getLocalBatchSize(PipelinePhase::CONTEXT, batch_size, seq_len);
 }
 
 }  // namespace fastertransformer
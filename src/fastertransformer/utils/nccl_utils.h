@@ -116,6 +116,7 @@ void ftNcclInitialize(NcclParam& tensor_para,
                       const int  tensor_para_size,
                       const int  pipeline_para_size);
 
+// The microbatch size of pipeline parallelism, by the rule of HeuristicMicrobatchPlanner.
 size_t getLocalBatchSize(const size_t batch_size, const size_t seq_len, const size_t pipeline_para_size);
 
 }  // namespace fastertransformer
@@ -16,6 +16,10 @@
 
 #pragma once
 
+#include "src/fastertransformer/utils/host_tracer.h"
+
+#include <string>
+
 namespace ft_nvtx {
 static std::string scope;
 std::string        getScope();
@@ -34,11 +38,15 @@ void        ftNvtxRangePush(std::string name);
 void        ftNvtxRangePop();
 }  // namespace ft_nvtx
 
+// The ranges go to NVTX with FT_NVTX=ON, and to the host tracer with FT_TRACE=ON, see host_tracer.h.
 #define PUSH_RANGE(name)                                                                                               \
     {                                                                                                                  \
         if (ft_nvtx::isEnableNvtx()) {                                                                                 \
             ft_nvtx::ftNvtxRangePush(name);                                                                            \
         }                                                                                                              \
+        if (fastertransformer::HostTracer::isEnabled()) {                                                              \
+            fastertransformer::HostTracer::pushRange(name);                                                            \
+        }                                                                                                              \
     }
 
 #define POP_RANGE                                                                                                      \
@@ -46,4 +54,7 @@ void        ftNvtxRangePop();
         if (ft_nvtx::isEnableNvtx()) {                                                                                 \
             ft_nvtx::ftNvtxRangePop();                                                                                 \
         }                                                                                                              \
+        if (fastertransformer::HostTracer::isEnabled()) {                                                              \
+            fastertransformer::HostTracer::popRange();                                                                 \
+        }                                                                                                              \
     }
@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) 2023, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/fastertransformer/utils/cuda_utils.h"
+#include "src/fastertransformer/utils/packed_checkpoint.h"
+
+namespace ft = fastertransformer;
+
+int main(int argc, char* argv[])
+{
+    if (argc < 4 || argc > 5) {
+        FT_LOG_ERROR("./bin/pack_checkpoint input_dir \\ \n"
+                     "                      output_dir \\ \n"
+                     "                      data_type (0 FP32, 1 FP16, 2 BF16, 3 INT8) \\ \n"
+                     "                      tensor_para_size");
+        FT_LOG_ERROR("e.g. ./bin/pack_checkpoint ../models/gpt/c-model/345m/1-gpu ../models/gpt/c-model/345m/1-gpu 0");
+        return 0;
+    }
+
+    const std::string        input_dir        = argv[1];
+    const std::string        output_dir       = argv[2];
+    const ft::FtCudaDataType data_type        = static_cast<ft::FtCudaDataType>(atoi(argv[3]));
+    const int                tensor_para_size = argc < 5 ? 1 : atoi(argv[4]);
+
+    size_t element_size = 0;
+    switch (data_type) {
+        case ft::FtCudaDataType::FP32:
+            element_size = 4;
+            break;
+        case ft::FtCudaDataType::FP16:
+        case ft::FtCudaDataType::BF16:
+            element_size = 2;
+            break;
+        case ft::FtCudaDataType::INT8:
+            element_size = 1;
+            break;
+        default:
+            FT_LOG_ERROR("Does not support FtCudaDataType=%d", data_type);
+            return -1;
+    }
+
+    FT_LOG_INFO("Arguments:");
+    FT_LOG_INFO("  input_dir: %s", input_dir.c_str());
+    FT_LOG_INFO("  output_dir: %s", output_dir.c_str());
+    FT_LOG_INFO("  data_type: %d", data_type);
+    FT_LOG_INFO("  tensor_para_size: %d", tensor_para_size);
+
+    ft::convertCheckpointDirectory(input_dir, output_dir, (uint32_t)data_type, element_size, tensor_para_size);
+    return 0;
+}
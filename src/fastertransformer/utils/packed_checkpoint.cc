@@ -0,0 +1,389 @@
+/*
+ * Copyright (c) 2023, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/fastertransformer/utils/packed_checkpoint.h"
+#include "src/fastertransformer/utils/cuda_utils.h"
+
+#include <algorithm>
+#include <cstring>
+#include <dirent.h>
+#include <mutex>
+#include <stdexcept>
+
+namespace fastertransformer {
+
+namespace {
+
+std::string basename(const std::string& path)
+{
+    size_t pos = path.find_last_of('/');
+    return pos == std::string::npos ? path : path.substr(pos + 1);
+}
+
+std::string dirname(const std::string& path)
+{
+    size_t pos = path.find_last_of('/');
+    return pos == std::string::npos ? std::string(".") : path.substr(0, pos);
+}
+
+bool endsWith(const std::string& str, const std::string& suffix)
+{
+    return str.size() >= suffix.size() && str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+std::vector<std::string> listDirectory(const std::string& dir, const std::string& suffix)
+{
+    std::vector<std::string> names;
+    DIR*                     d = opendir(dir.c_str());
+    if (d == nullptr) {
+        return names;
+    }
+    while (struct dirent* ent = readdir(d)) {
+        std::string name(ent->d_name);
+        if (endsWith(name, suffix)) {
+            names.push_back(name);
+        }
+    }
+    closedir(d);
+    std::sort(names.begin(), names.end());
+    return names;
+}
+
+// Returns the tensor parallel rank encoded as `<name>.<rank>.bin`, or -1 if the name has no rank suffix.
+int getRankSuffix(const std::string& name)
+{
+    if (!endsWith(name, ".bin")) {
+        return -1;
+    }
+    std::string stem = name.substr(0, name.size() - 4);
+    size_t      pos  = stem.find_last_of('.');
+    if (pos == std::string::npos || pos + 1 == stem.size()) {
+        return -1;
+    }
+    std::string suffix = stem.substr(pos + 1);
+    if (suffix.find_first_not_of("0123456789") != std::string::npos) {
+        return -1;
+    }
+    return std::stoi(suffix);
+}
+
+// Name of the container of a tensor parallel rank, or of the single container if rank is -1.
+std::string packedCheckpointName(int rank)
+{
+    return "packed" + (rank >= 0 ? "." + std::to_string(rank) : std::string("")) + PACKED_CHECKPOINT_SUFFIX;
+}
+
+// Containers of a checkpoint directory. Only the names are listed up front, the containers are opened when a
+// tensor is looked up in them.
+struct PackedCheckpointDir {
+    std::vector<std::string>                                                 names;
+    std::unordered_map<std::string, std::shared_ptr<PackedCheckpointReader>> readers;  // nullptr if invalid
+};
+
+std::shared_ptr<PackedCheckpointReader>
+openPackedCheckpoint(const std::string& dir, const std::string& name, PackedCheckpointDir* packed_dir)
+{
+    if (std::find(packed_dir->names.begin(), packed_dir->names.end(), name) == packed_dir->names.end()) {
+        return nullptr;
+    }
+    auto it = packed_dir->readers.find(name);
+    if (it == packed_dir->readers.end()) {
+        std::shared_ptr<PackedCheckpointReader> reader = std::make_shared<PackedCheckpointReader>(dir + "/" + name);
+        if (reader->isValid()) {
+            FT_LOG_INFO("Use packed checkpoint %s/%s", dir.c_str(), name.c_str());
+        }
+        else {
+            reader = nullptr;
+        }
+        it = packed_dir->readers.emplace(name, reader).first;
+    }
+    return it->second;
+}
+
+// Containers opened by findPackedCheckpoint, by directory. releasePackedCheckpoints drops them.
+std::mutex& getPackedDirsMutex()
+{
+    static std::mutex mutex;
+    return mutex;
+}
+
+std::unordered_map<std::string, PackedCheckpointDir>& getPackedDirs()
+{
+    static std::unordered_map<std::string, PackedCheckpointDir> packed_dirs;
+    return packed_dirs;
+}
+
+template<typename T>
+void writePod(std::string& buf, const T& val)
+{
+    buf.append((const char*)&val, sizeof(T));
+}
+
+template<typename T>
+bool readPod(const char*& ptr, const char* end, T& val)
+{
+    if (ptr + sizeof(T) > end) {
+        return false;
+    }
+    memcpy(&val, ptr, sizeof(T));
+    ptr += sizeof(T);
+    return true;
+}
+
+}  // namespace
+
+uint32_t crc32(const void* data, size_t size, uint32_t crc)
+{
+    static uint32_t table[256];
+    static bool     is_table_init = []() {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            table[i] = c;
+        }
+        return true;
+    }();
+    (void)is_table_init;
+
+    const uint8_t* bytes = (const uint8_t*)data;
+    crc                  = ~crc;
+    for (size_t i = 0; i < size; i++) {
+        crc = table[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+PackedCheckpointWriter::PackedCheckpointWriter(const std::string& filename, uint64_t alignment):
+    filename_(filename), out_(filename, std::ios::out | std::ios::binary | std::ios::trunc), alignment_(alignment)
+{
+    FT_CHECK_WITH_INFO(out_.is_open(), "Cannot open " + filename + " for writing.");
+    FT_CHECK_WITH_INFO(alignment_ > 0 && (alignment_ & (alignment_ - 1)) == 0, "alignment must be a power of two.");
+    // the header is rewritten by finalize() once the index location is known.
+    PackedCheckpointHeader header{};
+    out_.write((const char*)&header, sizeof(header));
+    offset_ = sizeof(header);
+    pad();
+}
+
+PackedCheckpointWriter::~PackedCheckpointWriter()
+{
+    if (!finalized_) {
+        finalize();
+    }
+}
+
+void PackedCheckpointWriter::pad()
+{
+    uint64_t aligned = (offset_ + alignment_ - 1) / alignment_ * alignment_;
+    if (aligned > offset_) {
+        std::vector<char> zeros(aligned - offset_, 0);
+        out_.write(zeros.data(), zeros.size());
+        offset_ = aligned;
+    }
+}
+
+void PackedCheckpointWriter::addTensor(const std::string& name, uint32_t data_type, const void* data, size_t size)
+{
+    FT_CHECK_WITH_INFO(!finalized_, "Cannot add tensor " + name + " to a finalized packed checkpoint.");
+    PackedTensorEntry entry;
+    entry.name      = name;
+    entry.data_type = data_type;
+    entry.offset    = offset_;
+    entry.size      = size;
+    entry.checksum  = crc32(data, size);
+    out_.write((const char*)data, size);
+    offset_ += size;
+    pad();
+    entries_.push_back(entry);
+}
+
+void PackedCheckpointWriter::addFile(const std::string& filename, uint32_t data_type, size_t element_size)
+{
+    std::shared_ptr<MappedFile> file = openMappedFile(filename);
+    FT_CHECK_WITH_INFO(file != nullptr, "Cannot open " + filename + " for packing.");
+    FT_CHECK_WITH_INFO(file->size() % element_size == 0,
+                       filename + " size is not a multiple of the element size.");
+    addTensor(basename(filename), data_type, file->data(), file->size());
+}
+
+void PackedCheckpointWriter::finalize()
+{
+    if (finalized_) {
+        return;
+    }
+    std::string index;
+    for (const PackedTensorEntry& entry : entries_) {
+        writePod(index, (uint32_t)entry.name.size());
+        index.append(entry.name);
+        writePod(index, entry.data_type);
+        writePod(index, entry.offset);
+        writePod(index, entry.size);
+        writePod(index, entry.checksum);
+    }
+    out_.write(index.data(), index.size());
+
+    PackedCheckpointHeader header;
+    memcpy(header.magic, PACKED_CHECKPOINT_MAGIC, sizeof(header.magic));
+    header.version      = PACKED_CHECKPOINT_VERSION;
+    header.num_tensors  = (uint32_t)entries_.size();
+    header.alignment    = alignment_;
+    header.index_offset = offset_;
+    header.index_size   = index.size();
+    out_.seekp(0, out_.beg);
+    out_.write((const char*)&header, sizeof(header));
+    out_.close();
+    finalized_ = true;
+    FT_LOG_INFO("Packed %d tensors into %s", (int)entries_.size(), filename_.c_str());
+}
+
+PackedCheckpointReader::PackedCheckpointReader(const std::string& filename)
+{
+    char* verify_env = std::getenv("FT_VERIFY_PACKED_CHECKPOINT");
+    verify_on_load_  = verify_env != nullptr && std::string(verify_env) == "ON";
+
+    std::shared_ptr<MappedFile> file = openMappedFile(filename);
+    if (file == nullptr || file->size() < sizeof(PackedCheckpointHeader)) {
+        FT_LOG_WARNING("%s is not a packed checkpoint.", filename.c_str());
+        return;
+    }
+    PackedCheckpointHeader header;
+    memcpy(&header, file->data(), sizeof(header));
+    if (memcmp(header.magic, PACKED_CHECKPOINT_MAGIC, sizeof(header.magic)) != 0
+        || header.version != PACKED_CHECKPOINT_VERSION || header.index_offset + header.index_size > file->size()) {
+        FT_LOG_WARNING("%s has an invalid or unsupported packed checkpoint header.", filename.c_str());
+        return;
+    }
+
+    const char* ptr = (const char*)file->data() + header.index_offset;
+    const char* end = ptr + header.index_size;
+    entries_.resize(header.num_tensors);
+    for (PackedTensorEntry& entry : entries_) {
+        uint32_t name_len = 0;
+        bool     is_valid = readPod(ptr, end, name_len) && ptr + name_len <= end;
+        if (is_valid) {
+            entry.name.assign(ptr, name_len);
+            ptr += name_len;
+        }
+        is_valid = is_valid && readPod(ptr, end, entry.data_type) && readPod(ptr, end, entry.offset) && readPod(ptr, end, entry.size)
+                   && readPod(ptr, end, entry.checksum) && entry.offset + entry.size <= header.index_offset;
+        if (!is_valid) {
+            FT_LOG_WARNING("%s has a corrupted index.", filename.c_str());
+            entries_.clear();
+            name_to_entry_.clear();
+            return;
+        }
+        // size() is read before the insertion: the order of the two is unspecified before C++17.
+        const size_t index         = name_to_entry_.size();
+        name_to_entry_[entry.name] = index;
+    }
+    file_ = file;
+}
+
+const PackedTensorEntry* PackedCheckpointReader::find(const std::string& name) const
+{
+    auto it = name_to_entry_.find(name);
+    return it == name_to_entry_.end() ? nullptr : &entries_[it->second];
+}
+
+bool PackedCheckpointReader::verify(const PackedTensorEntry& entry) const
+{
+    return crc32((const char*)file_->data() + entry.offset, entry.size) == entry.checksum;
+}
+
+void convertCheckpointDirectory(const std::string& input_dir,
+                                const std::string& output_dir,
+                                uint32_t           data_type,
+                                size_t             element_size,
+                                int                tensor_para_size)
+{
+    std::vector<std::string> names = listDirectory(input_dir, ".bin");
+    FT_CHECK_WITH_INFO(!names.empty(), "No .bin file is found in " + input_dir);
+    for (int rank = 0; rank < tensor_para_size; rank++) {
+        PackedCheckpointWriter writer(output_dir + "/" + packedCheckpointName(tensor_para_size > 1 ? rank : -1));
+        for (const std::string& name : names) {
+            int name_rank = tensor_para_size > 1 ? getRankSuffix(name) : -1;
+            if (name_rank == -1 || name_rank == rank) {
+                writer.addFile(input_dir + "/" + name, data_type, element_size);
+            }
+        }
+        writer.finalize();
+    }
+}
+
+std::shared_ptr<PackedCheckpointReader> findPackedCheckpoint(const std::string&        filename,
+                                                             const PackedTensorEntry** entry)
+{
+    std::mutex&                                           mutex       = getPackedDirsMutex();
+    std::unordered_map<std::string, PackedCheckpointDir>& packed_dirs = getPackedDirs();
+
+    const std::string           dir  = dirname(filename);
+    const std::string           name = basename(filename);
+    std::lock_guard<std::mutex> lock(mutex);
+    auto                        it = packed_dirs.find(dir);
+    if (it == packed_dirs.end()) {
+        PackedCheckpointDir packed_dir;
+        packed_dir.names = listDirectory(dir, PACKED_CHECKPOINT_SUFFIX);
+        it               = packed_dirs.emplace(dir, std::move(packed_dir)).first;
+    }
+    PackedCheckpointDir* packed_dir = &it->second;
+    if (packed_dir->names.empty()) {
+        return nullptr;
+    }
+
+    auto find_in = [&](const std::shared_ptr<PackedCheckpointReader>& reader) {
+        const PackedTensorEntry* found = reader == nullptr ? nullptr : reader->find(name);
+        if (found != nullptr) {
+            *entry = found;
+        }
+        return found != nullptr;
+    };
+    // A sliced tensor is only in the container of its rank. A replicated one is in every container, so it is read
+    // from a container this process already maps, and only otherwise from the first valid one of the directory.
+    const int rank = getRankSuffix(name);
+    if (rank >= 0) {
+        for (const std::string& container : {packedCheckpointName(rank), packedCheckpointName(-1)}) {
+            std::shared_ptr<PackedCheckpointReader> reader = openPackedCheckpoint(dir, container, packed_dir);
+            if (find_in(reader)) {
+                return reader;
+            }
+        }
+        return nullptr;
+    }
+    for (const auto& opened : packed_dir->readers) {
+        if (find_in(opened.second)) {
+            return opened.second;
+        }
+    }
+    for (const std::string& container : packed_dir->names) {
+        // The other containers replicate the same tensors, so there is no need to open them as well.
+        std::shared_ptr<PackedCheckpointReader> reader = openPackedCheckpoint(dir, container, packed_dir);
+        if (reader != nullptr) {
+            return find_in(reader) ? reader : nullptr;
+        }
+    }
+    return nullptr;
+}
+
+void releasePackedCheckpoints(const std::string& dir)
+{
+    std::lock_guard<std::mutex> lock(getPackedDirsMutex());
+    // A lookup of dir + "/<name>" keys the containers by dirname, which is dir itself.
+    getPackedDirs().erase(dirname(dir + "/"));
+}
+
+}  // namespace fastertransformer
@@ -0,0 +1,203 @@
+/*
+ * Copyright (c) 2023, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Packed checkpoint container.
+ *
+ * A packed checkpoint replaces a directory of per-tensor `*.bin` files by a single file:
+ *
+ *   [header][payload 0][pad][payload 1][pad]...[index]
+ *
+ * Payloads are aligned to PackedCheckpointHeader::alignment bytes, so that every tensor starts on a page boundary
+ * of the mapping. The index stores, for each tensor, its name (the basename of the original .bin file), data type,
+ * byte offset, byte size and a CRC32 of the payload. Like the .bin files, a container does not store the shapes: the
+ * model gives them when it loads the weights.
+ **/
+
+#pragma once
+
+#include "src/fastertransformer/utils/cuda_utils.h"
+#include "src/fastertransformer/utils/mmap_utils.h"
+
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace fastertransformer {
+
+static const char     PACKED_CHECKPOINT_MAGIC[8]  = {'F', 'T', 'P', 'A', 'C', 'K', '\0', '\0'};
+static const uint32_t PACKED_CHECKPOINT_VERSION   = 2;
+static const uint64_t PACKED_CHECKPOINT_ALIGNMENT = 4096;
+static const char     PACKED_CHECKPOINT_SUFFIX[]  = ".ftpk";
+
+struct PackedCheckpointHeader {
+    char     magic[8];
+    uint32_t version;
+    uint32_t num_tensors;
+    uint64_t alignment;
+    uint64_t index_offset;
+    uint64_t index_size;
+};
+
+struct PackedTensorEntry {
+    std::string name;
+    uint32_t    data_type;  // FtCudaDataType of the payload
+    uint64_t    offset;
+    uint64_t    size;  // in bytes
+    uint32_t    checksum;
+};
+
+uint32_t crc32(const void* data, size_t size, uint32_t crc = 0);
+
+// Whether a tensor packed with data_type (the model_file_type of loadWeightFromBin) is read as T. FP8 checkpoints
+// hold FP32 values. Other types, such as int, have no FtCudaDataType and match any container.
+template<typename T>
+bool isPackedDataTypeOf(uint32_t data_type)
+{
+    return true;
+}
+template<>
+inline bool isPackedDataTypeOf<float>(uint32_t data_type)
+{
+    return data_type == FtCudaDataType::FP32 || data_type == FtCudaDataType::FP8;
+}
+template<>
+inline bool isPackedDataTypeOf<half>(uint32_t data_type)
+{
+    return data_type == FtCudaDataType::FP16;
+}
+#ifdef ENABLE_BF16
+template<>
+inline bool isPackedDataTypeOf<__nv_bfloat16>(uint32_t data_type)
+{
+    return data_type == FtCudaDataType::BF16;
+}
+#endif
+template<>
+inline bool isPackedDataTypeOf<int8_t>(uint32_t data_type)
+{
+    return data_type == FtCudaDataType::INT8;
+}
+
+class PackedCheckpointWriter {
+public:
+    explicit PackedCheckpointWriter(const std::string& filename, uint64_t alignment = PACKED_CHECKPOINT_ALIGNMENT);
+    ~PackedCheckpointWriter();
+
+    void addTensor(const std::string& name, uint32_t data_type, const void* data, size_t size);
+    // Packs the content of an existing per-tensor .bin file under its basename.
+    void addFile(const std::string& filename, uint32_t data_type, size_t element_size);
+    void finalize();
+
+private:
+    std::string                    filename_;
+    std::ofstream                  out_;
+    uint64_t                       alignment_;
+    uint64_t                       offset_;
+    std::vector<PackedTensorEntry> entries_;
+    bool                           finalized_ = false;
+
+    void pad();
+};
+
+class PackedCheckpointReader {
+public:
+    explicit PackedCheckpointReader(const std::string& filename);
+
+    bool isValid() const
+    {
+        return file_ != nullptr;
+    }
+    const PackedTensorEntry* find(const std::string& name) const;
+    const std::vector<PackedTensorEntry>& entries() const
+    {
+        return entries_;
+    }
+    bool verify(const PackedTensorEntry& entry) const;
+
+    template<typename T>
+    MappedWeight<T> mapTensor(const PackedTensorEntry& entry, size_t num_elements) const
+    {
+        FT_CHECK_WITH_INFO(isPackedDataTypeOf<T>(entry.data_type),
+                           fmtstr("tensor %s is packed with data type %u, which does not match the requested one",
+                                  entry.name.c_str(),
+                                  entry.data_type));
+        MappedWeight<T> weight;
+        if (entry.size < sizeof(T) * num_elements) {
+            FT_LOG_WARNING("tensor %s only has %ld bytes, but request %ld, loading model fails! \n",
+                           entry.name.c_str(),
+                           entry.size,
+                           sizeof(T) * num_elements);
+            return weight;
+        }
+        if (verify_on_load_ && !verify(entry)) {
+            FT_LOG_WARNING("checksum of tensor %s mismatches, loading model fails! \n", entry.name.c_str());
+            return weight;
+        }
+        file_->prefetch(entry.offset, entry.size);
+        weight.file = file_;
+        weight.data = reinterpret_cast<const T*>((const char*)file_->data() + entry.offset);
+        weight.size = num_elements;
+        return weight;
+    }
+
+private:
+    std::shared_ptr<MappedFile>             file_;
+    std::vector<PackedTensorEntry>          entries_;
+    std::unordered_map<std::string, size_t> name_to_entry_;
+    bool                                    verify_on_load_ = false;  // FT_VERIFY_PACKED_CHECKPOINT=ON
+};
+
+// Packs every `*.bin` file of input_dir into output_dir. If tensor_para_size > 1, tensors with a `.<rank>.bin`
+// suffix are written to the container of that rank (`packed.<rank>.ftpk`), and the others are replicated in every
+// container, so that a rank only has to map its own file.
+void convertCheckpointDirectory(const std::string& input_dir,
+                                const std::string& output_dir,
+                                uint32_t           data_type,
+                                size_t             element_size,
+                                int                tensor_para_size = 1);
+
+// Looks for `filename`'s basename in the packed checkpoints next to it. A `.<rank>.bin` tensor is only looked up in
+// the container of that rank (or the single `packed.ftpk`), and a replicated tensor in a container which is already
+// open, so a rank does not map the containers of the other ranks. Returns nullptr if no container has the tensor.
+std::shared_ptr<PackedCheckpointReader> findPackedCheckpoint(const std::string& filename,
+                                                             const PackedTensorEntry** entry);
+
+// Forgets the containers findPackedCheckpoint opened in dir, so that they are unmapped once the weights mapped from
+// them are released. Model loaders call it when they are done with dir; a later lookup opens the containers again.
+void releasePackedCheckpoints(const std::string& dir);
+
+// Maps a weight either from a packed checkpoint found next to filename, or from filename itself.
+template<typename T>
+MappedWeight<T> mapCheckpointWeight(std::vector<size_t> shape, std::string filename)
+{
+    const PackedTensorEntry*                entry  = nullptr;
+    std::shared_ptr<PackedCheckpointReader> reader = findPackedCheckpoint(filename, &entry);
+    if (reader == nullptr) {
+        return mapWeightFromBin<T>(shape, filename);
+    }
+    size_t size = weightNumElements(shape, filename);
+    if (size == 0) {
+        FT_LOG_WARNING("shape is zero, skip loading weight from file %s \n", filename.c_str());
+        return MappedWeight<T>();
+    }
+    return reader->mapTensor<T>(*entry, size);
+}
+
+}  // namespace fastertransformer
@@ -0,0 +1,268 @@
+/*
+ * Copyright (c) 2023, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/fastertransformer/utils/prefix_kv_cache.h"
+#include "src/fastertransformer/utils/cuda_utils.h"
+
+#include <algorithm>
+#include <functional>
+#include <queue>
+
+namespace fastertransformer {
+
+struct PrefixKVCacheNode {
+    PrefixKVCacheNode* parent = nullptr;
+    std::vector<int>   tokens;  // blocks.size() * block_size token ids
+    std::vector<int>   blocks;
+    // Keyed by the token ids of the first block of the child.
+    std::map<std::vector<int>, std::unique_ptr<PrefixKVCacheNode>> children;
+    int                                                            pin_count   = 0;
+    uint64_t                                                       last_access = 0;
+};
+
+namespace {
+
+void pin(PrefixKVCacheNode* node, int delta)
+{
+    for (; node != nullptr && node->parent != nullptr; node = node->parent) {
+        node->pin_count += delta;
+    }
+}
+
+// Number of leading blocks of node which hold tokens[0, num_blocks * block_size).
+size_t matchBlocks(const PrefixKVCacheNode* node, const int* tokens, size_t num_blocks, size_t block_size)
+{
+    size_t matched = 0;
+    while (matched < std::min(num_blocks, node->blocks.size())
+           && std::equal(tokens + matched * block_size,
+                         tokens + (matched + 1) * block_size,
+                         node->tokens.begin() + matched * block_size)) {
+        matched++;
+    }
+    return matched;
+}
+
+}  // namespace
+
+PrefixKVCache::PrefixKVCache(KVCacheBlockManager* block_manager, size_t max_cached_blocks):
+    block_manager_(block_manager),
+    block_size_(block_manager->blockSize()),
+    max_cached_blocks_(max_cached_blocks),
+    root_(new PrefixKVCacheNode())
+{
+}
+
+PrefixKVCache::~PrefixKVCache()
+{
+    std::vector<PrefixKVCacheNode*> nodes = {root_.get()};
+    while (!nodes.empty()) {
+        PrefixKVCacheNode* node = nodes.back();
+        nodes.pop_back();
+        for (int block : node->blocks) {
+            block_manager_->releaseBlock(block);
+        }
+        for (auto& child : node->children) {
+            nodes.push_back(child.second.get());
+        }
+    }
+}
+
+void PrefixKVCache::touch(PrefixKVCacheNode* node)
+{
+    tick_++;
+    for (; node != nullptr; node = node->parent) {
+        node->last_access = tick_;
+    }
+}
+
+PrefixKVCacheMatch PrefixKVCache::match(const int* tokens, size_t length)
+{
+    PrefixKVCacheMatch result;
+    stats_.num_lookups++;
+    // The last token is recomputed, so that the context step still produces the logits of the prompt.
+    const size_t max_blocks = length > 0 ? (length - 1) / block_size_ : 0;
+
+    PrefixKVCacheNode* node     = root_.get();
+    size_t             position = 0;  // in blocks
+    while (position < max_blocks) {
+        const int* block_tokens = tokens + position * block_size_;
+        auto       it           = node->children.find(std::vector<int>(block_tokens, block_tokens + block_size_));
+        if (it == node->children.end()) {
+            break;
+        }
+        PrefixKVCacheNode* child   = it->second.get();
+        const size_t       matched = matchBlocks(child, block_tokens, max_blocks - position, block_size_);
+        result.blocks.insert(result.blocks.end(), child->blocks.begin(), child->blocks.begin() + matched);
+        position += matched;
+        node = child;
+        if (matched < child->blocks.size()) {
+            break;
+        }
+    }
+
+    result.length = position * block_size_;
+    if (node != root_.get()) {
+        result.node = node;
+        pin(node, 1);
+        touch(node);
+        stats_.num_hits++;
+        stats_.num_hit_tokens += result.length;
+    }
+    return result;
+}
+
+void PrefixKVCache::release(PrefixKVCacheMatch* match)
+{
+    pin(match->node, -1);
+    match->node = nullptr;
+    match->blocks.clear();
+    match->length = 0;
+}
+
+PrefixKVCacheNode* PrefixKVCache::split(PrefixKVCacheNode* node, size_t num_blocks)
+{
+    // The original node keeps its children and becomes the lower half, so outstanding matches which point to it
+    // still release every node of their path.
+    PrefixKVCacheNode* parent = node->parent;
+    std::vector<int>   key(node->tokens.begin(), node->tokens.begin() + block_size_);
+
+    std::unique_ptr<PrefixKVCacheNode> top(new PrefixKVCacheNode());
+    top->parent      = parent;
+    top->tokens      = std::vector<int>(node->tokens.begin(), node->tokens.begin() + num_blocks * block_size_);
+    top->blocks      = std::vector<int>(node->blocks.begin(), node->blocks.begin() + num_blocks);
+    top->pin_count   = node->pin_count;
+    top->last_access = node->last_access;
+    node->tokens.erase(node->tokens.begin(), node->tokens.begin() + num_blocks * block_size_);
+    node->blocks.erase(node->blocks.begin(), node->blocks.begin() + num_blocks);
+
+    std::unique_ptr<PrefixKVCacheNode> bottom = std::move(parent->children[key]);
+    bottom->parent                            = top.get();
+    top->children[std::vector<int>(node->tokens.begin(), node->tokens.begin() + block_size_)] = std::move(bottom);
+
+    PrefixKVCacheNode* result = top.get();
+    parent->children[key]     = std::move(top);
+    num_nodes_++;
+    return result;
+}
+
+size_t PrefixKVCache::insert(const int* tokens, size_t length, const std::vector<int>& blocks)
+{
+    const size_t num_blocks = std::min(length / block_size_, blocks.size());
+
+    PrefixKVCacheNode* node     = root_.get();
+    size_t             position = 0;
+    while (position < num_blocks) {
+        const int* block_tokens = tokens + position * block_size_;
+        auto       it           = node->children.find(std::vector<int>(block_tokens, block_tokens + block_size_));
+        if (it == node->children.end()) {
+            break;
+        }
+        PrefixKVCacheNode* child   = it->second.get();
+        const size_t       matched = matchBlocks(child, block_tokens, num_blocks - position, block_size_);
+        position += matched;
+        if (matched < child->blocks.size() && position < num_blocks) {
+            node = split(child, matched);  // the new blocks branch off in the middle of the run of child
+            break;
+        }
+        node = child;
+    }
+    touch(node);
+    if (position == num_blocks) {
+        return 0;
+    }
+
+    // Keep the path alive while making room for the new blocks.
+    size_t num_new_blocks = num_blocks - position;
+    pin(node, 1);
+    if (num_cached_blocks_ + num_new_blocks > max_cached_blocks_) {
+        evict(num_cached_blocks_ + num_new_blocks - max_cached_blocks_);
+    }
+    pin(node, -1);
+    num_new_blocks = std::min(num_new_blocks, max_cached_blocks_ - std::min(max_cached_blocks_, num_cached_blocks_));
+    if (num_new_blocks == 0) {
+        return 0;
+    }
+
+    std::unique_ptr<PrefixKVCacheNode> leaf(new PrefixKVCacheNode());
+    leaf->parent = node;
+    leaf->tokens = std::vector<int>(tokens + position * block_size_,
+                                    tokens + (position + num_new_blocks) * block_size_);
+    leaf->blocks = std::vector<int>(blocks.begin() + position, blocks.begin() + position + num_new_blocks);
+    for (int block : leaf->blocks) {
+        block_manager_->addBlockRef(block);
+    }
+    PrefixKVCacheNode* leaf_ptr = leaf.get();
+    node->children[std::vector<int>(leaf->tokens.begin(), leaf->tokens.begin() + block_size_)] = std::move(leaf);
+    num_cached_blocks_ += num_new_blocks;
+    num_nodes_++;
+    touch(leaf_ptr);
+    return num_new_blocks;
+}
+
+void PrefixKVCache::removeLeaf(PrefixKVCacheNode* node)
+{
+    for (int block : node->blocks) {
+        block_manager_->releaseBlock(block);
+    }
+    num_cached_blocks_ -= node->blocks.size();
+    stats_.num_evicted_blocks += node->blocks.size();
+    num_nodes_--;
+    node->parent->children.erase(std::vector<int>(node->tokens.begin(), node->tokens.begin() + block_size_));
+}
+
+size_t PrefixKVCache::evict(size_t num_blocks)
+{
+    typedef std::pair<uint64_t, PrefixKVCacheNode*> Candidate;
+    std::priority_queue<Candidate, std::vector<Candidate>, std::greater<Candidate>> candidates;
+    auto is_evictable = [this](const PrefixKVCacheNode* node) {
+        return node != root_.get() && node->children.empty() && node->pin_count == 0;
+    };
+
+    std::vector<PrefixKVCacheNode*> nodes = {root_.get()};
+    while (!nodes.empty()) {
+        PrefixKVCacheNode* node = nodes.back();
+        nodes.pop_back();
+        if (is_evictable(node)) {
+            candidates.push({node->last_access, node});
+        }
+        for (auto& child : node->children) {
+            nodes.push_back(child.second.get());
+        }
+    }
+
+    size_t num_freed = 0;
+    while (num_freed < num_blocks && !candidates.empty()) {
+        PrefixKVCacheNode* node = candidates.top().second;
+        candidates.pop();
+        PrefixKVCacheNode* parent = node->parent;
+        num_freed += node->blocks.size();
+        removeLeaf(node);
+        if (is_evictable(parent)) {
+            candidates.push({parent->last_access, parent});
+        }
+    }
+    return num_freed;
+}
+
+PrefixKVCacheStats PrefixKVCache::getStats() const
+{
+    PrefixKVCacheStats stats = stats_;
+    stats.num_cached_blocks  = num_cached_blocks_;
+    stats.num_nodes          = num_nodes_;
+    return stats;
+}
+
+}  // namespace fastertransformer
@@ -0,0 +1,102 @@
+/*
+ * Copyright (c) 2023, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Cross-request prompt prefix cache over the paged key/value cache.
+ *
+ * The key/value entries of a token only depend on the tokens before it, so the blocks computed for a prompt can be
+ * reused by any later prompt which starts with the same tokens. Full blocks of finished context steps are kept in a
+ * radix tree keyed by token ids: each edge holds a run of whole blocks and their token ids, and a node is split when
+ * two prompts diverge in the middle of its run. Only full blocks are cached, since they are never written again.
+ *
+ * A new request looks up its longest cached prefix, starts its sequence from those blocks (see
+ * KVCacheBlockManager::addSequence) and only runs the context decoder on the remaining tokens. Matched nodes are
+ * pinned until the request releases its match. When the cache holds more than max_cached_blocks, the least
+ * recently used unpinned leaves are evicted and their blocks are returned to the block manager.
+ **/
+
+#pragma once
+
+#include "src/fastertransformer/utils/kv_cache_block_manager.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <vector>
+
+namespace fastertransformer {
+
+struct PrefixKVCacheNode;
+
+struct PrefixKVCacheMatch {
+    size_t             length = 0;  // number of cached tokens, a multiple of the block size
+    std::vector<int>   blocks;      // blocks of the cached tokens
+    PrefixKVCacheNode* node = nullptr;
+};
+
+struct PrefixKVCacheStats {
+    size_t num_lookups        = 0;
+    size_t num_hits           = 0;  // lookups which matched at least one block
+    size_t num_hit_tokens     = 0;  // context tokens which did not have to be recomputed
+    size_t num_cached_blocks  = 0;
+    size_t num_nodes          = 0;
+    size_t num_evicted_blocks = 0;
+};
+
+class PrefixKVCache {
+public:
+    PrefixKVCache(KVCacheBlockManager* block_manager, size_t max_cached_blocks);
+    ~PrefixKVCache();
+    PrefixKVCache(PrefixKVCache const&)  = delete;
+    void operator=(PrefixKVCache const&) = delete;
+
+    // Longest cached prefix of tokens. The returned blocks stay cached until release() is called with the match.
+    // A prefix never covers the whole prompt: the last token is always recomputed to produce the first logits.
+    PrefixKVCacheMatch match(const int* tokens, size_t length);
+    void               release(PrefixKVCacheMatch* match);
+
+    // Caches the full blocks of a sequence whose first length tokens are tokens, stored in blocks. The cache takes
+    // its own reference on the blocks it keeps, so the sequence can be removed afterwards. Returns the number of
+    // newly cached blocks, which may be less than requested if the budget is exhausted by pinned blocks.
+    size_t insert(const int* tokens, size_t length, const std::vector<int>& blocks);
+
+    // Evicts least recently used unpinned leaves until at least num_blocks blocks are freed, or nothing is left to
+    // evict. Returns the number of freed blocks.
+    size_t evict(size_t num_blocks);
+
+    size_t numCachedBlocks() const
+    {
+        return num_cached_blocks_;
+    }
+    PrefixKVCacheStats getStats() const;
+
+private:
+    PrefixKVCacheNode* split(PrefixKVCacheNode* node, size_t num_blocks);
+    void               removeLeaf(PrefixKVCacheNode* node);
+    void               touch(PrefixKVCacheNode* node);
+
+    KVCacheBlockManager*               block_manager_;
+    const size_t                       block_size_;
+    const size_t                       max_cached_blocks_;
+    std::unique_ptr<PrefixKVCacheNode> root_;
+    uint64_t                           tick_              = 0;
+    size_t                             num_cached_blocks_ = 0;
+    size_t                             num_nodes_         = 0;
+    PrefixKVCacheStats                 stats_;
+};
+
+}  // namespace fastertransformer
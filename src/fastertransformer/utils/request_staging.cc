@@ -0,0 +1,113 @@
+/*
+ * Copyright (c) 2023, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/fastertransformer/utils/request_staging.h"
+#include "src/fastertransformer/utils/cuda_utils.h"
+
+#include <cstring>
+
+namespace fastertransformer {
+
+const size_t RequestStaging::kMaxCachedLayouts;
+
+RequestStaging::RequestStaging(IAllocator* allocator, size_t alignment):
+    allocator_(allocator), h_allocator_(CpuAllocatorMode::PINNED_POOL), alignment_(alignment)
+{
+    FT_CHECK_WITH_INFO(alignment > 0 && (alignment & (alignment - 1)) == 0,
+                       fmtstr("The alignment %ld is not a power of two.", alignment));
+}
+
+RequestStaging::~RequestStaging()
+{
+    if (is_copy_in_flight_) {
+        cudaEventSynchronize(copy_done_);
+    }
+    if (copy_done_ != nullptr) {
+        cudaEventDestroy(copy_done_);
+    }
+    // h_allocator_ frees the pinned buffer when it is destroyed.
+    allocator_->free((void**)(&d_buffer_));
+}
+
+void RequestStaging::clear()
+{
+    inputs_.clear();
+    sizes_.clear();
+    layout_ = nullptr;
+}
+
+int RequestStaging::add(const void* data, size_t size)
+{
+    inputs_.push_back(data);
+    sizes_.push_back(size);
+    return (int)inputs_.size() - 1;
+}
+
+const RequestStaging::Layout& RequestStaging::getLayout()
+{
+    std::string key((const char*)sizes_.data(), sizes_.size() * sizeof(size_t));
+    auto        layout = layouts_.find(key);
+    if (layout != layouts_.end()) {
+        return layout->second;
+    }
+
+    if (layouts_.size() >= kMaxCachedLayouts) {
+        layouts_.clear();
+    }
+    Layout new_layout;
+    new_layout.size = 0;
+    for (size_t size : sizes_) {
+        new_layout.offsets.push_back(new_layout.size);
+        new_layout.size += (size + alignment_ - 1) / alignment_ * alignment_;
+    }
+    return layouts_.emplace(std::move(key), std::move(new_layout)).first->second;
+}
+
+void RequestStaging::copyToDevice(cudaStream_t stream)
+{
+    layout_ = &getLayout();
+    if (layout_->size == 0) {
+        return;
+    }
+
+    // The previous copy may still read the pinned buffer.
+    if (is_copy_in_flight_) {
+        check_cuda_error(cudaEventSynchronize(copy_done_));
+        is_copy_in_flight_ = false;
+    }
+    if (layout_->size > h_capacity_) {
+        h_buffer_   = (char*)h_allocator_.reMalloc(h_buffer_, layout_->size, false);
+        h_capacity_ = layout_->size;
+        // Only one pinned buffer is used at a time, so the one it replaces is not kept cached.
+        h_allocator_.trimCache();
+    }
+    if (layout_->size > d_capacity_) {
+        d_buffer_   = (char*)allocator_->reMalloc(d_buffer_, layout_->size, false);
+        d_capacity_ = layout_->size;
+    }
+
+    for (size_t i = 0; i < inputs_.size(); i++) {
+        std::memcpy(h_buffer_ + layout_->offsets[i], inputs_[i], sizes_[i]);
+    }
+    check_cuda_error(cudaMemcpyAsync(d_buffer_, h_buffer_, layout_->size, cudaMemcpyHostToDevice, stream));
+    if (copy_done_ == nullptr) {
+        check_cuda_error(cudaEventCreateWithFlags(&copy_done_, cudaEventDisableTiming));
+    }
+    check_cuda_error(cudaEventRecord(copy_done_, stream));
+    is_copy_in_flight_ = true;
+}
+
+}  // namespace fastertransformer
@@ -0,0 +1,99 @@
+/*
+ * Copyright (c) 2023, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Staging of the host inputs of a request (input ids, lengths, word lists, runtime arguments...) for the device.
+ *
+ * Instead of one buffer, one reMalloc and one copy per input, the inputs are packed into one pinned host buffer at
+ * aligned offsets, copied with a single cudaMemcpyAsync into one device buffer, and handed out as views of it. Both
+ * buffers are kept from one request to the next and only grow. The pinned buffer comes from a pinned pool
+ * Allocator<AllocatorType::CPU>, the device buffer from the allocator given to the constructor.
+ *
+ * The offsets only depend on the sizes of the inputs, which repeat from one request to the next for a given batch
+ * size and input length, so the layouts are cached by the list of sizes.
+ **/
+
+#pragma once
+
+#include "src/fastertransformer/utils/allocator.h"
+
+#include <cstddef>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace fastertransformer {
+
+class RequestStaging {
+public:
+    // alignment of each input in the device buffer, cudaMalloc aligns its buffers to 256 bytes.
+    explicit RequestStaging(IAllocator* allocator, size_t alignment = 256);
+    RequestStaging(const RequestStaging&) = delete;
+    RequestStaging& operator=(const RequestStaging&) = delete;
+    ~RequestStaging();
+
+    // Forgets the inputs of the previous request.
+    void clear();
+    // Adds the size bytes at data, on the host, and returns the index of the input. data is read by copyToDevice.
+    int add(const void* data, size_t size);
+    // Packs the inputs and copies them to the device on stream. The copy is asynchronous: the next copyToDevice
+    // waits for it before it reuses the pinned buffer.
+    void copyToDevice(cudaStream_t stream);
+
+    // The input on the device, after copyToDevice, or nullptr for the index -1.
+    void* getDevicePtr(int index) const
+    {
+        return index < 0 ? nullptr : d_buffer_ + layout_->offsets[index];
+    }
+    template<typename T>
+    T* getDevicePtr(int index) const
+    {
+        return static_cast<T*>(getDevicePtr(index));
+    }
+
+    size_t getNumCachedLayouts() const
+    {
+        return layouts_.size();
+    }
+
+private:
+    struct Layout {
+        std::vector<size_t> offsets;
+        size_t              size;
+    };
+    static const size_t kMaxCachedLayouts = 64;
+
+    const Layout& getLayout();
+
+    IAllocator*                   allocator_;
+    Allocator<AllocatorType::CPU> h_allocator_;
+    const size_t                  alignment_;
+
+    std::vector<const void*> inputs_;
+    std::vector<size_t>      sizes_;
+
+    std::unordered_map<std::string, Layout> layouts_;  // keyed by the bytes of sizes_
+    const Layout*                           layout_ = nullptr;
+
+    char*       h_buffer_          = nullptr;  // pinned
+    size_t      h_capacity_        = 0;
+    char*       d_buffer_          = nullptr;
+    size_t      d_capacity_        = 0;
+    cudaEvent_t copy_done_         = nullptr;
+    bool        is_copy_in_flight_ = false;
+};
+
+}  // namespace fastertransformer
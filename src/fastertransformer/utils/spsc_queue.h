@@ -0,0 +1,126 @@
+/*
+ * Copyright (c) 2023, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Bounded lock-free queue between exactly one producer thread and one consumer thread.
+ *
+ * The elements live in a ring of a power-of-two number of slots. The producer only writes tail_ and the consumer
+ * only writes head_, so each side needs a single acquire load of the other side's index and a release store of its
+ * own: neither side ever blocks the other. The indices are on separate cache lines to avoid false sharing.
+ **/
+
+#pragma once
+
+#include "src/fastertransformer/utils/cuda_utils.h"
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+namespace fastertransformer {
+
+template<typename T>
+class SpscQueue {
+public:
+    // capacity is rounded up to a power of two.
+    explicit SpscQueue(size_t capacity)
+    {
+        FT_CHECK_WITH_INFO(capacity > 0, "The capacity of a SpscQueue must be positive.");
+        size_t num_slots = 1;
+        while (num_slots < capacity) {
+            num_slots *= 2;
+        }
+        slots_.resize(num_slots);
+        mask_ = num_slots - 1;
+    }
+    SpscQueue(SpscQueue const&)      = delete;
+    void operator=(SpscQueue const&) = delete;
+
+    // Producer side. Returns false, and leaves value untouched, if the queue is full.
+    bool tryPush(T&& value)
+    {
+        const size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - head_.load(std::memory_order_acquire) == slots_.size()) {
+            return false;
+        }
+        slots_[tail & mask_] = std::move(value);
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Producer side, to build a large element in place: the slot of the next element, nullptr if the queue is full.
+    // The element is published by commitPush.
+    T* tryAcquirePush()
+    {
+        const size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - head_.load(std::memory_order_acquire) == slots_.size()) {
+            return nullptr;
+        }
+        return &slots_[tail & mask_];
+    }
+    void commitPush()
+    {
+        tail_.store(tail_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    // Consumer side. Returns false if the queue is empty.
+    bool tryPop(T* value)
+    {
+        const size_t head = head_.load(std::memory_order_relaxed);
+        if (head == tail_.load(std::memory_order_acquire)) {
+            return false;
+        }
+        *value = std::move(slots_[head & mask_]);
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side, to read an element in place: the next element, nullptr if the queue is empty. It stays in the
+    // queue until pop.
+    const T* front() const
+    {
+        const size_t head = head_.load(std::memory_order_relaxed);
+        return head == tail_.load(std::memory_order_acquire) ? nullptr : &slots_[head & mask_];
+    }
+    void pop()
+    {
+        head_.store(head_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    // Exact when called from either end while the other one is idle, a snapshot otherwise.
+    size_t size() const
+    {
+        return tail_.load(std::memory_order_acquire) - head_.load(std::memory_order_acquire);
+    }
+    bool empty() const
+    {
+        return size() == 0;
+    }
+    size_t capacity() const
+    {
+        return slots_.size();
+    }
+
+private:
+    std::vector<T> slots_;
+    size_t         mask_;
+
+    alignas(64) std::atomic<size_t> head_{0};  // next slot to pop, written by the consumer
+    alignas(64) std::atomic<size_t> tail_{0};  // next slot to push, written by the producer
+};
+
+}  // namespace fastertransformer
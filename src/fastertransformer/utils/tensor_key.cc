@@ -0,0 +1,57 @@
+/*
+ * Copyright (c) 2023, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/fastertransformer/utils/tensor_key.h"
+
+#include <unordered_map>
+
+namespace fastertransformer {
+
+namespace tensor_keys {
+// Constant-initialized, so they can be used during the dynamic initialization of other translation units.
+#define FT_STATIC_TENSOR_KEY(name) const TensorKey name{TENSOR_KEY_##name, #name, sizeof(#name) - 1};
+FT_TENSOR_KEYS(FT_STATIC_TENSOR_KEY)
+#undef FT_STATIC_TENSOR_KEY
+}  // namespace tensor_keys
+
+namespace {
+
+const std::unordered_map<std::string, TensorKey>& getStaticTensorKeys()
+{
+    static const std::unordered_map<std::string, TensorKey> static_keys = {
+#define FT_STATIC_TENSOR_KEY_ENTRY(name) {#name, tensor_keys::name},
+        FT_TENSOR_KEYS(FT_STATIC_TENSOR_KEY_ENTRY)
+#undef FT_STATIC_TENSOR_KEY_ENTRY
+    };
+    return static_keys;
+}
+
+}  // namespace
+
+TensorKey::TensorKey(const char* name, size_t length): id_(TENSOR_KEY_DYNAMIC), length_((uint32_t)length)
+{
+    const std::unordered_map<std::string, TensorKey>& static_keys = getStaticTensorKeys();
+    std::string                                       str(name, length);
+    auto                                              it = static_keys.find(str);
+    if (it != static_keys.end()) {
+        *this = it->second;
+        return;
+    }
+    owned_name_ = std::make_shared<const std::string>(std::move(str));
+    name_       = owned_name_->c_str();
+}
+
+}  // namespace fastertransformer
@@ -0,0 +1,160 @@
+/*
+ * Copyright (c) 2023, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Keys of TensorMap.
+ *
+ * TensorMap is rebuilt on every generation step, and looking its tensors up by std::string hashes and compares the
+ * names again and again. The names used on the per-step path are declared in FT_TENSOR_KEYS. They have fixed ids
+ * and are constant-initialized (tensor_keys::logits, ...), so they compare by id, cost nothing at run time, and a
+ * typo is a compile error.
+ *
+ * Any other name is not interned: TensorKey(name) shares a copy of it between the copies of the key, and compares
+ * as a string. Names can come from requests or files, so a process-wide registry of them would grow without bound.
+ **/
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+
+namespace fastertransformer {
+
+// clang-format off
+#define FT_TENSOR_KEYS(X)                                                                                              \
+    X(logits) X(embedding_bias) X(step) X(max_input_length) X(input_lengths) X(ite) X(local_batch_size) X(end_id)      \
+    X(min_length) X(sequence_limit_length) X(stop_words_list) X(bad_words_list) X(runtime_top_k) X(runtime_top_p)     \
+    X(temperature) X(len_penalty) X(repetition_penalty) X(presence_penalty) X(beam_search_diversity_rate)              \
+    X(random_seed) X(top_p_decay) X(top_p_min) X(top_p_reset_ids) X(src_cache_indirection)                             \
+    X(is_initialize_random_table) X(output_ids) X(finished) X(should_stop) X(cum_log_probs) X(parent_ids)              \
+    X(sequence_length) X(output_log_probs) X(tgt_cache_indirection) X(beam_hyps)
+// clang-format on
+
+enum TensorKeyId : uint32_t {
+#define FT_TENSOR_KEY_ID(name) TENSOR_KEY_##name,
+    FT_TENSOR_KEYS(FT_TENSOR_KEY_ID)
+#undef FT_TENSOR_KEY_ID
+        NUM_STATIC_TENSOR_KEYS,
+    TENSOR_KEY_DYNAMIC = NUM_STATIC_TENSOR_KEYS  // the id of every name which is not in FT_TENSOR_KEYS
+};
+
+class TensorKey {
+public:
+    constexpr TensorKey(uint32_t id, const char* name, uint32_t length): id_(id), length_(length), name_(name) {}
+    // Resolves name to its static key, or copies it. Prefer the static keys on hot paths.
+    TensorKey(const char* name, size_t length);
+    explicit TensorKey(const std::string& name): TensorKey(name.c_str(), name.size()) {}
+    explicit TensorKey(const char* name): TensorKey(name, std::strlen(name)) {}
+
+    uint32_t id() const
+    {
+        return id_;
+    }
+    const char* c_str() const
+    {
+        return name_;
+    }
+    size_t length() const
+    {
+        return length_;
+    }
+    std::string str() const
+    {
+        return std::string(name_, length_);
+    }
+    operator std::string() const
+    {
+        return str();
+    }
+
+    bool isStatic() const
+    {
+        return id_ != TENSOR_KEY_DYNAMIC;
+    }
+    // A dynamic key never holds the name of a static one, so the names are only compared between dynamic keys.
+    bool operator==(const TensorKey& other) const
+    {
+        return id_ == other.id_ && (isStatic() || other.equals(name_, length_));
+    }
+    bool operator!=(const TensorKey& other) const
+    {
+        return !(*this == other);
+    }
+    bool equals(const char* name, size_t length) const
+    {
+        return length_ == length && std::memcmp(name_, name, length) == 0;
+    }
+    bool operator==(const std::string& name) const
+    {
+        return equals(name.c_str(), name.size());
+    }
+    bool operator!=(const std::string& name) const
+    {
+        return !(*this == name);
+    }
+    bool operator==(const char* name) const
+    {
+        return equals(name, std::strlen(name));
+    }
+    bool operator!=(const char* name) const
+    {
+        return !(*this == name);
+    }
+
+private:
+    uint32_t                           id_;
+    uint32_t                           length_;
+    const char*                        name_;        // a literal for the static keys, or owned_name_'s characters
+    std::shared_ptr<const std::string> owned_name_;  // nullptr for the static keys
+};
+
+namespace tensor_keys {
+#define FT_STATIC_TENSOR_KEY(name) extern const TensorKey name;
+FT_TENSOR_KEYS(FT_STATIC_TENSOR_KEY)
+#undef FT_STATIC_TENSOR_KEY
+}  // namespace tensor_keys
+
+// A key of a TensorMap lookup: either an interned key, compared by id, or a plain name, compared as a string. It
+// refers to the name of the caller, and must not outlive the call.
+class TensorKeyRef {
+public:
+    TensorKeyRef(const TensorKey& key): key_(&key), name_(key.c_str()), length_(key.length()) {}
+    TensorKeyRef(const std::string& name): key_(nullptr), name_(name.c_str()), length_(name.size()) {}
+    TensorKeyRef(const char* name): key_(nullptr), name_(name), length_(std::strlen(name)) {}
+
+    bool matches(const TensorKey& key) const
+    {
+        return key_ != nullptr ? *key_ == key : key.equals(name_, length_);
+    }
+    // Copies the name if it is not a static key.
+    TensorKey toKey() const
+    {
+        return key_ != nullptr ? *key_ : TensorKey(name_, length_);
+    }
+    const char* c_str() const
+    {
+        return name_;
+    }
+
+private:
+    const TensorKey* key_;
+    const char*      name_;
+    size_t           length_;
+};
+
+}  // namespace fastertransformer
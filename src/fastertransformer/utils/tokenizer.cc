@@ -0,0 +1,1048 @@
+/*
+ * Copyright (c) 2023, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/fastertransformer/utils/tokenizer.h"
+#include "src/fastertransformer/utils/cuda_utils.h"
+#include "src/fastertransformer/utils/logger.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <queue>
+#include <sstream>
+#include <thread>
+
+namespace fastertransformer {
+
+namespace {
+
+const char* const kSentencePieceSpace = "\xe2\x96\x81";  // U+2581, "▁"
+
+// Length of the UTF-8 sequence starting with c, 1 for bytes which cannot start a sequence.
+size_t getUtf8Length(unsigned char c)
+{
+    if (c < 0xC0) {
+        return 1;
+    }
+    return c < 0xE0 ? 2 : (c < 0xF0 ? 3 : (c < 0xF8 ? 4 : 1));
+}
+
+// Decodes the code point at text[pos], and sets its length in bytes. Invalid sequences decode byte per byte.
+uint32_t decodeUtf8(const char* text, size_t length, size_t pos, size_t* char_length)
+{
+    const unsigned char c = text[pos];
+    size_t              n = getUtf8Length(c);
+    if (n == 1 || pos + n > length) {
+        *char_length = 1;
+        return c;
+    }
+    uint32_t code_point = c & (0x7F >> n);
+    for (size_t i = 1; i < n; i++) {
+        const unsigned char d = text[pos + i];
+        if ((d & 0xC0) != 0x80) {
+            *char_length = 1;
+            return c;
+        }
+        code_point = (code_point << 6) | (d & 0x3F);
+    }
+    *char_length = n;
+    return code_point;
+}
+
+void appendUtf8(uint32_t code_point, std::string* out)
+{
+    if (code_point < 0x80) {
+        out->push_back((char)code_point);
+    }
+    else if (code_point < 0x800) {
+        out->push_back((char)(0xC0 | (code_point >> 6)));
+        out->push_back((char)(0x80 | (code_point & 0x3F)));
+    }
+    else if (code_point < 0x10000) {
+        out->push_back((char)(0xE0 | (code_point >> 12)));
+        out->push_back((char)(0x80 | ((code_point >> 6) & 0x3F)));
+        out->push_back((char)(0x80 | (code_point & 0x3F)));
+    }
+    else {
+        out->push_back((char)(0xF0 | (code_point >> 18)));
+        out->push_back((char)(0x80 | ((code_point >> 12) & 0x3F)));
+        out->push_back((char)(0x80 | ((code_point >> 6) & 0x3F)));
+        out->push_back((char)(0x80 | (code_point & 0x3F)));
+    }
+}
+
+std::string readFile(const std::string& path)
+{
+    std::ifstream file(path, std::ios::in | std::ios::binary);
+    FT_CHECK_WITH_INFO(file.is_open(), fmtstr("Cannot open %s", path.c_str()));
+    std::ostringstream ss;
+    ss << file.rdbuf();
+    return ss.str();
+}
+
+bool fileExists(const std::string& path)
+{
+    return std::ifstream(path).good();
+}
+
+// The byte-level BPE of GPT-2 maps each byte to a printable character, so that the vocabulary has no whitespace
+// or control characters: the printable bytes of Latin-1 map to themselves, the other ones to U+0100 and above.
+std::array<uint32_t, 256> getGpt2ByteCharacters()
+{
+    std::array<uint32_t, 256> characters;
+    uint32_t                  n = 0;
+    for (int b = 0; b < 256; b++) {
+        const bool printable = (b >= '!' && b <= '~') || (b >= 0xA1 && b <= 0xAC) || (b >= 0xAE && b <= 0xFF);
+        characters[b]        = printable ? b : 256 + n++;
+    }
+    return characters;
+}
+
+// The classes of the GPT-2 pre-tokenization regex
+//   's|'t|'re|'ve|'m|'ll|'d| ?\p{L}+| ?\p{N}+| ?[^\s\p{L}\p{N}]+|\s+(?!\S)|\s+
+// Exact for ASCII. Above it, the spaces, digits, punctuation and symbols of the common blocks are recognized, and
+// everything else is a letter.
+enum CharClass {
+    CHAR_LETTER,
+    CHAR_NUMBER,
+    CHAR_SPACE,
+    CHAR_OTHER
+};
+
+CharClass getCharClass(uint32_t c)
+{
+    if (c < 0x80) {
+        if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')) {
+            return CHAR_LETTER;
+        }
+        if (c >= '0' && c <= '9') {
+            return CHAR_NUMBER;
+        }
+        return (c == ' ' || (c >= '\t' && c <= '\r')) ? CHAR_SPACE : CHAR_OTHER;
+    }
+    if (c == 0x85 || c == 0xA0 || c == 0x1680 || (c >= 0x2000 && c <= 0x200A) || c == 0x2028 || c == 0x2029
+        || c == 0x202F || c == 0x205F || c == 0x3000) {
+        return CHAR_SPACE;
+    }
+    if (c == 0xB2 || c == 0xB3 || c == 0xB9 || (c >= 0xBC && c <= 0xBE) || (c >= 0x660 && c <= 0x669)
+        || (c >= 0x6F0 && c <= 0x6F9) || (c >= 0x966 && c <= 0x96F) || (c >= 0x2070 && c <= 0x2089)
+        || (c >= 0x2150 && c <= 0x218B) || (c >= 0x2460 && c <= 0x249B) || (c >= 0xFF10 && c <= 0xFF19)) {
+        return CHAR_NUMBER;
+    }
+    if ((c < 0xC0 && c != 0xAA && c != 0xB5 && c != 0xBA) || c == 0xD7 || c == 0xF7 || (c >= 0x300 && c <= 0x36F)
+        || (c >= 0x2010 && c <= 0x2027) || (c >= 0x2030 && c <= 0x205E) || (c >= 0x20A0 && c <= 0x20FF)
+        || (c >= 0x2190 && c <= 0x2BFF) || (c >= 0x3001 && c <= 0x3004) || (c >= 0x3008 && c <= 0x3020)
+        || c == 0x3030 || (c >= 0xFE30 && c <= 0xFE6F) || (c >= 0xFF01 && c <= 0xFF0F)
+        || (c >= 0xFF1A && c <= 0xFF20) || (c >= 0xFF3B && c <= 0xFF40) || (c >= 0xFF5B && c <= 0xFF65)
+        || (c >= 0x1F000 && c <= 0x1FAFF)) {
+        return CHAR_OTHER;
+    }
+    return CHAR_LETTER;
+}
+
+struct CodePoint {
+    uint32_t  value;
+    size_t    begin;  // in bytes
+    CharClass char_class;
+};
+
+// Splits text into the words of the GPT-2 regex, as [begin, end) byte ranges.
+void splitGpt2Words(const char* text, size_t length, std::vector<std::pair<size_t, size_t>>* words)
+{
+    std::vector<CodePoint> chars;
+    for (size_t pos = 0; pos < length;) {
+        size_t         char_length;
+        const uint32_t c = decodeUtf8(text, length, pos, &char_length);
+        chars.push_back({c, pos, getCharClass(c)});
+        pos += char_length;
+    }
+    const size_t n        = chars.size();
+    auto         getBegin = [&](size_t i) { return i < n ? chars[i].begin : length; };
+    auto         isChar   = [&](size_t i, uint32_t c) { return i < n && chars[i].value == c; };
+
+    for (size_t i = 0; i < n;) {
+        size_t end = i;
+        if (chars[i].value == '\'') {
+            if (isChar(i + 1, 's') || isChar(i + 1, 't') || isChar(i + 1, 'm') || isChar(i + 1, 'd')) {
+                end = i + 2;
+            }
+            else if ((isChar(i + 1, 'r') && isChar(i + 2, 'e')) || (isChar(i + 1, 'v') && isChar(i + 2, 'e'))
+                     || (isChar(i + 1, 'l') && isChar(i + 2, 'l'))) {
+                end = i + 3;
+            }
+        }
+        if (end == i) {
+            // An optional space, then a run of letters, of digits, or of other characters.
+            size_t j = chars[i].value == ' ' && i + 1 < n && chars[i + 1].char_class != CHAR_SPACE ? i + 1 : i;
+            const CharClass char_class = chars[j].char_class;
+            if (char_class != CHAR_SPACE) {
+                end = j + 1;
+                while (end < n && chars[end].char_class == char_class) {
+                    end++;
+                }
+            }
+            else {
+                // Whitespace, without the last space when a word follows: it is the optional space of the word.
+                end = i + 1;
+                while (end < n && chars[end].char_class == CHAR_SPACE) {
+                    end++;
+                }
+                if (end < n && end - i > 1) {
+                    end--;
+                }
+            }
+        }
+        words->push_back({getBegin(i), getBegin(end)});
+        i = end;
+    }
+}
+
+// Parses the {"token": id, ...} object of vocab.json.
+class JsonVocabParser {
+public:
+    explicit JsonVocabParser(const std::string& json): json_(json) {}
+
+    void parse(std::unordered_map<std::string, int>* vocab)
+    {
+        expect('{');
+        skipWhitespace();
+        if (peek() == '}') {
+            return;
+        }
+        while (true) {
+            std::string token = parseString();
+            expect(':');
+            skipWhitespace();
+            const size_t begin = pos_;
+            while (pos_ < json_.size() && (isdigit(json_[pos_]) || json_[pos_] == '-')) {
+                pos_++;
+            }
+            FT_CHECK_WITH_INFO(pos_ > begin, fmtstr("vocab.json: expected an id at offset %lu", begin));
+            (*vocab)[token] = std::stoi(json_.substr(begin, pos_ - begin));
+            skipWhitespace();
+            if (peek() == '}') {
+                return;
+            }
+            expect(',');
+        }
+    }
+
+private:
+    char peek() const
+    {
+        return pos_ < json_.size() ? json_[pos_] : '\0';
+    }
+    void skipWhitespace()
+    {
+        while (pos_ < json_.size() && isspace((unsigned char)json_[pos_])) {
+            pos_++;
+        }
+    }
+    void expect(char c)
+    {
+        skipWhitespace();
+        FT_CHECK_WITH_INFO(peek() == c, fmtstr("vocab.json: expected '%c' at offset %lu", c, pos_));
+        pos_++;
+    }
+    uint32_t parseHex4()
+    {
+        FT_CHECK_WITH_INFO(pos_ + 4 <= json_.size(), "vocab.json: truncated \\u escape");
+        const uint32_t value = std::stoul(json_.substr(pos_, 4), nullptr, 16);
+        pos_ += 4;
+        return value;
+    }
+    std::string parseString()
+    {
+        expect('"');
+        std::string value;
+        while (true) {
+            FT_CHECK_WITH_INFO(pos_ < json_.size(), "vocab.json: unterminated string");
+            const char c = json_[pos_++];
+            if (c == '"') {
+                return value;
+            }
+            if (c != '\\') {
+                value.push_back(c);
+                continue;
+            }
+            FT_CHECK_WITH_INFO(pos_ < json_.size(), "vocab.json: unterminated string");
+            const char e = json_[pos_++];
+            switch (e) {
+                case 'b':
+                    value.push_back('\b');
+                    break;
+                case 'f':
+                    value.push_back('\f');
+                    break;
+                case 'n':
+                    value.push_back('\n');
+                    break;
+                case 'r':
+                    value.push_back('\r');
+                    break;
+                case 't':
+                    value.push_back('\t');
+                    break;
+                case 'u': {
+                    uint32_t code_point = parseHex4();
+                    if (code_point >= 0xD800 && code_point < 0xDC00 && json_.compare(pos_, 2, "\\u") == 0) {
+                        pos_ += 2;
+                        code_point = 0x10000 + ((code_point - 0xD800) << 10) + (parseHex4() - 0xDC00);
+                    }
+                    appendUtf8(code_point, &value);
+                    break;
+                }
+                default:
+                    value.push_back(e);  // '"', '\\' and '/'
+            }
+        }
+    }
+
+    const std::string& json_;
+    size_t             pos_ = 0;
+};
+
+// Reads the protobuf wire format, enough for the sentencepiece ModelProto.
+class ProtoReader {
+public:
+    ProtoReader(const char* data, size_t size): data_(data), end_(data + size) {}
+
+    bool done() const
+    {
+        return data_ >= end_;
+    }
+    uint64_t readVarint()
+    {
+        uint64_t value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            FT_CHECK_WITH_INFO(data_ < end_, "Truncated sentencepiece model");
+            const uint8_t b = *data_++;
+            value |= (uint64_t)(b & 0x7F) << shift;
+            if ((b & 0x80) == 0) {
+                break;
+            }
+        }
+        return value;
+    }
+    // Returns the field number, and sets the wire type.
+    int readTag(int* wire_type)
+    {
+        const uint64_t tag = readVarint();
+        *wire_type         = tag & 7;
+        return (int)(tag >> 3);
+    }
+    ProtoReader readMessage()
+    {
+        const size_t size = readVarint();
+        FT_CHECK_WITH_INFO(size <= (size_t)(end_ - data_), "Truncated sentencepiece model");
+        ProtoReader message(data_, size);
+        data_ += size;
+        return message;
+    }
+    std::string readString()
+    {
+        ProtoReader message = readMessage();
+        return std::string(message.data_, message.end_);
+    }
+    float readFloat()
+    {
+        FT_CHECK_WITH_INFO(end_ - data_ >= 4, "Truncated sentencepiece model");
+        float value;
+        std::memcpy(&value, data_, 4);
+        data_ += 4;
+        return value;
+    }
+    void skip(int wire_type)
+    {
+        switch (wire_type) {
+            case 0:
+                readVarint();
+                break;
+            case 1:
+                FT_CHECK_WITH_INFO(end_ - data_ >= 8, "Truncated sentencepiece model");
+                data_ += 8;
+                break;
+            case 2:
+                readMessage();
+                break;
+            case 5:
+                readFloat();
+                break;
+            default:
+                FT_CHECK_WITH_INFO(false, fmtstr("Unsupported protobuf wire type %d", wire_type));
+        }
+    }
+
+private:
+    const char* data_;
+    const char* end_;
+};
+
+// sentencepiece_model.proto
+enum SentencePieceType {
+    PIECE_NORMAL       = 1,
+    PIECE_UNKNOWN      = 2,
+    PIECE_CONTROL      = 3,
+    PIECE_USER_DEFINED = 4,
+    PIECE_UNUSED       = 5,
+    PIECE_BYTE         = 6
+};
+enum SentencePieceModelType {
+    MODEL_UNIGRAM = 1,
+    MODEL_BPE     = 2,
+    MODEL_WORD    = 3,
+    MODEL_CHAR    = 4
+};
+
+bool isEncodablePiece(uint8_t type)
+{
+    return type == PIECE_NORMAL || type == PIECE_USER_DEFINED;
+}
+
+}  // namespace
+
+const size_t Tokenizer::kNumCacheShards;
+const size_t Tokenizer::kMaxWordsPerShard;
+const size_t Tokenizer::kMaxCachedLength;
+
+std::shared_ptr<Tokenizer> Tokenizer::loadGpt2(const std::string& vocab_path, const std::string& merges_path)
+{
+    std::shared_ptr<Tokenizer> tokenizer(new Tokenizer());
+    tokenizer->type_ = TokenizerType::GPT2_BPE;
+    JsonVocabParser(readFile(vocab_path)).parse(&tokenizer->token_ids_);
+    FT_CHECK_WITH_INFO(!tokenizer->token_ids_.empty(), fmtstr("%s has no token", vocab_path.c_str()));
+
+    const std::array<uint32_t, 256> byte_characters = getGpt2ByteCharacters();
+    std::unordered_map<uint32_t, char> character_bytes;
+    for (int b = 0; b < 256; b++) {
+        character_bytes[byte_characters[b]] = (char)b;
+    }
+
+    int max_id = 0;
+    for (const auto& token : tokenizer->token_ids_) {
+        FT_CHECK_WITH_INFO(token.second >= 0, fmtstr("Negative id of token %s", token.first.c_str()));
+        max_id = std::max(max_id, token.second);
+    }
+    tokenizer->token_bytes_.resize(max_id + 1);
+    for (const auto& token : tokenizer->token_ids_) {
+        const std::string& text  = token.first;
+        std::string&       bytes = tokenizer->token_bytes_[token.second];
+        for (size_t pos = 0; pos < text.size();) {
+            size_t         char_length;
+            const uint32_t c  = decodeUtf8(text.data(), text.size(), pos, &char_length);
+            auto           it = character_bytes.find(c);
+            if (it != character_bytes.end()) {
+                bytes.push_back(it->second);
+            }
+            else {
+                bytes.append(text, pos, char_length);
+            }
+            pos += char_length;
+        }
+        if (text.size() > 4 && text.compare(0, 2, "<|") == 0 && text.compare(text.size() - 2, 2, "|>") == 0) {
+            tokenizer->special_tokens_.push_back(text);
+        }
+    }
+    for (int b = 0; b < 256; b++) {
+        std::string character;
+        appendUtf8(byte_characters[b], &character);
+        auto it = tokenizer->token_ids_.find(character);
+        FT_CHECK_WITH_INFO(it != tokenizer->token_ids_.end(), fmtstr("%s has no token for byte %d", vocab_path.c_str(), b));
+        tokenizer->byte_ids_[b] = it->second;
+    }
+
+    std::ifstream merges_file(merges_path, std::ios::in);
+    FT_CHECK_WITH_INFO(merges_file.is_open(), fmtstr("Cannot open %s", merges_path.c_str()));
+    std::string line;
+    int         rank = 0;
+    while (std::getline(merges_file, line)) {
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        if (line.empty() || line.compare(0, 8, "#version") == 0) {
+            continue;
+        }
+        const size_t space = line.find(' ');
+        FT_CHECK_WITH_INFO(space != std::string::npos && space > 0,
+                           fmtstr("%s: invalid merge '%s'", merges_path.c_str(), line.c_str()));
+        const std::string left  = line.substr(0, space);
+        const std::string right = line.substr(space + 1);
+        const int         left_id   = tokenizer->tokenToId(left);
+        const int         right_id  = tokenizer->tokenToId(right);
+        const int         merged_id = tokenizer->tokenToId(left + right);
+        FT_CHECK_WITH_INFO(left_id >= 0 && right_id >= 0 && merged_id >= 0,
+                           fmtstr("%s: merge '%s' of tokens not in the vocabulary", merges_path.c_str(), line.c_str()));
+        tokenizer->addMerge(left_id, right_id, (float)rank++, merged_id);
+    }
+    FT_LOG_DEBUG("Loaded GPT-2 tokenizer with %lu tokens and %d merges", tokenizer->token_bytes_.size(), rank);
+    return tokenizer;
+}
+
+std::shared_ptr<Tokenizer> Tokenizer::loadSentencePiece(const std::string& model_path)
+{
+    std::shared_ptr<Tokenizer> tokenizer(new Tokenizer());
+    const std::string          model      = readFile(model_path);
+    int                        model_type = MODEL_UNIGRAM;
+    bool                       has_normalization_rules = false;
+    // The defaults of NormalizerSpec.
+    tokenizer->add_dummy_prefix_         = true;
+    tokenizer->remove_extra_whitespaces_ = true;
+    tokenizer->escape_whitespaces_       = true;
+
+    std::vector<std::string> pieces;
+    ProtoReader              reader(model.data(), model.size());
+    while (!reader.done()) {
+        int       wire_type;
+        const int field = reader.readTag(&wire_type);
+        if (field == 1 && wire_type == 2) {  // SentencePiece pieces
+            ProtoReader piece_reader = reader.readMessage();
+            std::string piece;
+            float       score = 0.0f;
+            uint8_t     type  = PIECE_NORMAL;
+            while (!piece_reader.done()) {
+                const int piece_field = piece_reader.readTag(&wire_type);
+                if (piece_field == 1 && wire_type == 2) {
+                    piece = piece_reader.readString();
+                }
+                else if (piece_field == 2 && wire_type == 5) {
+                    score = piece_reader.readFloat();
+                }
+                else if (piece_field == 3 && wire_type == 0) {
+                    type = (uint8_t)piece_reader.readVarint();
+                }
+                else {
+                    piece_reader.skip(wire_type);
+                }
+            }
+            pieces.push_back(piece);
+            tokenizer->scores_.push_back(score);
+            tokenizer->piece_types_.push_back(type);
+        }
+        else if (field == 2 && wire_type == 2) {  // TrainerSpec trainer_spec
+            ProtoReader spec_reader = reader.readMessage();
+            while (!spec_reader.done()) {
+                const int spec_field = spec_reader.readTag(&wire_type);
+                if (spec_field == 3 && wire_type == 0) {
+                    model_type = (int)spec_reader.readVarint();
+                }
+                else if (spec_field == 35 && wire_type == 0) {
+                    tokenizer->byte_fallback_ = spec_reader.readVarint() != 0;
+                }
+                else {
+                    spec_reader.skip(wire_type);
+                }
+            }
+        }
+        else if (field == 3 && wire_type == 2) {  // NormalizerSpec normalizer_spec
+            ProtoReader spec_reader = reader.readMessage();
+            while (!spec_reader.done()) {
+                const int spec_field = spec_reader.readTag(&wire_type);
+                if (spec_field == 2 && wire_type == 2) {
+                    has_normalization_rules = !spec_reader.readString().empty();
+                }
+                else if (spec_field == 3 && wire_type == 0) {
+                    tokenizer->add_dummy_prefix_ = spec_reader.readVarint() != 0;
+                }
+                else if (spec_field == 4 && wire_type == 0) {
+                    tokenizer->remove_extra_whitespaces_ = spec_reader.readVarint() != 0;
+                }
+                else if (spec_field == 5 && wire_type == 0) {
+                    tokenizer->escape_whitespaces_ = spec_reader.readVarint() != 0;
+                }
+                else {
+                    spec_reader.skip(wire_type);
+                }
+            }
+        }
+        else {
+            reader.skip(wire_type);
+        }
+    }
+    FT_CHECK_WITH_INFO(!pieces.empty(), fmtstr("%s has no piece", model_path.c_str()));
+    FT_CHECK_WITH_INFO(model_type == MODEL_UNIGRAM || model_type == MODEL_BPE,
+                       fmtstr("%s: only the unigram and BPE sentencepiece models are supported", model_path.c_str()));
+    tokenizer->type_ =
+        model_type == MODEL_BPE ? TokenizerType::SENTENCEPIECE_BPE : TokenizerType::SENTENCEPIECE_UNIGRAM;
+    if (has_normalization_rules) {
+        FT_LOG_WARNING("%s has normalization rules, which are not applied: the text is expected to be normalized.",
+                       model_path.c_str());
+    }
+
+    float min_score = std::numeric_limits<float>::max();
+    int   num_bytes = 0;
+    tokenizer->token_bytes_.resize(pieces.size());
+    tokenizer->byte_fallback_ids_.fill(-1);
+    for (size_t id = 0; id < pieces.size(); id++) {
+        const std::string& piece = pieces[id];
+        const uint8_t      type  = tokenizer->piece_types_[id];
+        std::string&       bytes = tokenizer->token_bytes_[id];
+        tokenizer->token_ids_.insert({piece, (int)id});
+        if (isEncodablePiece(type)) {
+            for (size_t pos = 0; pos < piece.size();) {
+                if (tokenizer->escape_whitespaces_ && piece.compare(pos, 3, kSentencePieceSpace) == 0) {
+                    bytes.push_back(' ');
+                    pos += 3;
+                }
+                else {
+                    bytes.push_back(piece[pos++]);
+                }
+            }
+            tokenizer->max_piece_length_ = std::max(tokenizer->max_piece_length_, piece.size());
+            min_score                    = std::min(min_score, tokenizer->scores_[id]);
+        }
+        else if (type == PIECE_BYTE) {
+            unsigned int b;
+            if (piece.size() == 6 && sscanf(piece.c_str(), "<0x%02X>", &b) == 1) {
+                bytes.push_back((char)b);
+                num_bytes += tokenizer->byte_fallback_ids_[b] < 0;
+                tokenizer->byte_fallback_ids_[b] = (int)id;
+            }
+        }
+        else if (type == PIECE_UNKNOWN) {
+            bytes               = " \xe2\x81\x87 ";  // " ⁇ ", like sentencepiece
+            tokenizer->unk_id_ = (int)id;
+        }
+    }
+    tokenizer->byte_fallback_ = tokenizer->byte_fallback_ && num_bytes == 256;
+    tokenizer->unk_score_     = min_score - 10.0f;
+
+    if (tokenizer->type_ == TokenizerType::SENTENCEPIECE_BPE) {
+        // A piece is the merge of each of its splits in two pieces, with the priority of its score.
+        for (size_t id = 0; id < pieces.size(); id++) {
+            const std::string& piece = pieces[id];
+            if (tokenizer->piece_types_[id] != PIECE_NORMAL) {
+                continue;
+            }
+            for (size_t split = getUtf8Length(piece[0]); split < piece.size(); split += getUtf8Length(piece[split])) {
+                const int left_id  = tokenizer->tokenToId(piece.substr(0, split));
+                const int right_id = tokenizer->tokenToId(piece.substr(split));
+                if (left_id >= 0 && right_id >= 0) {
+                    tokenizer->addMerge(left_id, right_id, -tokenizer->scores_[id], (int)id);
+                }
+            }
+        }
+    }
+    FT_LOG_DEBUG("Loaded sentencepiece %s tokenizer with %lu pieces",
+                 tokenizer->type_ == TokenizerType::SENTENCEPIECE_BPE ? "BPE" : "unigram",
+                 pieces.size());
+    return tokenizer;
+}
+
+std::shared_ptr<Tokenizer> Tokenizer::loadFromDirectory(const std::string& dir)
+{
+    if (fileExists(dir + "/vocab.json") && fileExists(dir + "/merges.txt")) {
+        return loadGpt2(dir + "/vocab.json", dir + "/merges.txt");
+    }
+    for (const char* name : {"tokenizer.model", "spiece.model"}) {
+        if (fileExists(dir + "/" + name)) {
+            return loadSentencePiece(dir + "/" + name);
+        }
+    }
+    return nullptr;
+}
+
+int Tokenizer::tokenToId(const std::string& token) const
+{
+    auto it = token_ids_.find(token);
+    return it == token_ids_.end() ? -1 : it->second;
+}
+
+void Tokenizer::addMerge(int left_id, int right_id, float priority, int merged_id)
+{
+    // With duplicated merges, the first one wins like in the reference implementations.
+    merges_.insert({getPairKey(left_id, right_id), {priority, merged_id}});
+}
+
+void Tokenizer::mergeSymbols(std::vector<Symbol>* symbols) const
+{
+    struct Candidate {
+        float priority;
+        int   left;
+        int   right;
+        int   left_id;
+        int   right_id;
+        int   merged_id;
+
+        // The lowest priority first, then the leftmost.
+        bool operator<(const Candidate& other) const
+        {
+            return priority > other.priority || (priority == other.priority && left > other.left);
+        }
+    };
+    std::vector<Symbol>& s = *symbols;
+    const int            n = (int)s.size();
+    if (n < 2) {
+        return;
+    }
+    std::vector<int>               next(n);
+    std::vector<int>               prev(n);
+    std::vector<bool>              merged(n, false);
+    std::priority_queue<Candidate> candidates;
+    for (int i = 0; i < n; i++) {
+        next[i] = i + 1 < n ? i + 1 : -1;
+        prev[i] = i - 1;
+    }
+    auto addCandidate = [&](int left) {
+        const int right = next[left];
+        if (right < 0 || s[left].id < 0 || s[right].id < 0) {
+            return;
+        }
+        auto it = merges_.find(getPairKey(s[left].id, s[right].id));
+        if (it != merges_.end()) {
+            candidates.push({it->second.priority, left, right, s[left].id, s[right].id, it->second.merged_id});
+        }
+    };
+    for (int i = 0; i + 1 < n; i++) {
+        addCandidate(i);
+    }
+
+    while (!candidates.empty()) {
+        const Candidate c = candidates.top();
+        candidates.pop();
+        // Stale when either symbol was merged since.
+        if (merged[c.left] || merged[c.right] || next[c.left] != c.right || s[c.left].id != c.left_id
+            || s[c.right].id != c.right_id) {
+            continue;
+        }
+        s[c.left].id    = c.merged_id;
+        s[c.left].end   = s[c.right].end;
+        merged[c.right] = true;
+        next[c.left]    = next[c.right];
+        if (next[c.left] >= 0) {
+            prev[next[c.left]] = c.left;
+        }
+        if (prev[c.left] >= 0) {
+            addCandidate(prev[c.left]);
+        }
+        addCandidate(c.left);
+    }
+
+    int num_symbols = 0;
+    for (int i = 0; i < n; i++) {
+        if (!merged[i]) {
+            s[num_symbols++] = s[i];
+        }
+    }
+    s.resize(num_symbols);
+}
+
+std::vector<int> Tokenizer::encode(const std::string& text) const
+{
+    std::vector<int> ids;
+    if (type_ == TokenizerType::GPT2_BPE) {
+        encodeGpt2(text, &ids);
+    }
+    else {
+        encodeSentencePiece(text, &ids);
+    }
+    return ids;
+}
+
+std::vector<std::vector<int>> Tokenizer::encodeBatch(const std::vector<std::string>& texts, int num_threads) const
+{
+    std::vector<std::vector<int>> ids(texts.size());
+    if (num_threads <= 0) {
+        num_threads = std::max(1, (int)std::thread::hardware_concurrency());
+    }
+    num_threads = std::min(num_threads, (int)texts.size());
+    if (num_threads <= 1) {
+        for (size_t i = 0; i < texts.size(); i++) {
+            ids[i] = encode(texts[i]);
+        }
+        return ids;
+    }
+
+    // The texts have different lengths, so the threads take them one at a time.
+    std::atomic<size_t> next_text(0);
+    auto                encodeTexts = [&]() {
+        for (size_t i = next_text++; i < texts.size(); i = next_text++) {
+            ids[i] = encode(texts[i]);
+        }
+    };
+    std::vector<std::thread> threads;
+    for (int t = 1; t < num_threads; t++) {
+        threads.emplace_back(encodeTexts);
+    }
+    encodeTexts();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    return ids;
+}
+
+void Tokenizer::encodeGpt2(const std::string& text, std::vector<int>* ids) const
+{
+    std::vector<std::pair<size_t, size_t>> words;
+    for (size_t pos = 0; pos < text.size();) {
+        // The next special token, which is not split into words.
+        size_t special_pos = std::string::npos;
+        int    special_id  = -1;
+        size_t special_len = 0;
+        for (const std::string& token : special_tokens_) {
+            const size_t found = text.find(token, pos);
+            // The first one, and the longest one at the same position.
+            if (found != std::string::npos
+                && (found < special_pos || (found == special_pos && token.size() > special_len))) {
+                special_pos = found;
+                special_len = token.size();
+                special_id  = tokenToId(token);
+            }
+        }
+        const size_t end = std::min(special_pos, text.size());
+
+        words.clear();
+        splitGpt2Words(text.data() + pos, end - pos, &words);
+        for (const auto& word : words) {
+            encodeGpt2Word(text.data() + pos + word.first, word.second - word.first, ids);
+        }
+        if (special_pos != std::string::npos) {
+            ids->push_back(special_id);
+            pos = special_pos + special_len;
+        }
+        else {
+            pos = end;
+        }
+    }
+}
+
+void Tokenizer::encodeGpt2Word(const char* word, size_t length, std::vector<int>* ids) const
+{
+    const bool  cached = length <= kMaxCachedLength;
+    std::string key;
+    CacheShard* shard = nullptr;
+    if (cached) {
+        key.assign(word, length);
+        shard = &cache_[std::hash<std::string>()(key) % kNumCacheShards];
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        auto                        it = shard->words.find(key);
+        if (it != shard->words.end()) {
+            ids->insert(ids->end(), it->second.begin(), it->second.end());
+            return;
+        }
+    }
+
+    std::vector<Symbol> symbols(length);
+    for (size_t i = 0; i < length; i++) {
+        symbols[i] = {byte_ids_[(unsigned char)word[i]], i, i + 1};
+    }
+    mergeSymbols(&symbols);
+    const size_t begin = ids->size();
+    for (const Symbol& symbol : symbols) {
+        ids->push_back(symbol.id);
+    }
+
+    if (cached) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        if (shard->words.size() >= kMaxWordsPerShard) {
+            shard->words.clear();
+        }
+        shard->words.emplace(std::move(key), std::vector<int>(ids->begin() + begin, ids->end()));
+    }
+}
+
+std::string Tokenizer::normalizeSentencePiece(const std::string& text) const
+{
+    std::string normalized;
+    if (remove_extra_whitespaces_) {
+        for (char c : text) {
+            if (c != ' ' || (!normalized.empty() && normalized.back() != ' ')) {
+                normalized.push_back(c);
+            }
+        }
+        if (!normalized.empty() && normalized.back() == ' ') {
+            normalized.pop_back();
+        }
+    }
+    else {
+        normalized = text;
+    }
+    if (add_dummy_prefix_ && !normalized.empty()) {
+        normalized.insert(normalized.begin(), ' ');
+    }
+    if (!escape_whitespaces_) {
+        return normalized;
+    }
+    std::string escaped;
+    escaped.reserve(normalized.size() + normalized.size() / 4);
+    for (char c : normalized) {
+        if (c == ' ') {
+            escaped.append(kSentencePieceSpace);
+        }
+        else {
+            escaped.push_back(c);
+        }
+    }
+    return escaped;
+}
+
+void Tokenizer::encodeSentencePiece(const std::string& text, std::vector<int>* ids) const
+{
+    const std::string   normalized = normalizeSentencePiece(text);
+    std::vector<Symbol> symbols;
+    if (type_ == TokenizerType::SENTENCEPIECE_BPE) {
+        std::string character;
+        for (size_t pos = 0; pos < normalized.size();) {
+            const size_t char_length = std::min(getUtf8Length(normalized[pos]), normalized.size() - pos);
+            character.assign(normalized, pos, char_length);
+            auto it = token_ids_.find(character);
+            const int id = it != token_ids_.end() && isEncodablePiece(piece_types_[it->second]) ? it->second : -1;
+            symbols.push_back({id, pos, pos + char_length});
+            pos += char_length;
+        }
+        mergeSymbols(&symbols);
+    }
+    else {
+        encodeUnigram(normalized, &symbols);
+    }
+    for (const Symbol& symbol : symbols) {
+        if (symbol.id >= 0) {
+            ids->push_back(symbol.id);
+        }
+        else {
+            appendUnknown(normalized, symbol, ids);
+        }
+    }
+}
+
+void Tokenizer::encodeUnigram(const std::string& text, std::vector<Symbol>* symbols) const
+{
+    // Viterbi: the segmentation of the text in pieces with the best total score. The characters which are not the
+    // start of any piece are unknown, with a penalty.
+    const size_t        n = text.size();
+    std::vector<double> best_score(n + 1, -std::numeric_limits<double>::infinity());
+    std::vector<size_t> best_begin(n + 1, 0);
+    std::vector<int>    best_id(n + 1, -1);
+    best_score[0] = 0.0;
+    std::string piece;
+    for (size_t begin = 0; begin < n;) {
+        const size_t char_length = std::min(getUtf8Length(text[begin]), n - begin);
+        if (best_score[begin] == -std::numeric_limits<double>::infinity()) {
+            begin += char_length;
+            continue;
+        }
+        bool has_character = false;
+        for (size_t end = begin + char_length; end <= std::min(n, begin + max_piece_length_);
+             end += std::min(getUtf8Length(text[end]), n - end)) {
+            piece.assign(text, begin, end - begin);
+            auto it = token_ids_.find(piece);
+            if (it != token_ids_.end() && isEncodablePiece(piece_types_[it->second])) {
+                const double score = best_score[begin] + scores_[it->second];
+                if (score > best_score[end]) {
+                    best_score[end] = score;
+                    best_begin[end] = begin;
+                    best_id[end]    = it->second;
+                }
+                has_character |= end == begin + char_length;
+            }
+            if (end == n) {
+                break;
+            }
+        }
+        const size_t end = begin + char_length;
+        if (!has_character && best_score[begin] + unk_score_ > best_score[end]) {
+            best_score[end] = best_score[begin] + unk_score_;
+            best_begin[end] = begin;
+            best_id[end]    = -1;
+        }
+        begin = end;
+    }
+
+    symbols->clear();
+    for (size_t end = n; end > 0; end = best_begin[end]) {
+        // Consecutive unknown characters are one unknown piece, like sentencepiece.
+        if (best_id[end] < 0 && !symbols->empty() && symbols->back().id < 0) {
+            symbols->back().begin = best_begin[end];
+        }
+        else {
+            symbols->push_back({best_id[end], best_begin[end], end});
+        }
+    }
+    std::reverse(symbols->begin(), symbols->end());
+}
+
+void Tokenizer::appendUnknown(const std::string& text, const Symbol& symbol, std::vector<int>* ids) const
+{
+    if (byte_fallback_) {
+        for (size_t i = symbol.begin; i < symbol.end; i++) {
+            ids->push_back(byte_fallback_ids_[(unsigned char)text[i]]);
+        }
+    }
+    else if (unk_id_ >= 0) {
+        ids->push_back(unk_id_);
+    }
+}
+
+std::string Tokenizer::decode(const int* ids, size_t num_ids) const
+{
+    std::string text;
+    for (size_t i = 0; i < num_ids; i++) {
+        text.append(getTokenBytes(ids[i]));
+    }
+    if (add_dummy_prefix_ && !text.empty() && text[0] == ' ') {
+        text.erase(0, 1);
+    }
+    return text;
+}
+
+std::string IncrementalDetokenizer::push(int id)
+{
+    return push(&id, 1);
+}
+
+std::string IncrementalDetokenizer::push(const int* ids, size_t num_ids)
+{
+    for (size_t i = 0; i < num_ids; i++) {
+        const std::string& bytes = tokenizer_.getTokenBytes(ids[i]);
+        if (at_start_ && !bytes.empty()) {
+            at_start_ = false;
+            if (tokenizer_.hasDummyPrefix() && !is_continuation_ && bytes[0] == ' ') {
+                pending_.append(bytes, 1, std::string::npos);
+                continue;
+            }
+        }
+        pending_.append(bytes);
+    }
+
+    // Keeps the last character if it is incomplete, i.e. its first byte announces more bytes than there are.
+    size_t complete = pending_.size();
+    for (size_t k = 1; k <= std::min<size_t>(3, pending_.size()); k++) {
+        const unsigned char c = pending_[pending_.size() - k];
+        if ((c & 0xC0) == 0x80) {
+            continue;
+        }
+        if (getUtf8Length(c) > k) {
+            complete = pending_.size() - k;
+        }
+        break;
+    }
+    std::string text = pending_.substr(0, complete);
+    pending_.erase(0, complete);
+    return text;
+}
+
+std::string IncrementalDetokenizer::finish()
+{
+    std::string text;
+    text.swap(pending_);
+    at_start_ = true;
+    return text;
+}
+
+}  // namespace fastertransformer
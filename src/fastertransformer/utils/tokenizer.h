@@ -0,0 +1,178 @@
+/*
+ * Copyright (c) 2023, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Text tokenizer and detokenizer, so that the examples and the triton backend can take text in and give text out
+ * without a python pre/post-processing step.
+ *
+ * Two families of vocabularies are supported:
+ *   - GPT-2 byte-level BPE (GPT-2, GPT-J, GPT-NeoX, OPT, ...), loaded from vocab.json and merges.txt. The text is
+ *     split into words like the GPT-2 regex does, and each word is merged from its bytes. The words are cached.
+ *   - SentencePiece models (tokenizer.model, spiece.model), BPE (LLaMA, ...) or unigram (T5, ...). The model proto is
+ *     parsed directly, without the sentencepiece library. The whitespace options of the normalizer are applied, the
+ *     precompiled normalization rules (NFKC) are not.
+ *
+ * BPE merges are looked up in one hash table keyed by the pair of token ids, whose value is the merged token and its
+ * priority (the rank of the merge for GPT-2, the score of the piece for SentencePiece). The symbols of a word are
+ * merged in priority order with a heap, in O(n log n).
+ *
+ * Tokenizer is immutable after loading, apart from its word cache which is thread-safe, so one instance can be
+ * shared by all the model instances and encodeBatch can encode on several threads.
+ **/
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace fastertransformer {
+
+enum class TokenizerType {
+    GPT2_BPE,
+    SENTENCEPIECE_BPE,
+    SENTENCEPIECE_UNIGRAM
+};
+
+class Tokenizer {
+public:
+    static std::shared_ptr<Tokenizer> loadGpt2(const std::string& vocab_path, const std::string& merges_path);
+    static std::shared_ptr<Tokenizer> loadSentencePiece(const std::string& model_path);
+    // Loads vocab.json and merges.txt, or else tokenizer.model or spiece.model, from dir. Returns nullptr when dir
+    // has none of them.
+    static std::shared_ptr<Tokenizer> loadFromDirectory(const std::string& dir);
+
+    std::vector<int> encode(const std::string& text) const;
+    // Encodes the texts on num_threads threads, one per core when 0.
+    std::vector<std::vector<int>> encodeBatch(const std::vector<std::string>& texts, int num_threads = 0) const;
+
+    // Control tokens (<s>, </s>, ...) of SentencePiece decode to nothing, ids out of the vocabulary as well.
+    std::string decode(const int* ids, size_t num_ids) const;
+    std::string decode(const std::vector<int>& ids) const
+    {
+        return decode(ids.data(), ids.size());
+    }
+
+    // The bytes the token decodes to.
+    const std::string& getTokenBytes(int id) const
+    {
+        return id >= 0 && id < (int)token_bytes_.size() ? token_bytes_[id] : empty_;
+    }
+    // The id of a token as written in the vocabulary, e.g. "Ġthe" or "▁the", or -1.
+    int tokenToId(const std::string& token) const;
+
+    TokenizerType getType() const
+    {
+        return type_;
+    }
+    size_t getVocabSize() const
+    {
+        return token_bytes_.size();
+    }
+    // SentencePiece prefixes the text with a space, which the decoding removes at the start of a sequence.
+    bool hasDummyPrefix() const
+    {
+        return add_dummy_prefix_;
+    }
+
+private:
+    struct MergeRule {
+        float priority;  // the lowest is merged first
+        int   merged_id;
+    };
+    struct Symbol {
+        int    id;     // -1 for text which has no token
+        size_t begin;  // bytes of the symbol in the text
+        size_t end;
+    };
+    struct CacheShard {
+        std::mutex                                        mutex;
+        std::unordered_map<std::string, std::vector<int>> words;
+    };
+    static const size_t kNumCacheShards   = 16;
+    static const size_t kMaxWordsPerShard = 4096;
+    static const size_t kMaxCachedLength  = 64;  // bytes, longer words are not cached
+
+    Tokenizer() = default;
+
+    static uint64_t getPairKey(int left_id, int right_id)
+    {
+        return ((uint64_t)(uint32_t)left_id << 32) | (uint32_t)right_id;
+    }
+    void addMerge(int left_id, int right_id, float priority, int merged_id);
+    // Merges symbols in place.
+    void mergeSymbols(std::vector<Symbol>* symbols) const;
+
+    void encodeGpt2(const std::string& text, std::vector<int>* ids) const;
+    void encodeGpt2Word(const char* word, size_t length, std::vector<int>* ids) const;
+    void encodeSentencePiece(const std::string& text, std::vector<int>* ids) const;
+    void encodeUnigram(const std::string& text, std::vector<Symbol>* symbols) const;
+    void appendUnknown(const std::string& text, const Symbol& symbol, std::vector<int>* ids) const;
+    std::string normalizeSentencePiece(const std::string& text) const;
+
+    TokenizerType                           type_ = TokenizerType::GPT2_BPE;
+    std::unordered_map<std::string, int>    token_ids_;    // the tokens as written in the vocabulary
+    std::vector<std::string>                token_bytes_;  // by id
+    std::unordered_map<uint64_t, MergeRule> merges_;
+    const std::string                       empty_;
+
+    // GPT-2
+    std::array<int, 256>     byte_ids_;        // the token of each byte
+    std::vector<std::string> special_tokens_;  // "<|endoftext|>" ..., matched in the text before the words
+
+    // SentencePiece
+    std::vector<float>   scores_;
+    std::vector<uint8_t> piece_types_;        // SentencePiece::Type of the proto
+    std::array<int, 256> byte_fallback_ids_;  // "<0x00>" ... "<0xFF>"
+    int                  unk_id_                   = -1;
+    bool                 byte_fallback_            = false;
+    bool                 add_dummy_prefix_         = false;
+    bool                 remove_extra_whitespaces_ = false;
+    bool                 escape_whitespaces_       = false;
+    size_t               max_piece_length_         = 0;  // bytes
+    float                unk_score_                = 0.0f;
+
+    mutable std::array<CacheShard, kNumCacheShards> cache_;
+};
+
+// Decodes a stream of tokens, e.g. the tokens generated at each step, into text. Tokens may end in the middle of a
+// UTF-8 character, so push only returns the text up to the last complete character and keeps the rest.
+class IncrementalDetokenizer {
+public:
+    // A continuation, e.g. of a prompt, keeps the space of the first token, which is otherwise the dummy prefix.
+    explicit IncrementalDetokenizer(const Tokenizer& tokenizer, bool is_continuation = false):
+        tokenizer_(tokenizer), is_continuation_(is_continuation)
+    {
+    }
+
+    // Returns the text completed by the token, often empty.
+    std::string push(int id);
+    std::string push(const int* ids, size_t num_ids);
+    // Returns what is left, incomplete characters included, and starts a new sequence.
+    std::string finish();
+
+private:
+    const Tokenizer& tokenizer_;
+    const bool       is_continuation_;
+    std::string      pending_;
+    bool             at_start_ = true;
+};
+
+}  // namespace fastertransformer
@@ -0,0 +1,45 @@
+/*
+ * Copyright (c) 2023, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/fastertransformer/utils/weight_loader.h"
+#include "src/fastertransformer/utils/cuda_utils.h"
+#include "src/fastertransformer/utils/memory_utils.h"
+
+#include <algorithm>
+
+namespace fastertransformer {
+
+int getWeightLoaderThreadCount()
+{
+    char* num_threads_env = std::getenv("FT_LOAD_WEIGHT_THREADS");
+    if (num_threads_env != nullptr) {
+        return std::max(1, atoi(num_threads_env));
+    }
+    return std::max(1, std::min((int)std::thread::hardware_concurrency(), 8));
+}
+
+WeightLoaderPool::WeightLoaderPool(int num_threads, size_t max_queue_size): HostThreadPool(num_threads, max_queue_size)
+{
+    beginWeightStaging();
+}
+
+WeightLoaderPool::~WeightLoaderPool()
+{
+    // A buffer still used by a task is freed when the task gives it back.
+    endWeightStaging();
+}
+
+}  // namespace fastertransformer
@@ -0,0 +1,37 @@
+/*
+ * Copyright (c) 2023, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+
+#include "src/fastertransformer/utils/host_thread_pool.h"
+
+namespace fastertransformer {
+
+// Returns the number of loader threads: FT_LOAD_WEIGHT_THREADS if it is set, otherwise the number of hardware
+// threads capped to 8, which is enough to saturate PCIe with the host-side read and convert work.
+int getWeightLoaderThreadCount();
+
+// Thread pool used by the *Weight::loadModel functions to load several layers concurrently. Layers are independent,
+// so their host-side read and conversion work is spread over the loader threads. The pinned staging buffers of the
+// weight conversions are kept while a pool exists, see beginWeightStaging.
+class WeightLoaderPool: public HostThreadPool {
+public:
+    explicit WeightLoaderPool(int num_threads = getWeightLoaderThreadCount(), size_t max_queue_size = 0);
+    ~WeightLoaderPool();
+};
+
+}  // namespace fastertransformer
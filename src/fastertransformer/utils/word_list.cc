@@ -15,9 +15,13 @@
  */
 
 #include "word_list.h"
+#include "cuda_utils.h"
 #include "memory_utils.h"
 
 #include "assert.h"
+#include <algorithm>
+#include <iterator>
+#include <unordered_map>
 
 namespace fastertransformer {
 
@@ -47,4 +51,130 @@ int read_word_list(const std::string& filename, std::vector<int>& file_data)
     return 0;
 }
 
+const int WordListMatcher::kStartState;
+
+WordListMatcher::WordListMatcher():
+    edge_begin_(2, 0), fail_(1, kStartState), is_match_(1, false), next_word_end_begin_(2, 0)
+{
+}
+
+WordListMatcher::WordListMatcher(const int* words, size_t words_len)
+{
+    const int* offsets = words + words_len;
+
+    // The trie, with a hash table of the edges while it is built.
+    std::unordered_map<uint64_t, int> edges;
+    std::vector<std::vector<int>>     children(1);  // tokens of the edges of each state
+    std::vector<bool>                 is_word_end(1, false);
+    for (size_t id = 0; id < words_len && offsets[id] >= 0; id++) {
+        const int item_start = id > 0 ? offsets[id - 1] : 0;
+        const int item_end   = offsets[id];
+        FT_CHECK_WITH_INFO(item_start <= item_end && (size_t)item_end <= words_len,
+                           fmtstr("Invalid word list: word %lu spans [%d, %d) of %lu tokens.",
+                                  id,
+                                  item_start,
+                                  item_end,
+                                  words_len));
+        if (item_start == item_end) {
+            continue;
+        }
+        if (item_end - item_start == 1) {
+            single_token_words_.push_back(words[item_start]);
+        }
+        int state = kStartState;
+        for (int i = item_start; i < item_end; i++) {
+            const uint64_t key  = ((uint64_t)(uint32_t)state << 32) | (uint32_t)words[i];
+            auto           edge = edges.find(key);
+            if (edge == edges.end()) {
+                edge = edges.emplace(key, (int)children.size()).first;
+                children[state].push_back(words[i]);
+                children.emplace_back();
+                is_word_end.push_back(false);
+            }
+            state = edge->second;
+        }
+        is_word_end[state] = true;
+        max_word_length_   = std::max(max_word_length_, (size_t)(item_end - item_start));
+    }
+    std::sort(single_token_words_.begin(), single_token_words_.end());
+    single_token_words_.erase(std::unique(single_token_words_.begin(), single_token_words_.end()),
+                              single_token_words_.end());
+
+    const size_t num_states = children.size();
+    edge_begin_.assign(1, 0);
+    for (size_t state = 0; state < num_states; state++) {
+        std::vector<int>& tokens = children[state];
+        std::sort(tokens.begin(), tokens.end());
+        for (int token : tokens) {
+            edge_tokens_.push_back(token);
+            edge_targets_.push_back(edges.at(((uint64_t)(uint32_t)state << 32) | (uint32_t)token));
+        }
+        edge_begin_.push_back(edge_tokens_.size());
+    }
+
+    // Failure links in breadth-first order, so that the failure link of a state, which is shallower, is done first.
+    fail_.assign(num_states, kStartState);
+    is_match_.assign(num_states, false);
+    std::vector<std::vector<int>> next_word_ends(num_states);
+    std::vector<int>              queue(1, kStartState);
+    for (size_t head = 0; head < queue.size(); head++) {
+        const int state = queue[head];
+        if (state != kStartState) {
+            is_match_[state] = is_word_end[state] || is_match_[fail_[state]];
+            // The words of one token are left out, they end a word after every state.
+            std::vector<int>& ends = next_word_ends[state];
+            for (uint32_t e = edge_begin_[state]; e < edge_begin_[state + 1]; e++) {
+                if (is_word_end[edge_targets_[e]]) {
+                    ends.push_back(edge_tokens_[e]);
+                }
+            }
+            const std::vector<int>& fail_ends = next_word_ends[fail_[state]];
+            std::vector<int>        merged;
+            std::set_union(ends.begin(), ends.end(), fail_ends.begin(), fail_ends.end(), std::back_inserter(merged));
+            ends.swap(merged);
+        }
+        for (uint32_t e = edge_begin_[state]; e < edge_begin_[state + 1]; e++) {
+            const int child = edge_targets_[e];
+            if (state != kStartState) {
+                int fail = fail_[state];
+                int next = findEdge(fail, edge_tokens_[e]);
+                while (next < 0 && fail != kStartState) {
+                    fail = fail_[fail];
+                    next = findEdge(fail, edge_tokens_[e]);
+                }
+                fail_[child] = next >= 0 ? next : kStartState;
+            }
+            queue.push_back(child);
+        }
+    }
+
+    next_word_end_begin_.assign(1, 0);
+    for (size_t state = 0; state < num_states; state++) {
+        next_word_ends_.insert(next_word_ends_.end(), next_word_ends[state].begin(), next_word_ends[state].end());
+        next_word_end_begin_.push_back(next_word_ends_.size());
+    }
+}
+
+int WordListMatcher::findEdge(int state, int token) const
+{
+    const int* begin = edge_tokens_.data() + edge_begin_[state];
+    const int* end   = edge_tokens_.data() + edge_begin_[state + 1];
+    const int* edge  = std::lower_bound(begin, end, token);
+    return edge != end && *edge == token ? edge_targets_[edge - edge_tokens_.data()] : -1;
+}
+
+int WordListMatcher::advance(int state, int token) const
+{
+    while (true) {
+        const int next = findEdge(state, token);
+        if (next >= 0) {
+            return next;
+        }
+        if (state == kStartState) {
+            return kStartState;
+        }
+        state = fail_[state];
+    }
+}
+
 }  // namespace fastertransformer
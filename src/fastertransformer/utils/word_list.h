@@ -19,8 +19,88 @@
 #include "Tensor.h"
 #include "stdlib.h"
 
+#include <cstddef>
+#include <vector>
+
 namespace fastertransformer {
 
 int read_word_list(const std::string& filename, std::vector<int>& tensor_data);
 
-}
+/**
+ * Aho-Corasick automaton of a stop or bad word list, so that the words ending at a token are found with one
+ * transition per generated token instead of comparing every word with the end of the sequence.
+ *
+ * The list is in the layout of read_word_list and of the stop_words_list/bad_words_list tensors: [2, words_len], the
+ * tokens of all the words, then the end offset of each word in the tokens, padded with -1.
+ *
+ * The state of a sequence is the longest end of its tokens that is the beginning of a word. The transitions are
+ * stored compactly: the edges of the trie sorted by token for each state, and the failure link of each state, which
+ * the transition follows when the token has no edge (amortized O(1) per token). What a state matches is precomputed
+ * along its failure links.
+ **/
+class WordListMatcher {
+public:
+    static const int kStartState = 0;
+
+    // Matches no word.
+    WordListMatcher();
+    WordListMatcher(const int* words, size_t words_len);
+
+    int advance(int state, int token) const;
+    int advance(int state, const int* tokens, size_t num_tokens) const
+    {
+        for (size_t i = 0; i < num_tokens; i++) {
+            state = advance(state, tokens[i]);
+        }
+        return state;
+    }
+
+    // Whether a word ends with the last token fed to the state, as a stop word.
+    bool isMatch(int state) const
+    {
+        return is_match_[state];
+    }
+    // The tokens that would end a word of two tokens or more if they came next, as the banned bad words. Sorted.
+    const int* getNextWordEnds(int state, size_t* num_tokens) const
+    {
+        *num_tokens = next_word_end_begin_[state + 1] - next_word_end_begin_[state];
+        return next_word_ends_.data() + next_word_end_begin_[state];
+    }
+    // The words of one token, which end a word after any state.
+    const std::vector<int>& getSingleTokenWords() const
+    {
+        return single_token_words_;
+    }
+
+    // The longest word. The state only depends on the last getMaxWordLength() tokens, so that feeding them from
+    // kStartState gives the same state as feeding the whole sequence.
+    size_t getMaxWordLength() const
+    {
+        return max_word_length_;
+    }
+    size_t getNumStates() const
+    {
+        return fail_.size();
+    }
+    bool empty() const
+    {
+        return max_word_length_ == 0;
+    }
+
+private:
+    int findEdge(int state, int token) const;
+
+    // trie edges of state s: edge_tokens_/edge_targets_[edge_begin_[s], edge_begin_[s + 1]), sorted by token
+    std::vector<uint32_t> edge_begin_;
+    std::vector<int>      edge_tokens_;
+    std::vector<int>      edge_targets_;
+    std::vector<int>      fail_;
+    std::vector<bool>     is_match_;
+
+    std::vector<uint32_t> next_word_end_begin_;
+    std::vector<int>      next_word_ends_;
+    std::vector<int>      single_token_words_;
+    size_t                max_word_length_ = 0;
+};
+
+}  // namespace fastertransformer
@@ -0,0 +1,115 @@
+/*
+ * Copyright (c) 2023, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/fastertransformer/utils/workspace_planner.h"
+#include "src/fastertransformer/utils/cuda_utils.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <numeric>
+
+namespace fastertransformer {
+
+int WorkspacePlan::find(const std::string& name) const
+{
+    for (size_t i = 0; i < buffers.size(); i++) {
+        if (buffers[i].name == name) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+int WorkspacePlan::findOrThrow(const std::string& name) const
+{
+    int buffer_id = find(name);
+    FT_CHECK_WITH_INFO(buffer_id >= 0, fmtstr("unknown workspace buffer %s", name.c_str()));
+    return buffer_id;
+}
+
+WorkspacePlanner::WorkspacePlanner(size_t alignment): alignment_(alignment)
+{
+    FT_CHECK_WITH_INFO(alignment > 0 && (alignment & (alignment - 1)) == 0, "alignment must be a power of two");
+}
+
+int WorkspacePlanner::addBuffer(const std::string& name, size_t size, int first_use, int last_use)
+{
+    FT_CHECK_WITH_INFO(first_use <= last_use,
+                       fmtstr("buffer %s is used from step %d to step %d", name.c_str(), first_use, last_use));
+    const size_t aligned_size = (size + alignment_ - 1) & ~(alignment_ - 1);
+    buffers_.push_back({name, aligned_size, first_use, last_use});
+    return (int)buffers_.size() - 1;
+}
+
+WorkspacePlan WorkspacePlanner::plan() const
+{
+    WorkspacePlan plan;
+    plan.buffers = buffers_;
+    plan.offsets.assign(buffers_.size(), 0);
+
+    // Largest first, and earliest first among equal sizes so the plan does not depend on the declaration order.
+    std::vector<int> order(buffers_.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [this](int a, int b) {
+        if (buffers_[a].size != buffers_[b].size) {
+            return buffers_[a].size > buffers_[b].size;
+        }
+        return buffers_[a].first_use < buffers_[b].first_use;
+    });
+
+    std::vector<int>                       placed;
+    std::vector<std::pair<size_t, size_t>> conflicts;  // [offset, end) of the placed buffers live at the same time
+    for (int id : order) {
+        const WorkspaceBuffer& buffer = buffers_[id];
+        conflicts.clear();
+        for (int other : placed) {
+            if (buffer.overlaps(buffers_[other])) {
+                conflicts.push_back({plan.offsets[other], plan.offsets[other] + buffers_[other].size});
+            }
+        }
+        std::sort(conflicts.begin(), conflicts.end());
+
+        // Best fit: the smallest gap between the conflicting buffers which can hold this one, else the end.
+        size_t offset   = 0;
+        size_t best     = 0;
+        size_t best_gap = SIZE_MAX;
+        for (const auto& range : conflicts) {
+            if (range.first >= offset && range.first - offset >= buffer.size && range.first - offset < best_gap) {
+                best     = offset;
+                best_gap = range.first - offset;
+            }
+            offset = std::max(offset, range.second);
+        }
+        plan.offsets[id] = best_gap == SIZE_MAX ? offset : best;
+        plan.arena_size  = std::max(plan.arena_size, plan.offsets[id] + buffer.size);
+        placed.push_back(id);
+    }
+
+    // The live set only changes when a buffer starts to be used.
+    for (const WorkspaceBuffer& buffer : buffers_) {
+        size_t live_size = 0;
+        for (const WorkspaceBuffer& other : buffers_) {
+            if (other.first_use <= buffer.first_use && buffer.first_use <= other.last_use) {
+                live_size += other.size;
+            }
+        }
+        plan.max_live_size = std::max(plan.max_live_size, live_size);
+        plan.total_size += buffer.size;
+    }
+    return plan;
+}
+
+}  // namespace fastertransformer
@@ -0,0 +1,102 @@
+/*
+ * Copyright (c) 2023, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Static planning of the layer scratch buffers in one shared arena.
+ *
+ * Each layer allocates its own buffers in allocateBuffer and keeps them until freeBuffer, so the scratch memory of
+ * a model is the sum of the buffers of all its layers. Most of them are only live while their layer runs.
+ *
+ * With the planner, the layers declare their buffers for a given shape, with a lifetime [first_use, last_use]
+ * in steps of the forward pass (typically the index of the layer which produces the buffer and of the last layer
+ * which reads it). Two buffers whose lifetimes overlap must not overlap in memory; the others can share it. The
+ * buffers form an interval graph, and plan() colours it with offsets: buffers are placed from the largest to the
+ * smallest, each one at the lowest offset which does not collide with an already placed buffer whose lifetime
+ * overlaps. The arena size is the peak of the plan, and is bounded below by the largest live set.
+ *
+ * ParallelGptContextDecoder plans its scratch buffers in allocateBuffer, for the shape of each forward pass.
+ **/
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace fastertransformer {
+
+struct WorkspaceBuffer {
+    std::string name;
+    size_t      size;
+    int         first_use;  // both ends are inclusive
+    int         last_use;
+
+    bool overlaps(const WorkspaceBuffer& other) const
+    {
+        return first_use <= other.last_use && other.first_use <= last_use;
+    }
+};
+
+struct WorkspacePlan {
+    std::vector<WorkspaceBuffer> buffers;
+    std::vector<size_t>          offsets;  // in the arena, in the order of buffers
+    size_t                       arena_size    = 0;  // peak memory of the plan
+    size_t                       max_live_size = 0;  // largest live set, a lower bound of arena_size
+    size_t                       total_size    = 0;  // memory taken by private buffers
+
+    // Returns the index of the buffer, or -1.
+    int find(const std::string& name) const;
+
+    template<typename T>
+    T* getBuffer(void* arena, int buffer_id) const
+    {
+        return reinterpret_cast<T*>(static_cast<char*>(arena) + offsets[buffer_id]);
+    }
+    template<typename T>
+    T* getBuffer(void* arena, const std::string& name) const
+    {
+        return getBuffer<T>(arena, findOrThrow(name));
+    }
+
+private:
+    int findOrThrow(const std::string& name) const;
+};
+
+class WorkspacePlanner {
+public:
+    // Buffer sizes are rounded up to alignment, so every offset is aligned as well.
+    explicit WorkspacePlanner(size_t alignment = 256);
+
+    // Returns the id of the buffer, i.e. its index in the plan.
+    int  addBuffer(const std::string& name, size_t size, int first_use, int last_use);
+    void clear()
+    {
+        buffers_.clear();
+    }
+
+    const std::vector<WorkspaceBuffer>& getBuffers() const
+    {
+        return buffers_;
+    }
+
+    WorkspacePlan plan() const;
+
+private:
+    const size_t                 alignment_;
+    std::vector<WorkspaceBuffer> buffers_;
+};
+
+}  // namespace fastertransformer
@@ -0,0 +1,57 @@
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "src/fastertransformer/utils/host_convert_utils.h"
+#include "src/fastertransformer/utils/logger.h"
+
+using namespace fastertransformer;
+
+// Measures the host conversion throughput of each instruction set available on this machine.
+// Usage: ./bin/bench_host_convert [num_elements] [num_iterations]
+
+template<typename T_OUT, typename T_IN>
+void benchmark(const std::string& name, const std::vector<T_IN>& src, int num_iterations)
+{
+    std::vector<T_OUT> dst(src.size());
+    for (HostConvertIsa isa : {HostConvertIsa::SCALAR, HostConvertIsa::AVX2, HostConvertIsa::AVX512}) {
+        if ((int)isa > (int)getHostConvertIsa()) {
+            continue;
+        }
+        hostCast(dst.data(), src.data(), src.size(), isa);  // warmup
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < num_iterations; i++) {
+            hostCast(dst.data(), src.data(), src.size(), isa);
+        }
+        auto   end     = std::chrono::steady_clock::now();
+        double time_ms = std::chrono::duration<double, std::milli>(end - start).count() / num_iterations;
+        double gbps    = src.size() * (sizeof(T_IN) + sizeof(T_OUT)) / (time_ms * 1e6);
+        FT_LOG_INFO("%-16s %-7s %9.3f ms  %7.2f GB/s", name.c_str(), getHostConvertIsaName(isa), time_ms, gbps);
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    const size_t num_elements   = argc > 1 ? (size_t)atoll(argv[1]) : (size_t)(64 << 20);
+    const int    num_iterations = argc > 2 ? atoi(argv[2]) : 5;
+
+    std::vector<float>                    src_float(num_elements);
+    std::mt19937                          gen(0);
+    std::uniform_real_distribution<float> dist(-4.0f, 4.0f);
+    for (auto& v : src_float) {
+        v = dist(gen);
+    }
+    std::vector<half> src_half(num_elements);
+    hostCast(src_half.data(), src_float.data(), num_elements);
+
+    FT_LOG_INFO("num_elements: %ld, num_iterations: %d", num_elements, num_iterations);
+    benchmark<half, float>("float -> half", src_float, num_iterations);
+    benchmark<float, half>("half -> float", src_half, num_iterations);
+    benchmark<int8_t, float>("float -> int8", src_float, num_iterations);
+#ifdef ENABLE_BF16
+    benchmark<__nv_bfloat16, float>("float -> bf16", src_float, num_iterations);
+    benchmark<__nv_bfloat16, half>("half -> bf16", src_half, num_iterations);
+#endif
+    return 0;
+}
@@ -0,0 +1,83 @@
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+#include <string>
+
+#include "src/fastertransformer/utils/async_logger.h"
+#include "src/fastertransformer/utils/logger.h"
+
+using namespace fastertransformer;
+
+// Measures the CPU time FT_LOG_DEBUG takes on the calling thread, with the synchronous logger and with the asynchronous
+// one writing text or binary records. The logs go to /dev/null, the results to stderr.
+// Usage: ./bin/bench_logger [num_iterations]
+
+namespace {
+
+template<typename T>
+struct Layer {
+    void forward(int step, size_t batch_size, float ms)
+    {
+        FT_LOG_DEBUG(__PRETTY_FUNCTION__);
+        FT_LOG_DEBUG("step %d, batch_size %lu, %.3f ms, %s", step, batch_size, ms, "decoding");
+    }
+};
+
+double getThreadCpuTimeNs()
+{
+    timespec time;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+    return time.tv_sec * 1e9 + time.tv_nsec;
+}
+
+// Logs in bursts that fit in the queue, and lets the background thread catch up between them.
+void benchmark(const char* name, int num_iterations)
+{
+    const int    kBurstSize = 512;
+    Layer<float> layer;
+    layer.forward(0, 8, 0.0f);  // allocates the queue of the thread
+    AsyncLogger::flush();
+
+    const AsyncLoggerStats start_stats = AsyncLogger::getStats();
+    double                 time_ns     = 0;
+    for (int i = 0; i < num_iterations; i += kBurstSize) {
+        const double start = getThreadCpuTimeNs();
+        for (int j = i; j < std::min(i + kBurstSize, num_iterations); j++) {
+            layer.forward(j, 8, 0.5f * j);
+        }
+        time_ns += getThreadCpuTimeNs() - start;
+        AsyncLogger::flush();
+    }
+    const AsyncLoggerStats stats = AsyncLogger::getStats();
+    fprintf(stderr,
+            "%-14s %8.1f ns/log (written %lu, dropped %lu)\n",
+            name,
+            time_ns / (2.0 * num_iterations),
+            (unsigned long)(stats.num_written - start_stats.num_written),
+            (unsigned long)(stats.num_dropped - start_stats.num_dropped));
+}
+
+}  // namespace
+
+int main(int argc, char* argv[])
+{
+    const int num_iterations = argc > 1 ? atoi(argv[1]) : 100000;
+    if (freopen("/dev/null", "w", stdout) == nullptr) {
+        return -1;
+    }
+    Logger::getLogger().setLevel(Logger::DEBUG);
+
+    benchmark("synchronous", num_iterations);
+
+    AsyncLoggerConfig config;
+    config.path = "/dev/null";
+    AsyncLogger::start(config);
+    benchmark("async text", num_iterations);
+    AsyncLogger::stop();
+
+    config.binary = true;
+    AsyncLogger::start(config);
+    benchmark("async binary", num_iterations);
+    AsyncLogger::stop();
+    return 0;
+}
@@ -0,0 +1,150 @@
+#include <chrono>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "src/fastertransformer/utils/Tensor.h"
+#include "src/fastertransformer/utils/logger.h"
+
+using namespace fastertransformer;
+
+// Measures the host work of one DynamicDecodeLayer step: build the sub-maps of the sampling layers from the maps of
+// the model, and look tensors up. The baseline is the former TensorMap, a std::unordered_map keyed by std::string
+// holding tensors with std::vector shapes.
+// Usage: ./bin/bench_tensor_map [num_iterations]
+
+namespace {
+
+struct LegacyTensor {
+    MemoryType          where;
+    DataType            type;
+    std::vector<size_t> shape;
+    const void*         data;
+};
+
+typedef std::unordered_map<std::string, LegacyTensor> LegacyTensorMap;
+
+const char* const kInputNames[]  = {"logits",
+                                    "step",
+                                    "max_input_length",
+                                    "end_id",
+                                    "ite",
+                                    "local_batch_size",
+                                    "input_lengths",
+                                    "sequence_limit_length",
+                                    "runtime_top_k",
+                                    "runtime_top_p",
+                                    "temperature",
+                                    "random_seed"};
+const char* const kOutputNames[] = {
+    "output_ids", "finished", "should_stop", "cum_log_probs", "parent_ids", "sequence_length"};
+
+static int g_buffer[1];
+
+size_t legacyStep(const LegacyTensorMap& inputs, const LegacyTensorMap& outputs)
+{
+    size_t              checksum = 0;
+    const LegacyTensor& logits   = inputs.at("logits");
+    LegacyTensorMap     decode_inputs;
+    decode_inputs.insert({"logits", LegacyTensor{logits.where, logits.type, {1, 1, logits.shape[2]}, logits.data}});
+    for (const char* name : {"step", "max_input_length", "end_id", "ite", "input_lengths"}) {
+        decode_inputs.insert({name, inputs.at(name)});
+    }
+    LegacyTensorMap decode_outputs;
+    for (const char* name : {"output_ids", "finished", "cum_log_probs", "sequence_length"}) {
+        const LegacyTensor& t = outputs.at(name);
+        decode_outputs.insert({name, LegacyTensor{t.where, t.type, {t.shape[0]}, t.data}});
+    }
+    // The sampling layers look up their arguments.
+    for (const char* name : {"runtime_top_k", "runtime_top_p", "temperature", "embedding_bias", "logits", "step"}) {
+        checksum += inputs.find(name) != inputs.end() ? inputs.at(name).shape.size() : 0;
+        checksum += decode_inputs.find(name) != decode_inputs.end() ? decode_inputs.at(name).shape.size() : 0;
+    }
+    return checksum + decode_inputs.size() + decode_outputs.size();
+}
+
+size_t stringKeyStep(const TensorMap& inputs, TensorMap& outputs)
+{
+    size_t    checksum = 0;
+    Tensor    logits   = inputs.at("logits");
+    TensorMap decode_inputs;
+    decode_inputs.insert("logits", logits.slice({1, 1, logits.shape[2]}));
+    for (const char* name : {"step", "max_input_length", "end_id", "ite", "input_lengths"}) {
+        decode_inputs.insert(name, inputs.at(name));
+    }
+    TensorMap decode_outputs;
+    for (const char* name : {"output_ids", "finished", "cum_log_probs", "sequence_length"}) {
+        const Tensor& t = outputs.at(name);
+        decode_outputs.insert(name, t.slice({t.shape[0]}));
+    }
+    for (const char* name : {"runtime_top_k", "runtime_top_p", "temperature", "embedding_bias", "logits", "step"}) {
+        checksum += inputs.isExist(name) ? inputs.at(name).shape.size() : 0;
+        checksum += decode_inputs.isExist(name) ? decode_inputs.at(name).shape.size() : 0;
+    }
+    return checksum + decode_inputs.size() + decode_outputs.size();
+}
+
+size_t internedKeyStep(const TensorMap& inputs, TensorMap& outputs)
+{
+    namespace keys = tensor_keys;
+
+    size_t    checksum = 0;
+    Tensor    logits   = inputs.at(keys::logits);
+    TensorMap decode_inputs;
+    decode_inputs.insert(keys::logits, logits.slice({1, 1, logits.shape[2]}));
+    for (const TensorKey& key : {keys::step, keys::max_input_length, keys::end_id, keys::ite, keys::input_lengths}) {
+        decode_inputs.insert(key, inputs.at(key));
+    }
+    TensorMap decode_outputs;
+    for (const TensorKey& key : {keys::output_ids, keys::finished, keys::cum_log_probs, keys::sequence_length}) {
+        const Tensor& t = outputs.at(key);
+        decode_outputs.insert(key, t.slice({t.shape[0]}));
+    }
+    for (const TensorKey& key : {keys::runtime_top_k,
+                                 keys::runtime_top_p,
+                                 keys::temperature,
+                                 keys::embedding_bias,
+                                 keys::logits,
+                                 keys::step}) {
+        checksum += inputs.isExist(key) ? inputs.at(key).shape.size() : 0;
+        checksum += decode_inputs.isExist(key) ? decode_inputs.at(key).shape.size() : 0;
+    }
+    return checksum + decode_inputs.size() + decode_outputs.size();
+}
+
+template<typename F>
+void benchmark(const std::string& name, int num_iterations, F step)
+{
+    size_t checksum = 0;
+    auto   start    = std::chrono::steady_clock::now();
+    for (int i = 0; i < num_iterations; i++) {
+        checksum += step();
+    }
+    auto   end     = std::chrono::steady_clock::now();
+    double time_us = std::chrono::duration<double, std::micro>(end - start).count() / num_iterations;
+    FT_LOG_INFO("%-24s %8.3f us/step (checksum %lu)", name.c_str(), time_us, checksum);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[])
+{
+    const int num_iterations = argc > 1 ? atoi(argv[1]) : 200000;
+
+    LegacyTensorMap legacy_inputs, legacy_outputs;
+    TensorMap       inputs, outputs;
+    for (const char* name : kInputNames) {
+        legacy_inputs.insert({name, LegacyTensor{MEMORY_CPU, TYPE_INT32, {1, 1, 50304}, g_buffer}});
+        inputs.insert(name, Tensor{MEMORY_CPU, TYPE_INT32, {1, 1, 50304}, g_buffer});
+    }
+    for (const char* name : kOutputNames) {
+        legacy_outputs.insert({name, LegacyTensor{MEMORY_CPU, TYPE_INT32, {1}, g_buffer}});
+        outputs.insert(name, Tensor{MEMORY_CPU, TYPE_INT32, {1}, g_buffer});
+    }
+
+    FT_LOG_INFO("num_iterations: %d", num_iterations);
+    benchmark("unordered_map baseline", num_iterations, [&]() { return legacyStep(legacy_inputs, legacy_outputs); });
+    benchmark("TensorMap, string keys", num_iterations, [&]() { return stringKeyStep(inputs, outputs); });
+    benchmark("TensorMap, interned keys", num_iterations, [&]() { return internedKeyStep(inputs, outputs); });
+    return 0;
+}
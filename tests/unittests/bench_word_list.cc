@@ -0,0 +1,182 @@
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "src/fastertransformer/utils/logger.h"
+#include "src/fastertransformer/utils/word_list.h"
+
+using namespace fastertransformer;
+
+// Measures the stop and bad word checks of one decoding step on the host: the linear scan of the former
+// CpuDynamicDecodeLayer, which compares every word with the end of the sequence, against WordListMatcher, which
+// advances the state of the sequence by one token.
+// Usage: ./bin/bench_word_list [num_words] [batch_size] [num_steps]
+
+namespace {
+
+// The word list in the layout of read_word_list. The words are drawn from a small set of frequent tokens, so that
+// many of them partially match the generated text as real stop sequences do.
+std::vector<int> makeWordList(int num_words, std::mt19937* gen, size_t* words_len)
+{
+    std::vector<int> tokens, offsets;
+    for (int i = 0; i < num_words; i++) {
+        const int length = 1 + (*gen)() % 6;
+        for (int j = 0; j < length; j++) {
+            tokens.push_back((*gen)() % 200);
+        }
+        offsets.push_back(tokens.size());
+    }
+    *words_len = tokens.size();
+    offsets.resize(tokens.size(), -1);
+    tokens.insert(tokens.end(), offsets.begin(), offsets.end());
+    return tokens;
+}
+
+// The former CpuDynamicDecodeLayer::applyStopWords and banBadWords of one sequence, without beams.
+bool scanStopWords(const int* words, size_t words_len, const int* ids, int step)
+{
+    const int* offsets = words + words_len;
+    for (size_t id = 0; id < words_len && offsets[id] >= 0; id++) {
+        const int item_end   = offsets[id];
+        const int item_start = id > 0 ? offsets[id - 1] : 0;
+        const int item_size  = item_end - item_start;
+        if (step + 1 < item_size) {
+            continue;
+        }
+        bool should_stop = true;
+        for (int token_idx = item_size - 1; token_idx >= 0; token_idx--) {
+            if (ids[step - (item_size - 1) + token_idx] != words[item_start + token_idx]) {
+                should_stop = false;
+                break;
+            }
+        }
+        if (should_stop) {
+            return true;
+        }
+    }
+    return false;
+}
+
+const float kBanned = -1e20f;
+
+size_t scanBadWords(const int* words, size_t words_len, const int* ids, int step, float* logits)
+{
+    const int* offsets    = words + words_len;
+    size_t     num_banned = 0;
+    for (size_t id = 0; id < words_len && offsets[id] >= 0; id++) {
+        const int item_end   = offsets[id];
+        const int item_start = id > 0 ? offsets[id - 1] : 0;
+        const int item_size  = item_end - item_start;
+        bool      should_ban = item_size == 1;
+        if (item_size > 1 && step >= item_size - 1) {
+            should_ban = true;
+            for (int token_idx = item_size - 2; token_idx >= 0; token_idx--) {
+                if (ids[step - (item_size - 1) + token_idx] != words[item_start + token_idx]) {
+                    should_ban = false;
+                    break;
+                }
+            }
+        }
+        if (should_ban && logits[words[item_end - 1]] != kBanned) {
+            logits[words[item_end - 1]] = kBanned;
+            num_banned++;
+        }
+    }
+    return num_banned;
+}
+
+template<typename F>
+void benchmark(const std::string& name, int num_sequence_steps, F run)
+{
+    auto   start    = std::chrono::steady_clock::now();
+    size_t checksum = run();
+    auto   end      = std::chrono::steady_clock::now();
+    double time_ns  = std::chrono::duration<double, std::nano>(end - start).count() / num_sequence_steps;
+    FT_LOG_INFO("%-24s %10.1f ns/sequence/step (checksum %lu)", name.c_str(), time_ns, checksum);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[])
+{
+    const int num_words  = argc > 1 ? atoi(argv[1]) : 500;
+    const int batch_size = argc > 2 ? atoi(argv[2]) : 64;
+    const int num_steps  = argc > 3 ? atoi(argv[3]) : 256;
+
+    std::mt19937     gen(1);
+    size_t           words_len;
+    std::vector<int> words = makeWordList(num_words, &gen, &words_len);
+    // Sequences of frequent tokens, [batch_size, num_steps].
+    std::vector<int> ids((size_t)batch_size * num_steps);
+    for (int& id : ids) {
+        id = gen() % 200;
+    }
+    std::vector<float> logits(256);
+
+    auto            compile_start = std::chrono::steady_clock::now();
+    WordListMatcher matcher(words.data(), words_len);
+    auto            compile_end = std::chrono::steady_clock::now();
+    FT_LOG_INFO("%d words, %lu tokens: %lu states, compiled in %.1f us",
+                num_words,
+                words_len,
+                matcher.getNumStates(),
+                std::chrono::duration<double, std::micro>(compile_end - compile_start).count());
+
+    const int num_sequence_steps = batch_size * num_steps;
+    benchmark("stop words, linear scan", num_sequence_steps, [&]() {
+        size_t num_stops = 0;
+        for (int step = 0; step < num_steps; step++) {
+            for (int b = 0; b < batch_size; b++) {
+                num_stops += scanStopWords(words.data(), words_len, ids.data() + (size_t)b * num_steps, step);
+            }
+        }
+        return num_stops;
+    });
+    benchmark("stop words, automaton", num_sequence_steps, [&]() {
+        size_t           num_stops = 0;
+        std::vector<int> states(batch_size, WordListMatcher::kStartState);
+        for (int step = 0; step < num_steps; step++) {
+            for (int b = 0; b < batch_size; b++) {
+                states[b] = matcher.advance(states[b], ids[(size_t)b * num_steps + step]);
+                num_stops += matcher.isMatch(states[b]);
+            }
+        }
+        return num_stops;
+    });
+
+    benchmark("bad words, linear scan", num_sequence_steps, [&]() {
+        size_t num_banned = 0;
+        for (int step = 0; step < num_steps; step++) {
+            for (int b = 0; b < batch_size; b++) {
+                std::fill(logits.begin(), logits.end(), 0.0f);
+                num_banned +=
+                    scanBadWords(words.data(), words_len, ids.data() + (size_t)b * num_steps, step, logits.data());
+            }
+        }
+        return num_banned;
+    });
+    benchmark("bad words, automaton", num_sequence_steps, [&]() {
+        size_t           num_banned = 0;
+        std::vector<int> states(batch_size, WordListMatcher::kStartState);
+        for (int step = 0; step < num_steps; step++) {
+            for (int b = 0; b < batch_size; b++) {
+                std::fill(logits.begin(), logits.end(), 0.0f);
+                size_t     num_ends;
+                const int* ends = matcher.getNextWordEnds(states[b], &num_ends);
+                for (size_t i = 0; i < num_ends; i++) {
+                    num_banned += logits[ends[i]] != kBanned;
+                    logits[ends[i]] = kBanned;
+                }
+                for (int token : matcher.getSingleTokenWords()) {
+                    num_banned += logits[token] != kBanned;
+                    logits[token] = kBanned;
+                }
+                states[b] = matcher.advance(states[b], ids[(size_t)b * num_steps + step]);
+            }
+        }
+        return num_banned;
+    });
+    return 0;
+}
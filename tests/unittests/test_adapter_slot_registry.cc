@@ -0,0 +1,198 @@
+#include <condition_variable>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "src/fastertransformer/layers/adapter_layers/AdapterSlotRegistry.h"
+
+using namespace fastertransformer;
+
+namespace {
+
+// Holds the staging thread until open is called.
+class Gate {
+public:
+    void wait()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [this] { return is_open_; });
+    }
+    void open()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            is_open_ = true;
+        }
+        cv_.notify_all();
+    }
+
+private:
+    std::mutex              mutex_;
+    std::condition_variable cv_;
+    bool                    is_open_ = false;
+};
+
+AdapterInfo findAdapter(const AdapterSlotRegistry& registry, int adapter_id, AdapterState state)
+{
+    for (const AdapterInfo& info : registry.listAdapters()) {
+        if (info.adapter_id == adapter_id && info.state == state) {
+            return info;
+        }
+    }
+    return AdapterInfo();
+}
+
+TEST(AdapterSlotRegistryTest, ServesAnAdapterOnceItIsStaged)
+{
+    AdapterSlotRegistry registry(2);
+    Gate                gate;
+    std::vector<int>    staged_slots;
+    registry.registerAdapter(5, [&](int slot) {
+        gate.wait();
+        staged_slots.push_back(slot);
+    });
+
+    EXPECT_EQ(findAdapter(registry, 5, AdapterState::STAGING).slot, 0);
+    std::vector<int> adapter_ids = {5, -1};
+    std::vector<int> slots(2);
+    EXPECT_THROW(registry.acquireSlots(slots.data(), adapter_ids.data(), 2), std::runtime_error);
+    adapter_ids = {3};
+    EXPECT_THROW(registry.acquireSlots(slots.data(), adapter_ids.data(), 1), std::runtime_error);
+
+    gate.open();
+    registry.waitForStaging();
+    EXPECT_EQ(staged_slots, std::vector<int>({0}));
+    adapter_ids = {5, -1};
+    registry.acquireSlots(slots.data(), adapter_ids.data(), 2);
+    EXPECT_EQ(slots, std::vector<int>({0, -1}));
+    EXPECT_EQ(findAdapter(registry, 5, AdapterState::READY).num_references, 1u);
+    registry.releaseSlots(slots.data(), 2);
+    EXPECT_EQ(findAdapter(registry, 5, AdapterState::READY).num_references, 0u);
+}
+
+TEST(AdapterSlotRegistryTest, KeepsReplacedAdaptersUntilTheirRequestsRelease)
+{
+    AdapterSlotRegistry registry(2);
+    registry.addStagedAdapter(0, 1);
+
+    // A request holds the first version while the second one is staged.
+    std::vector<int> adapter_ids = {0, 0};
+    std::vector<int> old_slots(2), new_slots(1);
+    registry.acquireSlots(old_slots.data(), adapter_ids.data(), 2);
+    EXPECT_EQ(old_slots, std::vector<int>({1, 1}));
+    registry.registerAdapter(0, [](int) {});
+    registry.waitForStaging();
+
+    registry.acquireSlots(new_slots.data(), adapter_ids.data(), 1);
+    EXPECT_EQ(new_slots[0], 0);
+    AdapterInfo retired = findAdapter(registry, 0, AdapterState::RETIRED);
+    EXPECT_EQ(retired.slot, 1);
+    EXPECT_EQ(retired.num_references, 2u);
+
+    // Both slots are held, so nothing can be registered until the old version is released.
+    EXPECT_TRUE(registry.unregisterAdapter(0));
+    EXPECT_FALSE(registry.unregisterAdapter(0));
+    EXPECT_THROW(registry.acquireSlots(new_slots.data(), adapter_ids.data(), 1), std::runtime_error);
+    EXPECT_THROW(registry.registerAdapter(7, [](int) {}), std::runtime_error);
+    registry.releaseSlots(old_slots.data(), 2);
+    registry.registerAdapter(7, [](int) {});
+    registry.waitForStaging();
+    EXPECT_EQ(findAdapter(registry, 7, AdapterState::READY).slot, 1);
+
+    registry.releaseSlots(new_slots.data(), 1);
+    const std::vector<AdapterInfo> infos = registry.listAdapters();
+    ASSERT_EQ(infos.size(), 1u);
+    EXPECT_EQ(infos[0].adapter_id, 7);
+}
+
+TEST(AdapterSlotRegistryTest, FreesTheSlotOfAFailedOrDroppedStaging)
+{
+    AdapterSlotRegistry registry(1);
+    registry.registerAdapter(2, [](int) { throw std::runtime_error("missing file"); });
+    registry.waitForStaging();
+    EXPECT_EQ(findAdapter(registry, 2, AdapterState::FAILED).slot, -1);
+    std::vector<int> adapter_ids = {2};
+    std::vector<int> slots(1);
+    EXPECT_THROW(registry.acquireSlots(slots.data(), adapter_ids.data(), 1), std::runtime_error);
+
+    // Unregistered while it is staged: the staging finishes, then the slot is freed.
+    Gate gate;
+    registry.registerAdapter(2, [&](int) { gate.wait(); });
+    EXPECT_EQ(findAdapter(registry, 2, AdapterState::FAILED).adapter_id, -1);
+    EXPECT_TRUE(registry.unregisterAdapter(2));
+    EXPECT_EQ(findAdapter(registry, 2, AdapterState::STAGING).slot, 0);
+    gate.open();
+    registry.waitForStaging();
+    EXPECT_TRUE(registry.listAdapters().empty());
+
+    registry.registerAdapter(4, [](int) {});
+    registry.waitForStaging();
+    adapter_ids = {4};
+    registry.acquireSlots(slots.data(), adapter_ids.data(), 1);
+    EXPECT_EQ(slots[0], 0);
+    registry.releaseSlots(slots.data(), 1);
+}
+
+TEST(AdapterSlotRegistryTest, PagesAdaptersIntoTheLeastRecentlyUsedSlots)
+{
+    AdapterSlotRegistry registry(2);
+    std::vector<std::pair<int, int>> pages;  // adapter id, slot
+    auto page = [&](int adapter_id, int slot) { pages.push_back({adapter_id, slot}); };
+    for (int adapter_id = 0; adapter_id < 3; adapter_id++) {
+        registry.addPagedAdapter(adapter_id);
+    }
+    EXPECT_EQ(findAdapter(registry, 2, AdapterState::PAGED_OUT).adapter_id, 2);
+
+    // Only acquireSlots with a page function pages adapters in.
+    std::vector<int> adapter_ids = {0, -1, 1, 0};
+    std::vector<int> slots(4);
+    EXPECT_THROW(registry.acquireSlots(slots.data(), adapter_ids.data(), 4), std::runtime_error);
+    registry.acquireSlots(slots.data(), adapter_ids.data(), 4, 0, page);
+    EXPECT_EQ(slots, std::vector<int>({0, -1, 1, 0}));
+    EXPECT_EQ(pages.size(), 2u);
+
+    // Both slots are held.
+    std::vector<int> other_slots(1);
+    adapter_ids = {2};
+    EXPECT_THROW(registry.acquireSlots(other_slots.data(), adapter_ids.data(), 1, 0, page), std::runtime_error);
+    registry.releaseSlots(slots.data(), 4);
+
+    // Adapter 0 was used last, so adapter 2 takes the slot of adapter 1, which is paged in again when it is used.
+    adapter_ids = {0};
+    registry.acquireSlots(other_slots.data(), adapter_ids.data(), 1, 0, page);
+    registry.releaseSlots(other_slots.data(), 1);
+    adapter_ids = {2, 2};
+    registry.acquireSlots(slots.data(), adapter_ids.data(), 2, 0, page);
+    EXPECT_EQ(slots[0], 1);
+    EXPECT_EQ(pages.back(), std::make_pair(2, 1));
+    EXPECT_EQ(registry.getSlot(1), -1);
+    EXPECT_EQ(findAdapter(registry, 1, AdapterState::PAGED_OUT).adapter_id, 1);
+
+    // A batch cannot page out its own adapters.
+    adapter_ids = {0, 1};
+    EXPECT_THROW(registry.acquireSlots(other_slots.data(), adapter_ids.data(), 2, 0, page), std::runtime_error);
+    registry.releaseSlots(slots.data(), 2);
+    EXPECT_EQ(pages.size(), 3u);
+
+    // A new version is paged in by the next request, a failed page leaves the slot free.
+    registry.addPagedAdapter(0);
+    EXPECT_EQ(registry.getSlot(0), -1);
+    adapter_ids = {0};
+    EXPECT_THROW(registry.acquireSlots(other_slots.data(),
+                                       adapter_ids.data(),
+                                       1,
+                                       0,
+                                       [](int, int) { throw std::runtime_error("copy failed"); }),
+                 std::runtime_error);
+    registry.acquireSlots(other_slots.data(), adapter_ids.data(), 1, 0, page);
+    EXPECT_EQ(other_slots[0], 0);
+    EXPECT_TRUE(registry.unregisterAdapter(0));
+    EXPECT_EQ(findAdapter(registry, 0, AdapterState::RETIRED).slot, 0);
+    registry.releaseSlots(other_slots.data(), 1);
+    EXPECT_EQ(findAdapter(registry, 0, AdapterState::RETIRED).adapter_id, -1);
+}
+
+}  // end of namespace
@@ -0,0 +1,199 @@
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "src/fastertransformer/utils/async_logger.h"
+#include "src/fastertransformer/utils/logger.h"
+
+using namespace fastertransformer;
+
+namespace {
+
+template<typename... Args>
+std::string format(const char* format, const Args&... args)
+{
+    std::vector<char> buffer(LogRecord::kPayloadSize);
+    LogArgWriter      writer(buffer.data(), buffer.size());
+    writer.putAll(args...);
+    return formatLogMessage(format, std::strlen(format), buffer.data(), writer.size());
+}
+
+std::string readFile(const std::string& path)
+{
+    std::ifstream      file(path);
+    std::ostringstream ss;
+    ss << file.rdbuf();
+    return ss.str();
+}
+
+std::vector<std::string> splitLines(const std::string& text)
+{
+    std::vector<std::string> lines;
+    std::istringstream       ss(text);
+    for (std::string line; std::getline(ss, line);) {
+        lines.push_back(line);
+    }
+    return lines;
+}
+
+class AsyncLoggerTest: public testing::Test {
+protected:
+    void SetUp() override
+    {
+        level_ = Logger::getLogger().getLevel();
+        Logger::getLogger().setLevel(Logger::INFO);
+        AsyncLogger::stop();
+    }
+    void TearDown() override
+    {
+        AsyncLogger::stop();
+        Logger::getLogger().setLevel((Logger::Level)level_);
+        for (const std::string& path : paths_) {
+            std::remove(path.c_str());
+        }
+    }
+    std::string tempPath(const std::string& name)
+    {
+        paths_.push_back(testing::TempDir() + name);
+        return paths_.back();
+    }
+
+    int                      level_;
+    std::vector<std::string> paths_;
+};
+
+TEST(LogArgTest, FormatsLikePrintf)
+{
+    EXPECT_EQ(format("plain 100%%"), "plain 100%");
+    EXPECT_EQ(format("%d %5d %-4d| %u %x %#X", -3, 42, 7, 4000000000u, 255, 255), "-3    42 7   | 4000000000 ff 0XFF");
+    EXPECT_EQ(format("%ld %lu %zu %lld", -5L, 6UL, (size_t)7, -8LL), "-5 6 7 -8");
+    EXPECT_EQ(format("%u %hhd %c", -1, 300, 'x'), "4294967295 44 x");
+    EXPECT_EQ(format("%.3f %e %g %5.1f", 3.14159, 1e10, 0.5f, 2.25), "3.142 1.000000e+10 0.5   2.2");
+    EXPECT_EQ(format("%s=%-6s| %.2s %s", "key", std::string("value"), "abc", (const char*)nullptr),
+              "key=value | ab (null)");
+    EXPECT_EQ(format("%*d|%.*f", 4, 1, 2, 1.0), "   1|1.00");
+    EXPECT_EQ(format("%d %d", 1), "1 <?>");
+    EXPECT_EQ(format("%s", 1), "<?>");
+
+    int  value = 0;
+    char expected[32];
+    snprintf(expected, sizeof(expected), "%p", (void*)&value);
+    EXPECT_EQ(format("%p", &value), expected);
+}
+
+TEST(LogArgTest, LongArgumentsAreTruncated)
+{
+    std::vector<char> buffer(32);
+    LogArgWriter      writer(buffer.data(), buffer.size());
+    writer.putAll(std::string(100, 'a'), 1);
+    EXPECT_TRUE(writer.truncated());
+    EXPECT_EQ(writer.size(), 32u);
+    EXPECT_EQ(formatLogMessage("%s %d", 5, buffer.data(), writer.size()), std::string(29, 'a') + " <?>");
+}
+
+TEST_F(AsyncLoggerTest, WritesTextInOrder)
+{
+    const std::string path = tempPath("async_logger.txt");
+    AsyncLoggerConfig config;
+    config.path = path;
+    ASSERT_TRUE(AsyncLogger::start(config));
+    EXPECT_FALSE(AsyncLogger::start(config));
+    EXPECT_TRUE(AsyncLogger::isRunning());
+
+    FT_LOG_DEBUG("not logged");
+    FT_LOG_INFO("step %d of %s", 1, "decoding");
+    FT_LOG_WARNING(std::string("batch size ") + "%lu", (size_t)8);
+    Logger::getLogger().log(Logger::INFO, 3, "rank %d", 3);
+    AsyncLogger::flush();
+    std::vector<std::string> lines = splitLines(readFile(path));
+    ASSERT_EQ(lines.size(), 3u);
+    EXPECT_EQ(lines[0], "[FT][INFO] step 1 of decoding");
+    EXPECT_EQ(lines[1], "[FT][WARNING] batch size 8");
+    EXPECT_EQ(lines[2], "[FT][INFO][3] rank 3");
+
+    AsyncLogger::stop();
+    EXPECT_FALSE(AsyncLogger::isRunning());
+    EXPECT_EQ(AsyncLogger::getStats().num_dropped, 0u);
+}
+
+TEST_F(AsyncLoggerTest, FullQueuesDropRecords)
+{
+    const std::string path = tempPath("async_logger_drops.txt");
+    AsyncLoggerConfig config;
+    config.path       = path;
+    config.queue_size = 4;
+    ASSERT_TRUE(AsyncLogger::start(config));
+
+    const int                kNumThreads = 4;
+    const int                kNumLogs    = 2000;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kNumThreads; t++) {
+        threads.emplace_back([t]() {
+            Logger::getLogger().setLevel(Logger::INFO);
+            for (int i = 0; i < kNumLogs; i++) {
+                FT_LOG_INFO("thread %d log %d", t, i);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    AsyncLogger::stop();
+
+    const AsyncLoggerStats stats = AsyncLogger::getStats();
+    // Each thread also logs the change of level.
+    EXPECT_EQ(stats.num_written + stats.num_dropped, (uint64_t)kNumThreads * (kNumLogs + 1));
+    EXPECT_GT(stats.num_dropped, 0u);
+
+    std::vector<int> last(kNumThreads, -1);
+    uint64_t         num_logs = 0;
+    for (const std::string& line : splitLines(readFile(path))) {
+        int t, i;
+        if (sscanf(line.c_str(), "[FT][INFO] thread %d log %d", &t, &i) == 2) {
+            EXPECT_GT(i, last[t]) << "the records of a thread are out of order";
+            last[t] = i;
+            num_logs++;
+        }
+    }
+    EXPECT_GT(num_logs, 0u);
+}
+
+TEST_F(AsyncLoggerTest, BinaryLogDecodesToText)
+{
+    const std::string path = tempPath("async_logger.bin");
+    AsyncLoggerConfig config;
+    config.path   = path;
+    config.binary = true;
+    ASSERT_TRUE(AsyncLogger::start(config));
+    for (int i = 0; i < 3; i++) {
+        FT_LOG_INFO("step %d, %.1f ms, %s", i, 0.5 * i, "ok");
+    }
+    FT_LOG_ERROR("out of memory");
+    AsyncLogger::stop();
+
+    FILE* input = fopen(path.c_str(), "rb");
+    ASSERT_NE(input, nullptr);
+    const std::string text_path = tempPath("async_logger_decoded.txt");
+    FILE*             output    = fopen(text_path.c_str(), "w");
+    EXPECT_TRUE(decodeBinaryLog(input, output, false));
+    fclose(input);
+    fclose(output);
+    EXPECT_EQ(readFile(text_path),
+              "[FT][INFO] step 0, 0.0 ms, ok\n"
+              "[FT][INFO] step 1, 0.5 ms, ok\n"
+              "[FT][INFO] step 2, 1.0 ms, ok\n"
+              "[FT][ERROR] out of memory\n");
+
+    // The format is written once, each record only holds its arguments.
+    const std::string binary = readFile(path);
+    const size_t      first  = binary.find("step %d");
+    ASSERT_NE(first, std::string::npos);
+    EXPECT_EQ(binary.find("step %d", first + 1), std::string::npos);
+}
+
+}  // end of namespace
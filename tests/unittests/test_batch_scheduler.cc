@@ -0,0 +1,162 @@
+#include <map>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "src/fastertransformer/utils/batch_scheduler.h"
+
+using namespace fastertransformer;
+
+namespace {
+
+// Mock model: the next token of a slot is the last input token plus one, so outputs only depend on the request.
+// It also checks that the scheduler feeds the prompt once and then the previously generated token.
+class MockStep {
+public:
+    explicit MockStep(size_t max_batch_size): cache_length_(max_batch_size, 0) {}
+
+    void operator()(const std::vector<BatchSlot>& slots, std::vector<int>* next_token_ids)
+    {
+        batch_sizes.push_back(slots.size());
+        for (size_t i = 0; i < slots.size(); i++) {
+            const BatchSlot& slot = slots[i];
+            if (slot.is_context) {
+                EXPECT_EQ(slot.step, 0);
+                cache_length_[slot.slot] = 0;
+            }
+            else {
+                EXPECT_EQ(slot.input_length, 1);
+            }
+            EXPECT_EQ(slot.step, cache_length_[slot.slot]);
+            cache_length_[slot.slot] += slot.input_length;
+            (*next_token_ids)[i] = slot.input_ids[slot.input_length - 1] + 1;
+        }
+    }
+
+    std::vector<size_t> batch_sizes;
+
+private:
+    std::vector<int> cache_length_;
+};
+
+BatchRequest makeRequest(uint64_t                              id,
+                         std::vector<int>                      input_ids,
+                         int                                   max_new_tokens,
+                         std::map<uint64_t, std::vector<int>>* outputs)
+{
+    BatchRequest request;
+    request.request_id      = id;
+    request.input_ids       = input_ids;
+    request.max_new_tokens  = max_new_tokens;
+    request.finish_callback = [outputs](uint64_t request_id, const std::vector<int>& output_ids) {
+        (*outputs)[request_id] = output_ids;
+    };
+    return request;
+}
+
+TEST(BatchSchedulerTest, SlotManagerHandsOutLowestFreeSlot)
+{
+    BatchSlotManager manager(3);
+    EXPECT_EQ(manager.acquire(), 0);
+    EXPECT_EQ(manager.acquire(), 1);
+    EXPECT_EQ(manager.acquire(), 2);
+    EXPECT_EQ(manager.acquire(), -1);
+    manager.release(1);
+    manager.release(0);
+    EXPECT_EQ(manager.numFreeSlots(), 2u);
+    EXPECT_EQ(manager.acquire(), 0);
+    EXPECT_THROW(manager.release(1), std::runtime_error);
+}
+
+TEST(BatchSchedulerTest, FreedSlotsAreReusedBetweenSteps)
+{
+    std::map<uint64_t, std::vector<int>> outputs;
+    std::shared_ptr<MockStep>            mock = std::make_shared<MockStep>(2);
+    BatchScheduler scheduler(2, 16, [mock](const std::vector<BatchSlot>& slots, std::vector<int>* ids) {
+        (*mock)(slots, ids);
+    });
+    scheduler.enqueue(makeRequest(0, {10, 11}, 8, &outputs));
+    scheduler.enqueue(makeRequest(1, {20}, 2, &outputs));
+    scheduler.enqueue(makeRequest(2, {30, 31, 32}, 2, &outputs));
+    scheduler.enqueue(makeRequest(3, {40}, 3, &outputs));
+    scheduler.runUntilIdle();
+
+    EXPECT_EQ(outputs[0], std::vector<int>({12, 13, 14, 15, 16, 17, 18, 19}));
+    EXPECT_EQ(outputs[1], std::vector<int>({21, 22}));
+    EXPECT_EQ(outputs[2], std::vector<int>({33, 34}));
+    EXPECT_EQ(outputs[3], std::vector<int>({41, 42, 43}));
+
+    // A static batch would need 8 + 3 steps; request 0 shares its steps with the three others.
+    BatchSchedulerStats stats = scheduler.getStats();
+    EXPECT_EQ(stats.num_steps, 8u);
+    EXPECT_EQ(stats.num_admitted, 4u);
+    EXPECT_EQ(stats.num_finished, 4u);
+    EXPECT_EQ(stats.num_generated_tokens, 15u);
+    EXPECT_EQ(stats.num_slot_steps, 15u);
+    EXPECT_EQ(mock->batch_sizes, std::vector<size_t>({2, 2, 2, 2, 2, 2, 2, 1}));
+    EXPECT_EQ(scheduler.numActiveRequests(), 0u);
+}
+
+TEST(BatchSchedulerTest, EndIdEvictsRequest)
+{
+    std::map<uint64_t, std::vector<int>> outputs;
+    MockStep                             mock(1);
+    BatchScheduler scheduler(1, 16, [&mock](const std::vector<BatchSlot>& slots, std::vector<int>* ids) {
+        mock(slots, ids);
+    });
+    BatchRequest request = makeRequest(7, {1}, 10, &outputs);
+    request.end_id          = 4;
+    std::vector<int> streamed;
+    request.token_callback = [&streamed](uint64_t, int token_id) { streamed.push_back(token_id); };
+    scheduler.enqueue(request);
+    scheduler.runUntilIdle();
+    EXPECT_EQ(outputs[7], std::vector<int>({2, 3, 4}));
+    EXPECT_EQ(streamed, outputs[7]);
+}
+
+TEST(BatchSchedulerTest, ContextTokenBudgetDelaysAdmission)
+{
+    std::map<uint64_t, std::vector<int>> outputs;
+    MockStep                             mock(4);
+    BatchScheduler                       scheduler(
+        4, 16, [&mock](const std::vector<BatchSlot>& slots, std::vector<int>* ids) { mock(slots, ids); }, 4);
+    scheduler.enqueue(makeRequest(0, {1, 2, 3}, 4, &outputs));
+    scheduler.enqueue(makeRequest(1, {1, 2, 3}, 4, &outputs));
+    scheduler.enqueue(makeRequest(2, {1, 2, 3, 4, 5, 6}, 4, &outputs));
+    EXPECT_THROW(scheduler.enqueue(makeRequest(3, std::vector<int>(15, 1), 2, &outputs)), std::runtime_error);
+
+    EXPECT_TRUE(scheduler.step());
+    EXPECT_EQ(scheduler.numActiveRequests(), 1u);
+    EXPECT_TRUE(scheduler.step());
+    EXPECT_EQ(scheduler.numActiveRequests(), 2u);
+    EXPECT_TRUE(scheduler.step());  // longer than the budget, admitted alone
+    EXPECT_EQ(scheduler.numActiveRequests(), 3u);
+    scheduler.runUntilIdle();
+    EXPECT_EQ(outputs.size(), 3u);
+    EXPECT_EQ(outputs[2], std::vector<int>({7, 8, 9, 10}));
+    EXPECT_EQ(scheduler.getStats().num_context_steps, 3u);
+}
+
+TEST(BatchSchedulerTest, ServeProcessesRequestsFromAnotherThread)
+{
+    std::map<uint64_t, std::vector<int>> outputs;
+    MockStep                             mock(4);
+    BatchScheduler scheduler(4, 64, [&mock](const std::vector<BatchSlot>& slots, std::vector<int>* ids) {
+        mock(slots, ids);
+    });
+    std::thread server([&scheduler] { scheduler.serve(); });
+    for (uint64_t i = 0; i < 32; i++) {
+        scheduler.enqueue(makeRequest(i, {(int)i * 100}, 1 + (int)(i % 5), &outputs));
+    }
+    scheduler.close();
+    server.join();
+    ASSERT_EQ(outputs.size(), 32u);
+    for (uint64_t i = 0; i < 32; i++) {
+        ASSERT_EQ(outputs[i].size(), 1 + i % 5);
+        EXPECT_EQ(outputs[i].back(), (int)(i * 100 + 1 + i % 5));
+    }
+}
+
+}  // end of namespace
@@ -0,0 +1,339 @@
+#include <algorithm>  // std::fill
+#include <memory>     // std::unique_ptr
+#include <random>     // std::mt19937
+#include <string>     // std::string
+#include <vector>     // std::vector
+
+#include <cublasLt.h>
+#include <cublas_v2.h>
+#include <cuda_runtime.h>
+
+#include "src/fastertransformer/layers/DynamicDecodeLayer.h"
+#include "src/fastertransformer/layers/beam_search_layers/BeamSearchReference.h"
+#include "src/fastertransformer/layers/beam_search_layers/OnlineBeamSearchLayer.h"
+#include "src/fastertransformer/utils/cublasMMWrapper.h"
+#include "src/fastertransformer/utils/cuda_utils.h"
+#include "src/fastertransformer/utils/memory_utils.h"
+#include "src/fastertransformer/utils/Tensor.h"
+
+#include "tests/unittests/gtest_utils.h"
+
+using namespace fastertransformer;
+
+namespace {
+
+// Decodes a batch of requests with different runtime arguments with DynamicDecodeLayer, and checks every step against
+// beamSearchStepReference. Logits are random, so that ties between candidates are unlikely.
+class BeamSearchDecodeTest: public FtTestBase {
+protected:
+    const size_t batch_size     = 4;
+    const size_t beam_width     = 2;
+    const size_t batchxbeam     = batch_size * beam_width;
+    const size_t vocab_size     = 13;
+    const size_t vocab_size_pad = 16;
+    const int    max_input_len  = 2;
+    const size_t max_seq_len    = 10;
+
+    cublasHandle_t   cublas_handle;
+    cublasLtHandle_t cublaslt_handle;
+    std::mutex*      cublas_wrapper_mutex;
+    cublasMMWrapper* cublas_wrapper;
+
+    void SetUp() override
+    {
+        FtTestBase::SetUp();
+        check_cuda_error(cublasCreate(&cublas_handle));
+        check_cuda_error(cublasLtCreate(&cublaslt_handle));
+        check_cuda_error(cublasSetStream(cublas_handle, stream));
+        cublasAlgoMap cublas_algo_map(GEMM_CONFIG);
+        cublas_wrapper_mutex = new std::mutex();
+        cublas_wrapper       = new cublasMMWrapper(
+            cublas_handle, cublaslt_handle, stream, &cublas_algo_map, cublas_wrapper_mutex, allocator);
+    }
+
+    void TearDown() override
+    {
+        delete cublas_wrapper;
+        delete cublas_wrapper_mutex;
+        check_cuda_error(cublasLtDestroy(cublaslt_handle));
+        check_cuda_error(cublasDestroy(cublas_handle));
+        FtTestBase::TearDown();
+    }
+
+    // with_request_inputs also passes the tensors of the request to every step, as ParallelGpt does, so that the keys
+    // DynamicDecodeLayer sets itself (src_cache_indirection, ...) come twice. without_setup calls the forward of
+    // OnlineBeamSearchLayer directly, with the runtime arguments in its inputs instead of setup().
+    void runTest(const std::vector<BeamSearchRequestArgs>& args,
+                 RepetitionPenaltyType                     repetition_penalty_type,
+                 bool                                      with_request_inputs = false,
+                 bool                                      without_setup       = false)
+    {
+        struct cudaDeviceProp prop;
+        check_cuda_error(cudaGetDeviceProperties(&prop, 0));
+        DynamicDecodeLayer<float> decode_layer(
+            vocab_size, vocab_size_pad, args[0].end_id, stream, cublas_wrapper, allocator, false, &prop);
+        OnlineBeamSearchLayer<float> beam_search_layer(0,
+                                                       0,
+                                                       0,
+                                                       0,
+                                                       vocab_size,
+                                                       vocab_size_pad,
+                                                       0,
+                                                       0.0f,
+                                                       1.0f,
+                                                       0.0f,
+                                                       1.0f,
+                                                       stream,
+                                                       cublas_wrapper,
+                                                       allocator,
+                                                       false);
+
+        // Runtime arguments of each request.
+        std::vector<int>   end_ids(batch_size);
+        std::vector<float> temperatures(batch_size);
+        std::vector<float> len_penalties(batch_size);
+        std::vector<float> repetition_penalties(batch_size);
+        std::vector<float> diversity_rates(batch_size);
+        std::vector<int>   min_lengths(batch_size);
+        for (size_t i = 0; i < batch_size; i++) {
+            end_ids[i]              = args[i].end_id;
+            temperatures[i]         = args[i].temperature;
+            len_penalties[i]        = args[i].len_penalty;
+            repetition_penalties[i] = args[i].repetition_penalty;
+            diversity_rates[i]      = args[i].diversity_rate;
+            min_lengths[i]          = args[i].min_length;
+        }
+        const std::string penalty_name =
+            repetition_penalty_type == RepetitionPenaltyType::Additive ? "presence_penalty" : "repetition_penalty";
+        TensorMap runtime_args(
+            {{"temperature", Tensor{MEMORY_CPU, TYPE_FP32, {batch_size}, temperatures.data()}},
+             {"len_penalty", Tensor{MEMORY_CPU, TYPE_FP32, {batch_size}, len_penalties.data()}},
+             {penalty_name, Tensor{MEMORY_CPU, TYPE_FP32, {batch_size}, repetition_penalties.data()}},
+             {"beam_search_diversity_rate", Tensor{MEMORY_CPU, TYPE_FP32, {batch_size}, diversity_rates.data()}},
+             {"min_length", Tensor{MEMORY_CPU, TYPE_INT32, {batch_size}, min_lengths.data()}}});
+        if (!without_setup) {
+            decode_layer.setup(batch_size, beam_width, &runtime_args);
+        }
+
+        // Host state, shared by the reference and the device buffers.
+        std::mt19937                          gen(0);
+        std::uniform_real_distribution<float> logit_dist(-3.0f, 3.0f);
+        std::uniform_int_distribution<int>    token_dist(0, vocab_size - 1);
+
+        std::vector<int>   h_output_ids(max_seq_len * batchxbeam, 0);
+        std::vector<int>   h_parent_ids(max_seq_len * batchxbeam, 0);
+        std::vector<int>   h_input_lengths(batchxbeam, max_input_len);
+        std::vector<int>   h_sequence_lengths(batchxbeam, max_input_len);
+        std::vector<float> h_cum_log_probs(batchxbeam);
+        std::vector<float> h_output_log_probs(max_seq_len * batchxbeam, 0.0f);
+
+        std::unique_ptr<bool[]> h_finished(new bool[batchxbeam]);
+        std::fill(h_finished.get(), h_finished.get() + batchxbeam, false);
+        for (size_t i = 0; i < batchxbeam; i++) {
+            h_cum_log_probs[i] = i % beam_width == 0 ? 0.0f : -1e20f;
+        }
+        for (int step = 0; step < max_input_len; step++) {
+            for (size_t b = 0; b < batch_size; b++) {
+                const int token_id = token_dist(gen);
+                for (size_t k = 0; k < beam_width; k++) {
+                    h_output_ids[step * batchxbeam + b * beam_width + k] = token_id;
+                }
+            }
+        }
+
+        float* d_logits = reinterpret_cast<float*>(allocator->malloc(sizeof(float) * batchxbeam * vocab_size_pad));
+        int*   d_end_ids          = reinterpret_cast<int*>(allocator->malloc(sizeof(int) * batch_size));
+        int*   d_input_lengths    = reinterpret_cast<int*>(allocator->malloc(sizeof(int) * batchxbeam));
+        int*   d_output_ids       = reinterpret_cast<int*>(allocator->malloc(sizeof(int) * max_seq_len * batchxbeam));
+        int*   d_parent_ids       = reinterpret_cast<int*>(allocator->malloc(sizeof(int) * max_seq_len * batchxbeam));
+        int*   d_sequence_lengths = reinterpret_cast<int*>(allocator->malloc(sizeof(int) * batchxbeam));
+        bool*  d_finished         = reinterpret_cast<bool*>(allocator->malloc(sizeof(bool) * batchxbeam));
+        float* d_cum_log_probs    = reinterpret_cast<float*>(allocator->malloc(sizeof(float) * batchxbeam));
+        float* d_output_log_probs =
+            reinterpret_cast<float*>(allocator->malloc(sizeof(float) * max_seq_len * batchxbeam));
+        int* d_cache_indirections[2];
+        for (int i = 0; i < 2; i++) {
+            d_cache_indirections[i] =
+                reinterpret_cast<int*>(allocator->malloc(sizeof(int) * batchxbeam * max_seq_len, true));
+        }
+        cudaH2Dcpy(d_end_ids, end_ids.data(), batch_size);
+        cudaH2Dcpy(d_input_lengths, h_input_lengths.data(), batchxbeam);
+        cudaH2Dcpy(d_output_ids, h_output_ids.data(), max_seq_len * batchxbeam);
+        cudaH2Dcpy(d_parent_ids, h_parent_ids.data(), max_seq_len * batchxbeam);
+        cudaH2Dcpy(d_sequence_lengths, h_sequence_lengths.data(), batchxbeam);
+        cudaH2Dcpy(d_finished, h_finished.get(), batchxbeam);
+        cudaH2Dcpy(d_cum_log_probs, h_cum_log_probs.data(), batchxbeam);
+        cudaH2Dcpy(d_output_log_probs, h_output_log_probs.data(), max_seq_len * batchxbeam);
+
+        std::vector<float> h_logits(batchxbeam * vocab_size_pad);
+        std::vector<int>   output_ids(max_seq_len * batchxbeam);
+        std::vector<int>   parent_ids(max_seq_len * batchxbeam);
+        std::vector<int>   sequence_lengths(batchxbeam);
+        std::vector<float> cum_log_probs(batchxbeam);
+
+        std::unique_ptr<bool[]> finished(new bool[batchxbeam]);
+
+        const uint            ite              = 0;
+        const int             local_batch_size = batch_size;
+        std::vector<uint64_t> random_seeds(batch_size, 0);
+        bool                  is_initialize_random_table = true;
+        for (int step = max_input_len; step < (int)max_seq_len; step++) {
+            for (float& logit : h_logits) {
+                logit = logit_dist(gen);
+            }
+            // Make some requests end early, so that finished beams are covered.
+            for (size_t i = 0; i < batchxbeam; i++) {
+                h_logits[i * vocab_size_pad + end_ids[i / beam_width]] += step % 3 == 0 ? 2.0f : 0.0f;
+            }
+            cudaH2Dcpy(d_logits, h_logits.data(), batchxbeam * vocab_size_pad);
+
+            TensorMap input_tensors(
+                {{"logits", Tensor{MEMORY_GPU, TYPE_FP32, {batch_size, beam_width, vocab_size_pad}, d_logits}},
+                 {"step", Tensor{MEMORY_CPU, TYPE_INT32, {1}, &step}},
+                 {"max_input_length", Tensor{MEMORY_CPU, TYPE_INT32, {1}, &max_input_len}},
+                 {"input_lengths", Tensor{MEMORY_GPU, TYPE_INT32, {batch_size, beam_width}, d_input_lengths}},
+                 {"end_id", Tensor{MEMORY_GPU, TYPE_INT32, {batch_size}, d_end_ids}},
+                 {"ite", Tensor{MEMORY_CPU, TYPE_UINT32, {1}, &ite}},
+                 {"local_batch_size", Tensor{MEMORY_CPU, TYPE_INT32, {1}, &local_batch_size}},
+                 {"src_cache_indirection",
+                  Tensor{MEMORY_GPU,
+                         TYPE_INT32,
+                         {batch_size, beam_width, max_seq_len},
+                         d_cache_indirections[step % 2]}}});
+            TensorMap output_tensors(
+                {{"output_ids", Tensor{MEMORY_GPU, TYPE_INT32, {max_seq_len, batch_size, beam_width}, d_output_ids}},
+                 {"parent_ids", Tensor{MEMORY_GPU, TYPE_INT32, {max_seq_len, batch_size, beam_width}, d_parent_ids}},
+                 {"sequence_length", Tensor{MEMORY_GPU, TYPE_INT32, {batchxbeam}, d_sequence_lengths}},
+                 {"finished", Tensor{MEMORY_GPU, TYPE_BOOL, {batchxbeam}, d_finished}},
+                 {"cum_log_probs", Tensor{MEMORY_GPU, TYPE_FP32, {batchxbeam}, d_cum_log_probs}},
+                 {"output_log_probs",
+                  Tensor{MEMORY_GPU, TYPE_FP32, {max_seq_len, batch_size, beam_width}, d_output_log_probs}},
+                 {"tgt_cache_indirection",
+                  Tensor{MEMORY_GPU,
+                         TYPE_INT32,
+                         {batch_size, beam_width, max_seq_len},
+                         d_cache_indirections[(step + 1) % 2]}}});
+            if (with_request_inputs) {
+                for (auto& kv : runtime_args) {
+                    input_tensors.insert(kv.first, kv.second);
+                }
+                input_tensors.insert("random_seed", Tensor{MEMORY_CPU, TYPE_UINT64, {batch_size}, random_seeds.data()});
+                input_tensors.insert("is_initialize_random_table",
+                                     Tensor{MEMORY_CPU, TYPE_BOOL, {1}, &is_initialize_random_table});
+                // An optional input the request left empty.
+                input_tensors.insert({"embedding_bias", Tensor{MEMORY_GPU, TYPE_FP32, {vocab_size_pad}, nullptr}});
+            }
+            if (without_setup) {
+                for (auto& kv : runtime_args) {
+                    input_tensors.insert(kv.first, kv.second);
+                }
+                beam_search_layer.forward(&output_tensors, &input_tensors);
+            }
+            else {
+                decode_layer.forward(&output_tensors, &input_tensors);
+            }
+
+            beamSearchStepReference(h_logits.data(),
+                                    (const float*)nullptr,
+                                    args,
+                                    repetition_penalty_type,
+                                    h_input_lengths.data(),
+                                    h_output_ids.data(),
+                                    h_parent_ids.data(),
+                                    h_sequence_lengths.data(),
+                                    h_finished.get(),
+                                    h_cum_log_probs.data(),
+                                    h_output_log_probs.data(),
+                                    step,
+                                    max_input_len,
+                                    ite,
+                                    local_batch_size,
+                                    batch_size,
+                                    beam_width,
+                                    vocab_size,
+                                    vocab_size_pad);
+
+            cudaD2Hcpy(output_ids.data(), d_output_ids, max_seq_len * batchxbeam);
+            cudaD2Hcpy(parent_ids.data(), d_parent_ids, max_seq_len * batchxbeam);
+            cudaD2Hcpy(sequence_lengths.data(), d_sequence_lengths, batchxbeam);
+            cudaD2Hcpy(cum_log_probs.data(), d_cum_log_probs, batchxbeam);
+            cudaD2Hcpy(finished.get(), d_finished, batchxbeam);
+            for (size_t i = 0; i < batchxbeam; i++) {
+                const size_t idx = step * batchxbeam + i;
+                EXPECT_EQ(output_ids[idx], h_output_ids[idx]) << "step " << step << ", beam " << i;
+                EXPECT_EQ(parent_ids[idx], h_parent_ids[idx]) << "step " << step << ", beam " << i;
+                EXPECT_EQ(sequence_lengths[i], h_sequence_lengths[i]) << "step " << step << ", beam " << i;
+                EXPECT_EQ(finished[i], h_finished[i]) << "step " << step << ", beam " << i;
+                EXPECT_NEAR(cum_log_probs[i], h_cum_log_probs[i], 1e-4f) << "step " << step << ", beam " << i;
+            }
+            // Continue from the device state, so that a mismatch does not cascade to the next steps.
+            h_output_ids       = output_ids;
+            h_parent_ids       = parent_ids;
+            h_sequence_lengths = sequence_lengths;
+            h_cum_log_probs    = cum_log_probs;
+            std::copy(finished.get(), finished.get() + batchxbeam, h_finished.get());
+        }
+    }
+};
+
+TEST_F(BeamSearchDecodeTest, SameArgs)
+{
+    std::vector<BeamSearchRequestArgs> args(batch_size);
+    for (BeamSearchRequestArgs& arg : args) {
+        arg.end_id = 1;
+    }
+    runTest(args, RepetitionPenaltyType::None);
+}
+
+TEST_F(BeamSearchDecodeTest, BatchArgs)
+{
+    std::vector<BeamSearchRequestArgs> args(batch_size);
+    args[0].end_id             = 1;
+    args[1].end_id             = 2;
+    args[1].temperature        = 0.5f;
+    args[1].len_penalty        = 1.0f;
+    args[2].end_id             = 3;
+    args[2].repetition_penalty = 2.0f;
+    args[2].min_length         = 4;
+    args[3].end_id             = 4;
+    args[3].temperature        = 2.0f;
+    args[3].diversity_rate     = -0.5f;
+    args[3].min_length         = 2;
+    runTest(args, RepetitionPenaltyType::Multiplicative);
+}
+
+TEST_F(BeamSearchDecodeTest, BatchPresencePenalty)
+{
+    std::vector<BeamSearchRequestArgs> args(batch_size);
+    for (size_t i = 0; i < batch_size; i++) {
+        args[i].end_id             = i;
+        args[i].repetition_penalty = 0.5f * i;
+        args[i].len_penalty        = 0.5f * i;
+    }
+    runTest(args, RepetitionPenaltyType::Additive);
+}
+
+TEST_F(BeamSearchDecodeTest, RequestInputs)
+{
+    std::vector<BeamSearchRequestArgs> args(batch_size);
+    for (size_t i = 0; i < batch_size; i++) {
+        args[i].end_id      = i;
+        args[i].temperature = 1.0f + 0.5f * i;
+        args[i].min_length  = i;
+    }
+    runTest(args, RepetitionPenaltyType::Multiplicative, true);
+}
+
+TEST_F(BeamSearchDecodeTest, ForwardWithoutSetup)
+{
+    std::vector<BeamSearchRequestArgs> args(batch_size);
+    for (size_t i = 0; i < batch_size; i++) {
+        args[i].end_id             = i;
+        args[i].temperature        = 1.0f + 0.5f * i;
+        args[i].repetition_penalty = 1.0f + 0.5f * i;
+        args[i].min_length         = i;
+    }
+    runTest(args, RepetitionPenaltyType::Multiplicative, false, true);
+}
+
+}  // end of namespace
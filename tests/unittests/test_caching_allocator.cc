@@ -0,0 +1,149 @@
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "src/fastertransformer/utils/caching_allocator.h"
+
+using namespace fastertransformer;
+
+namespace {
+
+cudaStream_t fakeStream(size_t id)
+{
+    return reinterpret_cast<cudaStream_t>(id);
+}
+
+TEST(CachingAllocatorTest, RoundsToSizeClasses)
+{
+    EXPECT_EQ(CachingAllocator::roundSize(1), 512u);
+    EXPECT_EQ(CachingAllocator::roundSize(512), 512u);
+    EXPECT_EQ(CachingAllocator::roundSize(513), 640u);
+    EXPECT_EQ(CachingAllocator::roundSize(1025), 1280u);
+    EXPECT_EQ(CachingAllocator::roundSize(3000), 3072u);
+    EXPECT_EQ(CachingAllocator::roundSize((size_t)16 << 20), (size_t)16 << 20);
+    EXPECT_EQ(CachingAllocator::roundSize(((size_t)16 << 20) + 1), (size_t)18 << 20);
+    for (size_t size = 1; size < ((size_t)1 << 22); size = size * 3 / 2 + 1) {
+        const size_t rounded = CachingAllocator::roundSize(size);
+        EXPECT_GE(rounded, size);
+        EXPECT_LE(rounded, std::max<size_t>(512, size + size / 4 + 1)) << size;
+    }
+}
+
+TEST(CachingAllocatorTest, ReusesBlocksOnlyOnTheirStream)
+{
+    HostBlockBackend backend;
+    CachingAllocator allocator(&backend);
+
+    void* a = allocator.malloc(3000, fakeStream(1));
+    allocator.free(a, fakeStream(1));
+    EXPECT_EQ(allocator.getStats().cached_bytes, 3072u);
+
+    // another stream gets a new block, the same stream gets the cached one
+    void* b = allocator.malloc(1000, fakeStream(2));
+    EXPECT_NE(a, b);
+    void* c = allocator.malloc(2900, fakeStream(1));
+    EXPECT_EQ(a, c);
+    EXPECT_EQ(allocator.getSize(c), 2900u);
+
+    // a much larger cached block is not used for a small request
+    allocator.free(c, fakeStream(1));
+    void* d = allocator.malloc(100, fakeStream(1));
+    EXPECT_NE(a, d);
+
+    CachingAllocatorStats stats = allocator.getStats();
+    EXPECT_EQ(stats.num_allocs, 4u);
+    EXPECT_EQ(stats.num_cache_hits, 1u);
+    EXPECT_EQ(stats.num_backend_allocs, 3u);
+    EXPECT_EQ(backend.getUsedBytes(), stats.reserved_bytes);
+    allocator.free(b, fakeStream(2));
+    allocator.free(d, fakeStream(1));
+}
+
+TEST(CachingAllocatorTest, TracksPeaksAndFragmentation)
+{
+    HostBlockBackend backend;
+    CachingAllocator allocator(&backend);
+
+    std::vector<void*> ptrs;
+    for (int i = 0; i < 4; i++) {
+        ptrs.push_back(allocator.malloc(768, nullptr));
+    }
+    CachingAllocatorStats stats = allocator.getStats();
+    EXPECT_EQ(stats.allocated_bytes, 4u * 768);
+    EXPECT_EQ(stats.reserved_bytes, 4u * 768);
+    EXPECT_FLOAT_EQ(stats.getFragmentation(), 0.0f);
+
+    for (void* ptr : ptrs) {
+        allocator.free(ptr, nullptr);
+    }
+    stats = allocator.getStats();
+    EXPECT_EQ(stats.allocated_bytes, 0u);
+    EXPECT_EQ(stats.cached_bytes, 4u * 768);
+    EXPECT_EQ(stats.peak_allocated_bytes, 4u * 768);
+    EXPECT_FLOAT_EQ(stats.getFragmentation(), 1.0f);
+
+    allocator.resetPeakStats();
+    void* ptr = allocator.malloc(700, nullptr);
+    stats     = allocator.getStats();
+    EXPECT_EQ(stats.peak_allocated_bytes, 700u);
+    EXPECT_EQ(stats.peak_reserved_bytes, 4u * 768);
+    allocator.free(ptr, nullptr);
+}
+
+TEST(CachingAllocatorTest, TrimReleasesTheLargestBlocksFirst)
+{
+    HostBlockBackend backend;
+    {
+        CachingAllocator allocator(&backend);
+        void*            small = allocator.malloc(512, fakeStream(1));
+        void*            large = allocator.malloc(4096, fakeStream(2));
+        void*            live  = allocator.malloc(2048, fakeStream(1));
+        allocator.free(small, fakeStream(1));
+        allocator.free(large, fakeStream(2));
+
+        EXPECT_EQ(allocator.trim(1024), 4096u);
+        EXPECT_EQ(allocator.getStats().cached_bytes, 512u);
+        EXPECT_EQ(backend.getUsedBytes(), 512u + 2048);
+        EXPECT_EQ(allocator.trim(), 512u);
+        EXPECT_EQ(backend.getUsedBytes(), 2048u);
+        EXPECT_TRUE(allocator.isExist(live));
+    }
+    // the destructor releases the live blocks
+    EXPECT_EQ(backend.getUsedBytes(), 0u);
+}
+
+TEST(CachingAllocatorTest, ReleasesTheCacheWhenOutOfMemory)
+{
+    HostBlockBackend backend(8192);
+    CachingAllocator allocator(&backend);
+
+    void* a = allocator.malloc(4096, fakeStream(1));
+    void* b = allocator.malloc(2048, fakeStream(2));
+    allocator.free(a, fakeStream(1));
+    allocator.free(b, fakeStream(2));
+
+    // does not fit next to the cached blocks, which are on other streams
+    void* c = allocator.malloc(6144, fakeStream(3));
+    EXPECT_NE(c, nullptr);
+    CachingAllocatorStats stats = allocator.getStats();
+    EXPECT_EQ(stats.cached_bytes, 0u);
+    EXPECT_EQ(stats.num_backend_frees, 2u);
+    EXPECT_EQ(backend.getUsedBytes(), 6144u);
+    allocator.free(c, fakeStream(3));
+}
+
+TEST(CachingAllocatorTest, DoesNotCacheWhenDisabled)
+{
+    HostBlockBackend backend;
+    CachingAllocator allocator(&backend, false);
+
+    void* a = allocator.malloc(1000, nullptr);
+    allocator.free(a, nullptr);
+    CachingAllocatorStats stats = allocator.getStats();
+    EXPECT_EQ(stats.cached_bytes, 0u);
+    EXPECT_EQ(stats.reserved_bytes, 0u);
+    EXPECT_EQ(stats.num_backend_frees, 1u);
+    EXPECT_EQ(backend.getUsedBytes(), 0u);
+}
+
+}  // end of namespace
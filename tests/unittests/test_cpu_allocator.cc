@@ -0,0 +1,100 @@
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "src/fastertransformer/utils/allocator.h"
+
+using namespace fastertransformer;
+
+namespace {
+
+TEST(CpuAllocatorTest, ArenaBuffersAreAlignedAndDisjoint)
+{
+    Allocator<AllocatorType::CPU> allocator(CpuAllocatorMode::ARENA, 128, 4096);
+
+    std::vector<char*> ptrs;
+    for (size_t size : {1, 100, 128, 1000, 3000, 5000}) {
+        char* ptr = (char*)allocator.malloc(size);
+        EXPECT_EQ((uintptr_t)ptr % 128, 0u);
+        for (size_t i = 0; i < size; i++) {
+            EXPECT_EQ(ptr[i], 0);
+        }
+        std::memset(ptr, (int)ptrs.size() + 1, size);
+        ptrs.push_back(ptr);
+    }
+    // the buffers do not overlap
+    const size_t sizes[] = {1, 100, 128, 1000, 3000, 5000};
+    for (size_t i = 0; i < ptrs.size(); i++) {
+        for (size_t j = 0; j < sizes[i]; j++) {
+            ASSERT_EQ(ptrs[i][j], (char)(i + 1));
+        }
+    }
+
+    CachingAllocatorStats stats = allocator.getStats();
+    EXPECT_EQ(stats.allocated_bytes, 1u + 100 + 128 + 1000 + 3000 + 5000);
+    EXPECT_EQ(stats.num_allocs, 6u);
+    EXPECT_GT(stats.num_backend_allocs, 1u);
+    EXPECT_GE(stats.reserved_bytes, stats.allocated_bytes);
+}
+
+TEST(CpuAllocatorTest, ArenaResetMergesTheChunks)
+{
+    Allocator<AllocatorType::CPU> allocator(CpuAllocatorMode::ARENA, 64, 1024);
+
+    for (int round = 0; round < 3; round++) {
+        void* ptrs[8];
+        for (int i = 0; i < 8; i++) {
+            ptrs[i] = allocator.malloc(512, false);
+        }
+        for (int i = 0; i < 8; i++) {
+            allocator.free(&ptrs[i]);
+            EXPECT_EQ(ptrs[i], nullptr);
+        }
+        EXPECT_EQ(allocator.getStats().allocated_bytes, 0u);
+        allocator.reset();
+    }
+    // only the first round had to grow the arena, with 4 chunks merged into one by the first reset
+    CachingAllocatorStats stats = allocator.getStats();
+    EXPECT_EQ(stats.num_backend_allocs, 5u);
+    EXPECT_EQ(stats.reserved_bytes, 4096u);
+    EXPECT_EQ(stats.peak_allocated_bytes, 4096u);
+}
+
+TEST(CpuAllocatorTest, ArenaReMalloc)
+{
+    Allocator<AllocatorType::CPU> allocator(CpuAllocatorMode::ARENA);
+
+    int* buffer = (int*)allocator.reMalloc((int*)nullptr, 64 * sizeof(int), false);
+    buffer[0]   = 7;
+    EXPECT_EQ(allocator.reMalloc(buffer, 64 * sizeof(int), false), buffer);
+    EXPECT_EQ(buffer[0], 7);
+    int* larger = (int*)allocator.reMalloc(buffer, 128 * sizeof(int), true);
+    EXPECT_NE(larger, buffer);
+    EXPECT_EQ(larger[127], 0);
+}
+
+TEST(CpuAllocatorTest, PinnedPoolReusesTheBuffers)
+{
+    Allocator<AllocatorType::CPU> allocator(CpuAllocatorMode::PINNED_POOL);
+
+    void* a = allocator.malloc(10000, false);
+    EXPECT_EQ((uintptr_t)a % 64, 0u);
+    allocator.free(&a);
+    void* b = allocator.malloc(9000, false);
+    void* c = allocator.malloc(9000, false);
+
+    CachingAllocatorStats stats = allocator.getStats();
+    EXPECT_EQ(stats.num_allocs, 3u);
+    EXPECT_EQ(stats.num_cache_hits, 1u);
+    EXPECT_EQ(stats.num_backend_allocs, 2u);
+    EXPECT_EQ(stats.allocated_bytes, 18000u);
+
+    allocator.free(&b);
+    allocator.free(&c);
+    EXPECT_EQ(allocator.trimCache(), 2 * CachingAllocator::roundSize(10000));
+    EXPECT_EQ(allocator.getStats().reserved_bytes, 0u);
+}
+
+}  // end of namespace
@@ -0,0 +1,332 @@
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "src/fastertransformer/layers/CpuDynamicDecodeLayer.h"
+#include "src/fastertransformer/layers/beam_search_layers/BeamSearchReference.h"
+
+using namespace fastertransformer;
+
+namespace {
+
+std::vector<int> stableTopK(const std::vector<float>& values, int k)
+{
+    std::vector<int> indices(values.size());
+    std::iota(indices.begin(), indices.end(), 0);
+    std::stable_sort(indices.begin(), indices.end(), [&](int a, int b) { return values[a] > values[b]; });
+    indices.resize(std::min(k, (int)values.size()));
+    return indices;
+}
+
+TEST(HostTopKTest, MatchesStableSortForEveryIsa)
+{
+    const int          n = 50257;
+    std::mt19937       gen(7);
+    std::vector<float> values(n);
+    for (int i = 0; i < n; i++) {
+        // few distinct values, so that many ties have to be broken by the lowest index
+        values[i] = (float)(gen() % 512) * 0.125f - 32.0f;
+    }
+    values[123] = -INFINITY;
+
+    std::vector<int> indices;
+    for (HostConvertIsa isa : {HostConvertIsa::SCALAR, HostConvertIsa::AVX2, HostConvertIsa::AVX512}) {
+        for (int k : {1, 7, 64, 1024, n + 5}) {
+            hostTopK(values.data(), n, k, &indices, isa);
+            EXPECT_EQ(indices, stableTopK(values, k)) << getHostConvertIsaName(isa) << " k=" << k;
+        }
+    }
+}
+
+class CpuDynamicDecodeLayerTest: public testing::Test {
+protected:
+    size_t batch_size_        = 4;
+    size_t vocab_size_        = 6;
+    size_t vocab_size_padded_ = 8;
+    int    end_id_            = 0;
+    int    max_input_length_  = 1;
+    size_t max_seq_len_       = 8;
+
+    std::vector<float>    logits_;
+    std::vector<int>      output_ids_;
+    std::vector<int>      sequence_lengths_;
+    std::vector<bool>     finished_;
+    std::vector<float>    cum_log_probs_;
+    std::vector<int>      end_ids_;
+    std::vector<uint32_t> sequence_limit_lengths_;
+
+    void SetUp() override
+    {
+        output_ids_.assign(max_seq_len_ * batch_size_, 1);  // the input is the token 1
+        sequence_lengths_.assign(batch_size_, max_input_length_ - 1);
+        cum_log_probs_.assign(batch_size_, 0.0f);
+        end_ids_.assign(batch_size_, end_id_);
+        sequence_limit_lengths_.assign(batch_size_, (uint32_t)max_seq_len_);
+    }
+
+    // The same probabilities for every request: tokens 1, 2 and 3 are the most likely ones.
+    void setLogits(size_t batch_size)
+    {
+        const float probs[] = {0.01f, 0.4f, 0.3f, 0.2f, 0.09f, 1e-6f};
+        logits_.assign(batch_size * vocab_size_padded_, -INFINITY);
+        for (size_t b = 0; b < batch_size; b++) {
+            for (size_t i = 0; i < vocab_size_; i++) {
+                logits_[b * vocab_size_padded_ + i] = std::log(probs[i]);
+            }
+        }
+    }
+
+    // Runs one step and returns the generated tokens.
+    std::vector<int> runStep(CpuDynamicDecodeLayer<float>* layer, int step, TensorMap extra_inputs = TensorMap())
+    {
+        bool     finished[8];
+        bool     should_stop = false;
+        int      ite         = 0;
+        int      local_batch = (int)batch_size_;
+        std::copy(finished_.begin(), finished_.end(), finished);
+        TensorMap input_tensors(
+            {{"logits", Tensor{MEMORY_CPU, TYPE_FP32, {batch_size_, 1, vocab_size_padded_}, logits_.data()}},
+             {"step", Tensor{MEMORY_CPU, TYPE_INT32, {1}, &step}},
+             {"max_input_length", Tensor{MEMORY_CPU, TYPE_INT32, {1}, &max_input_length_}},
+             {"end_id", Tensor{MEMORY_CPU, TYPE_INT32, {batch_size_}, end_ids_.data()}},
+             {"sequence_limit_length",
+              Tensor{MEMORY_CPU, TYPE_UINT32, {batch_size_}, sequence_limit_lengths_.data()}},
+             {"ite", Tensor{MEMORY_CPU, TYPE_INT32, {1}, &ite}},
+             {"local_batch_size", Tensor{MEMORY_CPU, TYPE_INT32, {1}, &local_batch}}});
+        for (auto& key : extra_inputs.keys()) {
+            input_tensors.insert(key, extra_inputs.at(key));
+        }
+        TensorMap output_tensors(
+            {{"output_ids", Tensor{MEMORY_CPU, TYPE_INT32, {max_seq_len_, batch_size_}, output_ids_.data()}},
+             {"finished", Tensor{MEMORY_CPU, TYPE_BOOL, {batch_size_}, finished}},
+             {"sequence_length", Tensor{MEMORY_CPU, TYPE_INT32, {batch_size_}, sequence_lengths_.data()}},
+             {"cum_log_probs", Tensor{MEMORY_CPU, TYPE_FP32, {batch_size_}, cum_log_probs_.data()}},
+             {"should_stop", Tensor{MEMORY_CPU, TYPE_BOOL, {1}, &should_stop}}});
+        layer->forward(&output_tensors, &input_tensors);
+        finished_.assign(finished, finished + batch_size_);
+        should_stop_ = should_stop;
+        return std::vector<int>(output_ids_.begin() + step * batch_size_,
+                                output_ids_.begin() + (step + 1) * batch_size_);
+    }
+
+    bool should_stop_ = false;
+};
+
+TEST_F(CpuDynamicDecodeLayerTest, TopKAndTopPStayInTheirCandidates)
+{
+    // request 0: greedy, 1: top-2, 2: top-p 0.5 -> {1, 2}, 3: top-3 with top-p 0.5 -> {1, 2}
+    uint  top_ks[] = {1, 2, 0, 3};
+    float top_ps[] = {0.0f, 0.0f, 0.5f, 0.5f};
+    std::vector<std::vector<int>> allowed = {{1}, {1, 2}, {1, 2}, {1, 2}};
+
+    CpuDynamicDecodeLayer<float> layer(vocab_size_, vocab_size_padded_, 2);
+    for (unsigned long long seed = 0; seed < 20; seed++) {
+        TensorMap runtime_args({{"runtime_top_k", Tensor{MEMORY_CPU, TYPE_UINT32, {batch_size_}, top_ks}},
+                                {"runtime_top_p", Tensor{MEMORY_CPU, TYPE_FP32, {batch_size_}, top_ps}},
+                                {"random_seed", Tensor{MEMORY_CPU, TYPE_UINT64, {1}, &seed}}});
+        layer.setup(batch_size_, 1, &runtime_args);
+        SetUp();
+        finished_.assign(batch_size_, false);
+        setLogits(batch_size_);
+        std::vector<int> ids = runStep(&layer, max_input_length_);
+        for (size_t b = 0; b < batch_size_; b++) {
+            EXPECT_NE(std::find(allowed[b].begin(), allowed[b].end(), ids[b]), allowed[b].end())
+                << "request " << b << " sampled " << ids[b];
+            EXPECT_EQ(sequence_lengths_[b], max_input_length_);
+        }
+        EXPECT_NEAR(cum_log_probs_[0], std::log(0.4f), 1e-5f);
+    }
+}
+
+TEST_F(CpuDynamicDecodeLayerTest, PenaltiesAndStopCriteria)
+{
+    uint  top_k      = 1;
+    int   min_length = 2;
+    float presence   = 10.0f;
+    // The inputs are [1, 1] and token 2 is banned, so greedy search picks 3, then 4 as 3 is penalized too.
+    int bad_words[] = {2, -1, 1, -1};
+    // request 2 stops after 2 tokens, request 3 stops on [3, 4]
+    std::vector<int> stop_words(batch_size_ * 2 * 2, -1);
+    stop_words[3 * 4 + 0] = 3;
+    stop_words[3 * 4 + 1] = 4;
+    stop_words[3 * 4 + 2] = 2;
+
+    max_input_length_ = 2;
+    SetUp();
+    sequence_limit_lengths_[2] = 3;
+    finished_.assign(batch_size_, false);
+    CpuDynamicDecodeLayer<float> layer(vocab_size_, vocab_size_padded_, 3);
+    TensorMap runtime_args({{"runtime_top_k", Tensor{MEMORY_CPU, TYPE_UINT32, {1}, &top_k}},
+                            {"min_length", Tensor{MEMORY_CPU, TYPE_INT32, {1}, &min_length}},
+                            {"presence_penalty", Tensor{MEMORY_CPU, TYPE_FP32, {1}, &presence}}});
+    layer.setup(batch_size_, 1, &runtime_args);
+    TensorMap extra({{"bad_words_list", Tensor{MEMORY_CPU, TYPE_INT32, {2, 2}, bad_words}},
+                     {"stop_words_list", Tensor{MEMORY_CPU, TYPE_INT32, {batch_size_, 2, 2}, stop_words.data()}}});
+
+    // end_id is more likely than the remaining tokens, but banned until min_length tokens are generated.
+    auto set_logits = [&]() {
+        setLogits(batch_size_);
+        for (size_t b = 0; b < batch_size_; b++) {
+            logits_[b * vocab_size_padded_ + end_id_] = std::log(0.05f);
+        }
+    };
+    set_logits();
+    EXPECT_EQ(runStep(&layer, 2, extra), std::vector<int>(batch_size_, 3));
+    EXPECT_FALSE(should_stop_);
+    set_logits();
+    EXPECT_EQ(runStep(&layer, 3, extra), std::vector<int>(batch_size_, 4));
+    EXPECT_EQ(finished_, std::vector<bool>({false, false, true, true}));
+    EXPECT_FALSE(should_stop_);
+
+    set_logits();
+    EXPECT_EQ(runStep(&layer, 4, extra), std::vector<int>(batch_size_, end_id_));
+    EXPECT_EQ(finished_, std::vector<bool>(batch_size_, true));
+    EXPECT_TRUE(should_stop_);
+    EXPECT_EQ(sequence_lengths_, std::vector<int>({4, 4, 3, 3}));
+}
+
+TEST(CpuDynamicDecodeLayerDeterminismTest, DoesNotDependOnTheNumberOfThreads)
+{
+    const size_t batch_size = 8, vocab_size = 50257, vocab_size_padded = 50264, max_seq_len = 6;
+    int          max_input_length = 1, ite = 0, local_batch_size = (int)batch_size;
+
+    std::vector<uint>               top_ks = {0, 1, 4, 40, 0, 0, 1024, 2};
+    std::vector<float>              top_ps = {0.9f, 0.0f, 0.0f, 0.8f, 0.3f, 1.0f, 0.95f, 0.5f};
+    std::vector<unsigned long long> seeds  = {1, 2, 3, 4, 5, 6, 7, 8};
+    std::vector<float>              temperatures(batch_size, 0.7f);
+    std::vector<int>                end_ids(batch_size, 50256);
+
+    std::vector<std::vector<int>>   all_ids;
+    std::vector<std::vector<float>> all_log_probs;
+    for (int num_threads : {1, 4}) {
+        CpuDynamicDecodeLayer<float> layer(vocab_size, vocab_size_padded, num_threads);
+        TensorMap runtime_args({{"runtime_top_k", Tensor{MEMORY_CPU, TYPE_UINT32, {batch_size}, top_ks.data()}},
+                                {"runtime_top_p", Tensor{MEMORY_CPU, TYPE_FP32, {batch_size}, top_ps.data()}},
+                                {"temperature", Tensor{MEMORY_CPU, TYPE_FP32, {batch_size}, temperatures.data()}},
+                                {"random_seed", Tensor{MEMORY_CPU, TYPE_UINT64, {batch_size}, seeds.data()}}});
+        layer.setup(batch_size, 1, &runtime_args);
+
+        std::mt19937       gen(11);
+        std::normal_distribution<float> dist(0.0f, 3.0f);
+        std::vector<float> logits(batch_size * vocab_size_padded);
+        std::vector<int>   output_ids(max_seq_len * batch_size, 0);
+        std::vector<float> cum_log_probs(batch_size, 0.0f);
+        std::vector<float> output_log_probs((max_seq_len - max_input_length) * batch_size, 0.0f);
+        for (int step = max_input_length; step < (int)max_seq_len; step++) {
+            for (float& logit : logits) {
+                logit = dist(gen);
+            }
+            TensorMap input_tensors(
+                {{"logits", Tensor{MEMORY_CPU, TYPE_FP32, {batch_size, 1, vocab_size_padded}, logits.data()}},
+                 {"step", Tensor{MEMORY_CPU, TYPE_INT32, {1}, &step}},
+                 {"max_input_length", Tensor{MEMORY_CPU, TYPE_INT32, {1}, &max_input_length}},
+                 {"end_id", Tensor{MEMORY_CPU, TYPE_INT32, {batch_size}, end_ids.data()}},
+                 {"ite", Tensor{MEMORY_CPU, TYPE_INT32, {1}, &ite}},
+                 {"local_batch_size", Tensor{MEMORY_CPU, TYPE_INT32, {1}, &local_batch_size}}});
+            TensorMap output_tensors(
+                {{"output_ids", Tensor{MEMORY_CPU, TYPE_INT32, {max_seq_len, batch_size}, output_ids.data()}},
+                 {"cum_log_probs", Tensor{MEMORY_CPU, TYPE_FP32, {batch_size}, cum_log_probs.data()}},
+                 {"output_log_probs",
+                  Tensor{MEMORY_CPU,
+                         TYPE_FP32,
+                         {max_seq_len - max_input_length, batch_size},
+                         output_log_probs.data()}}});
+            layer.forward(&output_tensors, &input_tensors);
+        }
+        for (size_t b = 0; b < batch_size; b++) {
+            EXPECT_LE(cum_log_probs[b], 0.0f);
+        }
+        all_ids.push_back(output_ids);
+        all_log_probs.push_back(output_log_probs);
+    }
+    EXPECT_EQ(all_ids[0], all_ids[1]);
+    EXPECT_EQ(all_log_probs[0], all_log_probs[1]);
+}
+
+TEST(CpuDynamicDecodeLayerBeamSearchTest, MatchesTheReference)
+{
+    const size_t batch_size = 2, beam_width = 2, vocab_size = 11, vocab_size_padded = 12, max_seq_len = 5;
+    const size_t bbsize = batch_size * beam_width;
+    int          max_input_length = 1, ite = 0, local_batch_size = (int)batch_size;
+    float        len_penalty[] = {0.0f, 1.0f};
+    std::vector<int> end_ids(batch_size, 0);
+
+    CpuDynamicDecodeLayer<float> layer(vocab_size, vocab_size_padded, 2);
+    TensorMap runtime_args({{"len_penalty", Tensor{MEMORY_CPU, TYPE_FP32, {batch_size}, len_penalty}}});
+    layer.setup(batch_size, beam_width, &runtime_args);
+
+    std::vector<int>   output_ids(max_seq_len * bbsize, 1), ref_output_ids(max_seq_len * bbsize, 1);
+    std::vector<int>   parent_ids(max_seq_len * bbsize, 0), ref_parent_ids(max_seq_len * bbsize, 0);
+    std::vector<int>   sequence_lengths(bbsize, 0), ref_sequence_lengths(bbsize, 0);
+    std::vector<float> cum_log_probs = {0.0f, -1e20f, 0.0f, -1e20f}, ref_cum_log_probs = cum_log_probs;
+    bool               finished[bbsize] = {}, ref_finished[bbsize] = {};
+    std::vector<int>   src_indir(bbsize * max_seq_len, 0), tgt_indir(bbsize * max_seq_len, 0);
+
+    std::mt19937                    gen(3);
+    std::normal_distribution<float> dist;
+    std::vector<float>              logits(bbsize * vocab_size_padded), ref_logits;
+    std::vector<BeamSearchRequestArgs> ref_args(batch_size);
+    for (size_t b = 0; b < batch_size; b++) {
+        ref_args[b].end_id      = end_ids[b];
+        ref_args[b].len_penalty = len_penalty[b];
+    }
+    for (int step = max_input_length; step < (int)max_seq_len; step++) {
+        for (float& logit : logits) {
+            logit = dist(gen);
+        }
+        ref_logits = logits;
+        TensorMap input_tensors(
+            {{"logits", Tensor{MEMORY_CPU, TYPE_FP32, {batch_size, beam_width, vocab_size_padded}, logits.data()}},
+             {"step", Tensor{MEMORY_CPU, TYPE_INT32, {1}, &step}},
+             {"max_input_length", Tensor{MEMORY_CPU, TYPE_INT32, {1}, &max_input_length}},
+             {"end_id", Tensor{MEMORY_CPU, TYPE_INT32, {batch_size}, end_ids.data()}},
+             {"ite", Tensor{MEMORY_CPU, TYPE_INT32, {1}, &ite}},
+             {"local_batch_size", Tensor{MEMORY_CPU, TYPE_INT32, {1}, &local_batch_size}},
+             {"src_cache_indirection",
+              Tensor{MEMORY_CPU, TYPE_INT32, {batch_size, beam_width, max_seq_len}, src_indir.data()}}});
+        TensorMap output_tensors(
+            {{"output_ids", Tensor{MEMORY_CPU, TYPE_INT32, {max_seq_len, bbsize}, output_ids.data()}},
+             {"parent_ids", Tensor{MEMORY_CPU, TYPE_INT32, {max_seq_len, bbsize}, parent_ids.data()}},
+             {"sequence_length", Tensor{MEMORY_CPU, TYPE_INT32, {bbsize}, sequence_lengths.data()}},
+             {"finished", Tensor{MEMORY_CPU, TYPE_BOOL, {bbsize}, finished}},
+             {"cum_log_probs", Tensor{MEMORY_CPU, TYPE_FP32, {bbsize}, cum_log_probs.data()}},
+             {"tgt_cache_indirection",
+              Tensor{MEMORY_CPU, TYPE_INT32, {batch_size, beam_width, max_seq_len}, tgt_indir.data()}}});
+        layer.forward(&output_tensors, &input_tensors);
+
+        beamSearchStepReference(ref_logits.data(),
+                                (const float*)nullptr,
+                                ref_args,
+                                RepetitionPenaltyType::None,
+                                nullptr,
+                                ref_output_ids.data(),
+                                ref_parent_ids.data(),
+                                ref_sequence_lengths.data(),
+                                ref_finished,
+                                ref_cum_log_probs.data(),
+                                nullptr,
+                                step,
+                                max_input_length,
+                                0,
+                                (int)batch_size,
+                                (int)batch_size,
+                                (int)beam_width,
+                                (int)vocab_size,
+                                (int)vocab_size_padded);
+        ASSERT_EQ(output_ids, ref_output_ids) << "step " << step;
+        ASSERT_EQ(parent_ids, ref_parent_ids) << "step " << step;
+        ASSERT_EQ(cum_log_probs, ref_cum_log_probs) << "step " << step;
+        for (size_t bb = 0; bb < bbsize; bb++) {
+            if (!finished[bb]) {
+                EXPECT_EQ(tgt_indir[bb * max_seq_len + step], (int)(bb % beam_width));
+            }
+        }
+        std::swap(src_indir, tgt_indir);
+    }
+}
+
+}  // end of namespace
@@ -0,0 +1,172 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "src/fastertransformer/utils/cublasAlgoMap.h"
+#include "src/fastertransformer/utils/gemm_algo_cache.h"
+
+using namespace fastertransformer;
+
+namespace {
+
+GemmAlgoRecord makeRecord(int data_type, int batch_count, int m, int n, int k, int algo_id)
+{
+    GemmAlgoRecord record;
+    memset(&record, 0, sizeof(record));
+    record.data_type   = data_type;
+    record.batch_count = batch_count;
+    record.m           = m;
+    record.n           = n;
+    record.k           = k;
+    record.algoId      = algo_id;
+    record.stages      = 7;
+    record.exec_time   = 0.5f;
+    return record;
+}
+
+std::vector<GemmAlgoRecord> makeRecords()
+{
+    return {makeRecord(HALF_DATATYPE, 1, 4096, 8, 1024, 21),
+            makeRecord(FLOAT_DATATYPE, 1, 4096, 8, 1024, 1),
+            makeRecord(HALF_DATATYPE, 1, 1024, 8, 4096, 22),
+            makeRecord(HALF_DATATYPE, 1, 4096, 8, 1024, 99),  // duplicated key, ignored
+            makeRecord(HALF_DATATYPE, 16, 64, 128, 64, 23)};
+}
+
+TEST(GemmAlgoCacheTest, SortedLookupKeepsFirstRecordOfAKey)
+{
+    GemmAlgoCache cache(makeRecords());
+    EXPECT_EQ(cache.size(), 4u);
+    for (const GemmAlgoRecord* it = cache.begin(); it + 1 < cache.end(); it++) {
+        EXPECT_TRUE(*it < *(it + 1));
+    }
+    const GemmAlgoRecord* record = cache.find(1, 4096, 8, 1024, HALF_DATATYPE);
+    ASSERT_TRUE(record != nullptr);
+    EXPECT_EQ(record->algoId, 21);
+    EXPECT_EQ(cache.find(1, 4096, 8, 1024, FLOAT_DATATYPE)->algoId, 1);
+    EXPECT_TRUE(cache.find(1, 4096, 8, 1024, BFLOAT16_DATATYPE) == nullptr);
+    EXPECT_TRUE(cache.find(2, 4096, 8, 1024, HALF_DATATYPE) == nullptr);
+    EXPECT_TRUE(cache.find(1, 4096, 16, 1024, HALF_DATATYPE) == nullptr);
+}
+
+TEST(GemmAlgoCacheTest, TextAndBinaryRoundTrip)
+{
+    std::string text_filename   = "/tmp/ft_test_gemm_algo_cache.in";
+    std::string binary_filename = "/tmp/ft_test_gemm_algo_cache.in.bin";
+    GemmAlgoCache cache(makeRecords());
+    ASSERT_TRUE(cache.writeText(text_filename));
+    ASSERT_TRUE(cache.writeBinary(binary_filename));
+
+    std::shared_ptr<GemmAlgoCache> from_text   = GemmAlgoCache::read(text_filename);
+    std::shared_ptr<GemmAlgoCache> from_binary = GemmAlgoCache::read(binary_filename);
+    ASSERT_TRUE(from_text != nullptr);
+    ASSERT_TRUE(from_binary != nullptr);
+    ASSERT_EQ(from_text->size(), cache.size());
+    ASSERT_EQ(from_binary->size(), cache.size());
+    for (size_t i = 0; i < cache.size(); i++) {
+        EXPECT_EQ(memcmp(&cache.begin()[i], &from_binary->begin()[i], sizeof(GemmAlgoRecord)), 0);
+        EXPECT_EQ(from_text->begin()[i].algoId, cache.begin()[i].algoId);
+        EXPECT_EQ(from_text->begin()[i].stages, 7);
+    }
+    EXPECT_TRUE(GemmAlgoCache::readBinary(text_filename) == nullptr);
+    std::remove(text_filename.c_str());
+    std::remove(binary_filename.c_str());
+}
+
+TEST(GemmAlgoCacheTest, AlgoMapsShareTheCacheWrittenNextToTheConfig)
+{
+    std::string config_filename = "/tmp/ft_test_gemm_algo_map.in";
+    std::string cache_filename  = config_filename + GEMM_ALGO_CACHE_SUFFIX;
+    std::remove(cache_filename.c_str());
+    GemmAlgoCache(makeRecords()).writeText(config_filename);
+
+    cublasAlgoMap algo_map(config_filename);
+    cublasAlgoMap copied_map(algo_map);
+    FILE*         fd = fopen(cache_filename.c_str(), "rb");
+    ASSERT_TRUE(fd != NULL);
+    fclose(fd);
+
+    // cublasAlgoMap swaps m and n, as the gemm tests write n before m.
+    EXPECT_TRUE(algo_map.isExist(1, 8, 4096, 1024, HALF_DATATYPE));
+    EXPECT_FALSE(algo_map.isExist(1, 4096, 8, 1024, HALF_DATATYPE));
+    EXPECT_EQ(copied_map.getAlgo(1, 8, 4096, 1024, HALF_DATATYPE).algoId, 21);
+    EXPECT_EQ(copied_map.getAlgo(1, 8, 4096, 1024, HALF_DATATYPE).stages, 7);
+    EXPECT_EQ(copied_map.getAlgo(1, 8, 4096, 512, HALF_DATATYPE).stages, -1);
+
+    // A later process maps the binary cache instead of parsing the text.
+    std::shared_ptr<GemmAlgoCache> cache = GemmAlgoCache::readBinary(cache_filename);
+    ASSERT_TRUE(cache != nullptr);
+    EXPECT_EQ(cache->size(), 4u);
+    std::remove(config_filename.c_str());
+    std::remove(cache_filename.c_str());
+}
+
+TEST(GemmAlgoCacheTest, NearestLookupPrefersTheSmallestLargerShape)
+{
+    GemmAlgoCache cache({makeRecord(HALF_DATATYPE, 1, 16, 3072, 1024, 1),
+                         makeRecord(HALF_DATATYPE, 1, 64, 3072, 1024, 2),
+                         makeRecord(HALF_DATATYPE, 1, 256, 3072, 1024, 3),
+                         makeRecord(HALF_DATATYPE, 1, 32, 3072, 4096, 4),
+                         makeRecord(HALF_DATATYPE, 1, 32, 1024, 1024, 5)});
+    EXPECT_EQ(cache.findNearest(1, 16, 3072, 1024, HALF_DATATYPE)->algoId, 1);
+    EXPECT_EQ(cache.findNearest(1, 1, 3072, 1024, HALF_DATATYPE)->algoId, 1);
+    EXPECT_EQ(cache.findNearest(1, 17, 3072, 1024, HALF_DATATYPE)->algoId, 2);
+    EXPECT_EQ(cache.findNearest(1, 64, 3072, 1024, HALF_DATATYPE)->algoId, 2);
+    EXPECT_EQ(cache.findNearest(1, 200, 3072, 1024, HALF_DATATYPE)->algoId, 3);
+    EXPECT_EQ(cache.findNearest(1, 100000, 3072, 1024, HALF_DATATYPE)->algoId, 3);
+    EXPECT_EQ(cache.findNearest(1, 100000, 3072, 4096, HALF_DATATYPE)->algoId, 4);
+    EXPECT_TRUE(cache.findNearest(1, 16, 3072, 2048, HALF_DATATYPE) == nullptr);
+    EXPECT_TRUE(cache.findNearest(1, 16, 2048, 1024, HALF_DATATYPE) == nullptr);
+    EXPECT_TRUE(cache.findNearest(2, 16, 3072, 1024, HALF_DATATYPE) == nullptr);
+    EXPECT_TRUE(cache.findNearest(1, 16, 3072, 1024, FLOAT_DATATYPE) == nullptr);
+    EXPECT_TRUE(cache.find(1, 17, 3072, 1024, HALF_DATATYPE) == nullptr);
+}
+
+TEST(GemmAlgoCacheTest, AlgoMapCountsExactAndNearestHits)
+{
+    std::string    config_filename = "/tmp/ft_test_gemm_algo_map_nearest.in";
+    GemmAlgoRecord cublas_record   = makeRecord(HALF_DATATYPE, 1, 16, 3072, 4096, 3);
+    cublas_record.stages           = -1;
+    GemmAlgoCache({makeRecord(HALF_DATATYPE, 1, 16, 3072, 1024, 1),
+                   makeRecord(HALF_DATATYPE, 1, 64, 3072, 1024, 2),
+                   cublas_record})
+        .writeText(config_filename);
+
+    cublasLtMatmulAlgo_info info;
+    // The fallback is opt-in.
+    EXPECT_EQ(cublasAlgoMap(config_filename).lookupAlgo(1, 3072, 40, 1024, HALF_DATATYPE, &info, true),
+              cublasAlgoMatch::NONE);
+
+    setenv("FT_GEMM_ALGO_FALLBACK", "ON", 1);
+    cublasAlgoMap algo_map(config_filename);
+    unsetenv("FT_GEMM_ALGO_FALLBACK");
+    EXPECT_EQ(algo_map.lookupAlgo(1, 3072, 16, 1024, HALF_DATATYPE, &info, true), cublasAlgoMatch::EXACT);
+    EXPECT_EQ(info.algoId, 1);
+    EXPECT_EQ(algo_map.lookupAlgo(1, 3072, 40, 1024, HALF_DATATYPE, &info, true), cublasAlgoMatch::NEAREST);
+    EXPECT_EQ(info.algoId, 2);
+    EXPECT_EQ(algo_map.lookupAlgo(1, 3072, 1000, 1024, HALF_DATATYPE, &info, true), cublasAlgoMatch::NEAREST);
+    EXPECT_EQ(info.algoId, 2);
+    // Without allow_nearest, as in getAlgo, only exact shapes match.
+    EXPECT_EQ(algo_map.lookupAlgo(1, 3072, 40, 1024, HALF_DATATYPE, &info), cublasAlgoMatch::NONE);
+    EXPECT_EQ(algo_map.getAlgo(1, 3072, 40, 1024, HALF_DATATYPE).stages, -1);
+    EXPECT_EQ(algo_map.getAlgo(1, 3072, 64, 1024, HALF_DATATYPE).algoId, 2);
+    // A cublasGemmEx algorithm cannot be checked against another shape.
+    EXPECT_EQ(algo_map.lookupAlgo(1, 3072, 40, 4096, HALF_DATATYPE, &info, true), cublasAlgoMatch::NONE);
+    EXPECT_EQ(algo_map.lookupAlgo(1, 3072, 16, 4096, HALF_DATATYPE, &info, true), cublasAlgoMatch::EXACT);
+    EXPECT_EQ(algo_map.lookupAlgo(1, 3072, 40, 512, HALF_DATATYPE, &info, true), cublasAlgoMatch::NONE);
+    EXPECT_EQ(info.stages, -1);
+    EXPECT_FALSE(algo_map.isExist(1, 3072, 40, 1024, HALF_DATATYPE));
+
+    cublasAlgoMapStats stats = algo_map.getStats();
+    EXPECT_EQ(stats.exact_hits, 3u);
+    EXPECT_EQ(stats.nearest_hits, 2u);
+    EXPECT_EQ(stats.misses, 4u);
+    std::remove(config_filename.c_str());
+    std::remove((config_filename + GEMM_ALGO_CACHE_SUFFIX).c_str());
+}
+
+}  // end of namespace
@@ -0,0 +1,244 @@
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "src/fastertransformer/utils/host_convert_utils.h"
+
+using namespace fastertransformer;
+
+namespace {
+
+const HostConvertIsa ALL_ISAS[] = {HostConvertIsa::SCALAR, HostConvertIsa::AVX2, HostConvertIsa::AVX512};
+
+uint32_t floatBits(float f)
+{
+    uint32_t u;
+    memcpy(&u, &f, sizeof(u));
+    return u;
+}
+
+float bitsFloat(uint32_t u)
+{
+    float f;
+    memcpy(&f, &u, sizeof(f));
+    return f;
+}
+
+template<typename T>
+uint16_t bits16(T v)
+{
+    uint16_t u;
+    memcpy(&u, &v, sizeof(u));
+    return u;
+}
+
+template<typename T>
+T fromBits16(uint16_t u)
+{
+    T v;
+    memcpy(&v, &u, sizeof(u));
+    return v;
+}
+
+// Exact value of a finite half, computed independently of the implementation under test.
+double halfValue(uint16_t h)
+{
+    int    e = (h >> 10) & 0x1f;
+    int    m = h & 0x3ff;
+    double v = e == 0 ? std::ldexp((double)m, -24) : std::ldexp((double)(1024 + m), e - 25);
+    return (h & 0x8000) ? -v : v;
+}
+
+// Reference round-to-nearest-even float -> half, by searching the closest representable half.
+uint16_t referenceFloat2Half(float f)
+{
+    if (std::isnan(f)) {
+        return 0x7fff;
+    }
+    uint16_t sign = std::signbit(f) ? 0x8000 : 0;
+    double   a    = std::fabs((double)f);
+    if (a >= 65520.0) {
+        return sign | 0x7c00;
+    }
+    uint16_t lo = 0, hi = 0x7bff;
+    while (lo < hi) {  // largest half <= a
+        uint16_t mid = (uint16_t)((lo + hi + 1) / 2);
+        if (halfValue(mid) <= a) {
+            lo = mid;
+        }
+        else {
+            hi = (uint16_t)(mid - 1);
+        }
+    }
+    if (halfValue(lo) == a) {
+        return sign | lo;
+    }
+    double d_lo = a - halfValue(lo), d_hi = halfValue(lo + 1) - a;
+    if (d_lo < d_hi || (d_lo == d_hi && (lo & 1) == 0)) {
+        return sign | lo;
+    }
+    return sign | (uint16_t)(lo + 1);
+}
+
+uint16_t referenceFloat2Bfloat16(float f)
+{
+    if (std::isnan(f)) {
+        return 0x7fff;
+    }
+    uint32_t u  = floatBits(f);
+    uint16_t lo = (uint16_t)(u >> 16);
+    double   a  = std::fabs((double)f);
+    double   v_lo = std::fabs((double)bitsFloat((uint32_t)lo << 16));
+    uint16_t hi   = (uint16_t)(lo + 1);
+    double   v_hi = ((hi & 0x7f80) == 0x7f80) ? std::ldexp(1.0, 128) : std::fabs((double)bitsFloat((uint32_t)hi << 16));
+    if (a == v_lo) {
+        return lo;
+    }
+    double d_lo = a - v_lo, d_hi = v_hi - a;
+    return (d_lo < d_hi || (d_lo == d_hi && (lo & 1) == 0)) ? lo : hi;
+}
+
+int8_t referenceFloat2Int8(float f)
+{
+    if (std::isnan(f)) {
+        return 0;
+    }
+    double r = std::floor((double)f + 0.5);
+    if (r - (double)f == 0.5 && std::fmod(r, 2.0) != 0.0) {
+        r -= 1.0;
+    }
+    return (int8_t)std::max(-128.0, std::min(127.0, r));
+}
+
+std::vector<float> makeTestFloats()
+{
+    std::vector<float> values = {0.0f,
+                                 -0.0f,
+                                 1.0f,
+                                 -1.0f,
+                                 0.5f,
+                                 1.5f,
+                                 2.5f,
+                                 -2.5f,
+                                 126.5f,
+                                 127.5f,
+                                 -128.5f,
+                                 300.0f,
+                                 65504.0f,
+                                 65519.99f,
+                                 65520.0f,
+                                 1e-8f,
+                                 5.9604645e-8f,
+                                 2.9802322e-8f,
+                                 6.1035156e-5f,
+                                 3.0e38f,
+                                 std::numeric_limits<float>::max(),
+                                 std::numeric_limits<float>::denorm_min(),
+                                 std::numeric_limits<float>::infinity(),
+                                 -std::numeric_limits<float>::infinity(),
+                                 std::numeric_limits<float>::quiet_NaN(),
+                                 bitsFloat(0xffc00001u)};
+    std::mt19937 gen(2023);
+    // uniformly distributed bit patterns cover every exponent, plus values around the half rounding boundaries.
+    std::uniform_int_distribution<uint32_t> bits_dist;
+    std::uniform_real_distribution<float>   small_dist(-200.0f, 200.0f);
+    for (int i = 0; i < 100000; i++) {
+        values.push_back(bitsFloat(bits_dist(gen)));
+        values.push_back(small_dist(gen));
+        values.push_back((float)halfValue((uint16_t)(gen() & 0x7bff)) + (float)halfValue(0x0001) * 0.5f);
+    }
+    return values;
+}
+
+TEST(HostConvertTest, Float2HalfIsRoundToNearestEven)
+{
+    std::vector<float> src = makeTestFloats();
+    for (HostConvertIsa isa : ALL_ISAS) {
+        std::vector<half> dst(src.size());
+        hostCast(dst.data(), src.data(), src.size(), isa);
+        for (size_t i = 0; i < src.size(); i++) {
+            ASSERT_EQ(bits16(dst[i]), referenceFloat2Half(src[i]))
+                << getHostConvertIsaName(isa) << " value " << src[i] << " bits " << floatBits(src[i]);
+        }
+    }
+}
+
+TEST(HostConvertTest, Half2FloatIsExactForEveryHalf)
+{
+    std::vector<half> src(1 << 16);
+    for (uint32_t i = 0; i < src.size(); i++) {
+        src[i] = fromBits16<half>((uint16_t)i);
+    }
+    for (HostConvertIsa isa : ALL_ISAS) {
+        std::vector<float> dst(src.size());
+        hostCast(dst.data(), src.data(), src.size(), isa);
+        for (uint32_t i = 0; i < src.size(); i++) {
+            bool is_nan = (i & 0x7c00) == 0x7c00 && (i & 0x3ff) != 0;
+            bool is_inf = (i & 0x7fff) == 0x7c00;
+            if (is_nan) {
+                ASSERT_EQ(floatBits(dst[i]), 0x7fffffffu) << getHostConvertIsaName(isa);
+            }
+            else if (is_inf) {
+                ASSERT_TRUE(std::isinf(dst[i]));
+            }
+            else {
+                ASSERT_EQ((double)dst[i], halfValue((uint16_t)i)) << getHostConvertIsaName(isa) << " bits " << i;
+            }
+        }
+    }
+}
+
+#ifdef ENABLE_BF16
+TEST(HostConvertTest, Float2Bfloat16IsRoundToNearestEven)
+{
+    std::vector<float> src = makeTestFloats();
+    for (HostConvertIsa isa : ALL_ISAS) {
+        std::vector<__nv_bfloat16> dst(src.size());
+        std::vector<float>         back(src.size());
+        hostCast(dst.data(), src.data(), src.size(), isa);
+        hostCast(back.data(), dst.data(), dst.size(), isa);
+        for (size_t i = 0; i < src.size(); i++) {
+            ASSERT_EQ(bits16(dst[i]), referenceFloat2Bfloat16(src[i])) << getHostConvertIsaName(isa);
+            ASSERT_EQ(floatBits(back[i]), (uint32_t)bits16(dst[i]) << 16);
+        }
+    }
+}
+
+TEST(HostConvertTest, Half2Bfloat16GoesThroughFloat)
+{
+    std::vector<half> src(1 << 16);
+    for (uint32_t i = 0; i < src.size(); i++) {
+        src[i] = fromBits16<half>((uint16_t)i);
+    }
+    std::vector<float> as_float(src.size());
+    hostCast(as_float.data(), src.data(), src.size(), HostConvertIsa::SCALAR);
+    for (HostConvertIsa isa : ALL_ISAS) {
+        std::vector<__nv_bfloat16> dst(src.size());
+        hostCast(dst.data(), src.data(), src.size(), isa);
+        for (size_t i = 0; i < src.size(); i++) {
+            ASSERT_EQ(bits16(dst[i]), referenceFloat2Bfloat16(as_float[i])) << getHostConvertIsaName(isa);
+        }
+    }
+}
+#endif
+
+TEST(HostConvertTest, Float2Int8RoundsAndSaturates)
+{
+    std::vector<float> src = makeTestFloats();
+    for (HostConvertIsa isa : ALL_ISAS) {
+        std::vector<int8_t> dst(src.size());
+        std::vector<float>  back(src.size());
+        hostCast(dst.data(), src.data(), src.size(), isa);
+        hostCast(back.data(), dst.data(), dst.size(), isa);
+        for (size_t i = 0; i < src.size(); i++) {
+            ASSERT_EQ(dst[i], referenceFloat2Int8(src[i])) << getHostConvertIsaName(isa) << " value " << src[i];
+            ASSERT_EQ(back[i], (float)dst[i]);
+        }
+    }
+}
+
+}  // end of namespace
@@ -0,0 +1,49 @@
+#include <atomic>
+#include <stdexcept>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "src/fastertransformer/utils/host_thread_pool.h"
+
+using namespace fastertransformer;
+
+namespace {
+
+TEST(HostThreadPoolTest, RunsEveryTask)
+{
+    for (int num_threads : {1, 4}) {
+        HostThreadPool   pool(num_threads, 2);
+        std::vector<int> loaded(64, 0);
+        std::atomic<int> count{0};
+        for (int l = 0; l < (int)loaded.size(); l++) {
+            pool.submit([&loaded, &count, l]() {
+                loaded[l] = l + 1;
+                count++;
+            });
+        }
+        pool.wait();
+        EXPECT_EQ(count.load(), (int)loaded.size());
+        for (int l = 0; l < (int)loaded.size(); l++) {
+            EXPECT_EQ(loaded[l], l + 1);
+        }
+    }
+}
+
+TEST(HostThreadPoolTest, WaitRethrowsTaskError)
+{
+    HostThreadPool pool(3);
+    for (int l = 0; l < 8; l++) {
+        pool.submit([l]() {
+            if (l == 5) {
+                throw std::runtime_error("cannot load layer");
+            }
+        });
+    }
+    EXPECT_THROW(pool.wait(), std::runtime_error);
+    // the error is reported once and the pool stays usable.
+    pool.submit([]() {});
+    EXPECT_NO_THROW(pool.wait());
+}
+
+}  // end of namespace
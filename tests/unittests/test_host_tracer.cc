@@ -0,0 +1,162 @@
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "src/fastertransformer/utils/host_tracer.h"
+#include "src/fastertransformer/utils/nvtx_utils.h"
+#include "src/fastertransformer/utils/string_utils.h"
+
+using namespace fastertransformer;
+
+namespace {
+
+class HostTracerTest: public testing::Test {
+protected:
+    void SetUp() override
+    {
+        HostTracer::setEnabled(true);
+        HostTracer::reset();
+    }
+    void TearDown() override
+    {
+        HostTracer::setEnabled(false);
+        HostTracer::reset();
+    }
+};
+
+const TraceScopeStats* findScope(const std::vector<TraceScopeStats>& stats, const std::string& scope)
+{
+    for (const TraceScopeStats& s : stats) {
+        if (s.scope == scope) {
+            return &s;
+        }
+    }
+    return nullptr;
+}
+
+TEST(LatencyHistogramTest, PercentilesAreWithinBucketPrecision)
+{
+    LatencyHistogram histogram;
+    EXPECT_EQ(histogram.getPercentile(0.5), 0);
+    for (int64_t i = 1; i <= 10000; i++) {
+        histogram.record(i * 1000);
+    }
+    EXPECT_EQ(histogram.getCount(), 10000u);
+    EXPECT_EQ(histogram.getMin(), 1000);
+    EXPECT_EQ(histogram.getMax(), 10000000);
+    EXPECT_EQ(histogram.getTotal(), 1000LL * 10000 * 10001 / 2);
+    EXPECT_NEAR(histogram.getPercentile(0.5), 5000000, 5000000 / 32);
+    EXPECT_NEAR(histogram.getPercentile(0.99), 9900000, 9900000 / 32);
+    EXPECT_EQ(histogram.getPercentile(1.0), 10000000);  // clamped to the max
+    EXPECT_NEAR(histogram.getPercentile(0.0), 1000, 1000 / 32);
+
+    LatencyHistogram small;
+    for (int64_t i = 0; i < 16; i++) {
+        small.record(i);
+    }
+    small.record((int64_t)1 << 50);  // in the last bucket
+    EXPECT_EQ(small.getPercentile(0.5), 8);
+    histogram.merge(small);
+    EXPECT_EQ(histogram.getCount(), 10017u);
+    EXPECT_EQ(histogram.getMin(), 0);
+}
+
+TEST(HostTracerScopeTest, NumbersAfterUnderscoresAreMerged)
+{
+    EXPECT_EQ(HostTracer::getScopeName("layer_12"), "layer_#");
+    EXPECT_EQ(HostTracer::getScopeName("token_3/layer_0_attention"), "token_#/layer_#_attention");
+    EXPECT_EQ(HostTracer::getScopeName("FFN gemm 2"), "FFN gemm 2");
+    EXPECT_EQ(HostTracer::getScopeName("x_"), "x_");
+}
+
+TEST_F(HostTracerTest, RangesAreAggregatedPerScope)
+{
+    for (int step = 0; step < 4; step++) {
+        PUSH_RANGE(fmtstr("token_%d", step));
+        for (int l = 0; l < 3; l++) {
+            PUSH_RANGE(fmtstr("layer_%d", l));
+            PUSH_RANGE("qkv_gemm");
+            POP_RANGE;
+            POP_RANGE;
+        }
+        POP_RANGE;
+    }
+    POP_RANGE;  // unbalanced pops are ignored
+
+    std::vector<TraceScopeStats> stats = HostTracer::getScopeStats();
+    ASSERT_EQ(stats.size(), 3u);
+    EXPECT_EQ(stats[0].scope, "token_#");  // the most total time first
+    EXPECT_EQ(stats[0].count, 4u);
+    const TraceScopeStats* layer = findScope(stats, "layer_#");
+    const TraceScopeStats* gemm  = findScope(stats, "qkv_gemm");
+    ASSERT_NE(layer, nullptr);
+    ASSERT_NE(gemm, nullptr);
+    EXPECT_EQ(layer->count, 12u);
+    EXPECT_EQ(gemm->count, 12u);
+    EXPECT_GE(stats[0].total_ns, layer->total_ns);
+    EXPECT_GE(layer->total_ns, gemm->total_ns);
+    EXPECT_LE(layer->min_ns, layer->p50_ns);
+    EXPECT_LE(layer->p50_ns, layer->p99_ns);
+    EXPECT_LE(layer->p99_ns, layer->max_ns);
+
+    const std::string summary = HostTracer::getSummary();
+    EXPECT_NE(summary.find("token_#"), std::string::npos);
+    EXPECT_NE(summary.find("p99 us"), std::string::npos);
+
+    HostTracer::reset();
+    EXPECT_TRUE(HostTracer::getScopeStats().empty());
+}
+
+TEST_F(HostTracerTest, DisabledTracerRecordsNothing)
+{
+    HostTracer::setEnabled(false);
+    PUSH_RANGE("ignored");
+    POP_RANGE;
+    HostTracer::setEnabled(true);
+    POP_RANGE;
+    EXPECT_TRUE(HostTracer::getScopeStats().empty());
+}
+
+TEST_F(HostTracerTest, ExportsChromeTraceOfAllThreads)
+{
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 3; t++) {
+        threads.emplace_back([]() {
+            PUSH_RANGE("worker \"step\"");
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            POP_RANGE;
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    const std::string path = testing::TempDir() + "host_trace.json";
+    ASSERT_TRUE(HostTracer::exportChromeTrace(path));
+    std::ifstream      file(path);
+    std::ostringstream ss;
+    ss << file.rdbuf();
+    const std::string trace = ss.str();
+    std::remove(path.c_str());
+
+    EXPECT_EQ(trace.find("{\"displayTimeUnit\":\"ms\",\"traceEvents\":["), 0u);
+    size_t num_events = 0;
+    for (size_t pos = trace.find("\"name\":\"worker \\\"step\\\"\""); pos != std::string::npos;
+         pos        = trace.find("\"name\":\"worker \\\"step\\\"\"", pos + 1)) {
+        num_events++;
+    }
+    EXPECT_EQ(num_events, 3u);
+    EXPECT_NE(trace.find("\"ph\":\"X\""), std::string::npos);
+
+    const std::vector<TraceScopeStats> stats = HostTracer::getScopeStats();
+    ASSERT_EQ(stats.size(), 1u);
+    EXPECT_EQ(stats[0].count, 3u);
+    EXPECT_GE(stats[0].min_ns, 1000000);
+}
+
+}  // end of namespace
@@ -0,0 +1,111 @@
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "src/fastertransformer/utils/kv_cache_block_manager.h"
+
+using namespace fastertransformer;
+
+namespace {
+
+TEST(KVCacheBlockManagerTest, AllocatesBlocksOnDemand)
+{
+    KVCacheBlockManager manager(8, 4);
+    ASSERT_TRUE(manager.addSequence(0, 5));
+    EXPECT_EQ(manager.getBlockTable(0).size(), 2u);
+    EXPECT_EQ(manager.numFreeBlocks(), 6u);
+
+    std::vector<KVCacheBlockCopy> copies;
+    ASSERT_TRUE(manager.appendTokens(0, 3, &copies));  // fills the second block
+    EXPECT_EQ(manager.getBlockTable(0).size(), 2u);
+    ASSERT_TRUE(manager.appendTokens(0, 1, &copies));
+    EXPECT_EQ(manager.getBlockTable(0).size(), 3u);
+    EXPECT_EQ(manager.getSequenceLength(0), 9u);
+    EXPECT_TRUE(copies.empty());
+
+    EXPECT_FALSE(manager.addSequence(1, 21));  // needs 6 blocks, 5 are free
+    EXPECT_FALSE(manager.hasSequence(1));
+    EXPECT_EQ(manager.numFreeBlocks(), 5u);
+    ASSERT_TRUE(manager.addSequence(1, 20));
+    EXPECT_FALSE(manager.appendTokens(1, 1, &copies));
+    EXPECT_EQ(manager.getSequenceLength(1), 20u);
+
+    KVCacheBlockStats stats = manager.getStats();
+    EXPECT_EQ(stats.num_used_blocks, 8u);
+    EXPECT_EQ(stats.num_tokens, 29u);
+    EXPECT_EQ(stats.num_token_slots, 32u);
+    EXPECT_FLOAT_EQ(stats.utilization(), 1.0f);
+    EXPECT_FLOAT_EQ(stats.fragmentation(), 3.0f / 32.0f);
+
+    manager.removeSequence(0);
+    manager.removeSequence(1);
+    EXPECT_EQ(manager.numFreeBlocks(), 8u);
+    EXPECT_EQ(manager.getStats().peak_used_blocks, 8u);
+    EXPECT_THROW(manager.removeSequence(1), std::runtime_error);
+}
+
+TEST(KVCacheBlockManagerTest, ForkedBeamsCopyTheSharedTailOnWrite)
+{
+    KVCacheBlockManager manager(8, 4);
+    ASSERT_TRUE(manager.addSequence(0, 6));
+    manager.forkSequence(0, 1);
+    const std::vector<int> parent_blocks = manager.getBlockTable(0);
+    EXPECT_EQ(manager.getBlockTable(1), parent_blocks);
+    EXPECT_EQ(manager.getBlockRefCount(parent_blocks[0]), 2);
+    EXPECT_EQ(manager.getStats().num_shared_blocks, 2u);
+
+    std::vector<KVCacheBlockCopy> copies;
+    ASSERT_TRUE(manager.appendTokens(1, 1, &copies));
+    ASSERT_EQ(copies.size(), 1u);
+    EXPECT_EQ(copies[0].src_block, parent_blocks[1]);
+    const std::vector<int>& child_blocks = manager.getBlockTable(1);
+    EXPECT_EQ(child_blocks[0], parent_blocks[0]);
+    EXPECT_EQ(child_blocks[1], copies[0].dst_block);
+    EXPECT_EQ(manager.getBlockRefCount(parent_blocks[1]), 1);
+
+    // The parent is now the only owner of its tail, no copy is needed.
+    copies.clear();
+    ASSERT_TRUE(manager.appendTokens(0, 1, &copies));
+    EXPECT_TRUE(copies.empty());
+    EXPECT_EQ(manager.getBlockTable(0), parent_blocks);
+    EXPECT_EQ(manager.getStats().num_cow_copies, 1u);
+
+    manager.removeSequence(0);
+    EXPECT_EQ(manager.getBlockRefCount(parent_blocks[0]), 1);
+    manager.removeSequence(1);
+    EXPECT_EQ(manager.numFreeBlocks(), 8u);
+}
+
+TEST(KVCacheBlockManagerTest, SequencesShareRetainedPrefixBlocks)
+{
+    KVCacheBlockManager manager(8, 4);
+    ASSERT_TRUE(manager.addSequence(0, 6));
+    // A prefix cache keeps the blocks of the prompt after the request ends.
+    const std::vector<int> prefix_blocks = manager.getBlockTable(0);
+    for (int block : prefix_blocks) {
+        manager.addBlockRef(block);
+    }
+    manager.removeSequence(0);
+    EXPECT_EQ(manager.numFreeBlocks(), 6u);
+
+    ASSERT_TRUE(manager.addSequence(1, prefix_blocks, 6, 10));
+    const std::vector<int>& blocks = manager.getBlockTable(1);
+    ASSERT_EQ(blocks.size(), 3u);
+    EXPECT_EQ(blocks[0], prefix_blocks[0]);
+    EXPECT_NE(blocks[1], prefix_blocks[1]);  // the partial block of the prefix is copied before being extended
+    EXPECT_EQ(manager.getBlockRefCount(prefix_blocks[1]), 1);
+
+    std::vector<int> tables(2 * 4);
+    ASSERT_TRUE(manager.addSequence(2, 1));
+    manager.getBlockTables({1, 2}, 4, tables.data());
+    EXPECT_EQ(tables, std::vector<int>({blocks[0], blocks[1], blocks[2], -1, manager.getBlockTable(2)[0], -1, -1, -1}));
+
+    manager.removeSequence(1);
+    manager.removeSequence(2);
+    for (int block : prefix_blocks) {
+        manager.releaseBlock(block);
+    }
+    EXPECT_EQ(manager.numFreeBlocks(), 8u);
+}
+
+}  // end of namespace
@@ -0,0 +1,251 @@
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "src/fastertransformer/kernels/lora_kernels.h"
+#include "src/fastertransformer/layers/adapter_layers/LoraAdapterRegistry.h"
+#include "src/fastertransformer/utils/allocator.h"
+
+using namespace fastertransformer;
+
+namespace {
+
+class LoraAdaptersTest: public testing::Test {
+protected:
+    cudaStream_t                                    stream_;
+    std::unique_ptr<Allocator<AllocatorType::CUDA>> allocator_;
+    std::mt19937                                    generator_{42};
+
+    void SetUp() override
+    {
+        check_cuda_error(cudaStreamCreate(&stream_));
+        allocator_.reset(new Allocator<AllocatorType::CUDA>(getDevice()));
+        allocator_->setStream(stream_);
+    }
+    void TearDown() override
+    {
+        allocator_.reset();
+        check_cuda_error(cudaStreamDestroy(stream_));
+    }
+
+    template<typename T>
+    std::vector<T> toHost(const T* d_ptr, size_t size)
+    {
+        std::vector<T> values(size);
+        check_cuda_error(cudaStreamSynchronize(stream_));
+        check_cuda_error(cudaMemcpy(values.data(), d_ptr, size * sizeof(T), cudaMemcpyDeviceToHost));
+        return values;
+    }
+
+    std::vector<float> random(size_t size)
+    {
+        std::uniform_real_distribution<float> distribution(-1.0f, 1.0f);
+        std::vector<float>                    values(size);
+        for (float& value : values) {
+            value = distribution(generator_);
+        }
+        return values;
+    }
+
+    // An adapter on every target of the layers of registry.
+    LoraAdapterWeights<float> randomAdapter(const LoraAdapterRegistry<float>& registry, size_t num_layer, size_t rank)
+    {
+        LoraAdapterWeights<float> weights;
+        weights.rank = rank;
+        weights.a.resize(num_layer);
+        weights.b.resize(num_layer);
+        for (size_t l = 0; l < num_layer; l++) {
+            for (int t = 0; t < (int)LORA_TARGET_NUM; t++) {
+                weights.a[l][t] = random(rank * registry.getShape((LoraTarget)t).k);
+                weights.b[l][t] = random(rank * registry.getShape((LoraTarget)t).n);
+            }
+        }
+        return weights;
+    }
+};
+
+TEST_F(LoraAdaptersTest, PagesAdaptersInLeastRecentlyUsedOrder)
+{
+    LoraAdapterRegistry<float> registry(0, 2, getLoraShapes(8, 8, 16, 1), 4, 2, allocator_.get());
+    for (int adapter_id = 0; adapter_id < 3; adapter_id++) {
+        registry.addAdapter(adapter_id, randomAdapter(registry, 2, adapter_id + 1));
+    }
+    EXPECT_EQ(registry.getAdapterIds(), std::vector<int>({0, 1, 2}));
+
+    // A batch mixing two adapters and the base model.
+    std::vector<int> adapter_ids = {0, -1, 1, 0};
+    std::vector<int> slots = registry.getSlots(adapter_ids.data(), adapter_ids.size(), stream_)->getSlots();
+    EXPECT_EQ(slots[1], -1);
+    EXPECT_EQ(slots[0], slots[3]);
+    EXPECT_NE(slots[0], slots[2]);
+    EXPECT_EQ(registry.getNumCopies(), 2u);
+
+    // The slots hold the adapters padded to the maximum rank.
+    const LoraWeight<float> qkv       = registry.getWeight(1, LoraTarget::QKV);
+    const std::vector<int>  adapter_1 = {1};
+    std::vector<float>      in        = random(8);
+    std::vector<float>      expected(24, 0.0f), out(24, 0.0f);
+    registry.addLoraOnHost(expected.data(), in.data(), adapter_1.data(), 1, 1, 1, LoraTarget::QKV);
+    const std::vector<float> a = toHost(qkv.a + slots[2] * qkv.slot_stride, 4 * 8);
+    const std::vector<float> b = toHost(qkv.b + slots[2] * qkv.slot_stride, 4 * 24);
+    for (size_t r = 2; r < 4; r++) {
+        for (size_t j = 0; j < 8; j++) {
+            EXPECT_EQ(a[r * 8 + j], 0.0f);
+        }
+    }
+    for (size_t j = 0; j < 24; j++) {
+        for (size_t r = 0; r < 4; r++) {
+            float shrunk = 0.0f;
+            for (size_t i = 0; i < 8; i++) {
+                shrunk += in[i] * a[r * 8 + i];
+            }
+            out[j] += shrunk * b[r * 24 + j];
+        }
+        EXPECT_NEAR(out[j], expected[j], 1e-5f);
+    }
+
+    // Adapter 0 was used last, so adapter 2 takes the slot of adapter 1.
+    adapter_ids         = {0};
+    const int slot_of_0 = registry.getSlots(adapter_ids.data(), 1, stream_)->getSlots()[0];
+    const int slot_of_1 = registry.getSlot(1);
+    adapter_ids         = {2, 2};
+    {
+        std::unique_ptr<AdapterSlotsHolder> held = registry.getSlots(adapter_ids.data(), 2, stream_);
+        EXPECT_EQ(held->getSlots()[0], slot_of_1);
+        EXPECT_EQ(registry.getSlot(0), slot_of_0);
+        EXPECT_EQ(registry.getSlot(1), -1);
+        EXPECT_EQ(registry.getNumCopies(), 3u);
+
+        // Neither the slots of the running batches nor those of the batch itself are paged out.
+        adapter_ids = {0, 1};
+        EXPECT_THROW(registry.getSlots(adapter_ids.data(), 2, stream_), std::runtime_error);
+    }
+    adapter_ids = {1};
+    EXPECT_EQ(registry.getSlots(adapter_ids.data(), 1, stream_)->getSlots()[0], slot_of_0);
+
+    adapter_ids = {0, 1, 2};
+    EXPECT_THROW(registry.getSlots(adapter_ids.data(), 3, stream_), std::runtime_error);
+    adapter_ids = {3};
+    EXPECT_THROW(registry.getSlots(adapter_ids.data(), 1, stream_), std::runtime_error);
+    EXPECT_THROW(registry.addAdapter(4, randomAdapter(registry, 2, 5)), std::runtime_error);
+
+    // Unregistered adapters are dropped once no batch uses them.
+    adapter_ids = {1};
+    {
+        std::unique_ptr<AdapterSlotsHolder> held = registry.getSlots(adapter_ids.data(), 1, stream_);
+        EXPECT_TRUE(registry.unregisterAdapter(1));
+        EXPECT_FALSE(registry.hasAdapter(1));
+        EXPECT_THROW(registry.getSlots(adapter_ids.data(), 1, stream_), std::runtime_error);
+    }
+    EXPECT_FALSE(registry.unregisterAdapter(1));
+    EXPECT_EQ(registry.getAdapterIds(), std::vector<int>({0, 2}));
+    EXPECT_EQ(registry.listAdapters().size(), 2u);
+}
+
+TEST_F(LoraAdaptersTest, KernelsMatchTheHostReference)
+{
+    const size_t batch_size = 4, seq_len = 3, m = batch_size * seq_len;
+    const auto   shapes = getLoraShapes(64, 64, 256, 2);
+
+    LoraAdapterRegistry<float> registry(0, 1, shapes, 8, 3, allocator_.get());
+    registry.addAdapter(7, randomAdapter(registry, 1, 8));
+    registry.addAdapter(9, randomAdapter(registry, 1, 3));
+
+    const std::vector<int>              adapter_ids = {9, -1, 7, 9};
+    std::unique_ptr<AdapterSlotsHolder> held        = registry.getSlots(adapter_ids.data(), batch_size, stream_);
+    const std::vector<int>&             slots       = held->getSlots();
+
+    int*   d_slots    = (int*)allocator_->malloc(sizeof(int) * batch_size);
+    float* d_lora_buf = (float*)allocator_->malloc(sizeof(float) * m * registry.getMaxRank());
+    check_cuda_error(cudaMemcpy(d_slots, slots.data(), sizeof(int) * batch_size, cudaMemcpyHostToDevice));
+
+    for (int t = 0; t < (int)LORA_TARGET_NUM; t++) {
+        const LoraShape          shape  = shapes[t];
+        const LoraWeight<float>  weight = registry.getWeight(0, (LoraTarget)t);
+        const std::vector<float> in     = random(m * shape.k);
+        std::vector<float>       out    = random(m * shape.n);
+
+        float* d_in  = (float*)allocator_->malloc(sizeof(float) * in.size());
+        float* d_out = (float*)allocator_->malloc(sizeof(float) * out.size());
+        check_cuda_error(cudaMemcpy(d_in, in.data(), sizeof(float) * in.size(), cudaMemcpyHostToDevice));
+        check_cuda_error(cudaMemcpy(d_out, out.data(), sizeof(float) * out.size(), cudaMemcpyHostToDevice));
+        invokeAddLora(d_out,
+                      d_in,
+                      d_lora_buf,
+                      weight.a,
+                      weight.b,
+                      weight.slot_stride,
+                      d_slots,
+                      (const int*)nullptr,
+                      seq_len,
+                      m,
+                      shape.k,
+                      shape.n,
+                      weight.rank,
+                      stream_);
+
+        registry.addLoraOnHost(out.data(), in.data(), adapter_ids.data(), m, seq_len, 0, (LoraTarget)t);
+        const std::vector<float> result = toHost(d_out, out.size());
+        for (size_t i = 0; i < out.size(); i++) {
+            ASSERT_NEAR(result[i], out[i], 1e-4f * (1.0f + std::fabs(out[i]))) << getLoraTargetName((LoraTarget)t);
+        }
+        allocator_->free((void**)&d_in);
+        allocator_->free((void**)&d_out);
+    }
+    allocator_->free((void**)&d_slots);
+    allocator_->free((void**)&d_lora_buf);
+}
+
+TEST_F(LoraAdaptersTest, LoadsTheMatricesOfItsTensorParallelRank)
+{
+    // Rank 1 of 2, layer 1 only, and an adapter on the QKV and FFN output GEMMs.
+    const auto                 shapes = getLoraShapes(4, 4, 8, 2);
+    LoraAdapterRegistry<float> registry(1, 2, shapes, 2, 1, allocator_.get());
+    const std::string          dir = testing::TempDir();
+
+    const std::vector<float> qkv_a = random(2 * 4), qkv_b = random(2 * 6), out_a = random(2 * 4), out_b = random(2 * 4);
+    const std::vector<std::pair<std::string, const std::vector<float>*>> files = {
+        {"layers.1.qkv.lora_a.bin", &qkv_a},
+        {"layers.1.qkv.lora_b.1.bin", &qkv_b},
+        {"layers.1.ffn_output.lora_a.1.bin", &out_a},
+        {"layers.1.ffn_output.lora_b.bin", &out_b}};
+    for (const auto& file : files) {
+        std::ofstream(dir + file.first, std::ios::binary)
+            .write((const char*)file.second->data(), sizeof(float) * file.second->size());
+    }
+    registry.loadAdapter(3, dir, 2, 4.0f, 1);
+    for (const auto& file : files) {
+        std::remove((dir + file.first).c_str());
+    }
+
+    // alpha / rank = 2 scales B.
+    const std::vector<int>   adapter_ids = {3};
+    const std::vector<float> in          = random(4);
+    std::vector<float>       out(4, 0.0f);
+    registry.addLoraOnHost(out.data(), in.data(), adapter_ids.data(), 1, 1, 1, LoraTarget::FFN_OUTPUT);
+    for (size_t j = 0; j < 4; j++) {
+        float expected = 0.0f;
+        for (size_t r = 0; r < 2; r++) {
+            float shrunk = 0.0f;
+            for (size_t i = 0; i < 4; i++) {
+                shrunk += in[i] * out_a[r * 4 + i];
+            }
+            expected += 2.0f * shrunk * out_b[r * 4 + j];
+        }
+        EXPECT_NEAR(out[j], expected, 1e-5f);
+    }
+
+    // No files for the intermediate GEMM, so no adapter on it.
+    std::vector<float> inter(4, 0.0f);
+    registry.addLoraOnHost(inter.data(), in.data(), adapter_ids.data(), 1, 1, 1, LoraTarget::FFN_INTERMEDIATE);
+    EXPECT_EQ(inter, std::vector<float>(4, 0.0f));
+    EXPECT_EQ(registry.getWeight(0, LoraTarget::QKV).a, nullptr);
+}
+
+}  // end of namespace
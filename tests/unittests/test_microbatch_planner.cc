@@ -0,0 +1,153 @@
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "src/fastertransformer/utils/microbatch_planner.h"
+
+using namespace fastertransformer;
+
+namespace {
+
+// About GPT-3 175B on 8-way tensor and 4-way pipeline parallelism.
+PipelineCostParams getGpt175bParams()
+{
+    PipelineCostParams params;
+    params.num_layer          = 96;
+    params.hidden_units       = 12288;
+    params.inter_size         = 4 * 12288;
+    params.vocab_size         = 51200;
+    params.tensor_para_size   = 8;
+    params.pipeline_para_size = 4;
+    return params;
+}
+
+TEST(MicrobatchPlannerTest, HeuristicKeepsTheRuleOfGetLocalBatchSize)
+{
+    HeuristicMicrobatchPlanner planner(4);
+    EXPECT_EQ(planner.getLocalBatchSize(PipelinePhase::CONTEXT, 16, 128), 4u);
+    EXPECT_EQ(planner.getLocalBatchSize(PipelinePhase::CONTEXT, 16, 1024), 1u);
+    EXPECT_EQ(planner.getLocalBatchSize(PipelinePhase::CONTEXT, 6, 1024), 3u);  // not a multiple of 4, halved
+    EXPECT_EQ(planner.getLocalBatchSize(PipelinePhase::GENERATION, 64, 2048, 4), 16u);
+    EXPECT_EQ(HeuristicMicrobatchPlanner(1).getLocalBatchSize(PipelinePhase::CONTEXT, 16, 1024), 16u);
+}
+
+TEST(MicrobatchPlannerTest, CostModelPicksTheFastestDivisor)
+{
+    CostModelMicrobatchPlanner planner(getGpt175bParams());
+
+    // Generation reads all the weights for each microbatch, so splitting the batch costs more than the bubble...
+    EXPECT_EQ(planner.getLocalBatchSize(PipelinePhase::GENERATION, 64, 128), 64u);
+    EXPECT_LT(planner.getCost(PipelinePhase::GENERATION, 64, 64, 128).total_us,
+              planner.getCost(PipelinePhase::GENERATION, 64, 16, 128).total_us);
+    // ... unless the keys and values of long sequences outweigh the weights.
+    EXPECT_EQ(planner.getLocalBatchSize(PipelinePhase::GENERATION, 64, 2048), 32u);
+
+    // Short contexts are still bound by memory with 2 sequences, so single sequences fill the pipeline best.
+    EXPECT_EQ(planner.getLocalBatchSize(PipelinePhase::CONTEXT, 8, 128), 1u);
+
+    for (PipelinePhase phase : {PipelinePhase::CONTEXT, PipelinePhase::GENERATION}) {
+        for (size_t batch_size : {1, 6, 12, 32}) {
+            const std::vector<MicrobatchCost> costs = planner.getCosts(phase, batch_size, 512);
+            const size_t local_batch_size           = planner.getLocalBatchSize(phase, batch_size, 512);
+            EXPECT_EQ(batch_size % local_batch_size, 0u);
+            for (const MicrobatchCost& cost : costs) {
+                EXPECT_GT(cost.stage_us, 0.0);
+                EXPECT_GE(cost.total_us, planner.getCost(phase, batch_size, local_batch_size, 512).total_us);
+            }
+        }
+    }
+
+    PipelineCostParams single_stage = getGpt175bParams();
+    single_stage.pipeline_para_size = 1;
+    EXPECT_EQ(CostModelMicrobatchPlanner(single_stage).getLocalBatchSize(PipelinePhase::CONTEXT, 8, 128), 8u);
+}
+
+TEST(MicrobatchPlannerTest, BubbleGrowsWithTheNumberOfStages)
+{
+    // One layer per stage, so only the fill and drain of the pipeline differ.
+    PipelineCostParams params = getGpt175bParams();
+    params.num_layer          = 2;
+    params.pipeline_para_size = 2;
+    CostModelMicrobatchPlanner two_stages(params);
+    params.num_layer          = 8;
+    params.pipeline_para_size = 8;
+    CostModelMicrobatchPlanner eight_stages(params);
+
+    const MicrobatchCost two   = two_stages.getCost(PipelinePhase::CONTEXT, 8, 1, 256);
+    const MicrobatchCost eight = eight_stages.getCost(PipelinePhase::CONTEXT, 8, 1, 256);
+    EXPECT_DOUBLE_EQ(two.stage_us, eight.stage_us);
+    EXPECT_NEAR(two.total_us, 9 * (two.stage_us + two.send_us) - two.send_us, 1e-6);
+    EXPECT_NEAR(eight.total_us, 15 * (eight.stage_us + eight.send_us) - eight.send_us, 1e-6);
+}
+
+TEST(MicrobatchPlannerTest, CalibrationReplacesTheAnalyticLayerTime)
+{
+    CostModelMicrobatchPlanner planner(getGpt175bParams());
+    const std::string          path = testing::TempDir() + "microbatch_calibration.txt";
+
+    // Not calibrating, the timings are ignored.
+    planner.recordStageTime(PipelinePhase::CONTEXT, 128, 100.0f);
+    EXPECT_FALSE(planner.hasCalibration(PipelinePhase::CONTEXT));
+
+    // Calibrating, the microbatch sizes are swept.
+    planner.setCalibrating(true, path);
+    std::vector<size_t> local_batch_sizes;
+    for (int i = 0; i < 5; i++) {
+        local_batch_sizes.push_back(planner.getLocalBatchSize(PipelinePhase::CONTEXT, 8, 128));
+    }
+    EXPECT_EQ(local_batch_sizes, std::vector<size_t>({1, 2, 4, 8, 1}));
+
+    planner.recordStageTime(PipelinePhase::CONTEXT, 128, 90.0f);
+    planner.recordStageTime(PipelinePhase::CONTEXT, 128, 110.0f);
+    planner.recordStageTime(PipelinePhase::CONTEXT, 512, 400.0f);
+    planner.saveCalibration();
+
+    CostModelMicrobatchPlanner calibrated(getGpt175bParams());
+    EXPECT_FALSE(calibrated.loadCalibration(path + ".missing"));
+    ASSERT_TRUE(calibrated.loadCalibration(path));
+    std::remove(path.c_str());
+    EXPECT_TRUE(calibrated.hasCalibration(PipelinePhase::CONTEXT));
+    EXPECT_FALSE(calibrated.hasCalibration(PipelinePhase::GENERATION));
+
+    EXPECT_DOUBLE_EQ(calibrated.getLayerTime(PipelinePhase::CONTEXT, 64, 64), 100.0);    // flat below
+    EXPECT_DOUBLE_EQ(calibrated.getLayerTime(PipelinePhase::CONTEXT, 128, 64), 100.0);   // the mean
+    EXPECT_DOUBLE_EQ(calibrated.getLayerTime(PipelinePhase::CONTEXT, 320, 64), 250.0);   // interpolated
+    EXPECT_DOUBLE_EQ(calibrated.getLayerTime(PipelinePhase::CONTEXT, 1024, 64), 800.0);  // proportional above
+    EXPECT_DOUBLE_EQ(calibrated.getLayerTime(PipelinePhase::GENERATION, 16, 64),
+                     calibrated.getAnalyticLayerTime(PipelinePhase::GENERATION, 16, 64));
+    // The plans use the timings: 24 layers a stage.
+    EXPECT_DOUBLE_EQ(calibrated.getCost(PipelinePhase::CONTEXT, 8, 1, 128).stage_us, 24 * 100.0);
+
+    std::ofstream(path) << "context 128 x 1\n";
+    EXPECT_THROW(calibrated.loadCalibration(path), std::runtime_error);
+    std::remove(path.c_str());
+}
+
+TEST(MicrobatchPlannerTest, CostModelIsOptIn)
+{
+    unsetenv("FT_MICROBATCH_PLANNER");
+    EXPECT_NE(dynamic_cast<HeuristicMicrobatchPlanner*>(createMicrobatchPlanner(getGpt175bParams()).get()), nullptr);
+    setenv("FT_MICROBATCH_PLANNER", "COST_MODEL", 1);
+    EXPECT_NE(dynamic_cast<CostModelMicrobatchPlanner*>(createMicrobatchPlanner(getGpt175bParams()).get()), nullptr);
+    unsetenv("FT_MICROBATCH_PLANNER");
+}
+
+TEST(MicrobatchPlannerTest, BroadcastGivesThePlanOfTheRoot)
+{
+    // The root planned 2 on a batch of 8, while this rank would run the whole batch at once.
+    std::vector<size_t>        planned;
+    BroadcastMicrobatchPlanner planner(std::make_shared<HeuristicMicrobatchPlanner>(1), [&](size_t local_batch_size) {
+        planned.push_back(local_batch_size);
+        return size_t(2);
+    });
+    EXPECT_EQ(planner.getLocalBatchSize(PipelinePhase::CONTEXT, 8, 128), 2u);
+    EXPECT_EQ(planned, std::vector<size_t>({8}));
+    EXPECT_FALSE(planner.isCalibrating());
+}
+
+}  // end of namespace
@@ -0,0 +1,65 @@
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "src/fastertransformer/utils/mmap_utils.h"
+
+using namespace fastertransformer;
+
+namespace {
+
+std::string writeTempBin(const std::string& name, const std::vector<float>& values)
+{
+    std::string   filename = "/tmp/ft_test_mmap_utils_" + name + ".bin";
+    std::ofstream out(filename, std::ios::out | std::ios::binary);
+    out.write((const char*)values.data(), values.size() * sizeof(float));
+    return filename;
+}
+
+TEST(MmapUtilsTest, MapWeightFromBinReturnsFileContents)
+{
+    std::vector<float> values   = {0.5f, -1.0f, 2.0f, 3.25f, 4.0f, 5.5f};
+    std::string        filename = writeTempBin("contents", values);
+
+    MappedWeight<float> weight = mapWeightFromBin<float>({2, 3}, filename);
+    ASSERT_FALSE(weight.empty());
+    EXPECT_EQ(weight.size, values.size());
+    for (size_t i = 0; i < values.size(); i++) {
+        EXPECT_EQ(weight.data[i], values[i]);
+    }
+    std::remove(filename.c_str());
+}
+
+TEST(MmapUtilsTest, MappingOutlivesFileRemoval)
+{
+    std::vector<float> values   = {1.0f, 2.0f, 3.0f, 4.0f};
+    std::string        filename = writeTempBin("outlive", values);
+
+    MappedWeight<float> weight = mapWeightFromBin<float>({4}, filename);
+    std::remove(filename.c_str());
+    ASSERT_FALSE(weight.empty());
+    EXPECT_EQ(weight.data[3], 4.0f);
+}
+
+TEST(MmapUtilsTest, MapWeightFromBinRejectsShortFile)
+{
+    std::string filename = writeTempBin("short", {1.0f, 2.0f});
+    EXPECT_TRUE(mapWeightFromBin<float>({3}, filename).empty());
+    EXPECT_TRUE(mapWeightFromBin<float>({0}, filename).empty());
+    EXPECT_TRUE(mapWeightFromBin<float>({2}, "/tmp/ft_test_mmap_utils_missing.bin").empty());
+    std::remove(filename.c_str());
+}
+
+TEST(MmapUtilsTest, MapWeightFromBinRejectsBadShape)
+{
+    std::string filename = writeTempBin("bad_shape", {1.0f, 2.0f});
+    EXPECT_THROW(mapWeightFromBin<float>({}, filename), std::runtime_error);
+    EXPECT_THROW(mapWeightFromBin<float>({1, 1, 2}, filename), std::runtime_error);
+    std::remove(filename.c_str());
+}
+
+}  // end of namespace
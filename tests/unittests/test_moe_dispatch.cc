@@ -0,0 +1,314 @@
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "src/fastertransformer/kernels/moe_dispatch_kernels.h"
+#include "src/fastertransformer/utils/allocator.h"
+
+using namespace fastertransformer;
+
+namespace {
+
+std::vector<int> randomExperts(std::mt19937& generator, size_t num_rows, int num_experts, int k)
+{
+    // Skewed to the first experts, so that some of them drop rows.
+    std::vector<int>                experts(num_rows * k);
+    std::discrete_distribution<int> distribution({8, 4, 2, 1, 1, 1, 1, 1});
+    for (size_t row = 0; row < num_rows; row++) {
+        for (int i = 0; i < k; i++) {
+            int expert;
+            do {
+                expert = distribution(generator) % num_experts;
+            } while (std::find(&experts[row * k], &experts[row * k] + i, expert) != &experts[row * k] + i);
+            experts[row * k + i] = expert;
+        }
+    }
+    return experts;
+}
+
+// A toy expert e scaling its rows by e + 1, run on the rows grouped by expert.
+void runToyExperts(float*                      out,
+                   const float*                in,
+                   const std::vector<int64_t>& total_rows_before_expert,
+                   int                         first_expert,
+                   int                         cols)
+{
+    int64_t row = 0;
+    for (size_t e = 0; e < total_rows_before_expert.size(); e++) {
+        for (; row < total_rows_before_expert[e]; row++) {
+            for (int j = 0; j < cols; j++) {
+                out[row * cols + j] = (first_expert + e + 1) * in[row * cols + j];
+            }
+        }
+    }
+}
+
+// The expanded rows of the tokens of a rank, run on every expert without dispatch.
+std::vector<float> runDense(const std::vector<float>&  input,
+                            const std::vector<int>&    expert_for_source_row,
+                            const std::vector<int>&    slot_for_expanded_row,
+                            int                        num_rows,
+                            int                        k,
+                            int                        cols)
+{
+    std::vector<float> out((size_t)k * num_rows * cols, 0.0f);
+    for (int i = 0; i < k * num_rows; i++) {
+        const int row = i % num_rows;
+        if (slot_for_expanded_row[i] < 0) {
+            continue;
+        }
+        for (int j = 0; j < cols; j++) {
+            out[(size_t)i * cols + j] = (expert_for_source_row[row * k + i / num_rows] + 1) * input[row * cols + j];
+        }
+    }
+    return out;
+}
+
+// The slots of the rank, its experts run on them, as in ExpertParallelMoe.
+std::vector<float> runLocalExperts(const std::vector<float>& slots,
+                                   const int*                counts,
+                                   int                       num_sources,
+                                   int                       num_local_experts,
+                                   int                       first_expert,
+                                   int                       capacity,
+                                   int                       cols)
+{
+    const int            num_slots = num_sources * num_local_experts * capacity;
+    std::vector<int64_t> total_rows_before_expert(num_local_experts);
+    std::vector<int>     grouped_row_slots(num_slots), slot_grouped_rows(num_slots);
+    buildExpertRowMapsOnHost(total_rows_before_expert.data(),
+                             grouped_row_slots.data(),
+                             slot_grouped_rows.data(),
+                             counts,
+                             num_sources,
+                             num_local_experts,
+                             capacity);
+
+    std::vector<float> grouped_input((size_t)num_slots * cols), grouped_output((size_t)num_slots * cols, 0.0f);
+    std::vector<float> out((size_t)num_slots * cols);
+    permuteMoeRowsOnHost(
+        grouped_input.data(), slots.data(), grouped_row_slots.data(), num_slots, 0, num_slots, cols);
+    runToyExperts(grouped_output.data(), grouped_input.data(), total_rows_before_expert, first_expert, cols);
+    permuteMoeRowsOnHost(out.data(), grouped_output.data(), slot_grouped_rows.data(), num_slots, 0, num_slots, cols);
+    return out;
+}
+
+std::vector<float> randomRows(std::mt19937& generator, size_t size)
+{
+    std::uniform_real_distribution<float> distribution(-1.0f, 1.0f);
+    std::vector<float>                    values(size);
+    for (float& value : values) {
+        value = distribution(generator);
+    }
+    return values;
+}
+
+TEST(MoeDispatchTest, KeepsTheFirstRowsOfEachExpertUpToItsCapacity)
+{
+    EXPECT_EQ(getMoeExpertCapacity(8, 2, 4, 0.0f), 8u);
+    EXPECT_EQ(getMoeExpertCapacity(8, 2, 4, 1.0f), 4u);
+    EXPECT_EQ(getMoeExpertCapacity(8, 2, 4, 1.1f), 5u);
+    EXPECT_EQ(getMoeExpertCapacity(8, 2, 4, 100.0f), 8u);
+    EXPECT_EQ(getMoeExpertCapacity(1, 1, 64, 1.0f), 1u);
+
+    // 4 tokens, top-2 over 3 experts with 2 slots each. The first choices come first, so the second choice of token 0
+    // is dropped by expert 0, full with the first choices of tokens 1 and 2.
+    const std::vector<int> experts = {2, 0, 0, 1, 0, 2, 1, 0};
+    const MoeDispatchPlan  plan    = planMoeDispatchOnHost(experts.data(), 4, 3, 2, 2);
+    EXPECT_EQ(plan.slot_for_expanded_row, std::vector<int>({4, 0, 1, 2, -1, 3, 5, -1}));
+    EXPECT_EQ(plan.slot_rows, std::vector<int>({1, 2, 3, 1, 0, 2}));
+    EXPECT_EQ(plan.expert_counts, std::vector<int>({2, 2, 2}));
+    EXPECT_EQ(plan.expert_load, std::vector<int64_t>({4, 2, 2, 2, 0, 0}));
+
+    // Two sources sending 2 slots to each of two local experts: the first expert got 2 rows from the source 0 and 1
+    // from the source 1, and the second one 1 row from each source.
+    const std::vector<int> counts = {2, 1, 1, 1};
+    std::vector<int64_t>   total_rows_before_expert(2);
+    std::vector<int>       grouped_row_slots(8), slot_grouped_rows(8);
+    buildExpertRowMapsOnHost(
+        total_rows_before_expert.data(), grouped_row_slots.data(), slot_grouped_rows.data(), counts.data(), 2, 2, 2);
+    EXPECT_EQ(total_rows_before_expert, std::vector<int64_t>({3, 5}));
+    EXPECT_EQ(grouped_row_slots, std::vector<int>({0, 1, 4, 2, 6, -1, -1, -1}));
+    EXPECT_EQ(slot_grouped_rows, std::vector<int>({0, 1, 3, -1, 2, -1, 4, -1}));
+}
+
+TEST(MoeDispatchTest, ExpertParallelRanksMatchTheDenseExperts)
+{
+    const int    world_size = 4, num_experts = 8, num_local_experts = 2, k = 2, num_rows = 24, cols = 5;
+    const size_t capacity = getMoeExpertCapacity(num_rows, k, num_experts, 1.0f);
+    std::mt19937 generator(7);
+
+    // The inputs are replicated: each rank runs its experts, and the sum of the ranks is the dense result.
+    const std::vector<float> input   = randomRows(generator, num_rows * cols);
+    const std::vector<int>   experts = randomExperts(generator, num_rows, num_experts, k);
+    const MoeDispatchPlan    plan    = planMoeDispatchOnHost(experts.data(), num_rows, num_experts, k, capacity);
+    int64_t                  num_dropped = 0;
+    for (int e = 0; e < num_experts; e++) {
+        num_dropped += plan.expert_load[num_experts + e];
+    }
+    EXPECT_GT(num_dropped, 0);
+
+    std::vector<float> sum((size_t)k * num_rows * cols, 0.0f), out(sum.size());
+    for (int rank = 0; rank < world_size; rank++) {
+        const int          slot_begin = rank * num_local_experts * capacity;
+        const int          num_slots  = num_local_experts * capacity;
+        std::vector<float> slots((size_t)num_slots * cols);
+        permuteMoeRowsOnHost(slots.data(), input.data(), &plan.slot_rows[slot_begin], num_slots, 0, num_rows, cols);
+        const std::vector<float> results = runLocalExperts(slots,
+                                                           &plan.expert_counts[rank * num_local_experts],
+                                                           1,
+                                                           num_local_experts,
+                                                           rank * num_local_experts,
+                                                           capacity,
+                                                           cols);
+        permuteMoeRowsOnHost(
+            out.data(), results.data(), plan.slot_for_expanded_row.data(), k * num_rows, slot_begin, num_slots, cols);
+        for (size_t i = 0; i < sum.size(); i++) {
+            sum[i] += out[i];
+        }
+    }
+    const std::vector<float> dense = runDense(input, experts, plan.slot_for_expanded_row, num_rows, k, cols);
+    for (size_t i = 0; i < sum.size(); i++) {
+        ASSERT_FLOAT_EQ(sum[i], dense[i]) << i;
+    }
+}
+
+class MoeDispatchKernelTest: public testing::Test {
+protected:
+    cudaStream_t                                    stream_;
+    std::unique_ptr<Allocator<AllocatorType::CUDA>> allocator_;
+
+    void SetUp() override
+    {
+        check_cuda_error(cudaStreamCreate(&stream_));
+        allocator_.reset(new Allocator<AllocatorType::CUDA>(getDevice()));
+        allocator_->setStream(stream_);
+    }
+    void TearDown() override
+    {
+        allocator_.reset();
+        check_cuda_error(cudaStreamDestroy(stream_));
+    }
+
+    template<typename T>
+    T* toDevice(const std::vector<T>& values)
+    {
+        T* d_ptr = (T*)allocator_->malloc(sizeof(T) * values.size());
+        check_cuda_error(cudaMemcpy(d_ptr, values.data(), sizeof(T) * values.size(), cudaMemcpyHostToDevice));
+        return d_ptr;
+    }
+
+    template<typename T>
+    std::vector<T> toHost(const T* d_ptr, size_t size)
+    {
+        std::vector<T> values(size);
+        check_cuda_error(cudaStreamSynchronize(stream_));
+        check_cuda_error(cudaMemcpy(values.data(), d_ptr, size * sizeof(T), cudaMemcpyDeviceToHost));
+        return values;
+    }
+};
+
+TEST_F(MoeDispatchKernelTest, KernelsMatchTheHostReference)
+{
+    // More expanded rows than a block, to cover the scan across chunks.
+    const int    num_experts = 8, num_local_experts = 4, k = 2, num_rows = 300, cols = 40;
+    const size_t capacity = getMoeExpertCapacity(num_rows, k, num_experts, 1.25f);
+    std::mt19937 generator(3);
+
+    const std::vector<int>   experts = randomExperts(generator, num_rows, num_experts, k);
+    const std::vector<float> input   = randomRows(generator, num_rows * cols);
+    std::vector<float>       scales  = randomRows(generator, num_rows * k);
+    const MoeDispatchPlan    plan    = planMoeDispatchOnHost(experts.data(), num_rows, num_experts, k, capacity);
+
+    int*     d_experts = toDevice(experts);
+    int*     d_slot_for_expanded_row = (int*)allocator_->malloc(sizeof(int) * k * num_rows);
+    int*     d_slot_rows             = (int*)allocator_->malloc(sizeof(int) * num_experts * capacity);
+    int*     d_expert_counts         = (int*)allocator_->malloc(sizeof(int) * num_experts);
+    int64_t* d_expert_load           = (int64_t*)allocator_->malloc(sizeof(int64_t) * 2 * num_experts, true);
+    for (int i = 0; i < 2; i++) {
+        invokePlanMoeDispatch(d_slot_for_expanded_row,
+                              d_slot_rows,
+                              d_expert_counts,
+                              d_expert_load,
+                              d_experts,
+                              num_rows,
+                              num_experts,
+                              k,
+                              capacity,
+                              stream_);
+    }
+    EXPECT_EQ(toHost(d_slot_for_expanded_row, k * num_rows), plan.slot_for_expanded_row);
+    EXPECT_EQ(toHost(d_slot_rows, num_experts * capacity), plan.slot_rows);
+    EXPECT_EQ(toHost(d_expert_counts, num_experts), plan.expert_counts);
+    std::vector<int64_t> twice(plan.expert_load);
+    for (int64_t& load : twice) {
+        load *= 2;
+    }
+    EXPECT_EQ(toHost(d_expert_load, 2 * num_experts), twice);
+
+    // The experts 4 to 7, as the second of two ranks.
+    const int            num_slots = num_local_experts * capacity;
+    std::vector<int64_t> total_rows_before_expert(num_local_experts);
+    std::vector<int>     grouped_row_slots(num_slots), slot_grouped_rows(num_slots);
+    buildExpertRowMapsOnHost(total_rows_before_expert.data(),
+                             grouped_row_slots.data(),
+                             slot_grouped_rows.data(),
+                             &plan.expert_counts[num_local_experts],
+                             1,
+                             num_local_experts,
+                             capacity);
+    int64_t* d_total_rows_before_expert = (int64_t*)allocator_->malloc(sizeof(int64_t) * num_local_experts);
+    int*     d_grouped_row_slots        = (int*)allocator_->malloc(sizeof(int) * num_slots);
+    int*     d_slot_grouped_rows        = (int*)allocator_->malloc(sizeof(int) * num_slots);
+    invokeBuildExpertRowMaps(d_total_rows_before_expert,
+                             d_grouped_row_slots,
+                             d_slot_grouped_rows,
+                             d_expert_counts + num_local_experts,
+                             1,
+                             num_local_experts,
+                             capacity,
+                             stream_);
+    EXPECT_EQ(toHost(d_total_rows_before_expert, num_local_experts), total_rows_before_expert);
+    EXPECT_EQ(toHost(d_grouped_row_slots, num_slots), grouped_row_slots);
+    EXPECT_EQ(toHost(d_slot_grouped_rows, num_slots), slot_grouped_rows);
+
+    std::vector<float> out((size_t)k * num_rows * cols);
+    float*             d_input = toDevice(input);
+    float*             d_out   = (float*)allocator_->malloc(sizeof(float) * out.size());
+    permuteMoeRowsOnHost(
+        out.data(), input.data(), plan.slot_for_expanded_row.data(), k * num_rows, num_slots, num_rows, cols);
+    invokePermuteMoeRows(d_out, d_input, d_slot_for_expanded_row, k * num_rows, num_slots, num_rows, cols, stream_);
+    EXPECT_EQ(toHost(d_out, out.size()), out);
+
+    float* d_scales = toDevice(scales);
+    int*   d_rows   = (int*)allocator_->malloc(sizeof(int) * k * num_rows);
+    invokeDropMoeScales(d_scales, d_rows, d_slot_for_expanded_row, num_rows, k, stream_);
+    std::vector<int> identity(k * num_rows);
+    for (int i = 0; i < k * num_rows; i++) {
+        identity[i] = i;
+        if (plan.slot_for_expanded_row[i] < 0) {
+            scales[(i % num_rows) * k + i / num_rows] = 0.0f;
+        }
+    }
+    EXPECT_EQ(toHost(d_scales, scales.size()), scales);
+    EXPECT_EQ(toHost(d_rows, k * num_rows), identity);
+
+    for (void* ptr : {(void*)d_experts,
+                      (void*)d_slot_for_expanded_row,
+                      (void*)d_slot_rows,
+                      (void*)d_expert_counts,
+                      (void*)d_expert_load,
+                      (void*)d_total_rows_before_expert,
+                      (void*)d_grouped_row_slots,
+                      (void*)d_slot_grouped_rows,
+                      (void*)d_input,
+                      (void*)d_out,
+                      (void*)d_scales,
+                      (void*)d_rows}) {
+        allocator_->free(&ptr);
+    }
+}
+
+}  // end of namespace
@@ -0,0 +1,99 @@
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <sys/stat.h>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "src/fastertransformer/utils/packed_checkpoint.h"
+
+using namespace fastertransformer;
+
+namespace {
+
+void writeBin(const std::string& filename, const std::vector<float>& values)
+{
+    std::ofstream out(filename, std::ios::out | std::ios::binary);
+    out.write((const char*)values.data(), values.size() * sizeof(float));
+}
+
+TEST(PackedCheckpointTest, WriteAndReadBack)
+{
+    std::string filename = "/tmp/ft_test_packed_checkpoint_rw.ftpk";
+    {
+        std::vector<float> a = {1.0f, 2.0f, 3.0f};
+        std::vector<float> b = {-1.0f, -2.0f};
+        PackedCheckpointWriter writer(filename, 64);
+        writer.addTensor("a.bin", 0, a.data(), a.size() * sizeof(float));
+        writer.addTensor("b.bin", 0, b.data(), b.size() * sizeof(float));
+        writer.finalize();
+    }
+
+    PackedCheckpointReader reader(filename);
+    ASSERT_TRUE(reader.isValid());
+    EXPECT_EQ(reader.entries().size(), 2u);
+    EXPECT_TRUE(reader.find("c.bin") == nullptr);
+
+    const PackedTensorEntry* b = reader.find("b.bin");
+    ASSERT_TRUE(b != nullptr);
+    EXPECT_EQ(b->offset % 64, 0u);
+    EXPECT_TRUE(reader.verify(*b));
+
+    MappedWeight<float> weight = reader.mapTensor<float>(*b, 2);
+    ASSERT_FALSE(weight.empty());
+    EXPECT_EQ(weight.data[0], -1.0f);
+    EXPECT_EQ(weight.data[1], -2.0f);
+    EXPECT_TRUE(reader.mapTensor<float>(*b, 3).empty());
+    // b is packed as FP32.
+    EXPECT_THROW(reader.mapTensor<half>(*b, 2), std::runtime_error);
+    std::remove(filename.c_str());
+}
+
+TEST(PackedCheckpointTest, ConvertDirectoryAndResolveByFilename)
+{
+    std::string input_dir  = "/tmp/ft_test_packed_checkpoint_in";
+    std::string output_dir = "/tmp/ft_test_packed_checkpoint_out";
+    mkdir(input_dir.c_str(), 0755);
+    mkdir(output_dir.c_str(), 0755);
+    writeBin(input_dir + "/model.wte.bin", {0.5f, 1.5f});
+    writeBin(input_dir + "/model.layers.0.weight.0.bin", {10.0f});
+    writeBin(input_dir + "/model.layers.0.weight.1.bin", {11.0f});
+
+    convertCheckpointDirectory(input_dir, output_dir, 0, sizeof(float), 2);
+
+    PackedCheckpointReader rank1(output_dir + "/packed.1.ftpk");
+    ASSERT_TRUE(rank1.isValid());
+    EXPECT_TRUE(rank1.find("model.wte.bin") != nullptr);
+    EXPECT_TRUE(rank1.find("model.layers.0.weight.1.bin") != nullptr);
+    EXPECT_TRUE(rank1.find("model.layers.0.weight.0.bin") == nullptr);
+
+    MappedWeight<float> weight = mapCheckpointWeight<float>({1}, output_dir + "/model.layers.0.weight.1.bin");
+    ASSERT_FALSE(weight.empty());
+    EXPECT_EQ(weight.data[0], 11.0f);
+
+    // The replicated tensors come from the container the rank already maps.
+    const PackedTensorEntry*                rank_entry       = nullptr;
+    const PackedTensorEntry*                replicated_entry = nullptr;
+    std::shared_ptr<PackedCheckpointReader> rank_reader =
+        findPackedCheckpoint(output_dir + "/model.layers.0.weight.1.bin", &rank_entry);
+    std::shared_ptr<PackedCheckpointReader> replicated_reader =
+        findPackedCheckpoint(output_dir + "/model.wte.bin", &replicated_entry);
+    ASSERT_TRUE(rank_reader != nullptr);
+    EXPECT_EQ(replicated_reader, rank_reader);
+    EXPECT_EQ(replicated_entry->name, "model.wte.bin");
+
+    // Once released, the containers are only kept by their holders, and a later lookup opens them again.
+    std::weak_ptr<PackedCheckpointReader> released_reader = rank_reader;
+    rank_reader.reset();
+    replicated_reader.reset();
+    releasePackedCheckpoints(output_dir);
+    EXPECT_TRUE(released_reader.expired());
+    rank_reader = findPackedCheckpoint(output_dir + "/model.layers.0.weight.1.bin", &rank_entry);
+    ASSERT_TRUE(rank_reader != nullptr);
+    EXPECT_EQ(rank_entry->name, "model.layers.0.weight.1.bin");
+}
+
+}  // end of namespace
@@ -0,0 +1,122 @@
+#include <numeric>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "src/fastertransformer/utils/prefix_kv_cache.h"
+
+using namespace fastertransformer;
+
+namespace {
+
+std::vector<int> range(int begin, int end)
+{
+    std::vector<int> tokens(end - begin);
+    std::iota(tokens.begin(), tokens.end(), begin);
+    return tokens;
+}
+
+std::vector<int> concat(std::vector<int> a, const std::vector<int>& b)
+{
+    a.insert(a.end(), b.begin(), b.end());
+    return a;
+}
+
+// Runs the context step of a prompt: reuses its cached prefix, allocates the rest and caches the full blocks.
+std::vector<int> runPrompt(KVCacheBlockManager* manager, PrefixKVCache* cache, uint64_t id, const std::vector<int>& prompt)
+{
+    PrefixKVCacheMatch match = cache->match(prompt.data(), prompt.size());
+    EXPECT_TRUE(manager->addSequence(id, match.blocks, match.length, prompt.size()));
+    cache->release(&match);
+    std::vector<int> blocks = manager->getBlockTable(id);
+    cache->insert(prompt.data(), prompt.size(), blocks);
+    manager->removeSequence(id);
+    return blocks;
+}
+
+TEST(PrefixKVCacheTest, ReusesTheLongestCachedPrefix)
+{
+    KVCacheBlockManager manager(32, 4);
+    PrefixKVCache       cache(&manager, 32);
+    std::vector<int>    system_prompt = range(0, 10);
+
+    std::vector<int> first = runPrompt(&manager, &cache, 0, concat(system_prompt, range(100, 106)));
+    EXPECT_EQ(cache.numCachedBlocks(), 4u);
+
+    std::vector<int>   prompt = concat(system_prompt, range(200, 203));
+    PrefixKVCacheMatch match  = cache.match(prompt.data(), prompt.size());
+    EXPECT_EQ(match.length, 8u);  // the two full blocks of the system prompt
+    EXPECT_EQ(match.blocks, std::vector<int>({first[0], first[1]}));
+    cache.release(&match);
+
+    // The second prompt branches off in the middle of the first cached run, which is split.
+    runPrompt(&manager, &cache, 1, prompt);
+    EXPECT_EQ(cache.getStats().num_nodes, 3u);
+    EXPECT_EQ(cache.numCachedBlocks(), 5u);
+
+    // A prompt is never fully matched, its last token has to be recomputed.
+    std::vector<int> exact = range(0, 8);
+    match                  = cache.match(exact.data(), exact.size());
+    EXPECT_EQ(match.length, 4u);
+    cache.release(&match);
+
+    std::vector<int> other = range(1000, 1010);
+    match                  = cache.match(other.data(), other.size());
+    EXPECT_EQ(match.length, 0u);
+    EXPECT_TRUE(match.blocks.empty());
+    cache.release(&match);
+
+    PrefixKVCacheStats stats = cache.getStats();
+    EXPECT_EQ(stats.num_lookups, 5u);
+    EXPECT_EQ(stats.num_hits, 3u);
+    EXPECT_EQ(stats.num_hit_tokens, 8u + 8u + 4u);
+}
+
+TEST(PrefixKVCacheTest, EvictsLeastRecentlyUsedUnpinnedLeaves)
+{
+    KVCacheBlockManager manager(32, 4);
+    PrefixKVCache       cache(&manager, 4);
+    runPrompt(&manager, &cache, 0, range(0, 9));      // 2 blocks
+    runPrompt(&manager, &cache, 1, range(100, 109));  // 2 blocks
+    EXPECT_EQ(cache.numCachedBlocks(), 4u);
+    EXPECT_EQ(manager.numFreeBlocks(), 28u);
+
+    // Use the first prompt again, and keep it pinned.
+    std::vector<int>   first = range(0, 9);
+    PrefixKVCacheMatch match = cache.match(first.data(), first.size());
+    EXPECT_EQ(match.length, 8u);
+
+    runPrompt(&manager, &cache, 2, range(200, 209));  // evicts the second prompt
+    EXPECT_EQ(cache.numCachedBlocks(), 4u);
+    std::vector<int>   second       = range(100, 109);
+    PrefixKVCacheMatch second_match = cache.match(second.data(), second.size());
+    EXPECT_EQ(second_match.length, 0u);
+    cache.release(&second_match);
+
+    // Everything but the pinned prompt can be evicted.
+    EXPECT_EQ(cache.evict(100), 2u);
+    EXPECT_EQ(cache.numCachedBlocks(), 2u);
+    cache.release(&match);
+    EXPECT_EQ(cache.evict(100), 2u);
+    EXPECT_EQ(manager.numFreeBlocks(), 32u);
+    EXPECT_EQ(cache.getStats().num_evicted_blocks, 6u);
+}
+
+TEST(PrefixKVCacheTest, InsertStopsWhenTheBudgetIsPinned)
+{
+    KVCacheBlockManager manager(32, 4);
+    PrefixKVCache       cache(&manager, 3);
+    std::vector<int>    first = range(0, 9);
+    runPrompt(&manager, &cache, 0, first);
+    PrefixKVCacheMatch match = cache.match(first.data(), first.size());
+
+    std::vector<int> second = range(100, 109);
+    runPrompt(&manager, &cache, 1, second);
+    EXPECT_EQ(cache.numCachedBlocks(), 3u);  // only one block of the second prompt fits
+    PrefixKVCacheMatch second_match = cache.match(second.data(), second.size());
+    EXPECT_EQ(second_match.length, 4u);
+    cache.release(&second_match);
+    cache.release(&match);
+}
+
+}  // end of namespace
@@ -0,0 +1,98 @@
+#include <cstdint>
+#include <numeric>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "src/fastertransformer/utils/allocator.h"
+#include "src/fastertransformer/utils/request_staging.h"
+
+using namespace fastertransformer;
+
+namespace {
+
+class RequestStagingTest: public testing::Test {
+protected:
+    cudaStream_t                                    stream_;
+    std::unique_ptr<Allocator<AllocatorType::CUDA>> allocator_;
+
+    void SetUp() override
+    {
+        check_cuda_error(cudaStreamCreate(&stream_));
+        allocator_.reset(new Allocator<AllocatorType::CUDA>(getDevice()));
+        allocator_->setStream(stream_);
+    }
+    void TearDown() override
+    {
+        allocator_.reset();
+        check_cuda_error(cudaStreamDestroy(stream_));
+    }
+
+    template<typename T>
+    std::vector<T> toHost(const T* d_ptr, size_t size)
+    {
+        std::vector<T> values(size);
+        check_cuda_error(cudaStreamSynchronize(stream_));
+        check_cuda_error(cudaMemcpy(values.data(), d_ptr, size * sizeof(T), cudaMemcpyDeviceToHost));
+        return values;
+    }
+};
+
+TEST_F(RequestStagingTest, CopiesEveryInputInOneAlignedBuffer)
+{
+    RequestStaging     staging(allocator_.get());
+    std::vector<int>   input_ids(3 * 17);
+    std::vector<int>   input_lengths = {17, 5, 9};
+    std::vector<float> top_p_decay   = {0.5f, 0.9f, 1.0f};
+    std::iota(input_ids.begin(), input_ids.end(), 100);
+
+    staging.clear();
+    const int ids_index     = staging.add(input_ids.data(), input_ids.size() * sizeof(int));
+    const int lengths_index = staging.add(input_lengths.data(), input_lengths.size() * sizeof(int));
+    const int decay_index   = staging.add(top_p_decay.data(), top_p_decay.size() * sizeof(float));
+    staging.copyToDevice(stream_);
+
+    EXPECT_EQ(staging.getDevicePtr(-1), nullptr);
+    for (int index : {ids_index, lengths_index, decay_index}) {
+        EXPECT_EQ((uintptr_t)staging.getDevicePtr(index) % 256, 0u);
+    }
+    EXPECT_EQ(toHost(staging.getDevicePtr<int>(ids_index), input_ids.size()), input_ids);
+    EXPECT_EQ(toHost(staging.getDevicePtr<int>(lengths_index), input_lengths.size()), input_lengths);
+    EXPECT_EQ(toHost(staging.getDevicePtr<float>(decay_index), top_p_decay.size()), top_p_decay);
+}
+
+TEST_F(RequestStagingTest, ReusesItsBuffersAndLayouts)
+{
+    RequestStaging   staging(allocator_.get(), 64);
+    std::vector<int> a(100), b(10);
+
+    // Two requests of the same shape, back to back: the second one overwrites the pinned buffer after the first
+    // copy is done.
+    void* d_first = nullptr;
+    for (int request = 0; request < 2; request++) {
+        std::fill(a.begin(), a.end(), request);
+        std::fill(b.begin(), b.end(), -request);
+        staging.clear();
+        const int a_index = staging.add(a.data(), a.size() * sizeof(int));
+        const int b_index = staging.add(b.data(), b.size() * sizeof(int));
+        staging.copyToDevice(stream_);
+        EXPECT_EQ(toHost(staging.getDevicePtr<int>(a_index), a.size()), a);
+        EXPECT_EQ(toHost(staging.getDevicePtr<int>(b_index), b.size()), b);
+        EXPECT_EQ((char*)staging.getDevicePtr(b_index) - (char*)staging.getDevicePtr(a_index), 448);
+        if (request == 0) {
+            d_first = staging.getDevicePtr(a_index);
+        }
+        EXPECT_EQ(staging.getDevicePtr(a_index), d_first);
+    }
+    EXPECT_EQ(staging.getNumCachedLayouts(), 1u);
+
+    // A smaller request keeps the buffers, with a layout of its own.
+    staging.clear();
+    const int b_index = staging.add(b.data(), b.size() * sizeof(int));
+    staging.copyToDevice(stream_);
+    EXPECT_EQ(staging.getDevicePtr(b_index), d_first);
+    EXPECT_EQ(toHost(staging.getDevicePtr<int>(b_index), b.size()), b);
+    EXPECT_EQ(staging.getNumCachedLayouts(), 2u);
+}
+
+}  // end of namespace
@@ -0,0 +1,91 @@
+#include <array>
+#include <memory>
+#include <thread>
+
+#include <gtest/gtest.h>
+
+#include "src/fastertransformer/utils/spsc_queue.h"
+
+using namespace fastertransformer;
+
+namespace {
+
+TEST(SpscQueueTest, IsBoundedAndFifo)
+{
+    SpscQueue<std::unique_ptr<int>> queue(3);
+    EXPECT_EQ(queue.capacity(), 4u);
+    for (int i = 0; i < 4; i++) {
+        std::unique_ptr<int> value(new int(i));
+        ASSERT_TRUE(queue.tryPush(std::move(value)));
+        EXPECT_EQ(value, nullptr);
+    }
+    std::unique_ptr<int> rejected(new int(4));
+    EXPECT_FALSE(queue.tryPush(std::move(rejected)));
+    ASSERT_NE(rejected, nullptr);  // a failed push does not consume the value
+    EXPECT_EQ(queue.size(), 4u);
+
+    std::unique_ptr<int> value;
+    for (int i = 0; i < 4; i++) {
+        ASSERT_TRUE(queue.tryPop(&value));
+        EXPECT_EQ(*value, i);
+    }
+    EXPECT_FALSE(queue.tryPop(&value));
+    EXPECT_TRUE(queue.empty());
+    EXPECT_TRUE(queue.tryPush(std::move(rejected)));
+}
+
+TEST(SpscQueueTest, ElementsAreAccessedInPlace)
+{
+    SpscQueue<std::array<int, 4>> queue(2);
+    EXPECT_EQ(queue.front(), nullptr);
+    for (int i = 0; i < 2; i++) {
+        std::array<int, 4>* slot = queue.tryAcquirePush();
+        ASSERT_NE(slot, nullptr);
+        slot->fill(i);
+        EXPECT_EQ(queue.size(), (size_t)i);  // not published before commitPush
+        queue.commitPush();
+    }
+    EXPECT_EQ(queue.tryAcquirePush(), nullptr);
+
+    for (int i = 0; i < 2; i++) {
+        const std::array<int, 4>* element = queue.front();
+        ASSERT_NE(element, nullptr);
+        EXPECT_EQ((*element)[3], i);
+        EXPECT_EQ(queue.front(), element);
+        queue.pop();
+    }
+    EXPECT_TRUE(queue.empty());
+    EXPECT_NE(queue.tryAcquirePush(), nullptr);
+}
+
+TEST(SpscQueueTest, ProducerAndConsumerThreads)
+{
+    const int      num_values = 10000;
+    SpscQueue<int> queue(16);
+    std::thread    producer([&queue]() {
+        for (int i = 0; i < num_values; i++) {
+            int value = i;
+            while (!queue.tryPush(std::move(value))) {
+                std::this_thread::yield();
+            }
+        }
+    });
+
+    int  expected = 0;
+    int  value;
+    bool in_order = true;
+    while (expected < num_values) {
+        if (queue.tryPop(&value)) {
+            in_order &= value == expected;
+            expected++;
+        }
+        else {
+            std::this_thread::yield();
+        }
+    }
+    producer.join();
+    EXPECT_TRUE(in_order);
+    EXPECT_TRUE(queue.empty());
+}
+
+}  // end of namespace
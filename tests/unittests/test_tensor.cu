@@ -68,6 +68,23 @@ TEST(TensorMapTest, InsertDoesNotAllowDuplicatedKey) {
     delete[] v1;
 }
 
+TEST(TensorMapTest, InsertIfValidKeepsTheExistingTensor) {
+    int* v1 = new int[4]{1, 10, 20, 30};
+    Tensor t1 = Tensor(MEMORY_CPU, TYPE_INT32, {4}, v1);
+    Tensor t2 = Tensor(MEMORY_CPU, TYPE_INT32, {2}, v1);
+    TensorMap map({{"t1", t1}});
+    // neither a duplicated key nor a none tensor raises an error.
+    map.insertIfValid("t1", t2);
+    map.insertIfValid(tensor_keys::src_cache_indirection, Tensor(MEMORY_CPU, TYPE_INT32, {}, nullptr));
+    EXPECT_TRUE(map.size() == 1);
+    EXPECT_EQUAL_TENSORS(map.at("t1"), t1);
+    EXPECT_FALSE(map.isExist(tensor_keys::src_cache_indirection));
+    map.insertIfValid(tensor_keys::src_cache_indirection, t2);
+    EXPECT_TRUE(map.size() == 2);
+    EXPECT_EQUAL_TENSORS(map.at("src_cache_indirection"), t2);
+    delete[] v1;
+}
+
 TEST(TensorMapTest, GetValCorrectness) {
     int* v1 = new int[4]{1, 10, 20, 30};
     Tensor t1 = Tensor(MEMORY_CPU, TYPE_INT32, {4}, v1);
@@ -135,6 +152,76 @@ TEST(TensorMapTest, GetTensorCorrectnessAtConstTensorMap) {
     delete[] t1_val;
 }
 
+TEST(TensorMapTest, InternedKeysAndNamesFindTheSameTensor) {
+    int* v1 = new int[4]{1, 10, 20, 30};
+    Tensor t1 = Tensor(MEMORY_CPU, TYPE_INT32, {4}, v1);
+    Tensor t2 = Tensor(MEMORY_CPU, TYPE_INT32, {2}, v1);
+
+    TensorMap map;
+    map.insert(tensor_keys::logits, t1);
+    map.insert("custom_tensor", t2);
+    EXPECT_TRUE(map.isExist("logits"));
+    EXPECT_TRUE(map.isExist(std::string("logits")));
+    EXPECT_TRUE(map.isExist(TensorKey("custom_tensor")));
+    EXPECT_FALSE(map.isExist(tensor_keys::output_ids));
+    EXPECT_EQUAL_TENSORS(map.at("logits"), t1);
+    EXPECT_EQUAL_TENSORS(map.at(tensor_keys::logits), t1);
+    EXPECT_EQ(map.getValWithOffset<int>(TensorKey("custom_tensor"), 1), 10);
+    EXPECT_THROW(map.insert("logits", t2), std::runtime_error);
+    EXPECT_THROW(map.at(tensor_keys::output_ids), std::runtime_error);
+
+    // Iteration follows the insertion order, and keys convert back to names.
+    std::vector<std::string> keys;
+    for (auto& kv : map) {
+        keys.push_back(kv.first);
+    }
+    EXPECT_EQ(keys, std::vector<std::string>({"logits", "custom_tensor"}));
+    EXPECT_EQ(map.keys(), keys);
+    EXPECT_EQ(map.getMap().size(), 2u);
+    delete[] v1;
+}
+
+TEST(TensorKeyTest, OnlyStaticNamesAreInterned) {
+    TensorKey k1("a_tensor_name_longer_than_the_small_string_buffer");
+    TensorKey k2(std::string("a_tensor_name_longer_than_the_small_string_buffer"));
+    EXPECT_EQ(k1, k2);
+    EXPECT_FALSE(k1.isStatic());
+    EXPECT_NE(k1, TensorKey("another_tensor_name"));
+    EXPECT_TRUE(TensorKey("logits").isStatic());
+    EXPECT_EQ(TensorKey("logits"), tensor_keys::logits);
+    EXPECT_EQ(TensorKey("logits").c_str(), tensor_keys::logits.c_str());
+    EXPECT_NE(k1, tensor_keys::logits);
+    EXPECT_TRUE(tensor_keys::output_ids == "output_ids");
+
+    // A dynamic key owns its name, which outlives the string it was made from.
+    TensorKey k3 = [] {
+        std::string name = "a_temporary_tensor_name_longer_than_the_small_string_buffer";
+        return TensorKey(name);
+    }();
+    EXPECT_EQ(k3.str(), "a_temporary_tensor_name_longer_than_the_small_string_buffer");
+}
+
+TEST(TensorTest, ShapeIsStoredInline) {
+    TensorShape shape{1, 2, 3};
+    EXPECT_EQ(shape.size(), 3u);
+    EXPECT_EQ(shape.back(), 3u);
+    EXPECT_EQ(shape, TensorShape(std::vector<size_t>{1, 2, 3}));
+    EXPECT_EQ(std::vector<size_t>(shape), std::vector<size_t>({1, 2, 3}));
+    EXPECT_EQ(vec2str(shape), "(1, 2, 3)");
+
+    // More dimensions than the inline storage spill to the heap.
+    TensorShape large(std::vector<size_t>(TensorShape::kInlineDims + 2, 2));
+    large.push_back(7);
+    TensorShape copy = large;
+    EXPECT_EQ(copy.size(), TensorShape::kInlineDims + 3);
+    EXPECT_EQ(copy.back(), 7u);
+    EXPECT_NE(copy, shape);
+
+    Tensor t = Tensor{MEMORY_CPU, TYPE_INT32, {2, 3}, nullptr};
+    t.updateShape(0, 4);
+    EXPECT_EQ(t.shape, TensorShape({4, 3}));
+}
+
 TEST(TensorTest, EmptyTensorMinMaxRaiseError) {
     Tensor t1;
     EXPECT_THROW(t1.min<int>(), std::runtime_error);
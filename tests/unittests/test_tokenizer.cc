@@ -0,0 +1,322 @@
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "src/fastertransformer/utils/tokenizer.h"
+
+using namespace fastertransformer;
+
+namespace {
+
+// "\xc4\xa0" is "Ġ", the character of the space byte in the GPT-2 vocabulary.
+const std::string kSpace = "\xc4\xa0";
+// "\xe2\x96\x81" is "▁", the space of sentencepiece.
+const std::string kPiece = "\xe2\x96\x81";
+
+void writeFile(const std::string& path, const std::string& content)
+{
+    std::ofstream file(path, std::ios::out | std::ios::binary);
+    file << content;
+}
+
+bool isPrintable(int b)
+{
+    return (b >= '!' && b <= '~') || (b >= 0xA1 && b <= 0xAC) || (b >= 0xAE && b <= 0xFF);
+}
+
+// The character of a byte in the GPT-2 vocabulary, as a JSON string escaped like in the vocab.json of GPT-2.
+std::string getByteJson(int b)
+{
+    if (isPrintable(b) && b < 0x80) {
+        return b == '"' || b == '\\' ? std::string("\\") + (char)b : std::string(1, (char)b);
+    }
+    int character = b;
+    if (!isPrintable(b)) {
+        character = 256;
+        for (int c = 0; c < b; c++) {
+            character += !isPrintable(c);
+        }
+    }
+    char escaped[8];
+    snprintf(escaped, sizeof(escaped), "\\u%04x", character);
+    return escaped;
+}
+
+// Appends the protobuf encoding of the sentencepiece model fields.
+struct ProtoWriter {
+    std::string data;
+
+    void varint(uint64_t value)
+    {
+        do {
+            data.push_back((char)((value & 0x7F) | (value > 0x7F ? 0x80 : 0)));
+            value >>= 7;
+        } while (value);
+    }
+    void varintField(int field, uint64_t value)
+    {
+        varint(field << 3);
+        varint(value);
+    }
+    void bytesField(int field, const std::string& value)
+    {
+        varint((field << 3) | 2);
+        varint(value.size());
+        data += value;
+    }
+    void floatField(int field, float value)
+    {
+        varint((field << 3) | 5);
+        data.append((const char*)&value, 4);
+    }
+    void piece(const std::string& piece, float score, int type = 1)
+    {
+        ProtoWriter message;
+        message.bytesField(1, piece);
+        message.floatField(2, score);
+        if (type != 1) {
+            message.varintField(3, type);
+        }
+        bytesField(1, message.data);
+    }
+};
+
+class TokenizerTest: public testing::Test {
+protected:
+    void SetUp() override
+    {
+        char dir[] = "/tmp/test_tokenizer_XXXXXX";
+        ASSERT_NE(mkdtemp(dir), nullptr);
+        dir_ = dir;
+    }
+    void TearDown() override
+    {
+        for (const char* name : {"vocab.json", "merges.txt", "tokenizer.model"}) {
+            std::remove((dir_ + "/" + name).c_str());
+        }
+        rmdir(dir_.c_str());
+    }
+
+    // Bytes are the tokens 0 to 255, then come the merges, then <|endoftext|>.
+    std::shared_ptr<Tokenizer> loadGpt2()
+    {
+        const std::vector<std::pair<std::string, std::string>> merges = {{"l", "l"},
+                                                                         {"e", "ll"},
+                                                                         {"h", "ell"},
+                                                                         {"hell", "o"},
+                                                                         {kSpace, "t"},
+                                                                         {"h", "e"},
+                                                                         {kSpace + "t", "he"},
+                                                                         {kSpace, kSpace},
+                                                                         {"'", "s"}};
+        std::string vocab = "{";
+        for (int b = 0; b < 256; b++) {
+            vocab += "\"" + getByteJson(b) + "\": " + std::to_string(b) + ", ";
+        }
+        std::string merges_txt = "#version: 0.2\n";
+        for (size_t i = 0; i < merges.size(); i++) {
+            // The merged tokens only use ASCII and "Ġ", which JSON takes as is.
+            vocab += "\"" + merges[i].first + merges[i].second + "\": " + std::to_string(256 + i) + ", ";
+            merges_txt += merges[i].first + " " + merges[i].second + "\n";
+        }
+        vocab += "\"<|endoftext|>\": " + std::to_string(256 + merges.size()) + "}";
+        writeFile(dir_ + "/vocab.json", vocab);
+        writeFile(dir_ + "/merges.txt", merges_txt);
+        return Tokenizer::loadFromDirectory(dir_);
+    }
+
+    std::shared_ptr<Tokenizer> loadSentencePiece(int model_type)
+    {
+        ProtoWriter model;
+        model.piece("<unk>", 0.0f, 2);
+        model.piece("<s>", 0.0f, 3);
+        model.piece("</s>", 0.0f, 3);
+        if (model_type == 2) {
+            // BPE: the higher the score, the earlier the merge.
+            for (const char* c : {"h", "e", "l", "o", "w", "r", "d"}) {
+                model.piece(c, -10.0f);
+            }
+            model.piece(kPiece, -10.0f);
+            model.piece("ll", -1.0f);
+            model.piece("he", -2.0f);
+            model.piece("hell", -3.0f);
+            model.piece("hello", -4.0f);
+            model.piece(kPiece + "hello", -5.0f);
+            model.piece("wo", -6.0f);
+            model.piece(kPiece + "w", -7.0f);
+            for (int b = 0; b < 256; b++) {
+                char piece[8];
+                snprintf(piece, sizeof(piece), "<0x%02X>", b);
+                model.piece(piece, 0.0f, 6);
+            }
+        }
+        else {
+            // Unigram: the scores are log probabilities.
+            for (const char* c : {"h", "e", "l", "o"}) {
+                model.piece(c, -5.0f);
+            }
+            model.piece(kPiece, -2.0f);
+            model.piece(kPiece + "hello", -1.0f);
+            model.piece("hello", -3.0f);
+            model.piece(kPiece + "he", -2.0f);
+            model.piece("llo", -2.0f);
+        }
+        ProtoWriter trainer_spec;
+        trainer_spec.varintField(3, model_type);
+        trainer_spec.varintField(35, model_type == 2);
+        model.bytesField(2, trainer_spec.data);
+
+        writeFile(dir_ + "/tokenizer.model", model.data);
+        return Tokenizer::loadFromDirectory(dir_);
+    }
+
+    std::string dir_;
+};
+
+TEST_F(TokenizerTest, MissingFilesGiveNoTokenizer)
+{
+    EXPECT_EQ(Tokenizer::loadFromDirectory(dir_), nullptr);
+}
+
+TEST_F(TokenizerTest, Gpt2MergesInRankOrderWithinWords)
+{
+    std::shared_ptr<Tokenizer> tokenizer = loadGpt2();
+    ASSERT_NE(tokenizer, nullptr);
+    EXPECT_EQ(tokenizer->getType(), TokenizerType::GPT2_BPE);
+    EXPECT_EQ(tokenizer->getVocabSize(), 266u);
+
+    const int hello = tokenizer->tokenToId("hello");
+    const int the   = tokenizer->tokenToId(kSpace + "the");
+    const int eot   = tokenizer->tokenToId("<|endoftext|>");
+    ASSERT_EQ(hello, 259);
+    ASSERT_EQ(the, 262);
+    EXPECT_EQ(tokenizer->getTokenBytes(the), " the");
+
+    EXPECT_EQ(tokenizer->encode("hello the"), std::vector<int>({hello, the}));
+    EXPECT_EQ(tokenizer->encode("hello<|endoftext|> the"), std::vector<int>({hello, eot, the}));
+    // The text is split in words before the merges, so "x hello" is "x" and " hello", whose "Ġ" is not merged.
+    EXPECT_EQ(tokenizer->encode("x hello"), std::vector<int>({'x', ' ', hello}));
+    EXPECT_EQ(tokenizer->encode("the"), std::vector<int>({'t', tokenizer->tokenToId("he")}));
+    // Spaces before a word: the last one goes with the word.
+    EXPECT_EQ(tokenizer->encode("a   b"), std::vector<int>({'a', tokenizer->tokenToId(kSpace + kSpace), ' ', 'b'}));
+    EXPECT_EQ(tokenizer->encode("it's"), std::vector<int>({'i', 't', tokenizer->tokenToId("'s")}));
+    EXPECT_EQ(tokenizer->encode("h\xc3\xa9llo"), std::vector<int>({'h', 0xC3, 0xA9, tokenizer->tokenToId("ll"), 'o'}));
+}
+
+TEST_F(TokenizerTest, Gpt2DecodesAnyText)
+{
+    std::shared_ptr<Tokenizer> tokenizer = loadGpt2();
+    ASSERT_NE(tokenizer, nullptr);
+    const std::vector<std::string> texts = {"hello the world",
+                                            "  leading and trailing spaces  ",
+                                            "it's 2023!!\n\nnew\tline",
+                                            "caf\xc3\xa9 \xe6\x97\xa5\xe6\x9c\xac \xf0\x9f\x98\x80 \xe2\x80\x94 end",
+                                            "<|endoftext|>hello<|endoftext|>",
+                                            ""};
+    for (const std::string& text : texts) {
+        EXPECT_EQ(tokenizer->decode(tokenizer->encode(text)), text);
+    }
+}
+
+TEST_F(TokenizerTest, BatchEncodingMatchesEncoding)
+{
+    std::shared_ptr<Tokenizer> tokenizer = loadGpt2();
+    ASSERT_NE(tokenizer, nullptr);
+    std::vector<std::string> texts;
+    for (int i = 0; i < 200; i++) {
+        std::string text;
+        for (int j = 0; j <= i % 17; j++) {
+            text += j % 3 ? " hello" : " the caf\xc3\xa9";
+            text += std::to_string(i * j);
+        }
+        texts.push_back(text);
+    }
+    const std::vector<std::vector<int>> ids = tokenizer->encodeBatch(texts, 4);
+    ASSERT_EQ(ids.size(), texts.size());
+    for (size_t i = 0; i < texts.size(); i++) {
+        EXPECT_EQ(ids[i], tokenizer->encode(texts[i]));
+    }
+    EXPECT_TRUE(tokenizer->encodeBatch({}).empty());
+}
+
+TEST_F(TokenizerTest, IncrementalDetokenizerHoldsIncompleteCharacters)
+{
+    std::shared_ptr<Tokenizer> tokenizer = loadGpt2();
+    ASSERT_NE(tokenizer, nullptr);
+    const std::string      text = "h\xc3\xa9llo \xf0\x9f\x98\x80!";
+    const std::vector<int> ids  = tokenizer->encode(text);
+
+    IncrementalDetokenizer detokenizer(*tokenizer);
+    EXPECT_EQ(detokenizer.push(ids[0]), "h");
+    EXPECT_EQ(detokenizer.push(0xC3), "");  // the first byte of "é"
+    EXPECT_EQ(detokenizer.push(0xA9), "\xc3\xa9");
+
+    std::string streamed = "h\xc3\xa9";
+    for (size_t i = 3; i < ids.size(); i++) {
+        streamed += detokenizer.push(ids[i]);
+    }
+    streamed += detokenizer.finish();
+    EXPECT_EQ(streamed, text);
+
+    EXPECT_EQ(detokenizer.push(0xF0), "");
+    EXPECT_EQ(detokenizer.push(0x9F), "");
+    EXPECT_EQ(detokenizer.push(0x98), "");
+    EXPECT_EQ(detokenizer.push(0x80), "\xf0\x9f\x98\x80");
+    // An incomplete character at the end is given by finish.
+    EXPECT_EQ(detokenizer.push(0xF0), "");
+    EXPECT_EQ(detokenizer.finish(), "\xf0");
+}
+
+TEST_F(TokenizerTest, SentencePieceBpeMergesByScore)
+{
+    std::shared_ptr<Tokenizer> tokenizer = loadSentencePiece(2);
+    ASSERT_NE(tokenizer, nullptr);
+    EXPECT_EQ(tokenizer->getType(), TokenizerType::SENTENCEPIECE_BPE);
+    EXPECT_TRUE(tokenizer->hasDummyPrefix());
+
+    auto id = [&](const std::string& piece) { return tokenizer->tokenToId(piece); };
+    // "▁w" would be merged before "w o" if "wo" did not have a better score.
+    const std::vector<int> expected = {id(kPiece + "hello"), id(kPiece), id("wo"), id("r"), id("l"), id("d")};
+    EXPECT_EQ(tokenizer->encode("hello world"), expected);
+    // The extra whitespaces are removed by default.
+    EXPECT_EQ(tokenizer->encode("  hello   world "), expected);
+    EXPECT_EQ(tokenizer->decode(expected), "hello world");
+
+    // Characters out of the vocabulary fall back to their bytes.
+    const std::vector<int> ids = tokenizer->encode("h\xc3\xa9");
+    EXPECT_EQ(ids, std::vector<int>({id(kPiece), id("h"), id("<0xC3>"), id("<0xA9>")}));
+    EXPECT_EQ(tokenizer->decode(ids), "h\xc3\xa9");
+
+    // Control tokens decode to nothing, and the dummy prefix is removed at the start of the stream only.
+    IncrementalDetokenizer detokenizer(*tokenizer);
+    EXPECT_EQ(detokenizer.push(id("<s>")), "");
+    EXPECT_EQ(detokenizer.push(id(kPiece + "hello")), "hello");
+    EXPECT_EQ(detokenizer.push(id(kPiece)), " ");
+    EXPECT_EQ(detokenizer.push(id("<0xC3>")), "");
+    EXPECT_EQ(detokenizer.push(id("<0xA9>")), "\xc3\xa9");
+    EXPECT_EQ(detokenizer.finish(), "");
+
+    IncrementalDetokenizer continuation(*tokenizer, true);
+    EXPECT_EQ(continuation.push(id(kPiece + "hello")), " hello");
+}
+
+TEST_F(TokenizerTest, SentencePieceUnigramFindsTheBestSegmentation)
+{
+    std::shared_ptr<Tokenizer> tokenizer = loadSentencePiece(1);
+    ASSERT_NE(tokenizer, nullptr);
+    EXPECT_EQ(tokenizer->getType(), TokenizerType::SENTENCEPIECE_UNIGRAM);
+
+    auto id = [&](const std::string& piece) { return tokenizer->tokenToId(piece); };
+    EXPECT_EQ(tokenizer->encode("hello"), std::vector<int>({id(kPiece + "hello")}));
+    EXPECT_EQ(tokenizer->encode("hello hello"), std::vector<int>({id(kPiece + "hello"), id(kPiece + "hello")}));
+    // Consecutive unknown characters are one unknown token.
+    EXPECT_EQ(tokenizer->encode("hexxo"), std::vector<int>({id(kPiece + "he"), id("<unk>"), id("o")}));
+    EXPECT_EQ(tokenizer->encode(""), std::vector<int>());
+}
+
+}  // end of namespace
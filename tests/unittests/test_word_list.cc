@@ -0,0 +1,129 @@
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "src/fastertransformer/utils/word_list.h"
+
+using namespace fastertransformer;
+
+namespace {
+
+// The [2, words_len] layout of the stop_words_list and bad_words_list tensors, padded to words_len.
+std::vector<int> makeWordList(const std::vector<std::vector<int>>& words, size_t words_len)
+{
+    std::vector<int> list(2 * words_len, -1);
+    int              offset = 0;
+    for (size_t i = 0; i < words.size(); i++) {
+        std::copy(words[i].begin(), words[i].end(), list.begin() + offset);
+        offset += words[i].size();
+        list[words_len + i] = offset;
+    }
+    return list;
+}
+
+bool endsWith(const std::vector<int>& tokens, size_t length, const std::vector<int>& word)
+{
+    return length >= word.size() && std::equal(word.begin(), word.end(), tokens.begin() + length - word.size());
+}
+
+TEST(WordListMatcherTest, FindsOverlappingWords)
+{
+    // "he", "she", "his", "hers" with h=1 e=2 s=3 i=4 r=5, and the single token 9
+    const std::vector<int> list = makeWordList({{1, 2}, {3, 1, 2}, {1, 4, 3}, {1, 2, 5, 3}, {9}}, 16);
+    WordListMatcher        matcher(list.data(), 16);
+    EXPECT_EQ(matcher.getMaxWordLength(), 4u);
+    EXPECT_EQ(matcher.getSingleTokenWords(), std::vector<int>({9}));
+
+    // "ushers"
+    const int  tokens[]  = {7, 3, 1, 2, 5, 3};
+    const bool matches[] = {false, false, false, true, false, true};
+    int        state     = WordListMatcher::kStartState;
+    for (int i = 0; i < 6; i++) {
+        state = matcher.advance(state, tokens[i]);
+        EXPECT_EQ(matcher.isMatch(state), matches[i]) << "token " << i;
+    }
+
+    // After "sh", "e" ends "she" and "he", "i" would not end "his" yet.
+    size_t     num_ends;
+    const int* ends = matcher.getNextWordEnds(WordListMatcher::kStartState, &num_ends);
+    EXPECT_EQ(num_ends, 0u);
+    const int sh[] = {3, 1};
+    ends           = matcher.getNextWordEnds(matcher.advance(WordListMatcher::kStartState, sh, 2), &num_ends);
+    EXPECT_EQ(std::vector<int>(ends, ends + num_ends), std::vector<int>({2}));
+    const int hi[] = {1, 4};
+    ends           = matcher.getNextWordEnds(matcher.advance(WordListMatcher::kStartState, hi, 2), &num_ends);
+    EXPECT_EQ(std::vector<int>(ends, ends + num_ends), std::vector<int>({3}));
+}
+
+TEST(WordListMatcherTest, EmptyListMatchesNothing)
+{
+    const std::vector<int> list = makeWordList({}, 4);
+    for (const WordListMatcher& matcher : {WordListMatcher(), WordListMatcher(list.data(), 4)}) {
+        EXPECT_TRUE(matcher.empty());
+        EXPECT_EQ(matcher.advance(WordListMatcher::kStartState, 3), WordListMatcher::kStartState);
+        EXPECT_FALSE(matcher.isMatch(WordListMatcher::kStartState));
+        size_t num_ends;
+        matcher.getNextWordEnds(WordListMatcher::kStartState, &num_ends);
+        EXPECT_EQ(num_ends, 0u);
+    }
+}
+
+TEST(WordListMatcherTest, MatchesTheLinearScan)
+{
+    std::mt19937 gen(3);
+    for (int trial = 0; trial < 50; trial++) {
+        // A small alphabet, so that the words overlap often.
+        const int                     num_tokens = 2 + trial % 5;
+        std::vector<std::vector<int>> words(1 + gen() % 40);
+        size_t                        words_len = 0;
+        for (std::vector<int>& word : words) {
+            word.resize(1 + gen() % 5);
+            for (int& token : word) {
+                token = gen() % num_tokens;
+            }
+            words_len += word.size();
+        }
+        if (trial % 2 == 0) {
+            auto is_single_token = [](const std::vector<int>& word) { return word.size() == 1; };
+            words.erase(std::remove_if(words.begin(), words.end(), is_single_token), words.end());
+        }
+        const std::vector<int> list = makeWordList(words, words_len + 3);
+        WordListMatcher        matcher(list.data(), words_len + 3);
+
+        std::vector<int> sequence(200);
+        for (int& token : sequence) {
+            token = gen() % (num_tokens + 1);
+        }
+        int state = WordListMatcher::kStartState;
+        for (size_t length = 0; length <= sequence.size(); length++) {
+            bool             is_match = false;
+            std::vector<int> expected_ends;
+            for (const std::vector<int>& word : words) {
+                is_match |= endsWith(sequence, length, word);
+                const std::vector<int> prefix(word.begin(), word.end() - 1);
+                if (word.size() > 1 && endsWith(sequence, length, prefix)) {
+                    expected_ends.push_back(word.back());
+                }
+            }
+            std::sort(expected_ends.begin(), expected_ends.end());
+            expected_ends.erase(std::unique(expected_ends.begin(), expected_ends.end()), expected_ends.end());
+
+            size_t     num_ends;
+            const int* ends = matcher.getNextWordEnds(state, &num_ends);
+            ASSERT_EQ(matcher.isMatch(state), is_match) << "trial " << trial << " length " << length;
+            ASSERT_EQ(std::vector<int>(ends, ends + num_ends), expected_ends)
+                << "trial " << trial << " length " << length;
+
+            // Replaying the last tokens gives the same state.
+            const size_t replay = std::min(length, matcher.getMaxWordLength());
+            ASSERT_EQ(matcher.advance(WordListMatcher::kStartState, sequence.data() + length - replay, replay), state);
+            if (length < sequence.size()) {
+                state = matcher.advance(state, sequence[length]);
+            }
+        }
+    }
+}
+
+}  // end of namespace
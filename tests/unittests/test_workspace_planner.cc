@@ -0,0 +1,87 @@
+#include <random>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "src/fastertransformer/utils/workspace_planner.h"
+
+using namespace fastertransformer;
+
+namespace {
+
+void checkPlan(const WorkspacePlan& plan)
+{
+    for (size_t i = 0; i < plan.buffers.size(); i++) {
+        EXPECT_LE(plan.offsets[i] + plan.buffers[i].size, plan.arena_size);
+        for (size_t j = i + 1; j < plan.buffers.size(); j++) {
+            if (plan.buffers[i].overlaps(plan.buffers[j])) {
+                const bool disjoint = plan.offsets[i] + plan.buffers[i].size <= plan.offsets[j]
+                                      || plan.offsets[j] + plan.buffers[j].size <= plan.offsets[i];
+                EXPECT_TRUE(disjoint) << plan.buffers[i].name << " and " << plan.buffers[j].name << " collide";
+            }
+        }
+    }
+    EXPECT_GE(plan.arena_size, plan.max_live_size);
+    EXPECT_LE(plan.arena_size, plan.total_size);
+}
+
+TEST(WorkspacePlannerTest, LayerScratchBuffersShareMemory)
+{
+    WorkspacePlanner planner(256);
+    // A context decoder: attention then ffn, with the hidden states passed from one to the other.
+    planner.addBuffer("qkv_buf", 3000, 0, 0);
+    planner.addBuffer("qk_buf", 8000, 0, 0);
+    planner.addBuffer("attn_out", 1000, 0, 1);
+    planner.addBuffer("inter_buf", 4000, 1, 1);
+    planner.addBuffer("ffn_out", 1000, 1, 2);
+    planner.addBuffer("logits", 5000, 2, 2);
+
+    WorkspacePlan plan = planner.plan();
+    checkPlan(plan);
+    EXPECT_EQ(plan.buffers[0].size, 3072u);  // rounded up to the alignment
+    for (size_t offset : plan.offsets) {
+        EXPECT_EQ(offset % 256, 0u);
+    }
+    EXPECT_EQ(plan.total_size, 3072u + 8192 + 1024 + 4096 + 1024 + 5120);
+    EXPECT_EQ(plan.max_live_size, 3072u + 8192 + 1024);
+    EXPECT_EQ(plan.arena_size, plan.max_live_size);
+    EXPECT_EQ(plan.offsets[plan.find("inter_buf")], 0u);  // reuses the memory of qk_buf
+    EXPECT_EQ(plan.find("unknown"), -1);
+
+    std::vector<char> arena(plan.arena_size);
+    EXPECT_EQ(plan.getBuffer<char>(arena.data(), "attn_out"), arena.data() + plan.offsets[2]);
+    EXPECT_THROW(plan.getBuffer<char>(arena.data(), "unknown"), std::runtime_error);
+    EXPECT_THROW(planner.addBuffer("bad", 1, 2, 1), std::runtime_error);
+}
+
+TEST(WorkspacePlannerTest, ReusesTheSlotsOfDeadBuffers)
+{
+    WorkspacePlanner planner(1);
+    planner.addBuffer("a", 100, 0, 2);
+    planner.addBuffer("b", 40, 0, 0);  // dead from step 1, its slot is free for d
+    planner.addBuffer("c", 90, 0, 2);
+    planner.addBuffer("d", 30, 1, 2);
+
+    WorkspacePlan plan = planner.plan();
+    checkPlan(plan);
+    EXPECT_EQ(plan.offsets[plan.find("d")], plan.offsets[plan.find("b")]);
+    EXPECT_EQ(plan.arena_size, 230u);
+}
+
+TEST(WorkspacePlannerTest, RandomPlansAreValid)
+{
+    std::mt19937 rng(1234);
+    for (int trial = 0; trial < 20; trial++) {
+        WorkspacePlanner planner(64);
+        for (int i = 0; i < 50; i++) {
+            const int first_use = rng() % 20;
+            planner.addBuffer(std::to_string(i), 1 + rng() % 10000, first_use, first_use + rng() % 5);
+        }
+        WorkspacePlan plan = planner.plan();
+        checkPlan(plan);
+        EXPECT_LT(plan.arena_size, plan.total_size);
+    }
+}
+
+}  // end of namespace